@@ -0,0 +1,511 @@
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include "alloc.h"
+#include "betree.h"
+
+/*
+ * Macro benchmark over a synthetic corpus: campaigns target an exchange, then add a few conditions
+ * over demographics, segments and tags. Events carry every attribute, the lists are the longest part.
+ * Everything is drawn from one seeded generator so two runs with the same options see the same
+ * corpus and events. Results are printed one "name value" per line, and checked against a baseline
+ * written the same way when one is given
+ */
+
+#define COUNTRY_COUNT 64
+#define DEVICE_COUNT 4
+#define EXCHANGE_COUNT 32
+#define TAG_COUNT 256
+#define MEMBER_MAX 100000
+// Most segment ids come from a popular range so that member_of conditions hit now and then
+#define MEMBER_POPULAR 1000
+#define EXPR_SIZE 4096
+#define EVENT_SIZE 8192
+#define WARMUP_EVENTS 1000
+
+struct options {
+    size_t sub_count;
+    size_t event_count;
+    // Elements in the event lists and in the sub lists
+    size_t event_list_size;
+    size_t sub_list_size;
+    // Width of the age ranges, narrower ones match less
+    size_t age_width;
+    uint64_t seed;
+    const char* baseline;
+    double tolerance;
+};
+
+enum metric_kind {
+    // Must match the baseline, the workload or its results changed otherwise
+    METRIC_EXACT,
+    METRIC_HIGHER_BETTER,
+    METRIC_LOWER_BETTER,
+    // Printed only, too noisy or too host-dependent to gate on
+    METRIC_INFO,
+};
+
+struct metric {
+    const char* name;
+    enum metric_kind kind;
+    double value;
+};
+
+#define METRIC_MAX 32
+
+struct metrics {
+    size_t count;
+    struct metric metrics[METRIC_MAX];
+};
+
+static void add_metric(struct metrics* metrics, const char* name, enum metric_kind kind, double value)
+{
+    if(metrics->count == METRIC_MAX) {
+        fprintf(stderr, "%s too many metrics\n", __func__);
+        abort();
+    }
+    struct metric* metric = &metrics->metrics[metrics->count++];
+    metric->name = name;
+    metric->kind = kind;
+    metric->value = value;
+}
+
+static uint64_t random_state;
+
+static uint64_t next_random()
+{
+    // splitmix64, the same on every platform
+    uint64_t z = (random_state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static size_t random_below(size_t n)
+{
+    return (size_t)(next_random() % n);
+}
+
+static bool random_chance(size_t percent)
+{
+    return random_below(100) < percent;
+}
+
+static int64_t random_member()
+{
+    return (int64_t)(random_chance(50) ? random_below(MEMBER_POPULAR) : random_below(MEMBER_MAX));
+}
+
+static uint64_t now_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static size_t heap_in_use()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+static void add_variables(struct betree* tree)
+{
+    betree_add_integer_variable(tree, "exchange", false, 0, EXCHANGE_COUNT - 1);
+    betree_add_integer_variable(tree, "age", false, 0, 100);
+    betree_add_integer_variable(tree, "hour", false, 0, 23);
+    betree_add_string_variable(tree, "country", false, COUNTRY_COUNT);
+    betree_add_string_variable(tree, "device", false, DEVICE_COUNT);
+    betree_add_boolean_variable(tree, "private", false);
+    betree_add_float_variable(tree, "price", false, 0., 100.);
+    betree_add_integer_list_variable(tree, "member_of", true, 0, MEMBER_MAX);
+    betree_add_string_list_variable(tree, "tags", true, TAG_COUNT);
+}
+
+static size_t append(char* buffer, size_t length, const char* text)
+{
+    size_t size = strlen(text);
+    if(length + size >= EXPR_SIZE) {
+        fprintf(stderr, "%s expression too long\n", __func__);
+        abort();
+    }
+    memcpy(buffer + length, text, size + 1);
+    return length + size;
+}
+
+static size_t append_condition(char* expr, size_t length, size_t condition, const struct options* options)
+{
+    char part[EXPR_SIZE];
+    size_t used = 0;
+    switch(condition) {
+        case 0: {
+            size_t low = random_below(101 - options->age_width);
+            used = snprintf(part, sizeof(part), "age >= %zu and age <= %zu", low, low + options->age_width);
+            break;
+        }
+        case 1: {
+            used = snprintf(part, sizeof(part), "country in (");
+            size_t count = 1 + random_below(4);
+            for(size_t i = 0; i < count; i++) {
+                used += snprintf(part + used, sizeof(part) - used, "%s\"c%zu\"", i == 0 ? "" : ", ",
+                    random_below(COUNTRY_COUNT));
+            }
+            snprintf(part + used, sizeof(part) - used, ")");
+            break;
+        }
+        case 2:
+            snprintf(part, sizeof(part), "device = \"d%zu\"", random_below(DEVICE_COUNT));
+            break;
+        case 3: {
+            used = snprintf(part, sizeof(part), "member_of one of (");
+            for(size_t i = 0; i < options->sub_list_size; i++) {
+                used += snprintf(
+                    part + used, sizeof(part) - used, "%s%" PRId64, i == 0 ? "" : ", ", random_member());
+            }
+            snprintf(part + used, sizeof(part) - used, ")");
+            break;
+        }
+        case 4: {
+            size_t low = random_below(20);
+            snprintf(part, sizeof(part), "hour in (%zu, %zu, %zu, %zu)", low, low + 1, low + 2, low + 3);
+            break;
+        }
+        case 5:
+            snprintf(part, sizeof(part), "not private");
+            break;
+        case 6:
+            snprintf(part, sizeof(part), "price > %zu.5", random_below(100));
+            break;
+        case 7:
+            snprintf(part, sizeof(part), "tags none of (\"t%zu\", \"t%zu\")", random_below(TAG_COUNT),
+                random_below(TAG_COUNT));
+            break;
+        default: abort();
+    }
+    length = append(expr, length, " and ");
+    return append(expr, length, part);
+}
+
+static void make_expr(char* expr, const struct options* options)
+{
+    size_t length = 0;
+    if(random_chance(30)) {
+        size_t first = random_below(EXCHANGE_COUNT - 2);
+        length = snprintf(expr, EXPR_SIZE, "exchange in (%zu, %zu, %zu)", first, first + 1, first + 2);
+    }
+    else {
+        length = snprintf(expr, EXPR_SIZE, "exchange = %zu", random_below(EXCHANGE_COUNT));
+    }
+    size_t condition_count = 2 + random_below(3);
+    bool used[8] = { false };
+    for(size_t i = 0; i < condition_count; i++) {
+        size_t condition = random_below(8);
+        if(!used[condition]) {
+            used[condition] = true;
+            length = append_condition(expr, length, condition, options);
+        }
+    }
+}
+
+static void make_event(char* event, const struct options* options)
+{
+    size_t used = snprintf(event, EVENT_SIZE,
+        "{\"exchange\": %zu, \"age\": %zu, \"hour\": %zu, \"country\": \"c%zu\", \"device\": \"d%zu\", "
+        "\"private\": %s, \"price\": %zu.25",
+        random_below(EXCHANGE_COUNT), random_below(101), random_below(24), random_below(COUNTRY_COUNT),
+        random_below(DEVICE_COUNT), random_chance(20) ? "true" : "false", random_below(100));
+    // Lists are left out now and then, their short circuits get exercised
+    if(random_chance(90)) {
+        used += snprintf(event + used, EVENT_SIZE - used, ", \"member_of\": [");
+        for(size_t i = 0; i < options->event_list_size; i++) {
+            used += snprintf(
+                event + used, EVENT_SIZE - used, "%s%" PRId64, i == 0 ? "" : ", ", random_member());
+        }
+        used += snprintf(event + used, EVENT_SIZE - used, "]");
+    }
+    if(random_chance(90)) {
+        used += snprintf(event + used, EVENT_SIZE - used, ", \"tags\": [");
+        for(size_t i = 0; i < 8; i++) {
+            used += snprintf(
+                event + used, EVENT_SIZE - used, "%s\"t%zu\"", i == 0 ? "" : ", ", random_below(TAG_COUNT));
+        }
+        used += snprintf(event + used, EVENT_SIZE - used, "]");
+    }
+    if(used + 2 > EVENT_SIZE) {
+        fprintf(stderr, "%s event too long\n", __func__);
+        abort();
+    }
+    snprintf(event + used, EVENT_SIZE - used, "}");
+}
+
+static int compare_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(const uint64_t* sorted, size_t count, double p)
+{
+    size_t rank = (size_t)ceil(p * (double)count);
+    return (double)sorted[rank == 0 ? 0 : rank - 1];
+}
+
+static void run(const struct options* options, struct metrics* metrics)
+{
+    random_state = options->seed;
+    char** exprs = malloc(options->sub_count * sizeof(*exprs));
+    betree_sub_t* ids = malloc(options->sub_count * sizeof(*ids));
+    char** events = malloc(options->event_count * sizeof(*events));
+    uint64_t* latencies = malloc(options->event_count * sizeof(*latencies));
+    if(exprs == NULL || ids == NULL || events == NULL || latencies == NULL) {
+        fprintf(stderr, "%s malloc failed\n", __func__);
+        abort();
+    }
+    for(size_t i = 0; i < options->sub_count; i++) {
+        exprs[i] = malloc(EXPR_SIZE);
+        if(exprs[i] == NULL) {
+            fprintf(stderr, "%s malloc failed\n", __func__);
+            abort();
+        }
+        make_expr(exprs[i], options);
+        ids[i] = i;
+    }
+    for(size_t i = 0; i < options->event_count; i++) {
+        events[i] = malloc(EVENT_SIZE);
+        if(events[i] == NULL) {
+            fprintf(stderr, "%s malloc failed\n", __func__);
+            abort();
+        }
+        make_event(events[i], options);
+    }
+
+    // One insert at a time, the tree the searches run on
+    size_t heap_before = heap_in_use();
+    struct betree* tree = betree_make();
+    add_variables(tree);
+    uint64_t start = now_ns();
+    for(size_t i = 0; i < options->sub_count; i++) {
+        if(!betree_insert(tree, ids[i], exprs[i])) {
+            fprintf(stderr, "Can't insert %s\n", exprs[i]);
+            abort();
+        }
+    }
+    uint64_t insert_ns = now_ns() - start;
+    betree_pack(tree);
+    size_t heap_after = heap_in_use();
+
+    struct betree* bulk = betree_make();
+    add_variables(bulk);
+    start = now_ns();
+    if(!betree_insert_all(bulk, options->sub_count, ids, (const char**)exprs)) {
+        fprintf(stderr, "Can't bulk insert\n");
+        abort();
+    }
+    uint64_t bulk_ns = now_ns() - start;
+    betree_free(bulk);
+
+    struct betree_search_context* context = betree_make_search_context(tree);
+    struct report* report = make_report();
+    for(size_t i = 0; i < options->event_count && i < WARMUP_EVENTS; i++) {
+        betree_report_reset(report);
+        betree_search_with_context(tree, events[i], report, context);
+    }
+    uint64_t matches = 0, evaluated = 0;
+    uint64_t allocations = betree_allocation_count();
+    start = now_ns();
+    for(size_t i = 0; i < options->event_count; i++) {
+        uint64_t event_start = now_ns();
+        betree_report_reset(report);
+        if(!betree_search_with_context(tree, events[i], report, context)) {
+            fprintf(stderr, "Can't search %s\n", events[i]);
+            abort();
+        }
+        latencies[i] = now_ns() - event_start;
+        matches += report->matched;
+        evaluated += report->evaluated;
+    }
+    uint64_t search_ns = now_ns() - start;
+    allocations = betree_allocation_count() - allocations;
+    qsort(latencies, options->event_count, sizeof(*latencies), compare_u64);
+
+    double subs = (double)options->sub_count;
+    double event_count = (double)options->event_count;
+    add_metric(metrics, "subs", METRIC_EXACT, subs);
+    add_metric(metrics, "events", METRIC_EXACT, event_count);
+    add_metric(metrics, "seed", METRIC_EXACT, (double)options->seed);
+    add_metric(metrics, "matches", METRIC_EXACT, (double)matches);
+    add_metric(metrics, "evaluated_per_search", METRIC_LOWER_BETTER, (double)evaluated / event_count);
+    add_metric(metrics, "insert_subs_per_sec", METRIC_HIGHER_BETTER, subs * 1e9 / (double)insert_ns);
+    add_metric(metrics, "bulk_insert_subs_per_sec", METRIC_HIGHER_BETTER, subs * 1e9 / (double)bulk_ns);
+    add_metric(metrics, "searches_per_sec", METRIC_HIGHER_BETTER, event_count * 1e9 / (double)search_ns);
+    add_metric(metrics, "search_p50_ns", METRIC_LOWER_BETTER, percentile(latencies, options->event_count, 0.5));
+    add_metric(metrics, "search_p99_ns", METRIC_LOWER_BETTER, percentile(latencies, options->event_count, 0.99));
+    add_metric(metrics, "search_p999_ns", METRIC_INFO, percentile(latencies, options->event_count, 0.999));
+    add_metric(metrics, "search_max_ns", METRIC_INFO, (double)latencies[options->event_count - 1]);
+    add_metric(metrics, "bytes_per_sub", METRIC_LOWER_BETTER,
+        heap_after > heap_before ? (double)(heap_after - heap_before) / subs : 0.);
+    add_metric(metrics, "allocations_per_search", METRIC_LOWER_BETTER, (double)allocations / event_count);
+
+    free_report(report);
+    betree_free_search_context(context);
+    betree_free(tree);
+    for(size_t i = 0; i < options->sub_count; i++) {
+        free(exprs[i]);
+    }
+    for(size_t i = 0; i < options->event_count; i++) {
+        free(events[i]);
+    }
+    free(exprs);
+    free(ids);
+    free(events);
+    free(latencies);
+}
+
+static const struct metric* find_metric(const struct metrics* metrics, const char* name)
+{
+    for(size_t i = 0; i < metrics->count; i++) {
+        if(strcmp(metrics->metrics[i].name, name) == 0) {
+            return &metrics->metrics[i];
+        }
+    }
+    return NULL;
+}
+
+// Number of metrics worse than the baseline by more than the tolerance, -1 when it can't be read
+static int compare_baseline(const struct metrics* metrics, const char* path, double tolerance)
+{
+    FILE* file = fopen(path, "r");
+    if(file == NULL) {
+        fprintf(stderr, "Can't open the baseline %s\n", path);
+        return -1;
+    }
+    int regressions = 0;
+    char line[256];
+    while(fgets(line, sizeof(line), file) != NULL) {
+        char name[128];
+        double expected;
+        if(line[0] == '#' || sscanf(line, "%127s %lf", name, &expected) != 2) {
+            continue;
+        }
+        const struct metric* metric = find_metric(metrics, name);
+        if(metric == NULL) {
+            continue;
+        }
+        bool regressed = false;
+        switch(metric->kind) {
+            case METRIC_EXACT:
+                regressed = fabs(metric->value - expected) > 0.5;
+                break;
+            case METRIC_HIGHER_BETTER:
+                regressed = metric->value < expected * (1. - tolerance);
+                break;
+            case METRIC_LOWER_BETTER:
+                // Counts that were 0 stay 0, anything else gets the tolerance
+                regressed = metric->value > expected * (1. + tolerance) + (expected < 1. ? 0.5 : 0.);
+                break;
+            case METRIC_INFO:
+            default:
+                break;
+        }
+        if(regressed) {
+            printf("# regression %s %.2f baseline %.2f\n", name, metric->value, expected);
+            regressions++;
+        }
+    }
+    fclose(file);
+    return regressions;
+}
+
+static void usage(const char* program)
+{
+    fprintf(stderr,
+        "usage: %s [--subs N] [--events N] [--event-list N] [--sub-list N] [--age-width N] [--seed N]\n"
+        "          [--baseline FILE] [--tolerance FRACTION]\n",
+        program);
+}
+
+static bool parse_options(int argc, char** argv, struct options* options)
+{
+    for(int i = 1; i < argc; i++) {
+        if(i + 1 == argc) {
+            return false;
+        }
+        const char* option = argv[i];
+        const char* value = argv[++i];
+        if(strcmp(option, "--subs") == 0) {
+            options->sub_count = strtoull(value, NULL, 10);
+        }
+        else if(strcmp(option, "--events") == 0) {
+            options->event_count = strtoull(value, NULL, 10);
+        }
+        else if(strcmp(option, "--event-list") == 0) {
+            options->event_list_size = strtoull(value, NULL, 10);
+        }
+        else if(strcmp(option, "--sub-list") == 0) {
+            options->sub_list_size = strtoull(value, NULL, 10);
+        }
+        else if(strcmp(option, "--age-width") == 0) {
+            options->age_width = strtoull(value, NULL, 10);
+        }
+        else if(strcmp(option, "--seed") == 0) {
+            options->seed = strtoull(value, NULL, 10);
+        }
+        else if(strcmp(option, "--baseline") == 0) {
+            options->baseline = value;
+        }
+        else if(strcmp(option, "--tolerance") == 0) {
+            options->tolerance = strtod(value, NULL);
+        }
+        else {
+            return false;
+        }
+    }
+    return options->sub_count != 0 && options->event_count != 0 && options->sub_list_size != 0
+        && options->age_width <= 100;
+}
+
+int main(int argc, char** argv)
+{
+    struct options options = { .sub_count = 20000,
+        .event_count = 20000,
+        .event_list_size = 32,
+        .sub_list_size = 8,
+        .age_width = 20,
+        .seed = 1,
+        .baseline = NULL,
+        .tolerance = 0.1 };
+    if(!parse_options(argc, argv, &options)) {
+        usage(argv[0]);
+        return 2;
+    }
+    struct metrics metrics = { .count = 0 };
+    run(&options, &metrics);
+    printf("# subs %zu events %zu event_list %zu sub_list %zu age_width %zu seed %" PRIu64 "\n",
+        options.sub_count, options.event_count, options.event_list_size, options.sub_list_size,
+        options.age_width, options.seed);
+    for(size_t i = 0; i < metrics.count; i++) {
+        printf("%s %.2f\n", metrics.metrics[i].name, metrics.metrics[i].value);
+    }
+    if(options.baseline == NULL) {
+        return 0;
+    }
+    int regressions = compare_baseline(&metrics, options.baseline, options.tolerance);
+    if(regressions < 0) {
+        return 2;
+    }
+    return regressions == 0 ? 0 : 1;
+}
@@ -0,0 +1,431 @@
+#include <inttypes.h>
+#include <linux/perf_event.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ast.h"
+#include "betree.h"
+#include "tree.h"
+
+/*
+ * Micro benchmark of the predicate kernels: one leaf expression is matched against a ring of
+ * prepared events, without the tree, the memoize or the event parsing around it. Each case sets the
+ * length of the sub's list, the length of the event's list and the share of events that hit, i.e.
+ * contain what the predicate looks for. Results are checked against what the hit rate says, so a
+ * replacement kernel that gets an answer wrong stops the run
+ */
+
+#define EVENT_RING 64
+#define EXPR_SIZE 16384
+#define EVENT_SIZE 65536
+#define STRING_COUNT 4096
+
+enum kernel {
+    KERNEL_ONE_OF,
+    KERNEL_NONE_OF,
+    KERNEL_ALL_OF,
+    KERNEL_IN_INTEGERS,
+    KERNEL_IN_STRINGS,
+    KERNEL_INTEGER_IN_LIST,
+    KERNEL_COMPARE_INTEGER,
+    KERNEL_COMPARE_FLOAT,
+    KERNEL_FREQUENCY_CAP,
+    KERNEL_GEO,
+};
+
+struct kernel_spec {
+    enum kernel kernel;
+    const char* name;
+    // Whether the case has a list on the sub side, the event side
+    bool sub_list;
+    bool event_list;
+    // Result of the predicate for an event that hits
+    bool hit_result;
+};
+
+static const struct kernel_spec KERNELS[] = {
+    { KERNEL_ONE_OF, "list_one_of", true, true, true },
+    { KERNEL_NONE_OF, "list_none_of", true, true, false },
+    { KERNEL_ALL_OF, "list_all_of", true, true, true },
+    { KERNEL_IN_INTEGERS, "set_in_integers", true, false, true },
+    { KERNEL_IN_STRINGS, "set_in_strings", true, false, true },
+    { KERNEL_INTEGER_IN_LIST, "set_integer_in_list", false, true, true },
+    { KERNEL_COMPARE_INTEGER, "compare_integer", false, false, true },
+    { KERNEL_COMPARE_FLOAT, "compare_float", false, false, true },
+    { KERNEL_FREQUENCY_CAP, "within_frequency_cap", false, true, false },
+    { KERNEL_GEO, "geo_within_radius", false, false, true },
+};
+
+static const size_t SUB_LIST_SIZES[] = { 4, 16, 64 };
+static const size_t EVENT_LIST_SIZES[] = { 1, 16, 128, 1024 };
+static const size_t HIT_PERCENTS[] = { 0, 50, 100 };
+
+#define COUNT_OF(array) (sizeof(array) / sizeof((array)[0]))
+
+struct counters {
+    int cycles;
+    int instructions;
+};
+
+static int open_counter(uint64_t config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void start_counter(int fd)
+{
+    if(fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+// Counted since start_counter, -1 without the counter
+static double stop_counter(int fd)
+{
+    if(fd < 0) {
+        return -1.;
+    }
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    uint64_t count;
+    if(read(fd, &count, sizeof(count)) != sizeof(count)) {
+        return -1.;
+    }
+    return (double)count;
+}
+
+static uint64_t now_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static void add_variables(struct betree* tree)
+{
+    betree_add_integer_list_variable(tree, "il", false, 0, INT64_MAX);
+    betree_add_integer_variable(tree, "i", false, 0, INT64_MAX);
+    betree_add_string_variable(tree, "s", false, STRING_COUNT);
+    betree_add_float_variable(tree, "f", false, 0., 1.);
+    betree_add_frequency_caps_variable(tree, "frequency_caps", false);
+    betree_add_integer_variable(tree, "now", false, 0, INT64_MAX);
+    betree_add_float_variable(tree, "latitude", false, -180., 180.);
+    betree_add_float_variable(tree, "longitude", false, -180., 180.);
+}
+
+// Sub values are even, the values an event adds without hitting are odd
+static int64_t sub_value(size_t i)
+{
+    return (int64_t)(i * 2);
+}
+
+static int64_t filler_value(size_t i)
+{
+    return (int64_t)(i * 2 + 1);
+}
+
+static size_t append(char* buffer, size_t length, size_t size, const char* text)
+{
+    size_t text_length = strlen(text);
+    if(length + text_length >= size) {
+        fprintf(stderr, "%s buffer too small\n", __func__);
+        abort();
+    }
+    memcpy(buffer + length, text, text_length + 1);
+    return length + text_length;
+}
+
+static size_t append_integers(char* buffer, size_t length, size_t size, size_t count, int64_t (*value)(size_t))
+{
+    char number[32];
+    for(size_t i = 0; i < count; i++) {
+        snprintf(number, sizeof(number), "%s%" PRId64, i == 0 ? "" : ", ", value(i));
+        length = append(buffer, length, size, number);
+    }
+    return length;
+}
+
+static void make_expr(char* expr, enum kernel kernel, size_t sub_list)
+{
+    size_t length = 0;
+    switch(kernel) {
+        case KERNEL_ONE_OF:
+        case KERNEL_NONE_OF:
+        case KERNEL_ALL_OF:
+            length = append(expr, length, EXPR_SIZE,
+                kernel == KERNEL_ONE_OF ? "il one of (" : kernel == KERNEL_NONE_OF ? "il none of (" : "il all of (");
+            length = append_integers(expr, length, EXPR_SIZE, sub_list, sub_value);
+            append(expr, length, EXPR_SIZE, ")");
+            break;
+        case KERNEL_IN_INTEGERS:
+            length = append(expr, length, EXPR_SIZE, "i in (");
+            length = append_integers(expr, length, EXPR_SIZE, sub_list, sub_value);
+            append(expr, length, EXPR_SIZE, ")");
+            break;
+        case KERNEL_IN_STRINGS: {
+            length = append(expr, length, EXPR_SIZE, "s in (");
+            char string[32];
+            for(size_t i = 0; i < sub_list; i++) {
+                snprintf(string, sizeof(string), "%s\"s%" PRId64 "\"", i == 0 ? "" : ", ", sub_value(i));
+                length = append(expr, length, EXPR_SIZE, string);
+            }
+            append(expr, length, EXPR_SIZE, ")");
+            break;
+        }
+        case KERNEL_INTEGER_IN_LIST:
+            append(expr, length, EXPR_SIZE, "0 in il");
+            break;
+        case KERNEL_COMPARE_INTEGER:
+            append(expr, length, EXPR_SIZE, "i > 1000");
+            break;
+        case KERNEL_COMPARE_FLOAT:
+            append(expr, length, EXPR_SIZE, "f < 0.5");
+            break;
+        case KERNEL_FREQUENCY_CAP:
+            append(expr, length, EXPR_SIZE, "within_frequency_cap(\"flight\", \"ns\", 100, 0)");
+            break;
+        case KERNEL_GEO:
+            append(expr, length, EXPR_SIZE, "geo_within_radius(45.0, -73.0, 10.0)");
+            break;
+        default: abort();
+    }
+}
+
+static void make_event(char* event, enum kernel kernel, size_t sub_list, size_t event_list, bool hit)
+{
+    size_t length = 0;
+    char part[128];
+    switch(kernel) {
+        case KERNEL_ONE_OF:
+        case KERNEL_NONE_OF:
+        case KERNEL_ALL_OF:
+        case KERNEL_INTEGER_IN_LIST: {
+            // Hits hold the first sub value, or all of them for all of, events sort their lists
+            size_t hits = !hit ? 0 : kernel == KERNEL_ALL_OF ? sub_list : 1;
+            size_t fillers = event_list > hits ? event_list - hits : 0;
+            length = append(event, length, EVENT_SIZE, "{\"il\": [");
+            length = append_integers(event, length, EVENT_SIZE, fillers, filler_value);
+            if(fillers != 0 && hits != 0) {
+                length = append(event, length, EVENT_SIZE, ", ");
+            }
+            length = append_integers(event, length, EVENT_SIZE, hits, sub_value);
+            append(event, length, EVENT_SIZE, "]}");
+            break;
+        }
+        case KERNEL_IN_INTEGERS:
+            snprintf(part, sizeof(part), "{\"i\": %" PRId64 "}", hit ? sub_value(sub_list - 1) : filler_value(0));
+            append(event, length, EVENT_SIZE, part);
+            break;
+        case KERNEL_IN_STRINGS:
+            snprintf(part, sizeof(part), "{\"s\": \"s%" PRId64 "\"}", hit ? sub_value(sub_list - 1) : filler_value(0));
+            append(event, length, EVENT_SIZE, part);
+            break;
+        case KERNEL_COMPARE_INTEGER:
+            snprintf(part, sizeof(part), "{\"i\": %d}", hit ? 2000 : 10);
+            append(event, length, EVENT_SIZE, part);
+            break;
+        case KERNEL_COMPARE_FLOAT:
+            snprintf(part, sizeof(part), "{\"f\": %s}", hit ? "0.25" : "0.75");
+            append(event, length, EVENT_SIZE, part);
+            break;
+        case KERNEL_FREQUENCY_CAP: {
+            // Caps of other flights first, a hit ends with this flight over its cap
+            length = append(event, length, EVENT_SIZE, "{\"now\": 0, \"frequency_caps\": [");
+            size_t others = hit && event_list != 0 ? event_list - 1 : event_list;
+            for(size_t i = 0; i < others; i++) {
+                snprintf(part, sizeof(part), "%s[\"flight\", %zu, \"ns\", 200, 0]", i == 0 ? "" : ", ", 1000 + i);
+                length = append(event, length, EVENT_SIZE, part);
+            }
+            if(hit) {
+                length = append(event, length, EVENT_SIZE, others == 0 ? "" : ", ");
+                length = append(event, length, EVENT_SIZE, "[\"flight\", 10, \"ns\", 200, 0]");
+            }
+            append(event, length, EVENT_SIZE, "]}");
+            break;
+        }
+        case KERNEL_GEO:
+            snprintf(part, sizeof(part), "{\"latitude\": %s, \"longitude\": %s}", hit ? "45.01" : "40.0",
+                hit ? "-73.01" : "-70.0");
+            append(event, length, EVENT_SIZE, part);
+            break;
+        default: abort();
+    }
+}
+
+struct bench_case {
+    const struct kernel_spec* spec;
+    size_t sub_list;
+    size_t event_list;
+    size_t hit_percent;
+};
+
+struct bench_options {
+    size_t iterations;
+    const char* filter;
+    struct counters counters;
+};
+
+static void run_case(const struct bench_options* options, const struct bench_case* bench_case)
+{
+    const struct kernel_spec* spec = bench_case->spec;
+    char name[128];
+    snprintf(name, sizeof(name), "%s/sub%zu/event%zu/hit%zu", spec->name, bench_case->sub_list,
+        bench_case->event_list, bench_case->hit_percent);
+    if(options->filter != NULL && strstr(name, options->filter) == NULL) {
+        return;
+    }
+    enum e { constant_count = 1 };
+    const struct betree_constant* constants[constant_count]
+        = { betree_make_integer_constant("flight_id", 10) };
+    struct betree* tree = betree_make();
+    add_variables(tree);
+    char* text = malloc(EXPR_SIZE > EVENT_SIZE ? EXPR_SIZE : EVENT_SIZE);
+    if(text == NULL) {
+        fprintf(stderr, "%s malloc failed\n", __func__);
+        abort();
+    }
+    make_expr(text, spec->kernel, bench_case->sub_list);
+    const struct betree_sub* sub = betree_make_sub(tree, 1, constant_count, constants, text);
+    if(sub == NULL) {
+        fprintf(stderr, "Can't parse %s\n", text);
+        abort();
+    }
+    // Only the kernel, the memoize is left out
+    struct ast_node* expr = (struct ast_node*)sub->expr;
+    set_memoize_id(expr, INVALID_PRED);
+
+    // Hits are spread over the ring so branch predictors see the mix
+    size_t attr_domain_count = tree->config->attr_domain_count;
+    struct betree_event* events[EVENT_RING];
+    const struct betree_variable** preds[EVENT_RING];
+    bool expected[EVENT_RING];
+    size_t hits = bench_case->hit_percent * EVENT_RING / 100;
+    for(size_t i = 0; i < EVENT_RING; i++) {
+        bool hit = (i * hits) % EVENT_RING < hits;
+        make_event(text, spec->kernel, bench_case->sub_list, bench_case->event_list, hit);
+        events[i] = make_event_from_string(tree, text);
+        preds[i] = calloc(attr_domain_count, sizeof(*preds[i]));
+        if(preds[i] == NULL) {
+            fprintf(stderr, "%s calloc failed\n", __func__);
+            abort();
+        }
+        for(size_t j = 0; j < events[i]->variable_count; j++) {
+            if(events[i]->variables[j] != NULL) {
+                preds[i][events[i]->variables[j]->attr_var.var] = events[i]->variables[j];
+            }
+        }
+        expected[i] = hit ? spec->hit_result : !spec->hit_result;
+    }
+    for(size_t i = 0; i < EVENT_RING; i++) {
+        if(match_node(preds[i], expr, NULL, NULL) != expected[i]) {
+            fprintf(stderr, "%s gives the wrong result on event %zu\n", name, i);
+            abort();
+        }
+    }
+
+    size_t matched = 0;
+    start_counter(options->counters.cycles);
+    start_counter(options->counters.instructions);
+    uint64_t start = now_ns();
+    for(size_t i = 0; i < options->iterations; i++) {
+        matched += match_node(preds[i % EVENT_RING], expr, NULL, NULL);
+    }
+    uint64_t elapsed = now_ns() - start;
+    double cycles = stop_counter(options->counters.cycles);
+    double instructions = stop_counter(options->counters.instructions);
+    size_t expected_matched = 0;
+    for(size_t i = 0; i < options->iterations; i++) {
+        expected_matched += expected[i % EVENT_RING];
+    }
+    if(matched != expected_matched) {
+        fprintf(stderr, "%s matched %zu instead of %zu\n", name, matched, expected_matched);
+        abort();
+    }
+
+    double iterations = (double)options->iterations;
+    printf("%s %.2f %.2f %.2f\n", name, (double)elapsed / iterations,
+        cycles < 0. ? -1. : cycles / iterations, instructions < 0. ? -1. : instructions / iterations);
+
+    for(size_t i = 0; i < EVENT_RING; i++) {
+        free_event(events[i]);
+        free(preds[i]);
+    }
+    free_sub((struct betree_sub*)sub);
+    betree_free_constant((struct betree_constant*)constants[0]);
+    free(text);
+    betree_free(tree);
+}
+
+static void run_kernel(const struct bench_options* options, const struct kernel_spec* spec)
+{
+    size_t sub_count = spec->sub_list ? COUNT_OF(SUB_LIST_SIZES) : 1;
+    size_t event_count = spec->event_list ? COUNT_OF(EVENT_LIST_SIZES) : 1;
+    for(size_t i = 0; i < sub_count; i++) {
+        for(size_t j = 0; j < event_count; j++) {
+            struct bench_case bench_case = { .spec = spec,
+                .sub_list = spec->sub_list ? SUB_LIST_SIZES[i] : 1,
+                .event_list = spec->event_list ? EVENT_LIST_SIZES[j] : 1,
+                .hit_percent = 0 };
+            // All of can only hit when the event holds the whole sub list
+            if(spec->kernel == KERNEL_ALL_OF && bench_case.event_list < bench_case.sub_list) {
+                continue;
+            }
+            for(size_t k = 0; k < COUNT_OF(HIT_PERCENTS); k++) {
+                bench_case.hit_percent = HIT_PERCENTS[k];
+                run_case(options, &bench_case);
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    struct bench_options options = { .iterations = 1000000, .filter = NULL };
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            options.iterations = strtoull(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            options.filter = argv[++i];
+        }
+        else {
+            fprintf(stderr, "usage: %s [--iterations N] [--filter SUBSTRING]\n", argv[0]);
+            return 2;
+        }
+    }
+    if(options.iterations == 0) {
+        fprintf(stderr, "At least one iteration is needed\n");
+        return 2;
+    }
+    options.counters.cycles = open_counter(PERF_COUNT_HW_CPU_CYCLES);
+    options.counters.instructions = open_counter(PERF_COUNT_HW_INSTRUCTIONS);
+    if(options.counters.cycles < 0) {
+        printf("# hardware counters unavailable, cycles and instructions are -1\n");
+    }
+    printf("# case ns_per_eval cycles_per_eval instructions_per_eval\n");
+    for(size_t i = 0; i < COUNT_OF(KERNELS); i++) {
+        run_kernel(&options, &KERNELS[i]);
+    }
+    if(options.counters.cycles >= 0) {
+        close(options.counters.cycles);
+    }
+    if(options.counters.instructions >= 0) {
+        close(options.counters.instructions);
+    }
+    return 0;
+}
@@ -0,0 +1,139 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "activation.h"
+#include "alloc.h"
+#include "tree.h"
+
+struct activation_index* make_activation_index(int64_t now)
+{
+    struct activation_index* index = bcalloc(sizeof(*index));
+    if(index == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    index->now = now;
+    index->count = 0;
+    index->capacity = 0;
+    index->timers = NULL;
+    return index;
+}
+
+void free_activation_index(struct activation_index* index)
+{
+    if(index == NULL) {
+        return;
+    }
+    bfree(index->timers);
+    bfree(index);
+}
+
+static void place_timer(struct activation_index* index, size_t position, struct activation_timer timer)
+{
+    index->timers[position] = timer;
+    timer.sub->timer = position;
+}
+
+static void sift_up(struct activation_index* index, size_t position)
+{
+    struct activation_timer timer = index->timers[position];
+    while(position > 0) {
+        size_t parent = (position - 1) / 2;
+        if(index->timers[parent].at <= timer.at) {
+            break;
+        }
+        place_timer(index, position, index->timers[parent]);
+        position = parent;
+    }
+    place_timer(index, position, timer);
+}
+
+static void sift_down(struct activation_index* index, size_t position)
+{
+    struct activation_timer timer = index->timers[position];
+    while(true) {
+        size_t child = 2 * position + 1;
+        if(child >= index->count) {
+            break;
+        }
+        if(child + 1 < index->count && index->timers[child + 1].at < index->timers[child].at) {
+            child++;
+        }
+        if(timer.at <= index->timers[child].at) {
+            break;
+        }
+        place_timer(index, position, index->timers[child]);
+        position = child;
+    }
+    place_timer(index, position, timer);
+}
+
+static void push_timer(struct activation_index* index, int64_t at, struct betree_sub* sub)
+{
+    if(index->count == index->capacity) {
+        size_t capacity = index->capacity == 0 ? 16 : index->capacity * 2;
+        struct activation_timer* timers = brealloc(index->timers, capacity * sizeof(*timers));
+        if(timers == NULL) {
+            fprintf(stderr, "%s brealloc failed\n", __func__);
+            abort();
+        }
+        index->timers = timers;
+        index->capacity = capacity;
+    }
+    struct activation_timer timer = { .at = at, .sub = sub };
+    index->count++;
+    place_timer(index, index->count - 1, timer);
+    sift_up(index, index->count - 1);
+}
+
+void unschedule_activation(struct activation_index* index, struct betree_sub* sub)
+{
+    size_t position = sub->timer;
+    if(position == SIZE_MAX) {
+        return;
+    }
+    sub->timer = SIZE_MAX;
+    index->count--;
+    if(position == index->count) {
+        return;
+    }
+    // The last timer takes the hole and moves whichever way it has to
+    place_timer(index, position, index->timers[index->count]);
+    if(position > 0 && index->timers[(position - 1) / 2].at > index->timers[position].at) {
+        sift_up(index, position);
+    }
+    else {
+        sift_down(index, position);
+    }
+}
+
+void schedule_activation(struct activation_index* index, struct betree_sub* sub)
+{
+    unschedule_activation(index, sub);
+    sub->active = sub->window_start <= index->now && index->now <= sub->window_end;
+    if(index->now < sub->window_start) {
+        push_timer(index, sub->window_start, sub);
+    }
+    else if(sub->active && sub->window_end != INT64_MAX) {
+        push_timer(index, sub->window_end + 1, sub);
+    }
+}
+
+size_t advance_activation(struct activation_index* index, int64_t now)
+{
+    if(now <= index->now) {
+        return 0;
+    }
+    index->now = now;
+    size_t flipped = 0;
+    while(index->count != 0 && index->timers[0].at <= now) {
+        struct betree_sub* sub = index->timers[0].sub;
+        bool active = sub->active;
+        schedule_activation(index, sub);
+        if(sub->active != active) {
+            flipped++;
+        }
+    }
+    return flipped;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct betree_sub;
+
+/*
+ * Subs with an activation window are only candidates while the clock of the tree is inside it. Each
+ * windowed sub that will still flip has one timer in a min-heap, at its start while it waits and
+ * past its end while it is active, so moving the clock costs O(log n) per sub that flips
+ */
+
+struct activation_timer {
+    int64_t at;
+    struct betree_sub* sub;
+};
+
+struct activation_index {
+    // INT64_MIN until the clock is first moved
+    int64_t now;
+    size_t count;
+    size_t capacity;
+    struct activation_timer* timers;
+};
+
+struct activation_index* make_activation_index(int64_t now);
+void free_activation_index(struct activation_index* index);
+
+// Recomputes whether the sub is active and arms its next timer, for new subs and changed windows
+void schedule_activation(struct activation_index* index, struct betree_sub* sub);
+// Drops the timer of the sub, before it is freed
+void unschedule_activation(struct activation_index* index, struct betree_sub* sub);
+// Flips the subs whose timers are due, returns how many changed. The clock never moves back
+size_t advance_activation(struct activation_index* index, int64_t now);
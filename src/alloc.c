@@ -1,7 +1,16 @@
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 
 #include "alloc.h"
 
@@ -15,7 +24,414 @@ void* enif_calloc(size_t size)
     }
     return ptr;
 }
+#define system_malloc enif_alloc
+#define system_calloc enif_calloc
+#define system_realloc enif_realloc
+#define system_free enif_free
+#else
+#define system_malloc malloc
+#define system_calloc(x) calloc(x, 1)
+#define system_realloc realloc
+#define system_free free
+#endif
+
+// 16 byte steps up to 256 then half powers of two, anything bigger gets a chunk of its own
+static const size_t ARENA_CLASS_SIZES[] = { 16, 32, 48, 64, 80, 96, 112, 128, 144, 160, 176, 192, 208,
+    224, 240, 256, 384, 512, 768, 1024, 1536, 2048 };
+#define ARENA_CLASS_COUNT (sizeof(ARENA_CLASS_SIZES) / sizeof(ARENA_CLASS_SIZES[0]))
+#define ARENA_LARGE_CLASS ARENA_CLASS_COUNT
+#define ARENA_SLAB_SIZE (64 * 1024)
+// Huge page arenas carve their slabs from regions of one huge page
+#define ARENA_REGION_SIZE (2 * 1024 * 1024)
+
+struct arena_chunk {
+    char* base;
+    size_t size;
+    size_t class;
+};
+
+struct arena_class {
+    void* free_list;
+    char* next;
+    char* end;
+};
+
+struct arena {
+    pthread_mutex_t lock;
+    struct arena_class classes[ARENA_CLASS_COUNT];
+    // Sorted by base so a pointer's chunk is found with a binary search
+    size_t chunk_count;
+    size_t chunk_capacity;
+    struct arena_chunk* chunks;
+    bool huge_pages;
+    // Set once no explicit huge page could be mapped, transparent ones are asked for then
+    bool transparent_only;
+    char* region_next;
+    char* region_end;
+    size_t region_count;
+    size_t region_capacity;
+    char** regions;
+};
+
+static __thread struct arena* current_arena = NULL;
+
+#ifdef BETREE_ALLOC_STATS
+static uint64_t allocation_count = 0;
+#define COUNT_ALLOCATION() __atomic_fetch_add(&allocation_count, 1, __ATOMIC_RELAXED)
+#else
+#define COUNT_ALLOCATION() ((void)0)
+#endif
+
+uint64_t betree_allocation_count()
+{
+#ifdef BETREE_ALLOC_STATS
+    return __atomic_load_n(&allocation_count, __ATOMIC_RELAXED);
+#else
+    return 0;
+#endif
+}
+
+struct arena* make_arena()
+{
+    struct arena* arena = system_calloc(sizeof(*arena));
+    if(arena == NULL) {
+        fprintf(stderr, "%s calloc failed\n", __func__);
+        abort();
+    }
+    pthread_mutex_init(&arena->lock, NULL);
+    return arena;
+}
+
+struct arena* make_huge_page_arena()
+{
+    struct arena* arena = make_arena();
+    arena->huge_pages = true;
+    return arena;
+}
+
+struct arena* make_arena_like(const struct arena* arena)
+{
+    if(arena == NULL) {
+        return NULL;
+    }
+    return arena->huge_pages ? make_huge_page_arena() : make_arena();
+}
+
+static char* map_region(struct arena* arena)
+{
+#ifdef __linux__
+    int protection = PROT_READ | PROT_WRITE;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if(!arena->transparent_only) {
+        void* region = mmap(NULL, ARENA_REGION_SIZE, protection, flags | MAP_HUGETLB, -1, 0);
+        if(region != MAP_FAILED) {
+            return region;
+        }
+        arena->transparent_only = true;
+    }
+    // Twice the size so an aligned region fits, the kernel only backs aligned ones with a huge page
+    size_t size = 2 * ARENA_REGION_SIZE;
+    char* mapped = mmap(NULL, size, protection, flags, -1, 0);
+    if(mapped == MAP_FAILED) {
+        return NULL;
+    }
+    char* region = (char*)(((uintptr_t)mapped + ARENA_REGION_SIZE - 1) & ~(uintptr_t)(ARENA_REGION_SIZE - 1));
+    if(region != mapped) {
+        munmap(mapped, region - mapped);
+    }
+    if(region + ARENA_REGION_SIZE != mapped + size) {
+        munmap(region + ARENA_REGION_SIZE, mapped + size - (region + ARENA_REGION_SIZE));
+    }
+    madvise(region, ARENA_REGION_SIZE, MADV_HUGEPAGE);
+    return region;
+#else
+    (void)arena;
+    return system_malloc(ARENA_REGION_SIZE);
+#endif
+}
+
+static void unmap_region(char* region)
+{
+#ifdef __linux__
+    munmap(region, ARENA_REGION_SIZE);
+#else
+    system_free(region);
 #endif
+}
+
+// Next slab of a huge page arena, NULL when no region can be mapped
+static char* carve_slab(struct arena* arena)
+{
+    if(arena->region_next == NULL || arena->region_next + ARENA_SLAB_SIZE > arena->region_end) {
+        if(arena->region_count == arena->region_capacity) {
+            size_t capacity = arena->region_capacity == 0 ? 16 : arena->region_capacity * 2;
+            char** regions = system_realloc(arena->regions, capacity * sizeof(*regions));
+            if(regions == NULL) {
+                return NULL;
+            }
+            arena->regions = regions;
+            arena->region_capacity = capacity;
+        }
+        char* region = map_region(arena);
+        if(region == NULL) {
+            return NULL;
+        }
+        arena->regions[arena->region_count++] = region;
+        arena->region_next = region;
+        arena->region_end = region + ARENA_REGION_SIZE;
+    }
+    char* slab = arena->region_next;
+    arena->region_next += ARENA_SLAB_SIZE;
+    return slab;
+}
+
+// Slabs carved from a region are released with it
+static bool carved(const struct arena* arena, size_t class)
+{
+    return arena->huge_pages && class != ARENA_LARGE_CLASS;
+}
+
+void free_arena(struct arena* arena)
+{
+    if(arena == NULL) {
+        return;
+    }
+    for(size_t i = 0; i < arena->chunk_count; i++) {
+        if(!carved(arena, arena->chunks[i].class)) {
+            system_free(arena->chunks[i].base);
+        }
+    }
+    for(size_t i = 0; i < arena->region_count; i++) {
+        unmap_region(arena->regions[i]);
+    }
+    system_free(arena->regions);
+    system_free(arena->chunks);
+    pthread_mutex_destroy(&arena->lock);
+    system_free(arena);
+}
+
+struct arena* set_current_arena(struct arena* arena)
+{
+    struct arena* previous = current_arena;
+    current_arena = arena;
+    return previous;
+}
+
+static size_t class_for_size(size_t size)
+{
+    if(size <= 256) {
+        return size == 0 ? 0 : (size - 1) / 16;
+    }
+    for(size_t i = 16; i < ARENA_CLASS_COUNT; i++) {
+        if(size <= ARENA_CLASS_SIZES[i]) {
+            return i;
+        }
+    }
+    return ARENA_LARGE_CLASS;
+}
+
+static struct arena_chunk* find_chunk(struct arena* arena, const void* ptr)
+{
+    const char* p = ptr;
+    size_t low = 0, high = arena->chunk_count;
+    while(low < high) {
+        size_t mid = low + (high - low) / 2;
+        struct arena_chunk* chunk = &arena->chunks[mid];
+        if(p < chunk->base) {
+            high = mid;
+        }
+        else if(p >= chunk->base + chunk->size) {
+            low = mid + 1;
+        }
+        else {
+            return chunk;
+        }
+    }
+    return NULL;
+}
+
+static char* add_chunk(struct arena* arena, size_t size, size_t class)
+{
+    char* base = carved(arena, class) ? carve_slab(arena) : system_malloc(size);
+    if(base == NULL) {
+        return NULL;
+    }
+    if(arena->chunk_count == arena->chunk_capacity) {
+        size_t capacity = arena->chunk_capacity == 0 ? 16 : arena->chunk_capacity * 2;
+        struct arena_chunk* chunks = system_realloc(arena->chunks, capacity * sizeof(*chunks));
+        if(chunks == NULL) {
+            // A carved slab is only released with its region
+            if(!carved(arena, class)) {
+                system_free(base);
+            }
+            return NULL;
+        }
+        arena->chunks = chunks;
+        arena->chunk_capacity = capacity;
+    }
+    size_t position = arena->chunk_count;
+    while(position > 0 && arena->chunks[position - 1].base > base) {
+        position--;
+    }
+    memmove(&arena->chunks[position + 1],
+        &arena->chunks[position],
+        (arena->chunk_count - position) * sizeof(*arena->chunks));
+    arena->chunks[position] = (struct arena_chunk){ .base = base, .size = size, .class = class };
+    arena->chunk_count++;
+    return base;
+}
+
+static void remove_chunk(struct arena* arena, struct arena_chunk* chunk)
+{
+    system_free(chunk->base);
+    size_t position = chunk - arena->chunks;
+    memmove(chunk, chunk + 1, (arena->chunk_count - position - 1) * sizeof(*chunk));
+    arena->chunk_count--;
+}
+
+static void* arena_malloc(struct arena* arena, size_t size)
+{
+    size_t class = class_for_size(size);
+    pthread_mutex_lock(&arena->lock);
+    void* ptr;
+    if(class == ARENA_LARGE_CLASS) {
+        ptr = add_chunk(arena, size, ARENA_LARGE_CLASS);
+    }
+    else {
+        struct arena_class* slab = &arena->classes[class];
+        size_t block_size = ARENA_CLASS_SIZES[class];
+        if(slab->free_list != NULL) {
+            ptr = slab->free_list;
+            slab->free_list = *(void**)ptr;
+        }
+        else {
+            if(slab->next == NULL || slab->next + block_size > slab->end) {
+                slab->next = add_chunk(arena, ARENA_SLAB_SIZE, class);
+                slab->end = slab->next == NULL ? NULL : slab->next + ARENA_SLAB_SIZE;
+            }
+            ptr = slab->next;
+            if(ptr != NULL) {
+                slab->next += block_size;
+            }
+        }
+    }
+    pthread_mutex_unlock(&arena->lock);
+    return ptr;
+}
+
+// Returns false when ptr was not carved from this arena
+static bool arena_free(struct arena* arena, void* ptr)
+{
+    pthread_mutex_lock(&arena->lock);
+    struct arena_chunk* chunk = find_chunk(arena, ptr);
+    if(chunk != NULL) {
+        if(chunk->class == ARENA_LARGE_CLASS) {
+            remove_chunk(arena, chunk);
+        }
+        else {
+            struct arena_class* slab = &arena->classes[chunk->class];
+            *(void**)ptr = slab->free_list;
+            slab->free_list = ptr;
+        }
+    }
+    pthread_mutex_unlock(&arena->lock);
+    return chunk != NULL;
+}
+
+static size_t arena_block_size(struct arena* arena, const void* ptr)
+{
+    pthread_mutex_lock(&arena->lock);
+    struct arena_chunk* chunk = find_chunk(arena, ptr);
+    size_t size = 0;
+    if(chunk != NULL) {
+        size = chunk->class == ARENA_LARGE_CLASS ? chunk->size : ARENA_CLASS_SIZES[chunk->class];
+    }
+    pthread_mutex_unlock(&arena->lock);
+    return size;
+}
+
+void* bmalloc(size_t size)
+{
+    COUNT_ALLOCATION();
+    struct arena* arena = current_arena;
+    if(arena != NULL) {
+        return arena_malloc(arena, size);
+    }
+    return system_malloc(size);
+}
+
+void* bcalloc(size_t size)
+{
+    COUNT_ALLOCATION();
+    struct arena* arena = current_arena;
+    if(arena != NULL) {
+        void* ptr = arena_malloc(arena, size);
+        if(ptr != NULL) {
+            memset(ptr, 0, size);
+        }
+        return ptr;
+    }
+    return system_calloc(size);
+}
+
+void* brealloc(void* ptr, size_t size)
+{
+    COUNT_ALLOCATION();
+    struct arena* arena = current_arena;
+    if(arena == NULL) {
+        return system_realloc(ptr, size);
+    }
+    if(ptr == NULL) {
+        return arena_malloc(arena, size);
+    }
+    size_t old_size = arena_block_size(arena, ptr);
+    if(old_size == 0) {
+        // Allocated before the arena was current, it stays on the heap
+        return system_realloc(ptr, size);
+    }
+    if(size <= old_size && class_for_size(size) == class_for_size(old_size)) {
+        return ptr;
+    }
+    void* resized = arena_malloc(arena, size);
+    if(resized == NULL) {
+        return NULL;
+    }
+    memcpy(resized, ptr, old_size < size ? old_size : size);
+    arena_free(arena, ptr);
+    return resized;
+}
+
+void bfree(void* ptr)
+{
+    if(ptr == NULL) {
+        return;
+    }
+    struct arena* arena = current_arena;
+    if(arena != NULL && arena_free(arena, ptr)) {
+        return;
+    }
+    system_free(ptr);
+}
+
+size_t bsize(const void* ptr, size_t requested)
+{
+    if(ptr == NULL) {
+        return 0;
+    }
+    struct arena* arena = current_arena;
+    if(arena != NULL) {
+        size_t size = arena_block_size(arena, ptr);
+        if(size != 0) {
+            return size;
+        }
+    }
+#if defined(__GLIBC__) && !defined(NIF)
+    (void)requested;
+    return malloc_usable_size((void*)ptr);
+#else
+    return requested;
+#endif
+}
 
 char* bstrdup(const char *s1)
 {
@@ -53,7 +469,7 @@ int bvasprintf(char **buf, const char *format, va_list va)
 
 	ret = vsnprintf(*buf, len, format, va);
 	if (ret < 0) {
-		free(*buf);
+		bfree(*buf);
 		*buf = NULL;
 	}
 
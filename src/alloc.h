@@ -1,22 +1,43 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifdef NIF
 #include <erl_nif.h>
-#define bmalloc enif_alloc
-#define bcalloc enif_calloc
-#define brealloc enif_realloc
-#define bfree enif_free
 void* enif_calloc(size_t size);
-#else
-#define bmalloc malloc
-#define bcalloc(x) calloc(x, 1)
-#define brealloc realloc
-#define bfree free
 #endif
 
+/*
+ * Everything goes through these, they carve from the current arena when one is set on the thread
+ */
+void* bmalloc(size_t size);
+void* bcalloc(size_t size);
+void* brealloc(void* ptr, size_t size);
+void bfree(void* ptr);
+// Usable size of a block from the functions above, requested when the allocator can't tell
+size_t bsize(const void* ptr, size_t requested);
+// Calls to the three above since the start, always 0 unless built with -DBETREE_ALLOC_STATS
+uint64_t betree_allocation_count();
+
 #include <stdarg.h>
 
 char* bstrdup(const char *s1);
 int bvasprintf(char **buf, const char *format, va_list va);
 int basprintf(char **buf, const char *format, ...);
 
+/*
+ * Arenas: size class slabs with free lists, freeing the arena releases every block carved from it.
+ * Blocks are recognized by address, so freeing a heap pointer while an arena is current is fine
+ */
+struct arena;
+
+struct arena* make_arena();
+// Slabs come from 2MB regions backed by explicit huge pages when the system has some reserved, and
+// transparent ones otherwise, for fewer TLB misses on big trees. Blocks past 2KB stay on the heap
+struct arena* make_huge_page_arena();
+// Empty arena with the same kind of pages, NULL when arena is
+struct arena* make_arena_like(const struct arena* arena);
+void free_arena(struct arena* arena);
+// Returns the arena that was current before, to be restored afterwards
+struct arena* set_current_arena(struct arena* arena);
@@ -9,10 +9,12 @@
 #include "alloc.h"
 #include "ast.h"
 #include "betree.h"
+#include "bitmap.h"
 #include "error.h"
 #include "hashmap.h"
 #include "memoize.h"
 #include "printer.h"
+#include "sorted_list.h"
 #include "special.h"
 #include "utils.h"
 #include "value.h"
@@ -27,6 +29,8 @@ struct ast_node* ast_node_create()
     }
     node->global_id = INVALID_PRED;
     node->memoize_id = INVALID_PRED;
+    node->memoize_site = NULL;
+    node->ref_count = 1;
     return node;
 }
 
@@ -134,6 +138,199 @@ static uint64_t score_node(struct ast_node* node)
     }
 }
 
+// Expected cost under short circuit and probability of passing, used to order AND/OR operands
+struct node_estimate {
+    double cost;
+    double pass;
+};
+
+static double list_pass_rate(size_t count)
+{
+    return fmin(1., 0.1 * count);
+}
+
+static struct node_estimate estimate_node(const struct ast_node* node);
+
+static struct node_estimate estimate_leaf(const struct ast_node* node)
+{
+    struct node_estimate estimate = { .cost = score_node((struct ast_node*)node), .pass = 0.5 };
+    switch(node->type) {
+        case AST_TYPE_EQUALITY_EXPR:
+            estimate.pass = node->equality_expr.op == AST_EQUALITY_EQ ? 0.1 : 0.9;
+            break;
+        case AST_TYPE_SET_EXPR: {
+            const struct set_right_value* right = &node->set_expr.right_value;
+            size_t count;
+            switch(right->value_type) {
+                case AST_SET_RIGHT_VALUE_INTEGER_LIST:
+                    count = right->integer_list_value->count;
+                    break;
+                case AST_SET_RIGHT_VALUE_STRING_LIST:
+                    count = right->string_list_value->count;
+                    break;
+                case AST_SET_RIGHT_VALUE_INTEGER_LIST_ENUM:
+                    count = right->integer_enum_list_value->count;
+                    break;
+                case AST_SET_RIGHT_VALUE_VARIABLE:
+                    return estimate;
+                default: abort();
+            }
+            estimate.pass = list_pass_rate(count);
+            if(node->set_expr.op == AST_SET_NOT_IN) {
+                estimate.pass = 1. - estimate.pass;
+            }
+            break;
+        }
+        case AST_TYPE_LIST_EXPR: {
+            size_t count = node->list_expr.value.value_type == AST_LIST_VALUE_INTEGER_LIST
+                ? node->list_expr.value.integer_list_value->count
+                : node->list_expr.value.string_list_value->count;
+            switch(node->list_expr.op) {
+                case AST_LIST_ONE_OF:
+                    estimate.pass = list_pass_rate(count);
+                    break;
+                case AST_LIST_NONE_OF:
+                    estimate.pass = 1. - list_pass_rate(count);
+                    break;
+                case AST_LIST_ALL_OF:
+                    estimate.pass = 0.05;
+                    break;
+                default: abort();
+            }
+            break;
+        }
+        case AST_TYPE_SPECIAL_EXPR:
+            // Most events are under their caps
+            if(node->special_expr.type == AST_SPECIAL_FREQUENCY) {
+                estimate.pass = 0.9;
+            }
+            break;
+        case AST_TYPE_IS_NULL_EXPR:
+        case AST_TYPE_COMPARE_EXPR:
+            break;
+        case AST_TYPE_BOOL_EXPR:
+        default: abort();
+    }
+    return estimate;
+}
+
+static struct node_estimate estimate_node(const struct ast_node* node)
+{
+    if(node->type != AST_TYPE_BOOL_EXPR) {
+        return estimate_leaf(node);
+    }
+    switch(node->bool_expr.op) {
+        case AST_BOOL_LITERAL:
+            return (struct node_estimate){ .cost = instant_cost, .pass = node->bool_expr.literal ? 1. : 0. };
+        case AST_BOOL_VARIABLE:
+            return (struct node_estimate){ .cost = variable_fetch_cost, .pass = 0.5 };
+        case AST_BOOL_NOT: {
+            struct node_estimate estimate = estimate_node(node->bool_expr.unary.expr);
+            estimate.pass = 1. - estimate.pass;
+            return estimate;
+        }
+        case AST_BOOL_AND: {
+            struct node_estimate lhs = estimate_node(node->bool_expr.binary.lhs);
+            struct node_estimate rhs = estimate_node(node->bool_expr.binary.rhs);
+            return (struct node_estimate){ .cost = lhs.cost + lhs.pass * rhs.cost, .pass = lhs.pass * rhs.pass };
+        }
+        case AST_BOOL_OR: {
+            struct node_estimate lhs = estimate_node(node->bool_expr.binary.lhs);
+            struct node_estimate rhs = estimate_node(node->bool_expr.binary.rhs);
+            return (struct node_estimate){ .cost = lhs.cost + (1. - lhs.pass) * rhs.cost,
+                .pass = 1. - (1. - lhs.pass) * (1. - rhs.pass) };
+        }
+        default: abort();
+    }
+}
+
+struct ranked_operand {
+    struct ast_node* node;
+    double rank;
+    size_t position;
+};
+
+static int ranked_operand_cmp(const void* a, const void* b)
+{
+    const struct ranked_operand* x = a;
+    const struct ranked_operand* y = b;
+    if(x->rank < y->rank) {
+        return -1;
+    }
+    if(x->rank > y->rank) {
+        return 1;
+    }
+    // Keeps the order stable so equal expressions are rewritten the same way
+    return x->position < y->position ? -1 : (x->position > y->position ? 1 : 0);
+}
+
+static void collect_chain(struct ast_node* node,
+    enum ast_bool_e op,
+    struct ast_node** links,
+    size_t* link_count,
+    struct ranked_operand* operands,
+    size_t* operand_count)
+{
+    if(node->type == AST_TYPE_BOOL_EXPR && node->bool_expr.op == op) {
+        links[(*link_count)++] = node;
+        collect_chain(node->bool_expr.binary.lhs, op, links, link_count, operands, operand_count);
+        collect_chain(node->bool_expr.binary.rhs, op, links, link_count, operands, operand_count);
+        return;
+    }
+    operands[*operand_count].node = node;
+    operands[*operand_count].position = *operand_count;
+    (*operand_count)++;
+}
+
+static size_t chain_length(const struct ast_node* node, enum ast_bool_e op)
+{
+    if(node->type == AST_TYPE_BOOL_EXPR && node->bool_expr.op == op) {
+        return chain_length(node->bool_expr.binary.lhs, op) + chain_length(node->bool_expr.binary.rhs, op);
+    }
+    return 1;
+}
+
+void reorder_bool_exprs(struct ast_node* node)
+{
+    if(node->type != AST_TYPE_BOOL_EXPR) {
+        return;
+    }
+    enum ast_bool_e op = node->bool_expr.op;
+    if(op == AST_BOOL_NOT) {
+        reorder_bool_exprs(node->bool_expr.unary.expr);
+        return;
+    }
+    if(op != AST_BOOL_AND && op != AST_BOOL_OR) {
+        return;
+    }
+    // a and (b and c) is flattened so every operand of the chain competes for the first slot
+    size_t count = chain_length(node, op);
+    struct ast_node** links = bcalloc((count - 1) * sizeof(*links));
+    struct ranked_operand* operands = bcalloc(count * sizeof(*operands));
+    if(links == NULL || operands == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    size_t link_count = 0, operand_count = 0;
+    collect_chain(node, op, links, &link_count, operands, &operand_count);
+    for(size_t i = 0; i < operand_count; i++) {
+        reorder_bool_exprs(operands[i].node);
+        struct node_estimate estimate = estimate_node(operands[i].node);
+        // An AND stops at the first failure and an OR at the first success, cheap and decisive goes first
+        double stop = op == AST_BOOL_AND ? 1. - estimate.pass : estimate.pass;
+        operands[i].rank = stop > 0. ? estimate.cost / stop : INFINITY;
+    }
+    qsort(operands, operand_count, sizeof(*operands), ranked_operand_cmp);
+    // Relink as a right leaning chain, node stays the root since the parent points to it
+    for(size_t i = 0; i < link_count; i++) {
+        links[i]->bool_expr.binary.lhs = operands[i].node;
+        links[i]->bool_expr.binary.rhs
+            = i + 1 < link_count ? links[i + 1] : operands[operand_count - 1].node;
+    }
+    bfree(links);
+    bfree(operands);
+}
+
 struct ast_node* ast_bool_expr_binary_create(
     enum ast_bool_e op, struct ast_node* lhs, struct ast_node* rhs)
 {
@@ -234,6 +431,7 @@ struct ast_node* ast_special_geo_create(const enum ast_special_geo_e op,
         .radius = radius,
         .latitude_var = make_attr_var("latitude", NULL),
         .longitude_var = make_attr_var("longitude", NULL) };
+    prepare_geo(&geo);
     node->special_expr.type = AST_SPECIAL_GEO;
     node->special_expr.geo = geo;
     return node;
@@ -331,6 +529,10 @@ void free_ast_node(struct ast_node* node)
     if(node == NULL) {
         return;
     }
+    node->ref_count--;
+    if(node->ref_count != 0) {
+        return;
+    }
     switch(node->type) {
         case AST_TYPE_IS_NULL_EXPR:
             free_attr_var(node->is_null_expr.attr_var);
@@ -382,44 +584,6 @@ static void invalid_expr(const char* msg)
     abort();
 }
 
-static bool d64binary_search(const int64_t arr[], size_t count, int64_t to_find)
-{
-    int imin = 0;
-    int imax = (int)count - 1;
-    while(imax >= imin) {
-        int imid = imin + ((imax - imin) / 2);
-        if(arr[imid] == to_find) {
-            return true;
-        }
-        if(arr[imid] < to_find) {
-            imin = imid + 1;
-        }
-        else {
-            imax = imid - 1;
-        }
-    }
-    return false;
-}
-
-static bool sbinary_search(struct string_value arr[], size_t count, betree_str_t to_find)
-{
-    int imin = 0;
-    int imax = (int)count - 1;
-    while(imax >= imin) {
-        int imid = imin + ((imax - imin) / 2);
-        if(arr[imid].str == to_find) {
-            return true;
-        }
-        if(arr[imid].str < to_find) {
-            imin = imid + 1;
-        }
-        else {
-            imax = imid - 1;
-        }
-    }
-    return false;
-}
-
 static bool iebinary_search(struct integer_enum_value arr[], size_t count, betree_ienum_t to_find)
 {
     int imin = 0;
@@ -441,12 +605,15 @@ static bool iebinary_search(struct integer_enum_value arr[], size_t count, betre
 
 static bool integer_in_integer_list(int64_t integer, struct betree_integer_list* list)
 {
-    return d64binary_search(list->integers, list->count, integer);
+    return sorted_integer_contains(list->integers, list->count, integer);
 }
 
 static bool string_in_string_list(struct string_value string, struct betree_string_list* list)
 {
-    return sbinary_search(list->strings, list->count, string.str);
+    if(list->bitmap != NULL) {
+        return id_bitmap_test(list->bitmap, string.str);
+    }
+    return sorted_string_contains(list->strings, list->count, string.str);
 }
 
 static bool integer_enum_in_integer_enum_list(struct integer_enum_value ienum, struct betree_integer_enum_list* list)
@@ -576,8 +743,7 @@ static bool match_special_expr(
                         return false;
                     }
 
-                    return geo_within_radius(
-                        g->latitude, g->longitude, latitude_var, longitude_var, g->radius);
+                    return geo_within(g, latitude_var, longitude_var);
                 }
                 default: abort();
             }
@@ -607,132 +773,58 @@ static bool match_special_expr(
 
 static bool match_not_all_of_int(struct value variable, struct ast_list_expr list_expr)
 {
-    int64_t* xs;
-    size_t x_count;
-    int64_t* ys;
-    size_t y_count;
-    if(variable.integer_list_value->count < list_expr.value.integer_list_value->count) {
-        xs = variable.integer_list_value->integers;
-        x_count = variable.integer_list_value->count;
-        ys = list_expr.value.integer_list_value->integers;
-        y_count = list_expr.value.integer_list_value->count;
-    }
-    else {
-        ys = variable.integer_list_value->integers;
-        y_count = variable.integer_list_value->count;
-        xs = list_expr.value.integer_list_value->integers;
-        x_count = list_expr.value.integer_list_value->count;
-    }
-    size_t i = 0, j = 0;
-    while(i < x_count && j < y_count) {
-        int64_t x = xs[i];
-        int64_t y = ys[j];
-        if(x == y) {
-            return true;
-        }
-        if(y < x) {
-            j++;
-        }
-        else {
-            i++;
-        }
-    }
-    return false;
+    return sorted_integer_intersects(variable.integer_list_value->integers,
+        variable.integer_list_value->count,
+        list_expr.value.integer_list_value->integers,
+        list_expr.value.integer_list_value->count);
 }
 
 static bool match_not_all_of_string(struct value variable, struct ast_list_expr list_expr)
 {
-    struct string_value* xs;
-    size_t x_count;
-    struct string_value* ys;
-    size_t y_count;
-    if(variable.string_list_value->count < list_expr.value.integer_list_value->count) {
-        xs = variable.string_list_value->strings;
-        x_count = variable.string_list_value->count;
-        ys = list_expr.value.string_list_value->strings;
-        y_count = list_expr.value.integer_list_value->count;
+    const struct betree_string_list* values = variable.string_list_value;
+    const struct betree_string_list* expected = list_expr.value.string_list_value;
+    if(values->bitmap != NULL && expected->bitmap != NULL) {
+        return id_bitmap_intersects(values->bitmap, expected->bitmap);
     }
-    else {
-        ys = variable.string_list_value->strings;
-        y_count = variable.string_list_value->count;
-        xs = list_expr.value.string_list_value->strings;
-        x_count = list_expr.value.integer_list_value->count;
-    }
-    size_t i = 0, j = 0;
-    while(i < x_count && j < y_count) {
-        struct string_value* x = &xs[i];
-        struct string_value* y = &ys[j];
-        if(x->str == y->str) {
-            return true;
-        }
-        if(y->str < x->str) {
-            j++;
-        }
-        else {
-            i++;
-        }
+    if(expected->bitmap != NULL) {
+        return id_bitmap_count_strings(expected->bitmap, values->strings, values->count) != 0;
     }
-    return false;
+    if(values->bitmap != NULL) {
+        return id_bitmap_count_strings(values->bitmap, expected->strings, expected->count) != 0;
+    }
+    return sorted_string_intersects(values->strings, values->count, expected->strings, expected->count);
 }
 
 static bool match_all_of_int(struct value variable, struct ast_list_expr list_expr)
 {
-    int64_t* xs = list_expr.value.integer_list_value->integers;
-    size_t x_count = list_expr.value.integer_list_value->count;
-    int64_t* ys = variable.integer_list_value->integers;
-    size_t y_count = variable.integer_list_value->count;
-    if(x_count <= y_count) {
-        size_t i = 0, j = 0;
-        while(i < y_count && j < x_count) {
-            int64_t x = xs[j];
-            int64_t y = ys[i];
-            if(y < x) {
-                i++;
-            }
-            else if(x == y) {
-                i++;
-                j++;
-            }
-            else {
-                return false;
-            }
-        }
-        if(j < x_count) {
-            return false;
-        }
-        return true;
-    }
-    return false;
+    return sorted_integer_includes(variable.integer_list_value->integers,
+        variable.integer_list_value->count,
+        list_expr.value.integer_list_value->integers,
+        list_expr.value.integer_list_value->count);
 }
 
 static bool match_all_of_string(struct value variable, struct ast_list_expr list_expr)
 {
-    struct string_value* xs = list_expr.value.string_list_value->strings;
-    size_t x_count = list_expr.value.string_list_value->count;
-    struct string_value* ys = variable.string_list_value->strings;
-    size_t y_count = variable.string_list_value->count;
-    if(x_count <= y_count) {
-        size_t i = 0, j = 0;
-        while(i < y_count && j < x_count) {
-            struct string_value* x = &xs[j];
-            struct string_value* y = &ys[i];
-            if(y->str < x->str) {
-                i++;
-            }
-            else if(x->str == y->str) {
-                i++;
-                j++;
-            }
-            else {
+    // Lists with a bitmap have no duplicates so counting hits is enough
+    const struct betree_string_list* values = variable.string_list_value;
+    const struct betree_string_list* expected = list_expr.value.string_list_value;
+    if(values->bitmap != NULL && expected->bitmap != NULL) {
+        return id_bitmap_includes(values->bitmap, expected->bitmap);
+    }
+    if(expected->bitmap != NULL) {
+        return id_bitmap_count_strings(expected->bitmap, values->strings, values->count) == expected->count;
+    }
+    if(values->bitmap != NULL) {
+        for(size_t i = 0; i < expected->count; i++) {
+            // A repeated value has nothing left to match, same as the merge
+            if(!id_bitmap_test(values->bitmap, expected->strings[i].str)
+                || (i != 0 && expected->strings[i - 1].str == expected->strings[i].str)) {
                 return false;
             }
         }
-        if(j < x_count) {
-            return false;
-        }
         return true;
     }
-    return false;
+    return sorted_string_includes(values->strings, values->count, expected->strings, expected->count);
 }
 
 static bool match_list_expr(
@@ -1027,6 +1119,26 @@ static bool match_is_null_expr(const struct betree_variable** preds,
     }
 }
 
+bool match_leaf_node(const struct betree_variable** preds, const struct ast_node* node)
+{
+    switch(node->type) {
+        case AST_TYPE_IS_NULL_EXPR:
+            return match_is_null_expr(preds, node->is_null_expr);
+        case AST_TYPE_SPECIAL_EXPR:
+            return match_special_expr(preds, node->special_expr);
+        case AST_TYPE_LIST_EXPR:
+            return match_list_expr(preds, node->list_expr);
+        case AST_TYPE_SET_EXPR:
+            return match_set_expr(preds, node->set_expr);
+        case AST_TYPE_COMPARE_EXPR:
+            return match_compare_expr(preds, node->compare_expr);
+        case AST_TYPE_EQUALITY_EXPR:
+            return match_equality_expr(preds, node->equality_expr);
+        case AST_TYPE_BOOL_EXPR:
+        default: abort();
+    }
+}
+
 static bool match_node_inner(const struct betree_variable** preds,
     const struct ast_node* node,
     struct memoize* memoize,
@@ -1047,43 +1159,14 @@ static bool match_node_inner(const struct betree_variable** preds,
         }
     }
     bool result;
-    switch(node->type) {
-        case AST_TYPE_IS_NULL_EXPR:
-            result = match_is_null_expr(preds, node->is_null_expr);
-            break;
-        case AST_TYPE_SPECIAL_EXPR: {
-            result = match_special_expr(preds, node->special_expr);
-            break;
-        }
-        case AST_TYPE_BOOL_EXPR: {
-            result = match_bool_expr(preds, node->bool_expr, memoize, report);
-            break;
-        }
-        case AST_TYPE_LIST_EXPR: {
-            result = match_list_expr(preds, node->list_expr);
-            break;
-        }
-        case AST_TYPE_SET_EXPR: {
-            result = match_set_expr(preds, node->set_expr);
-            break;
-        }
-        case AST_TYPE_COMPARE_EXPR: {
-            result = match_compare_expr(preds, node->compare_expr);
-            break;
-        }
-        case AST_TYPE_EQUALITY_EXPR: {
-            result = match_equality_expr(preds, node->equality_expr);
-            break;
-        }
-        default: abort();
+    if(node->type == AST_TYPE_BOOL_EXPR) {
+        result = match_bool_expr(preds, node->bool_expr, memoize, report);
+    }
+    else {
+        result = match_leaf_node(preds, node);
     }
     if(node->memoize_id != INVALID_PRED) {
-        if(result) {
-            set_bit(memoize->pass, node->memoize_id);
-        }
-        else {
-            set_bit(memoize->fail, node->memoize_id);
-        }
+        memoize_result(memoize, node->memoize_id, result);
     }
     return result;
 }
@@ -1096,11 +1179,213 @@ bool match_node(const struct betree_variable** preds,
     return match_node_inner(preds, node, memoize, report);
 }
 
+static void count_program(const struct ast_node* node, size_t* instruction_count, size_t* leaf_count)
+{
+    // Check and store
+    *instruction_count += 2;
+    if(node->type != AST_TYPE_BOOL_EXPR) {
+        (*instruction_count)++;
+        (*leaf_count)++;
+        return;
+    }
+    switch(node->bool_expr.op) {
+        case AST_BOOL_AND:
+        case AST_BOOL_OR:
+            count_program(node->bool_expr.binary.lhs, instruction_count, leaf_count);
+            (*instruction_count)++;
+            count_program(node->bool_expr.binary.rhs, instruction_count, leaf_count);
+            break;
+        case AST_BOOL_NOT:
+            count_program(node->bool_expr.unary.expr, instruction_count, leaf_count);
+            (*instruction_count)++;
+            break;
+        case AST_BOOL_VARIABLE:
+        case AST_BOOL_LITERAL:
+            (*instruction_count)++;
+            break;
+        default: abort();
+    }
+}
+
+static size_t emit_instruction(struct ast_program* program, enum ast_op_e op)
+{
+    size_t index = program->instruction_count++;
+    program->instructions[index].op = op;
+    program->instructions[index].jump = 0;
+    return index;
+}
+
+static void emit_program(struct ast_program* program, struct ast_node* node)
+{
+    // Every node gets a check and a store, a predicate seen once so far can become shared later
+    size_t check = emit_instruction(program, AST_OP_MEMO_CHECK);
+    program->instructions[check].memoize_id = node->memoize_id;
+    if(node->memoize_id == INVALID_PRED) {
+        node->memoize_site = &program->instructions[check];
+    }
+    if(node->type != AST_TYPE_BOOL_EXPR) {
+        size_t leaf = program->leaf_count++;
+        // Shallow copy, lists and strings stay owned by the sub's AST
+        program->leaves[leaf] = *node;
+        size_t index = emit_instruction(program, AST_OP_LEAF);
+        program->instructions[index].leaf = &program->leaves[leaf];
+    }
+    else {
+        switch(node->bool_expr.op) {
+            case AST_BOOL_AND:
+            case AST_BOOL_OR: {
+                emit_program(program, node->bool_expr.binary.lhs);
+                size_t jump = emit_instruction(program,
+                    node->bool_expr.op == AST_BOOL_AND ? AST_OP_JUMP_IF_FALSE : AST_OP_JUMP_IF_TRUE);
+                emit_program(program, node->bool_expr.binary.rhs);
+                // The short circuit lands on this node's store so the result is still memoized
+                program->instructions[jump].jump = program->instruction_count - jump;
+                break;
+            }
+            case AST_BOOL_NOT:
+                emit_program(program, node->bool_expr.unary.expr);
+                emit_instruction(program, AST_OP_NOT);
+                break;
+            case AST_BOOL_VARIABLE: {
+                size_t index = emit_instruction(program, AST_OP_BOOL_VARIABLE);
+                program->instructions[index].var = node->bool_expr.variable.var;
+                break;
+            }
+            case AST_BOOL_LITERAL: {
+                size_t index = emit_instruction(program, AST_OP_LITERAL);
+                program->instructions[index].literal = node->bool_expr.literal;
+                break;
+            }
+            default: abort();
+        }
+    }
+    size_t store = emit_instruction(program, AST_OP_MEMO_STORE);
+    program->instructions[store].memoize_id = node->memoize_id;
+    // A memoized result skips the whole subtree, store included
+    program->instructions[check].jump = program->instruction_count - check;
+}
+
+void set_memoize_id(struct ast_node* node, betree_pred_t memoize_id)
+{
+    node->memoize_id = memoize_id;
+    struct ast_instruction* check = node->memoize_site;
+    if(check != NULL) {
+        struct ast_instruction* store = check + check->jump - 1;
+        check->memoize_id = memoize_id;
+        store->memoize_id = memoize_id;
+        node->memoize_site = NULL;
+    }
+}
+
+struct ast_program* compile_ast(struct ast_node* node)
+{
+    size_t instruction_count = 0, leaf_count = 0;
+    count_program(node, &instruction_count, &leaf_count);
+    // One block so the interpreter walks contiguous memory
+    size_t size = sizeof(struct ast_program) + leaf_count * sizeof(struct ast_node)
+        + instruction_count * sizeof(struct ast_instruction);
+    struct ast_program* program = bcalloc(size);
+    if(program == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    program->leaves = (struct ast_node*)(program + 1);
+    program->instructions = (struct ast_instruction*)(program->leaves + leaf_count);
+    emit_program(program, node);
+    return program;
+}
+
+void free_ast_program(struct ast_program* program)
+{
+    bfree(program);
+}
+
+bool match_program(const struct betree_variable** preds,
+    const struct ast_program* program,
+    struct memoize* memoize,
+    struct report* report)
+{
+    const struct ast_instruction* instructions = program->instructions;
+    size_t count = program->instruction_count;
+    bool result = false;
+    size_t pc = 0;
+    while(pc < count) {
+        const struct ast_instruction* instruction = &instructions[pc];
+        switch(instruction->op) {
+            case AST_OP_MEMO_CHECK:
+                if(instruction->memoize_id == INVALID_PRED) {
+                    break;
+                }
+                if(test_bit(memoize->pass, instruction->memoize_id)) {
+                    result = true;
+                }
+                else if(test_bit(memoize->fail, instruction->memoize_id)) {
+                    result = false;
+                }
+                else {
+                    break;
+                }
+                if(report != NULL) {
+                    report->memoized++;
+                }
+                pc += instruction->jump;
+                continue;
+            case AST_OP_MEMO_STORE:
+                if(instruction->memoize_id == INVALID_PRED) {
+                    break;
+                }
+                memoize_result(memoize, instruction->memoize_id, result);
+                break;
+            case AST_OP_JUMP_IF_FALSE:
+                if(!result) {
+                    pc += instruction->jump;
+                    continue;
+                }
+                break;
+            case AST_OP_JUMP_IF_TRUE:
+                if(result) {
+                    pc += instruction->jump;
+                    continue;
+                }
+                break;
+            case AST_OP_NOT:
+                result = !result;
+                break;
+            case AST_OP_LITERAL:
+                result = instruction->literal;
+                break;
+            case AST_OP_BOOL_VARIABLE: {
+                bool value;
+                result = get_bool_var(instruction->var, preds, &value) && value;
+                break;
+            }
+            case AST_OP_LEAF:
+                result = match_leaf_node(preds, instruction->leaf);
+                break;
+            default: abort();
+        }
+        pc++;
+    }
+    return result;
+}
+
 struct bound_dirty {
     bool min_dirty;
     bool max_dirty;
 };
 
+// not (a or b) is bounded like not a and not b, not (a and b) like not a or not b
+static enum ast_bool_e bound_bool_op(enum ast_bool_e op, bool is_reversed)
+{
+    if(is_reversed && op == AST_BOOL_OR) {
+        return AST_BOOL_AND;
+    }
+    if(is_reversed && op == AST_BOOL_AND) {
+        return AST_BOOL_OR;
+    }
+    return op;
+}
+
 static void get_variable_bound_inner(const struct attr_domain* domain,
     const struct ast_node* node,
     struct value_bound* bound,
@@ -1405,7 +1690,7 @@ static void get_variable_bound_inner(const struct attr_domain* domain,
                 default: abort();
             }
         case AST_TYPE_BOOL_EXPR:
-            switch(node->bool_expr.op) {
+            switch(bound_bool_op(node->bool_expr.op, is_reversed)) {
                 case AST_BOOL_LITERAL:
                     return;
                 case AST_BOOL_VARIABLE:
@@ -2520,9 +2805,9 @@ bool fast_eq_expr(const struct ast_node* a, const struct ast_node* b)
     return a->global_id == b->global_id;
 }
 
-void assign_pred_id(struct config* config, struct ast_node* node)
+struct ast_node* assign_pred_id(struct config* config, struct ast_node* node)
 {
-    assign_pred(config->pred_map, node);
+    return assign_pred(config->pred_map, node);
 }
 
 
@@ -2591,16 +2876,78 @@ void sort_lists(struct ast_node* node)
     }
 }
 
-bool var_exists(const struct config* config, const char* attr)
+static bool has_duplicate_strings(const struct betree_string_list* list)
 {
-    for(size_t i = 0; i < config->attr_domain_count; i++) {
-        if(strcmp(attr, config->attr_domains[i]->attr_var.attr) == 0) {
+    for(size_t i = 1; i < list->count; i++) {
+        if(list->strings[i - 1].str == list->strings[i].str) {
             return true;
         }
     }
     return false;
 }
 
+// Subtrees shared with earlier subs are already indexed and must stay untouched
+static void index_expr_list(const struct attr_domain* domain, struct betree_string_list* list)
+{
+    if(list->bitmap == NULL) {
+        index_string_list(domain, list);
+    }
+}
+
+void index_list_bitmaps(const struct config* config, struct ast_node* node)
+{
+    switch(node->type) {
+        case AST_TYPE_BOOL_EXPR:
+            switch(node->bool_expr.op) {
+                case AST_BOOL_AND:
+                case AST_BOOL_OR:
+                    index_list_bitmaps(config, node->bool_expr.binary.lhs);
+                    index_list_bitmaps(config, node->bool_expr.binary.rhs);
+                    return;
+                case AST_BOOL_NOT:
+                    index_list_bitmaps(config, node->bool_expr.unary.expr);
+                    return;
+                case AST_BOOL_VARIABLE:
+                case AST_BOOL_LITERAL:
+                    return;
+                default: abort();
+            }
+        case AST_TYPE_SET_EXPR: {
+            betree_var_t var = node->set_expr.left_value.variable_value.var;
+            if(node->set_expr.left_value.value_type != AST_SET_LEFT_VALUE_VARIABLE
+                || var >= config->attr_domain_count) {
+                return;
+            }
+            if(node->set_expr.right_value.value_type == AST_SET_RIGHT_VALUE_STRING_LIST) {
+                index_expr_list(config->attr_domains[var], node->set_expr.right_value.string_list_value);
+            }
+            return;
+        }
+        case AST_TYPE_LIST_EXPR: {
+            betree_var_t var = node->list_expr.attr_var.var;
+            // All of with a repeated value never matches a list without them, only the merge keeps that
+            if(node->list_expr.value.value_type != AST_LIST_VALUE_STRING_LIST
+                || var >= config->attr_domain_count
+                || has_duplicate_strings(node->list_expr.value.string_list_value)) {
+                return;
+            }
+            index_expr_list(config->attr_domains[var], node->list_expr.value.string_list_value);
+            return;
+        }
+        case AST_TYPE_IS_NULL_EXPR:
+        case AST_TYPE_SPECIAL_EXPR:
+        case AST_TYPE_COMPARE_EXPR:
+        case AST_TYPE_EQUALITY_EXPR:
+            return;
+        default: abort();
+    }
+}
+
+bool var_exists(const struct config* config, const char* attr)
+{
+    return try_get_id_for_exact_attr(config, attr) != INVALID_VAR;
+}
+
 bool is_variable_valid(struct attr_var attr_var)
 {
     if(attr_var.var == INVALID_VAR) {
@@ -2657,16 +3004,15 @@ bool all_variables_in_config(const struct config* config, const struct ast_node*
 
 static size_t get_attr_string_bound(const struct config* config, const char* attr)
 {
-    for(size_t i = 0; i < config->attr_domain_count; i++) {
-        if(strcmp(attr, config->attr_domains[i]->attr_var.attr) == 0) {
-            size_t count = config->attr_domains[i]->bound.smax;
-            if(count == SIZE_MAX) {
-                return count;
-            }
-            return count + 1;
-        }
+    betree_var_t var = try_get_id_for_exact_attr(config, attr);
+    if(var == INVALID_VAR) {
+        return SIZE_MAX;
     }
-    return SIZE_MAX;
+    size_t count = config->attr_domains[var]->bound.smax;
+    if(count == SIZE_MAX) {
+        return count;
+    }
+    return count + 1;
 }
 
 static struct string_map* get_string_map_for_attr(const struct config* config, const char* attr)
@@ -2686,8 +3032,7 @@ static bool str_valid(const struct config* config, const char* attr, const char*
     struct string_map* string_map = get_string_map_for_attr(config, attr);
     size_t space_left = string_map == NULL ? bound : bound - string_map->string_value_count;
     if(string_map != NULL) {
-        betree_str_t* str = map_get(&string_map->m, string);
-        if(str != NULL) {
+        if(find_string_id(string_map, string) != INVALID_STR) {
             return true;
         }
     }
@@ -2715,8 +3060,7 @@ static bool strs_valid(
     if(string_map != NULL) {
         for(size_t i = 0; i < strings->count; i++) {
             const char* string = strings->strings[i].string;
-            betree_str_t* str = map_get(&string_map->m, string);
-            if(str != NULL) {
+            if(find_string_id(string_map, string) != INVALID_STR) {
                 found++;
             }
         }
@@ -2788,3 +3132,40 @@ bool all_bounded_strings_valid(const struct config* config, const struct ast_nod
     }
 }
 
+betree_var_t find_now_var(const struct ast_node* node)
+{
+    switch(node->type) {
+        case AST_TYPE_BOOL_EXPR:
+            switch(node->bool_expr.op) {
+                case AST_BOOL_AND:
+                case AST_BOOL_OR: {
+                    betree_var_t var = find_now_var(node->bool_expr.binary.lhs);
+                    return var != INVALID_VAR ? var : find_now_var(node->bool_expr.binary.rhs);
+                }
+                case AST_BOOL_NOT:
+                    return find_now_var(node->bool_expr.unary.expr);
+                case AST_BOOL_VARIABLE:
+                case AST_BOOL_LITERAL:
+                    return INVALID_VAR;
+                default: abort();
+            }
+        case AST_TYPE_SPECIAL_EXPR:
+            switch(node->special_expr.type) {
+                case AST_SPECIAL_FREQUENCY:
+                    return node->special_expr.frequency.now.var;
+                case AST_SPECIAL_SEGMENT:
+                    return node->special_expr.segment.now.var;
+                case AST_SPECIAL_GEO:
+                case AST_SPECIAL_STRING:
+                    return INVALID_VAR;
+                default: abort();
+            }
+        case AST_TYPE_COMPARE_EXPR:
+        case AST_TYPE_EQUALITY_EXPR:
+        case AST_TYPE_SET_EXPR:
+        case AST_TYPE_LIST_EXPR:
+        case AST_TYPE_IS_NULL_EXPR:
+            return INVALID_VAR;
+        default: abort();
+    }
+}
@@ -219,6 +219,12 @@ struct ast_special_geo {
     double radius;
     struct attr_var latitude_var;
     struct attr_var longitude_var;
+    // Filled by prepare_geo from the constants above
+    double sin_latitude;
+    double cos_latitude;
+    double latitude_span;
+    double longitude_span;
+    double chord_squared;
 };
 
 enum ast_special_string_e {
@@ -275,9 +281,17 @@ enum ast_node_type_e {
     AST_TYPE_IS_NULL_EXPR,
 };
 
+struct ast_instruction;
+
 struct ast_node {
     betree_pred_t global_id;
     betree_pred_t memoize_id;
+    // Memoize check compiled for this node while it had no memoize_id, patched once it gets one
+    struct ast_instruction* memoize_site;
+    // Equal subtrees are stored once across subs, see assign_pred
+    size_t ref_count;
+    // Structural hash, cached by the pred map
+    uint64_t hash;
     enum ast_node_type_e type;
     union {
         struct ast_compare_expr compare_expr;
@@ -321,11 +335,57 @@ struct ast_node* ast_is_null_expr_create(enum ast_is_null_e type, const char* na
 
 void free_ast_node(struct ast_node* node);
 
+/*
+ * Flattened form of an expression used at search time. Everything runs through a single result
+ * register: leaves set it, jumps short circuit on it and memoize stores save it
+ */
+enum ast_op_e {
+    AST_OP_MEMO_CHECK,
+    AST_OP_MEMO_STORE,
+    AST_OP_JUMP_IF_FALSE,
+    AST_OP_JUMP_IF_TRUE,
+    AST_OP_NOT,
+    AST_OP_LITERAL,
+    AST_OP_BOOL_VARIABLE,
+    AST_OP_LEAF,
+};
+
+struct ast_instruction {
+    enum ast_op_e op;
+    // Relative to this instruction
+    size_t jump;
+    union {
+        betree_pred_t memoize_id;
+        betree_var_t var;
+        bool literal;
+        const struct ast_node* leaf;
+    };
+};
+
+struct ast_program {
+    size_t instruction_count;
+    struct ast_instruction* instructions;
+    size_t leaf_count;
+    struct ast_node* leaves;
+};
+
+struct ast_program* compile_ast(struct ast_node* node);
+void set_memoize_id(struct ast_node* node, betree_pred_t memoize_id);
+void free_ast_program(struct ast_program* program);
+
 bool match_node(const struct betree_variable** preds,
     const struct ast_node* node,
     struct memoize* memoize,
     struct report* report);
 
+// Any node but a boolean expression, on its own and without memoization
+bool match_leaf_node(const struct betree_variable** preds, const struct ast_node* node);
+
+bool match_program(const struct betree_variable** preds,
+    const struct ast_program* program,
+    struct memoize* memoize,
+    struct report* report);
+
 struct value_bound get_variable_bound(
     const struct attr_domain* domain, const struct ast_node* node);
 
@@ -334,8 +394,12 @@ bool assign_constants(
 void assign_variable_id(struct config* config, struct ast_node* node);
 void assign_str_id(struct config* config, struct ast_node* node, bool always_assign);
 void assign_ienum_id(struct config* config, struct ast_node* node, bool always_assign);
-void assign_pred_id(struct config* config, struct ast_node* node);
+// Returns the node the expression is stored as, node itself is released when an equal one exists
+struct ast_node* assign_pred_id(struct config* config, struct ast_node* node);
 void sort_lists(struct ast_node* node);
+// Gives the string lists of small domains their bitmaps
+void index_list_bitmaps(const struct config* config, struct ast_node* node);
+void reorder_bool_exprs(struct ast_node* node);
 
 const char* frequency_type_to_string(enum frequency_type_e type);
 bool eq_expr(const struct ast_node* a, const struct ast_node* b);
@@ -343,3 +407,5 @@ bool fast_eq_expr(const struct ast_node* a, const struct ast_node* b);
 
 bool all_variables_in_config(const struct config* config, const struct ast_node* node);
 bool all_bounded_strings_valid(const struct config* config, const struct ast_node* node);
+// The now attribute of the frequency caps and segment predicates of node, INVALID_VAR when it has none
+betree_var_t find_now_var(const struct ast_node* node);
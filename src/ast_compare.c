@@ -1,5 +1,8 @@
 #include "ast_compare.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "ast.h"
 #include "value.h"
 
@@ -495,3 +498,161 @@ int expr_cmp(const void* p1, const void* p2)
     }
 }
 
+
+static uint64_t mix(uint64_t hash, uint64_t value)
+{
+    uint64_t x = hash ^ (value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2));
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static uint64_t mix_float(uint64_t hash, double value)
+{
+    // 0.0 and -0.0 compare equal
+    if(!(value < 0.) && !(value > 0.)) {
+        return mix(hash, 0);
+    }
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return mix(hash, bits);
+}
+
+static uint64_t mix_integer_list(uint64_t hash, const struct betree_integer_list* list)
+{
+    hash = mix(hash, list->count);
+    for(size_t i = 0; i < list->count; i++) {
+        hash = mix(hash, (uint64_t)list->integers[i]);
+    }
+    return hash;
+}
+
+static uint64_t mix_string_list(uint64_t hash, const struct betree_string_list* list)
+{
+    hash = mix(hash, list->count);
+    for(size_t i = 0; i < list->count; i++) {
+        hash = mix(hash, list->strings[i].str);
+    }
+    return hash;
+}
+
+static uint64_t mix_integer_enum_list(uint64_t hash, const struct betree_integer_enum_list* list)
+{
+    hash = mix(hash, list->count);
+    for(size_t i = 0; i < list->count; i++) {
+        hash = mix(hash, list->integers[i].ienum);
+    }
+    return hash;
+}
+
+static uint64_t compare_expr_hash(uint64_t hash, const struct ast_compare_expr* c)
+{
+    hash = mix(mix(mix(hash, c->op), c->attr_var.var), c->value.value_type);
+    switch(c->value.value_type) {
+        case AST_COMPARE_VALUE_INTEGER: return mix(hash, (uint64_t)c->value.integer_value);
+        case AST_COMPARE_VALUE_FLOAT: return mix_float(hash, c->value.float_value);
+        default: abort();
+    }
+}
+
+static uint64_t equality_expr_hash(uint64_t hash, const struct ast_equality_expr* e)
+{
+    hash = mix(mix(mix(hash, e->op), e->attr_var.var), e->value.value_type);
+    switch(e->value.value_type) {
+        case AST_EQUALITY_VALUE_INTEGER_ENUM: return mix(hash, e->value.integer_enum_value.ienum);
+        case AST_EQUALITY_VALUE_INTEGER: return mix(hash, (uint64_t)e->value.integer_value);
+        case AST_EQUALITY_VALUE_FLOAT: return mix_float(hash, e->value.float_value);
+        case AST_EQUALITY_VALUE_STRING: return mix(hash, e->value.string_value.str);
+        default: abort();
+    }
+}
+
+static uint64_t bool_expr_hash(uint64_t hash, const struct ast_bool_expr* b)
+{
+    hash = mix(hash, b->op);
+    switch(b->op) {
+        case AST_BOOL_OR:
+        case AST_BOOL_AND:
+            return mix(mix(hash, b->binary.lhs->global_id), b->binary.rhs->global_id);
+        case AST_BOOL_NOT: return mix(hash, b->unary.expr->global_id);
+        case AST_BOOL_VARIABLE: return mix(hash, b->variable.var);
+        case AST_BOOL_LITERAL: return mix(hash, b->literal);
+        default: abort();
+    }
+}
+
+static uint64_t set_expr_hash(uint64_t hash, const struct ast_set_expr* s)
+{
+    hash = mix(mix(mix(hash, s->op), s->left_value.value_type), s->right_value.value_type);
+    switch(s->left_value.value_type) {
+        case AST_SET_LEFT_VALUE_INTEGER:
+            hash = mix(hash, (uint64_t)s->left_value.integer_value);
+            break;
+        case AST_SET_LEFT_VALUE_STRING:
+            hash = mix(hash, s->left_value.string_value.str);
+            break;
+        case AST_SET_LEFT_VALUE_VARIABLE:
+            hash = mix(hash, s->left_value.variable_value.var);
+            break;
+        default: abort();
+    }
+    switch(s->right_value.value_type) {
+        case AST_SET_RIGHT_VALUE_INTEGER_LIST: return mix_integer_list(hash, s->right_value.integer_list_value);
+        case AST_SET_RIGHT_VALUE_STRING_LIST: return mix_string_list(hash, s->right_value.string_list_value);
+        case AST_SET_RIGHT_VALUE_VARIABLE: return mix(hash, s->right_value.variable_value.var);
+        case AST_SET_RIGHT_VALUE_INTEGER_LIST_ENUM:
+            return mix_integer_enum_list(hash, s->right_value.integer_enum_list_value);
+        default: abort();
+    }
+}
+
+static uint64_t list_expr_hash(uint64_t hash, const struct ast_list_expr* l)
+{
+    hash = mix(mix(mix(hash, l->op), l->attr_var.var), l->value.value_type);
+    switch(l->value.value_type) {
+        case AST_LIST_VALUE_INTEGER_LIST: return mix_integer_list(hash, l->value.integer_list_value);
+        case AST_LIST_VALUE_STRING_LIST: return mix_string_list(hash, l->value.string_list_value);
+        default: abort();
+    }
+}
+
+static uint64_t special_expr_hash(uint64_t hash, const struct ast_special_expr* s)
+{
+    hash = mix(hash, s->type);
+    switch(s->type) {
+        case AST_SPECIAL_FREQUENCY:
+            hash = mix(mix(mix(hash, s->frequency.op), s->frequency.attr_var.var), s->frequency.id);
+            hash = mix(mix(hash, s->frequency.length), s->frequency.ns.str);
+            return mix(mix(hash, s->frequency.type), (uint64_t)s->frequency.value);
+        case AST_SPECIAL_SEGMENT:
+            hash = mix(mix(mix(hash, s->segment.op), s->segment.has_variable), s->segment.attr_var.var);
+            return mix(mix(hash, (uint64_t)s->segment.seconds), s->segment.segment_id);
+        case AST_SPECIAL_GEO:
+            hash = mix(mix(hash, s->geo.op), s->geo.has_radius);
+            hash = mix(mix(hash, s->geo.latitude_var.var), s->geo.longitude_var.var);
+            hash = mix_float(mix_float(hash, s->geo.latitude), s->geo.longitude);
+            return mix_float(hash, s->geo.radius);
+        case AST_SPECIAL_STRING:
+            hash = mix(mix(hash, s->string.op), s->string.attr_var.var);
+            for(const char* c = s->string.pattern; *c != '\0'; c++) {
+                hash = mix(hash, (unsigned char)*c);
+            }
+            return hash;
+        default: abort();
+    }
+}
+
+uint64_t expr_hash(const struct ast_node* node)
+{
+    uint64_t hash = mix(0, node->type);
+    switch(node->type) {
+        case AST_TYPE_COMPARE_EXPR: return compare_expr_hash(hash, &node->compare_expr);
+        case AST_TYPE_EQUALITY_EXPR: return equality_expr_hash(hash, &node->equality_expr);
+        case AST_TYPE_BOOL_EXPR: return bool_expr_hash(hash, &node->bool_expr);
+        case AST_TYPE_SET_EXPR: return set_expr_hash(hash, &node->set_expr);
+        case AST_TYPE_LIST_EXPR: return list_expr_hash(hash, &node->list_expr);
+        case AST_TYPE_SPECIAL_EXPR: return special_expr_hash(hash, &node->special_expr);
+        case AST_TYPE_IS_NULL_EXPR: return mix(mix(hash, node->is_null_expr.attr_var.var), node->is_null_expr.type);
+        default: abort();
+    }
+}
@@ -1,4 +1,9 @@
 #pragma once
 
-int expr_cmp(const void* p1, const void* p2);
+#include <stdint.h>
+
+struct ast_node;
 
+int expr_cmp(const void* p1, const void* p2);
+// Nodes equal under expr_cmp hash the same, children count through their global id like in expr_cmp
+uint64_t expr_hash(const struct ast_node* node);
@@ -2,28 +2,51 @@
 #include <float.h>
 #include <inttypes.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
+#include "activation.h"
 #include "alloc.h"
 #include "ast.h"
 #include "betree.h"
+#include "dependents.h"
 #include "error.h"
+#include "event_sample.h"
+#include "event_scanner.h"
 #include "hashmap.h"
+#include "jit.h"
+#include "parse_cache.h"
+#include "result_cache.h"
+#include "snapshot.h"
+#include "string_matcher.h"
+#include "sub_index.h"
 #include "tree.h"
 #include "utils.h"
 #include "value.h"
 
-/*bool betree_delete(struct betree* betree, betree_sub_t id)*/
-/*{*/
-    /*struct betree_sub* sub = find_sub_id(id, betree->cnode);*/
-    /*bool found = betree_delete_inner(betree->config->attr_domain_count, (const struct attr_domain**)betree->config->attr_domains, sub, betree->cnode);*/
-    /*free_sub(sub);*/
-    /*return found;*/
-/*}*/
+static bool delete_sub(struct betree* betree, betree_sub_t id)
+{
+    struct betree_sub* sub = sub_index_find(betree->sub_index, id);
+    if(sub == NULL) {
+        return false;
+    }
+    bool found = betree_delete_inner(betree->config, sub);
+    if(found) {
+        unschedule_activation(betree->config->activation, sub);
+        sub_index_remove(betree->sub_index, sub);
+        remove_pred(betree->config->pred_map, (struct ast_node*)sub->expr);
+        sub->expr = NULL;
+        free_sub(sub);
+        clear_result_cache(betree->config->result_cache);
+        clear_sub_dependents(betree->config->dependents);
+    }
+    return found;
+}
 
 int parse(const char* text, struct ast_node** node);
 int event_parse(const char* text, struct betree_event** event);
@@ -83,34 +106,6 @@ static bool is_valid(const struct config* config, const struct ast_node* node)
     return true;
 }
 
-/*
-bool betree_insert_all(struct betree* tree, size_t count, const char** exprs)
-{
-    // Hackish a bit for now, insert all except the last manually, then insert the last one legit
-    struct sub** subs = bcalloc(count - 1, sizeof(*subs));
-    for(size_t i = 0; i < count - 1; i++) {
-        const char* expr = exprs[i];
-        struct ast_node* node;
-        if(parse(expr, &node) != 0) {
-            fprintf(stderr, "Failed to parse id %" PRIu64 ": %s\n", i, expr);
-            abort();
-        }
-        if(!is_valid(tree->config, node)) {
-            return false;
-        }
-        assign_variable_id(tree->config, node);
-        assign_str_id(tree->config, node);
-        sort_lists(node);
-        assign_pred_id(tree->config, node);
-        struct sub* sub = make_sub(tree->config, i, node);
-        subs[i] = sub;
-    }
-    tree->cnode->lnode->sub_count = count - 1;
-    tree->cnode->lnode->subs = subs;
-    return betree_insert(tree, count - 1, exprs[count - 1]);
-}
-*/
-
 static void fix_float_with_no_fractions(struct config* config, struct ast_node* node)
 {
     switch(node->type) {
@@ -413,8 +408,10 @@ static bool get_simple_variable_bound(betree_var_t var, const struct ast_node* n
     return false;
 }
 
-static void change_boundaries(struct config* config, const struct ast_node* node) 
+// True when a domain changed
+static bool change_boundaries(struct config* config, const struct ast_node* node)
 {
+    bool changed = false;
     // Use function to extract boundaries, THEN apply them to the config
     for(size_t i = 0; i < config->attr_domain_count; i++) {
         struct attr_domain* attr_domain = config->attr_domains[i];
@@ -461,33 +458,33 @@ static void change_boundaries(struct config* config, const struct ast_node* node
                 }
                 break;
             case BETREE_STRING:
-            case BETREE_STRING_LIST:
-                for(size_t j = 0; j < config->string_map_count; j++) {
-                    if(config->string_maps[j].attr_var.var == attr_domain->attr_var.var) {
-                        size_t smax = config->string_maps[j].string_value_count - 1;
-                        if(attr_domain->bound.smax < SIZE_MAX - 1) {
-                            attr_domain->bound.smax = smax > attr_domain->bound.smax ? smax : attr_domain->bound.smax;
-                        }
-                        else {
-                            attr_domain->bound.smax = smax;
-                        }
+            case BETREE_STRING_LIST: {
+                const struct string_map* string_map = get_string_map(config, attr_domain->attr_var.var);
+                if(string_map != NULL) {
+                    size_t smax = string_map->string_value_count - 1;
+                    if(attr_domain->bound.smax < SIZE_MAX - 1) {
+                        attr_domain->bound.smax = smax > attr_domain->bound.smax ? smax : attr_domain->bound.smax;
+                    }
+                    else {
+                        attr_domain->bound.smax = smax;
                     }
                 }
                 break;
+            }
             case BETREE_INTEGER_ENUM:
-            case BETREE_INTEGER_LIST_ENUM:
-                for(size_t j = 0; j < config->integer_map_count; j++) {
-                    if(config->integer_maps[j].attr_var.var == attr_domain->attr_var.var) {
-                        size_t smax = config->integer_maps[j].integer_value_count - 1;
-                        if(attr_domain->bound.smax < SIZE_MAX - 1) {
-                            attr_domain->bound.smax = smax > attr_domain->bound.smax ? smax : attr_domain->bound.smax;
-                        }
-                        else {
-                            attr_domain->bound.smax = smax;
-                        }
+            case BETREE_INTEGER_LIST_ENUM: {
+                const struct integer_map* integer_map = get_integer_map(config, attr_domain->attr_var.var);
+                if(integer_map != NULL) {
+                    size_t smax = integer_map->integer_value_count - 1;
+                    if(attr_domain->bound.smax < SIZE_MAX - 1) {
+                        attr_domain->bound.smax = smax > attr_domain->bound.smax ? smax : attr_domain->bound.smax;
+                    }
+                    else {
+                        attr_domain->bound.smax = smax;
                     }
                 }
                 break;
+            }
             case BETREE_SEGMENTS:
                 break;
             case BETREE_FREQUENCY_CAPS:
@@ -495,37 +492,74 @@ static void change_boundaries(struct config* config, const struct ast_node* node
             default:
                 break;
         }
+        attr_domain->bound_version++;
+        touch_config_ids(config);
+        changed = true;
     }
+    return changed;
 }
 
-bool betree_change_boundaries(struct betree* tree, const char* expr)
+// Parses the expression with its variable ids assigned, or copies the parse cached for the same text
+static struct ast_node* parse_expr(struct config* config, const char* expr)
 {
-    struct ast_node* node;
+    struct ast_node* node = NULL;
+    if(config->parse_cache != NULL) {
+        node = parse_cache_get(config->parse_cache, expr);
+        if(node != NULL) {
+            return node;
+        }
+    }
     if(parse(expr, &node) != 0) {
+        return NULL;
+    }
+    assign_variable_id(config, node);
+    // Ids of variables added later would be missing from the cached copy
+    if(config->parse_cache != NULL && all_variables_in_config(config, node)) {
+        parse_cache_put(config->parse_cache, expr, node);
+    }
+    return node;
+}
+
+static bool change_boundaries_with_expr(struct betree* tree, const char* expr)
+{
+    struct ast_node* node = parse_expr(tree->config, expr);
+    if(node == NULL) {
         return false;
     }
-    assign_variable_id(tree->config, node);
     assign_str_id(tree->config, node, true);
     assign_ienum_id(tree->config, node, true);
     sort_lists(node);
     fix_float_with_no_fractions(tree->config, node);
-    change_boundaries(tree->config, node);
+    if(change_boundaries(tree->config, node)) {
+        widen_be_tree(tree->config, tree->cnode);
+    }
     free_ast_node(node);
     return true;
 }
 
-bool betree_insert_with_constants(struct betree* tree,
+static bool insert_made_sub(struct betree* tree, const struct betree_sub* sub)
+{
+    bool inserted = insert_be_tree(tree->config, sub, tree->cnode, NULL);
+    if(inserted) {
+        sub_index_add(tree->sub_index, (struct betree_sub*)sub);
+        schedule_activation(tree->config->activation, (struct betree_sub*)sub);
+        clear_result_cache(tree->config->result_cache);
+        clear_sub_dependents(tree->config->dependents);
+    }
+    return inserted;
+}
+
+static bool insert_with_constants(struct betree* tree,
     betree_sub_t id,
     size_t constant_count,
     const struct betree_constant** constants,
     const char* expr)
 {
-    struct ast_node* node;
-    if(parse(expr, &node) != 0) {
+    struct ast_node* node = parse_expr(tree->config, expr);
+    if(node == NULL) {
         fprintf(stderr, "Can't parse %ld\n", id);
         return false;
     }
-    assign_variable_id(tree->config, node);
     if(!is_valid(tree->config, node)) {
         fprintf(stderr, "Can't validate %ld\n", id);
         free_ast_node(node);
@@ -539,19 +573,21 @@ bool betree_insert_with_constants(struct betree* tree,
     assign_ienum_id(tree->config, node, false);
     sort_lists(node);
     fix_float_with_no_fractions(tree->config, node);
-    assign_pred_id(tree->config, node);
+    if(tree->config->reorder_expressions) {
+        reorder_bool_exprs(node);
+    }
+    node = assign_pred_id(tree->config, node);
     struct betree_sub* sub = make_sub(tree->config, id, node);
-    return insert_be_tree(tree->config, sub, tree->cnode, NULL);
+    return insert_made_sub(tree, sub);
 }
 
-const struct betree_sub* betree_make_sub(struct betree* tree, betree_sub_t id, size_t constant_count, const struct betree_constant** constants, const char* expr)
+static const struct betree_sub* make_sub_with_constants(struct betree* tree, betree_sub_t id, size_t constant_count, const struct betree_constant** constants, const char* expr)
 {
-    struct ast_node* node;
-    if(parse(expr, &node) != 0) {
+    struct ast_node* node = parse_expr(tree->config, expr);
+    if(node == NULL) {
         fprintf(stderr, "Can't parse %ld\n", id);
         return false;
     }
-    assign_variable_id(tree->config, node);
     if(!all_variables_in_config(tree->config, node)) {
         fprintf(stderr, "Missing variable in config\n");
         return false;
@@ -568,78 +604,776 @@ const struct betree_sub* betree_make_sub(struct betree* tree, betree_sub_t id, s
     assign_ienum_id(tree->config, node, true);
     sort_lists(node);
     fix_float_with_no_fractions(tree->config, node);
-    change_boundaries(tree->config, node);
-    assign_pred_id(tree->config, node);
+    if(change_boundaries(tree->config, node)) {
+        widen_be_tree(tree->config, tree->cnode);
+    }
+    if(tree->config->reorder_expressions) {
+        reorder_bool_exprs(node);
+    }
+    node = assign_pred_id(tree->config, node);
     struct betree_sub* sub = make_sub(tree->config, id, node);
     return sub;
 }
 
+bool betree_insert(struct betree* tree, betree_sub_t id, const char* expr)
+{
+    return betree_insert_with_constants(tree, id, 0, NULL, expr);
+}
+
+#define INSERT_ALL_MAX_THREADS 16
+
+struct insert_all_job {
+    struct betree* tree;
+    const betree_sub_t* ids;
+    const char** exprs;
+    struct ast_node** nodes;
+    struct betree_sub** subs;
+    size_t start;
+    size_t end;
+    bool valid;
+};
+
+static void* parse_all(void* arg)
+{
+    struct insert_all_job* job = arg;
+    struct arena* previous = set_current_arena(job->tree->arena);
+    for(size_t i = job->start; i < job->end; i++) {
+        struct ast_node* node = parse_expr(job->tree->config, job->exprs[i]);
+        if(node == NULL) {
+            fprintf(stderr, "Can't parse %ld\n", job->ids[i]);
+            job->valid = false;
+            continue;
+        }
+        if(!is_valid(job->tree->config, node)) {
+            fprintf(stderr, "Can't validate %ld\n", job->ids[i]);
+            free_ast_node(node);
+            job->valid = false;
+            continue;
+        }
+        if(!assign_constants(0, NULL, node)) {
+            fprintf(stderr, "Can't assign constants %ld\n", job->ids[i]);
+            free_ast_node(node);
+            job->valid = false;
+            continue;
+        }
+        job->nodes[i] = node;
+    }
+    set_current_arena(previous);
+    return NULL;
+}
+
+static void* prepare_all(void* arg)
+{
+    struct insert_all_job* job = arg;
+    struct arena* previous = set_current_arena(job->tree->arena);
+    for(size_t i = job->start; i < job->end; i++) {
+        sort_lists(job->nodes[i]);
+        fix_float_with_no_fractions(job->tree->config, job->nodes[i]);
+        if(job->tree->config->reorder_expressions) {
+            reorder_bool_exprs(job->nodes[i]);
+        }
+    }
+    set_current_arena(previous);
+    return NULL;
+}
+
+static void* make_all_subs(void* arg)
+{
+    struct insert_all_job* job = arg;
+    struct arena* previous = set_current_arena(job->tree->arena);
+    for(size_t i = job->start; i < job->end; i++) {
+        job->subs[i] = make_sub(job->tree->config, job->ids[i], job->nodes[i]);
+    }
+    set_current_arena(previous);
+    return NULL;
+}
+
+static size_t insert_all_thread_count(size_t count)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t max_threads = cpus > 0 ? (size_t)cpus : 1;
+    // Not worth a thread below a few thousand expressions
+    return smax(1, smin(smin(max_threads, INSERT_ALL_MAX_THREADS), count / 4096));
+}
+
+static bool run_insert_all_phase(void* (*phase)(void*), struct insert_all_job* jobs, size_t job_count)
+{
+    pthread_t threads[INSERT_ALL_MAX_THREADS];
+    for(size_t i = 1; i < job_count; i++) {
+        if(pthread_create(&threads[i], NULL, phase, &jobs[i]) != 0) {
+            fprintf(stderr, "%s pthread_create failed\n", __func__);
+            abort();
+        }
+    }
+    phase(&jobs[0]);
+    bool valid = jobs[0].valid;
+    for(size_t i = 1; i < job_count; i++) {
+        pthread_join(threads[i], NULL);
+        valid = valid && jobs[i].valid;
+    }
+    return valid;
+}
+
+static bool insert_all(struct betree* tree, size_t count, const betree_sub_t* ids, const char** exprs)
+{
+    if(count == 0) {
+        return true;
+    }
+    struct ast_node** nodes = bcalloc(count * sizeof(*nodes));
+    struct betree_sub** subs = bcalloc(count * sizeof(*subs));
+    if(nodes == NULL || subs == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    size_t job_count = insert_all_thread_count(count);
+    struct insert_all_job jobs[INSERT_ALL_MAX_THREADS];
+    size_t per_job = count / job_count;
+    for(size_t i = 0; i < job_count; i++) {
+        jobs[i].tree = tree;
+        jobs[i].ids = ids;
+        jobs[i].exprs = exprs;
+        jobs[i].nodes = nodes;
+        jobs[i].subs = subs;
+        jobs[i].start = i * per_job;
+        jobs[i].end = i == job_count - 1 ? count : (i + 1) * per_job;
+        jobs[i].valid = true;
+    }
+
+    // Phase 1: parse and validate in parallel, nothing is inserted if one expression is invalid
+    if(!run_insert_all_phase(parse_all, jobs, job_count)) {
+        for(size_t i = 0; i < count; i++) {
+            if(nodes[i] != NULL) {
+                free_ast_node(nodes[i]);
+            }
+        }
+        bfree(nodes);
+        bfree(subs);
+        return false;
+    }
+
+    // Phase 2: string and enum ids go through the shared config maps, in input order
+    for(size_t i = 0; i < count; i++) {
+        assign_str_id(tree->config, nodes[i], false);
+        assign_ienum_id(tree->config, nodes[i], false);
+    }
+    run_insert_all_phase(prepare_all, jobs, job_count);
+    for(size_t i = 0; i < count; i++) {
+        nodes[i] = assign_pred_id(tree->config, nodes[i]);
+        // Shared subtrees are indexed here, the subs are made in parallel
+        index_list_bitmaps(tree->config, nodes[i]);
+    }
+    run_insert_all_phase(make_all_subs, jobs, job_count);
+
+    // Phase 3: build the tree top-down from all the subs at once
+    bool result = insert_be_tree_all(tree->config, subs, count, tree->cnode);
+    for(size_t i = 0; i < count; i++) {
+        sub_index_add(tree->sub_index, subs[i]);
+    }
+    clear_result_cache(tree->config->result_cache);
+    clear_sub_dependents(tree->config->dependents);
+    bfree(nodes);
+    bfree(subs);
+    return result;
+}
+
+/*
+ * Everything the tree owns is allocated and freed within these, against the tree's arena when it has one
+ */
+
+bool betree_delete(struct betree* betree, betree_sub_t id)
+{
+    struct arena* previous = set_current_arena(betree->arena);
+    bool result = delete_sub(betree, id);
+    set_current_arena(previous);
+    return result;
+}
+
+bool betree_change_boundaries(struct betree* tree, const char* expr)
+{
+    struct arena* previous = set_current_arena(tree->arena);
+    bool result = change_boundaries_with_expr(tree, expr);
+    set_current_arena(previous);
+    return result;
+}
+
+bool betree_insert_with_constants(struct betree* tree,
+    betree_sub_t id,
+    size_t constant_count,
+    const struct betree_constant** constants,
+    const char* expr)
+{
+    struct arena* previous = set_current_arena(tree->arena);
+    bool result = insert_with_constants(tree, id, constant_count, constants, expr);
+    set_current_arena(previous);
+    return result;
+}
+
+const struct betree_sub* betree_make_sub(struct betree* tree, betree_sub_t id, size_t constant_count, const struct betree_constant** constants, const char* expr)
+{
+    struct arena* previous = set_current_arena(tree->arena);
+    const struct betree_sub* sub = make_sub_with_constants(tree, id, constant_count, constants, expr);
+    set_current_arena(previous);
+    return sub;
+}
+
+const struct betree_sub* betree_make_sub_with_window(struct betree* tree,
+    betree_sub_t id,
+    size_t constant_count,
+    const struct betree_constant** constants,
+    const char* expr,
+    int64_t start,
+    int64_t end)
+{
+    const struct betree_sub* made = betree_make_sub(tree, id, constant_count, constants, expr);
+    if(made != NULL) {
+        struct betree_sub* sub = (struct betree_sub*)made;
+        sub->window_start = start;
+        sub->window_end = end;
+    }
+    return made;
+}
+
 bool betree_insert_sub(struct betree* tree, const struct betree_sub* sub)
 {
-    return insert_be_tree(tree->config, sub, tree->cnode, NULL);
+    struct arena* previous = set_current_arena(tree->arena);
+    bool result = insert_made_sub(tree, sub);
+    set_current_arena(previous);
+    return result;
 }
 
-bool betree_insert(struct betree* tree, betree_sub_t id, const char* expr)
+bool betree_insert_all(struct betree* tree, size_t count, const betree_sub_t* ids, const char** exprs)
 {
-    return betree_insert_with_constants(tree, id, 0, NULL, expr);
+    struct arena* previous = set_current_arena(tree->arena);
+    bool result = insert_all(tree, count, ids, exprs);
+    set_current_arena(previous);
+    return result;
 }
 
-static const struct betree_variable** make_environment(size_t attr_domain_count, const struct betree_event* event)
+static void fill_environment(const struct betree_event* event, struct betree_search_context* context)
 {
-    const struct betree_variable** preds = bcalloc(attr_domain_count * sizeof(*preds));
     for(size_t i = 0; i < event->variable_count; i++) {
         if(event->variables[i] != NULL) {
-            preds[event->variables[i]->attr_var.var] = event->variables[i];
+            context->preds[event->variables[i]->attr_var.var] = event->variables[i];
         }
     }
-    return preds;
 }
 
-static bool betree_search_with_event_filled(const struct betree* betree, struct betree_event* event, struct report* report)
+// Full searches go through the result cache when the tree has one
+static bool search_with_result_cache(
+    const struct betree* betree, struct betree_search_context* context, struct report* report)
+{
+    struct result_cache* cache = betree->config->result_cache;
+    if(cache == NULL) {
+        return betree_search_with_preds(betree->config, context, betree->cnode, report);
+    }
+    if(context->result_key == NULL) {
+        context->result_key = make_result_key();
+    }
+    fill_result_key(cache, betree->config, betree->cnode, context->preds, context->result_key);
+    if(result_cache_get(cache, context->result_key, report)) {
+        return true;
+    }
+    size_t before = report->matched;
+    bool result = betree_search_with_preds(betree->config, context, betree->cnode, report);
+    if(result) {
+        result_cache_put(cache, context->result_key, report->subs + before, report->matched - before);
+    }
+    return result;
+}
+
+static bool betree_search_with_event_filled(const struct betree* betree,
+    struct betree_event* event,
+    struct report* report,
+    struct betree_search_context* context)
 {
-    const struct betree_variable** variables
-        = make_environment(betree->config->attr_domain_count, event);
-    if(validate_variables(betree->config, variables) == false) {
+    reset_search_context(betree->config, context);
+    fill_environment(event, context);
+    if(validate_variables(betree->config, context->preds) == false) {
         fprintf(stderr, "Failed to validate event\n");
         return false;
     }
-    return betree_search_with_preds(betree->config, variables, betree->cnode, report);
+    return search_with_result_cache(betree, context, report);
 }
 
-static bool betree_exists_with_event_filled(const struct betree* betree, struct betree_event* event)
+static bool betree_exists_with_event_filled(
+    const struct betree* betree, struct betree_event* event, struct betree_search_context* context)
 {
-    const struct betree_variable** variables = make_environment(betree->config->attr_domain_count, event);
-    return betree_exists_with_preds(betree->config, variables, betree->cnode);
+    reset_search_context(betree->config, context);
+    fill_environment(event, context);
+    return betree_exists_with_preds(betree->config, context, betree->cnode);
 }
 
-bool betree_exists(const struct betree* tree, const char* event_str)
+bool betree_exists_with_context(
+    const struct betree* tree, const char* event_str, struct betree_search_context* context)
 {
-    struct betree_event* event = make_event_from_string(tree, event_str);
-    bool result = betree_exists_with_event_filled(tree, event);
+    struct betree_event* event = scan_event(tree->config, event_str, context);
+    if(event != NULL) {
+        return betree_exists_with_event_filled(tree, event, context);
+    }
+    event = make_event_from_string(tree, event_str);
+    bool result = betree_exists_with_event_filled(tree, event, context);
     free_event(event);
     return result;
 }
 
-bool betree_exists_with_event(const struct betree* betree, struct betree_event* event)
+bool betree_exists(const struct betree* tree, const char* event_str)
+{
+    struct betree_search_context* context = make_search_context(tree->config);
+    bool result = betree_exists_with_context(tree, event_str, context);
+    free_search_context(context);
+    return result;
+}
+
+bool betree_exists_with_event_and_context(
+    const struct betree* betree, struct betree_event* event, struct betree_search_context* context)
 {
     fill_event(betree->config, event);
-    sort_event_lists(event);
-    return betree_exists_with_event_filled(betree, event);
+    sort_event_lists(betree->config, event);
+    return betree_exists_with_event_filled(betree, event, context);
+}
+
+bool betree_exists_with_event(const struct betree* betree, struct betree_event* event)
+{
+    struct betree_search_context* context = make_search_context(betree->config);
+    bool result = betree_exists_with_event_and_context(betree, event, context);
+    free_search_context(context);
+    return result;
+}
+
+bool betree_search_with_context(const struct betree* tree,
+    const char* event_str,
+    struct report* report,
+    struct betree_search_context* context)
+{
+    // The scanner covers the common cases, anything else goes through the bison parser
+    struct betree_event* event = scan_event(tree->config, event_str, context);
+    if(event != NULL) {
+        return betree_search_with_event_filled(tree, event, report, context);
+    }
+    event = make_event_from_string(tree, event_str);
+    bool result = betree_search_with_event_filled(tree, event, report, context);
+    free_event(event);
+    return result;
 }
 
 bool betree_search(const struct betree* tree, const char* event_str, struct report* report)
 {
-    struct betree_event* event = make_event_from_string(tree, event_str);
-    bool result = betree_search_with_event_filled(tree, event, report);
+    struct betree_search_context* context = make_search_context(tree->config);
+    bool result = betree_search_with_context(tree, event_str, report, context);
+    free_search_context(context);
+    return result;
+}
+
+static bool search_limit_with_event_filled(const struct betree* betree,
+    struct betree_event* event,
+    size_t limit,
+    bool by_priority,
+    const struct match_sink* sink,
+    struct report* report,
+    struct betree_search_context* context)
+{
+    reset_search_context(betree->config, context);
+    fill_environment(event, context);
+    if(validate_variables(betree->config, context->preds) == false) {
+        fprintf(stderr, "Failed to validate event\n");
+        return false;
+    }
+    return betree_search_limit_with_preds(
+        betree->config, context, betree->cnode, limit, by_priority, sink, report);
+}
+
+static bool search_limit_with_context(const struct betree* tree,
+    const char* event_str,
+    size_t limit,
+    bool by_priority,
+    const struct match_sink* sink,
+    struct report* report,
+    struct betree_search_context* context)
+{
+    struct betree_event* event = scan_event(tree->config, event_str, context);
+    if(event != NULL) {
+        return search_limit_with_event_filled(tree, event, limit, by_priority, sink, report, context);
+    }
+    event = make_event_from_string(tree, event_str);
+    bool result = search_limit_with_event_filled(tree, event, limit, by_priority, sink, report, context);
     free_event(event);
     return result;
 }
 
-bool betree_search_with_event(const struct betree* betree, struct betree_event* event, struct report* report)
+bool betree_search_limit_with_context(const struct betree* tree,
+    const char* event_str,
+    size_t limit,
+    struct report* report,
+    struct betree_search_context* context)
+{
+    return search_limit_with_context(tree, event_str, limit, false, NULL, report, context);
+}
+
+bool betree_search_limit(const struct betree* tree, const char* event_str, size_t limit, struct report* report)
+{
+    struct betree_search_context* context = make_search_context(tree->config);
+    bool result = search_limit_with_context(tree, event_str, limit, false, NULL, report, context);
+    free_search_context(context);
+    return result;
+}
+
+bool betree_search_top_with_context(const struct betree* tree,
+    const char* event_str,
+    size_t limit,
+    struct report* report,
+    struct betree_search_context* context)
+{
+    return search_limit_with_context(tree, event_str, limit, true, NULL, report, context);
+}
+
+bool betree_search_top(const struct betree* tree, const char* event_str, size_t limit, struct report* report)
+{
+    struct betree_search_context* context = make_search_context(tree->config);
+    bool result = search_limit_with_context(tree, event_str, limit, true, NULL, report, context);
+    free_search_context(context);
+    return result;
+}
+
+bool betree_search_each_with_context(const struct betree* tree,
+    const char* event_str,
+    betree_match_callback callback,
+    void* data,
+    struct betree_search_context* context)
+{
+    struct match_sink sink = { .callback = callback, .data = data };
+    struct report report = { 0 };
+    return search_limit_with_context(tree, event_str, SIZE_MAX, false, &sink, &report, context);
+}
+
+bool betree_search_each(
+    const struct betree* tree, const char* event_str, betree_match_callback callback, void* data)
+{
+    struct betree_search_context* context = make_search_context(tree->config);
+    bool result = betree_search_each_with_context(tree, event_str, callback, data, context);
+    free_search_context(context);
+    return result;
+}
+
+struct betree_search_cursor {
+    struct betree_search_context* context;
+    // Owned when the event could not be read into the context's scratch
+    struct betree_event* event;
+    struct report* report;
+    struct search_steps steps;
+};
+
+struct betree_search_cursor* betree_make_search_cursor(const struct betree* tree,
+    const char* event_str,
+    struct report* report,
+    struct betree_search_context* context)
+{
+    struct betree_event* owned = NULL;
+    struct betree_event* event = scan_event(tree->config, event_str, context);
+    if(event == NULL) {
+        owned = event = make_event_from_string(tree, event_str);
+    }
+    reset_search_context(tree->config, context);
+    fill_environment(event, context);
+    if(validate_variables(tree->config, context->preds) == false) {
+        fprintf(stderr, "Failed to validate event\n");
+        free_event(owned);
+        return NULL;
+    }
+    struct betree_search_cursor* cursor = bcalloc(sizeof(*cursor));
+    if(cursor == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    cursor->context = context;
+    cursor->event = owned;
+    cursor->report = report;
+    start_search_steps(tree->config, context, tree->cnode, &cursor->steps);
+    return cursor;
+}
+
+bool betree_search_cursor_step(struct betree_search_cursor* cursor, size_t budget)
+{
+    return search_steps(cursor->context, &cursor->steps, budget, cursor->report);
+}
+
+void betree_free_search_cursor(struct betree_search_cursor* cursor)
+{
+    if(cursor == NULL) {
+        return;
+    }
+    free_event(cursor->event);
+    bfree(cursor);
+}
+
+struct betree_prepared_event {
+    // Kept for the trees whose ids differ from those it was prepared with
+    char* text;
+    // Only the variables of text when the event is a delta of base
+    struct betree_event* event;
+    const struct betree_prepared_event* base;
+    uint64_t ids_stamp;
+    // Indexed by variable id, the variables base doesn't change point into it
+    size_t pred_count;
+    const struct betree_variable** preds;
+    // Variables text sets, NULL unless the event is a delta
+    uint64_t* changed;
+    bool valid;
+};
+
+static struct betree_prepared_event* make_prepared_event(const struct betree* tree, const char* event_str)
+{
+    struct betree_prepared_event* prepared = bcalloc(sizeof(*prepared));
+    if(prepared == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    prepared->text = bstrdup(event_str);
+    prepared->event = make_event_from_string(tree, event_str);
+    prepared->base = NULL;
+    prepared->ids_stamp = tree->config->ids_stamp;
+    prepared->pred_count = tree->config->attr_domain_count;
+    prepared->preds = bcalloc((prepared->pred_count == 0 ? 1 : prepared->pred_count) * sizeof(*prepared->preds));
+    if(prepared->preds == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    prepared->changed = NULL;
+    return prepared;
+}
+
+static void set_prepared_preds(struct betree_prepared_event* prepared, const struct betree_event* event)
+{
+    for(size_t i = 0; i < event->variable_count; i++) {
+        const struct betree_variable* variable = event->variables[i];
+        if(variable != NULL) {
+            prepared->preds[variable->attr_var.var] = variable;
+        }
+    }
+}
+
+// The whole event for the ids of tree, a delta is read again on top of its base
+static struct betree_event* make_event_from_prepared(const struct betree* tree, const struct betree_prepared_event* prepared)
+{
+    struct betree_event* event = make_event_from_string(tree, prepared->text);
+    if(prepared->base == NULL) {
+        return event;
+    }
+    struct betree_event* merged = make_event_from_prepared(tree, prepared->base);
+    merge_events(merged, event);
+    return merged;
+}
+
+struct betree_prepared_event* betree_prepare_event(const struct betree* tree, const char* event_str)
+{
+    struct betree_prepared_event* prepared = make_prepared_event(tree, event_str);
+    set_prepared_preds(prepared, prepared->event);
+    prepared->valid = validate_variables(tree->config, prepared->preds);
+    return prepared;
+}
+
+struct betree_prepared_event* betree_prepare_delta(
+    const struct betree* tree, const struct betree_prepared_event* base, const char* delta_str)
+{
+    struct betree_prepared_event* prepared = make_prepared_event(tree, delta_str);
+    prepared->base = base;
+    prepared->changed = bcalloc((prepared->pred_count / 64 + 1) * sizeof(*prepared->changed));
+    if(prepared->changed == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    for(size_t i = 0; i < prepared->event->variable_count; i++) {
+        const struct betree_variable* variable = prepared->event->variables[i];
+        if(variable != NULL) {
+            set_bit(prepared->changed, variable->attr_var.var);
+        }
+    }
+    if(base->ids_stamp == prepared->ids_stamp) {
+        memcpy(prepared->preds, base->preds, base->pred_count * sizeof(*prepared->preds));
+    }
+    else {
+        // The variables of base can't be shared, the whole event is read again
+        free_event(prepared->event);
+        prepared->event = make_event_from_prepared(tree, prepared);
+    }
+    set_prepared_preds(prepared, prepared->event);
+    prepared->valid = validate_variables(tree->config, prepared->preds);
+    return prepared;
+}
+
+void betree_free_prepared_event(struct betree_prepared_event* prepared)
+{
+    if(prepared == NULL) {
+        return;
+    }
+    bfree(prepared->text);
+    free_event(prepared->event);
+    bfree(prepared->preds);
+    bfree(prepared->changed);
+    bfree(prepared);
+}
+
+bool betree_search_prepared(const struct betree* tree,
+    const struct betree_prepared_event* prepared,
+    struct report* report,
+    struct betree_search_context* context)
+{
+    if(prepared->ids_stamp != tree->config->ids_stamp) {
+        if(prepared->base == NULL) {
+            return betree_search_with_context(tree, prepared->text, report, context);
+        }
+        struct betree_event* event = make_event_from_prepared(tree, prepared);
+        bool result = betree_search_with_event_filled(tree, event, report, context);
+        free_event(event);
+        return result;
+    }
+    if(!prepared->valid) {
+        fprintf(stderr, "Failed to validate event\n");
+        return false;
+    }
+    reset_search_context(tree->config, context);
+    memcpy(context->preds, prepared->preds, prepared->pred_count * sizeof(*context->preds));
+    return search_with_result_cache(tree, context, report);
+}
+
+bool betree_search_delta(const struct betree* tree,
+    const struct betree_prepared_event* previous,
+    const struct report* previous_report,
+    const struct betree_prepared_event* next,
+    struct report* report,
+    struct betree_search_context* context)
+{
+    uint64_t ids_stamp = tree->config->ids_stamp;
+    if(next->base != previous || previous->ids_stamp != ids_stamp || next->ids_stamp != ids_stamp
+        || !previous->valid || !next->valid) {
+        return betree_search_prepared(tree, next, report, context);
+    }
+    reset_search_context(tree->config, context);
+    memcpy(context->preds, next->preds, next->pred_count * sizeof(*context->preds));
+    return betree_search_delta_with_preds(tree->config, context, tree->cnode, next->changed, previous_report, report);
+}
+
+bool betree_set_priority(struct betree* betree, betree_sub_t id, int64_t priority)
+{
+    struct betree_sub* sub = sub_index_find(betree->sub_index, id);
+    if(sub == NULL) {
+        return false;
+    }
+    sub->priority = priority;
+    return true;
+}
+
+bool betree_set_sub_window(struct betree* betree, betree_sub_t id, int64_t start, int64_t end)
+{
+    struct betree_sub* sub = sub_index_find(betree->sub_index, id);
+    if(sub == NULL) {
+        return false;
+    }
+    struct arena* previous = set_current_arena(betree->arena);
+    bool active = sub->active;
+    sub->window_start = start;
+    sub->window_end = end;
+    schedule_activation(betree->config->activation, sub);
+    if(sub->active != active) {
+        clear_result_cache(betree->config->result_cache);
+    }
+    set_current_arena(previous);
+    return true;
+}
+
+bool betree_advance_time(struct betree* betree, int64_t now)
+{
+    if(now < betree->config->activation->now) {
+        return false;
+    }
+    struct arena* previous = set_current_arena(betree->arena);
+    if(advance_activation(betree->config->activation, now) != 0) {
+        clear_result_cache(betree->config->result_cache);
+    }
+    set_current_arena(previous);
+    return true;
+}
+
+int64_t betree_get_time(const struct betree* betree)
+{
+    return betree->config->activation->now;
+}
+
+bool betree_search_with_event_and_context(const struct betree* betree,
+    struct betree_event* event,
+    struct report* report,
+    struct betree_search_context* context)
 {
     fill_event(betree->config, event);
-    sort_event_lists(event);
-    return betree_search_with_event_filled(betree, event, report);
+    sort_event_lists(betree->config, event);
+    return betree_search_with_event_filled(betree, event, report, context);
+}
+
+bool betree_search_with_event(const struct betree* betree, struct betree_event* event, struct report* report)
+{
+    struct betree_search_context* context = make_search_context(betree->config);
+    bool result = betree_search_with_event_and_context(betree, event, report, context);
+    free_search_context(context);
+    return result;
+}
+
+bool betree_search_batch_with_contexts(const struct betree* betree,
+    struct betree_event** events,
+    size_t count,
+    struct report** reports,
+    struct betree_search_context** contexts)
+{
+    bool result = true;
+    for(size_t start = 0; start < count; start += BETREE_BATCH_SIZE) {
+        size_t batch_count = smin(count - start, BETREE_BATCH_SIZE);
+        uint64_t live = 0;
+        for(size_t i = 0; i < batch_count; i++) {
+            struct betree_event* event = events[start + i];
+            struct betree_search_context* context = contexts[start + i];
+            fill_event(betree->config, event);
+            sort_event_lists(betree->config, event);
+            reset_search_context(betree->config, context);
+            fill_environment(event, context);
+            if(validate_variables(betree->config, context->preds) == false) {
+                fprintf(stderr, "Failed to validate event\n");
+                result = false;
+                continue;
+            }
+            live |= 1ULL << i;
+        }
+        betree_search_batch_with_preds(betree->config, contexts + start, live, betree->cnode, reports + start);
+    }
+    return result;
+}
+
+bool betree_search_batch(
+    const struct betree* betree, struct betree_event** events, size_t count, struct report** reports)
+{
+    struct betree_search_context* contexts[BETREE_BATCH_SIZE];
+    size_t context_count = smin(count, BETREE_BATCH_SIZE);
+    for(size_t i = 0; i < context_count; i++) {
+        contexts[i] = make_search_context(betree->config);
+    }
+    bool result = true;
+    for(size_t start = 0; start < count; start += BETREE_BATCH_SIZE) {
+        size_t batch_count = smin(count - start, BETREE_BATCH_SIZE);
+        if(!betree_search_batch_with_contexts(betree, events + start, batch_count, reports + start, contexts)) {
+            result = false;
+        }
+    }
+    for(size_t i = 0; i < context_count; i++) {
+        free_search_context(contexts[i]);
+    }
+    return result;
+}
+
+struct betree_search_context* betree_make_search_context(const struct betree* betree)
+{
+    return make_search_context(betree->config);
+}
+
+void betree_free_search_context(struct betree_search_context* context)
+{
+    free_search_context(context);
 }
 
 struct report* make_report()
@@ -653,10 +1387,20 @@ struct report* make_report()
     report->matched = 0;
     report->memoized = 0;
     report->shorted = 0;
+    report->capacity = 0;
     report->subs = NULL;
     return report;
 }
 
+void betree_report_reset(struct report* report)
+{
+    // Keep the subs buffer around so the next search can reuse it
+    report->evaluated = 0;
+    report->matched = 0;
+    report->memoized = 0;
+    report->shorted = 0;
+}
+
 void free_report(struct report* report)
 {
     bfree(report->subs);
@@ -667,10 +1411,12 @@ static void betree_init_with_config(struct betree* betree, struct config* config
 {
     betree->config = config;
     betree->cnode = make_cnode(betree->config, NULL);
+    betree->sub_index = make_sub_index();
 }
 
 void betree_init(struct betree* betree)
 {
+    betree->arena = NULL;
     struct config* config = make_default_config();
     betree_init_with_config(betree, config);
 }
@@ -692,14 +1438,128 @@ struct betree* betree_make()
     return betree_make_with_config(config);
 }
 
+static bool valid_parameters(uint64_t lnode_max_cap, uint64_t min_partition_size)
+{
+    return lnode_max_cap != 0 && lnode_max_cap <= UINT32_MAX && min_partition_size <= UINT32_MAX;
+}
+
 struct betree* betree_make_with_parameters(uint64_t lnode_max_cap, uint64_t min_partition_size)
 {
+    if(!valid_parameters(lnode_max_cap, min_partition_size)) {
+        return NULL;
+    }
+    struct config* config = make_config(lnode_max_cap, min_partition_size);
+    return betree_make_with_config(config);
+}
+
+static struct betree* make_tree_in_arena(struct arena* arena, uint64_t lnode_max_cap, uint64_t min_partition_size)
+{
+    struct betree* tree = bcalloc(sizeof(*tree));
+    if(tree == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    tree->arena = arena;
+    struct arena* previous = set_current_arena(tree->arena);
     struct config* config = make_config(lnode_max_cap, min_partition_size);
+    betree_init_with_config(tree, config);
+    set_current_arena(previous);
+    return tree;
+}
+
+struct betree* betree_make_with_arena(uint64_t lnode_max_cap, uint64_t min_partition_size)
+{
+    if(!valid_parameters(lnode_max_cap, min_partition_size)) {
+        return NULL;
+    }
+    return make_tree_in_arena(make_arena(), lnode_max_cap, min_partition_size);
+}
+
+struct betree* betree_make_with_huge_pages(uint64_t lnode_max_cap, uint64_t min_partition_size)
+{
+    if(!valid_parameters(lnode_max_cap, min_partition_size)) {
+        return NULL;
+    }
+    return make_tree_in_arena(make_huge_page_arena(), lnode_max_cap, min_partition_size);
+}
+
+struct betree_params betree_default_params()
+{
+    struct config* config = make_default_config();
+    struct betree_params params = {
+        .lnode_max_cap = config->lnode_max_cap,
+        .partition_min_size = config->partition_min_size,
+        .max_domain_for_split = config->max_domain_for_split,
+    };
+    free_config(config);
+    return params;
+}
+
+struct betree* betree_make_with_params(const struct betree_params* params)
+{
+    if(params->lnode_max_cap == 0) {
+        return NULL;
+    }
+    struct config* config = make_config(params->lnode_max_cap, params->partition_min_size);
+    config->max_domain_for_split = params->max_domain_for_split;
     return betree_make_with_config(config);
 }
 
+struct betree_params betree_get_params(const struct betree* betree)
+{
+    struct betree_params params = {
+        .lnode_max_cap = betree->config->lnode_max_cap,
+        .partition_min_size = betree->config->partition_min_size,
+        .max_domain_for_split = betree->config->max_domain_for_split,
+    };
+    return params;
+}
+
+bool betree_set_params(struct betree* betree, const struct betree_params* params)
+{
+    struct cnode* root = betree->cnode;
+    if(params->lnode_max_cap == 0 || root->lnode->sub_count != 0 || root->pdir != NULL) {
+        return false;
+    }
+    betree->config->lnode_max_cap = params->lnode_max_cap;
+    betree->config->partition_min_size = params->partition_min_size;
+    betree->config->max_domain_for_split = params->max_domain_for_split;
+    // The root lnode took the old capacity when it was made
+    root->lnode->max = params->lnode_max_cap;
+    return true;
+}
+
+bool betree_save(const struct betree* betree, const char* path)
+{
+    return save_snapshot(betree, path);
+}
+
+struct betree* betree_load(const char* path)
+{
+    struct betree* tree = bcalloc(sizeof(*tree));
+    if(tree == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    if(!load_snapshot(tree, path)) {
+        bfree(tree);
+        return NULL;
+    }
+    return tree;
+}
+
 void betree_deinit(struct betree* betree)
 {
+    if(betree->arena != NULL) {
+        // The tree and the sub index are entirely in the arena, parts of the config can be on the heap
+        struct arena* previous = set_current_arena(betree->arena);
+        free_config(betree->config);
+        set_current_arena(previous);
+        free_arena(betree->arena);
+        betree->arena = NULL;
+        return;
+    }
+    free_sub_index(betree->sub_index);
     free_cnode(betree->cnode);
     free_config(betree->config);
 }
@@ -710,6 +1570,152 @@ void betree_free(struct betree* betree)
     bfree(betree);
 }
 
+void betree_set_reorder_expressions(struct betree* betree, bool reorder)
+{
+    betree->config->reorder_expressions = reorder;
+}
+
+void betree_set_prefilter(struct betree* betree, bool prefilter)
+{
+    struct arena* previous = set_current_arena(betree->arena);
+    betree->config->prefilter = prefilter;
+    index_be_tree_postings(betree->cnode, prefilter);
+    set_current_arena(previous);
+}
+
+void betree_set_columns(struct betree* betree, bool columns)
+{
+    struct arena* previous = set_current_arena(betree->arena);
+    betree->config->columns = columns;
+    index_be_tree_columns(betree->cnode, columns);
+    set_current_arena(previous);
+}
+
+void betree_set_balanced_splits(struct betree* betree, bool balanced)
+{
+    betree->config->balanced_splits = balanced;
+}
+
+void betree_set_recursive_search(struct betree* betree, bool recursive)
+{
+    betree->config->recursive_search = recursive;
+}
+
+void betree_set_presorted_lists(struct betree* betree, bool presorted)
+{
+    betree->config->presorted_lists = presorted;
+}
+
+void betree_set_search_threads(struct betree* betree, size_t thread_count)
+{
+    betree->config->search_threads = smax(1, thread_count);
+}
+
+bool betree_set_jit_threshold(struct betree* betree, uint64_t threshold)
+{
+    if(!jit_supported()) {
+        return false;
+    }
+    betree->config->jit_threshold = threshold;
+#ifdef BETREE_JIT
+    size_t count = 0;
+    collect_subs(betree->cnode, NULL, &count);
+    struct betree_sub** subs = bmalloc((count + 1) * sizeof(*subs));
+    if(subs == NULL) {
+        fprintf(stderr, "%s bmalloc failed\n", __func__);
+        abort();
+    }
+    count = 0;
+    collect_subs(betree->cnode, subs, &count);
+    for(size_t i = 0; i < count; i++) {
+        if(subs[i]->native == NULL) {
+            subs[i]->jit_countdown = threshold;
+        }
+    }
+    bfree(subs);
+#endif
+    return true;
+}
+
+void betree_set_parse_cache(struct betree* betree, size_t capacity)
+{
+    free_parse_cache(betree->config->parse_cache);
+    betree->config->parse_cache = capacity == 0 ? NULL : make_parse_cache(capacity);
+}
+
+void betree_set_result_cache(struct betree* betree, size_t capacity, int64_t now_bucket)
+{
+    free_result_cache(betree->config->result_cache);
+    betree->config->result_cache = capacity == 0 ? NULL : make_result_cache(capacity, now_bucket);
+}
+
+void betree_rebalance(struct betree* betree, struct betree_event_sample* sample)
+{
+    struct arena* previous = set_current_arena(betree->arena);
+    pthread_mutex_lock(&sample->lock);
+    betree->config->event_sample = sample;
+    rebuild_be_tree(betree->config, betree->cnode);
+    betree->config->event_sample = NULL;
+    pthread_mutex_unlock(&sample->lock);
+    set_current_arena(previous);
+}
+
+void betree_pack(struct betree* betree)
+{
+    struct arena* previous = set_current_arena(betree->arena);
+    build_string_matchers(betree->config->pred_map->strings);
+    set_current_arena(previous);
+}
+
+void betree_order_by_hits(struct betree* betree)
+{
+    struct arena* previous = set_current_arena(betree->arena);
+    order_be_tree_by_hits(betree->cnode);
+    set_current_arena(previous);
+}
+
+void betree_reset_stats(struct betree* betree)
+{
+    reset_stats_cnode(betree->cnode);
+}
+
+size_t betree_most_expensive_subs(const struct betree* betree, size_t n, struct betree_sub_stats* stats)
+{
+#ifdef BETREE_STATS
+    size_t count = 0;
+    const struct sub_index* index = betree->sub_index;
+    for(size_t b = 0; b < index->bucket_count; b++) {
+        for(const struct sub_index_entry* entry = index->buckets[b]; entry != NULL; entry = entry->next) {
+            const struct betree_sub* sub = entry->sub;
+            // Insertion into the n kept so far, the cheapest falls off the end
+            size_t i = count;
+            while(i > 0 && stats[i - 1].cycles < sub->stats.cycles) {
+                if(i < n) {
+                    stats[i] = stats[i - 1];
+                }
+                i--;
+            }
+            if(i < n) {
+                stats[i].id = sub->id;
+                stats[i].evaluations = sub->stats.evaluations;
+                stats[i].cycles = sub->stats.cycles;
+                stats[i].passes = sub->stats.passes;
+                stats[i].shorted = sub->stats.shorted;
+                if(count < n) {
+                    count++;
+                }
+            }
+        }
+    }
+    return count;
+#else
+    (void)betree;
+    (void)n;
+    (void)stats;
+    return 0;
+#endif
+}
+
 void betree_add_boolean_variable(struct betree* betree, const char* name, bool allow_undefined)
 {
     add_attr_domain_b(betree->config, name, allow_undefined);
@@ -808,6 +1814,7 @@ struct betree_string_list* betree_make_string_list(size_t count)
     struct betree_string_list* list = bmalloc(sizeof(*list));
     list->count = count;
     list->strings = bcalloc(count * sizeof(*list->strings));
+    list->bitmap = NULL;
     return list;
 }
 
@@ -821,19 +1828,34 @@ struct betree_segments* betree_make_segments(size_t count)
 {
     struct betree_segments* segments = bmalloc(sizeof(*segments));
     segments->size = count;
+    segments->capacity = count;
     segments->content = bcalloc(count * sizeof(*segments->content));
     return segments;
 }
 
+struct betree_segments* betree_make_segments_from_array(
+    size_t count, const int64_t* ids, const int64_t* timestamps)
+{
+    struct betree_segments* segments = betree_make_segments(count);
+    for(size_t i = 0; i < count; i++) {
+        segments->content[i] = make_segment(ids[i], timestamps[i]);
+    }
+    return segments;
+}
+
 struct betree_segment* betree_make_segment(int64_t id, int64_t timestamp)
 {
-    return make_segment(id, timestamp);
+    struct betree_segment* segment = bmalloc(sizeof(*segment));
+    *segment = make_segment(id, timestamp);
+    return segment;
 }
 
 void betree_add_segment(
     struct betree_segments* segments, size_t index, struct betree_segment* segment)
 {
-    segments->content[index] = segment;
+    // The list keeps a copy
+    segments->content[index] = *segment;
+    bfree(segment);
 }
 
 
@@ -841,7 +1863,10 @@ struct betree_frequency_caps* betree_make_frequency_caps(size_t count)
 {
     struct betree_frequency_caps* frequency_caps = bmalloc(sizeof(*frequency_caps));
     frequency_caps->size = count;
+    frequency_caps->capacity = count;
     frequency_caps->content = bcalloc(count * sizeof(*frequency_caps->content));
+    frequency_caps->slot_count = 0;
+    frequency_caps->slots = NULL;
     return frequency_caps;
 }
 
@@ -854,14 +1879,36 @@ struct betree_frequency_cap* betree_make_frequency_cap(const char* stype,
 {
     struct string_value namespace
         = { .string = bstrdup(ns), .str = INVALID_STR, .var = INVALID_VAR };
-    return make_frequency_cap(stype, id, namespace, timestamp_defined, timestamp, value);
+    struct betree_frequency_cap* frequency_cap = bmalloc(sizeof(*frequency_cap));
+    *frequency_cap = make_frequency_cap(stype, id, namespace, timestamp_defined, timestamp, value);
+    return frequency_cap;
+}
+
+struct betree_frequency_caps* betree_make_frequency_caps_from_array(size_t count,
+    const char** stypes,
+    const uint32_t* ids,
+    const char** namespaces,
+    const bool* timestamp_defined,
+    const int64_t* timestamps,
+    const uint32_t* values)
+{
+    struct betree_frequency_caps* frequency_caps = betree_make_frequency_caps(count);
+    for(size_t i = 0; i < count; i++) {
+        struct string_value namespace
+            = { .string = bstrdup(namespaces[i]), .str = INVALID_STR, .var = INVALID_VAR };
+        frequency_caps->content[i] = make_frequency_cap(
+            stypes[i], ids[i], namespace, timestamp_defined[i], timestamps[i], values[i]);
+    }
+    return frequency_caps;
 }
 
 void betree_add_frequency_cap(struct betree_frequency_caps* frequency_caps,
     size_t index,
     struct betree_frequency_cap* frequency_cap)
 {
-    frequency_caps->content[index] = frequency_cap;
+    // The list keeps a copy and takes over the namespace
+    frequency_caps->content[index] = *frequency_cap;
+    bfree(frequency_cap);
 }
 
 static struct betree_variable* betree_make_variable(const char* name, struct value value)
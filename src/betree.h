@@ -8,10 +8,70 @@ typedef uint64_t betree_sub_t;
 
 struct config;
 struct cnode;
+struct sub_index;
+
+struct arena;
 
 struct betree {
     struct config* config;
     struct cnode* cnode;
+    struct sub_index* sub_index;
+    // Owns every tree object when set, see betree_make_with_arena
+    struct arena* arena;
+};
+
+// Cost of a sub across searches, see betree_most_expensive_subs
+struct betree_sub_stats {
+    betree_sub_t id;
+    uint64_t evaluations;
+    uint64_t cycles;
+    uint64_t passes;
+    uint64_t shorted;
+};
+
+// How a tree is partitioned as subs come in, see betree_make_with_params
+struct betree_params {
+    // Subs an lnode holds before it is split, at least 1. Bigger lnodes make shallower trees with
+    // fewer nodes, searches evaluate more subs per lnode they reach
+    uint32_t lnode_max_cap;
+    // Attributes fewer subs of a full lnode use are not split on
+    uint32_t partition_min_size;
+    // Bounded attributes with a wider domain are not split on, booleans always are
+    uint32_t max_domain_for_split;
+};
+
+// Bytes held by one part of a tree and how many of its objects there are, see betree_memory_stats
+struct betree_memory_usage {
+    size_t bytes;
+    size_t count;
+};
+
+struct betree_memory_stats {
+    // The tree and its config
+    struct betree_memory_usage tree;
+    struct betree_memory_usage attr_domains;
+    // Counts the strings and integers held
+    struct betree_memory_usage string_maps;
+    struct betree_memory_usage integer_maps;
+    // Slots and string matchers, counts the nodes in the map
+    struct betree_memory_usage pred_map;
+    // Counts the entries, with the activation timers and the subs by attribute
+    struct betree_memory_usage sub_index;
+    struct betree_memory_usage cnodes;
+    // With their sub arrays, short circuit masks and posting lists
+    struct betree_memory_usage lnodes;
+    struct betree_memory_usage pdirs;
+    struct betree_memory_usage pnodes;
+    struct betree_memory_usage cdirs;
+    // With their attribute and short circuit bitsets, compiled programs and cached bounds
+    struct betree_memory_usage subs;
+    // Nodes shared by several subs are counted once
+    struct betree_memory_usage ast;
+    // Counts the texts kept, see betree_set_parse_cache
+    struct betree_memory_usage parse_cache;
+    // Counts the events kept, see betree_set_result_cache
+    struct betree_memory_usage result_cache;
+    size_t total_bytes;
 };
 
 struct report {
@@ -19,6 +79,7 @@ struct report {
     size_t matched;
     size_t memoized;
     size_t shorted;
+    size_t capacity;
     betree_sub_t* subs;
 };
 
@@ -62,11 +123,16 @@ struct betree_string_list* betree_make_string_list(size_t count);
 void betree_add_string(struct betree_string_list* list, size_t index, const char* value);
 
 struct betree_segments* betree_make_segments(size_t count);
+// Segments are stored in one array, building them from arrays skips the per segment allocations
+struct betree_segments* betree_make_segments_from_array(size_t count, const int64_t* ids, const int64_t* timestamps);
 struct betree_segment* betree_make_segment(int64_t id, int64_t timestamp);
+// Copies the segment into the list and frees it
 void betree_add_segment(struct betree_segments* segments, size_t index, struct betree_segment* segment);
 
 struct betree_frequency_caps* betree_make_frequency_caps(size_t count);
+struct betree_frequency_caps* betree_make_frequency_caps_from_array(size_t count, const char** stypes, const uint32_t* ids, const char** namespaces, const bool* timestamp_defined, const int64_t* timestamps, const uint32_t* values);
 struct betree_frequency_cap* betree_make_frequency_cap(const char* stype, uint32_t id, const char* ns, bool timestamp_defined, int64_t timestamp, uint32_t value);
+// Copies the cap into the list and frees it, the list takes over the namespace
 void betree_add_frequency_cap(struct betree_frequency_caps* frequency_caps, size_t index, struct betree_frequency_cap* frequency_cap);
 
 struct betree_variable_definition {
@@ -79,7 +145,85 @@ struct betree_variable_definition {
  */
 void betree_init(struct betree* betree);
 struct betree* betree_make();
+// NULL when lnode_max_cap is 0 or a value does not fit the uint32_t of betree_params
 struct betree* betree_make_with_parameters(uint64_t lnode_max_cap, uint64_t min_partition_size);
+// Subs and tree nodes are carved from an arena released at once by betree_free.
+// Only the betree_* functions may build or change such a tree. NULL like betree_make_with_parameters
+struct betree* betree_make_with_arena(uint64_t lnode_max_cap, uint64_t min_partition_size);
+// betree_make_with_arena with the slabs of the arena on huge pages, see make_huge_page_arena. Clones
+// and live versions of the tree keep them
+struct betree* betree_make_with_huge_pages(uint64_t lnode_max_cap, uint64_t min_partition_size);
+// 3, 0 and 1000, what betree_make uses
+struct betree_params betree_default_params();
+// NULL when lnode_max_cap is 0
+struct betree* betree_make_with_params(const struct betree_params* params);
+struct betree_params betree_get_params(const struct betree* betree);
+// False when lnode_max_cap is 0 or the tree already has subs
+bool betree_set_params(struct betree* betree, const struct betree_params* params);
+// Inserts the exprs into empty copies of the variables and settings of the tree, one per candidate
+// lnode capacity and split domain, and times searches of the events on each. Fills params with the
+// fastest, or the one using the least memory within 5% of it. The tree is left as is, false when an
+// expression or event is invalid. Sample a few thousand subs and events of the corpus
+bool betree_tune_params(const struct betree* betree, size_t count, const char** exprs,
+    size_t event_count, const char** events, struct betree_params* params);
+// Independent copy with the same subs, settings and shape, for staging changes. Copies each shared
+// predicate once and skips the partitioning of a rebuild. Its string predicates are not indexed, see
+// betree_pack
+struct betree* betree_clone(const struct betree* betree);
+
+// Off by default, applies to subs inserted afterwards
+void betree_set_reorder_expressions(struct betree* betree, bool reorder);
+// Off by default, builds or drops the posting lists of the subs already inserted.
+// Does not change which subs match, only how many get evaluated
+void betree_set_prefilter(struct betree* betree, bool prefilter);
+// Off by default, builds or drops the columns of the subs already inserted. Lnodes keep the ranges
+// their subs ask of up to 4 attributes through "a < X", "a >= X" or "a = X" operands of the top AND
+// chain, and skip the subs an event is out of range of. Lnodes with posting lists use those instead.
+// Not kept in snapshots, does not change which subs match, only how many get evaluated
+void betree_set_columns(struct betree* betree, bool columns);
+// On by default, cdirs split afterwards pick between the middle of their range and the median of their subs
+void betree_set_balanced_splits(struct betree* betree, bool balanced);
+// Off by default, searches walk the tree with the older recursive traversal, for benchmarks
+void betree_set_recursive_search(struct betree* betree, bool recursive);
+// Off by default, the caller promises that the integer lists and segments of its events are sorted
+// in ascending order without repeats so they are not checked. String and enum lists are ordered by
+// ids the tree hands out and still get sorted. Lists that break the promise give wrong results
+void betree_set_presorted_lists(struct betree* betree, bool presorted);
+// 1 by default. Full searches whose events leave many candidate subs evaluate them on up to that many
+// threads, at most 16, with the same results in the same order. Small searches stay on the caller
+void betree_set_search_threads(struct betree* betree, size_t thread_count);
+// 0 by default. Keeps the parses of up to about capacity expression texts, so inserting a text again,
+// with the same or other constants, copies its parse instead. A text replaces the one that hashes
+// to the same slot, 0 drops the cache
+void betree_set_parse_cache(struct betree* betree, size_t capacity);
+// 0 by default. Keeps the matches of up to about capacity events, keyed by the values of the
+// attributes some sub uses, so that searching an event again, or one only differing in other
+// attributes, copies its matches instead. Frequency caps and segment predicates also key on now,
+// rounded down to a multiple of now_bucket seconds when it is above 1, which makes those matches as
+// of the first event of the bucket. Inserting or deleting subs drops the matches, 0 drops the cache
+void betree_set_result_cache(struct betree* betree, size_t capacity, int64_t now_bucket);
+// 0 by default. In builds made with JIT=1 on x86-64, subs evaluated threshold times from now on get
+// their expression compiled to native code, which searches run instead afterwards. Native code skips
+// memoization, so it changes the memoized count of the reports but not which subs match. 0 stops
+// compiling more subs, false when the build has no native tier
+bool betree_set_jit_threshold(struct betree* betree, uint64_t threshold);
+// Indexes the string predicates so that each event string is scanned once for all contains,
+// starts_with and ends_with, best once the tree is built. String predicates inserted afterwards are
+// evaluated one by one until the next call
+void betree_pack(struct betree* betree);
+// Exists searches try the candidate subs of an lnode in its order and stop at the first match. Puts
+// the subs that answered the most of them since the last call first in their lnode, and halves the
+// counts. Meant to be called every so often, no search may run meanwhile. Full searches then list
+// their matches in the new order
+void betree_order_by_hits(struct betree* betree);
+// Zeroes the per-node and per-sub search counters, only kept when built with make STATS=1
+void betree_reset_stats(struct betree* betree);
+// Fills stats with up to n subs that took the most cycles to evaluate, most expensive first, and
+// returns how many were filled. Always 0 unless built with make STATS=1
+size_t betree_most_expensive_subs(const struct betree* betree, size_t n, struct betree_sub_stats* stats);
+// Walks the tree and asks the allocator for the size of each block, slack included. Not safe
+// during inserts or deletes, searches may run meanwhile
+void betree_memory_stats(const struct betree* betree, struct betree_memory_stats* stats);
 
 void betree_add_boolean_variable(struct betree* betree, const char* name, bool allow_undefined);
 void betree_add_integer_variable(struct betree* betree, const char* name, bool allow_undefined, int64_t min, int64_t max);
@@ -91,15 +235,26 @@ void betree_add_string_list_variable(struct betree* betree, const char* name, bo
 void betree_add_segments_variable(struct betree* betree, const char* name, bool allow_undefined);
 void betree_add_frequency_caps_variable(struct betree* betree, const char* name, bool allow_undefined);
 
+// Widens the domains of the variables to fit the expression. The outer cdirs of the tree widen with
+// them and take down the subs that then fit, the rest of the tree keeps its shape
 bool betree_change_boundaries(struct betree* tree, const char* expr);
 
 const struct betree_sub* betree_make_sub(struct betree* tree, betree_sub_t id, size_t constant_count, const struct betree_constant** constants, const char* expr);
+// Like betree_make_sub, the sub is only a candidate of searches while the clock of the tree is in
+// [start, end] once inserted. Unlike now >= start and now <= end in the expression, subs out of their
+// window are skipped before any of their predicates run
+const struct betree_sub* betree_make_sub_with_window(struct betree* tree,
+    betree_sub_t id,
+    size_t constant_count,
+    const struct betree_constant** constants,
+    const char* expr,
+    int64_t start,
+    int64_t end);
 bool betree_insert_sub(struct betree* tree, const struct betree_sub* sub);
 
 /*
  * Runtime
  */
-//bool betree_insert_all(struct betree* tree, size_t count, const char** exprs);
 struct betree_variable_definition betree_get_variable_definition(struct betree* betree, size_t index);
 
 struct betree_constant* betree_make_integer_constant(const char* name, int64_t integer_value);
@@ -117,17 +272,281 @@ struct betree_event* betree_make_event(const struct betree* betree);
 void betree_set_variable(struct betree_event* event, size_t index, struct betree_variable* variable);
 
 bool betree_insert(struct betree* tree, betree_sub_t id, const char* expr);
+// Bulk load, parses in parallel and builds the tree in one pass, inserts nothing if an expression is invalid
+bool betree_insert_all(struct betree* tree, size_t count, const betree_sub_t* ids, const char** exprs);
 bool betree_insert_with_constants(struct betree* tree, betree_sub_t id, size_t constant_count, const struct betree_constant** constants, const char* expr);
 
 bool betree_search(const struct betree* tree, const char* event_str, struct report* report);
 bool betree_search_with_event(const struct betree* betree, struct betree_event* event, struct report* report);
 
+// Stops evaluating subs once limit of them matched, which ones is left to the tree
+bool betree_search_limit(const struct betree* tree, const char* event_str, size_t limit, struct report* report);
+// The limit matching subs of highest priority, ties broken by lowest id
+bool betree_search_top(const struct betree* tree, const char* event_str, size_t limit, struct report* report);
+// Called with each match in the order betree_search would report it, returning false ends the search
+typedef bool (*betree_match_callback)(betree_sub_t id, void* data);
+bool betree_search_each(const struct betree* tree, const char* event_str, betree_match_callback callback, void* data);
+// Subs start with a priority of 0, false when no sub has that id
+bool betree_set_priority(struct betree* betree, betree_sub_t id, int64_t priority);
+// Subs are active from INT64_MIN to INT64_MAX by default. False when no sub has that id
+bool betree_set_sub_window(struct betree* betree, betree_sub_t id, int64_t start, int64_t end);
+// Moves the clock the activation windows are checked against, in O(log n) for each sub that turns on
+// or off. The clock starts at INT64_MIN and never moves back, false when now is behind it. Like
+// inserts, it can't run at the same time as searches of the tree
+bool betree_advance_time(struct betree* betree, int64_t now);
+int64_t betree_get_time(const struct betree* betree);
 bool betree_exists(const struct betree* tree, const char* event_str);
 bool betree_exists_with_event(const struct betree* betree, struct betree_event* event);
 
-//bool betree_delete(struct betree* betree, betree_sub_t id);
+/*
+ * Search context: create one per thread and reuse it across searches to avoid per-event allocations
+ */
+struct betree_search_context;
+
+struct betree_search_context* betree_make_search_context(const struct betree* betree);
+void betree_free_search_context(struct betree_search_context* context);
+
+bool betree_search_with_context(const struct betree* tree, const char* event_str, struct report* report, struct betree_search_context* context);
+bool betree_search_with_event_and_context(const struct betree* betree, struct betree_event* event, struct report* report, struct betree_search_context* context);
+
+bool betree_search_limit_with_context(const struct betree* tree, const char* event_str, size_t limit, struct report* report, struct betree_search_context* context);
+bool betree_search_top_with_context(const struct betree* tree, const char* event_str, size_t limit, struct report* report, struct betree_search_context* context);
+bool betree_search_each_with_context(const struct betree* tree, const char* event_str, betree_match_callback callback, void* data, struct betree_search_context* context);
+
+/*
+ * Search cursor: the same search as betree_search_with_context done a bounded amount at a time, for
+ * callers that must not hold their thread for long, such as NIFs that yield between steps. A step
+ * spends about budget units, a cnode visited or a candidate sub checked or evaluated each. The tree
+ * must not change and context must not be used elsewhere until the cursor is freed
+ */
+struct betree_search_cursor;
+
+// NULL when the event can't be validated
+struct betree_search_cursor* betree_make_search_cursor(const struct betree* tree, const char* event_str, struct report* report, struct betree_search_context* context);
+// True once the search is over and report holds its matches, like betree_search would fill it
+bool betree_search_cursor_step(struct betree_search_cursor* cursor, size_t budget);
+void betree_free_search_cursor(struct betree_search_cursor* cursor);
+
+/*
+ * Prepared events: parsed, given the variable, string and enum ids of a tree, sorted and validated
+ * once, then searched as often as needed. The tree, and the copies made of it with betree_clone,
+ * live versions or shards of an empty schema, reuse that work for as long as they gain no variable,
+ * string or enum id and no domain bound. Other trees read the event again
+ */
+struct betree_prepared_event;
+
+// Aborts like betree_search when the event can't be parsed
+struct betree_prepared_event* betree_prepare_event(const struct betree* tree, const char* event_str);
+void betree_free_prepared_event(struct betree_prepared_event* prepared);
+// Only reads the prepared event, which several trees may search at once. False when it can't be validated
+bool betree_search_prepared(const struct betree* tree, const struct betree_prepared_event* prepared, struct report* report, struct betree_search_context* context);
+
+// The event of base with the variables of delta_str set on top, base has to outlive it. Aborts like
+// betree_prepare_event when delta_str can't be parsed
+struct betree_prepared_event* betree_prepare_delta(
+    const struct betree* tree, const struct betree_prepared_event* base, const char* delta_str);
+// Adds the matches of next to report from the matches previous_report got for previous, evaluating
+// again only the subs that depend on the variables next changes. previous_report must be what a
+// search of previous on the tree as it is now reported. Falls back to betree_search_prepared when
+// next isn't a delta of previous or when their ids are not those of the tree anymore
+bool betree_search_delta(const struct betree* tree,
+    const struct betree_prepared_event* previous,
+    const struct report* previous_report,
+    const struct betree_prepared_event* next,
+    struct report* report,
+    struct betree_search_context* context);
+
+bool betree_exists_with_context(const struct betree* tree, const char* event_str, struct betree_search_context* context);
+bool betree_exists_with_event_and_context(const struct betree* betree, struct betree_event* event, struct betree_search_context* context);
+
+/*
+ * Batch search: walks the tree once per BETREE_BATCH_SIZE events, reports[i] receives the matches of events[i]
+ */
+#define BETREE_BATCH_SIZE 64
+
+bool betree_search_batch(const struct betree* betree, struct betree_event** events, size_t count, struct report** reports);
+// contexts must hold one context per event
+bool betree_search_batch_with_contexts(const struct betree* betree, struct betree_event** events, size_t count, struct report** reports, struct betree_search_context** contexts);
+
+/*
+ * Engine: searches submitted from any thread without blocking it. A dispatcher thread takes the
+ * events that arrived meanwhile, up to BETREE_BATCH_SIZE, parses them and hands them to a pool of
+ * workers running batch searches, while it parses the next ones. Completions run on the workers.
+ * The tree must outlive the engine and not change while it runs
+ */
+struct betree_engine;
+struct betree_engine_future;
+
+// valid is false when the event could not be parsed or validated, report is only valid during the call
+typedef void (*betree_engine_callback)(void* data, bool valid, const struct report* report);
+
+#define BETREE_ENGINE_LATENCY_BUCKETS 32
+
+struct betree_engine_metrics {
+    uint64_t submitted;
+    uint64_t completed;
+    // Submitted and not completed yet
+    uint64_t queue_depth;
+    uint64_t invalid;
+    // Batches handed to the workers, completed / batches is the mean batch size
+    uint64_t batches;
+    // From the submission to the start of the completion
+    uint64_t latency_total_ns;
+    uint64_t latency_max_ns;
+    // Bucket i counts the latencies under 2^i microseconds, the last one takes the rest
+    uint64_t latency_buckets[BETREE_ENGINE_LATENCY_BUCKETS];
+};
+
+// Between 1 and 16 workers
+struct betree_engine* betree_engine_make(const struct betree* tree, size_t worker_count);
+// Completes every submitted event first, no submission may run meanwhile
+void betree_engine_free(struct betree_engine* engine);
+// The event is copied
+void betree_engine_submit(struct betree_engine* engine, const char* event, betree_engine_callback callback, void* data);
+struct betree_engine_future* betree_engine_submit_future(struct betree_engine* engine, const char* event);
+bool betree_engine_future_ready(struct betree_engine_future* future);
+// Waits for the search, adds its matches and counts to report and frees the future. False like the callback
+bool betree_engine_future_wait(struct betree_engine_future* future, struct report* report);
+void betree_engine_get_metrics(const struct betree_engine* engine, struct betree_engine_metrics* metrics);
+
+/*
+ * Binary events: variables are set by index with string and enum values already resolved to ids, so a search
+ * skips parsing, name lookups and copies. The event lives in a caller-owned buffer aligned for any type,
+ * betree_binary_event_size gives a size large enough for a number of variables holding element_count list
+ * elements in total. Lists must be sorted ascending by value or id without duplicates, strings are not copied.
+ * An event only searches the tree it was initialized with. Frequency caps still need a betree_event
+ */
+#define BETREE_UNKNOWN_ID UINT64_MAX
+
+struct betree_binary_event;
+
+// SIZE_MAX when the variable is unknown
+size_t betree_get_variable_index(const struct betree* betree, const char* name);
+// BETREE_UNKNOWN_ID when no expression uses the value
+uint64_t betree_get_string_id(const struct betree* betree, size_t variable, const char* value);
+uint64_t betree_get_integer_enum_id(const struct betree* betree, size_t variable, int64_t value);
+
+size_t betree_binary_event_size(size_t variable_count, size_t element_count);
+// NULL when the buffer is misaligned or too small
+struct betree_binary_event* betree_binary_event_init(const struct betree* betree, void* buffer, size_t size);
+void betree_binary_event_clear(struct betree_binary_event* event);
+
+// Each returns false when the variable has another type or the buffer is full
+bool betree_binary_event_add_boolean(struct betree_binary_event* event, size_t variable, bool value);
+bool betree_binary_event_add_integer(struct betree_binary_event* event, size_t variable, int64_t value);
+bool betree_binary_event_add_float(struct betree_binary_event* event, size_t variable, double value);
+bool betree_binary_event_add_string(struct betree_binary_event* event, size_t variable, uint64_t id, const char* value);
+bool betree_binary_event_add_integer_enum(struct betree_binary_event* event, size_t variable, uint64_t id, int64_t value);
+bool betree_binary_event_add_integer_list(struct betree_binary_event* event, size_t variable, size_t count, const int64_t* values);
+// values may be NULL when no string expression reads the text
+bool betree_binary_event_add_string_list(struct betree_binary_event* event, size_t variable, size_t count, const uint64_t* ids, const char** values);
+bool betree_binary_event_add_integer_enum_list(struct betree_binary_event* event, size_t variable, size_t count, const uint64_t* ids, const int64_t* values);
+bool betree_binary_event_add_segments(struct betree_binary_event* event, size_t variable, size_t count, const int64_t* ids, const int64_t* timestamps);
+
+struct betree_search_context;
+
+bool betree_search_binary_event(const struct betree* betree, const struct betree_binary_event* event, struct report* report);
+bool betree_search_binary_event_with_context(const struct betree* betree, const struct betree_binary_event* event, struct report* report, struct betree_search_context* context);
+bool betree_exists_binary_event_with_context(const struct betree* betree, const struct betree_binary_event* event, struct betree_search_context* context);
+
+bool betree_delete(struct betree* betree, betree_sub_t id);
+
+/*
+ * Snapshots: betree_load returns NULL when the file is missing, corrupt or from another version
+ */
+bool betree_save(const struct betree* betree, const char* path);
+struct betree* betree_load(const char* path);
+
+/*
+ * Live trees: searches pin an immutable version while updates build the next one on the side and
+ * publish it atomically. Old versions are freed once no pinned reader can still see them.
+ * One reader per thread, updates are serialized
+ */
+struct betree_live;
+struct betree_live_reader;
+
+// Takes ownership of tree
+struct betree_live* betree_live_make(struct betree* tree);
+// No reader may be pinned
+void betree_live_free(struct betree_live* live);
+
+struct betree_live_reader* betree_live_register(struct betree_live* live);
+void betree_live_unregister(struct betree_live_reader* reader);
+// The tree stays valid until betree_live_unpin
+const struct betree* betree_live_pin(struct betree_live_reader* reader);
+void betree_live_unpin(struct betree_live_reader* reader);
+bool betree_live_search(struct betree_live_reader* reader, const char* event, struct report* report);
+
+// Applies the deletes then the inserts to a copy of the current version and publishes it, nothing is published on failure
+bool betree_live_update(struct betree_live* live, size_t delete_count, const betree_sub_t* delete_ids, size_t insert_count, const betree_sub_t* insert_ids, const char** insert_exprs);
+// Frees retired versions that readers have moved past, updates do it as well
+void betree_live_reclaim(struct betree_live* live);
+
+/*
+ * Shards: subs are spread over independent trees that share one schema, each shard keeps the dictionaries
+ * it grows to itself. Searches run on a thread per shard and report the matches shard after shard
+ */
+struct betree_shards;
+
+// Takes ownership of schema, a tree with its variables defined and no subs, and copies it into each
+// of the shard_count shards, at most 64. NULL when schema has subs
+struct betree_shards* betree_shards_make(struct betree* schema, size_t shard_count);
+void betree_shards_free(struct betree_shards* shards);
+size_t betree_shards_count(const struct betree_shards* shards);
+// For settings and stats, subs must go through the shards
+struct betree* betree_shards_get(struct betree_shards* shards, size_t index);
+// Subs whose top AND chain holds attr = X, on an integer, string or integer enum attr, go to the shard
+// of X, any other to the shard of its id. An event with a value for attr only searches the shard of
+// that value and the shards holding other subs. False when attr is unknown or subs were inserted
+bool betree_shards_set_key(struct betree_shards* shards, const char* attr);
+// False when a shard already has the id
+bool betree_shards_insert(struct betree_shards* shards, betree_sub_t id, const char* expr);
+// Shards are loaded in parallel, inserts nothing if an expression is invalid
+bool betree_shards_insert_all(struct betree_shards* shards, size_t count, const betree_sub_t* ids, const char** exprs);
+bool betree_shards_delete(struct betree_shards* shards, betree_sub_t id);
+bool betree_shards_search(const struct betree_shards* shards, const char* event, struct report* report);
+
+/*
+ * Replicas: one copy of a tree per NUMA node, each carved from huge pages by a thread bound to
+ * its node so that searches chase local pointers only. Searches go to the copy of the node the
+ * calling thread runs on. A single copy when the system shows no NUMA topology
+ */
+struct betree_replicas;
+
+// Copies the tree as it is, later changes to it are not seen by the copies
+struct betree_replicas* betree_replicas_make(const struct betree* tree);
+void betree_replicas_free(struct betree_replicas* replicas);
+size_t betree_replicas_count(const struct betree_replicas* replicas);
+const struct betree* betree_replicas_get(const struct betree_replicas* replicas, size_t index);
+// Copy of the node the calling thread runs on
+const struct betree* betree_replicas_local(const struct betree_replicas* replicas);
+bool betree_replicas_search(const struct betree_replicas* replicas, const char* event, struct report* report);
+// The context can come from any of the copies
+bool betree_replicas_search_with_context(const struct betree_replicas* replicas,
+    const char* event,
+    struct report* report,
+    struct betree_search_context* context);
+bool betree_replicas_exists(const struct betree_replicas* replicas, const char* event);
+
+/*
+ * Rebalancing: the tree is partitioned from static domain widths as subs come in. A sample of the
+ * events it is searched with lets a rebuild pick the attributes that prune the most candidates for
+ * them, and split further the lnodes most of them reach
+ */
+struct betree_event_sample;
+
+// Keeps up to capacity events, later ones replace kept ones at random so all are equally likely
+struct betree_event_sample* betree_make_event_sample(size_t capacity);
+void betree_free_event_sample(struct betree_event_sample* sample);
+// Safe to call from several threads, false when the event can't be parsed
+bool betree_sample_event(struct betree_event_sample* sample, const struct betree* tree, const char* event);
+// Rebuilds the tree in place, no search may run meanwhile. Matches stay the same
+void betree_rebalance(struct betree* betree, struct betree_event_sample* sample);
+// Rebuilds a copy of the current version and publishes it, readers keep searching meanwhile
+void betree_live_rebalance(struct betree_live* live, struct betree_event_sample* sample);
 
 struct report* make_report();
+void betree_report_reset(struct report* report);
 void free_report(struct report* report);
 
 /*
@@ -0,0 +1,323 @@
+#include <stdalign.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "betree.h"
+#include "config.h"
+#include "tree.h"
+#include "utils.h"
+#include "value.h"
+
+/*
+ * The buffer holds the event header followed by records, each record is a variable ready to be
+ * pointed at by the search context and the list payload it references, all in the same buffer
+ */
+
+struct binary_record {
+    size_t size;
+    struct betree_variable variable;
+};
+
+struct betree_binary_event {
+    const struct config* config;
+    size_t capacity;
+    size_t used;
+    size_t record_count;
+};
+
+static const size_t binary_alignment = alignof(max_align_t);
+
+static size_t align_size(size_t size)
+{
+    return (size + binary_alignment - 1) & ~(binary_alignment - 1);
+}
+
+size_t betree_binary_event_size(size_t variable_count, size_t element_count)
+{
+    // Segments need a pointer next to each element
+    size_t element_size
+        = smax(sizeof(struct string_value), sizeof(struct betree_segment) + sizeof(struct betree_segment*));
+    size_t list_size = smax(sizeof(struct betree_string_list), sizeof(struct betree_segments));
+    return align_size(sizeof(struct betree_binary_event))
+        + variable_count * (align_size(sizeof(struct binary_record)) + align_size(list_size) + binary_alignment)
+        + element_count * element_size;
+}
+
+struct betree_binary_event* betree_binary_event_init(const struct betree* betree, void* buffer, size_t size)
+{
+    if(((uintptr_t)buffer & (binary_alignment - 1)) != 0 || size < sizeof(struct betree_binary_event)) {
+        return NULL;
+    }
+    struct betree_binary_event* event = buffer;
+    event->config = betree->config;
+    event->capacity = size;
+    event->used = align_size(sizeof(*event));
+    event->record_count = 0;
+    return event;
+}
+
+void betree_binary_event_clear(struct betree_binary_event* event)
+{
+    event->used = align_size(sizeof(*event));
+    event->record_count = 0;
+}
+
+static struct binary_record* first_record(const struct betree_binary_event* event)
+{
+    return (struct binary_record*)((char*)event + align_size(sizeof(*event)));
+}
+
+static struct binary_record* next_record(const struct binary_record* record)
+{
+    return (struct binary_record*)((char*)record + record->size);
+}
+
+// Reserves a record and payload_size more bytes right after it, NULL when the variable or buffer are wrong
+static struct binary_record* add_record(struct betree_binary_event* event,
+    size_t variable,
+    enum betree_value_type_e value_type,
+    size_t payload_size)
+{
+    const struct config* config = event->config;
+    if(variable >= config->attr_domain_count
+        || config->attr_domains[variable]->bound.value_type != value_type) {
+        return NULL;
+    }
+    size_t size = align_size(sizeof(struct binary_record)) + align_size(payload_size);
+    if(size > event->capacity - event->used) {
+        return NULL;
+    }
+    struct binary_record* record = (struct binary_record*)((char*)event + event->used);
+    record->size = size;
+    record->variable.attr_var = config->attr_domains[variable]->attr_var;
+    record->variable.value.value_type = value_type;
+    event->used += size;
+    event->record_count++;
+    return record;
+}
+
+static void* record_payload(struct binary_record* record)
+{
+    return (char*)record + align_size(sizeof(*record));
+}
+
+bool betree_binary_event_add_boolean(struct betree_binary_event* event, size_t variable, bool value)
+{
+    struct binary_record* record = add_record(event, variable, BETREE_BOOLEAN, 0);
+    if(record == NULL) {
+        return false;
+    }
+    record->variable.value.boolean_value = value;
+    return true;
+}
+
+bool betree_binary_event_add_integer(struct betree_binary_event* event, size_t variable, int64_t value)
+{
+    struct binary_record* record = add_record(event, variable, BETREE_INTEGER, 0);
+    if(record == NULL) {
+        return false;
+    }
+    record->variable.value.integer_value = value;
+    return true;
+}
+
+bool betree_binary_event_add_float(struct betree_binary_event* event, size_t variable, double value)
+{
+    struct binary_record* record = add_record(event, variable, BETREE_FLOAT, 0);
+    if(record == NULL) {
+        return false;
+    }
+    record->variable.value.float_value = value;
+    return true;
+}
+
+bool betree_binary_event_add_string(
+    struct betree_binary_event* event, size_t variable, uint64_t id, const char* value)
+{
+    struct binary_record* record = add_record(event, variable, BETREE_STRING, 0);
+    if(record == NULL) {
+        return false;
+    }
+    record->variable.value.string_value.string = value;
+    record->variable.value.string_value.var = variable;
+    record->variable.value.string_value.str = id;
+    return true;
+}
+
+bool betree_binary_event_add_integer_enum(
+    struct betree_binary_event* event, size_t variable, uint64_t id, int64_t value)
+{
+    struct binary_record* record = add_record(event, variable, BETREE_INTEGER_ENUM, 0);
+    if(record == NULL) {
+        return false;
+    }
+    record->variable.value.integer_enum_value.integer = value;
+    record->variable.value.integer_enum_value.var = variable;
+    record->variable.value.integer_enum_value.ienum = id;
+    return true;
+}
+
+bool betree_binary_event_add_integer_list(
+    struct betree_binary_event* event, size_t variable, size_t count, const int64_t* values)
+{
+    size_t list_size = align_size(sizeof(struct betree_integer_list));
+    struct binary_record* record
+        = add_record(event, variable, BETREE_INTEGER_LIST, list_size + count * sizeof(*values));
+    if(record == NULL) {
+        return false;
+    }
+    struct betree_integer_list* list = record_payload(record);
+    list->count = count;
+    list->integers = (int64_t*)((char*)list + list_size);
+    if(count != 0) {
+        memcpy(list->integers, values, count * sizeof(*values));
+    }
+    record->variable.value.integer_list_value = list;
+    return true;
+}
+
+bool betree_binary_event_add_string_list(struct betree_binary_event* event,
+    size_t variable,
+    size_t count,
+    const uint64_t* ids,
+    const char** values)
+{
+    size_t list_size = align_size(sizeof(struct betree_string_list));
+    struct binary_record* record
+        = add_record(event, variable, BETREE_STRING_LIST, list_size + count * sizeof(struct string_value));
+    if(record == NULL) {
+        return false;
+    }
+    struct betree_string_list* list = record_payload(record);
+    list->count = count;
+    list->strings = (struct string_value*)((char*)list + list_size);
+    list->bitmap = NULL;
+    for(size_t i = 0; i < count; i++) {
+        list->strings[i].string = values == NULL ? NULL : values[i];
+        list->strings[i].var = variable;
+        list->strings[i].str = ids[i];
+    }
+    record->variable.value.string_list_value = list;
+    return true;
+}
+
+bool betree_binary_event_add_integer_enum_list(struct betree_binary_event* event,
+    size_t variable,
+    size_t count,
+    const uint64_t* ids,
+    const int64_t* values)
+{
+    size_t list_size = align_size(sizeof(struct betree_integer_enum_list));
+    struct binary_record* record = add_record(
+        event, variable, BETREE_INTEGER_LIST_ENUM, list_size + count * sizeof(struct integer_enum_value));
+    if(record == NULL) {
+        return false;
+    }
+    struct betree_integer_enum_list* list = record_payload(record);
+    list->count = count;
+    list->integers = (struct integer_enum_value*)((char*)list + list_size);
+    for(size_t i = 0; i < count; i++) {
+        list->integers[i].integer = values[i];
+        list->integers[i].var = variable;
+        list->integers[i].ienum = ids[i];
+    }
+    record->variable.value.integer_enum_list_value = list;
+    return true;
+}
+
+bool betree_binary_event_add_segments(struct betree_binary_event* event,
+    size_t variable,
+    size_t count,
+    const int64_t* ids,
+    const int64_t* timestamps)
+{
+    size_t list_size = align_size(sizeof(struct betree_segments));
+    struct binary_record* record
+        = add_record(event, variable, BETREE_SEGMENTS, list_size + count * sizeof(struct betree_segment));
+    if(record == NULL) {
+        return false;
+    }
+    struct betree_segments* segments = record_payload(record);
+    segments->size = count;
+    segments->capacity = count;
+    segments->content = (struct betree_segment*)((char*)segments + list_size);
+    for(size_t i = 0; i < count; i++) {
+        segments->content[i].id = ids[i];
+        segments->content[i].timestamp = timestamps[i];
+    }
+    record->variable.value.segments_value = segments;
+    return true;
+}
+
+static bool fill_binary_environment(const struct betree* betree,
+    const struct betree_binary_event* event,
+    struct betree_search_context* context)
+{
+    if(event->config != betree->config) {
+        fprintf(stderr, "Binary event was built for another tree\n");
+        return false;
+    }
+    reset_search_context(betree->config, context);
+    struct binary_record* record = first_record(event);
+    for(size_t i = 0; i < event->record_count; i++) {
+        context->preds[record->variable.attr_var.var] = &record->variable;
+        record = next_record(record);
+    }
+    if(validate_variables(betree->config, context->preds) == false) {
+        fprintf(stderr, "Failed to validate event\n");
+        return false;
+    }
+    return true;
+}
+
+bool betree_search_binary_event_with_context(const struct betree* betree,
+    const struct betree_binary_event* event,
+    struct report* report,
+    struct betree_search_context* context)
+{
+    if(!fill_binary_environment(betree, event, context)) {
+        return false;
+    }
+    return betree_search_with_preds(betree->config, context, betree->cnode, report);
+}
+
+bool betree_search_binary_event(
+    const struct betree* betree, const struct betree_binary_event* event, struct report* report)
+{
+    struct betree_search_context* context = make_search_context(betree->config);
+    bool result = betree_search_binary_event_with_context(betree, event, report, context);
+    free_search_context(context);
+    return result;
+}
+
+bool betree_exists_binary_event_with_context(const struct betree* betree,
+    const struct betree_binary_event* event,
+    struct betree_search_context* context)
+{
+    if(!fill_binary_environment(betree, event, context)) {
+        return false;
+    }
+    return betree_exists_with_preds(betree->config, context, betree->cnode);
+}
+
+size_t betree_get_variable_index(const struct betree* betree, const char* name)
+{
+    betree_var_t var = try_get_id_for_attr(betree->config, name);
+    return var == INVALID_VAR ? SIZE_MAX : var;
+}
+
+uint64_t betree_get_string_id(const struct betree* betree, size_t variable, const char* value)
+{
+    if(variable >= betree->config->attr_domain_count) {
+        return BETREE_UNKNOWN_ID;
+    }
+    return try_get_id_for_string(betree->config, betree->config->attr_domains[variable]->attr_var, value);
+}
+
+uint64_t betree_get_integer_enum_id(const struct betree* betree, size_t variable, int64_t value)
+{
+    if(variable >= betree->config->attr_domain_count) {
+        return BETREE_UNKNOWN_ID;
+    }
+    return try_get_id_for_ienum(betree->config, betree->config->attr_domains[variable]->attr_var, value);
+}
@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "bitmap.h"
+#include "config.h"
+#include "utils.h"
+#include "value.h"
+
+bool list_bitmap_domain(const struct attr_domain* domain)
+{
+    return domain->bound.smax < LIST_BITMAP_MAX_IDS;
+}
+
+static size_t bitmap_size(uint64_t max_id)
+{
+    return sizeof(struct id_bitmap) + (max_id / 64 + 1) * sizeof(uint64_t);
+}
+
+static uint64_t string_list_max_id(const struct betree_string_list* list)
+{
+    // Event lists get their ids before they are sorted
+    uint64_t max_id = 0;
+    for(size_t i = 0; i < list->count; i++) {
+        max_id = u64max(max_id, list->strings[i].str);
+    }
+    return max_id;
+}
+
+size_t string_list_bitmap_size(const struct betree_string_list* list)
+{
+    if(list->count == 0) {
+        return 0;
+    }
+    uint64_t max_id = string_list_max_id(list);
+    return max_id < LIST_BITMAP_MAX_IDS ? bitmap_size(max_id) : 0;
+}
+
+void fill_string_list_bitmap(const struct betree_string_list* list, struct id_bitmap* bitmap)
+{
+    bitmap->word_count = string_list_max_id(list) / 64 + 1;
+    memset(bitmap->words, 0, bitmap->word_count * sizeof(*bitmap->words));
+    for(size_t i = 0; i < list->count; i++) {
+        betree_str_t str = list->strings[i].str;
+        bitmap->words[str / 64] |= 1ULL << (str % 64);
+    }
+}
+
+static struct id_bitmap* make_id_bitmap(size_t size)
+{
+    struct id_bitmap* bitmap = bmalloc(size);
+    if(bitmap == NULL) {
+        fprintf(stderr, "%s bmalloc failed\n", __func__);
+        abort();
+    }
+    return bitmap;
+}
+
+void index_string_list(const struct attr_domain* domain, struct betree_string_list* list)
+{
+    if(list->bitmap != NULL) {
+        bfree(list->bitmap);
+        list->bitmap = NULL;
+    }
+    size_t size = list_bitmap_domain(domain) ? string_list_bitmap_size(list) : 0;
+    if(size != 0) {
+        list->bitmap = make_id_bitmap(size);
+        fill_string_list_bitmap(list, list->bitmap);
+    }
+}
+
+bool id_bitmap_test(const struct id_bitmap* bitmap, uint64_t id)
+{
+    return id / 64 < bitmap->word_count && (bitmap->words[id / 64] & (1ULL << (id % 64))) != 0;
+}
+
+bool id_bitmap_intersects(const struct id_bitmap* a, const struct id_bitmap* b)
+{
+    size_t word_count = smin(a->word_count, b->word_count);
+    uint64_t any = 0;
+    for(size_t i = 0; i < word_count; i++) {
+        any |= a->words[i] & b->words[i];
+    }
+    return any != 0;
+}
+
+bool id_bitmap_includes(const struct id_bitmap* a, const struct id_bitmap* b)
+{
+    // Words are trimmed to the largest id so b cannot have bits past the end of a
+    if(b->word_count > a->word_count) {
+        return false;
+    }
+    uint64_t missing = 0;
+    for(size_t i = 0; i < b->word_count; i++) {
+        missing |= b->words[i] & ~a->words[i];
+    }
+    return missing == 0;
+}
+
+size_t id_bitmap_count_strings(const struct id_bitmap* bitmap, const struct string_value* strings, size_t count)
+{
+    size_t found = 0;
+    for(size_t i = 0; i < count; i++) {
+        found += id_bitmap_test(bitmap, strings[i].str);
+    }
+    return found;
+}
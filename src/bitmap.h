@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "value.h"
+
+struct attr_domain;
+
+// String lists of a domain with at most that many ids also carry their ids as bits
+#define LIST_BITMAP_MAX_IDS 1024
+
+// Bit i is set when id i is in the list, word_count only covers up to the largest id
+struct id_bitmap {
+    size_t word_count;
+    uint64_t words[];
+};
+
+bool list_bitmap_domain(const struct attr_domain* domain);
+
+// Size of the bitmap for the list, 0 when an id does not fit
+size_t string_list_bitmap_size(const struct betree_string_list* list);
+void fill_string_list_bitmap(const struct betree_string_list* list, struct id_bitmap* bitmap);
+
+// Replaces the bitmap of the list, NULL when its domain or ids are too large
+void index_string_list(const struct attr_domain* domain, struct betree_string_list* list);
+
+bool id_bitmap_test(const struct id_bitmap* bitmap, uint64_t id);
+bool id_bitmap_intersects(const struct id_bitmap* a, const struct id_bitmap* b);
+// Every bit of b is set in a
+bool id_bitmap_includes(const struct id_bitmap* a, const struct id_bitmap* b);
+size_t id_bitmap_count_strings(const struct id_bitmap* bitmap, const struct string_value* strings, size_t count);
@@ -1,10 +1,39 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "activation.h"
 #include "alloc.h"
 #include "ast.h"
+#include "betree.h"
 #include "clone.h"
+#include "columns.h"
+#include "config.h"
+#include "hashmap.h"
+#include "prefilter.h"
+#include "short_circuit.h"
+#include "sub_index.h"
+#include "tree.h"
 #include "utils.h"
 
+// Nodes of the original tree already copied into the clone, shared subtrees are copied once
+struct node_copies {
+    size_t slot_count;
+    size_t count;
+    const struct ast_node** from;
+    struct ast_node** to;
+    const struct pred_map* from_map;
+    struct pred_map* to_map;
+};
+
+static struct ast_node* copy_shared_node(struct node_copies* copies, const struct ast_node* node);
+
+static struct ast_node* clone_child(struct node_copies* copies, const struct ast_node* node)
+{
+    return copies == NULL ? clone_node(node) : copy_shared_node(copies, node);
+}
+
 static struct attr_var clone_attr_var(struct attr_var orig)
 {
     struct attr_var clone = { .attr = bstrdup(orig.attr), .var = orig.var };
@@ -77,7 +106,8 @@ static struct ast_node* clone_equality(betree_pred_t global_id, betree_pred_t me
     return clone;
 }
 
-static struct ast_node* clone_bool(betree_pred_t global_id, betree_pred_t memoize_id, struct ast_bool_expr orig)
+static struct ast_node* clone_bool(
+    struct node_copies* copies, betree_pred_t global_id, betree_pred_t memoize_id, struct ast_bool_expr orig)
 {
     struct ast_node* clone = ast_node_create();
     clone->global_id = global_id;
@@ -87,14 +117,14 @@ static struct ast_node* clone_bool(betree_pred_t global_id, betree_pred_t memoiz
     switch(orig.op) {
         case AST_BOOL_OR:
         case AST_BOOL_AND: {
-            struct ast_node* clone_lhs = clone_node(orig.binary.lhs);
-            struct ast_node* clone_rhs = clone_node(orig.binary.rhs);
+            struct ast_node* clone_lhs = clone_child(copies, orig.binary.lhs);
+            struct ast_node* clone_rhs = clone_child(copies, orig.binary.rhs);
             clone->bool_expr.binary.lhs = clone_lhs;
             clone->bool_expr.binary.rhs = clone_rhs;
             break;
         }
         case AST_BOOL_NOT: {
-            struct ast_node* clone_expr = clone_node(orig.unary.expr);
+            struct ast_node* clone_expr = clone_child(copies, orig.unary.expr);
             clone->bool_expr.unary.expr = clone_expr;
             break;
         }
@@ -234,6 +264,8 @@ static struct ast_node* clone_special(betree_pred_t global_id, betree_pred_t mem
             clone->special_expr.frequency.op = orig.frequency.op;
             clone->special_expr.frequency.type = orig.frequency.type;
             clone->special_expr.frequency.value = orig.frequency.value;
+            clone->special_expr.frequency.now = clone_attr_var(orig.frequency.now);
+            clone->special_expr.frequency.id = orig.frequency.id;
             break;
         case AST_SPECIAL_SEGMENT:
             clone->special_expr.segment.attr_var = clone_attr_var(orig.segment.attr_var);
@@ -241,6 +273,7 @@ static struct ast_node* clone_special(betree_pred_t global_id, betree_pred_t mem
             clone->special_expr.segment.op = orig.segment.op;
             clone->special_expr.segment.seconds = orig.segment.seconds;
             clone->special_expr.segment.segment_id = orig.segment.segment_id;
+            clone->special_expr.segment.now = clone_attr_var(orig.segment.now);
             break;
         case AST_SPECIAL_GEO:
             clone->special_expr.geo.has_radius = orig.geo.has_radius;
@@ -248,6 +281,13 @@ static struct ast_node* clone_special(betree_pred_t global_id, betree_pred_t mem
             clone->special_expr.geo.longitude = orig.geo.longitude;
             clone->special_expr.geo.op = orig.geo.op;
             clone->special_expr.geo.radius = orig.geo.radius;
+            clone->special_expr.geo.latitude_var = clone_attr_var(orig.geo.latitude_var);
+            clone->special_expr.geo.longitude_var = clone_attr_var(orig.geo.longitude_var);
+            clone->special_expr.geo.sin_latitude = orig.geo.sin_latitude;
+            clone->special_expr.geo.cos_latitude = orig.geo.cos_latitude;
+            clone->special_expr.geo.latitude_span = orig.geo.latitude_span;
+            clone->special_expr.geo.longitude_span = orig.geo.longitude_span;
+            clone->special_expr.geo.chord_squared = orig.geo.chord_squared;
             break;
         case AST_SPECIAL_STRING:
             clone->special_expr.string.attr_var = clone_attr_var(orig.string.attr_var);
@@ -270,7 +310,7 @@ static struct ast_node* clone_is_null(betree_pred_t global_id, betree_pred_t mem
     return clone;
 }
 
-struct ast_node* clone_node(const struct ast_node* node)
+static struct ast_node* clone_with_copies(struct node_copies* copies, const struct ast_node* node)
 {
     struct ast_node* clone = NULL;
     switch(node->type) {
@@ -281,7 +321,7 @@ struct ast_node* clone_node(const struct ast_node* node)
             clone = clone_equality(node->global_id, node->memoize_id, node->equality_expr);
             break;
         case AST_TYPE_BOOL_EXPR:
-            clone = clone_bool(node->global_id, node->memoize_id, node->bool_expr);
+            clone = clone_bool(copies, node->global_id, node->memoize_id, node->bool_expr);
             break;
         case AST_TYPE_SET_EXPR:
             clone = clone_set(node->global_id, node->memoize_id, node->set_expr);
@@ -300,3 +340,194 @@ struct ast_node* clone_node(const struct ast_node* node)
     return clone;
 }
 
+
+struct ast_node* clone_node(const struct ast_node* node)
+{
+    return clone_with_copies(NULL, node);
+}
+
+static size_t hash_node_pointer(const struct ast_node* node, size_t mask)
+{
+    uint64_t x = (uint64_t)(uintptr_t)node;
+    x = (x ^ (x >> 33)) * 0xff51afd7ed558ccdULL;
+    return (size_t)(x ^ (x >> 33)) & mask;
+}
+
+static size_t find_copy_slot(const struct node_copies* copies, const struct ast_node* node)
+{
+    size_t mask = copies->slot_count - 1;
+    size_t i = hash_node_pointer(node, mask);
+    while(copies->from[i] != NULL && copies->from[i] != node) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static void grow_copies(struct node_copies* copies)
+{
+    size_t old_count = copies->slot_count;
+    const struct ast_node** old_from = copies->from;
+    struct ast_node** old_to = copies->to;
+    copies->slot_count = old_count == 0 ? 64 : old_count * 2;
+    copies->from = bcalloc(copies->slot_count * sizeof(*copies->from));
+    copies->to = bcalloc(copies->slot_count * sizeof(*copies->to));
+    if(copies->from == NULL || copies->to == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    for(size_t i = 0; i < old_count; i++) {
+        if(old_from[i] != NULL) {
+            size_t slot = find_copy_slot(copies, old_from[i]);
+            copies->from[slot] = old_from[i];
+            copies->to[slot] = old_to[i];
+        }
+    }
+    bfree(old_from);
+    bfree(old_to);
+}
+
+// Copies keep the ids of the original so the clone memoizes and matches strings the same way
+static struct ast_node* copy_shared_node(struct node_copies* copies, const struct ast_node* node)
+{
+    if((copies->count + 1) * 2 > copies->slot_count) {
+        grow_copies(copies);
+    }
+    size_t slot = find_copy_slot(copies, node);
+    if(copies->from[slot] != NULL) {
+        struct ast_node* copy = copies->to[slot];
+        copy->ref_count++;
+        return copy;
+    }
+    struct ast_node* copy = clone_with_copies(copies, node);
+    copy->hash = node->hash;
+    if(is_pred_in_map(copies->from_map, node)) {
+        insert_pred(copies->to_map, copy);
+    }
+    // The children may have grown the table
+    slot = find_copy_slot(copies, node);
+    copies->from[slot] = node;
+    copies->to[slot] = copy;
+    copies->count++;
+    return copy;
+}
+
+static void copy_cnode(struct node_copies* copies, struct betree* clone, const struct cnode* from, struct cnode* to);
+
+static struct cdir* copy_cdir(struct node_copies* copies, struct betree* clone, const struct cdir* from)
+{
+    struct cdir* cdir = bcalloc(sizeof(*cdir));
+    if(cdir == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    cdir->attr_var = copy_attr_var(from->attr_var);
+    cdir->bound = from->bound;
+    cdir->cnode = make_cnode(clone->config, cdir);
+    copy_cnode(copies, clone, from->cnode, cdir->cnode);
+    if(from->lchild != NULL) {
+        cdir->lchild = copy_cdir(copies, clone, from->lchild);
+        cdir->lchild->parent_type = CNODE_PARENT_CDIR;
+        cdir->lchild->cdir_parent = cdir;
+    }
+    if(from->rchild != NULL) {
+        cdir->rchild = copy_cdir(copies, clone, from->rchild);
+        cdir->rchild->parent_type = CNODE_PARENT_CDIR;
+        cdir->rchild->cdir_parent = cdir;
+    }
+    return cdir;
+}
+
+static void copy_cnode(struct node_copies* copies, struct betree* clone, const struct cnode* from, struct cnode* to)
+{
+    struct lnode* lnode = to->lnode;
+    lnode->max = from->lnode->max;
+    lnode->sub_count = from->lnode->sub_count;
+    // Empty lnodes have no subs array
+    if(lnode->sub_count != 0) {
+        lnode->subs = bcalloc(lnode->sub_count * sizeof(*lnode->subs));
+        if(lnode->subs == NULL) {
+            fprintf(stderr, "%s bcalloc failed\n", __func__);
+            abort();
+        }
+    }
+    for(size_t i = 0; i < lnode->sub_count; i++) {
+        const struct betree_sub* orig = from->lnode->subs[i];
+        struct betree_sub* sub = make_sub(clone->config, orig->id, copy_shared_node(copies, orig->expr));
+        sub->priority = orig->priority;
+        sub->window_start = orig->window_start;
+        sub->window_end = orig->window_end;
+        sub->lnode = lnode;
+        lnode->subs[i] = sub;
+        sub_index_add(clone->sub_index, sub);
+        schedule_activation(clone->config->activation, sub);
+    }
+    rebuild_short_circuits(&lnode->short_circuits, lnode->subs, lnode->sub_count);
+    if(lnode->postings != NULL) {
+        index_lnode_postings(lnode, true);
+    }
+    if(lnode->columns != NULL) {
+        index_lnode_columns(lnode, true);
+    }
+    if(from->pdir == NULL) {
+        return;
+    }
+    struct pdir* pdir = bcalloc(sizeof(*pdir));
+    if(pdir == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    pdir->parent = to;
+    pdir->pnode_count = from->pdir->pnode_count;
+    pdir->pnodes = bcalloc(smax(1, pdir->pnode_count) * sizeof(*pdir->pnodes));
+    if(pdir->pnodes == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    for(size_t i = 0; i < pdir->pnode_count; i++) {
+        const struct pnode* orig = from->pdir->pnodes[i];
+        struct pnode* pnode = bcalloc(sizeof(*pnode));
+        if(pnode == NULL) {
+            fprintf(stderr, "%s bcalloc failed\n", __func__);
+            abort();
+        }
+        pnode->parent = pdir;
+        pnode->attr_var = copy_attr_var(orig->attr_var);
+        pnode->score = orig->score;
+        pnode->allow_undefined = orig->allow_undefined;
+        pnode->cdir = copy_cdir(copies, clone, orig->cdir);
+        pnode->cdir->parent_type = CNODE_PARENT_PNODE;
+        pnode->cdir->pnode_parent = pnode;
+        pdir->pnodes[i] = pnode;
+    }
+    to->pdir = pdir;
+}
+
+struct betree* betree_clone(const struct betree* betree)
+{
+    return clone_tree(betree, make_arena_like(betree->arena));
+}
+
+struct betree* clone_tree(const struct betree* betree, struct arena* arena)
+{
+    struct betree* clone = bcalloc(sizeof(*clone));
+    if(clone == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    clone->arena = arena;
+    struct arena* previous = set_current_arena(clone->arena);
+    clone->config = clone_config(betree->config);
+    clone->config->pred_map->pred_count = betree->config->pred_map->pred_count;
+    clone->config->pred_map->memoize_count = betree->config->pred_map->memoize_count;
+    clone->sub_index = make_sub_index();
+    clone->cnode = make_cnode(clone->config, NULL);
+    struct node_copies copies
+        = { .slot_count = 0, .count = 0, .from = NULL, .to = NULL, .from_map = betree->config->pred_map,
+              .to_map = clone->config->pred_map };
+    copy_cnode(&copies, clone, betree->cnode, clone->cnode);
+    bfree(copies.from);
+    bfree(copies.to);
+    require_be_tree(clone->cnode);
+    set_current_arena(previous);
+    return clone;
+}
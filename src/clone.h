@@ -2,5 +2,10 @@
 
 #include "ast.h"
 
+struct arena;
+struct betree;
+
 struct ast_node* clone_node(const struct ast_node* node);
+// betree_clone carving the copy from arena, which it takes ownership of, or the heap when NULL
+struct betree* clone_tree(const struct betree* betree, struct arena* arena);
 
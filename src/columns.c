@@ -0,0 +1,413 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define COLUMNS_X86 1
+#include <immintrin.h>
+#endif
+
+#include "alloc.h"
+#include "ast.h"
+#include "columns.h"
+#include "prefilter.h"
+#include "tree.h"
+#include "utils.h"
+
+struct columns_kernels {
+    // Bit i is set when value is outside [lo[i], hi[i]], count is at most 64
+    uint64_t (*outside)(const int64_t* lo, const int64_t* hi, size_t count, int64_t value);
+};
+
+static uint64_t outside_scalar(const int64_t* lo, const int64_t* hi, size_t count, int64_t value)
+{
+    uint64_t bits = 0;
+    for(size_t i = 0; i < count; i++) {
+        bits |= (uint64_t)(value < lo[i] || value > hi[i]) << i;
+    }
+    return bits;
+}
+
+static const struct columns_kernels scalar_kernels = {
+    .outside = outside_scalar,
+};
+
+#if COLUMNS_X86
+
+__attribute__((target("avx2"))) static uint64_t outside_avx2(
+    const int64_t* lo, const int64_t* hi, size_t count, int64_t value)
+{
+    __m256i values = _mm256_set1_epi64x(value);
+    uint64_t bits = 0;
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        __m256i below = _mm256_cmpgt_epi64(_mm256_loadu_si256((const __m256i*)(lo + i)), values);
+        __m256i above = _mm256_cmpgt_epi64(values, _mm256_loadu_si256((const __m256i*)(hi + i)));
+        int outside = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_or_si256(below, above)));
+        bits |= (uint64_t)outside << i;
+    }
+    return i == count ? bits : bits | (outside_scalar(lo + i, hi + i, count - i, value) << i);
+}
+
+static const struct columns_kernels avx2_kernels = {
+    .outside = outside_avx2,
+};
+
+__attribute__((target("avx512f"))) static uint64_t outside_avx512(
+    const int64_t* lo, const int64_t* hi, size_t count, int64_t value)
+{
+    __m512i values = _mm512_set1_epi64(value);
+    uint64_t bits = 0;
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __mmask8 below = _mm512_cmpgt_epi64_mask(_mm512_loadu_si512(lo + i), values);
+        __mmask8 above = _mm512_cmpgt_epi64_mask(values, _mm512_loadu_si512(hi + i));
+        bits |= (uint64_t)(below | above) << i;
+    }
+    return i == count ? bits : bits | (outside_scalar(lo + i, hi + i, count - i, value) << i);
+}
+
+static const struct columns_kernels avx512_kernels = {
+    .outside = outside_avx512,
+};
+
+#endif
+
+static _Atomic(const struct columns_kernels*) current_kernels = NULL;
+
+static const struct columns_kernels* select_kernels(void)
+{
+#if COLUMNS_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f")) {
+        return &avx512_kernels;
+    }
+    if(__builtin_cpu_supports("avx2")) {
+        return &avx2_kernels;
+    }
+#endif
+    return &scalar_kernels;
+}
+
+static const struct columns_kernels* get_kernels(void)
+{
+    // Racing threads all pick the same static table
+    const struct columns_kernels* kernels = atomic_load_explicit(&current_kernels, memory_order_relaxed);
+    if(unlikely(kernels == NULL)) {
+        kernels = select_kernels();
+        atomic_store_explicit(&current_kernels, kernels, memory_order_relaxed);
+    }
+    return kernels;
+}
+
+struct lnode_columns* make_lnode_columns()
+{
+    struct lnode_columns* columns = bcalloc(sizeof(*columns));
+    if(columns == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    return columns;
+}
+
+void free_lnode_columns(struct lnode_columns* columns)
+{
+    if(columns == NULL) {
+        return;
+    }
+    for(size_t i = 0; i < columns->column_count; i++) {
+        bfree(columns->columns[i].lo);
+        bfree(columns->columns[i].hi);
+    }
+    bfree(columns);
+}
+
+// Attribute of a column operand, INVALID_VAR for other nodes
+static betree_var_t operand_var(const struct ast_node* node)
+{
+    switch(node->type) {
+        case AST_TYPE_COMPARE_EXPR:
+            if(node->compare_expr.value.value_type != AST_COMPARE_VALUE_INTEGER) {
+                return INVALID_VAR;
+            }
+            return node->compare_expr.attr_var.var;
+        case AST_TYPE_EQUALITY_EXPR:
+            if(node->equality_expr.op != AST_EQUALITY_EQ
+                || node->equality_expr.value.value_type == AST_EQUALITY_VALUE_FLOAT) {
+                return INVALID_VAR;
+            }
+            return node->equality_expr.attr_var.var;
+        case AST_TYPE_BOOL_EXPR:
+        case AST_TYPE_SET_EXPR:
+        case AST_TYPE_LIST_EXPR:
+        case AST_TYPE_SPECIAL_EXPR:
+        case AST_TYPE_IS_NULL_EXPR:
+        default:
+            return INVALID_VAR;
+    }
+}
+
+static void narrow_range(const struct ast_node* node, int64_t* lo, int64_t* hi)
+{
+    if(node->type == AST_TYPE_EQUALITY_EXPR) {
+        // Same keys as the posting lists, only compared for equality outside of integers
+        int64_t value;
+        switch(node->equality_expr.value.value_type) {
+            case AST_EQUALITY_VALUE_INTEGER:
+                value = node->equality_expr.value.integer_value;
+                break;
+            case AST_EQUALITY_VALUE_STRING:
+                value = (int64_t)node->equality_expr.value.string_value.str;
+                break;
+            case AST_EQUALITY_VALUE_INTEGER_ENUM:
+                value = (int64_t)node->equality_expr.value.integer_enum_value.ienum;
+                break;
+            case AST_EQUALITY_VALUE_FLOAT:
+            default: abort();
+        }
+        *lo = value > *lo ? value : *lo;
+        *hi = value < *hi ? value : *hi;
+        return;
+    }
+    int64_t value = node->compare_expr.value.integer_value;
+    switch(node->compare_expr.op) {
+        case AST_COMPARE_LT:
+            // An empty range when nothing is below
+            if(value == INT64_MIN) {
+                *lo = INT64_MAX;
+                *hi = INT64_MIN;
+            }
+            else if(value - 1 < *hi) {
+                *hi = value - 1;
+            }
+            return;
+        case AST_COMPARE_LE:
+            *hi = value < *hi ? value : *hi;
+            return;
+        case AST_COMPARE_GT:
+            if(value == INT64_MAX) {
+                *lo = INT64_MAX;
+                *hi = INT64_MIN;
+            }
+            else if(value + 1 > *lo) {
+                *lo = value + 1;
+            }
+            return;
+        case AST_COMPARE_GE:
+            *lo = value > *lo ? value : *lo;
+            return;
+        default: abort();
+    }
+}
+
+// Intersection of the operands on var of the top AND chain
+static void sub_range(const struct ast_node* node, betree_var_t var, int64_t* lo, int64_t* hi)
+{
+    if(node->type == AST_TYPE_BOOL_EXPR && node->bool_expr.op == AST_BOOL_AND) {
+        sub_range(node->bool_expr.binary.lhs, var, lo, hi);
+        sub_range(node->bool_expr.binary.rhs, var, lo, hi);
+        return;
+    }
+    if(operand_var(node) == var) {
+        narrow_range(node, lo, hi);
+    }
+}
+
+static void reserve(struct lnode_columns* columns, size_t count)
+{
+    if(count <= columns->capacity) {
+        return;
+    }
+    size_t capacity = columns->capacity == 0 ? 4 : columns->capacity;
+    while(capacity < count) {
+        capacity *= 2;
+    }
+    for(size_t i = 0; i < columns->column_count; i++) {
+        struct lnode_column* column = &columns->columns[i];
+        int64_t* lo = brealloc(column->lo, capacity * sizeof(*lo));
+        int64_t* hi = brealloc(column->hi, capacity * sizeof(*hi));
+        if(lo == NULL || hi == NULL) {
+            fprintf(stderr, "%s brealloc failed\n", __func__);
+            abort();
+        }
+        column->lo = lo;
+        column->hi = hi;
+    }
+    columns->capacity = capacity;
+}
+
+// The first count subs get the full range
+static void add_column(struct lnode_columns* columns, size_t count, betree_var_t var)
+{
+    struct lnode_column* column = &columns->columns[columns->column_count];
+    size_t capacity = columns->capacity == 0 ? 4 : columns->capacity;
+    column->var = var;
+    column->lo = bmalloc(capacity * sizeof(*column->lo));
+    column->hi = bmalloc(capacity * sizeof(*column->hi));
+    if(column->lo == NULL || column->hi == NULL) {
+        fprintf(stderr, "%s bmalloc failed\n", __func__);
+        abort();
+    }
+    for(size_t i = 0; i < count; i++) {
+        column->lo[i] = INT64_MIN;
+        column->hi[i] = INT64_MAX;
+    }
+    columns->capacity = capacity;
+    columns->column_count++;
+}
+
+static bool has_column(const struct lnode_columns* columns, betree_var_t var)
+{
+    for(size_t i = 0; i < columns->column_count; i++) {
+        if(columns->columns[i].var == var) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void add_operand_columns(struct lnode_columns* columns, size_t count, const struct ast_node* node)
+{
+    if(node->type == AST_TYPE_BOOL_EXPR && node->bool_expr.op == AST_BOOL_AND) {
+        add_operand_columns(columns, count, node->bool_expr.binary.lhs);
+        add_operand_columns(columns, count, node->bool_expr.binary.rhs);
+        return;
+    }
+    betree_var_t var = operand_var(node);
+    if(var != INVALID_VAR && columns->column_count < LNODE_COLUMNS_MAX && !has_column(columns, var)) {
+        add_column(columns, count, var);
+    }
+}
+
+static void set_ranges(struct lnode_columns* columns, size_t index, const struct betree_sub* sub)
+{
+    for(size_t i = 0; i < columns->column_count; i++) {
+        struct lnode_column* column = &columns->columns[i];
+        column->lo[index] = INT64_MIN;
+        column->hi[index] = INT64_MAX;
+        sub_range(sub->expr, column->var, &column->lo[index], &column->hi[index]);
+    }
+}
+
+void columns_append(struct lnode_columns* columns, size_t count, const struct betree_sub* sub)
+{
+    add_operand_columns(columns, count, sub->expr);
+    reserve(columns, count + 1);
+    set_ranges(columns, count, sub);
+}
+
+void columns_remove(struct lnode_columns* columns, size_t count, size_t index)
+{
+    for(size_t i = 0; i < columns->column_count; i++) {
+        struct lnode_column* column = &columns->columns[i];
+        memmove(&column->lo[index], &column->lo[index + 1], (count - index - 1) * sizeof(*column->lo));
+        memmove(&column->hi[index], &column->hi[index + 1], (count - index - 1) * sizeof(*column->hi));
+    }
+}
+
+struct var_count {
+    betree_var_t var;
+    size_t count;
+    // Index + 1 of the last sub counted, operands on the same attribute count once per sub
+    size_t last;
+};
+
+struct var_counts {
+    size_t count;
+    size_t capacity;
+    struct var_count* vars;
+};
+
+static void count_var(struct var_counts* counts, betree_var_t var, size_t sub)
+{
+    for(size_t i = 0; i < counts->count; i++) {
+        if(counts->vars[i].var == var) {
+            if(counts->vars[i].last != sub + 1) {
+                counts->vars[i].count++;
+                counts->vars[i].last = sub + 1;
+            }
+            return;
+        }
+    }
+    if(counts->count == counts->capacity) {
+        counts->capacity = counts->capacity == 0 ? 8 : counts->capacity * 2;
+        counts->vars = brealloc(counts->vars, counts->capacity * sizeof(*counts->vars));
+        if(counts->vars == NULL) {
+            fprintf(stderr, "%s brealloc failed\n", __func__);
+            abort();
+        }
+    }
+    counts->vars[counts->count].var = var;
+    counts->vars[counts->count].count = 1;
+    counts->vars[counts->count].last = sub + 1;
+    counts->count++;
+}
+
+static void count_operand_vars(struct var_counts* counts, const struct ast_node* node, size_t sub)
+{
+    if(node->type == AST_TYPE_BOOL_EXPR && node->bool_expr.op == AST_BOOL_AND) {
+        count_operand_vars(counts, node->bool_expr.binary.lhs, sub);
+        count_operand_vars(counts, node->bool_expr.binary.rhs, sub);
+        return;
+    }
+    betree_var_t var = operand_var(node);
+    if(var != INVALID_VAR) {
+        count_var(counts, var, sub);
+    }
+}
+
+static int var_count_cmp(const void* a, const void* b)
+{
+    const struct var_count* x = a;
+    const struct var_count* y = b;
+    if(x->count != y->count) {
+        return (x->count < y->count) - (x->count > y->count);
+    }
+    return (x->var > y->var) - (x->var < y->var);
+}
+
+void index_lnode_columns(struct lnode* lnode, bool enable)
+{
+    free_lnode_columns(lnode->columns);
+    lnode->columns = NULL;
+    if(!enable) {
+        return;
+    }
+    struct lnode_columns* columns = make_lnode_columns();
+    struct var_counts counts = { .count = 0, .capacity = 0, .vars = NULL };
+    for(size_t i = 0; i < lnode->sub_count; i++) {
+        count_operand_vars(&counts, lnode->subs[i]->expr, i);
+    }
+    if(counts.count != 0) {
+        qsort(counts.vars, counts.count, sizeof(*counts.vars), var_count_cmp);
+    }
+    for(size_t i = 0; i < counts.count && i < LNODE_COLUMNS_MAX; i++) {
+        add_column(columns, 0, counts.vars[i].var);
+    }
+    bfree(counts.vars);
+    reserve(columns, lnode->sub_count);
+    for(size_t i = 0; i < lnode->sub_count; i++) {
+        set_ranges(columns, i, lnode->subs[i]);
+    }
+    lnode->columns = columns;
+}
+
+uint64_t columns_fail(const struct lnode_columns* columns,
+    const struct betree_variable** preds,
+    size_t first,
+    size_t count)
+{
+    const struct columns_kernels* kernels = get_kernels();
+    uint64_t fail = 0;
+    for(size_t i = 0; i < columns->column_count; i++) {
+        const struct lnode_column* column = &columns->columns[i];
+        uint64_t value;
+        if(!posting_value(preds[column->var], &value)) {
+            continue;
+        }
+        fail |= kernels->outside(&column->lo[first], &column->hi[first], count, (int64_t)value);
+    }
+    return fail;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "value.h"
+
+struct betree_sub;
+struct betree_variable;
+struct lnode;
+
+/*
+ * Optional columns of an lnode. The "a < X", "a >= X" or "a = X" operands of the top AND chain of a
+ * sub, on an integer, string or integer enum attribute, narrow the range of the sub in the column of
+ * that attribute. A search checks a column against the event value for 64 subs at a time, only the
+ * subs left in range get evaluated
+ */
+
+#define LNODE_COLUMNS_MAX 4
+
+struct lnode_column {
+    betree_var_t var;
+    // Sub i needs lo[i] <= value <= hi[i], the full range when it has no operand on var
+    int64_t* lo;
+    int64_t* hi;
+};
+
+struct lnode_columns {
+    size_t capacity;
+    size_t column_count;
+    struct lnode_column columns[LNODE_COLUMNS_MAX];
+};
+
+struct lnode_columns* make_lnode_columns();
+void free_lnode_columns(struct lnode_columns* columns);
+
+// Adds a column for the sub when it has an operand on an attribute without one and there is room
+void columns_append(struct lnode_columns* columns, size_t count, const struct betree_sub* sub);
+// Keeps the order of the other subs, like remove_sub
+void columns_remove(struct lnode_columns* columns, size_t count, size_t index);
+// Drops the columns and rebuilds them from the subs of the lnode when enable is set, picking the
+// attributes most of its subs have operands on
+void index_lnode_columns(struct lnode* lnode, bool enable);
+
+// Bit i is set when the event is out of the range of sub first + i in a column, for up to 64 subs.
+// Columns of attributes the event doesn't have are skipped, the short circuits cover those
+uint64_t columns_fail(const struct lnode_columns* columns,
+    const struct betree_variable** preds,
+    size_t first,
+    size_t count);
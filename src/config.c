@@ -1,15 +1,27 @@
+#include <ctype.h>
 #include <float.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "activation.h"
 #include "alloc.h"
 #include "config.h"
+#include "dependents.h"
 #include "error.h"
 #include "hashmap.h"
 #include "memoize.h"
+#include "parse_cache.h"
+#include "result_cache.h"
 #include "utils.h"
 
-struct config* make_config(uint8_t lnode_max_cap, uint8_t partition_min_size)
+static uint64_t ids_stamps = 0;
+
+void touch_config_ids(struct config* config)
+{
+    config->ids_stamp = __atomic_add_fetch(&ids_stamps, 1, __ATOMIC_RELAXED);
+}
+
+struct config* make_config(uint32_t lnode_max_cap, uint32_t partition_min_size)
 {
     struct config* config = bcalloc(sizeof(*config));
     if(config == NULL) {
@@ -18,12 +30,33 @@ struct config* make_config(uint8_t lnode_max_cap, uint8_t partition_min_size)
     }
     config->attr_domain_count = 0;
     config->attr_domains = NULL;
+    config->attr_slot_count = 0;
+    config->attr_slots = NULL;
     config->lnode_max_cap = lnode_max_cap;
     config->partition_min_size = partition_min_size;
     config->max_domain_for_split = 1000;
+    config->reorder_expressions = false;
+    config->prefilter = false;
+    config->columns = false;
+    config->balanced_splits = true;
+    config->recursive_search = false;
+    config->presorted_lists = false;
+    config->search_threads = 1;
+    config->jit_threshold = 0;
     config->string_map_count = 0;
     config->string_maps = NULL;
+    config->integer_map_count = 0;
+    config->integer_maps = NULL;
+    config->map_index_count = 0;
+    config->string_map_index = NULL;
+    config->integer_map_index = NULL;
     config->pred_map = make_pred_map();
+    config->parse_cache = NULL;
+    config->result_cache = NULL;
+    config->activation = make_activation_index(INT64_MIN);
+    config->dependents = make_sub_dependents();
+    config->event_sample = NULL;
+    touch_config_ids(config);
     return config;
 }
 
@@ -49,6 +82,7 @@ void free_config(struct config* config)
         for(size_t i = 0; i < config->integer_map_count; i++) {
             bfree((char*)config->integer_maps[i].attr_var.attr);
             bfree(config->integer_maps[i].integer_values);
+            bfree(config->integer_maps[i].slots);
         }
         bfree(config->integer_maps);
         config->integer_maps = NULL;
@@ -56,18 +90,226 @@ void free_config(struct config* config)
     if(config->string_maps != NULL) {
         for(size_t i = 0; i < config->string_map_count; i++) {
             bfree((char*)config->string_maps[i].attr_var.attr);
-            map_deinit(&config->string_maps[i].m);
+            for(size_t j = 0; j < config->string_maps[i].string_value_count; j++) {
+                bfree(config->string_maps[i].string_values[j]);
+            }
+            bfree(config->string_maps[i].string_values);
+            bfree(config->string_maps[i].slots);
         }
         bfree(config->string_maps);
         config->string_maps = NULL;
     }
+    bfree(config->attr_slots);
+    bfree(config->string_map_index);
+    bfree(config->integer_map_index);
     if(config->pred_map != NULL) {
         free_pred_map(config->pred_map);
         config->pred_map = NULL;
     }
+    free_parse_cache(config->parse_cache);
+    free_result_cache(config->result_cache);
+    free_activation_index(config->activation);
+    free_sub_dependents(config->dependents);
     bfree(config);
 }
 
+struct config* clone_config(const struct config* config)
+{
+    struct config* clone = make_config(config->lnode_max_cap, config->partition_min_size);
+    clone->max_domain_for_split = config->max_domain_for_split;
+    clone->reorder_expressions = config->reorder_expressions;
+    clone->prefilter = config->prefilter;
+    clone->columns = config->columns;
+    clone->balanced_splits = config->balanced_splits;
+    clone->recursive_search = config->recursive_search;
+    clone->presorted_lists = config->presorted_lists;
+    clone->search_threads = config->search_threads;
+    clone->jit_threshold = config->jit_threshold;
+    if(config->parse_cache != NULL) {
+        clone->parse_cache = make_parse_cache(config->parse_cache->slot_count);
+    }
+    if(config->result_cache != NULL) {
+        clone->result_cache = make_result_cache(config->result_cache->slot_count, config->result_cache->now_bucket);
+    }
+    // The copied subs arm their timers again as they are inserted
+    clone->activation->now = config->activation->now;
+    if(config->attr_domain_count != 0) {
+        clone->attr_domain_count = config->attr_domain_count;
+        clone->attr_domains = bcalloc(config->attr_domain_count * sizeof(*clone->attr_domains));
+        if(clone->attr_domains == NULL) {
+            fprintf(stderr, "%s bcalloc failed\n", __func__);
+            abort();
+        }
+        for(size_t i = 0; i < config->attr_domain_count; i++) {
+            struct attr_domain* attr_domain = bcalloc(sizeof(*attr_domain));
+            if(attr_domain == NULL) {
+                fprintf(stderr, "%s bcalloc failed\n", __func__);
+                abort();
+            }
+            *attr_domain = *config->attr_domains[i];
+            attr_domain->attr_var.attr = bstrdup(config->attr_domains[i]->attr_var.attr);
+            clone->attr_domains[i] = attr_domain;
+        }
+    }
+    // Ids stay the same so cloned expressions keep pointing at the right strings and enums
+    if(config->string_map_count != 0) {
+        clone->string_map_count = config->string_map_count;
+        clone->string_maps = bcalloc(config->string_map_count * sizeof(*clone->string_maps));
+        if(clone->string_maps == NULL) {
+            fprintf(stderr, "%s bcalloc failed\n", __func__);
+            abort();
+        }
+        for(size_t i = 0; i < config->string_map_count; i++) {
+            struct string_map* from = &config->string_maps[i];
+            struct string_map* to = &clone->string_maps[i];
+            to->attr_var.attr = bstrdup(from->attr_var.attr);
+            to->attr_var.var = from->attr_var.var;
+            to->string_value_count = from->string_value_count;
+            if(from->string_value_count == 0) {
+                continue;
+            }
+            to->string_values = bmalloc(from->string_value_count * sizeof(*to->string_values));
+            if(to->string_values == NULL) {
+                fprintf(stderr, "%s bmalloc failed\n", __func__);
+                abort();
+            }
+            for(size_t j = 0; j < from->string_value_count; j++) {
+                to->string_values[j] = bstrdup(from->string_values[j]);
+            }
+        }
+    }
+    if(config->integer_map_count != 0) {
+        clone->integer_map_count = config->integer_map_count;
+        clone->integer_maps = bcalloc(config->integer_map_count * sizeof(*clone->integer_maps));
+        if(clone->integer_maps == NULL) {
+            fprintf(stderr, "%s bcalloc failed\n", __func__);
+            abort();
+        }
+        for(size_t i = 0; i < config->integer_map_count; i++) {
+            const struct integer_map* from = &config->integer_maps[i];
+            struct integer_map* to = &clone->integer_maps[i];
+            to->attr_var.attr = bstrdup(from->attr_var.attr);
+            to->attr_var.var = from->attr_var.var;
+            to->integer_value_count = from->integer_value_count;
+            if(from->integer_value_count == 0) {
+                continue;
+            }
+            to->integer_values = bmalloc(from->integer_value_count * sizeof(*to->integer_values));
+            if(to->integer_values == NULL) {
+                fprintf(stderr, "%s bmalloc failed\n", __func__);
+                abort();
+            }
+            memcpy(to->integer_values, from->integer_values, from->integer_value_count * sizeof(*to->integer_values));
+        }
+    }
+    index_config_maps(clone);
+    // Same variables and ids, until either changes
+    clone->ids_stamp = config->ids_stamp;
+    return clone;
+}
+
+static uint32_t hash_string(const char* string)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for(const unsigned char* c = (const unsigned char*)string; *c != '\0'; c++) {
+        hash ^= *c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t hash_lower_string(const char* string)
+{
+    uint32_t hash = 2166136261u;
+    for(const unsigned char* c = (const unsigned char*)string; *c != '\0'; c++) {
+        hash ^= (unsigned char)tolower(*c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static bool equals_lower(const char* attr, const char* string)
+{
+    for(; *string != '\0'; attr++, string++) {
+        if(*attr != tolower((unsigned char)*string)) {
+            return false;
+        }
+    }
+    return *attr == '\0';
+}
+
+static size_t slot_count_for(size_t value_count)
+{
+    // Power of two, at most half full
+    size_t slot_count = 8;
+    while(slot_count < value_count * 2) {
+        slot_count *= 2;
+    }
+    return slot_count;
+}
+
+static betree_var_t find_attr(const struct config* config, const char* attr, bool lower)
+{
+    if(config->attr_slot_count == 0) {
+        return INVALID_VAR;
+    }
+    uint32_t hash = lower ? hash_lower_string(attr) : hash_string(attr);
+    size_t mask = config->attr_slot_count - 1;
+    for(size_t i = hash & mask;; i = (i + 1) & mask) {
+        betree_var_t var = config->attr_slots[i];
+        if(var == INVALID_VAR) {
+            return INVALID_VAR;
+        }
+        const char* name = config->attr_domains[var]->attr_var.attr;
+        if(lower ? equals_lower(name, attr) : strcmp(name, attr) == 0) {
+            return var;
+        }
+    }
+}
+
+betree_var_t try_get_id_for_attr(const struct config* config, const char* attr)
+{
+    return find_attr(config, attr, true);
+}
+
+betree_var_t try_get_id_for_exact_attr(const struct config* config, const char* attr)
+{
+    return find_attr(config, attr, false);
+}
+
+static void place_attr_slot(struct config* config, betree_var_t var)
+{
+    const char* name = config->attr_domains[var]->attr_var.attr;
+    // A repeated name keeps resolving to its first variable
+    if(find_attr(config, name, false) != INVALID_VAR) {
+        return;
+    }
+    size_t mask = config->attr_slot_count - 1;
+    size_t i = hash_string(name) & mask;
+    while(config->attr_slots[i] != INVALID_VAR) {
+        i = (i + 1) & mask;
+    }
+    config->attr_slots[i] = var;
+}
+
+static void index_attr_domains(struct config* config)
+{
+    bfree(config->attr_slots);
+    config->attr_slot_count = slot_count_for(config->attr_domain_count);
+    config->attr_slots = bmalloc(config->attr_slot_count * sizeof(*config->attr_slots));
+    if(config->attr_slots == NULL) {
+        fprintf(stderr, "%s bmalloc failed\n", __func__);
+        abort();
+    }
+    for(size_t i = 0; i < config->attr_slot_count; i++) {
+        config->attr_slots[i] = INVALID_VAR;
+    }
+    for(size_t i = 0; i < config->attr_domain_count; i++) {
+        place_attr_slot(config, i);
+    }
+}
+
 static struct attr_domain* make_attr_domain(
     const char* attr, betree_var_t variable_id, struct value_bound bound, bool allow_undefined)
 {
@@ -106,6 +348,13 @@ static void add_attr_domain(
     }
     config->attr_domains[config->attr_domain_count] = attr_domain;
     config->attr_domain_count++;
+    touch_config_ids(config);
+    if(config->attr_domain_count * 2 > config->attr_slot_count) {
+        index_attr_domains(config);
+    }
+    else {
+        place_attr_slot(config, variable_id);
+    }
 }
 
 void add_attr_domain_bounded_i(
@@ -204,7 +453,163 @@ const struct attr_domain* get_attr_domain(
     return attr_domains[variable_id];
 }
 
-static void add_integer_map(struct attr_var attr_var, struct config* config)
+static size_t* grow_map_index(size_t* index, size_t count, size_t new_count)
+{
+    size_t* new_index = brealloc(index, new_count * sizeof(*new_index));
+    if(new_index == NULL) {
+        fprintf(stderr, "%s brealloc failed\n", __func__);
+        abort();
+    }
+    for(size_t i = count; i < new_count; i++) {
+        new_index[i] = SIZE_MAX;
+    }
+    return new_index;
+}
+
+static void reserve_map_index(struct config* config, betree_var_t variable_id)
+{
+    // Both indices always share the same size
+    if(variable_id < config->map_index_count) {
+        return;
+    }
+    size_t new_count = smax(variable_id + 1, config->map_index_count * 2);
+    config->string_map_index = grow_map_index(config->string_map_index, config->map_index_count, new_count);
+    config->integer_map_index = grow_map_index(config->integer_map_index, config->map_index_count, new_count);
+    config->map_index_count = new_count;
+}
+
+struct string_map* get_string_map(const struct config* config, betree_var_t variable_id)
+{
+    if(variable_id >= config->map_index_count) {
+        return NULL;
+    }
+    size_t position = config->string_map_index[variable_id];
+    return position == SIZE_MAX ? NULL : &config->string_maps[position];
+}
+
+struct integer_map* get_integer_map(const struct config* config, betree_var_t variable_id)
+{
+    if(variable_id >= config->map_index_count) {
+        return NULL;
+    }
+    size_t position = config->integer_map_index[variable_id];
+    return position == SIZE_MAX ? NULL : &config->integer_maps[position];
+}
+
+static size_t hash_integer(int64_t integer)
+{
+    // splitmix64 finalizer, enum values are often small and sequential
+    uint64_t x = (uint64_t)integer;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return (size_t)(x ^ (x >> 31));
+}
+
+static void place_string_slot(struct string_map* string_map, uint32_t hash, betree_str_t str)
+{
+    size_t mask = string_map->slot_count - 1;
+    size_t i = hash & mask;
+    while(string_map->slots[i].str != INVALID_STR) {
+        i = (i + 1) & mask;
+    }
+    string_map->slots[i].hash = hash;
+    string_map->slots[i].str = str;
+}
+
+static void index_string_map(struct string_map* string_map, size_t value_count)
+{
+    bfree(string_map->slots);
+    string_map->slot_count = slot_count_for(value_count);
+    string_map->slots = bmalloc(string_map->slot_count * sizeof(*string_map->slots));
+    if(string_map->slots == NULL) {
+        fprintf(stderr, "%s bmalloc failed\n", __func__);
+        abort();
+    }
+    for(size_t i = 0; i < string_map->slot_count; i++) {
+        string_map->slots[i].str = INVALID_STR;
+    }
+    for(size_t i = 0; i < string_map->string_value_count; i++) {
+        place_string_slot(string_map, hash_string(string_map->string_values[i]), i);
+    }
+}
+
+static void place_ienum_slot(struct integer_map* integer_map, betree_ienum_t ienum)
+{
+    size_t mask = integer_map->slot_count - 1;
+    size_t i = hash_integer(integer_map->integer_values[ienum]) & mask;
+    while(integer_map->slots[i] != INVALID_IENUM) {
+        i = (i + 1) & mask;
+    }
+    integer_map->slots[i] = ienum;
+}
+
+static void index_integer_map(struct integer_map* integer_map, size_t value_count)
+{
+    bfree(integer_map->slots);
+    integer_map->slot_count = slot_count_for(value_count);
+    integer_map->slots = bmalloc(integer_map->slot_count * sizeof(*integer_map->slots));
+    if(integer_map->slots == NULL) {
+        fprintf(stderr, "%s bmalloc failed\n", __func__);
+        abort();
+    }
+    for(size_t i = 0; i < integer_map->slot_count; i++) {
+        integer_map->slots[i] = INVALID_IENUM;
+    }
+    for(size_t i = 0; i < integer_map->integer_value_count; i++) {
+        place_ienum_slot(integer_map, i);
+    }
+}
+
+void index_config_maps(struct config* config)
+{
+    index_attr_domains(config);
+    for(size_t i = 0; i < config->string_map_count; i++) {
+        struct string_map* string_map = &config->string_maps[i];
+        reserve_map_index(config, string_map->attr_var.var);
+        config->string_map_index[string_map->attr_var.var] = i;
+        index_string_map(string_map, string_map->string_value_count);
+    }
+    for(size_t i = 0; i < config->integer_map_count; i++) {
+        struct integer_map* integer_map = &config->integer_maps[i];
+        reserve_map_index(config, integer_map->attr_var.var);
+        config->integer_map_index[integer_map->attr_var.var] = i;
+        index_integer_map(integer_map, integer_map->integer_value_count);
+    }
+}
+
+betree_str_t find_string_id(const struct string_map* string_map, const char* string)
+{
+    if(string_map->slot_count == 0) {
+        return INVALID_STR;
+    }
+    uint32_t hash = hash_string(string);
+    size_t mask = string_map->slot_count - 1;
+    for(size_t i = hash & mask;; i = (i + 1) & mask) {
+        const struct string_slot* slot = &string_map->slots[i];
+        if(slot->str == INVALID_STR) {
+            return INVALID_STR;
+        }
+        if(slot->hash == hash && strcmp(string_map->string_values[slot->str], string) == 0) {
+            return slot->str;
+        }
+    }
+}
+
+betree_ienum_t find_ienum_id(const struct integer_map* integer_map, int64_t integer)
+{
+    if(integer_map->slot_count == 0) {
+        return INVALID_IENUM;
+    }
+    size_t mask = integer_map->slot_count - 1;
+    for(size_t i = hash_integer(integer) & mask;; i = (i + 1) & mask) {
+        betree_ienum_t ienum = integer_map->slots[i];
+        if(ienum == INVALID_IENUM || integer_map->integer_values[ienum] == integer) {
+            return ienum;
+        }
+    }
+}
+
+static struct integer_map* add_integer_map(struct attr_var attr_var, struct config* config)
 {
     if(config->integer_map_count == 0) {
         config->integer_maps = bcalloc(sizeof(*config->integer_maps));
@@ -222,14 +627,20 @@ static void add_integer_map(struct attr_var attr_var, struct config* config)
         }
         config->integer_maps = integer_maps;
     }
-    config->integer_maps[config->integer_map_count].attr_var.attr = bstrdup(attr_var.attr);
-    config->integer_maps[config->integer_map_count].attr_var.var = attr_var.var;
-    config->integer_maps[config->integer_map_count].integer_value_count = 0;
-    config->integer_maps[config->integer_map_count].integer_values = 0;
+    struct integer_map* integer_map = &config->integer_maps[config->integer_map_count];
+    integer_map->attr_var.attr = bstrdup(attr_var.attr);
+    integer_map->attr_var.var = attr_var.var;
+    integer_map->integer_value_count = 0;
+    integer_map->integer_values = NULL;
+    integer_map->slot_count = 0;
+    integer_map->slots = NULL;
+    reserve_map_index(config, attr_var.var);
+    config->integer_map_index[attr_var.var] = config->integer_map_count;
     config->integer_map_count++;
+    return integer_map;
 }
 
-static void add_string_map(struct attr_var attr_var, struct config* config)
+static struct string_map* add_string_map(struct attr_var attr_var, struct config* config)
 {
     if(config->string_map_count == 0) {
         config->string_maps = bcalloc(sizeof(*config->string_maps));
@@ -247,93 +658,88 @@ static void add_string_map(struct attr_var attr_var, struct config* config)
         }
         config->string_maps = string_maps;
     }
-    config->string_maps[config->string_map_count].attr_var.attr = bstrdup(attr_var.attr);
-    config->string_maps[config->string_map_count].attr_var.var = attr_var.var;
-    config->string_maps[config->string_map_count].string_value_count = 0;
+    struct string_map* string_map = &config->string_maps[config->string_map_count];
+    string_map->attr_var.attr = bstrdup(attr_var.attr);
+    string_map->attr_var.var = attr_var.var;
+    string_map->string_value_count = 0;
+    string_map->string_values = NULL;
+    string_map->slot_count = 0;
+    string_map->slots = NULL;
+    reserve_map_index(config, attr_var.var);
+    config->string_map_index[attr_var.var] = config->string_map_count;
     config->string_map_count++;
+    return string_map;
 }
 
 static void add_to_integer_map(struct integer_map* integer_map, int64_t integer)
 {
-    if(integer_map->integer_value_count == 0) {
-        integer_map->integer_values = bcalloc(sizeof(*integer_map->integer_values));
-        if(integer_map->integer_values == NULL) {
-            fprintf(stderr, "%s bcalloc failed\n", __func__);
-            abort();
-        }
-    }
-    else {
-        int64_t* integer_values = brealloc(integer_map->integer_values,
-            sizeof(*integer_values) * (integer_map->integer_value_count + 1));
-        if(integer_values == NULL) {
-            fprintf(stderr, "%s brealloc failed\n", __func__);
-            abort();
-        }
-        integer_map->integer_values = integer_values;
+    int64_t* integer_values = brealloc(integer_map->integer_values,
+        sizeof(*integer_values) * (integer_map->integer_value_count + 1));
+    if(integer_values == NULL) {
+        fprintf(stderr, "%s brealloc failed\n", __func__);
+        abort();
     }
+    integer_map->integer_values = integer_values;
     integer_map->integer_values[integer_map->integer_value_count] = integer;
     integer_map->integer_value_count++;
+    if(integer_map->integer_value_count * 2 > integer_map->slot_count) {
+        index_integer_map(integer_map, integer_map->integer_value_count);
+    }
+    else {
+        place_ienum_slot(integer_map, integer_map->integer_value_count - 1);
+    }
 }
 
 static void add_to_string_map(struct string_map* string_map, const char* string)
 {
-    if(string_map->string_value_count == 0) {
-        map_init(&string_map->m);
+    char** string_values = brealloc(string_map->string_values,
+        sizeof(*string_values) * (string_map->string_value_count + 1));
+    if(string_values == NULL) {
+        fprintf(stderr, "%s brealloc failed\n", __func__);
+        abort();
     }
-    map_set(&string_map->m, string, string_map->string_value_count);
+    string_map->string_values = string_values;
+    string_map->string_values[string_map->string_value_count] = bstrdup(string);
     string_map->string_value_count++;
+    if(string_map->string_value_count * 2 > string_map->slot_count) {
+        index_string_map(string_map, string_map->string_value_count);
+    }
+    else {
+        place_string_slot(string_map, hash_string(string), string_map->string_value_count - 1);
+    }
 }
 
 betree_ienum_t try_get_id_for_ienum(
     const struct config* config, struct attr_var attr_var, int64_t integer)
 {
-    for(size_t i = 0; i < config->integer_map_count; i++) {
-        if(config->integer_maps[i].attr_var.var == attr_var.var) {
-            struct integer_map* integer_map = integer_map = &config->integer_maps[i];
-            for(size_t j = 0; j < integer_map->integer_value_count; j++) {
-                if(integer_map->integer_values[j] == integer) {
-                    return j;
-                }
-            }
-            break;
-        }
+    const struct integer_map* integer_map = get_integer_map(config, attr_var.var);
+    if(integer_map == NULL) {
+        return INVALID_IENUM;
     }
-    return INVALID_IENUM;
+    return find_ienum_id(integer_map, integer);
 }
 
 betree_str_t try_get_id_for_string(
     const struct config* config, struct attr_var attr_var, const char* string)
 {
-    for(size_t i = 0; i < config->string_map_count; i++) {
-        if(config->string_maps[i].attr_var.var == attr_var.var) {
-            struct string_map* string_map = string_map = &config->string_maps[i];
-            betree_str_t* str = map_get(&string_map->m, string);
-            if(str != NULL) {
-                return *str;
-            }
-            break;
-        }
+    const struct string_map* string_map = get_string_map(config, attr_var.var);
+    if(string_map == NULL) {
+        return INVALID_STR;
     }
-    return INVALID_STR;
+    return find_string_id(string_map, string);
 }
 
 betree_ienum_t get_id_for_ienum(struct config* config, struct attr_var attr_var, int64_t integer, bool always_assign)
 {
-    struct integer_map* integer_map = NULL;
-    for(size_t i = 0; i < config->integer_map_count; i++) {
-        if(config->integer_maps[i].attr_var.var == attr_var.var) {
-            integer_map = &config->integer_maps[i];
-            for(size_t j = 0; j < integer_map->integer_value_count; j++) {
-                if(integer_map->integer_values[j] == integer) {
-                    return j;
-                }
-            }
-            break;
-        }
-    }
+    struct integer_map* integer_map = get_integer_map(config, attr_var.var);
     if(integer_map == NULL) {
-        add_integer_map(attr_var, config);
-        integer_map = &config->integer_maps[config->integer_map_count - 1];
+        integer_map = add_integer_map(attr_var, config);
+    }
+    else {
+        betree_ienum_t ienum = find_ienum_id(integer_map, integer);
+        if(ienum != INVALID_IENUM) {
+            return ienum;
+        }
     }
     const struct attr_domain* attr_domain
         = get_attr_domain((const struct attr_domain**)config->attr_domains, attr_var.var);
@@ -341,25 +747,21 @@ betree_ienum_t get_id_for_ienum(struct config* config, struct attr_var attr_var,
         return INVALID_IENUM;
     }
     add_to_integer_map(integer_map, integer);
+    touch_config_ids(config);
     return integer_map->integer_value_count - 1;
 }
 
 betree_str_t get_id_for_string(struct config* config, struct attr_var attr_var, const char* string, bool always_assign)
 {
-    struct string_map* string_map = NULL;
-    for(size_t i = 0; i < config->string_map_count; i++) {
-        if(config->string_maps[i].attr_var.var == attr_var.var) {
-            string_map = &config->string_maps[i];
-            betree_str_t* str = map_get(&string_map->m, string);
-            if(str != NULL) {
-                return *str;
-            }
-            break;
-        }
-    }
+    struct string_map* string_map = get_string_map(config, attr_var.var);
     if(string_map == NULL) {
-        add_string_map(attr_var, config);
-        string_map = &config->string_maps[config->string_map_count - 1];
+        string_map = add_string_map(attr_var, config);
+    }
+    else {
+        betree_str_t str = find_string_id(string_map, string);
+        if(str != INVALID_STR) {
+            return str;
+        }
     }
     const struct attr_domain* attr_domain
         = get_attr_domain((const struct attr_domain**)config->attr_domains, attr_var.var);
@@ -367,6 +769,7 @@ betree_str_t get_id_for_string(struct config* config, struct attr_var attr_var,
         return INVALID_STR;
     }
     add_to_string_map(string_map, string);
+    touch_config_ids(config);
     return string_map->string_value_count - 1;
 }
 
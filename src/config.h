@@ -5,24 +5,36 @@
 #include <stddef.h>
 
 #include "config.h"
-#include "map.h"
 #include "var.h"
 
 struct attr_domain {
     struct attr_var attr_var;
     struct value_bound bound;
     bool allow_undefined;
+    // Bumped when bound changes, sub bounds cached under an older version are computed again
+    uint32_t bound_version;
 };
 
+struct activation_index;
 struct ast_node;
+struct parse_cache;
 struct pred_map;
+struct result_cache;
+struct sub_dependents;
 
-typedef map_t(betree_str_t) str_map_t;
+// Open addressing slots, empty when the id is invalid
+struct string_slot {
+    uint32_t hash;
+    betree_str_t str;
+};
 
 struct string_map {
     struct attr_var attr_var;
     size_t string_value_count;
-    str_map_t m;
+    // Strings by id
+    char** string_values;
+    size_t slot_count;
+    struct string_slot* slots;
 };
 
 struct integer_map {
@@ -31,20 +43,49 @@ struct integer_map {
         size_t integer_value_count;
         int64_t* integer_values;
     };
+    size_t slot_count;
+    betree_ienum_t* slots;
 };
 
-struct config* make_config(uint8_t lnode_max_cap, uint8_t partition_min_size);
+struct config* make_config(uint32_t lnode_max_cap, uint32_t partition_min_size);
 struct config* make_default_config();
 void free_config(struct config* config);
+// Copies domains and string/integer maps, the pred map starts empty
+struct config* clone_config(const struct config* config);
+// Gives the config a stamp no other config has
+void touch_config_ids(struct config* config);
+
+struct betree_event_sample;
 
 struct config {
-    uint8_t lnode_max_cap;
-    uint8_t partition_min_size;
+    uint32_t lnode_max_cap;
+    uint32_t partition_min_size;
     uint32_t max_domain_for_split;
+    // Reorder AND/OR operands by estimated cost when inserting
+    bool reorder_expressions;
+    // Keep posting lists in the lnodes so searches only evaluate subs the event can match
+    bool prefilter;
+    // Check the leading operands the subs of an lnode share a column at a time, not kept in snapshots
+    bool columns;
+    // Split cdirs at the median of their subs instead of the middle of their range when it balances them better
+    bool balanced_splits;
+    // Walk the tree with the older recursive search, not kept in snapshots and only there to compare the two
+    bool recursive_search;
+    // Events come with their integer lists and segments sorted and without repeats, not kept in snapshots
+    bool presorted_lists;
+    // Threads a search spreads the evaluation of its candidates over, 1 keeps it on the caller, not kept in snapshots
+    size_t search_threads;
+    // Evaluations after which a sub gets compiled to native code, 0 for never, not kept in snapshots
+    uint64_t jit_threshold;
     struct {
         size_t attr_domain_count;
         struct attr_domain** attr_domains;
     };
+    // Open addressing slots over the attribute names, INVALID_VAR when empty
+    struct {
+        size_t attr_slot_count;
+        betree_var_t* attr_slots;
+    };
     struct {
         size_t string_map_count;
         struct string_map* string_maps;
@@ -53,7 +94,26 @@ struct config {
         size_t integer_map_count;
         struct integer_map* integer_maps;
     };
+    // Position of each variable's map, SIZE_MAX when the variable has none yet
+    struct {
+        size_t map_index_count;
+        size_t* string_map_index;
+        size_t* integer_map_index;
+    };
     struct pred_map* pred_map;
+    // NULL unless betree_set_parse_cache turned it on, not kept in snapshots
+    struct parse_cache* parse_cache;
+    // NULL unless betree_set_result_cache turned it on, not kept in snapshots
+    struct result_cache* result_cache;
+    // Clock and timers of the subs with an activation window, see betree_advance_time
+    struct activation_index* activation;
+    // Subs by the attributes they depend on, see betree_search_delta
+    struct sub_dependents* dependents;
+    // Changes with the variables, string and enum ids and domain bounds. Copies share it until one of
+    // them changes, events prepared for one are then valid for the other
+    uint64_t ids_stamp;
+    // Only set while betree_rebalance rebuilds the tree, partitions are then scored on these events
+    const struct betree_event_sample* event_sample;
 };
 
 void add_attr_domain_i(struct config* config, const char* attr, bool allow_undefined);
@@ -76,12 +136,21 @@ const struct attr_domain* get_attr_domain(const struct attr_domain** attr_domain
 bool is_variable_allow_undefined(const struct config* config, const betree_var_t variable_id);
 
 const char* get_attr_for_id(const struct config* config, betree_var_t variable_id);
+// Lowercases attr before looking it up
 betree_var_t try_get_id_for_attr(const struct config* config, const char* attr);
+betree_var_t try_get_id_for_exact_attr(const struct config* config, const char* attr);
 betree_ienum_t try_get_id_for_ienum(const struct config* config, struct attr_var attr_var, int64_t integer);
 betree_str_t try_get_id_for_string(const struct config* config, struct attr_var attr_var, const char* string);
 betree_ienum_t get_id_for_ienum(struct config* config, struct attr_var attr_var, int64_t integer, bool always_assign);
 betree_str_t get_id_for_string(struct config* config, struct attr_var attr_var, const char* string, bool always_assign);
 
+struct string_map* get_string_map(const struct config* config, betree_var_t variable_id);
+struct integer_map* get_integer_map(const struct config* config, betree_var_t variable_id);
+betree_str_t find_string_id(const struct string_map* string_map, const char* string);
+betree_ienum_t find_ienum_id(const struct integer_map* integer_map, int64_t integer);
+// Rebuilds the name and variable indices and the hash slots from attr_domains, string_values and integer_values
+void index_config_maps(struct config* config);
+
 struct attr_var make_attr_var(const char* attr, struct config* config);
 struct attr_var copy_attr_var(struct attr_var attr_var);
 void free_attr_var(struct attr_var attr_var);
@@ -5,6 +5,8 @@
 #include "alloc.h"
 #include "ast.h"
 #include "betree.h"
+#include "printer.h"
+#include "sub_index.h"
 #include "tree.h"
 #include "utils.h"
 
@@ -184,6 +186,103 @@ static const char* get_name_pdir(const struct config* config, const struct pdir*
     return name;
 }
 
+// Colors and counters of a node, the defaults unless built with BETREE_STATS
+struct dot_heat {
+    const char* color;
+    const char* font_color;
+    char buffer[8];
+    // Appended to the label
+    char counts[96];
+};
+
+static void init_heat(struct dot_heat* heat, const char* color, const char* font_color)
+{
+    heat->color = color;
+    heat->font_color = font_color;
+    heat->counts[0] = '\0';
+}
+
+#ifdef BETREE_STATS
+static const struct cnode* root_of(const struct cnode* cnode)
+{
+    while(cnode->parent != NULL) {
+        const struct cdir* cdir = cnode->parent;
+        while(cdir->parent_type == CNODE_PARENT_CDIR) {
+            cdir = cdir->cdir_parent;
+        }
+        cnode = cdir->pnode_parent->parent->parent;
+    }
+    return cnode;
+}
+
+// From white for nodes no search reached to red for nodes every search reached
+static void set_heat(struct dot_heat* heat, const struct node_stats* stats, const struct cnode* cnode)
+{
+    uint64_t searches = root_of(cnode)->stats.visits;
+    double share = searches == 0 ? 0. : (double)stats->visits / (double)searches;
+    unsigned other = (unsigned)(255. * (1. - share));
+    snprintf(heat->buffer, sizeof(heat->buffer), "#ff%02x%02x", other, other);
+    heat->color = heat->buffer;
+    heat->font_color = "black";
+}
+#endif
+
+static void cnode_heat(struct dot_heat* heat, const struct cnode* cnode)
+{
+    init_heat(heat, "darkolivegreen3", "black");
+#ifdef BETREE_STATS
+    set_heat(heat, &cnode->stats, cnode);
+    snprintf(heat->counts, sizeof(heat->counts), "\\n%" PRIu64, cnode->stats.visits);
+#else
+    (void)cnode;
+#endif
+}
+
+static void lnode_heat(struct dot_heat* heat, const struct lnode* lnode)
+{
+    init_heat(heat, "black", "white");
+#ifdef BETREE_STATS
+    set_heat(heat, &lnode->stats, lnode->parent);
+    snprintf(heat->counts,
+        sizeof(heat->counts),
+        "\\n%" PRIu64 "/%" PRIu64,
+        lnode->stats.matches,
+        lnode->stats.candidates);
+#else
+    (void)lnode;
+#endif
+}
+
+static void pnode_heat(struct dot_heat* heat, const struct pnode* pnode)
+{
+    init_heat(heat, "cyan2", "black");
+#ifdef BETREE_STATS
+    set_heat(heat, &pnode->stats, pnode->parent->parent);
+    snprintf(heat->counts, sizeof(heat->counts), " (%" PRIu64 ")", pnode->stats.visits);
+#else
+    (void)pnode;
+#endif
+}
+
+static void cdir_heat(struct dot_heat* heat, const struct cdir* cdir)
+{
+    init_heat(heat, "darkolivegreen3", "black");
+#ifdef BETREE_STATS
+    const struct cdir* top = cdir;
+    while(top->parent_type == CNODE_PARENT_CDIR) {
+        top = top->cdir_parent;
+    }
+    set_heat(heat, &cdir->stats, top->pnode_parent->parent->parent);
+    snprintf(heat->counts,
+        sizeof(heat->counts),
+        "<br/>%" PRIu64 "/%" PRIu64,
+        cdir->stats.enclosed,
+        cdir->stats.checks);
+#else
+    (void)cdir;
+#endif
+}
+
 static void print_spaces(FILE* f, uint64_t level)
 {
     fprintf(f, "%*s", (int)level * 4, "");
@@ -193,11 +292,16 @@ static void write_dot_file_lnode_names(
     FILE* f, const struct config* config, const struct lnode* lnode, uint64_t level)
 {
     const char* name = get_name_lnode(config, lnode);
+    struct dot_heat heat;
+    lnode_heat(&heat, lnode);
     print_spaces(f, level);
     fprintf(f,
-        "\"%s\" [label=\"l-node\", fillcolor=black, style=filled, fontcolor=white, shape=circle, "
+        "\"%s\" [label=\"l-node%s\", fillcolor=\"%s\", style=filled, fontcolor=%s, shape=circle, "
         "fixedsize=true, width=0.8]\n",
-        name);
+        name,
+        heat.counts,
+        heat.color,
+        heat.font_color);
     if(lnode->sub_count > 0) {
         print_spaces(f, level);
         fprintf(f, "\"%s_subs\" [label=<\\\{", name);
@@ -245,34 +349,42 @@ static void write_dot_file_cdir_td(FILE* f,
         }
         else {
             const char* name = get_name_cdir(config, cdir);
+            struct dot_heat heat;
+            cdir_heat(&heat, cdir);
             switch(cdir->bound.value_type) {
                 case(BETREE_INTEGER):
                 case(BETREE_INTEGER_LIST):
                     fprintf(f,
-                        "<td colspan=\"%lu\" port=\"%s\">[%ld, %ld]</td>\n",
+                        "<td colspan=\"%lu\" port=\"%s\" bgcolor=\"%s\">[%ld, %ld]%s</td>\n",
                         colspan,
                         name,
+                        heat.color,
                         cdir->bound.imin,
-                        cdir->bound.imax);
+                        cdir->bound.imax,
+                        heat.counts);
                     break;
                 case(BETREE_FLOAT): {
                     fprintf(f,
-                        "<td colspan=\"%lu\" port=\"%s\">[%.0f, %.0f]</td>\n",
+                        "<td colspan=\"%lu\" port=\"%s\" bgcolor=\"%s\">[%.0f, %.0f]%s</td>\n",
                         colspan,
                         name,
+                        heat.color,
                         cdir->bound.fmin,
-                        cdir->bound.fmax);
+                        cdir->bound.fmax,
+                        heat.counts);
                     break;
                 }
                 case(BETREE_BOOLEAN): {
                     const char* min = cdir->bound.bmin ? "true" : "false";
                     const char* max = cdir->bound.bmax ? "true" : "false";
                     fprintf(f,
-                        "<td colspan=\"%lu\" port=\"%s\">[%s, %s]</td>\n",
+                        "<td colspan=\"%lu\" port=\"%s\" bgcolor=\"%s\">[%s, %s]%s</td>\n",
                         colspan,
                         name,
+                        heat.color,
                         min,
-                        max);
+                        max,
+                        heat.counts);
                     break;
                 }
                 case(BETREE_STRING):
@@ -280,11 +392,13 @@ static void write_dot_file_cdir_td(FILE* f,
                 case(BETREE_INTEGER_ENUM):
                 case(BETREE_INTEGER_LIST_ENUM):
                     fprintf(f,
-                        "<td colspan=\"%lu\" port=\"%s\">[%zu, %zu]</td>\n",
+                        "<td colspan=\"%lu\" port=\"%s\" bgcolor=\"%s\">[%zu, %zu]%s</td>\n",
                         colspan,
                         name,
+                        heat.color,
                         cdir->bound.smin,
-                        cdir->bound.smax);
+                        cdir->bound.smax,
+                        heat.counts);
                     break;
                 case(BETREE_SEGMENTS): {
                     fprintf(
@@ -400,11 +514,15 @@ static void write_dot_file_pnode_names(
     FILE* f, const struct config* config, const struct pnode* pnode, uint64_t level)
 {
     const char* name = get_name_pnode(config, pnode);
+    struct dot_heat heat;
+    pnode_heat(&heat, pnode);
     print_spaces(f, level);
     fprintf(f,
-        "\"%s\" [label=\"%s\", color=cyan2, fillcolor=cyan2, style=filled, shape=record]\n",
+        "\"%s\" [label=\"%s%s\", color=cyan2, fillcolor=\"%s\", style=filled, shape=record]\n",
         name,
-        pnode->attr_var.attr);
+        pnode->attr_var.attr,
+        heat.counts,
+        heat.color);
     print_spaces(f, level);
     fprintf(f,
         "\"%s_fake\" [label=\"p-node\", color=cyan2, fillcolor=cyan2, style=filled, shape=circle, "
@@ -422,11 +540,15 @@ static void write_dot_file_pdir_inner_names(
     for(size_t i = 0; i < pdir->pnode_count; i++) {
         const struct pnode* pnode = pdir->pnodes[i];
         const char* name = get_name_pnode(config, pnode);
+        struct dot_heat heat;
+        pnode_heat(&heat, pnode);
         print_spaces(f, level);
         fprintf(f,
-            "\"%s\" [label=\"%s\", color=cyan2, fillcolor=cyan2, style=filled, shape=record]\n",
+            "\"%s\" [label=\"%s%s\", color=cyan2, fillcolor=\"%s\", style=filled, shape=record]\n",
             name,
-            pnode->attr_var.attr);
+            pnode->attr_var.attr,
+            heat.counts,
+            heat.color);
         bfree((char*)name);
     }
 }
@@ -456,11 +578,15 @@ static void write_dot_file_cnode_names(
     FILE* f, const struct config* config, const struct cnode* cnode, uint64_t level)
 {
     const char* name = get_name_cnode(config, cnode);
+    struct dot_heat heat;
+    cnode_heat(&heat, cnode);
     print_spaces(f, level);
     fprintf(f,
-        "\"%s\" [label=\"c-node\", color=darkolivegreen3, fillcolor=darkolivegreen3, style=filled, "
+        "\"%s\" [label=\"c-node%s\", color=darkolivegreen3, fillcolor=\"%s\", style=filled, "
         "shape=circle, fixedsize=true, width=0.8]\n",
-        name);
+        name,
+        heat.counts,
+        heat.color);
     bfree((char*)name);
     if(cnode->lnode != NULL) {
         write_dot_file_lnode_names(f, config, cnode->lnode, level);
@@ -782,3 +908,28 @@ void write_dot_file(const struct betree* tree)
     fprintf(f, "}\n");
 }
 
+
+void print_most_expensive_subs(const struct betree* tree, size_t n)
+{
+    struct betree_sub_stats* stats = bcalloc(n * sizeof(*stats));
+    if(n != 0 && stats == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    size_t count = betree_most_expensive_subs(tree, n, stats);
+    for(size_t i = 0; i < count; i++) {
+        const struct betree_sub* sub = sub_index_find(tree->sub_index, stats[i].id);
+        char* expr = ast_to_string(sub->expr);
+        fprintf(stderr,
+            "%" PRIu64 ": cycles = %" PRIu64 ", evaluated = %" PRIu64 ", passed = %" PRIu64
+            ", shorted = %" PRIu64 ", %s\n",
+            stats[i].id,
+            stats[i].cycles,
+            stats[i].evaluations,
+            stats[i].passes,
+            stats[i].shorted,
+            expr);
+        bfree(expr);
+    }
+    bfree(stats);
+}
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <stddef.h>
+
 struct config;
 struct cnode;
 struct betree;
 
 void write_dot_file(const struct betree* tree);
+// To stderr, with their expression, see betree_most_expensive_subs
+void print_most_expensive_subs(const struct betree* tree, size_t n);
 
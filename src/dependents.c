@@ -0,0 +1,170 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "ast.h"
+#include "config.h"
+#include "dependents.h"
+#include "tree.h"
+
+struct sub_dependents* make_sub_dependents()
+{
+    struct arena* previous = set_current_arena(NULL);
+    struct sub_dependents* dependents = bcalloc(sizeof(*dependents));
+    if(dependents == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    pthread_mutex_init(&dependents->lock, NULL);
+    dependents->known = false;
+    dependents->var_count = 0;
+    dependents->offsets = NULL;
+    dependents->subs = NULL;
+    set_current_arena(previous);
+    return dependents;
+}
+
+static void clear_lists(struct sub_dependents* dependents)
+{
+    struct arena* previous = set_current_arena(NULL);
+    bfree(dependents->offsets);
+    bfree(dependents->subs);
+    set_current_arena(previous);
+    dependents->offsets = NULL;
+    dependents->subs = NULL;
+    dependents->var_count = 0;
+    __atomic_store_n(&dependents->known, false, __ATOMIC_RELEASE);
+}
+
+void free_sub_dependents(struct sub_dependents* dependents)
+{
+    if(dependents == NULL) {
+        return;
+    }
+    clear_lists(dependents);
+    pthread_mutex_destroy(&dependents->lock);
+    struct arena* previous = set_current_arena(NULL);
+    bfree(dependents);
+    set_current_arena(previous);
+}
+
+void clear_sub_dependents(struct sub_dependents* dependents)
+{
+    pthread_mutex_lock(&dependents->lock);
+    clear_lists(dependents);
+    pthread_mutex_unlock(&dependents->lock);
+}
+
+static int id_cmp(const void* a, const void* b)
+{
+    betree_sub_t x = (*(const struct betree_sub* const*)a)->id;
+    betree_sub_t y = (*(const struct betree_sub* const*)b)->id;
+    return (x > y) - (x < y);
+}
+
+// Attributes of the subs first to last, which all have the same id
+static void group_mask(struct betree_sub* const* first, struct betree_sub* const* last, size_t word_count, uint64_t* used)
+{
+    memset(used, 0, word_count * sizeof(*used));
+    for(struct betree_sub* const* sub = first; sub != last; sub++) {
+        for(size_t w = 0; w < (*sub)->short_circuit.word_count && w < word_count; w++) {
+            used[w] |= (*sub)->attr_vars[w];
+        }
+        betree_var_t now_var = find_now_var((*sub)->expr);
+        if(now_var != INVALID_VAR) {
+            used[now_var / 64] |= 1ULL << (now_var % 64);
+        }
+    }
+}
+
+// Counts the subs of each attribute into offsets, or writes them at cursors when it is set
+static void list_groups(struct betree_sub** subs,
+    size_t sub_count,
+    size_t var_count,
+    uint64_t* used,
+    size_t* offsets,
+    size_t* cursors,
+    struct betree_sub** lists)
+{
+    size_t word_count = var_count / 64 + 1;
+    for(size_t first = 0; first < sub_count;) {
+        size_t last = first + 1;
+        while(last < sub_count && subs[last]->id == subs[first]->id) {
+            last++;
+        }
+        group_mask(subs + first, subs + last, word_count, used);
+        for(size_t w = 0; w < word_count; w++) {
+            for(uint64_t bits = used[w]; bits != 0; bits &= bits - 1) {
+                size_t var = w * 64 + (size_t)__builtin_ctzll(bits);
+                if(var >= var_count) {
+                    continue;
+                }
+                if(cursors == NULL) {
+                    offsets[var + 1] += last - first;
+                }
+                else {
+                    memcpy(lists + cursors[var], subs + first, (last - first) * sizeof(*lists));
+                    cursors[var] += last - first;
+                }
+            }
+        }
+        first = last;
+    }
+}
+
+// Expects the lock
+static void build_lists(struct sub_dependents* dependents, const struct config* config, const struct cnode* cnode)
+{
+    size_t var_count = config->attr_domain_count;
+    size_t sub_count = 0;
+    collect_subs(cnode, NULL, &sub_count);
+    struct betree_sub** subs = bcalloc((sub_count + 1) * sizeof(*subs));
+    uint64_t* used = bcalloc((var_count / 64 + 1) * sizeof(*used));
+    size_t* cursors = bcalloc((var_count + 1) * sizeof(*cursors));
+    if(subs == NULL || used == NULL || cursors == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    sub_count = 0;
+    collect_subs(cnode, subs, &sub_count);
+    qsort(subs, sub_count, sizeof(*subs), id_cmp);
+    struct arena* previous = set_current_arena(NULL);
+    size_t* offsets = bcalloc((var_count + 1) * sizeof(*offsets));
+    if(offsets == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    list_groups(subs, sub_count, var_count, used, offsets, NULL, NULL);
+    for(size_t var = 0; var < var_count; var++) {
+        offsets[var + 1] += offsets[var];
+    }
+    struct betree_sub** lists = bcalloc((offsets[var_count] + 1) * sizeof(*lists));
+    if(lists == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    set_current_arena(previous);
+    memcpy(cursors, offsets, (var_count + 1) * sizeof(*cursors));
+    list_groups(subs, sub_count, var_count, used, offsets, cursors, lists);
+    dependents->var_count = var_count;
+    dependents->offsets = offsets;
+    dependents->subs = lists;
+    __atomic_store_n(&dependents->known, true, __ATOMIC_RELEASE);
+    bfree(cursors);
+    bfree(used);
+    bfree(subs);
+}
+
+void find_sub_dependents(struct sub_dependents* dependents, const struct config* config, const struct cnode* cnode)
+{
+    if(__atomic_load_n(&dependents->known, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    pthread_mutex_lock(&dependents->lock);
+    if(!dependents->known) {
+        build_lists(dependents, config, cnode);
+    }
+    pthread_mutex_unlock(&dependents->lock);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct betree_sub;
+struct cnode;
+struct config;
+
+/*
+ * Subs by the attributes their outcome depends on, their attr_vars and the now attribute of their
+ * frequency caps and segment predicates, for searches that start from the matches of a previous
+ * event. Reports only tell subs apart by id, so subs sharing an id are listed under the attributes
+ * of all of them. Built off the arena by the first search that needs it after the subs change
+ */
+
+struct sub_dependents {
+    pthread_mutex_t lock;
+    bool known;
+    size_t var_count;
+    // The subs of var are subs[offsets[var]] up to subs[offsets[var + 1]]
+    size_t* offsets;
+    struct betree_sub** subs;
+};
+
+struct sub_dependents* make_sub_dependents();
+void free_sub_dependents(struct sub_dependents* dependents);
+// For when the subs change
+void clear_sub_dependents(struct sub_dependents* dependents);
+// Builds the lists if they aren't known, safe to call from several threads
+void find_sub_dependents(struct sub_dependents* dependents, const struct config* config, const struct cnode* cnode);
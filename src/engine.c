@@ -0,0 +1,514 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "alloc.h"
+#include "betree.h"
+#include "config.h"
+#include "tree.h"
+#include "utils.h"
+
+/*
+ * Producers push requests on an intrusive MPSC queue with one exchange and one store. The dispatcher
+ * is its only consumer: it takes whatever has arrived, up to BETREE_BATCH_SIZE requests, parses them
+ * and hands the batch to a worker, then goes on with the next one while the workers walk the tree
+ * and evaluate. Workers complete the requests of their batch once it is searched
+ */
+
+#define ENGINE_MAX_WORKERS 16
+// Batches parsed ahead of the workers, the dispatcher waits past that
+#define ENGINE_BATCHES_AHEAD 2
+
+int event_parse(const char* text, struct betree_event** event);
+
+struct betree_engine_future {
+    pthread_mutex_t lock;
+    pthread_cond_t done_cond;
+    bool done;
+    bool valid;
+    struct report report;
+};
+
+struct engine_request {
+    _Atomic(struct engine_request*) next;
+    char* text;
+    betree_engine_callback callback;
+    void* data;
+    struct betree_engine_future* future;
+    uint64_t submitted;
+    // Set by the dispatcher, NULL when the text could not be parsed
+    struct betree_event* event;
+};
+
+struct engine_queue {
+    _Atomic(struct engine_request*) head;
+    struct engine_request* tail;
+    struct engine_request stub;
+};
+
+struct engine_batch {
+    size_t count;
+    struct engine_request* requests[BETREE_BATCH_SIZE];
+    struct engine_batch* next;
+};
+
+struct betree_engine {
+    const struct betree* tree;
+    struct engine_queue queue;
+    // The dispatcher only sleeps after raising idle, producers take the lock to wake it then
+    atomic_bool idle;
+    atomic_bool stopping;
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;
+    pthread_t dispatcher;
+    // Parsed batches waiting for a worker
+    pthread_mutex_t batch_lock;
+    pthread_cond_t batch_ready;
+    pthread_cond_t batch_taken;
+    struct engine_batch* batches;
+    struct engine_batch* last_batch;
+    size_t batch_count;
+    bool dispatched_all;
+    size_t worker_count;
+    pthread_t workers[ENGINE_MAX_WORKERS];
+    // Metrics, relaxed
+    atomic_uint_fast64_t submitted;
+    atomic_uint_fast64_t completed;
+    atomic_uint_fast64_t invalid;
+    atomic_uint_fast64_t dispatched_batches;
+    atomic_uint_fast64_t latency_total;
+    atomic_uint_fast64_t latency_max;
+    atomic_uint_fast64_t latency_buckets[BETREE_ENGINE_LATENCY_BUCKETS];
+};
+
+static uint64_t engine_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static void init_queue(struct engine_queue* queue)
+{
+    atomic_init(&queue->stub.next, NULL);
+    atomic_init(&queue->head, &queue->stub);
+    queue->tail = &queue->stub;
+}
+
+static void push_request(struct engine_queue* queue, struct engine_request* request)
+{
+    atomic_store_explicit(&request->next, NULL, memory_order_relaxed);
+    struct engine_request* previous = atomic_exchange_explicit(&queue->head, request, memory_order_acq_rel);
+    atomic_store_explicit(&previous->next, request, memory_order_release);
+}
+
+// NULL when the queue is empty or a producer is between its two steps, the request shows up later
+static struct engine_request* pop_request(struct engine_queue* queue)
+{
+    struct engine_request* tail = queue->tail;
+    struct engine_request* next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if(tail == &queue->stub) {
+        if(next == NULL) {
+            return NULL;
+        }
+        queue->tail = next;
+        tail = next;
+        next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    }
+    if(next != NULL) {
+        queue->tail = next;
+        return tail;
+    }
+    if(tail != atomic_load_explicit(&queue->head, memory_order_acquire)) {
+        return NULL;
+    }
+    // The last request only leaves once the stub is behind it
+    push_request(queue, &queue->stub);
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if(next != NULL) {
+        queue->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+static bool queue_empty(struct engine_queue* queue)
+{
+    return queue->tail == &queue->stub && atomic_load_explicit(&queue->stub.next, memory_order_acquire) == NULL
+        && atomic_load_explicit(&queue->head, memory_order_acquire) == &queue->stub;
+}
+
+// Unknown variables would abort in fill_event, such events are refused instead
+static struct betree_event* prepare_event(const struct config* config, const char* text)
+{
+    struct betree_event* event = NULL;
+    if(event_parse(text, &event) != 0) {
+        return NULL;
+    }
+    for(size_t i = 0; i < event->variable_count; i++) {
+        const struct betree_variable* pred = event->variables[i];
+        if(pred != NULL && try_get_id_for_attr(config, pred->attr_var.attr) == INVALID_VAR) {
+            free_event(event);
+            return NULL;
+        }
+    }
+    fill_event(config, event);
+    sort_event_lists(config, event);
+    return event;
+}
+
+static void queue_batch(struct betree_engine* engine, struct engine_batch* batch)
+{
+    pthread_mutex_lock(&engine->batch_lock);
+    while(engine->batch_count >= ENGINE_BATCHES_AHEAD * engine->worker_count) {
+        pthread_cond_wait(&engine->batch_taken, &engine->batch_lock);
+    }
+    batch->next = NULL;
+    if(engine->last_batch == NULL) {
+        engine->batches = batch;
+    }
+    else {
+        engine->last_batch->next = batch;
+    }
+    engine->last_batch = batch;
+    engine->batch_count++;
+    pthread_cond_signal(&engine->batch_ready);
+    pthread_mutex_unlock(&engine->batch_lock);
+    atomic_fetch_add_explicit(&engine->dispatched_batches, 1, memory_order_relaxed);
+}
+
+static void wait_for_requests(struct betree_engine* engine)
+{
+    pthread_mutex_lock(&engine->idle_lock);
+    atomic_store(&engine->idle, true);
+    // A producer that pushed before seeing idle did not signal, the queue is checked again under the lock
+    if(queue_empty(&engine->queue) && !atomic_load(&engine->stopping)) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += 1000000;
+        if(until.tv_nsec >= 1000000000) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000;
+        }
+        // Also bounds the wait on a producer caught between its two steps
+        pthread_cond_timedwait(&engine->idle_cond, &engine->idle_lock, &until);
+    }
+    atomic_store(&engine->idle, false);
+    pthread_mutex_unlock(&engine->idle_lock);
+}
+
+static void* dispatch(void* data)
+{
+    struct betree_engine* engine = data;
+    const struct config* config = engine->tree->config;
+    struct engine_batch* batch = NULL;
+    while(true) {
+        struct engine_request* request = pop_request(&engine->queue);
+        if(request != NULL) {
+            if(batch == NULL) {
+                batch = bmalloc(sizeof(*batch));
+                if(batch == NULL) {
+                    fprintf(stderr, "%s bmalloc failed\n", __func__);
+                    abort();
+                }
+                batch->count = 0;
+            }
+            request->event = prepare_event(config, request->text);
+            batch->requests[batch->count++] = request;
+            if(batch->count < BETREE_BATCH_SIZE) {
+                continue;
+            }
+        }
+        // Nothing more has arrived or the batch is full
+        if(batch != NULL) {
+            queue_batch(engine, batch);
+            batch = NULL;
+            continue;
+        }
+        if(atomic_load(&engine->stopping) && queue_empty(&engine->queue)) {
+            break;
+        }
+        wait_for_requests(engine);
+    }
+    pthread_mutex_lock(&engine->batch_lock);
+    engine->dispatched_all = true;
+    pthread_cond_broadcast(&engine->batch_ready);
+    pthread_mutex_unlock(&engine->batch_lock);
+    return NULL;
+}
+
+// NULL once the dispatcher is done and every batch is taken
+static struct engine_batch* take_batch(struct betree_engine* engine)
+{
+    pthread_mutex_lock(&engine->batch_lock);
+    while(engine->batches == NULL && !engine->dispatched_all) {
+        pthread_cond_wait(&engine->batch_ready, &engine->batch_lock);
+    }
+    struct engine_batch* batch = engine->batches;
+    if(batch != NULL) {
+        engine->batches = batch->next;
+        if(engine->batches == NULL) {
+            engine->last_batch = NULL;
+        }
+        engine->batch_count--;
+        pthread_cond_signal(&engine->batch_taken);
+    }
+    pthread_mutex_unlock(&engine->batch_lock);
+    return batch;
+}
+
+static void record_latency(struct betree_engine* engine, uint64_t latency)
+{
+    atomic_fetch_add_explicit(&engine->latency_total, latency, memory_order_relaxed);
+    uint64_t max = atomic_load_explicit(&engine->latency_max, memory_order_relaxed);
+    while(latency > max
+        && !atomic_compare_exchange_weak_explicit(
+            &engine->latency_max, &max, latency, memory_order_relaxed, memory_order_relaxed)) {
+    }
+    // Bucket i counts the latencies under 2^i microseconds, the last one the rest
+    uint64_t micros = latency / 1000;
+    size_t bucket = micros == 0 ? 0 : 64 - (size_t)__builtin_clzll(micros);
+    bucket = smin(bucket, BETREE_ENGINE_LATENCY_BUCKETS - 1);
+    atomic_fetch_add_explicit(&engine->latency_buckets[bucket], 1, memory_order_relaxed);
+}
+
+static void complete_request(struct betree_engine* engine, struct engine_request* request, bool valid, struct report* report)
+{
+    if(!valid) {
+        atomic_fetch_add_explicit(&engine->invalid, 1, memory_order_relaxed);
+    }
+    record_latency(engine, engine_now() - request->submitted);
+    if(request->future != NULL) {
+        struct betree_engine_future* future = request->future;
+        pthread_mutex_lock(&future->lock);
+        // The matches move to the future, the worker's report starts over
+        future->report = *report;
+        *report = (struct report){ 0 };
+        future->valid = valid;
+        future->done = true;
+        pthread_cond_signal(&future->done_cond);
+        pthread_mutex_unlock(&future->lock);
+    }
+    else {
+        request->callback(request->data, valid, report);
+    }
+    atomic_fetch_add_explicit(&engine->completed, 1, memory_order_relaxed);
+    if(request->event != NULL) {
+        free_event(request->event);
+    }
+    bfree(request->text);
+    bfree(request);
+}
+
+static void* work(void* data)
+{
+    struct betree_engine* engine = data;
+    const struct config* config = engine->tree->config;
+    struct betree_search_context* contexts[BETREE_BATCH_SIZE];
+    struct report* reports[BETREE_BATCH_SIZE];
+    for(size_t i = 0; i < BETREE_BATCH_SIZE; i++) {
+        contexts[i] = make_search_context(config);
+        reports[i] = make_report();
+    }
+    struct engine_batch* batch;
+    while((batch = take_batch(engine)) != NULL) {
+        uint64_t live = 0;
+        for(size_t i = 0; i < batch->count; i++) {
+            const struct betree_event* event = batch->requests[i]->event;
+            betree_report_reset(reports[i]);
+            if(event == NULL) {
+                continue;
+            }
+            reset_search_context(config, contexts[i]);
+            for(size_t v = 0; v < event->variable_count; v++) {
+                if(event->variables[v] != NULL) {
+                    contexts[i]->preds[event->variables[v]->attr_var.var] = event->variables[v];
+                }
+            }
+            if(validate_variables(config, contexts[i]->preds)) {
+                live |= 1ULL << i;
+            }
+        }
+        betree_search_batch_with_preds(config, contexts, live, engine->tree->cnode, reports);
+        for(size_t i = 0; i < batch->count; i++) {
+            complete_request(engine, batch->requests[i], (live >> i) & 1, reports[i]);
+        }
+        bfree(batch);
+    }
+    for(size_t i = 0; i < BETREE_BATCH_SIZE; i++) {
+        free_search_context(contexts[i]);
+        free_report(reports[i]);
+    }
+    return NULL;
+}
+
+struct betree_engine* betree_engine_make(const struct betree* tree, size_t worker_count)
+{
+    struct betree_engine* engine = bcalloc(sizeof(*engine));
+    if(engine == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    engine->tree = tree;
+    init_queue(&engine->queue);
+    atomic_init(&engine->idle, false);
+    atomic_init(&engine->stopping, false);
+    pthread_mutex_init(&engine->idle_lock, NULL);
+    pthread_cond_init(&engine->idle_cond, NULL);
+    pthread_mutex_init(&engine->batch_lock, NULL);
+    pthread_cond_init(&engine->batch_ready, NULL);
+    pthread_cond_init(&engine->batch_taken, NULL);
+    engine->batches = NULL;
+    engine->last_batch = NULL;
+    engine->batch_count = 0;
+    engine->dispatched_all = false;
+    engine->worker_count = smin(smax(1, worker_count), ENGINE_MAX_WORKERS);
+    for(size_t i = 0; i < engine->worker_count; i++) {
+        if(pthread_create(&engine->workers[i], NULL, work, engine) != 0) {
+            fprintf(stderr, "%s pthread_create failed\n", __func__);
+            abort();
+        }
+    }
+    if(pthread_create(&engine->dispatcher, NULL, dispatch, engine) != 0) {
+        fprintf(stderr, "%s pthread_create failed\n", __func__);
+        abort();
+    }
+    return engine;
+}
+
+void betree_engine_free(struct betree_engine* engine)
+{
+    if(engine == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&engine->idle_lock);
+    atomic_store(&engine->stopping, true);
+    pthread_cond_signal(&engine->idle_cond);
+    pthread_mutex_unlock(&engine->idle_lock);
+    pthread_join(engine->dispatcher, NULL);
+    for(size_t i = 0; i < engine->worker_count; i++) {
+        pthread_join(engine->workers[i], NULL);
+    }
+    pthread_cond_destroy(&engine->batch_taken);
+    pthread_cond_destroy(&engine->batch_ready);
+    pthread_mutex_destroy(&engine->batch_lock);
+    pthread_cond_destroy(&engine->idle_cond);
+    pthread_mutex_destroy(&engine->idle_lock);
+    bfree(engine);
+}
+
+static void submit(struct betree_engine* engine, struct engine_request* request)
+{
+    request->submitted = engine_now();
+    request->event = NULL;
+    atomic_fetch_add_explicit(&engine->submitted, 1, memory_order_relaxed);
+    push_request(&engine->queue, request);
+    if(atomic_load(&engine->idle)) {
+        pthread_mutex_lock(&engine->idle_lock);
+        pthread_cond_signal(&engine->idle_cond);
+        pthread_mutex_unlock(&engine->idle_lock);
+    }
+}
+
+static struct engine_request* make_request(const char* event)
+{
+    struct engine_request* request = bmalloc(sizeof(*request));
+    if(request == NULL) {
+        fprintf(stderr, "%s bmalloc failed\n", __func__);
+        abort();
+    }
+    request->text = bstrdup(event);
+    if(request->text == NULL) {
+        fprintf(stderr, "%s bstrdup failed\n", __func__);
+        abort();
+    }
+    return request;
+}
+
+void betree_engine_submit(
+    struct betree_engine* engine, const char* event, betree_engine_callback callback, void* data)
+{
+    struct engine_request* request = make_request(event);
+    request->callback = callback;
+    request->data = data;
+    request->future = NULL;
+    submit(engine, request);
+}
+
+struct betree_engine_future* betree_engine_submit_future(struct betree_engine* engine, const char* event)
+{
+    struct betree_engine_future* future = bcalloc(sizeof(*future));
+    if(future == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    pthread_mutex_init(&future->lock, NULL);
+    pthread_cond_init(&future->done_cond, NULL);
+    future->done = false;
+    struct engine_request* request = make_request(event);
+    request->callback = NULL;
+    request->data = NULL;
+    request->future = future;
+    submit(engine, request);
+    return future;
+}
+
+bool betree_engine_future_ready(struct betree_engine_future* future)
+{
+    pthread_mutex_lock(&future->lock);
+    bool done = future->done;
+    pthread_mutex_unlock(&future->lock);
+    return done;
+}
+
+bool betree_engine_future_wait(struct betree_engine_future* future, struct report* report)
+{
+    pthread_mutex_lock(&future->lock);
+    while(!future->done) {
+        pthread_cond_wait(&future->done_cond, &future->lock);
+    }
+    pthread_mutex_unlock(&future->lock);
+    bool valid = future->valid;
+    for(size_t i = 0; i < future->report.matched; i++) {
+        if(report->matched == report->capacity) {
+            size_t capacity = report->capacity == 0 ? 8 : report->capacity * 2;
+            betree_sub_t* subs = brealloc(report->subs, sizeof(*report->subs) * capacity);
+            if(subs == NULL) {
+                fprintf(stderr, "%s brealloc failed\n", __func__);
+                abort();
+            }
+            report->subs = subs;
+            report->capacity = capacity;
+        }
+        report->subs[report->matched++] = future->report.subs[i];
+    }
+    report->evaluated += future->report.evaluated;
+    report->memoized += future->report.memoized;
+    report->shorted += future->report.shorted;
+    bfree(future->report.subs);
+    pthread_cond_destroy(&future->done_cond);
+    pthread_mutex_destroy(&future->lock);
+    bfree(future);
+    return valid;
+}
+
+void betree_engine_get_metrics(const struct betree_engine* engine, struct betree_engine_metrics* metrics)
+{
+    struct betree_engine* shared = (struct betree_engine*)engine;
+    metrics->submitted = atomic_load_explicit(&shared->submitted, memory_order_relaxed);
+    metrics->completed = atomic_load_explicit(&shared->completed, memory_order_relaxed);
+    // Completions after submitted was read can make up for it
+    metrics->queue_depth = metrics->submitted < metrics->completed ? 0 : metrics->submitted - metrics->completed;
+    metrics->invalid = atomic_load_explicit(&shared->invalid, memory_order_relaxed);
+    metrics->batches = atomic_load_explicit(&shared->dispatched_batches, memory_order_relaxed);
+    metrics->latency_total_ns = atomic_load_explicit(&shared->latency_total, memory_order_relaxed);
+    metrics->latency_max_ns = atomic_load_explicit(&shared->latency_max, memory_order_relaxed);
+    for(size_t i = 0; i < BETREE_ENGINE_LATENCY_BUCKETS; i++) {
+        metrics->latency_buckets[i] = atomic_load_explicit(&shared->latency_buckets[i], memory_order_relaxed);
+    }
+}
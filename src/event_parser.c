@@ -1,8 +1,9 @@
-/* A Bison parser, made by GNU Bison 3.0.4.  */
+/* A Bison parser, made by GNU Bison 3.8.2.  */
 
 /* Bison implementation for Yacc-like parsers in C
 
-   Copyright (C) 1984, 1989-1990, 2000-2015 Free Software Foundation, Inc.
+   Copyright (C) 1984, 1989-1990, 2000-2015, 2018-2021 Free Software Foundation,
+   Inc.
 
    This program is free software: you can redistribute it and/or modify
    it under the terms of the GNU General Public License as published by
@@ -15,7 +16,7 @@
    GNU General Public License for more details.
 
    You should have received a copy of the GNU General Public License
-   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
 
 /* As a special exception, you may create a larger work that contains
    part or all of the Bison parser skeleton and distribute that work
@@ -33,6 +34,10 @@
 /* C LALR(1) parser skeleton written by Richard Stallman, by
    simplifying the original so-called "semantic" parser.  */
 
+/* DO NOT RELY ON FEATURES THAT ARE NOT DOCUMENTED in the manual,
+   especially those whose name start with YY_ or yy_.  They are
+   private implementation details that can be changed or removed.  */
+
 /* All symbols defined below should begin with yy or YY, to avoid
    infringing on user name space.  This should be done even for local
    variables, as they might otherwise be expanded by user macros.
@@ -40,11 +45,11 @@
    define necessary library symbols; they are noted "INFRINGES ON
    USER NAME SPACE" below.  */
 
-/* Identify Bison output.  */
-#define YYBISON 1
+/* Identify Bison output, and Bison version.  */
+#define YYBISON 30802
 
-/* Bison version.  */
-#define YYBISON_VERSION "3.0.4"
+/* Bison version string.  */
+#define YYBISON_VERSION "3.8.2"
 
 /* Skeleton name.  */
 #define YYSKELETON_NAME "yacc.c"
@@ -67,9 +72,8 @@
 #define yydebug         zzdebug
 #define yynerrs         zznerrs
 
-
-/* Copy the first part of user declarations.  */
-#line 1 "src/event_parser.y" /* yacc.c:339  */
+/* First part of user prologue.  */
+#line 1 "src/event_parser.y"
 
     #include <stdint.h>
     #include <stdbool.h>
@@ -81,161 +85,172 @@
     #include "event_parser.h"
     #include "tree.h"
     #include "value.h"
-    struct betree_event *root;
     extern int zzlex();
-    void zzerror(void *scanner, const char *s) { (void)scanner; printf("ERROR: %s\n", s); }
+    void zzerror(void *scanner, struct betree_event **root, const char *s) { (void)scanner; (void)root; printf("ERROR: %s\n", s); }
 #if defined(__GNUC__)
     #pragma GCC diagnostic push
     #pragma GCC diagnostic ignored "-Wswitch-default"
     #pragma GCC diagnostic ignored "-Wshadow"
 #endif
-#line 28 "src/event_parser.y" /* yacc.c:339  */
+#line 27 "src/event_parser.y"
 
     int event_parse(const char *text, struct betree_event **event);
 
-#line 97 "src/event_parser.c" /* yacc.c:339  */
+#line 100 "src/event_parser.c"
 
-# ifndef YY_NULLPTR
-#  if defined __cplusplus && 201103L <= __cplusplus
-#   define YY_NULLPTR nullptr
+# ifndef YY_CAST
+#  ifdef __cplusplus
+#   define YY_CAST(Type, Val) static_cast<Type> (Val)
+#   define YY_REINTERPRET_CAST(Type, Val) reinterpret_cast<Type> (Val)
 #  else
-#   define YY_NULLPTR 0
+#   define YY_CAST(Type, Val) ((Type) (Val))
+#   define YY_REINTERPRET_CAST(Type, Val) ((Type) (Val))
 #  endif
 # endif
-
-/* Enabling verbose error messages.  */
-#ifdef YYERROR_VERBOSE
-# undef YYERROR_VERBOSE
-# define YYERROR_VERBOSE 1
-#else
-# define YYERROR_VERBOSE 0
-#endif
-
-/* In a future release of Bison, this section will be replaced
-   by #include "event_parser.h".  */
-#ifndef YY_ZZ_SRC_EVENT_PARSER_H_INCLUDED
-# define YY_ZZ_SRC_EVENT_PARSER_H_INCLUDED
-/* Debug traces.  */
-#ifndef ZZDEBUG
-# if defined YYDEBUG
-#if YYDEBUG
-#   define ZZDEBUG 1
+# ifndef YY_NULLPTR
+#  if defined __cplusplus
+#   if 201103L <= __cplusplus
+#    define YY_NULLPTR nullptr
+#   else
+#    define YY_NULLPTR 0
+#   endif
 #  else
-#   define ZZDEBUG 0
+#   define YY_NULLPTR ((void*)0)
 #  endif
-# else /* ! defined YYDEBUG */
-#  define ZZDEBUG 0
-# endif /* ! defined YYDEBUG */
-#endif  /* ! defined ZZDEBUG */
-#if ZZDEBUG
-extern int zzdebug;
-#endif
+# endif
 
-/* Token type.  */
-#ifndef ZZTOKENTYPE
-# define ZZTOKENTYPE
-  enum zztokentype
-  {
-    EVENT_LCURLY = 258,
-    EVENT_RCURLY = 259,
-    EVENT_LSQUARE = 260,
-    EVENT_RSQUARE = 261,
-    EVENT_COMMA = 262,
-    EVENT_COLON = 263,
-    EVENT_MINUS = 264,
-    EVENT_NULL = 265,
-    EVENT_TRUE = 266,
-    EVENT_FALSE = 267,
-    EVENT_INTEGER = 268,
-    EVENT_FLOAT = 269,
-    EVENT_STRING = 270
-  };
-#endif
-/* Tokens.  */
-#define EVENT_LCURLY 258
-#define EVENT_RCURLY 259
-#define EVENT_LSQUARE 260
-#define EVENT_RSQUARE 261
-#define EVENT_COMMA 262
-#define EVENT_COLON 263
-#define EVENT_MINUS 264
-#define EVENT_NULL 265
-#define EVENT_TRUE 266
-#define EVENT_FALSE 267
-#define EVENT_INTEGER 268
-#define EVENT_FLOAT 269
-#define EVENT_STRING 270
-
-/* Value type.  */
-#if ! defined ZZSTYPE && ! defined ZZSTYPE_IS_DECLARED
-
-union ZZSTYPE
+#include "event_parser.h"
+/* Symbol kind.  */
+enum yysymbol_kind_t
 {
-#line 32 "src/event_parser.y" /* yacc.c:355  */
-
-    int token;
-    char *string;
-
-    bool boolean_value;
-    int64_t integer_value;
-    double float_value;
-    struct string_value string_value;
-    struct betree_integer_list* integer_list_value;
-    struct betree_string_list* string_list_value;
-    struct betree_segments* segments_list_value;
-    struct betree_segment* segment_value;
-    struct betree_frequency_caps* frequencies_value;
-    struct betree_frequency_cap* frequency_value;
-
-    struct value value;
-    struct betree_variable* variable;
-
-    struct betree_event* event;
-
-#line 196 "src/event_parser.c" /* yacc.c:355  */
+  YYSYMBOL_YYEMPTY = -2,
+  YYSYMBOL_YYEOF = 0,                      /* "end of file"  */
+  YYSYMBOL_YYerror = 1,                    /* error  */
+  YYSYMBOL_YYUNDEF = 2,                    /* "invalid token"  */
+  YYSYMBOL_EVENT_LCURLY = 3,               /* EVENT_LCURLY  */
+  YYSYMBOL_EVENT_RCURLY = 4,               /* EVENT_RCURLY  */
+  YYSYMBOL_EVENT_LSQUARE = 5,              /* EVENT_LSQUARE  */
+  YYSYMBOL_EVENT_RSQUARE = 6,              /* EVENT_RSQUARE  */
+  YYSYMBOL_EVENT_COMMA = 7,                /* EVENT_COMMA  */
+  YYSYMBOL_EVENT_COLON = 8,                /* EVENT_COLON  */
+  YYSYMBOL_EVENT_MINUS = 9,                /* EVENT_MINUS  */
+  YYSYMBOL_EVENT_NULL = 10,                /* EVENT_NULL  */
+  YYSYMBOL_EVENT_TRUE = 11,                /* EVENT_TRUE  */
+  YYSYMBOL_EVENT_FALSE = 12,               /* EVENT_FALSE  */
+  YYSYMBOL_EVENT_INTEGER = 13,             /* EVENT_INTEGER  */
+  YYSYMBOL_EVENT_FLOAT = 14,               /* EVENT_FLOAT  */
+  YYSYMBOL_EVENT_STRING = 15,              /* EVENT_STRING  */
+  YYSYMBOL_YYACCEPT = 16,                  /* $accept  */
+  YYSYMBOL_program = 17,                   /* program  */
+  YYSYMBOL_variable_loop = 18,             /* variable_loop  */
+  YYSYMBOL_variable = 19,                  /* variable  */
+  YYSYMBOL_value = 20,                     /* value  */
+  YYSYMBOL_boolean = 21,                   /* boolean  */
+  YYSYMBOL_integer = 22,                   /* integer  */
+  YYSYMBOL_float = 23,                     /* float  */
+  YYSYMBOL_string = 24,                    /* string  */
+  YYSYMBOL_empty_list_value = 25,          /* empty_list_value  */
+  YYSYMBOL_integer_list_value = 26,        /* integer_list_value  */
+  YYSYMBOL_integer_list_loop = 27,         /* integer_list_loop  */
+  YYSYMBOL_string_list_value = 28,         /* string_list_value  */
+  YYSYMBOL_string_list_loop = 29,          /* string_list_loop  */
+  YYSYMBOL_segments_value = 30,            /* segments_value  */
+  YYSYMBOL_segments_loop = 31,             /* segments_loop  */
+  YYSYMBOL_segment_value = 32,             /* segment_value  */
+  YYSYMBOL_frequencies_value = 33,         /* frequencies_value  */
+  YYSYMBOL_frequencies_loop = 34,          /* frequencies_loop  */
+  YYSYMBOL_frequency_value = 35            /* frequency_value  */
 };
+typedef enum yysymbol_kind_t yysymbol_kind_t;
 
-typedef union ZZSTYPE ZZSTYPE;
-# define ZZSTYPE_IS_TRIVIAL 1
-# define ZZSTYPE_IS_DECLARED 1
-#endif
 
 
 
-int zzparse (void *scanner);
+#ifdef short
+# undef short
+#endif
 
-#endif /* !YY_ZZ_SRC_EVENT_PARSER_H_INCLUDED  */
+/* On compilers that do not define __PTRDIFF_MAX__ etc., make sure
+   <limits.h> and (if available) <stdint.h> are included
+   so that the code can choose integer types of a good width.  */
 
-/* Copy the second part of user declarations.  */
+#ifndef __PTRDIFF_MAX__
+# include <limits.h> /* INFRINGES ON USER NAME SPACE */
+# if defined __STDC_VERSION__ && 199901 <= __STDC_VERSION__
+#  include <stdint.h> /* INFRINGES ON USER NAME SPACE */
+#  define YY_STDINT_H
+# endif
+#endif
 
-#line 212 "src/event_parser.c" /* yacc.c:358  */
+/* Narrow types that promote to a signed type and that can represent a
+   signed or unsigned integer of at least N bits.  In tables they can
+   save space and decrease cache pressure.  Promoting to a signed type
+   helps avoid bugs in integer arithmetic.  */
 
-#ifdef short
-# undef short
+#ifdef __INT_LEAST8_MAX__
+typedef __INT_LEAST8_TYPE__ yytype_int8;
+#elif defined YY_STDINT_H
+typedef int_least8_t yytype_int8;
+#else
+typedef signed char yytype_int8;
 #endif
 
-#ifdef YYTYPE_UINT8
-typedef YYTYPE_UINT8 yytype_uint8;
+#ifdef __INT_LEAST16_MAX__
+typedef __INT_LEAST16_TYPE__ yytype_int16;
+#elif defined YY_STDINT_H
+typedef int_least16_t yytype_int16;
 #else
-typedef unsigned char yytype_uint8;
+typedef short yytype_int16;
 #endif
 
-#ifdef YYTYPE_INT8
-typedef YYTYPE_INT8 yytype_int8;
-#else
-typedef signed char yytype_int8;
+/* Work around bug in HP-UX 11.23, which defines these macros
+   incorrectly for preprocessor constants.  This workaround can likely
+   be removed in 2023, as HPE has promised support for HP-UX 11.23
+   (aka HP-UX 11i v2) only through the end of 2022; see Table 2 of
+   <https://h20195.www2.hpe.com/V2/getpdf.aspx/4AA4-7673ENW.pdf>.  */
+#ifdef __hpux
+# undef UINT_LEAST8_MAX
+# undef UINT_LEAST16_MAX
+# define UINT_LEAST8_MAX 255
+# define UINT_LEAST16_MAX 65535
 #endif
 
-#ifdef YYTYPE_UINT16
-typedef YYTYPE_UINT16 yytype_uint16;
+#if defined __UINT_LEAST8_MAX__ && __UINT_LEAST8_MAX__ <= __INT_MAX__
+typedef __UINT_LEAST8_TYPE__ yytype_uint8;
+#elif (!defined __UINT_LEAST8_MAX__ && defined YY_STDINT_H \
+       && UINT_LEAST8_MAX <= INT_MAX)
+typedef uint_least8_t yytype_uint8;
+#elif !defined __UINT_LEAST8_MAX__ && UCHAR_MAX <= INT_MAX
+typedef unsigned char yytype_uint8;
 #else
-typedef unsigned short int yytype_uint16;
+typedef short yytype_uint8;
 #endif
 
-#ifdef YYTYPE_INT16
-typedef YYTYPE_INT16 yytype_int16;
+#if defined __UINT_LEAST16_MAX__ && __UINT_LEAST16_MAX__ <= __INT_MAX__
+typedef __UINT_LEAST16_TYPE__ yytype_uint16;
+#elif (!defined __UINT_LEAST16_MAX__ && defined YY_STDINT_H \
+       && UINT_LEAST16_MAX <= INT_MAX)
+typedef uint_least16_t yytype_uint16;
+#elif !defined __UINT_LEAST16_MAX__ && USHRT_MAX <= INT_MAX
+typedef unsigned short yytype_uint16;
 #else
-typedef short int yytype_int16;
+typedef int yytype_uint16;
+#endif
+
+#ifndef YYPTRDIFF_T
+# if defined __PTRDIFF_TYPE__ && defined __PTRDIFF_MAX__
+#  define YYPTRDIFF_T __PTRDIFF_TYPE__
+#  define YYPTRDIFF_MAXIMUM __PTRDIFF_MAX__
+# elif defined PTRDIFF_MAX
+#  ifndef ptrdiff_t
+#   include <stddef.h> /* INFRINGES ON USER NAME SPACE */
+#  endif
+#  define YYPTRDIFF_T ptrdiff_t
+#  define YYPTRDIFF_MAXIMUM PTRDIFF_MAX
+# else
+#  define YYPTRDIFF_T long
+#  define YYPTRDIFF_MAXIMUM LONG_MAX
+# endif
 #endif
 
 #ifndef YYSIZE_T
@@ -243,15 +258,28 @@ typedef short int yytype_int16;
 #  define YYSIZE_T __SIZE_TYPE__
 # elif defined size_t
 #  define YYSIZE_T size_t
-# elif ! defined YYSIZE_T
+# elif defined __STDC_VERSION__ && 199901 <= __STDC_VERSION__
 #  include <stddef.h> /* INFRINGES ON USER NAME SPACE */
 #  define YYSIZE_T size_t
 # else
-#  define YYSIZE_T unsigned int
+#  define YYSIZE_T unsigned
 # endif
 #endif
 
-#define YYSIZE_MAXIMUM ((YYSIZE_T) -1)
+#define YYSIZE_MAXIMUM                                  \
+  YY_CAST (YYPTRDIFF_T,                                 \
+           (YYPTRDIFF_MAXIMUM < YY_CAST (YYSIZE_T, -1)  \
+            ? YYPTRDIFF_MAXIMUM                         \
+            : YY_CAST (YYSIZE_T, -1)))
+
+#define YYSIZEOF(X) YY_CAST (YYPTRDIFF_T, sizeof (X))
+
+
+/* Stored state numbers (used for stacks). */
+typedef yytype_int8 yy_state_t;
+
+/* State numbers in computations.  */
+typedef int yy_state_fast_t;
 
 #ifndef YY_
 # if defined YYENABLE_NLS && YYENABLE_NLS
@@ -265,47 +293,43 @@ typedef short int yytype_int16;
 # endif
 #endif
 
-#ifndef YY_ATTRIBUTE
-# if (defined __GNUC__                                               \
-      && (2 < __GNUC__ || (__GNUC__ == 2 && 96 <= __GNUC_MINOR__)))  \
-     || defined __SUNPRO_C && 0x5110 <= __SUNPRO_C
-#  define YY_ATTRIBUTE(Spec) __attribute__(Spec)
-# else
-#  define YY_ATTRIBUTE(Spec) /* empty */
-# endif
-#endif
 
 #ifndef YY_ATTRIBUTE_PURE
-# define YY_ATTRIBUTE_PURE   YY_ATTRIBUTE ((__pure__))
+# if defined __GNUC__ && 2 < __GNUC__ + (96 <= __GNUC_MINOR__)
+#  define YY_ATTRIBUTE_PURE __attribute__ ((__pure__))
+# else
+#  define YY_ATTRIBUTE_PURE
+# endif
 #endif
 
 #ifndef YY_ATTRIBUTE_UNUSED
-# define YY_ATTRIBUTE_UNUSED YY_ATTRIBUTE ((__unused__))
-#endif
-
-#if !defined _Noreturn \
-     && (!defined __STDC_VERSION__ || __STDC_VERSION__ < 201112)
-# if defined _MSC_VER && 1200 <= _MSC_VER
-#  define _Noreturn __declspec (noreturn)
+# if defined __GNUC__ && 2 < __GNUC__ + (7 <= __GNUC_MINOR__)
+#  define YY_ATTRIBUTE_UNUSED __attribute__ ((__unused__))
 # else
-#  define _Noreturn YY_ATTRIBUTE ((__noreturn__))
+#  define YY_ATTRIBUTE_UNUSED
 # endif
 #endif
 
 /* Suppress unused-variable warnings by "using" E.  */
 #if ! defined lint || defined __GNUC__
-# define YYUSE(E) ((void) (E))
+# define YY_USE(E) ((void) (E))
 #else
-# define YYUSE(E) /* empty */
+# define YY_USE(E) /* empty */
 #endif
 
-#if defined __GNUC__ && 407 <= __GNUC__ * 100 + __GNUC_MINOR__
 /* Suppress an incorrect diagnostic about yylval being uninitialized.  */
-# define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN \
-    _Pragma ("GCC diagnostic push") \
-    _Pragma ("GCC diagnostic ignored \"-Wuninitialized\"")\
+#if defined __GNUC__ && ! defined __ICC && 406 <= __GNUC__ * 100 + __GNUC_MINOR__
+# if __GNUC__ * 100 + __GNUC_MINOR__ < 407
+#  define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN                           \
+    _Pragma ("GCC diagnostic push")                                     \
+    _Pragma ("GCC diagnostic ignored \"-Wuninitialized\"")
+# else
+#  define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN                           \
+    _Pragma ("GCC diagnostic push")                                     \
+    _Pragma ("GCC diagnostic ignored \"-Wuninitialized\"")              \
     _Pragma ("GCC diagnostic ignored \"-Wmaybe-uninitialized\"")
-# define YY_IGNORE_MAYBE_UNINITIALIZED_END \
+# endif
+# define YY_IGNORE_MAYBE_UNINITIALIZED_END      \
     _Pragma ("GCC diagnostic pop")
 #else
 # define YY_INITIAL_VALUE(Value) Value
@@ -318,8 +342,22 @@ typedef short int yytype_int16;
 # define YY_INITIAL_VALUE(Value) /* Nothing. */
 #endif
 
+#if defined __cplusplus && defined __GNUC__ && ! defined __ICC && 6 <= __GNUC__
+# define YY_IGNORE_USELESS_CAST_BEGIN                          \
+    _Pragma ("GCC diagnostic push")                            \
+    _Pragma ("GCC diagnostic ignored \"-Wuseless-cast\"")
+# define YY_IGNORE_USELESS_CAST_END            \
+    _Pragma ("GCC diagnostic pop")
+#endif
+#ifndef YY_IGNORE_USELESS_CAST_BEGIN
+# define YY_IGNORE_USELESS_CAST_BEGIN
+# define YY_IGNORE_USELESS_CAST_END
+#endif
+
+
+#define YY_ASSERT(E) ((void) (0 && (E)))
 
-#if ! defined yyoverflow || YYERROR_VERBOSE
+#if !defined yyoverflow
 
 /* The parser invokes alloca or malloc; define the necessary symbols.  */
 
@@ -384,8 +422,7 @@ void free (void *); /* INFRINGES ON USER NAME SPACE */
 #   endif
 #  endif
 # endif
-#endif /* ! defined yyoverflow || YYERROR_VERBOSE */
-
+#endif /* !defined yyoverflow */
 
 #if (! defined yyoverflow \
      && (! defined __cplusplus \
@@ -394,17 +431,17 @@ void free (void *); /* INFRINGES ON USER NAME SPACE */
 /* A type that is properly aligned for any stack member.  */
 union yyalloc
 {
-  yytype_int16 yyss_alloc;
+  yy_state_t yyss_alloc;
   YYSTYPE yyvs_alloc;
 };
 
 /* The size of the maximum gap between one aligned stack and the next.  */
-# define YYSTACK_GAP_MAXIMUM (sizeof (union yyalloc) - 1)
+# define YYSTACK_GAP_MAXIMUM (YYSIZEOF (union yyalloc) - 1)
 
 /* The size of an array large to enough to hold all stacks, each with
    N elements.  */
 # define YYSTACK_BYTES(N) \
-     ((N) * (sizeof (yytype_int16) + sizeof (YYSTYPE)) \
+     ((N) * (YYSIZEOF (yy_state_t) + YYSIZEOF (YYSTYPE)) \
       + YYSTACK_GAP_MAXIMUM)
 
 # define YYCOPY_NEEDED 1
@@ -417,11 +454,11 @@ union yyalloc
 # define YYSTACK_RELOCATE(Stack_alloc, Stack)                           \
     do                                                                  \
       {                                                                 \
-        YYSIZE_T yynewbytes;                                            \
+        YYPTRDIFF_T yynewbytes;                                         \
         YYCOPY (&yyptr->Stack_alloc, Stack, yysize);                    \
         Stack = &yyptr->Stack_alloc;                                    \
-        yynewbytes = yystacksize * sizeof (*Stack) + YYSTACK_GAP_MAXIMUM; \
-        yyptr += yynewbytes / sizeof (*yyptr);                          \
+        yynewbytes = yystacksize * YYSIZEOF (*Stack) + YYSTACK_GAP_MAXIMUM; \
+        yyptr += yynewbytes / YYSIZEOF (*yyptr);                        \
       }                                                                 \
     while (0)
 
@@ -433,12 +470,12 @@ union yyalloc
 # ifndef YYCOPY
 #  if defined __GNUC__ && 1 < __GNUC__
 #   define YYCOPY(Dst, Src, Count) \
-      __builtin_memcpy (Dst, Src, (Count) * sizeof (*(Src)))
+      __builtin_memcpy (Dst, Src, YY_CAST (YYSIZE_T, (Count)) * sizeof (*(Src)))
 #  else
 #   define YYCOPY(Dst, Src, Count)              \
       do                                        \
         {                                       \
-          YYSIZE_T yyi;                         \
+          YYPTRDIFF_T yyi;                      \
           for (yyi = 0; yyi < (Count); yyi++)   \
             (Dst)[yyi] = (Src)[yyi];            \
         }                                       \
@@ -461,17 +498,20 @@ union yyalloc
 /* YYNSTATES -- Number of states.  */
 #define YYNSTATES  82
 
-/* YYTRANSLATE[YYX] -- Symbol number corresponding to YYX as returned
-   by yylex, with out-of-bounds checking.  */
-#define YYUNDEFTOK  2
+/* YYMAXUTOK -- Last valid token kind.  */
 #define YYMAXUTOK   270
 
-#define YYTRANSLATE(YYX)                                                \
-  ((unsigned int) (YYX) <= YYMAXUTOK ? yytranslate[YYX] : YYUNDEFTOK)
+
+/* YYTRANSLATE(TOKEN-NUM) -- Symbol number corresponding to TOKEN-NUM
+   as returned by yylex, with out-of-bounds checking.  */
+#define YYTRANSLATE(YYX)                                \
+  (0 <= (YYX) && (YYX) <= YYMAXUTOK                     \
+   ? YY_CAST (yysymbol_kind_t, yytranslate[YYX])        \
+   : YYSYMBOL_YYUNDEF)
 
 /* YYTRANSLATE[TOKEN-NUM] -- Symbol number corresponding to TOKEN-NUM
-   as returned by yylex, without out-of-bounds checking.  */
-static const yytype_uint8 yytranslate[] =
+   as returned by yylex.  */
+static const yytype_int8 yytranslate[] =
 {
        0,     2,     2,     2,     2,     2,     2,     2,     2,     2,
        2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
@@ -504,24 +544,31 @@ static const yytype_uint8 yytranslate[] =
 };
 
 #if ZZDEBUG
-  /* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
+/* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
 static const yytype_uint8 yyrline[] =
 {
-       0,    94,    94,    96,    97,   100,   101,   104,   105,   106,
-     107,   108,   109,   110,   111,   112,   114,   115,   118,   119,
-     122,   123,   126,   128,   130,   133,   134,   137,   140,   141,
-     144,   147,   148,   152,   155,   158,   159,   163,   165
+       0,    93,    93,    95,    96,    99,   100,   103,   104,   105,
+     106,   107,   108,   109,   110,   111,   113,   114,   117,   118,
+     121,   122,   125,   127,   129,   132,   133,   136,   139,   140,
+     143,   146,   147,   151,   154,   157,   158,   162,   164
 };
 #endif
 
-#if ZZDEBUG || YYERROR_VERBOSE || 0
+/** Accessing symbol of state STATE.  */
+#define YY_ACCESSING_SYMBOL(State) YY_CAST (yysymbol_kind_t, yystos[State])
+
+#if ZZDEBUG || 0
+/* The user-facing name of the symbol whose (internal) number is
+   YYSYMBOL.  No bounds checking.  */
+static const char *yysymbol_name (yysymbol_kind_t yysymbol) YY_ATTRIBUTE_UNUSED;
+
 /* YYTNAME[SYMBOL-NUM] -- String name of the symbol SYMBOL-NUM.
    First, the terminals, then, starting at YYNTOKENS, nonterminals.  */
 static const char *const yytname[] =
 {
-  "$end", "error", "$undefined", "EVENT_LCURLY", "EVENT_RCURLY",
-  "EVENT_LSQUARE", "EVENT_RSQUARE", "EVENT_COMMA", "EVENT_COLON",
-  "EVENT_MINUS", "EVENT_NULL", "EVENT_TRUE", "EVENT_FALSE",
+  "\"end of file\"", "error", "\"invalid token\"", "EVENT_LCURLY",
+  "EVENT_RCURLY", "EVENT_LSQUARE", "EVENT_RSQUARE", "EVENT_COMMA",
+  "EVENT_COLON", "EVENT_MINUS", "EVENT_NULL", "EVENT_TRUE", "EVENT_FALSE",
   "EVENT_INTEGER", "EVENT_FLOAT", "EVENT_STRING", "$accept", "program",
   "variable_loop", "variable", "value", "boolean", "integer", "float",
   "string", "empty_list_value", "integer_list_value", "integer_list_loop",
@@ -529,30 +576,26 @@ static const char *const yytname[] =
   "segments_loop", "segment_value", "frequencies_value",
   "frequencies_loop", "frequency_value", YY_NULLPTR
 };
-#endif
 
-# ifdef YYPRINT
-/* YYTOKNUM[NUM] -- (External) token number corresponding to the
-   (internal) symbol number NUM (which must be that of a token).  */
-static const yytype_uint16 yytoknum[] =
+static const char *
+yysymbol_name (yysymbol_kind_t yysymbol)
 {
-       0,   256,   257,   258,   259,   260,   261,   262,   263,   264,
-     265,   266,   267,   268,   269,   270
-};
-# endif
+  return yytname[yysymbol];
+}
+#endif
 
-#define YYPACT_NINF -9
+#define YYPACT_NINF (-9)
 
-#define yypact_value_is_default(Yystate) \
-  (!!((Yystate) == (-9)))
+#define yypact_value_is_default(Yyn) \
+  ((Yyn) == YYPACT_NINF)
 
-#define YYTABLE_NINF -1
+#define YYTABLE_NINF (-1)
 
-#define yytable_value_is_error(Yytable_value) \
+#define yytable_value_is_error(Yyn) \
   0
 
-  /* YYPACT[STATE-NUM] -- Index in YYTABLE of the portion describing
-     STATE-NUM.  */
+/* YYPACT[STATE-NUM] -- Index in YYTABLE of the portion describing
+   STATE-NUM.  */
 static const yytype_int8 yypact[] =
 {
       23,     3,    38,    33,    20,    -9,    -9,    -4,    -9,     3,
@@ -566,10 +609,10 @@ static const yytype_int8 yypact[] =
       60,    -9
 };
 
-  /* YYDEFACT[STATE-NUM] -- Default reduction number in state STATE-NUM.
-     Performed when YYTABLE does not specify something else to do.  Zero
-     means the default is an error.  */
-static const yytype_uint8 yydefact[] =
+/* YYDEFACT[STATE-NUM] -- Default reduction number in state STATE-NUM.
+   Performed when YYTABLE does not specify something else to do.  Zero
+   means the default is an error.  */
+static const yytype_int8 yydefact[] =
 {
        0,     0,     0,     0,     0,     3,     1,     0,     2,     0,
        0,     0,     6,    16,    17,    18,    20,    22,     5,     7,
@@ -582,24 +625,24 @@ static const yytype_uint8 yydefact[] =
        0,    38
 };
 
-  /* YYPGOTO[NTERM-NUM].  */
+/* YYPGOTO[NTERM-NUM].  */
 static const yytype_int8 yypgoto[] =
 {
       -9,    -9,    -9,    43,    -9,    -9,    -7,    -9,    -8,    -9,
       -9,    -9,    -9,    -9,    -9,    -9,    19,    -9,    -9,    18
 };
 
-  /* YYDEFGOTO[NTERM-NUM].  */
+/* YYDEFGOTO[NTERM-NUM].  */
 static const yytype_int8 yydefgoto[] =
 {
-      -1,     2,     4,     5,    18,    19,    44,    21,    22,    23,
+       0,     2,     4,     5,    18,    19,    44,    21,    22,    23,
       24,    34,    25,    35,    26,    36,    37,    27,    38,    39
 };
 
-  /* YYTABLE[YYPACT[STATE-NUM]] -- What to do in state STATE-NUM.  If
-     positive, shift that token.  If negative, reduce the rule whose
-     number is the opposite.  If YYTABLE_NINF, syntax error.  */
-static const yytype_uint8 yytable[] =
+/* YYTABLE[YYPACT[STATE-NUM]] -- What to do in state STATE-NUM.  If
+   positive, shift that token.  If negative, reduce the rule whose
+   number is the opposite.  If YYTABLE_NINF, syntax error.  */
+static const yytype_int8 yytable[] =
 {
       20,    10,    33,    32,    42,    11,    12,    13,    14,    15,
       16,    17,    29,    30,    43,    42,    31,    31,     3,    31,
@@ -611,7 +654,7 @@ static const yytype_uint8 yytable[] =
       61,    80
 };
 
-static const yytype_uint8 yycheck[] =
+static const yytype_int8 yycheck[] =
 {
        7,     5,    10,    10,     5,     9,    10,    11,    12,    13,
       14,    15,     5,     6,    15,     5,     9,     9,    15,     9,
@@ -623,9 +666,9 @@ static const yytype_uint8 yycheck[] =
       52,    78
 };
 
-  /* YYSTOS[STATE-NUM] -- The (internal number of the) accessing
-     symbol of state STATE-NUM.  */
-static const yytype_uint8 yystos[] =
+/* YYSTOS[STATE-NUM] -- The symbol kind of the accessing symbol of
+   state STATE-NUM.  */
+static const yytype_int8 yystos[] =
 {
        0,     3,    17,    15,    18,    19,     0,     8,     4,     7,
        5,     9,    10,    11,    12,    13,    14,    15,    20,    21,
@@ -638,8 +681,8 @@ static const yytype_uint8 yystos[] =
       22,     6
 };
 
-  /* YYR1[YYN] -- Symbol number of symbol that rule YYN derives.  */
-static const yytype_uint8 yyr1[] =
+/* YYR1[RULE-NUM] -- Symbol kind of the left-hand side of rule RULE-NUM.  */
+static const yytype_int8 yyr1[] =
 {
        0,    16,    17,    18,    18,    19,    19,    20,    20,    20,
       20,    20,    20,    20,    20,    20,    21,    21,    22,    22,
@@ -647,8 +690,8 @@ static const yytype_uint8 yyr1[] =
       30,    31,    31,    32,    33,    34,    34,    35,    35
 };
 
-  /* YYR2[YYN] -- Number of symbols on the right hand side of rule YYN.  */
-static const yytype_uint8 yyr2[] =
+/* YYR2[RULE-NUM] -- Number of symbols on the right-hand side of rule RULE-NUM.  */
+static const yytype_int8 yyr2[] =
 {
        0,     2,     3,     1,     3,     3,     3,     1,     1,     1,
        1,     1,     1,     1,     1,     1,     1,     1,     1,     2,
@@ -657,39 +700,39 @@ static const yytype_uint8 yyr2[] =
 };
 
 
+enum { YYENOMEM = -2 };
+
 #define yyerrok         (yyerrstatus = 0)
-#define yyclearin       (yychar = YYEMPTY)
-#define YYEMPTY         (-2)
-#define YYEOF           0
+#define yyclearin       (yychar = ZZEMPTY)
 
 #define YYACCEPT        goto yyacceptlab
 #define YYABORT         goto yyabortlab
 #define YYERROR         goto yyerrorlab
+#define YYNOMEM         goto yyexhaustedlab
 
 
 #define YYRECOVERING()  (!!yyerrstatus)
 
-#define YYBACKUP(Token, Value)                                  \
-do                                                              \
-  if (yychar == YYEMPTY)                                        \
-    {                                                           \
-      yychar = (Token);                                         \
-      yylval = (Value);                                         \
-      YYPOPSTACK (yylen);                                       \
-      yystate = *yyssp;                                         \
-      goto yybackup;                                            \
-    }                                                           \
-  else                                                          \
-    {                                                           \
-      yyerror (scanner, YY_("syntax error: cannot back up")); \
-      YYERROR;                                                  \
-    }                                                           \
-while (0)
-
-/* Error token number */
-#define YYTERROR        1
-#define YYERRCODE       256
-
+#define YYBACKUP(Token, Value)                                    \
+  do                                                              \
+    if (yychar == ZZEMPTY)                                        \
+      {                                                           \
+        yychar = (Token);                                         \
+        yylval = (Value);                                         \
+        YYPOPSTACK (yylen);                                       \
+        yystate = *yyssp;                                         \
+        goto yybackup;                                            \
+      }                                                           \
+    else                                                          \
+      {                                                           \
+        yyerror (scanner, root, YY_("syntax error: cannot back up")); \
+        YYERROR;                                                  \
+      }                                                           \
+  while (0)
+
+/* Backward compatibility with an undocumented macro.
+   Use ZZerror or ZZUNDEF. */
+#define YYERRCODE ZZUNDEF
 
 
 /* Enable debugging if requested.  */
@@ -706,151 +749,148 @@ do {                                            \
     YYFPRINTF Args;                             \
 } while (0)
 
-/* This macro is provided for backward compatibility. */
-#ifndef YY_LOCATION_PRINT
-# define YY_LOCATION_PRINT(File, Loc) ((void) 0)
-#endif
 
 
-# define YY_SYMBOL_PRINT(Title, Type, Value, Location)                    \
+
+# define YY_SYMBOL_PRINT(Title, Kind, Value, Location)                    \
 do {                                                                      \
   if (yydebug)                                                            \
     {                                                                     \
       YYFPRINTF (stderr, "%s ", Title);                                   \
       yy_symbol_print (stderr,                                            \
-                  Type, Value, scanner); \
+                  Kind, Value, scanner, root); \
       YYFPRINTF (stderr, "\n");                                           \
     }                                                                     \
 } while (0)
 
 
-/*----------------------------------------.
-| Print this symbol's value on YYOUTPUT.  |
-`----------------------------------------*/
+/*-----------------------------------.
+| Print this symbol's value on YYO.  |
+`-----------------------------------*/
 
 static void
-yy_symbol_value_print (FILE *yyoutput, int yytype, YYSTYPE const * const yyvaluep, void *scanner)
+yy_symbol_value_print (FILE *yyo,
+                       yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep, void *scanner, struct betree_event **root)
 {
-  FILE *yyo = yyoutput;
-  YYUSE (yyo);
-  YYUSE (scanner);
+  FILE *yyoutput = yyo;
+  YY_USE (yyoutput);
+  YY_USE (scanner);
+  YY_USE (root);
   if (!yyvaluep)
     return;
-# ifdef YYPRINT
-  if (yytype < YYNTOKENS)
-    YYPRINT (yyoutput, yytoknum[yytype], *yyvaluep);
-# endif
-  switch (yytype)
+  YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+  switch (yykind)
     {
-          case 13: /* EVENT_INTEGER  */
-#line 83 "src/event_parser.y" /* yacc.c:684  */
-      { fprintf(yyoutput, "%lld", ((*yyvaluep).integer_value)); }
-#line 749 "src/event_parser.c" /* yacc.c:684  */
+    case YYSYMBOL_EVENT_INTEGER: /* EVENT_INTEGER  */
+#line 82 "src/event_parser.y"
+         { fprintf(yyoutput, "%lld", ((*yyvaluep).integer_value)); }
+#line 788 "src/event_parser.c"
         break;
 
-    case 14: /* EVENT_FLOAT  */
-#line 84 "src/event_parser.y" /* yacc.c:684  */
-      { fprintf(yyoutput, "%.2f", ((*yyvaluep).float_value)); }
-#line 755 "src/event_parser.c" /* yacc.c:684  */
+    case YYSYMBOL_EVENT_FLOAT: /* EVENT_FLOAT  */
+#line 83 "src/event_parser.y"
+         { fprintf(yyoutput, "%.2f", ((*yyvaluep).float_value)); }
+#line 794 "src/event_parser.c"
         break;
 
-    case 15: /* EVENT_STRING  */
-#line 85 "src/event_parser.y" /* yacc.c:684  */
-      { fprintf(yyoutput, "%s", ((*yyvaluep).string)); }
-#line 761 "src/event_parser.c" /* yacc.c:684  */
+    case YYSYMBOL_EVENT_STRING: /* EVENT_STRING  */
+#line 84 "src/event_parser.y"
+         { fprintf(yyoutput, "%s", ((*yyvaluep).string)); }
+#line 800 "src/event_parser.c"
         break;
 
-    case 22: /* integer  */
-#line 83 "src/event_parser.y" /* yacc.c:684  */
-      { fprintf(yyoutput, "%lld", ((*yyvaluep).integer_value)); }
-#line 767 "src/event_parser.c" /* yacc.c:684  */
+    case YYSYMBOL_integer: /* integer  */
+#line 82 "src/event_parser.y"
+         { fprintf(yyoutput, "%lld", ((*yyvaluep).integer_value)); }
+#line 806 "src/event_parser.c"
         break;
 
-    case 23: /* float  */
-#line 84 "src/event_parser.y" /* yacc.c:684  */
-      { fprintf(yyoutput, "%.2f", ((*yyvaluep).float_value)); }
-#line 773 "src/event_parser.c" /* yacc.c:684  */
+    case YYSYMBOL_float: /* float  */
+#line 83 "src/event_parser.y"
+         { fprintf(yyoutput, "%.2f", ((*yyvaluep).float_value)); }
+#line 812 "src/event_parser.c"
         break;
 
-    case 24: /* string  */
-#line 86 "src/event_parser.y" /* yacc.c:684  */
-      { fprintf(yyoutput, "%s", ((*yyvaluep).string_value).string); }
-#line 779 "src/event_parser.c" /* yacc.c:684  */
+    case YYSYMBOL_string: /* string  */
+#line 85 "src/event_parser.y"
+         { fprintf(yyoutput, "%s", ((*yyvaluep).string_value).string); }
+#line 818 "src/event_parser.c"
         break;
 
-    case 25: /* empty_list_value  */
-#line 87 "src/event_parser.y" /* yacc.c:684  */
-      { fprintf(yyoutput, "%zu integers", ((*yyvaluep).integer_list_value).count); }
-#line 785 "src/event_parser.c" /* yacc.c:684  */
+    case YYSYMBOL_empty_list_value: /* empty_list_value  */
+#line 86 "src/event_parser.y"
+         { fprintf(yyoutput, "%zu integers", ((*yyvaluep).integer_list_value).count); }
+#line 824 "src/event_parser.c"
         break;
 
-    case 26: /* integer_list_value  */
-#line 87 "src/event_parser.y" /* yacc.c:684  */
-      { fprintf(yyoutput, "%zu integers", ((*yyvaluep).integer_list_value).count); }
-#line 791 "src/event_parser.c" /* yacc.c:684  */
+    case YYSYMBOL_integer_list_value: /* integer_list_value  */
+#line 86 "src/event_parser.y"
+         { fprintf(yyoutput, "%zu integers", ((*yyvaluep).integer_list_value).count); }
+#line 830 "src/event_parser.c"
         break;
 
-    case 27: /* integer_list_loop  */
-#line 87 "src/event_parser.y" /* yacc.c:684  */
-      { fprintf(yyoutput, "%zu integers", ((*yyvaluep).integer_list_value).count); }
-#line 797 "src/event_parser.c" /* yacc.c:684  */
+    case YYSYMBOL_integer_list_loop: /* integer_list_loop  */
+#line 86 "src/event_parser.y"
+         { fprintf(yyoutput, "%zu integers", ((*yyvaluep).integer_list_value).count); }
+#line 836 "src/event_parser.c"
         break;
 
-    case 28: /* string_list_value  */
-#line 88 "src/event_parser.y" /* yacc.c:684  */
-      { fprintf(yyoutput, "%zu strings", ((*yyvaluep).string_list_value).count); }
-#line 803 "src/event_parser.c" /* yacc.c:684  */
+    case YYSYMBOL_string_list_value: /* string_list_value  */
+#line 87 "src/event_parser.y"
+         { fprintf(yyoutput, "%zu strings", ((*yyvaluep).string_list_value).count); }
+#line 842 "src/event_parser.c"
         break;
 
-    case 29: /* string_list_loop  */
-#line 88 "src/event_parser.y" /* yacc.c:684  */
-      { fprintf(yyoutput, "%zu strings", ((*yyvaluep).string_list_value).count); }
-#line 809 "src/event_parser.c" /* yacc.c:684  */
+    case YYSYMBOL_string_list_loop: /* string_list_loop  */
+#line 87 "src/event_parser.y"
+         { fprintf(yyoutput, "%zu strings", ((*yyvaluep).string_list_value).count); }
+#line 848 "src/event_parser.c"
         break;
 
-    case 30: /* segments_value  */
-#line 89 "src/event_parser.y" /* yacc.c:684  */
-      { fprintf(yyoutput, "%zu segments", ((*yyvaluep).segments_list_value).size); }
-#line 815 "src/event_parser.c" /* yacc.c:684  */
+    case YYSYMBOL_segments_value: /* segments_value  */
+#line 88 "src/event_parser.y"
+         { fprintf(yyoutput, "%zu segments", ((*yyvaluep).segments_list_value).size); }
+#line 854 "src/event_parser.c"
         break;
 
-    case 31: /* segments_loop  */
-#line 89 "src/event_parser.y" /* yacc.c:684  */
-      { fprintf(yyoutput, "%zu segments", ((*yyvaluep).segments_list_value).size); }
-#line 821 "src/event_parser.c" /* yacc.c:684  */
+    case YYSYMBOL_segments_loop: /* segments_loop  */
+#line 88 "src/event_parser.y"
+         { fprintf(yyoutput, "%zu segments", ((*yyvaluep).segments_list_value).size); }
+#line 860 "src/event_parser.c"
         break;
 
-    case 33: /* frequencies_value  */
-#line 90 "src/event_parser.y" /* yacc.c:684  */
-      { fprintf(yyoutput, "%zu caps", ((*yyvaluep).frequencies_value).size); }
-#line 827 "src/event_parser.c" /* yacc.c:684  */
+    case YYSYMBOL_frequencies_value: /* frequencies_value  */
+#line 89 "src/event_parser.y"
+         { fprintf(yyoutput, "%zu caps", ((*yyvaluep).frequencies_value).size); }
+#line 866 "src/event_parser.c"
         break;
 
-    case 34: /* frequencies_loop  */
-#line 90 "src/event_parser.y" /* yacc.c:684  */
-      { fprintf(yyoutput, "%zu caps", ((*yyvaluep).frequencies_value).size); }
-#line 833 "src/event_parser.c" /* yacc.c:684  */
+    case YYSYMBOL_frequencies_loop: /* frequencies_loop  */
+#line 89 "src/event_parser.y"
+         { fprintf(yyoutput, "%zu caps", ((*yyvaluep).frequencies_value).size); }
+#line 872 "src/event_parser.c"
         break;
 
-
       default:
         break;
     }
+  YY_IGNORE_MAYBE_UNINITIALIZED_END
 }
 
 
-/*--------------------------------.
-| Print this symbol on YYOUTPUT.  |
-`--------------------------------*/
+/*---------------------------.
+| Print this symbol on YYO.  |
+`---------------------------*/
 
 static void
-yy_symbol_print (FILE *yyoutput, int yytype, YYSTYPE const * const yyvaluep, void *scanner)
+yy_symbol_print (FILE *yyo,
+                 yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep, void *scanner, struct betree_event **root)
 {
-  YYFPRINTF (yyoutput, "%s %s (",
-             yytype < YYNTOKENS ? "token" : "nterm", yytname[yytype]);
+  YYFPRINTF (yyo, "%s %s (",
+             yykind < YYNTOKENS ? "token" : "nterm", yysymbol_name (yykind));
 
-  yy_symbol_value_print (yyoutput, yytype, yyvaluep, scanner);
-  YYFPRINTF (yyoutput, ")");
+  yy_symbol_value_print (yyo, yykind, yyvaluep, scanner, root);
+  YYFPRINTF (yyo, ")");
 }
 
 /*------------------------------------------------------------------.
@@ -859,7 +899,7 @@ yy_symbol_print (FILE *yyoutput, int yytype, YYSTYPE const * const yyvaluep, voi
 `------------------------------------------------------------------*/
 
 static void
-yy_stack_print (yytype_int16 *yybottom, yytype_int16 *yytop)
+yy_stack_print (yy_state_t *yybottom, yy_state_t *yytop)
 {
   YYFPRINTF (stderr, "Stack now");
   for (; yybottom <= yytop; yybottom++)
@@ -882,21 +922,21 @@ do {                                                            \
 `------------------------------------------------*/
 
 static void
-yy_reduce_print (yytype_int16 *yyssp, YYSTYPE *yyvsp, int yyrule, void *scanner)
+yy_reduce_print (yy_state_t *yyssp, YYSTYPE *yyvsp,
+                 int yyrule, void *scanner, struct betree_event **root)
 {
-  unsigned long int yylno = yyrline[yyrule];
+  int yylno = yyrline[yyrule];
   int yynrhs = yyr2[yyrule];
   int yyi;
-  YYFPRINTF (stderr, "Reducing stack by rule %d (line %lu):\n",
+  YYFPRINTF (stderr, "Reducing stack by rule %d (line %d):\n",
              yyrule - 1, yylno);
   /* The symbols being reduced.  */
   for (yyi = 0; yyi < yynrhs; yyi++)
     {
       YYFPRINTF (stderr, "   $%d = ", yyi + 1);
       yy_symbol_print (stderr,
-                       yystos[yyssp[yyi + 1 - yynrhs]],
-                       &(yyvsp[(yyi + 1) - (yynrhs)])
-                                              , scanner);
+                       YY_ACCESSING_SYMBOL (+yyssp[yyi + 1 - yynrhs]),
+                       &yyvsp[(yyi + 1) - (yynrhs)], scanner, root);
       YYFPRINTF (stderr, "\n");
     }
 }
@@ -904,15 +944,15 @@ yy_reduce_print (yytype_int16 *yyssp, YYSTYPE *yyvsp, int yyrule, void *scanner)
 # define YY_REDUCE_PRINT(Rule)          \
 do {                                    \
   if (yydebug)                          \
-    yy_reduce_print (yyssp, yyvsp, Rule, scanner); \
+    yy_reduce_print (yyssp, yyvsp, Rule, scanner, root); \
 } while (0)
 
 /* Nonzero means print parse trace.  It is left uninitialized so that
    multiple parsers can coexist.  */
 int yydebug;
 #else /* !ZZDEBUG */
-# define YYDPRINTF(Args)
-# define YY_SYMBOL_PRINT(Title, Type, Value, Location)
+# define YYDPRINTF(Args) ((void) 0)
+# define YY_SYMBOL_PRINT(Title, Kind, Value, Location)
 # define YY_STACK_PRINT(Bottom, Top)
 # define YY_REDUCE_PRINT(Rule)
 #endif /* !ZZDEBUG */
@@ -935,257 +975,43 @@ int yydebug;
 #endif
 
 
-#if YYERROR_VERBOSE
 
-# ifndef yystrlen
-#  if defined __GLIBC__ && defined _STRING_H
-#   define yystrlen strlen
-#  else
-/* Return the length of YYSTR.  */
-static YYSIZE_T
-yystrlen (const char *yystr)
-{
-  YYSIZE_T yylen;
-  for (yylen = 0; yystr[yylen]; yylen++)
-    continue;
-  return yylen;
-}
-#  endif
-# endif
 
-# ifndef yystpcpy
-#  if defined __GLIBC__ && defined _STRING_H && defined _GNU_SOURCE
-#   define yystpcpy stpcpy
-#  else
-/* Copy YYSRC to YYDEST, returning the address of the terminating '\0' in
-   YYDEST.  */
-static char *
-yystpcpy (char *yydest, const char *yysrc)
-{
-  char *yyd = yydest;
-  const char *yys = yysrc;
 
-  while ((*yyd++ = *yys++) != '\0')
-    continue;
-
-  return yyd - 1;
-}
-#  endif
-# endif
-
-# ifndef yytnamerr
-/* Copy to YYRES the contents of YYSTR after stripping away unnecessary
-   quotes and backslashes, so that it's suitable for yyerror.  The
-   heuristic is that double-quoting is unnecessary unless the string
-   contains an apostrophe, a comma, or backslash (other than
-   backslash-backslash).  YYSTR is taken from yytname.  If YYRES is
-   null, do not copy; instead, return the length of what the result
-   would have been.  */
-static YYSIZE_T
-yytnamerr (char *yyres, const char *yystr)
-{
-  if (*yystr == '"')
-    {
-      YYSIZE_T yyn = 0;
-      char const *yyp = yystr;
-
-      for (;;)
-        switch (*++yyp)
-          {
-          case '\'':
-          case ',':
-            goto do_not_strip_quotes;
-
-          case '\\':
-            if (*++yyp != '\\')
-              goto do_not_strip_quotes;
-            /* Fall through.  */
-          default:
-            if (yyres)
-              yyres[yyn] = *yyp;
-            yyn++;
-            break;
-
-          case '"':
-            if (yyres)
-              yyres[yyn] = '\0';
-            return yyn;
-          }
-    do_not_strip_quotes: ;
-    }
-
-  if (! yyres)
-    return yystrlen (yystr);
-
-  return yystpcpy (yyres, yystr) - yyres;
-}
-# endif
-
-/* Copy into *YYMSG, which is of size *YYMSG_ALLOC, an error message
-   about the unexpected token YYTOKEN for the state stack whose top is
-   YYSSP.
-
-   Return 0 if *YYMSG was successfully written.  Return 1 if *YYMSG is
-   not large enough to hold the message.  In that case, also set
-   *YYMSG_ALLOC to the required number of bytes.  Return 2 if the
-   required number of bytes is too large to store.  */
-static int
-yysyntax_error (YYSIZE_T *yymsg_alloc, char **yymsg,
-                yytype_int16 *yyssp, int yytoken)
-{
-  YYSIZE_T yysize0 = yytnamerr (YY_NULLPTR, yytname[yytoken]);
-  YYSIZE_T yysize = yysize0;
-  enum { YYERROR_VERBOSE_ARGS_MAXIMUM = 5 };
-  /* Internationalized format string. */
-  const char *yyformat = YY_NULLPTR;
-  /* Arguments of yyformat. */
-  char const *yyarg[YYERROR_VERBOSE_ARGS_MAXIMUM];
-  /* Number of reported tokens (one for the "unexpected", one per
-     "expected"). */
-  int yycount = 0;
-
-  /* There are many possibilities here to consider:
-     - If this state is a consistent state with a default action, then
-       the only way this function was invoked is if the default action
-       is an error action.  In that case, don't check for expected
-       tokens because there are none.
-     - The only way there can be no lookahead present (in yychar) is if
-       this state is a consistent state with a default action.  Thus,
-       detecting the absence of a lookahead is sufficient to determine
-       that there is no unexpected or expected token to report.  In that
-       case, just report a simple "syntax error".
-     - Don't assume there isn't a lookahead just because this state is a
-       consistent state with a default action.  There might have been a
-       previous inconsistent state, consistent state with a non-default
-       action, or user semantic action that manipulated yychar.
-     - Of course, the expected token list depends on states to have
-       correct lookahead information, and it depends on the parser not
-       to perform extra reductions after fetching a lookahead from the
-       scanner and before detecting a syntax error.  Thus, state merging
-       (from LALR or IELR) and default reductions corrupt the expected
-       token list.  However, the list is correct for canonical LR with
-       one exception: it will still contain any token that will not be
-       accepted due to an error action in a later state.
-  */
-  if (yytoken != YYEMPTY)
-    {
-      int yyn = yypact[*yyssp];
-      yyarg[yycount++] = yytname[yytoken];
-      if (!yypact_value_is_default (yyn))
-        {
-          /* Start YYX at -YYN if negative to avoid negative indexes in
-             YYCHECK.  In other words, skip the first -YYN actions for
-             this state because they are default actions.  */
-          int yyxbegin = yyn < 0 ? -yyn : 0;
-          /* Stay within bounds of both yycheck and yytname.  */
-          int yychecklim = YYLAST - yyn + 1;
-          int yyxend = yychecklim < YYNTOKENS ? yychecklim : YYNTOKENS;
-          int yyx;
-
-          for (yyx = yyxbegin; yyx < yyxend; ++yyx)
-            if (yycheck[yyx + yyn] == yyx && yyx != YYTERROR
-                && !yytable_value_is_error (yytable[yyx + yyn]))
-              {
-                if (yycount == YYERROR_VERBOSE_ARGS_MAXIMUM)
-                  {
-                    yycount = 1;
-                    yysize = yysize0;
-                    break;
-                  }
-                yyarg[yycount++] = yytname[yyx];
-                {
-                  YYSIZE_T yysize1 = yysize + yytnamerr (YY_NULLPTR, yytname[yyx]);
-                  if (! (yysize <= yysize1
-                         && yysize1 <= YYSTACK_ALLOC_MAXIMUM))
-                    return 2;
-                  yysize = yysize1;
-                }
-              }
-        }
-    }
-
-  switch (yycount)
-    {
-# define YYCASE_(N, S)                      \
-      case N:                               \
-        yyformat = S;                       \
-      break
-      YYCASE_(0, YY_("syntax error"));
-      YYCASE_(1, YY_("syntax error, unexpected %s"));
-      YYCASE_(2, YY_("syntax error, unexpected %s, expecting %s"));
-      YYCASE_(3, YY_("syntax error, unexpected %s, expecting %s or %s"));
-      YYCASE_(4, YY_("syntax error, unexpected %s, expecting %s or %s or %s"));
-      YYCASE_(5, YY_("syntax error, unexpected %s, expecting %s or %s or %s or %s"));
-# undef YYCASE_
-    }
-
-  {
-    YYSIZE_T yysize1 = yysize + yystrlen (yyformat);
-    if (! (yysize <= yysize1 && yysize1 <= YYSTACK_ALLOC_MAXIMUM))
-      return 2;
-    yysize = yysize1;
-  }
-
-  if (*yymsg_alloc < yysize)
-    {
-      *yymsg_alloc = 2 * yysize;
-      if (! (yysize <= *yymsg_alloc
-             && *yymsg_alloc <= YYSTACK_ALLOC_MAXIMUM))
-        *yymsg_alloc = YYSTACK_ALLOC_MAXIMUM;
-      return 1;
-    }
-
-  /* Avoid sprintf, as that infringes on the user's name space.
-     Don't have undefined behavior even if the translation
-     produced a string with the wrong number of "%s"s.  */
-  {
-    char *yyp = *yymsg;
-    int yyi = 0;
-    while ((*yyp = *yyformat) != '\0')
-      if (*yyp == '%' && yyformat[1] == 's' && yyi < yycount)
-        {
-          yyp += yytnamerr (yyp, yyarg[yyi++]);
-          yyformat += 2;
-        }
-      else
-        {
-          yyp++;
-          yyformat++;
-        }
-  }
-  return 0;
-}
-#endif /* YYERROR_VERBOSE */
 
 /*-----------------------------------------------.
 | Release the memory associated to this symbol.  |
 `-----------------------------------------------*/
 
 static void
-yydestruct (const char *yymsg, int yytype, YYSTYPE *yyvaluep, void *scanner)
+yydestruct (const char *yymsg,
+            yysymbol_kind_t yykind, YYSTYPE *yyvaluep, void *scanner, struct betree_event **root)
 {
-  YYUSE (yyvaluep);
-  YYUSE (scanner);
+  YY_USE (yyvaluep);
+  YY_USE (scanner);
+  YY_USE (root);
   if (!yymsg)
     yymsg = "Deleting";
-  YY_SYMBOL_PRINT (yymsg, yytype, yyvaluep, yylocationp);
+  YY_SYMBOL_PRINT (yymsg, yykind, yyvaluep, yylocationp);
 
   YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
-  YYUSE (yytype);
+  YY_USE (yykind);
   YY_IGNORE_MAYBE_UNINITIALIZED_END
 }
 
 
 
 
+
+
 /*----------.
 | yyparse.  |
 `----------*/
 
 int
-yyparse (void *scanner)
+yyparse (void *scanner, struct betree_event **root)
 {
-/* The lookahead symbol.  */
+/* Lookahead token kind.  */
 int yychar;
 
 
@@ -1196,45 +1022,38 @@ YY_INITIAL_VALUE (static YYSTYPE yyval_default;)
 YYSTYPE yylval YY_INITIAL_VALUE (= yyval_default);
 
     /* Number of syntax errors so far.  */
-    int yynerrs;
+    int yynerrs = 0;
 
-    int yystate;
+    yy_state_fast_t yystate = 0;
     /* Number of tokens to shift before error messages enabled.  */
-    int yyerrstatus;
+    int yyerrstatus = 0;
 
-    /* The stacks and their tools:
-       'yyss': related to states.
-       'yyvs': related to semantic values.
-
-       Refer to the stacks through separate pointers, to allow yyoverflow
+    /* Refer to the stacks through separate pointers, to allow yyoverflow
        to reallocate them elsewhere.  */
 
-    /* The state stack.  */
-    yytype_int16 yyssa[YYINITDEPTH];
-    yytype_int16 *yyss;
-    yytype_int16 *yyssp;
+    /* Their size.  */
+    YYPTRDIFF_T yystacksize = YYINITDEPTH;
 
-    /* The semantic value stack.  */
-    YYSTYPE yyvsa[YYINITDEPTH];
-    YYSTYPE *yyvs;
-    YYSTYPE *yyvsp;
+    /* The state stack: array, bottom, top.  */
+    yy_state_t yyssa[YYINITDEPTH];
+    yy_state_t *yyss = yyssa;
+    yy_state_t *yyssp = yyss;
 
-    YYSIZE_T yystacksize;
+    /* The semantic value stack: array, bottom, top.  */
+    YYSTYPE yyvsa[YYINITDEPTH];
+    YYSTYPE *yyvs = yyvsa;
+    YYSTYPE *yyvsp = yyvs;
 
   int yyn;
+  /* The return value of yyparse.  */
   int yyresult;
-  /* Lookahead token as an internal (translated) token number.  */
-  int yytoken = 0;
+  /* Lookahead symbol kind.  */
+  yysymbol_kind_t yytoken = YYSYMBOL_YYEMPTY;
   /* The variables used to return semantic value and location from the
      action routines.  */
   YYSTYPE yyval;
 
-#if YYERROR_VERBOSE
-  /* Buffer for error messages, and its allocated size.  */
-  char yymsgbuf[128];
-  char *yymsg = yymsgbuf;
-  YYSIZE_T yymsg_alloc = sizeof yymsgbuf;
-#endif
+
 
 #define YYPOPSTACK(N)   (yyvsp -= (N), yyssp -= (N))
 
@@ -1242,71 +1061,75 @@ YYSTYPE yylval YY_INITIAL_VALUE (= yyval_default);
      Keep to zero when no symbol should be popped.  */
   int yylen = 0;
 
-  yyssp = yyss = yyssa;
-  yyvsp = yyvs = yyvsa;
-  yystacksize = YYINITDEPTH;
-
   YYDPRINTF ((stderr, "Starting parse\n"));
 
-  yystate = 0;
-  yyerrstatus = 0;
-  yynerrs = 0;
-  yychar = YYEMPTY; /* Cause a token to be read.  */
+  yychar = ZZEMPTY; /* Cause a token to be read.  */
+
   goto yysetstate;
 
+
 /*------------------------------------------------------------.
-| yynewstate -- Push a new state, which is found in yystate.  |
+| yynewstate -- push a new state, which is found in yystate.  |
 `------------------------------------------------------------*/
- yynewstate:
+yynewstate:
   /* In all cases, when you get here, the value and location stacks
      have just been pushed.  So pushing a state here evens the stacks.  */
   yyssp++;
 
- yysetstate:
-  *yyssp = yystate;
+
+/*--------------------------------------------------------------------.
+| yysetstate -- set current state (the top of the stack) to yystate.  |
+`--------------------------------------------------------------------*/
+yysetstate:
+  YYDPRINTF ((stderr, "Entering state %d\n", yystate));
+  YY_ASSERT (0 <= yystate && yystate < YYNSTATES);
+  YY_IGNORE_USELESS_CAST_BEGIN
+  *yyssp = YY_CAST (yy_state_t, yystate);
+  YY_IGNORE_USELESS_CAST_END
+  YY_STACK_PRINT (yyss, yyssp);
 
   if (yyss + yystacksize - 1 <= yyssp)
+#if !defined yyoverflow && !defined YYSTACK_RELOCATE
+    YYNOMEM;
+#else
     {
       /* Get the current used size of the three stacks, in elements.  */
-      YYSIZE_T yysize = yyssp - yyss + 1;
+      YYPTRDIFF_T yysize = yyssp - yyss + 1;
 
-#ifdef yyoverflow
+# if defined yyoverflow
       {
         /* Give user a chance to reallocate the stack.  Use copies of
            these so that the &'s don't force the real ones into
            memory.  */
+        yy_state_t *yyss1 = yyss;
         YYSTYPE *yyvs1 = yyvs;
-        yytype_int16 *yyss1 = yyss;
 
         /* Each stack pointer address is followed by the size of the
            data in use in that stack, in bytes.  This used to be a
            conditional around just the two extra args, but that might
            be undefined if yyoverflow is a macro.  */
         yyoverflow (YY_("memory exhausted"),
-                    &yyss1, yysize * sizeof (*yyssp),
-                    &yyvs1, yysize * sizeof (*yyvsp),
+                    &yyss1, yysize * YYSIZEOF (*yyssp),
+                    &yyvs1, yysize * YYSIZEOF (*yyvsp),
                     &yystacksize);
-
         yyss = yyss1;
         yyvs = yyvs1;
       }
-#else /* no yyoverflow */
-# ifndef YYSTACK_RELOCATE
-      goto yyexhaustedlab;
-# else
+# else /* defined YYSTACK_RELOCATE */
       /* Extend the stack our own way.  */
       if (YYMAXDEPTH <= yystacksize)
-        goto yyexhaustedlab;
+        YYNOMEM;
       yystacksize *= 2;
       if (YYMAXDEPTH < yystacksize)
         yystacksize = YYMAXDEPTH;
 
       {
-        yytype_int16 *yyss1 = yyss;
+        yy_state_t *yyss1 = yyss;
         union yyalloc *yyptr =
-          (union yyalloc *) YYSTACK_ALLOC (YYSTACK_BYTES (yystacksize));
+          YY_CAST (union yyalloc *,
+                   YYSTACK_ALLOC (YY_CAST (YYSIZE_T, YYSTACK_BYTES (yystacksize))));
         if (! yyptr)
-          goto yyexhaustedlab;
+          YYNOMEM;
         YYSTACK_RELOCATE (yyss_alloc, yyss);
         YYSTACK_RELOCATE (yyvs_alloc, yyvs);
 #  undef YYSTACK_RELOCATE
@@ -1314,30 +1137,31 @@ YYSTYPE yylval YY_INITIAL_VALUE (= yyval_default);
           YYSTACK_FREE (yyss1);
       }
 # endif
-#endif /* no yyoverflow */
 
       yyssp = yyss + yysize - 1;
       yyvsp = yyvs + yysize - 1;
 
-      YYDPRINTF ((stderr, "Stack size increased to %lu\n",
-                  (unsigned long int) yystacksize));
+      YY_IGNORE_USELESS_CAST_BEGIN
+      YYDPRINTF ((stderr, "Stack size increased to %ld\n",
+                  YY_CAST (long, yystacksize)));
+      YY_IGNORE_USELESS_CAST_END
 
       if (yyss + yystacksize - 1 <= yyssp)
         YYABORT;
     }
+#endif /* !defined yyoverflow && !defined YYSTACK_RELOCATE */
 
-  YYDPRINTF ((stderr, "Entering state %d\n", yystate));
 
   if (yystate == YYFINAL)
     YYACCEPT;
 
   goto yybackup;
 
+
 /*-----------.
 | yybackup.  |
 `-----------*/
 yybackup:
-
   /* Do appropriate processing given the current state.  Read a
      lookahead token if we need one and don't already have one.  */
 
@@ -1348,18 +1172,29 @@ yybackup:
 
   /* Not known => get a lookahead token if don't already have one.  */
 
-  /* YYCHAR is either YYEMPTY or YYEOF or a valid lookahead symbol.  */
-  if (yychar == YYEMPTY)
+  /* YYCHAR is either empty, or end-of-input, or a valid lookahead.  */
+  if (yychar == ZZEMPTY)
     {
-      YYDPRINTF ((stderr, "Reading a token: "));
+      YYDPRINTF ((stderr, "Reading a token\n"));
       yychar = yylex (&yylval, scanner);
     }
 
-  if (yychar <= YYEOF)
+  if (yychar <= ZZEOF)
     {
-      yychar = yytoken = YYEOF;
+      yychar = ZZEOF;
+      yytoken = YYSYMBOL_YYEOF;
       YYDPRINTF ((stderr, "Now at end of input.\n"));
     }
+  else if (yychar == ZZerror)
+    {
+      /* The scanner already issued an error message, process directly
+         to error recovery.  But do not keep the error token as
+         lookahead, it is too special and may lead us to an endless
+         loop in error recovery. */
+      yychar = ZZUNDEF;
+      yytoken = YYSYMBOL_YYerror;
+      goto yyerrlab1;
+    }
   else
     {
       yytoken = YYTRANSLATE (yychar);
@@ -1387,15 +1222,13 @@ yybackup:
 
   /* Shift the lookahead token.  */
   YY_SYMBOL_PRINT ("Shifting", yytoken, &yylval, &yylloc);
-
-  /* Discard the shifted token.  */
-  yychar = YYEMPTY;
-
   yystate = yyn;
   YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
   *++yyvsp = yylval;
   YY_IGNORE_MAYBE_UNINITIALIZED_END
 
+  /* Discard the shifted token.  */
+  yychar = ZZEMPTY;
   goto yynewstate;
 
 
@@ -1410,7 +1243,7 @@ yydefault:
 
 
 /*-----------------------------.
-| yyreduce -- Do a reduction.  |
+| yyreduce -- do a reduction.  |
 `-----------------------------*/
 yyreduce:
   /* yyn is the number of a rule to reduce with.  */
@@ -1430,230 +1263,231 @@ yyreduce:
   YY_REDUCE_PRINT (yyn);
   switch (yyn)
     {
-        case 2:
-#line 94 "src/event_parser.y" /* yacc.c:1646  */
-    { root = (yyvsp[-1].event); }
-#line 1437 "src/event_parser.c" /* yacc.c:1646  */
+  case 2: /* program: EVENT_LCURLY variable_loop EVENT_RCURLY  */
+#line 93 "src/event_parser.y"
+                                                                { *root = (yyvsp[-1].event); }
+#line 1270 "src/event_parser.c"
     break;
 
-  case 3:
-#line 96 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.event) = make_empty_event(); add_variable((yyvsp[0].variable), (yyval.event)); }
-#line 1443 "src/event_parser.c" /* yacc.c:1646  */
+  case 3: /* variable_loop: variable  */
+#line 95 "src/event_parser.y"
+                                                            { (yyval.event) = make_empty_event(); add_variable((yyvsp[0].variable), (yyval.event)); }
+#line 1276 "src/event_parser.c"
     break;
 
-  case 4:
-#line 97 "src/event_parser.y" /* yacc.c:1646  */
-    { add_variable((yyvsp[0].variable), (yyvsp[-2].event)); (yyval.event) = (yyvsp[-2].event); }
-#line 1449 "src/event_parser.c" /* yacc.c:1646  */
+  case 4: /* variable_loop: variable_loop EVENT_COMMA variable  */
+#line 96 "src/event_parser.y"
+                                                            { add_variable((yyvsp[0].variable), (yyvsp[-2].event)); (yyval.event) = (yyvsp[-2].event); }
+#line 1282 "src/event_parser.c"
     break;
 
-  case 5:
-#line 100 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.variable) = make_pred((yyvsp[-2].string), INVALID_VAR, (yyvsp[0].value)); bfree((yyvsp[-2].string)); }
-#line 1455 "src/event_parser.c" /* yacc.c:1646  */
+  case 5: /* variable: EVENT_STRING EVENT_COLON value  */
+#line 99 "src/event_parser.y"
+                                                            { (yyval.variable) = make_pred((yyvsp[-2].string), INVALID_VAR, (yyvsp[0].value)); bfree((yyvsp[-2].string)); }
+#line 1288 "src/event_parser.c"
     break;
 
-  case 6:
-#line 101 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.variable) = NULL; bfree((yyvsp[-2].string)); }
-#line 1461 "src/event_parser.c" /* yacc.c:1646  */
+  case 6: /* variable: EVENT_STRING EVENT_COLON EVENT_NULL  */
+#line 100 "src/event_parser.y"
+                                                            { (yyval.variable) = NULL; bfree((yyvsp[-2].string)); }
+#line 1294 "src/event_parser.c"
     break;
 
-  case 7:
-#line 104 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.value).value_type = BETREE_BOOLEAN; (yyval.value).boolean_value = (yyvsp[0].boolean_value); }
-#line 1467 "src/event_parser.c" /* yacc.c:1646  */
+  case 7: /* value: boolean  */
+#line 103 "src/event_parser.y"
+                                                            { (yyval.value).value_type = BETREE_BOOLEAN; (yyval.value).boolean_value = (yyvsp[0].boolean_value); }
+#line 1300 "src/event_parser.c"
     break;
 
-  case 8:
-#line 105 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.value).value_type = BETREE_INTEGER; (yyval.value).integer_value = (yyvsp[0].integer_value); }
-#line 1473 "src/event_parser.c" /* yacc.c:1646  */
+  case 8: /* value: integer  */
+#line 104 "src/event_parser.y"
+                                                            { (yyval.value).value_type = BETREE_INTEGER; (yyval.value).integer_value = (yyvsp[0].integer_value); }
+#line 1306 "src/event_parser.c"
     break;
 
-  case 9:
-#line 106 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.value).value_type = BETREE_FLOAT; (yyval.value).float_value = (yyvsp[0].float_value); }
-#line 1479 "src/event_parser.c" /* yacc.c:1646  */
+  case 9: /* value: float  */
+#line 105 "src/event_parser.y"
+                                                            { (yyval.value).value_type = BETREE_FLOAT; (yyval.value).float_value = (yyvsp[0].float_value); }
+#line 1312 "src/event_parser.c"
     break;
 
-  case 10:
-#line 107 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.value).value_type = BETREE_STRING; (yyval.value).string_value = (yyvsp[0].string_value); }
-#line 1485 "src/event_parser.c" /* yacc.c:1646  */
+  case 10: /* value: string  */
+#line 106 "src/event_parser.y"
+                                                            { (yyval.value).value_type = BETREE_STRING; (yyval.value).string_value = (yyvsp[0].string_value); }
+#line 1318 "src/event_parser.c"
     break;
 
-  case 11:
-#line 108 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.value).value_type = BETREE_INTEGER_LIST; (yyval.value).integer_list_value = (yyvsp[0].integer_list_value); }
-#line 1491 "src/event_parser.c" /* yacc.c:1646  */
+  case 11: /* value: empty_list_value  */
+#line 107 "src/event_parser.y"
+                                                            { (yyval.value).value_type = BETREE_INTEGER_LIST; (yyval.value).integer_list_value = (yyvsp[0].integer_list_value); }
+#line 1324 "src/event_parser.c"
     break;
 
-  case 12:
-#line 109 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.value).value_type = BETREE_INTEGER_LIST; (yyval.value).integer_list_value = (yyvsp[0].integer_list_value); }
-#line 1497 "src/event_parser.c" /* yacc.c:1646  */
+  case 12: /* value: integer_list_value  */
+#line 108 "src/event_parser.y"
+                                                            { (yyval.value).value_type = BETREE_INTEGER_LIST; (yyval.value).integer_list_value = (yyvsp[0].integer_list_value); }
+#line 1330 "src/event_parser.c"
     break;
 
-  case 13:
-#line 110 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.value).value_type = BETREE_STRING_LIST; (yyval.value).string_list_value = (yyvsp[0].string_list_value); }
-#line 1503 "src/event_parser.c" /* yacc.c:1646  */
+  case 13: /* value: string_list_value  */
+#line 109 "src/event_parser.y"
+                                                            { (yyval.value).value_type = BETREE_STRING_LIST; (yyval.value).string_list_value = (yyvsp[0].string_list_value); }
+#line 1336 "src/event_parser.c"
     break;
 
-  case 14:
-#line 111 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.value).value_type = BETREE_SEGMENTS; (yyval.value).segments_value = (yyvsp[0].segments_list_value); }
-#line 1509 "src/event_parser.c" /* yacc.c:1646  */
+  case 14: /* value: segments_value  */
+#line 110 "src/event_parser.y"
+                                                            { (yyval.value).value_type = BETREE_SEGMENTS; (yyval.value).segments_value = (yyvsp[0].segments_list_value); }
+#line 1342 "src/event_parser.c"
     break;
 
-  case 15:
-#line 112 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.value).value_type = BETREE_FREQUENCY_CAPS; (yyval.value).frequency_caps_value = (yyvsp[0].frequencies_value); }
-#line 1515 "src/event_parser.c" /* yacc.c:1646  */
+  case 15: /* value: frequencies_value  */
+#line 111 "src/event_parser.y"
+                                                            { (yyval.value).value_type = BETREE_FREQUENCY_CAPS; (yyval.value).frequency_caps_value = (yyvsp[0].frequencies_value); }
+#line 1348 "src/event_parser.c"
     break;
 
-  case 16:
-#line 114 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.boolean_value) = true; }
-#line 1521 "src/event_parser.c" /* yacc.c:1646  */
+  case 16: /* boolean: EVENT_TRUE  */
+#line 113 "src/event_parser.y"
+                                                            { (yyval.boolean_value) = true; }
+#line 1354 "src/event_parser.c"
     break;
 
-  case 17:
-#line 115 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.boolean_value) = false; }
-#line 1527 "src/event_parser.c" /* yacc.c:1646  */
+  case 17: /* boolean: EVENT_FALSE  */
+#line 114 "src/event_parser.y"
+                                                            { (yyval.boolean_value) = false; }
+#line 1360 "src/event_parser.c"
     break;
 
-  case 18:
-#line 118 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.integer_value) = (yyvsp[0].integer_value); }
-#line 1533 "src/event_parser.c" /* yacc.c:1646  */
+  case 18: /* integer: EVENT_INTEGER  */
+#line 117 "src/event_parser.y"
+                                                            { (yyval.integer_value) = (yyvsp[0].integer_value); }
+#line 1366 "src/event_parser.c"
     break;
 
-  case 19:
-#line 119 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.integer_value) = - (yyvsp[0].integer_value); }
-#line 1539 "src/event_parser.c" /* yacc.c:1646  */
+  case 19: /* integer: EVENT_MINUS EVENT_INTEGER  */
+#line 118 "src/event_parser.y"
+                                                            { (yyval.integer_value) = - (yyvsp[0].integer_value); }
+#line 1372 "src/event_parser.c"
     break;
 
-  case 20:
-#line 122 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.float_value) = (yyvsp[0].float_value); }
-#line 1545 "src/event_parser.c" /* yacc.c:1646  */
+  case 20: /* float: EVENT_FLOAT  */
+#line 121 "src/event_parser.y"
+                                                            { (yyval.float_value) = (yyvsp[0].float_value); }
+#line 1378 "src/event_parser.c"
     break;
 
-  case 21:
-#line 123 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.float_value) = - (yyvsp[0].float_value); }
-#line 1551 "src/event_parser.c" /* yacc.c:1646  */
+  case 21: /* float: EVENT_MINUS EVENT_FLOAT  */
+#line 122 "src/event_parser.y"
+                                                            { (yyval.float_value) = - (yyvsp[0].float_value); }
+#line 1384 "src/event_parser.c"
     break;
 
-  case 22:
-#line 126 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.string_value).string = bstrdup((yyvsp[0].string)); (yyval.string_value).str = INVALID_STR; bfree((yyvsp[0].string)); }
-#line 1557 "src/event_parser.c" /* yacc.c:1646  */
+  case 22: /* string: EVENT_STRING  */
+#line 125 "src/event_parser.y"
+                                                            { (yyval.string_value).string = bstrdup((yyvsp[0].string)); (yyval.string_value).str = INVALID_STR; bfree((yyvsp[0].string)); }
+#line 1390 "src/event_parser.c"
     break;
 
-  case 23:
-#line 128 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.integer_list_value) = make_integer_list(); }
-#line 1563 "src/event_parser.c" /* yacc.c:1646  */
+  case 23: /* empty_list_value: EVENT_LSQUARE EVENT_RSQUARE  */
+#line 127 "src/event_parser.y"
+                                                            { (yyval.integer_list_value) = make_integer_list(); }
+#line 1396 "src/event_parser.c"
     break;
 
-  case 24:
-#line 131 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.integer_list_value) = (yyvsp[-1].integer_list_value); }
-#line 1569 "src/event_parser.c" /* yacc.c:1646  */
+  case 24: /* integer_list_value: EVENT_LSQUARE integer_list_loop EVENT_RSQUARE  */
+#line 130 "src/event_parser.y"
+                                                            { (yyval.integer_list_value) = (yyvsp[-1].integer_list_value); }
+#line 1402 "src/event_parser.c"
     break;
 
-  case 25:
-#line 133 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.integer_list_value) = make_integer_list(); add_integer_list_value((yyvsp[0].integer_value), (yyval.integer_list_value)); }
-#line 1575 "src/event_parser.c" /* yacc.c:1646  */
+  case 25: /* integer_list_loop: integer  */
+#line 132 "src/event_parser.y"
+                                                            { (yyval.integer_list_value) = make_integer_list(); add_integer_list_value((yyvsp[0].integer_value), (yyval.integer_list_value)); }
+#line 1408 "src/event_parser.c"
     break;
 
-  case 26:
-#line 134 "src/event_parser.y" /* yacc.c:1646  */
-    { add_integer_list_value((yyvsp[0].integer_value), (yyvsp[-2].integer_list_value)); (yyval.integer_list_value) = (yyvsp[-2].integer_list_value); }
-#line 1581 "src/event_parser.c" /* yacc.c:1646  */
+  case 26: /* integer_list_loop: integer_list_loop EVENT_COMMA integer  */
+#line 133 "src/event_parser.y"
+                                                            { add_integer_list_value((yyvsp[0].integer_value), (yyvsp[-2].integer_list_value)); (yyval.integer_list_value) = (yyvsp[-2].integer_list_value); }
+#line 1414 "src/event_parser.c"
     break;
 
-  case 27:
-#line 138 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.string_list_value) = (yyvsp[-1].string_list_value); }
-#line 1587 "src/event_parser.c" /* yacc.c:1646  */
+  case 27: /* string_list_value: EVENT_LSQUARE string_list_loop EVENT_RSQUARE  */
+#line 137 "src/event_parser.y"
+                                                            { (yyval.string_list_value) = (yyvsp[-1].string_list_value); }
+#line 1420 "src/event_parser.c"
     break;
 
-  case 28:
-#line 140 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.string_list_value) = make_string_list(); add_string_list_value((yyvsp[0].string_value), (yyval.string_list_value)); }
-#line 1593 "src/event_parser.c" /* yacc.c:1646  */
+  case 28: /* string_list_loop: string  */
+#line 139 "src/event_parser.y"
+                                                            { (yyval.string_list_value) = make_string_list(); add_string_list_value((yyvsp[0].string_value), (yyval.string_list_value)); }
+#line 1426 "src/event_parser.c"
     break;
 
-  case 29:
-#line 141 "src/event_parser.y" /* yacc.c:1646  */
-    { add_string_list_value((yyvsp[0].string_value), (yyvsp[-2].string_list_value)); (yyval.string_list_value) = (yyvsp[-2].string_list_value); }
-#line 1599 "src/event_parser.c" /* yacc.c:1646  */
+  case 29: /* string_list_loop: string_list_loop EVENT_COMMA string  */
+#line 140 "src/event_parser.y"
+                                                            { add_string_list_value((yyvsp[0].string_value), (yyvsp[-2].string_list_value)); (yyval.string_list_value) = (yyvsp[-2].string_list_value); }
+#line 1432 "src/event_parser.c"
     break;
 
-  case 30:
-#line 145 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.segments_list_value) = (yyvsp[-1].segments_list_value); }
-#line 1605 "src/event_parser.c" /* yacc.c:1646  */
+  case 30: /* segments_value: EVENT_LSQUARE segments_loop EVENT_RSQUARE  */
+#line 144 "src/event_parser.y"
+                                                            { (yyval.segments_list_value) = (yyvsp[-1].segments_list_value); }
+#line 1438 "src/event_parser.c"
     break;
 
-  case 31:
-#line 147 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.segments_list_value) = make_segments(); add_segment((yyvsp[0].segment_value), (yyval.segments_list_value)); }
-#line 1611 "src/event_parser.c" /* yacc.c:1646  */
+  case 31: /* segments_loop: segment_value  */
+#line 146 "src/event_parser.y"
+                                                            { (yyval.segments_list_value) = make_segments(); add_segment((yyvsp[0].segment_value), (yyval.segments_list_value)); }
+#line 1444 "src/event_parser.c"
     break;
 
-  case 32:
-#line 149 "src/event_parser.y" /* yacc.c:1646  */
-    { add_segment((yyvsp[0].segment_value), (yyvsp[-2].segments_list_value)); (yyval.segments_list_value) = (yyvsp[-2].segments_list_value); }
-#line 1617 "src/event_parser.c" /* yacc.c:1646  */
+  case 32: /* segments_loop: segments_loop EVENT_COMMA segment_value  */
+#line 148 "src/event_parser.y"
+                                                            { add_segment((yyvsp[0].segment_value), (yyvsp[-2].segments_list_value)); (yyval.segments_list_value) = (yyvsp[-2].segments_list_value); }
+#line 1450 "src/event_parser.c"
     break;
 
-  case 33:
-#line 153 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.segment_value) = make_segment((yyvsp[-3].integer_value), (yyvsp[-1].integer_value)); }
-#line 1623 "src/event_parser.c" /* yacc.c:1646  */
+  case 33: /* segment_value: EVENT_LSQUARE integer EVENT_COMMA integer EVENT_RSQUARE  */
+#line 152 "src/event_parser.y"
+                                                            { (yyval.segment_value) = make_segment((yyvsp[-3].integer_value), (yyvsp[-1].integer_value)); }
+#line 1456 "src/event_parser.c"
     break;
 
-  case 34:
-#line 156 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.frequencies_value) = (yyvsp[-1].frequencies_value); }
-#line 1629 "src/event_parser.c" /* yacc.c:1646  */
+  case 34: /* frequencies_value: EVENT_LSQUARE frequencies_loop EVENT_RSQUARE  */
+#line 155 "src/event_parser.y"
+                                                            { (yyval.frequencies_value) = (yyvsp[-1].frequencies_value); }
+#line 1462 "src/event_parser.c"
     break;
 
-  case 35:
-#line 158 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.frequencies_value) = make_frequency_caps(); add_frequency((yyvsp[0].frequency_value), (yyval.frequencies_value)); }
-#line 1635 "src/event_parser.c" /* yacc.c:1646  */
+  case 35: /* frequencies_loop: frequency_value  */
+#line 157 "src/event_parser.y"
+                                                            { (yyval.frequencies_value) = make_frequency_caps(); add_frequency((yyvsp[0].frequency_value), (yyval.frequencies_value)); }
+#line 1468 "src/event_parser.c"
     break;
 
-  case 36:
-#line 160 "src/event_parser.y" /* yacc.c:1646  */
-    { add_frequency((yyvsp[0].frequency_value), (yyvsp[-2].frequencies_value)); (yyval.frequencies_value) = (yyvsp[-2].frequencies_value); }
-#line 1641 "src/event_parser.c" /* yacc.c:1646  */
+  case 36: /* frequencies_loop: frequencies_loop EVENT_COMMA frequency_value  */
+#line 159 "src/event_parser.y"
+                                                            { add_frequency((yyvsp[0].frequency_value), (yyvsp[-2].frequencies_value)); (yyval.frequencies_value) = (yyvsp[-2].frequencies_value); }
+#line 1474 "src/event_parser.c"
     break;
 
-  case 37:
-#line 164 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.frequency_value) = make_frequency_cap((yyvsp[-9].string), (yyvsp[-7].integer_value), (yyvsp[-5].string_value), true, (yyvsp[-1].integer_value), (yyvsp[-3].integer_value)); bfree((yyvsp[-9].string)); }
-#line 1647 "src/event_parser.c" /* yacc.c:1646  */
+  case 37: /* frequency_value: EVENT_LSQUARE EVENT_STRING EVENT_COMMA integer EVENT_COMMA string EVENT_COMMA integer EVENT_COMMA integer EVENT_RSQUARE  */
+#line 163 "src/event_parser.y"
+                                                            { (yyval.frequency_value) = make_frequency_cap((yyvsp[-9].string), (yyvsp[-7].integer_value), (yyvsp[-5].string_value), true, (yyvsp[-1].integer_value), (yyvsp[-3].integer_value)); bfree((yyvsp[-9].string)); }
+#line 1480 "src/event_parser.c"
     break;
 
-  case 38:
-#line 166 "src/event_parser.y" /* yacc.c:1646  */
-    { (yyval.frequency_value) = make_frequency_cap((yyvsp[-10].string), (yyvsp[-8].integer_value), (yyvsp[-6].string_value), true, (yyvsp[-1].integer_value), (yyvsp[-3].integer_value)); bfree((yyvsp[-10].string)); }
-#line 1653 "src/event_parser.c" /* yacc.c:1646  */
+  case 38: /* frequency_value: EVENT_LSQUARE EVENT_LSQUARE EVENT_STRING EVENT_COMMA integer EVENT_COMMA string EVENT_RSQUARE EVENT_COMMA integer EVENT_COMMA integer EVENT_RSQUARE  */
+#line 165 "src/event_parser.y"
+                                                            { (yyval.frequency_value) = make_frequency_cap((yyvsp[-10].string), (yyvsp[-8].integer_value), (yyvsp[-6].string_value), true, (yyvsp[-1].integer_value), (yyvsp[-3].integer_value)); bfree((yyvsp[-10].string)); }
+#line 1486 "src/event_parser.c"
     break;
 
 
-#line 1657 "src/event_parser.c" /* yacc.c:1646  */
+#line 1490 "src/event_parser.c"
+
       default: break;
     }
   /* User semantic actions sometimes alter yychar, and that requires
@@ -1667,25 +1501,23 @@ yyreduce:
      case of YYERROR or YYBACKUP, subsequent parser actions might lead
      to an incorrect destructor call or verbose syntax error message
      before the lookahead is translated.  */
-  YY_SYMBOL_PRINT ("-> $$ =", yyr1[yyn], &yyval, &yyloc);
+  YY_SYMBOL_PRINT ("-> $$ =", YY_CAST (yysymbol_kind_t, yyr1[yyn]), &yyval, &yyloc);
 
   YYPOPSTACK (yylen);
   yylen = 0;
-  YY_STACK_PRINT (yyss, yyssp);
 
   *++yyvsp = yyval;
 
   /* Now 'shift' the result of the reduction.  Determine what state
      that goes to, based on the state we popped back to and the rule
      number reduced by.  */
-
-  yyn = yyr1[yyn];
-
-  yystate = yypgoto[yyn - YYNTOKENS] + *yyssp;
-  if (0 <= yystate && yystate <= YYLAST && yycheck[yystate] == *yyssp)
-    yystate = yytable[yystate];
-  else
-    yystate = yydefgoto[yyn - YYNTOKENS];
+  {
+    const int yylhs = yyr1[yyn] - YYNTOKENS;
+    const int yyi = yypgoto[yylhs] + *yyssp;
+    yystate = (0 <= yyi && yyi <= YYLAST && yycheck[yyi] == *yyssp
+               ? yytable[yyi]
+               : yydefgoto[yylhs]);
+  }
 
   goto yynewstate;
 
@@ -1696,66 +1528,30 @@ yyreduce:
 yyerrlab:
   /* Make sure we have latest lookahead translation.  See comments at
      user semantic actions for why this is necessary.  */
-  yytoken = yychar == YYEMPTY ? YYEMPTY : YYTRANSLATE (yychar);
-
+  yytoken = yychar == ZZEMPTY ? YYSYMBOL_YYEMPTY : YYTRANSLATE (yychar);
   /* If not already recovering from an error, report this error.  */
   if (!yyerrstatus)
     {
       ++yynerrs;
-#if ! YYERROR_VERBOSE
-      yyerror (scanner, YY_("syntax error"));
-#else
-# define YYSYNTAX_ERROR yysyntax_error (&yymsg_alloc, &yymsg, \
-                                        yyssp, yytoken)
-      {
-        char const *yymsgp = YY_("syntax error");
-        int yysyntax_error_status;
-        yysyntax_error_status = YYSYNTAX_ERROR;
-        if (yysyntax_error_status == 0)
-          yymsgp = yymsg;
-        else if (yysyntax_error_status == 1)
-          {
-            if (yymsg != yymsgbuf)
-              YYSTACK_FREE (yymsg);
-            yymsg = (char *) YYSTACK_ALLOC (yymsg_alloc);
-            if (!yymsg)
-              {
-                yymsg = yymsgbuf;
-                yymsg_alloc = sizeof yymsgbuf;
-                yysyntax_error_status = 2;
-              }
-            else
-              {
-                yysyntax_error_status = YYSYNTAX_ERROR;
-                yymsgp = yymsg;
-              }
-          }
-        yyerror (scanner, yymsgp);
-        if (yysyntax_error_status == 2)
-          goto yyexhaustedlab;
-      }
-# undef YYSYNTAX_ERROR
-#endif
+      yyerror (scanner, root, YY_("syntax error"));
     }
 
-
-
   if (yyerrstatus == 3)
     {
       /* If just tried and failed to reuse lookahead token after an
          error, discard it.  */
 
-      if (yychar <= YYEOF)
+      if (yychar <= ZZEOF)
         {
           /* Return failure if at end of input.  */
-          if (yychar == YYEOF)
+          if (yychar == ZZEOF)
             YYABORT;
         }
       else
         {
           yydestruct ("Error: discarding",
-                      yytoken, &yylval, scanner);
-          yychar = YYEMPTY;
+                      yytoken, &yylval, scanner, root);
+          yychar = ZZEMPTY;
         }
     }
 
@@ -1768,12 +1564,11 @@ yyerrlab:
 | yyerrorlab -- error raised explicitly by YYERROR.  |
 `---------------------------------------------------*/
 yyerrorlab:
-
-  /* Pacify compilers like GCC when the user code never invokes
-     YYERROR and the label yyerrorlab therefore never appears in user
-     code.  */
-  if (/*CONSTCOND*/ 0)
-     goto yyerrorlab;
+  /* Pacify compilers when the user code never invokes YYERROR and the
+     label yyerrorlab therefore never appears in user code.  */
+  if (0)
+    YYERROR;
+  ++yynerrs;
 
   /* Do not reclaim the symbols of the rule whose action triggered
      this YYERROR.  */
@@ -1790,13 +1585,14 @@ yyerrorlab:
 yyerrlab1:
   yyerrstatus = 3;      /* Each real token shifted decrements this.  */
 
+  /* Pop stack until we find a state that shifts the error token.  */
   for (;;)
     {
       yyn = yypact[yystate];
       if (!yypact_value_is_default (yyn))
         {
-          yyn += YYTERROR;
-          if (0 <= yyn && yyn <= YYLAST && yycheck[yyn] == YYTERROR)
+          yyn += YYSYMBOL_YYerror;
+          if (0 <= yyn && yyn <= YYLAST && yycheck[yyn] == YYSYMBOL_YYerror)
             {
               yyn = yytable[yyn];
               if (0 < yyn)
@@ -1810,7 +1606,7 @@ yyerrlab1:
 
 
       yydestruct ("Error: popping",
-                  yystos[yystate], yyvsp, scanner);
+                  YY_ACCESSING_SYMBOL (yystate), yyvsp, scanner, root);
       YYPOPSTACK (1);
       yystate = *yyssp;
       YY_STACK_PRINT (yyss, yyssp);
@@ -1822,7 +1618,7 @@ yyerrlab1:
 
 
   /* Shift the error token.  */
-  YY_SYMBOL_PRINT ("Shifting", yystos[yyn], yyvsp, yylsp);
+  YY_SYMBOL_PRINT ("Shifting", YY_ACCESSING_SYMBOL (yyn), yyvsp, yylsp);
 
   yystate = yyn;
   goto yynewstate;
@@ -1833,33 +1629,37 @@ yyerrlab1:
 `-------------------------------------*/
 yyacceptlab:
   yyresult = 0;
-  goto yyreturn;
+  goto yyreturnlab;
+
 
 /*-----------------------------------.
 | yyabortlab -- YYABORT comes here.  |
 `-----------------------------------*/
 yyabortlab:
   yyresult = 1;
-  goto yyreturn;
+  goto yyreturnlab;
+
 
-#if !defined yyoverflow || YYERROR_VERBOSE
-/*-------------------------------------------------.
-| yyexhaustedlab -- memory exhaustion comes here.  |
-`-------------------------------------------------*/
+/*-----------------------------------------------------------.
+| yyexhaustedlab -- YYNOMEM (memory exhaustion) comes here.  |
+`-----------------------------------------------------------*/
 yyexhaustedlab:
-  yyerror (scanner, YY_("memory exhausted"));
+  yyerror (scanner, root, YY_("memory exhausted"));
   yyresult = 2;
-  /* Fall through.  */
-#endif
+  goto yyreturnlab;
+
 
-yyreturn:
-  if (yychar != YYEMPTY)
+/*----------------------------------------------------------.
+| yyreturnlab -- parsing is finished, clean up and return.  |
+`----------------------------------------------------------*/
+yyreturnlab:
+  if (yychar != ZZEMPTY)
     {
       /* Make sure we have latest lookahead translation.  See comments at
          user semantic actions for why this is necessary.  */
       yytoken = YYTRANSLATE (yychar);
       yydestruct ("Cleanup: discarding lookahead",
-                  yytoken, &yylval, scanner);
+                  yytoken, &yylval, scanner, root);
     }
   /* Do not reclaim the symbols of the rule whose action triggered
      this YYABORT or YYACCEPT.  */
@@ -1868,20 +1668,18 @@ yyreturn:
   while (yyssp != yyss)
     {
       yydestruct ("Cleanup: popping",
-                  yystos[*yyssp], yyvsp, scanner);
+                  YY_ACCESSING_SYMBOL (+*yyssp), yyvsp, scanner, root);
       YYPOPSTACK (1);
     }
 #ifndef yyoverflow
   if (yyss != yyssa)
     YYSTACK_FREE (yyss);
 #endif
-#if YYERROR_VERBOSE
-  if (yymsg != yymsgbuf)
-    YYSTACK_FREE (yymsg);
-#endif
+
   return yyresult;
 }
-#line 169 "src/event_parser.y" /* yacc.c:1906  */
+
+#line 168 "src/event_parser.y"
 
 
 #if defined(__GNUC__)
@@ -1898,7 +1696,8 @@ int event_parse(const char *text, struct betree_event** event)
     yyscan_t scanner;
     zzlex_init(&scanner);
     YY_BUFFER_STATE buffer = zz_scan_string(text, scanner);
-    int rc = zzparse(scanner);
+    struct betree_event* root = NULL;
+    int rc = zzparse(scanner, &root);
     zz_delete_buffer(buffer, scanner);
     zzlex_destroy(scanner);
     
@@ -1,8 +1,9 @@
-/* A Bison parser, made by GNU Bison 3.0.4.  */
+/* A Bison parser, made by GNU Bison 3.8.2.  */
 
 /* Bison interface for Yacc-like parsers in C
 
-   Copyright (C) 1984, 1989-1990, 2000-2015 Free Software Foundation, Inc.
+   Copyright (C) 1984, 1989-1990, 2000-2015, 2018-2021 Free Software Foundation,
+   Inc.
 
    This program is free software: you can redistribute it and/or modify
    it under the terms of the GNU General Public License as published by
@@ -15,7 +16,7 @@
    GNU General Public License for more details.
 
    You should have received a copy of the GNU General Public License
-   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
 
 /* As a special exception, you may create a larger work that contains
    part or all of the Bison parser skeleton and distribute that work
@@ -30,6 +31,10 @@
    This special exception was added by the Free Software Foundation in
    version 2.2 of Bison.  */
 
+/* DO NOT RELY ON FEATURES THAT ARE NOT DOCUMENTED in the manual,
+   especially those whose name start with YY_ or yy_.  They are
+   private implementation details that can be changed or removed.  */
+
 #ifndef YY_ZZ_SRC_EVENT_PARSER_H_INCLUDED
 # define YY_ZZ_SRC_EVENT_PARSER_H_INCLUDED
 /* Debug traces.  */
@@ -48,47 +53,37 @@
 extern int zzdebug;
 #endif
 
-/* Token type.  */
+/* Token kinds.  */
 #ifndef ZZTOKENTYPE
 # define ZZTOKENTYPE
   enum zztokentype
   {
-    EVENT_LCURLY = 258,
-    EVENT_RCURLY = 259,
-    EVENT_LSQUARE = 260,
-    EVENT_RSQUARE = 261,
-    EVENT_COMMA = 262,
-    EVENT_COLON = 263,
-    EVENT_MINUS = 264,
-    EVENT_NULL = 265,
-    EVENT_TRUE = 266,
-    EVENT_FALSE = 267,
-    EVENT_INTEGER = 268,
-    EVENT_FLOAT = 269,
-    EVENT_STRING = 270
+    ZZEMPTY = -2,
+    ZZEOF = 0,                     /* "end of file"  */
+    ZZerror = 256,                 /* error  */
+    ZZUNDEF = 257,                 /* "invalid token"  */
+    EVENT_LCURLY = 258,            /* EVENT_LCURLY  */
+    EVENT_RCURLY = 259,            /* EVENT_RCURLY  */
+    EVENT_LSQUARE = 260,           /* EVENT_LSQUARE  */
+    EVENT_RSQUARE = 261,           /* EVENT_RSQUARE  */
+    EVENT_COMMA = 262,             /* EVENT_COMMA  */
+    EVENT_COLON = 263,             /* EVENT_COLON  */
+    EVENT_MINUS = 264,             /* EVENT_MINUS  */
+    EVENT_NULL = 265,              /* EVENT_NULL  */
+    EVENT_TRUE = 266,              /* EVENT_TRUE  */
+    EVENT_FALSE = 267,             /* EVENT_FALSE  */
+    EVENT_INTEGER = 268,           /* EVENT_INTEGER  */
+    EVENT_FLOAT = 269,             /* EVENT_FLOAT  */
+    EVENT_STRING = 270             /* EVENT_STRING  */
   };
+  typedef enum zztokentype zztoken_kind_t;
 #endif
-/* Tokens.  */
-#define EVENT_LCURLY 258
-#define EVENT_RCURLY 259
-#define EVENT_LSQUARE 260
-#define EVENT_RSQUARE 261
-#define EVENT_COMMA 262
-#define EVENT_COLON 263
-#define EVENT_MINUS 264
-#define EVENT_NULL 265
-#define EVENT_TRUE 266
-#define EVENT_FALSE 267
-#define EVENT_INTEGER 268
-#define EVENT_FLOAT 269
-#define EVENT_STRING 270
 
 /* Value type.  */
 #if ! defined ZZSTYPE && ! defined ZZSTYPE_IS_DECLARED
-
 union ZZSTYPE
 {
-#line 32 "src/event_parser.y" /* yacc.c:1909  */
+#line 31 "src/event_parser.y"
 
     int token;
     char *string;
@@ -100,18 +95,18 @@ union ZZSTYPE
     struct betree_integer_list* integer_list_value;
     struct betree_string_list* string_list_value;
     struct betree_segments* segments_list_value;
-    struct betree_segment* segment_value;
+    struct betree_segment segment_value;
     struct betree_frequency_caps* frequencies_value;
-    struct betree_frequency_cap* frequency_value;
+    struct betree_frequency_cap frequency_value;
 
     struct value value;
     struct betree_variable* variable;
 
     struct betree_event* event;
 
-#line 113 "src/event_parser.h" /* yacc.c:1909  */
-};
+#line 108 "src/event_parser.h"
 
+};
 typedef union ZZSTYPE ZZSTYPE;
 # define ZZSTYPE_IS_TRIVIAL 1
 # define ZZSTYPE_IS_DECLARED 1
@@ -119,6 +114,8 @@ typedef union ZZSTYPE ZZSTYPE;
 
 
 
-int zzparse (void *scanner);
+
+int zzparse (void *scanner, struct betree_event **root);
+
 
 #endif /* !YY_ZZ_SRC_EVENT_PARSER_H_INCLUDED  */
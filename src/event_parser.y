@@ -9,9 +9,8 @@
     #include "event_parser.h"
     #include "tree.h"
     #include "value.h"
-    struct betree_event *root;
     extern int zzlex();
-    void zzerror(void *scanner, const char *s) { (void)scanner; printf("ERROR: %s\n", s); }
+    void zzerror(void *scanner, struct betree_event **root, const char *s) { (void)scanner; (void)root; printf("ERROR: %s\n", s); }
 #if defined(__GNUC__)
     #pragma GCC diagnostic push
     #pragma GCC diagnostic ignored "-Wswitch-default"
@@ -22,7 +21,7 @@
 // %debug
 %pure-parser
 %lex-param {void *scanner}
-%parse-param {void *scanner}
+%parse-param {void *scanner} {struct betree_event **root}
 %define api.prefix {zz}
 
 %{
@@ -40,9 +39,9 @@
     struct betree_integer_list* integer_list_value;
     struct betree_string_list* string_list_value;
     struct betree_segments* segments_list_value;
-    struct betree_segment* segment_value;
+    struct betree_segment segment_value;
     struct betree_frequency_caps* frequencies_value;
-    struct betree_frequency_cap* frequency_value;
+    struct betree_frequency_cap frequency_value;
 
     struct value value;
     struct betree_variable* variable;
@@ -91,7 +90,7 @@
 
 %%
 
-program             : EVENT_LCURLY variable_loop EVENT_RCURLY   { root = $2; }
+program             : EVENT_LCURLY variable_loop EVENT_RCURLY   { *root = $2; }
 
 variable_loop       : variable                              { $$ = make_empty_event(); add_variable($1, $$); }
                     | variable_loop EVENT_COMMA variable    { add_variable($3, $1); $$ = $1; }
@@ -182,7 +181,8 @@ int event_parse(const char *text, struct betree_event** event)
     yyscan_t scanner;
     zzlex_init(&scanner);
     YY_BUFFER_STATE buffer = zz_scan_string(text, scanner);
-    int rc = zzparse(scanner);
+    struct betree_event* root = NULL;
+    int rc = zzparse(scanner, &root);
     zz_delete_buffer(buffer, scanner);
     zzlex_destroy(scanner);
     
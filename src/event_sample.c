@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "alloc.h"
+#include "betree.h"
+#include "event_sample.h"
+#include "tree.h"
+
+int event_parse(const char* text, struct betree_event** event);
+
+struct betree_event_sample* betree_make_event_sample(size_t capacity)
+{
+    struct betree_event_sample* sample = bcalloc(sizeof(*sample));
+    if(sample == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    sample->events = bcalloc((capacity == 0 ? 1 : capacity) * sizeof(*sample->events));
+    if(sample->events == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    pthread_mutex_init(&sample->lock, NULL);
+    sample->capacity = capacity;
+    sample->count = 0;
+    sample->seen = 0;
+    sample->random = 0x9e3779b97f4a7c15ULL;
+    return sample;
+}
+
+static void free_sampled_event(struct sampled_event* sampled)
+{
+    free_event(sampled->event);
+    bfree(sampled->preds);
+}
+
+void betree_free_event_sample(struct betree_event_sample* sample)
+{
+    for(size_t i = 0; i < sample->count; i++) {
+        free_sampled_event(&sample->events[i]);
+    }
+    bfree(sample->events);
+    pthread_mutex_destroy(&sample->lock);
+    bfree(sample);
+}
+
+static uint64_t next_random(struct betree_event_sample* sample)
+{
+    // splitmix64
+    uint64_t x = (sample->random += 0x9e3779b97f4a7c15ULL);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+bool betree_sample_event(struct betree_event_sample* sample, const struct betree* tree, const char* event_str)
+{
+    struct betree_event* event;
+    if(event_parse(event_str, &event) != 0) {
+        return false;
+    }
+    fill_event(tree->config, event);
+    sort_event_lists(tree->config, event);
+    struct sampled_event sampled = { .event = event, .pred_count = tree->config->attr_domain_count };
+    sampled.preds = bcalloc((sampled.pred_count == 0 ? 1 : sampled.pred_count) * sizeof(*sampled.preds));
+    if(sampled.preds == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    for(size_t i = 0; i < event->variable_count; i++) {
+        if(event->variables[i] != NULL) {
+            sampled.preds[event->variables[i]->attr_var.var] = event->variables[i];
+        }
+    }
+    pthread_mutex_lock(&sample->lock);
+    sample->seen++;
+    if(sample->count < sample->capacity) {
+        sample->events[sample->count] = sampled;
+        sample->count++;
+    }
+    else {
+        uint64_t slot = next_random(sample) % sample->seen;
+        if(slot < sample->capacity) {
+            free_sampled_event(&sample->events[slot]);
+            sample->events[slot] = sampled;
+        }
+        else {
+            free_sampled_event(&sampled);
+        }
+    }
+    pthread_mutex_unlock(&sample->lock);
+    return true;
+}
+
+const struct betree_variable* sampled_pred(const struct sampled_event* event, betree_var_t var)
+{
+    return var < event->pred_count ? event->preds[var] : NULL;
+}
+
+bool sampled_value_in_bound(const struct betree_variable* pred, const struct value_bound* bound)
+{
+    // Empty lists can still match, like in the search
+    const struct value* value = &pred->value;
+    switch(value->value_type) {
+        case BETREE_BOOLEAN:
+            return bound->bmin <= value->boolean_value && value->boolean_value <= bound->bmax;
+        case BETREE_INTEGER:
+            return bound->imin <= value->integer_value && value->integer_value <= bound->imax;
+        case BETREE_FLOAT:
+            return bound->fmin <= value->float_value && value->float_value <= bound->fmax;
+        case BETREE_STRING:
+            return bound->smin <= value->string_value.str && value->string_value.str <= bound->smax;
+        case BETREE_INTEGER_ENUM:
+            return bound->smin <= value->integer_enum_value.ienum
+                && value->integer_enum_value.ienum <= bound->smax;
+        case BETREE_INTEGER_LIST: {
+            const struct betree_integer_list* list = value->integer_list_value;
+            return list->count == 0 || (list->integers[0] <= bound->imax
+                && bound->imin <= list->integers[list->count - 1]);
+        }
+        case BETREE_STRING_LIST: {
+            const struct betree_string_list* list = value->string_list_value;
+            return list->count == 0 || (list->strings[0].str <= bound->smax
+                && bound->smin <= list->strings[list->count - 1].str);
+        }
+        case BETREE_INTEGER_LIST_ENUM: {
+            const struct betree_integer_enum_list* list = value->integer_enum_list_value;
+            return list->count == 0 || (list->integers[0].ienum <= bound->smax
+                && bound->smin <= list->integers[list->count - 1].ienum);
+        }
+        case BETREE_SEGMENTS:
+        case BETREE_FREQUENCY_CAPS:
+            return true;
+        default: abort();
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "value.h"
+
+struct betree_event;
+struct betree_variable;
+
+/*
+ * Reservoir of the events a tree is searched with. betree_rebalance rebuilds the tree with the
+ * partitions that leave these events the fewest candidates
+ */
+
+struct sampled_event {
+    struct betree_event* event;
+    // Indexed by variable id, for the variables known when it was sampled
+    size_t pred_count;
+    const struct betree_variable** preds;
+};
+
+struct betree_event_sample {
+    pthread_mutex_t lock;
+    size_t capacity;
+    size_t count;
+    // Events offered so far, each ends up kept with probability capacity / seen
+    uint64_t seen;
+    uint64_t random;
+    struct sampled_event* events;
+};
+
+const struct betree_variable* sampled_pred(const struct sampled_event* event, betree_var_t var);
+// Whether a sub with that bound on the variable can match the event, lists when they overlap it or are empty
+bool sampled_value_in_bound(const struct betree_variable* pred, const struct value_bound* bound);
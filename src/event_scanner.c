@@ -0,0 +1,568 @@
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "bitmap.h"
+#include "config.h"
+#include "event_scanner.h"
+#include "tree.h"
+#include "utils.h"
+#include "value.h"
+
+/*
+ * Scratch space is a chain of bump allocated blocks. When an event needed more than one block they are
+ * merged into a single larger one on the next reset, so steady state is one block and no allocation
+ */
+
+struct scratch_block {
+    struct scratch_block* next;
+    size_t size;
+    size_t used;
+    max_align_t data[];
+};
+
+struct event_scratch {
+    struct scratch_block* blocks;
+    // List elements are staged here until the closing bracket gives their count
+    size_t stage_capacity;
+    char* stage;
+};
+
+static const size_t scratch_initial_size = 4096;
+
+static struct scratch_block* make_scratch_block(size_t size, struct scratch_block* next)
+{
+    struct scratch_block* block = bmalloc(sizeof(*block) + size);
+    if(block == NULL) {
+        fprintf(stderr, "%s bmalloc failed\n", __func__);
+        abort();
+    }
+    block->next = next;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+static struct event_scratch* make_event_scratch()
+{
+    struct event_scratch* scratch = bcalloc(sizeof(*scratch));
+    if(scratch == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    scratch->blocks = make_scratch_block(scratch_initial_size, NULL);
+    return scratch;
+}
+
+void free_event_scratch(struct event_scratch* scratch)
+{
+    if(scratch == NULL) {
+        return;
+    }
+    struct scratch_block* block = scratch->blocks;
+    while(block != NULL) {
+        struct scratch_block* next = block->next;
+        bfree(block);
+        block = next;
+    }
+    bfree(scratch->stage);
+    bfree(scratch);
+}
+
+static void reset_event_scratch(struct event_scratch* scratch)
+{
+    if(scratch->blocks->next == NULL) {
+        scratch->blocks->used = 0;
+        return;
+    }
+    size_t size = 0;
+    struct scratch_block* block = scratch->blocks;
+    while(block != NULL) {
+        struct scratch_block* next = block->next;
+        size += block->size;
+        bfree(block);
+        block = next;
+    }
+    scratch->blocks = make_scratch_block(size, NULL);
+}
+
+static void* scratch_alloc(struct event_scratch* scratch, size_t size)
+{
+    size_t aligned = (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+    struct scratch_block* block = scratch->blocks;
+    if(aligned > block->size - block->used) {
+        block = make_scratch_block(smax(block->size * 2, aligned), block);
+        scratch->blocks = block;
+    }
+    void* ptr = (char*)block->data + block->used;
+    block->used += aligned;
+    return ptr;
+}
+
+static void* scratch_calloc(struct event_scratch* scratch, size_t size)
+{
+    void* ptr = scratch_alloc(scratch, size);
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+static void* stage_at(struct event_scratch* scratch, size_t count, size_t element_size)
+{
+    size_t needed = (count + 1) * element_size;
+    if(needed > scratch->stage_capacity) {
+        size_t capacity = smax(needed, scratch->stage_capacity * 2);
+        char* stage = brealloc(scratch->stage, capacity);
+        if(stage == NULL) {
+            fprintf(stderr, "%s brealloc failed\n", __func__);
+            abort();
+        }
+        scratch->stage = stage;
+        scratch->stage_capacity = capacity;
+    }
+    return scratch->stage + count * element_size;
+}
+
+static void* unstage(struct event_scratch* scratch, size_t count, size_t element_size)
+{
+    void* elements = scratch_alloc(scratch, count * element_size);
+    if(count != 0) {
+        memcpy(elements, scratch->stage, count * element_size);
+    }
+    return elements;
+}
+
+struct scanner {
+    const char* p;
+    const struct config* config;
+    struct event_scratch* scratch;
+};
+
+// Same blanks as event_lexer.l
+static void skip_blanks(struct scanner* scanner)
+{
+    while(*scanner->p == ' ' || *scanner->p == '\t' || *scanner->p == '\n') {
+        scanner->p++;
+    }
+}
+
+static bool scan_char(struct scanner* scanner, char c)
+{
+    skip_blanks(scanner);
+    if(*scanner->p != c) {
+        return false;
+    }
+    scanner->p++;
+    return true;
+}
+
+static bool peek_char(struct scanner* scanner, char c)
+{
+    skip_blanks(scanner);
+    return *scanner->p == c;
+}
+
+static bool scan_keyword(struct scanner* scanner, const char* keyword, size_t length)
+{
+    skip_blanks(scanner);
+    if(strncmp(scanner->p, keyword, length) != 0) {
+        return false;
+    }
+    scanner->p += length;
+    return true;
+}
+
+// Escapes are kept as written, like the lexer does
+static const char* scan_string(struct scanner* scanner)
+{
+    skip_blanks(scanner);
+    char quote = *scanner->p;
+    if(quote != '"' && quote != '\'') {
+        return NULL;
+    }
+    const char* start = scanner->p + 1;
+    const char* stops = quote == '"' ? "\"\\" : "'\\";
+    const char* c = start;
+    while(true) {
+        c += strcspn(c, stops);
+        if(*c == '\\' && c[1] != '\0' && c[1] != '\n') {
+            c += 2;
+            continue;
+        }
+        if(*c != quote) {
+            return NULL;
+        }
+        break;
+    }
+    size_t length = c - start;
+    char* string = scratch_alloc(scanner->scratch, length + 1);
+    memcpy(string, start, length);
+    string[length] = '\0';
+    scanner->p = c + 1;
+    return string;
+}
+
+static bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// Integers overflowing int64_t and floats where an integer is expected are left to the bison parser
+static bool scan_integer(struct scanner* scanner, int64_t* integer)
+{
+    bool negative = scan_char(scanner, '-');
+    skip_blanks(scanner);
+    const char* c = scanner->p;
+    if(!is_digit(*c)) {
+        return false;
+    }
+    uint64_t value = 0;
+    for(; is_digit(*c); c++) {
+        uint64_t digit = *c - '0';
+        if(value > (INT64_MAX - digit) / 10) {
+            return false;
+        }
+        value = value * 10 + digit;
+    }
+    if(*c == '.') {
+        return false;
+    }
+    scanner->p = c;
+    *integer = negative ? -(int64_t)value : (int64_t)value;
+    return true;
+}
+
+static bool scan_float(struct scanner* scanner, double* value)
+{
+    bool negative = scan_char(scanner, '-');
+    skip_blanks(scanner);
+    const char* c = scanner->p;
+    if(!is_digit(*c)) {
+        return false;
+    }
+    while(is_digit(*c)) {
+        c++;
+    }
+    if(*c != '.') {
+        return false;
+    }
+    c++;
+    while(is_digit(*c)) {
+        c++;
+    }
+    // strtod would also read exponents the lexer does not know about
+    char number[64];
+    size_t length = c - scanner->p;
+    if(length >= sizeof(number)) {
+        return false;
+    }
+    memcpy(number, scanner->p, length);
+    number[length] = '\0';
+    double parsed = atof(number);
+    scanner->p = c;
+    *value = negative ? -parsed : parsed;
+    return true;
+}
+
+static bool scan_integer_list(struct scanner* scanner, struct betree_integer_list** out)
+{
+    size_t count = 0;
+    if(!scan_char(scanner, '[')) {
+        return false;
+    }
+    if(!peek_char(scanner, ']')) {
+        do {
+            int64_t* integer = stage_at(scanner->scratch, count, sizeof(*integer));
+            if(!scan_integer(scanner, integer)) {
+                return false;
+            }
+            count++;
+        } while(scan_char(scanner, ','));
+    }
+    if(!scan_char(scanner, ']')) {
+        return false;
+    }
+    struct betree_integer_list* list = scratch_alloc(scanner->scratch, sizeof(*list));
+    list->count = count;
+    list->integers = unstage(scanner->scratch, count, sizeof(*list->integers));
+    if(!scanner->config->presorted_lists) {
+        sort_and_remove_duplicate_integer_list(list);
+    }
+    *out = list;
+    return true;
+}
+
+static bool scan_integer_enum_list(
+    struct scanner* scanner, struct attr_var attr_var, struct betree_integer_enum_list** out)
+{
+    size_t count = 0;
+    if(!scan_char(scanner, '[')) {
+        return false;
+    }
+    if(!peek_char(scanner, ']')) {
+        do {
+            struct integer_enum_value* value = stage_at(scanner->scratch, count, sizeof(*value));
+            if(!scan_integer(scanner, &value->integer)) {
+                return false;
+            }
+            value->var = attr_var.var;
+            value->ienum = try_get_id_for_ienum(scanner->config, attr_var, value->integer);
+            count++;
+        } while(scan_char(scanner, ','));
+    }
+    if(!scan_char(scanner, ']')) {
+        return false;
+    }
+    struct betree_integer_enum_list* list = scratch_alloc(scanner->scratch, sizeof(*list));
+    list->count = count;
+    list->integers = unstage(scanner->scratch, count, sizeof(*list->integers));
+    sort_and_remove_duplicate_integer_enum_list(list);
+    *out = list;
+    return true;
+}
+
+static bool scan_string_list(struct scanner* scanner, struct attr_var attr_var, struct betree_string_list** out)
+{
+    size_t count = 0;
+    if(!scan_char(scanner, '[')) {
+        return false;
+    }
+    if(!peek_char(scanner, ']')) {
+        do {
+            const char* string = scan_string(scanner);
+            if(string == NULL) {
+                return false;
+            }
+            struct string_value* value = stage_at(scanner->scratch, count, sizeof(*value));
+            value->string = string;
+            value->var = attr_var.var;
+            value->str = try_get_id_for_string(scanner->config, attr_var, string);
+            count++;
+        } while(scan_char(scanner, ','));
+    }
+    if(!scan_char(scanner, ']')) {
+        return false;
+    }
+    struct betree_string_list* list = scratch_alloc(scanner->scratch, sizeof(*list));
+    list->count = count;
+    list->strings = unstage(scanner->scratch, count, sizeof(*list->strings));
+    sort_string_list(list);
+    // Same as remove_duplicates_string_list, the dropped strings belong to the scratch space
+    size_t r = 0;
+    for(size_t i = 1; i < list->count; i++) {
+        if(list->strings[r].str != list->strings[i].str) {
+            list->strings[++r] = list->strings[i];
+        }
+    }
+    list->count = count == 0 ? 0 : r + 1;
+    list->bitmap = NULL;
+    size_t bitmap_size = list_bitmap_domain(scanner->config->attr_domains[attr_var.var])
+        ? string_list_bitmap_size(list)
+        : 0;
+    if(bitmap_size != 0) {
+        list->bitmap = scratch_alloc(scanner->scratch, bitmap_size);
+        fill_string_list_bitmap(list, list->bitmap);
+    }
+    *out = list;
+    return true;
+}
+
+static bool scan_segments(struct scanner* scanner, struct betree_segments** out)
+{
+    size_t count = 0;
+    if(!scan_char(scanner, '[')) {
+        return false;
+    }
+    if(!peek_char(scanner, ']')) {
+        do {
+            struct betree_segment* segment = stage_at(scanner->scratch, count, sizeof(*segment));
+            if(!scan_char(scanner, '[') || !scan_integer(scanner, &segment->id) || !scan_char(scanner, ',')
+                || !scan_integer(scanner, &segment->timestamp) || !scan_char(scanner, ']')) {
+                return false;
+            }
+            count++;
+        } while(scan_char(scanner, ','));
+    }
+    if(!scan_char(scanner, ']')) {
+        return false;
+    }
+    struct betree_segments* segments = scratch_alloc(scanner->scratch, sizeof(*segments));
+    segments->size = count;
+    segments->capacity = count;
+    segments->content = unstage(scanner->scratch, count, sizeof(*segments->content));
+    if(!scanner->config->presorted_lists) {
+        sort_segments(segments);
+    }
+    *out = segments;
+    return true;
+}
+
+// Either [type, id, namespace, value, timestamp] or [[type, id, namespace], value, timestamp]
+static bool scan_frequency_cap(
+    struct scanner* scanner, struct attr_var attr_var, struct betree_frequency_cap* frequency_cap)
+{
+    if(!scan_char(scanner, '[')) {
+        return false;
+    }
+    bool nested = scan_char(scanner, '[');
+    const char* stype = scan_string(scanner);
+    int64_t id, value, timestamp;
+    if(stype == NULL || !scan_char(scanner, ',') || !scan_integer(scanner, &id) || !scan_char(scanner, ',')) {
+        return false;
+    }
+    const char* namespace = scan_string(scanner);
+    if(namespace == NULL || (nested && !scan_char(scanner, ']')) || !scan_char(scanner, ',')
+        || !scan_integer(scanner, &value) || !scan_char(scanner, ',') || !scan_integer(scanner, &timestamp)
+        || !scan_char(scanner, ']')) {
+        return false;
+    }
+    frequency_cap->type = get_type_from_string(stype);
+    frequency_cap->id = id;
+    frequency_cap->namespace.string = namespace;
+    frequency_cap->namespace.var = attr_var.var;
+    frequency_cap->namespace.str = try_get_id_for_string(scanner->config, attr_var, namespace);
+    frequency_cap->timestamp_defined = true;
+    frequency_cap->timestamp = timestamp;
+    frequency_cap->value = value;
+    return true;
+}
+
+static bool scan_frequency_caps(
+    struct scanner* scanner, struct attr_var attr_var, struct betree_frequency_caps** out)
+{
+    size_t count = 0;
+    if(!scan_char(scanner, '[')) {
+        return false;
+    }
+    if(!peek_char(scanner, ']')) {
+        do {
+            struct betree_frequency_cap* frequency_cap = stage_at(scanner->scratch, count, sizeof(*frequency_cap));
+            if(!scan_frequency_cap(scanner, attr_var, frequency_cap)) {
+                return false;
+            }
+            count++;
+        } while(scan_char(scanner, ','));
+    }
+    if(!scan_char(scanner, ']')) {
+        return false;
+    }
+    struct betree_frequency_caps* frequency_caps = scratch_alloc(scanner->scratch, sizeof(*frequency_caps));
+    frequency_caps->size = count;
+    frequency_caps->capacity = count;
+    frequency_caps->content = unstage(scanner->scratch, count, sizeof(*frequency_caps->content));
+    frequency_caps->slot_count = frequency_caps_slot_count(count);
+    frequency_caps->slots = NULL;
+    if(frequency_caps->slot_count != 0) {
+        frequency_caps->slots
+            = scratch_alloc(scanner->scratch, frequency_caps->slot_count * sizeof(*frequency_caps->slots));
+        fill_frequency_caps_slots(frequency_caps);
+    }
+    *out = frequency_caps;
+    return true;
+}
+
+// The value is read as the type declared for the variable
+static bool scan_value(struct scanner* scanner, const struct attr_domain* attr_domain, struct value* value)
+{
+    struct attr_var attr_var = attr_domain->attr_var;
+    value->value_type = attr_domain->bound.value_type;
+    switch(value->value_type) {
+        case BETREE_BOOLEAN:
+            if(scan_keyword(scanner, "true", 4)) {
+                value->boolean_value = true;
+                return true;
+            }
+            value->boolean_value = false;
+            return scan_keyword(scanner, "false", 5);
+        case BETREE_INTEGER:
+            return scan_integer(scanner, &value->integer_value);
+        case BETREE_FLOAT:
+            return scan_float(scanner, &value->float_value);
+        case BETREE_STRING: {
+            const char* string = scan_string(scanner);
+            if(string == NULL) {
+                return false;
+            }
+            value->string_value.string = string;
+            value->string_value.var = attr_var.var;
+            value->string_value.str = try_get_id_for_string(scanner->config, attr_var, string);
+            return true;
+        }
+        case BETREE_INTEGER_ENUM:
+            if(!scan_integer(scanner, &value->integer_enum_value.integer)) {
+                return false;
+            }
+            value->integer_enum_value.var = attr_var.var;
+            value->integer_enum_value.ienum
+                = try_get_id_for_ienum(scanner->config, attr_var, value->integer_enum_value.integer);
+            return true;
+        case BETREE_INTEGER_LIST:
+            return scan_integer_list(scanner, &value->integer_list_value);
+        case BETREE_STRING_LIST:
+            return scan_string_list(scanner, attr_var, &value->string_list_value);
+        case BETREE_INTEGER_LIST_ENUM:
+            return scan_integer_enum_list(scanner, attr_var, &value->integer_enum_list_value);
+        case BETREE_SEGMENTS:
+            return scan_segments(scanner, &value->segments_value);
+        case BETREE_FREQUENCY_CAPS:
+            return scan_frequency_caps(scanner, attr_var, &value->frequency_caps_value);
+        default: abort();
+    }
+}
+
+static bool scan_variable(struct scanner* scanner, struct betree_event* event)
+{
+    const char* attr = scan_string(scanner);
+    if(attr == NULL || !scan_char(scanner, ':')) {
+        return false;
+    }
+    if(scan_keyword(scanner, "null", 4)) {
+        return true;
+    }
+    // Unknown attributes abort in fill_event, the bison path keeps that behavior
+    betree_var_t var = try_get_id_for_attr(scanner->config, attr);
+    if(var == INVALID_VAR) {
+        return false;
+    }
+    const struct attr_domain* attr_domain = scanner->config->attr_domains[var];
+    struct betree_variable* variable = scratch_alloc(scanner->scratch, sizeof(*variable));
+    variable->attr_var = attr_domain->attr_var;
+    if(!scan_value(scanner, attr_domain, &variable->value)) {
+        return false;
+    }
+    event->variables[var] = variable;
+    return true;
+}
+
+struct betree_event* scan_event(
+    const struct config* config, const char* text, struct betree_search_context* context)
+{
+    if(context->scratch == NULL) {
+        context->scratch = make_event_scratch();
+    }
+    reset_event_scratch(context->scratch);
+    struct scanner scanner = { .p = text, .config = config, .scratch = context->scratch };
+
+    // Variables are indexed by id, a repeated attribute keeps its last value as with the bison parser
+    struct betree_event* event = scratch_alloc(scanner.scratch, sizeof(*event));
+    event->variable_count = config->attr_domain_count;
+    event->variables = scratch_calloc(scanner.scratch, smax(1, config->attr_domain_count) * sizeof(*event->variables));
+    if(!scan_char(&scanner, '{')) {
+        return NULL;
+    }
+    do {
+        if(!scan_variable(&scanner, event)) {
+            return NULL;
+        }
+    } while(scan_char(&scanner, ','));
+    if(!scan_char(&scanner, '}')) {
+        return NULL;
+    }
+    skip_blanks(&scanner);
+    if(*scanner.p != '\0') {
+        return NULL;
+    }
+    return event;
+}
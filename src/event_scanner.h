@@ -0,0 +1,12 @@
+#pragma once
+
+struct betree_event;
+struct betree_search_context;
+struct config;
+struct event_scratch;
+
+// Reads an event in one pass, resolving attributes, strings and enums against the config and sorting lists.
+// The event lives in the context scratch space until the next scan with the same context and must not be freed.
+// Returns NULL for anything the bison parser in event_parser.y would read differently, callers fall back to it
+struct betree_event* scan_event(const struct config* config, const char* text, struct betree_search_context* context);
+void free_event_scratch(struct event_scratch* scratch);
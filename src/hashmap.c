@@ -1,55 +1,188 @@
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "alloc.h"
 #include "ast.h"
 #include "ast_compare.h"
-#include "clone.h"
 #include "hashmap.h"
-#include "jsw_rbtree.h"
-#include "map.h"
-#include "printer.h"
+#include "string_matcher.h"
 #include "utils.h"
 
-void assign_pred(struct pred_map* pred_map, struct ast_node* node)
+static size_t slot_mask(const struct pred_map* pred_map)
+{
+    return pred_map->slot_count - 1;
+}
+
+static struct ast_node* find_slot(const struct pred_map* pred_map, const struct ast_node* node)
+{
+    if(pred_map->slot_count == 0) {
+        return NULL;
+    }
+    size_t mask = slot_mask(pred_map);
+    for(size_t i = node->hash & mask;; i = (i + 1) & mask) {
+        struct ast_node* slot = pred_map->slots[i];
+        if(slot == NULL) {
+            return NULL;
+        }
+        // The comparison only runs on a full hash match
+        if(slot->hash == node->hash && expr_cmp(slot, node) == 0) {
+            return slot;
+        }
+    }
+}
+
+static void place_slot(struct pred_map* pred_map, struct ast_node* node)
+{
+    size_t mask = slot_mask(pred_map);
+    size_t i = node->hash & mask;
+    while(pred_map->slots[i] != NULL) {
+        i = (i + 1) & mask;
+    }
+    pred_map->slots[i] = node;
+}
+
+static void insert_slot(struct pred_map* pred_map, struct ast_node* node)
+{
+    // At most half full
+    if((pred_map->node_count + 1) * 2 > pred_map->slot_count) {
+        struct ast_node** old = pred_map->slots;
+        size_t old_count = pred_map->slot_count;
+        pred_map->slot_count = old_count == 0 ? 64 : old_count * 2;
+        pred_map->slots = bcalloc(pred_map->slot_count * sizeof(*pred_map->slots));
+        if(pred_map->slots == NULL) {
+            fprintf(stderr, "%s bcalloc failed\n", __func__);
+            abort();
+        }
+        for(size_t i = 0; i < old_count; i++) {
+            if(old[i] != NULL) {
+                place_slot(pred_map, old[i]);
+            }
+        }
+        bfree(old);
+    }
+    place_slot(pred_map, node);
+    pred_map->node_count++;
+}
+
+static void erase_slot(struct pred_map* pred_map, const struct ast_node* node)
+{
+    size_t mask = slot_mask(pred_map);
+    size_t i = node->hash & mask;
+    while(pred_map->slots[i] != node) {
+        if(pred_map->slots[i] == NULL) {
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+    // Backward shift, so lookups never need tombstones
+    for(size_t j = (i + 1) & mask; pred_map->slots[j] != NULL; j = (j + 1) & mask) {
+        size_t home = pred_map->slots[j]->hash & mask;
+        bool movable = i <= j ? (home <= i || home > j) : (home <= i && home > j);
+        if(movable) {
+            pred_map->slots[i] = pred_map->slots[j];
+            i = j;
+        }
+    }
+    pred_map->slots[i] = NULL;
+    pred_map->node_count--;
+}
+
+bool is_pred_in_map(const struct pred_map* pred_map, const struct ast_node* node)
+{
+    return find_slot(pred_map, node) == node;
+}
+
+struct ast_node* find_pred(const struct pred_map* pred_map, struct ast_node* node)
+{
+    node->hash = expr_hash(node);
+    return find_slot(pred_map, node);
+}
+
+static bool is_string_pattern(const struct ast_node* node)
+{
+    return node->type == AST_TYPE_SPECIAL_EXPR && node->special_expr.type == AST_SPECIAL_STRING;
+}
+
+// String predicates always get a memoize_id, the string matchers write their results there
+static void add_pattern(struct pred_map* pred_map, struct ast_node* node)
+{
+    if(!is_string_pattern(node)) {
+        return;
+    }
+    if(node->memoize_id == INVALID_PRED) {
+        set_memoize_id(node, pred_map->memoize_count);
+        pred_map->memoize_count++;
+    }
+    add_string_pattern(pred_map->strings, node);
+}
+
+void insert_pred(struct pred_map* pred_map, struct ast_node* node)
+{
+    node->hash = expr_hash(node);
+    insert_slot(pred_map, node);
+    add_pattern(pred_map, node);
+}
+
+struct ast_node* assign_pred(struct pred_map* pred_map, struct ast_node* node)
 {
     if(node->type == AST_TYPE_BOOL_EXPR && node->bool_expr.op == AST_BOOL_NOT) {
-        assign_pred(pred_map, node->bool_expr.unary.expr);
+        node->bool_expr.unary.expr = assign_pred(pred_map, node->bool_expr.unary.expr);
     }
     else if (node->type == AST_TYPE_BOOL_EXPR && node->bool_expr.op == AST_BOOL_OR) {
-        assign_pred(pred_map, node->bool_expr.binary.lhs);
-        assign_pred(pred_map, node->bool_expr.binary.rhs);
+        node->bool_expr.binary.lhs = assign_pred(pred_map, node->bool_expr.binary.lhs);
+        node->bool_expr.binary.rhs = assign_pred(pred_map, node->bool_expr.binary.rhs);
     }
     else if (node->type == AST_TYPE_BOOL_EXPR && node->bool_expr.op == AST_BOOL_AND) {
-        assign_pred(pred_map, node->bool_expr.binary.lhs);
-        assign_pred(pred_map, node->bool_expr.binary.rhs);
+        node->bool_expr.binary.lhs = assign_pred(pred_map, node->bool_expr.binary.lhs);
+        node->bool_expr.binary.rhs = assign_pred(pred_map, node->bool_expr.binary.rhs);
     }
-    struct ast_node* find = jsw_rbfind(pred_map->m, node);
+    // Children are already shared, so equal composite nodes compare equal on their ids
+    struct ast_node* find = find_pred(pred_map, node);
     if(find == NULL) {
         betree_pred_t global_id = pred_map->pred_count;
         pred_map->pred_count++;
         node->global_id = global_id;
-        int ret = jsw_rbinsert(pred_map->m, node);
-        if(ret == 0) {
-            abort();
-        }
+        insert_slot(pred_map, node);
+        add_pattern(pred_map, node);
+        return node;
     }
-    else {
-        node->global_id = find->global_id;
-        if(find->memoize_id == INVALID_PRED) {
-            betree_pred_t memoize_id = pred_map->memoize_count;
-            pred_map->memoize_count++;
-            find->memoize_id = memoize_id;
-        }
-        node->memoize_id = find->memoize_id;
+    if(find == node) {
+        return node;
+    }
+    if(find->memoize_id == INVALID_PRED) {
+        betree_pred_t memoize_id = pred_map->memoize_count;
+        pred_map->memoize_count++;
+        set_memoize_id(find, memoize_id);
     }
+    find->ref_count++;
+    free_ast_node(node);
+    return find;
 }
 
-static struct jsw_rbtree* exprmap_new()
+void remove_pred(struct pred_map* pred_map, struct ast_node* node)
 {
-    struct jsw_rbtree* rbtree;
-    rbtree = jsw_rbnew(expr_cmp);
-
-    return rbtree;
+    // Still used by another sub, so is everything below it
+    if(node->ref_count > 1) {
+        node->ref_count--;
+        return;
+    }
+    // Erased while its children are alive, the map compares composite nodes on them
+    erase_slot(pred_map, node);
+    if(is_string_pattern(node)) {
+        remove_string_pattern(pred_map->strings, node);
+    }
+    if(node->type == AST_TYPE_BOOL_EXPR && node->bool_expr.op == AST_BOOL_NOT) {
+        remove_pred(pred_map, node->bool_expr.unary.expr);
+        node->bool_expr.unary.expr = NULL;
+    }
+    else if (node->type == AST_TYPE_BOOL_EXPR
+        && (node->bool_expr.op == AST_BOOL_OR || node->bool_expr.op == AST_BOOL_AND)) {
+        remove_pred(pred_map, node->bool_expr.binary.lhs);
+        remove_pred(pred_map, node->bool_expr.binary.rhs);
+        node->bool_expr.binary.lhs = NULL;
+        node->bool_expr.binary.rhs = NULL;
+    }
+    free_ast_node(node);
 }
 
 struct pred_map* make_pred_map()
@@ -60,14 +193,16 @@ struct pred_map* make_pred_map()
         abort();
     }
     pred_map->pred_count = 0;
-    pred_map->m = exprmap_new();
+    pred_map->slot_count = 0;
+    pred_map->node_count = 0;
+    pred_map->slots = NULL;
+    pred_map->strings = make_string_patterns();
     return pred_map;
 }
 
 void free_pred_map(struct pred_map* pred_map)
 {
-    jsw_rbdelete(pred_map->m);
+    bfree(pred_map->slots);
+    free_string_patterns(pred_map->strings);
     bfree(pred_map);
 }
-
-
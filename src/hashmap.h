@@ -1,19 +1,32 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
 
-#include "jsw_rbtree.h"
 #include "memoize.h"
 
 struct ast_node;
+struct string_patterns;
 
 struct pred_map {
     betree_pred_t pred_count;
     betree_pred_t memoize_count;
-    struct jsw_rbtree* m;
+    // Open addressing over the hash cached on each node, NULL when empty
+    size_t slot_count;
+    size_t node_count;
+    struct ast_node** slots;
+    // The contains, starts_with and ends_with nodes of the map, each with a memoize_id
+    struct string_patterns* strings;
 };
 
-void assign_pred(struct pred_map* pred_map, struct ast_node* node);
+// Hash-consing: node and its subtrees are replaced by the equal nodes already in the map, which gain a reference
+struct ast_node* assign_pred(struct pred_map* pred_map, struct ast_node* node);
+// Drops a reference to node, what is left unused is erased from the map and freed
+void remove_pred(struct pred_map* pred_map, struct ast_node* node);
+// Only the snapshot reader adds nodes without assign_pred, their ids are already set
+struct ast_node* find_pred(const struct pred_map* pred_map, struct ast_node* node);
+void insert_pred(struct pred_map* pred_map, struct ast_node* node);
+bool is_pred_in_map(const struct pred_map* pred_map, const struct ast_node* node);
 struct pred_map* make_pred_map();
 void free_pred_map(struct pred_map* pred_map);
 
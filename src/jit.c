@@ -0,0 +1,326 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(BETREE_JIT) && defined(__x86_64__)
+#define JIT_X86_64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "alloc.h"
+#include "ast.h"
+#include "jit.h"
+#include "tree.h"
+
+#ifdef JIT_X86_64
+
+struct jit_function {
+    size_t size;
+    uint8_t code[];
+};
+
+struct jit_buffer {
+    size_t count;
+    size_t capacity;
+    uint8_t* bytes;
+};
+
+static void emit(struct jit_buffer* buffer, const uint8_t* bytes, size_t count)
+{
+    if(buffer->count + count > buffer->capacity) {
+        size_t capacity = buffer->capacity == 0 ? 256 : buffer->capacity;
+        while(capacity < buffer->count + count) {
+            capacity *= 2;
+        }
+        uint8_t* grown = brealloc(buffer->bytes, capacity);
+        if(grown == NULL) {
+            fprintf(stderr, "%s brealloc failed\n", __func__);
+            abort();
+        }
+        buffer->bytes = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->bytes + buffer->count, bytes, count);
+    buffer->count += count;
+}
+
+#define EMIT(buffer, ...)                                         \
+    do {                                                          \
+        const uint8_t emitted[] = { __VA_ARGS__ };                \
+        emit((buffer), emitted, sizeof(emitted));                 \
+    } while(0)
+
+static void emit_u32(struct jit_buffer* buffer, uint32_t value)
+{
+    emit(buffer, (const uint8_t*)&value, sizeof(value));
+}
+
+static void emit_u64(struct jit_buffer* buffer, uint64_t value)
+{
+    emit(buffer, (const uint8_t*)&value, sizeof(value));
+}
+
+// Jump with a rel32 to fill in once the target is known, returns where the rel32 is
+static size_t emit_jump(struct jit_buffer* buffer, const uint8_t* opcode, size_t count)
+{
+    emit(buffer, opcode, count);
+    size_t at = buffer->count;
+    emit_u32(buffer, 0);
+    return at;
+}
+
+static void land_jump(struct jit_buffer* buffer, size_t at)
+{
+    uint32_t relative = (uint32_t)(buffer->count - (at + 4));
+    memcpy(buffer->bytes + at, &relative, sizeof(relative));
+}
+
+static const uint8_t jz[] = { 0x0f, 0x84 };
+static const uint8_t jnz[] = { 0x0f, 0x85 };
+static const uint8_t jmp[] = { 0xe9 };
+
+// rax = preds[var], eax = 0 when it is NULL. Returns the jump taken then
+static size_t emit_load_pred(struct jit_buffer* buffer, betree_var_t var)
+{
+    // mov rax, [rbx + var * 8]; test rax, rax
+    EMIT(buffer, 0x48, 0x8b, 0x83);
+    emit_u32(buffer, (uint32_t)(var * sizeof(struct betree_variable*)));
+    EMIT(buffer, 0x48, 0x85, 0xc0);
+    return emit_jump(buffer, jz, sizeof(jz));
+}
+
+static void emit_undefined_is_false(struct jit_buffer* buffer, size_t undefined)
+{
+    size_t done = emit_jump(buffer, jmp, sizeof(jmp));
+    land_jump(buffer, undefined);
+    // xor eax, eax
+    EMIT(buffer, 0x31, 0xc0);
+    land_jump(buffer, done);
+}
+
+// The variable's 64 bits at offset compared to value, setcc is the second byte of the setcc opcode
+static void emit_compare(struct jit_buffer* buffer, betree_var_t var, size_t offset, uint64_t value, uint8_t setcc)
+{
+    size_t undefined = emit_load_pred(buffer, var);
+    // mov rax, [rax + offset]; mov rcx, value; cmp rax, rcx; setcc al; movzx eax, al
+    EMIT(buffer, 0x48, 0x8b, 0x80);
+    emit_u32(buffer, (uint32_t)offset);
+    EMIT(buffer, 0x48, 0xb9);
+    emit_u64(buffer, value);
+    EMIT(buffer, 0x48, 0x39, 0xc8, 0x0f, setcc, 0xc0, 0x0f, 0xb6, 0xc0);
+    emit_undefined_is_false(buffer, undefined);
+}
+
+static void emit_bool_variable(struct jit_buffer* buffer, betree_var_t var)
+{
+    size_t undefined = emit_load_pred(buffer, var);
+    // movzx eax, byte [rax + offset]
+    EMIT(buffer, 0x0f, 0xb6, 0x80);
+    emit_u32(buffer, (uint32_t)offsetof(struct betree_variable, value.boolean_value));
+    emit_undefined_is_false(buffer, undefined);
+}
+
+static void emit_leaf_call(struct jit_buffer* buffer, const struct ast_node* node)
+{
+    bool (*leaf)(const struct betree_variable**, const struct ast_node*) = match_leaf_node;
+    // mov rdi, rbx; mov rsi, node; mov rax, match_leaf_node; call rax; movzx eax, al
+    EMIT(buffer, 0x48, 0x89, 0xdf, 0x48, 0xbe);
+    emit_u64(buffer, (uint64_t)(uintptr_t)node);
+    EMIT(buffer, 0x48, 0xb8);
+    emit_u64(buffer, (uint64_t)(uintptr_t)leaf);
+    EMIT(buffer, 0xff, 0xd0, 0x0f, 0xb6, 0xc0);
+}
+
+// Offsets past a 32 bits displacement go through match_leaf_node
+static bool fits_displacement(betree_var_t var)
+{
+    return var <= INT32_MAX / sizeof(struct betree_variable*);
+}
+
+static bool emit_compare_expr(struct jit_buffer* buffer, const struct ast_compare_expr* expr)
+{
+    if(expr->value.value_type != AST_COMPARE_VALUE_INTEGER || !fits_displacement(expr->attr_var.var)) {
+        return false;
+    }
+    uint8_t setcc;
+    switch(expr->op) {
+        case AST_COMPARE_LT: setcc = 0x9c; break;
+        case AST_COMPARE_LE: setcc = 0x9e; break;
+        case AST_COMPARE_GT: setcc = 0x9f; break;
+        case AST_COMPARE_GE: setcc = 0x9d; break;
+        default: abort();
+    }
+    emit_compare(buffer, expr->attr_var.var, offsetof(struct betree_variable, value.integer_value),
+        (uint64_t)expr->value.integer_value, setcc);
+    return true;
+}
+
+static bool emit_equality_expr(struct jit_buffer* buffer, const struct ast_equality_expr* expr)
+{
+    if(!fits_displacement(expr->attr_var.var)) {
+        return false;
+    }
+    uint8_t setcc = expr->op == AST_EQUALITY_EQ ? 0x94 : 0x95;
+    size_t offset;
+    uint64_t value;
+    switch(expr->value.value_type) {
+        case AST_EQUALITY_VALUE_INTEGER:
+            offset = offsetof(struct betree_variable, value.integer_value);
+            value = (uint64_t)expr->value.integer_value;
+            break;
+        case AST_EQUALITY_VALUE_STRING:
+            offset = offsetof(struct betree_variable, value.string_value.str);
+            value = expr->value.string_value.str;
+            break;
+        case AST_EQUALITY_VALUE_INTEGER_ENUM:
+            offset = offsetof(struct betree_variable, value.integer_enum_value.ienum);
+            value = expr->value.integer_enum_value.ienum;
+            break;
+        case AST_EQUALITY_VALUE_FLOAT:
+            return false;
+        default: abort();
+    }
+    emit_compare(buffer, expr->attr_var.var, offset, value, setcc);
+    return true;
+}
+
+// Leaves eax at 0 or 1
+static void emit_node(struct jit_buffer* buffer, const struct ast_node* node)
+{
+    switch(node->type) {
+        case AST_TYPE_BOOL_EXPR:
+            switch(node->bool_expr.op) {
+                case AST_BOOL_AND:
+                case AST_BOOL_OR: {
+                    emit_node(buffer, node->bool_expr.binary.lhs);
+                    // test eax, eax
+                    EMIT(buffer, 0x85, 0xc0);
+                    size_t done = node->bool_expr.op == AST_BOOL_AND ? emit_jump(buffer, jz, sizeof(jz))
+                                                                     : emit_jump(buffer, jnz, sizeof(jnz));
+                    emit_node(buffer, node->bool_expr.binary.rhs);
+                    land_jump(buffer, done);
+                    return;
+                }
+                case AST_BOOL_NOT:
+                    emit_node(buffer, node->bool_expr.unary.expr);
+                    // xor eax, 1
+                    EMIT(buffer, 0x83, 0xf0, 0x01);
+                    return;
+                case AST_BOOL_VARIABLE:
+                    if(fits_displacement(node->bool_expr.variable.var)) {
+                        emit_bool_variable(buffer, node->bool_expr.variable.var);
+                        return;
+                    }
+                    break;
+                case AST_BOOL_LITERAL:
+                    // mov eax, literal
+                    EMIT(buffer, 0xb8);
+                    emit_u32(buffer, node->bool_expr.literal ? 1 : 0);
+                    return;
+                default: abort();
+            }
+            break;
+        case AST_TYPE_COMPARE_EXPR:
+            if(emit_compare_expr(buffer, &node->compare_expr)) {
+                return;
+            }
+            break;
+        case AST_TYPE_EQUALITY_EXPR:
+            if(emit_equality_expr(buffer, &node->equality_expr)) {
+                return;
+            }
+            break;
+        case AST_TYPE_SET_EXPR:
+        case AST_TYPE_LIST_EXPR:
+        case AST_TYPE_SPECIAL_EXPR:
+        case AST_TYPE_IS_NULL_EXPR:
+            break;
+        default: abort();
+    }
+    emit_leaf_call(buffer, node);
+}
+
+bool jit_supported(void)
+{
+    return true;
+}
+
+struct jit_function* jit_compile(const struct ast_node* expr)
+{
+    struct jit_buffer buffer = { .count = 0, .capacity = 0, .bytes = NULL };
+    // push rbx; mov rbx, rdi, preds stay in rbx across the calls
+    EMIT(&buffer, 0x53, 0x48, 0x89, 0xfb);
+    emit_node(&buffer, expr);
+    // pop rbx; ret
+    EMIT(&buffer, 0x5b, 0xc3);
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t size = (sizeof(struct jit_function) + buffer.count + page - 1) / page * page;
+    void* mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mapped == MAP_FAILED) {
+        bfree(buffer.bytes);
+        return NULL;
+    }
+    struct jit_function* function = mapped;
+    function->size = size;
+    memcpy(function->code, buffer.bytes, buffer.count);
+    bfree(buffer.bytes);
+    // Never writable and executable at once
+    if(mprotect(mapped, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mapped, size);
+        return NULL;
+    }
+    return function;
+}
+
+void jit_free(struct jit_function* function)
+{
+    if(function != NULL) {
+        munmap(function, function->size);
+    }
+}
+
+bool jit_run(const struct jit_function* function, const struct betree_variable** preds)
+{
+    bool (*entry)(const struct betree_variable**) = (bool (*)(const struct betree_variable**))(uintptr_t)function->code;
+    return entry(preds);
+}
+
+size_t jit_size(const struct jit_function* function)
+{
+    return function == NULL ? 0 : function->size;
+}
+
+#else
+
+bool jit_supported(void)
+{
+    return false;
+}
+
+struct jit_function* jit_compile(const struct ast_node* expr)
+{
+    (void)expr;
+    return NULL;
+}
+
+void jit_free(struct jit_function* function)
+{
+    (void)function;
+}
+
+bool jit_run(const struct jit_function* function, const struct betree_variable** preds)
+{
+    (void)function;
+    (void)preds;
+    abort();
+}
+
+size_t jit_size(const struct jit_function* function)
+{
+    (void)function;
+    return 0;
+}
+
+#endif
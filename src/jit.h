@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct ast_node;
+struct betree_variable;
+
+/*
+ * Native tier for hot subs, built with JIT=1 (BETREE_JIT) and only emitting x86-64. An expression is
+ * compiled into one function with the variable offsets and constants of its integer, string and
+ * integer enum comparisons burned in. AND, OR and NOT become jumps, other leaves call back into
+ * match_leaf_node. Memoization is skipped, the function always works the expression out itself
+ */
+
+struct jit_function;
+
+// False when this build or CPU has no native tier
+bool jit_supported(void);
+// NULL when the tier isn't supported, expr must outlive the function
+struct jit_function* jit_compile(const struct ast_node* expr);
+void jit_free(struct jit_function* function);
+bool jit_run(const struct jit_function* function, const struct betree_variable** preds);
+// Bytes mapped for the function
+size_t jit_size(const struct jit_function* function);
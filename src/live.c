@@ -0,0 +1,320 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "activation.h"
+#include "alloc.h"
+#include "ast.h"
+#include "betree.h"
+#include "clone.h"
+#include "config.h"
+#include "event_sample.h"
+#include "sub_index.h"
+#include "tree.h"
+#include "utils.h"
+
+/*
+ * Readers publish the epoch they pinned at, writers swap the current version and retire the old one
+ * tagged with the epoch of the swap. A retired version is freed once every pinned reader is past it
+ */
+
+static const uint64_t LIVE_IDLE = UINT64_MAX;
+
+struct live_version {
+    struct betree* tree;
+    uint64_t number;
+    uint64_t retired_epoch;
+    struct live_version* next_retired;
+};
+
+struct betree_live_reader {
+    struct betree_live* live;
+    _Atomic uint64_t epoch;
+    struct live_version* pinned;
+    // Search contexts are sized for one version, it is rebuilt when the version changes
+    struct betree_search_context* context;
+    uint64_t context_version;
+    struct betree_live_reader* next;
+};
+
+struct betree_live {
+    _Atomic(struct live_version*) current;
+    _Atomic uint64_t epoch;
+    // Everything below is only touched with the lock held
+    pthread_mutex_t lock;
+    uint64_t version_count;
+    struct betree_live_reader* readers;
+    struct live_version* retired;
+};
+
+static struct live_version* make_live_version(struct betree* tree, uint64_t number)
+{
+    struct live_version* version = bcalloc(sizeof(*version));
+    if(version == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    version->tree = tree;
+    version->number = number;
+    version->retired_epoch = 0;
+    version->next_retired = NULL;
+    return version;
+}
+
+static void free_live_version(struct live_version* version)
+{
+    betree_free(version->tree);
+    bfree(version);
+}
+
+struct betree_live* betree_live_make(struct betree* tree)
+{
+    struct betree_live* live = bcalloc(sizeof(*live));
+    if(live == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    pthread_mutex_init(&live->lock, NULL);
+    betree_pack(tree);
+    live->version_count = 1;
+    atomic_init(&live->current, make_live_version(tree, 0));
+    atomic_init(&live->epoch, 0);
+    live->readers = NULL;
+    live->retired = NULL;
+    return live;
+}
+
+void betree_live_free(struct betree_live* live)
+{
+    while(live->readers != NULL) {
+        struct betree_live_reader* reader = live->readers;
+        live->readers = reader->next;
+        if(reader->context != NULL) {
+            betree_free_search_context(reader->context);
+        }
+        bfree(reader);
+    }
+    while(live->retired != NULL) {
+        struct live_version* version = live->retired;
+        live->retired = version->next_retired;
+        free_live_version(version);
+    }
+    free_live_version(atomic_load(&live->current));
+    pthread_mutex_destroy(&live->lock);
+    bfree(live);
+}
+
+struct betree_live_reader* betree_live_register(struct betree_live* live)
+{
+    struct betree_live_reader* reader = bcalloc(sizeof(*reader));
+    if(reader == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    reader->live = live;
+    atomic_init(&reader->epoch, LIVE_IDLE);
+    reader->pinned = NULL;
+    reader->context = NULL;
+    pthread_mutex_lock(&live->lock);
+    reader->next = live->readers;
+    live->readers = reader;
+    pthread_mutex_unlock(&live->lock);
+    return reader;
+}
+
+void betree_live_unregister(struct betree_live_reader* reader)
+{
+    struct betree_live* live = reader->live;
+    pthread_mutex_lock(&live->lock);
+    struct betree_live_reader** link = &live->readers;
+    while(*link != reader) {
+        link = &(*link)->next;
+    }
+    *link = reader->next;
+    pthread_mutex_unlock(&live->lock);
+    if(reader->context != NULL) {
+        betree_free_search_context(reader->context);
+    }
+    bfree(reader);
+}
+
+const struct betree* betree_live_pin(struct betree_live_reader* reader)
+{
+    struct betree_live* live = reader->live;
+    // The epoch has to be visible before the version is read, both are sequentially consistent
+    atomic_store(&reader->epoch, atomic_load(&live->epoch));
+    reader->pinned = atomic_load(&live->current);
+    return reader->pinned->tree;
+}
+
+void betree_live_unpin(struct betree_live_reader* reader)
+{
+    reader->pinned = NULL;
+    atomic_store(&reader->epoch, LIVE_IDLE);
+}
+
+bool betree_live_search(struct betree_live_reader* reader, const char* event, struct report* report)
+{
+    const struct betree* tree = betree_live_pin(reader);
+    if(reader->context == NULL || reader->context_version != reader->pinned->number) {
+        if(reader->context != NULL) {
+            betree_free_search_context(reader->context);
+        }
+        reader->context = betree_make_search_context(tree);
+        reader->context_version = reader->pinned->number;
+    }
+    bool result = betree_search_with_context(tree, event, report, reader->context);
+    betree_live_unpin(reader);
+    return result;
+}
+
+static void reclaim_versions(struct betree_live* live)
+{
+    uint64_t oldest = LIVE_IDLE;
+    for(struct betree_live_reader* reader = live->readers; reader != NULL; reader = reader->next) {
+        uint64_t epoch = atomic_load(&reader->epoch);
+        if(epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+    struct live_version** link = &live->retired;
+    while(*link != NULL) {
+        struct live_version* version = *link;
+        // A reader pinned at the retire epoch or before may still hold it
+        if(version->retired_epoch < oldest) {
+            *link = version->next_retired;
+            free_live_version(version);
+        }
+        else {
+            link = &version->next_retired;
+        }
+    }
+}
+
+void betree_live_reclaim(struct betree_live* live)
+{
+    pthread_mutex_lock(&live->lock);
+    reclaim_versions(live);
+    pthread_mutex_unlock(&live->lock);
+}
+
+static void reset_pred_ids(struct ast_node* node)
+{
+    node->global_id = INVALID_PRED;
+    node->memoize_id = INVALID_PRED;
+    if(node->type != AST_TYPE_BOOL_EXPR) {
+        return;
+    }
+    switch(node->bool_expr.op) {
+        case AST_BOOL_AND:
+        case AST_BOOL_OR:
+            reset_pred_ids(node->bool_expr.binary.lhs);
+            reset_pred_ids(node->bool_expr.binary.rhs);
+            break;
+        case AST_BOOL_NOT:
+            reset_pred_ids(node->bool_expr.unary.expr);
+            break;
+        case AST_BOOL_VARIABLE:
+        case AST_BOOL_LITERAL:
+            break;
+        default: abort();
+    }
+}
+
+// Same config and subs, the tree is rebuilt in one pass with the bulk loader, scored on the sample if any
+static struct betree* clone_betree(const struct betree* tree, const struct betree_event_sample* sample)
+{
+    struct betree* clone = bcalloc(sizeof(*clone));
+    if(clone == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    clone->arena = make_arena_like(tree->arena);
+    struct arena* previous = set_current_arena(clone->arena);
+    clone->config = clone_config(tree->config);
+    clone->cnode = make_cnode(clone->config, NULL);
+    clone->sub_index = make_sub_index();
+
+    size_t count = 0;
+    collect_subs(tree->cnode, NULL, &count);
+    struct betree_sub** subs = bcalloc(smax(1, count) * sizeof(*subs));
+    if(subs == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    count = 0;
+    collect_subs(tree->cnode, subs, &count);
+    for(size_t i = 0; i < count; i++) {
+        struct ast_node* node = clone_node(subs[i]->expr);
+        reset_pred_ids(node);
+        node = assign_pred_id(clone->config, node);
+        struct betree_sub* orig = subs[i];
+        subs[i] = make_sub(clone->config, orig->id, node);
+        subs[i]->priority = orig->priority;
+        subs[i]->window_start = orig->window_start;
+        subs[i]->window_end = orig->window_end;
+    }
+    clone->config->event_sample = sample;
+    if(count != 0) {
+        insert_be_tree_all(clone->config, subs, count, clone->cnode);
+    }
+    clone->config->event_sample = NULL;
+    for(size_t i = 0; i < count; i++) {
+        sub_index_add(clone->sub_index, subs[i]);
+        schedule_activation(clone->config->activation, subs[i]);
+    }
+    bfree(subs);
+    set_current_arena(previous);
+    return clone;
+}
+
+// Called with the lock held
+static void publish_version(struct betree_live* live, struct betree* next)
+{
+    // Versions no longer change once published
+    betree_pack(next);
+    struct live_version* version = make_live_version(next, live->version_count++);
+    struct live_version* old = atomic_exchange(&live->current, version);
+    old->retired_epoch = atomic_fetch_add(&live->epoch, 1);
+    old->next_retired = live->retired;
+    live->retired = old;
+    reclaim_versions(live);
+}
+
+bool betree_live_update(struct betree_live* live,
+    size_t delete_count,
+    const betree_sub_t* delete_ids,
+    size_t insert_count,
+    const betree_sub_t* insert_ids,
+    const char** insert_exprs)
+{
+    pthread_mutex_lock(&live->lock);
+    struct live_version* current = atomic_load(&live->current);
+    // Updates are small next to the tree, it keeps its shape instead of being rebuilt
+    struct betree* next = betree_clone(current->tree);
+    for(size_t i = 0; i < delete_count; i++) {
+        betree_delete(next, delete_ids[i]);
+    }
+    // The whole batch is dropped when one expression is invalid, readers never see half of it
+    if(insert_count != 0 && !betree_insert_all(next, insert_count, insert_ids, insert_exprs)) {
+        pthread_mutex_unlock(&live->lock);
+        betree_free(next);
+        return false;
+    }
+    publish_version(live, next);
+    pthread_mutex_unlock(&live->lock);
+    return true;
+}
+
+void betree_live_rebalance(struct betree_live* live, struct betree_event_sample* sample)
+{
+    pthread_mutex_lock(&live->lock);
+    struct live_version* current = atomic_load(&live->current);
+    pthread_mutex_lock(&sample->lock);
+    struct betree* next = clone_betree(current->tree, sample);
+    pthread_mutex_unlock(&sample->lock);
+    publish_version(live, next);
+    pthread_mutex_unlock(&live->lock);
+}
@@ -1,5 +1,9 @@
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "alloc.h"
 #include "memoize.h"
 
 void set_bit(uint64_t A[], uint64_t k)
@@ -17,3 +21,58 @@ bool test_bit(const uint64_t A[], uint64_t k)
     return ((A[k / 64ULL] & (1ULL << (k % 64ULL))) != 0ULL);
 }
 
+void memoize_result(struct memoize* memoize, betree_pred_t memoize_id, bool result)
+{
+    size_t word = memoize_id / 64;
+    if((memoize->pass[word] | memoize->fail[word]) == 0) {
+        memoize->touched[memoize->touched_count] = word;
+        memoize->touched_count++;
+    }
+    set_bit(result ? memoize->pass : memoize->fail, memoize_id);
+}
+
+void reset_memoize(struct memoize* memoize)
+{
+    for(size_t i = 0; i < memoize->touched_count; i++) {
+        memoize->pass[memoize->touched[i]] = 0;
+        memoize->fail[memoize->touched[i]] = 0;
+    }
+    memoize->touched_count = 0;
+}
+
+void copy_memoize(struct memoize* to, const struct memoize* from)
+{
+    for(size_t i = 0; i < from->touched_count; i++) {
+        size_t word = from->touched[i];
+        to->pass[word] = from->pass[word];
+        to->fail[word] = from->fail[word];
+        to->touched[i] = word;
+    }
+    to->touched_count = from->touched_count;
+}
+
+void grow_memoize(struct memoize* memoize, size_t pred_count)
+{
+    size_t needed = pred_count / 64 + 1;
+    if(needed <= memoize->word_count) {
+        return;
+    }
+    size_t count = memoize->word_count == 0 ? 1 : memoize->word_count;
+    while(count < needed) {
+        count *= 2;
+    }
+    uint64_t* pass = brealloc(memoize->pass, count * sizeof(*pass));
+    uint64_t* fail = brealloc(memoize->fail, count * sizeof(*fail));
+    size_t* touched = brealloc(memoize->touched, count * sizeof(*touched));
+    if(pass == NULL || fail == NULL || touched == NULL) {
+        fprintf(stderr, "%s brealloc failed\n", __func__);
+        abort();
+    }
+    size_t added = count - memoize->word_count;
+    memset(&pass[memoize->word_count], 0, added * sizeof(*pass));
+    memset(&fail[memoize->word_count], 0, added * sizeof(*fail));
+    memoize->pass = pass;
+    memoize->fail = fail;
+    memoize->touched = touched;
+    memoize->word_count = count;
+}
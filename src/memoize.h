@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 typedef uint64_t betree_pred_t;
@@ -9,9 +10,19 @@ static const betree_pred_t INVALID_PRED = UINT64_MAX;
 struct memoize {
     uint64_t* pass;
     uint64_t* fail;
+    size_t word_count;
+    // Words written since the last reset, each listed once, so a reset only clears those
+    size_t touched_count;
+    size_t* touched;
 };
 
 void set_bit(uint64_t A[], uint64_t k);
 void clear_bit(uint64_t A[], uint64_t k);
 bool test_bit(const uint64_t A[], uint64_t k);
 
+void memoize_result(struct memoize* memoize, betree_pred_t memoize_id, bool result);
+void reset_memoize(struct memoize* memoize);
+// Copies the words written in from into to, which is reset and has at least as many words
+void copy_memoize(struct memoize* to, const struct memoize* from);
+// Makes room for pred_count preds, growing geometrically. Expects a reset memoize
+void grow_memoize(struct memoize* memoize, size_t pred_count);
@@ -0,0 +1,493 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "activation.h"
+#include "alloc.h"
+#include "ast.h"
+#include "betree.h"
+#include "bitmap.h"
+#include "columns.h"
+#include "config.h"
+#include "dependents.h"
+#include "hashmap.h"
+#include "jit.h"
+#include "parse_cache.h"
+#include "prefilter.h"
+#include "result_cache.h"
+#include "string_matcher.h"
+#include "sub_index.h"
+#include "tree.h"
+#include "value.h"
+
+// Nodes already counted, shared nodes are reached from every sub that uses them
+struct seen_nodes {
+    size_t slot_count;
+    size_t count;
+    const struct ast_node** slots;
+};
+
+static size_t hash_node(const struct ast_node* node, size_t mask)
+{
+    uint64_t x = (uint64_t)(uintptr_t)node;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return (size_t)(x ^ (x >> 31)) & mask;
+}
+
+static void grow_seen(struct seen_nodes* seen)
+{
+    size_t slot_count = seen->slot_count == 0 ? 256 : seen->slot_count * 2;
+    // Off the tree's arena, it is current during the walk
+    const struct ast_node** slots = calloc(slot_count, sizeof(*slots));
+    if(slots == NULL) {
+        fprintf(stderr, "%s calloc failed\n", __func__);
+        abort();
+    }
+    for(size_t i = 0; i < seen->slot_count; i++) {
+        const struct ast_node* node = seen->slots[i];
+        if(node != NULL) {
+            size_t j = hash_node(node, slot_count - 1);
+            while(slots[j] != NULL) {
+                j = (j + 1) & (slot_count - 1);
+            }
+            slots[j] = node;
+        }
+    }
+    free(seen->slots);
+    seen->slots = slots;
+    seen->slot_count = slot_count;
+}
+
+// False when node was already seen
+static bool see_node(struct seen_nodes* seen, const struct ast_node* node)
+{
+    if((seen->count + 1) * 2 > seen->slot_count) {
+        grow_seen(seen);
+    }
+    size_t mask = seen->slot_count - 1;
+    size_t i = hash_node(node, mask);
+    while(seen->slots[i] != NULL) {
+        if(seen->slots[i] == node) {
+            return false;
+        }
+        i = (i + 1) & mask;
+    }
+    seen->slots[i] = node;
+    seen->count++;
+    return true;
+}
+
+// Sizes are asked from the allocator, the requested size is only used when it can't tell
+static void add_block(struct betree_memory_usage* usage, const void* ptr, size_t requested)
+{
+    usage->bytes += bsize(ptr, requested);
+}
+
+static void add_string(struct betree_memory_usage* usage, const char* string)
+{
+    if(string != NULL) {
+        add_block(usage, string, strlen(string) + 1);
+    }
+}
+
+static void add_integer_list(struct betree_memory_usage* usage, const struct betree_integer_list* list)
+{
+    add_block(usage, list, sizeof(*list));
+    add_block(usage, list->integers, list->count * sizeof(*list->integers));
+}
+
+static void add_string_list(struct betree_memory_usage* usage, const struct betree_string_list* list)
+{
+    add_block(usage, list, sizeof(*list));
+    add_block(usage, list->strings, list->count * sizeof(*list->strings));
+    for(size_t i = 0; i < list->count; i++) {
+        add_string(usage, list->strings[i].string);
+    }
+    if(list->bitmap != NULL) {
+        add_block(usage, list->bitmap, sizeof(*list->bitmap) + list->bitmap->word_count * sizeof(uint64_t));
+    }
+}
+
+static void add_special_expr(struct betree_memory_usage* usage, const struct ast_special_expr* special)
+{
+    switch(special->type) {
+        case AST_SPECIAL_FREQUENCY:
+            add_string(usage, special->frequency.attr_var.attr);
+            add_string(usage, special->frequency.now.attr);
+            add_string(usage, special->frequency.ns.string);
+            break;
+        case AST_SPECIAL_SEGMENT:
+            add_string(usage, special->segment.attr_var.attr);
+            add_string(usage, special->segment.now.attr);
+            break;
+        case AST_SPECIAL_GEO:
+            add_string(usage, special->geo.latitude_var.attr);
+            add_string(usage, special->geo.longitude_var.attr);
+            break;
+        case AST_SPECIAL_STRING:
+            add_string(usage, special->string.attr_var.attr);
+            add_string(usage, special->string.pattern);
+            break;
+        default: abort();
+    }
+}
+
+static void add_set_expr(struct betree_memory_usage* usage, const struct ast_set_expr* set)
+{
+    switch(set->left_value.value_type) {
+        case AST_SET_LEFT_VALUE_INTEGER:
+            break;
+        case AST_SET_LEFT_VALUE_STRING:
+            add_string(usage, set->left_value.string_value.string);
+            break;
+        case AST_SET_LEFT_VALUE_VARIABLE:
+            add_string(usage, set->left_value.variable_value.attr);
+            break;
+        default: abort();
+    }
+    switch(set->right_value.value_type) {
+        case AST_SET_RIGHT_VALUE_INTEGER_LIST:
+            add_integer_list(usage, set->right_value.integer_list_value);
+            break;
+        case AST_SET_RIGHT_VALUE_STRING_LIST:
+            add_string_list(usage, set->right_value.string_list_value);
+            break;
+        case AST_SET_RIGHT_VALUE_VARIABLE:
+            add_string(usage, set->right_value.variable_value.attr);
+            break;
+        case AST_SET_RIGHT_VALUE_INTEGER_LIST_ENUM: {
+            const struct betree_integer_enum_list* list = set->right_value.integer_enum_list_value;
+            add_block(usage, list, sizeof(*list));
+            add_block(usage, list->integers, list->count * sizeof(*list->integers));
+            break;
+        }
+        default: abort();
+    }
+}
+
+// Follows what free_ast_node releases
+static void add_ast(struct betree_memory_usage* usage, struct seen_nodes* seen, const struct ast_node* node)
+{
+    if(!see_node(seen, node)) {
+        return;
+    }
+    usage->count++;
+    add_block(usage, node, sizeof(*node));
+    switch(node->type) {
+        case AST_TYPE_IS_NULL_EXPR:
+            add_string(usage, node->is_null_expr.attr_var.attr);
+            break;
+        case AST_TYPE_SPECIAL_EXPR:
+            add_special_expr(usage, &node->special_expr);
+            break;
+        case AST_TYPE_COMPARE_EXPR:
+            add_string(usage, node->compare_expr.attr_var.attr);
+            break;
+        case AST_TYPE_EQUALITY_EXPR:
+            add_string(usage, node->equality_expr.attr_var.attr);
+            if(node->equality_expr.value.value_type == AST_EQUALITY_VALUE_STRING) {
+                add_string(usage, node->equality_expr.value.string_value.string);
+            }
+            break;
+        case AST_TYPE_BOOL_EXPR:
+            switch(node->bool_expr.op) {
+                case AST_BOOL_NOT:
+                    add_ast(usage, seen, node->bool_expr.unary.expr);
+                    break;
+                case AST_BOOL_OR:
+                case AST_BOOL_AND:
+                    add_ast(usage, seen, node->bool_expr.binary.lhs);
+                    add_ast(usage, seen, node->bool_expr.binary.rhs);
+                    break;
+                case AST_BOOL_VARIABLE:
+                    add_string(usage, node->bool_expr.variable.attr);
+                    break;
+                case AST_BOOL_LITERAL:
+                    break;
+                default: abort();
+            }
+            break;
+        case AST_TYPE_SET_EXPR:
+            add_set_expr(usage, &node->set_expr);
+            break;
+        case AST_TYPE_LIST_EXPR:
+            add_string(usage, node->list_expr.attr_var.attr);
+            if(node->list_expr.value.value_type == AST_LIST_VALUE_INTEGER_LIST) {
+                add_integer_list(usage, node->list_expr.value.integer_list_value);
+            }
+            else {
+                add_string_list(usage, node->list_expr.value.string_list_value);
+            }
+            break;
+        default: abort();
+    }
+}
+
+static void add_sub(struct betree_memory_stats* stats, struct seen_nodes* seen, const struct betree_sub* sub)
+{
+    struct betree_memory_usage* usage = &stats->subs;
+    usage->count++;
+    add_block(usage, sub, sizeof(*sub) + 3 * sub->short_circuit.word_count * sizeof(*sub->masks));
+#ifdef BETREE_JIT
+    // Mapped pages, not from the allocator
+    usage->bytes += jit_size(sub->native);
+#endif
+    add_block(usage, sub->bounds, sub->bound_count * sizeof(*sub->bounds));
+    if(sub->program != NULL) {
+        const struct ast_program* program = sub->program;
+        add_block(usage, program,
+            sizeof(*program) + program->leaf_count * sizeof(*program->leaves)
+                + program->instruction_count * sizeof(*program->instructions));
+    }
+    add_ast(&stats->ast, seen, sub->expr);
+}
+
+static void add_postings(struct betree_memory_usage* usage, const struct lnode_postings* postings)
+{
+    add_block(usage, postings, sizeof(*postings));
+    add_block(usage, postings->unkeyed, postings->unkeyed_count * sizeof(*postings->unkeyed));
+    add_block(usage, postings->slots, postings->slot_count * sizeof(*postings->slots));
+    for(size_t i = 0; i < postings->slot_count; i++) {
+        const struct posting* posting = &postings->slots[i];
+        add_block(usage, posting->subs, posting->sub_count * sizeof(*posting->subs));
+    }
+    add_block(usage, postings->vars, postings->var_count * sizeof(*postings->vars));
+}
+
+static void add_columns(struct betree_memory_usage* usage, const struct lnode_columns* columns)
+{
+    add_block(usage, columns, sizeof(*columns));
+    for(size_t i = 0; i < columns->column_count; i++) {
+        add_block(usage, columns->columns[i].lo, columns->capacity * sizeof(*columns->columns[i].lo));
+        add_block(usage, columns->columns[i].hi, columns->capacity * sizeof(*columns->columns[i].hi));
+    }
+}
+
+static void add_lnode(struct betree_memory_stats* stats, struct seen_nodes* seen, const struct lnode* lnode)
+{
+    struct betree_memory_usage* usage = &stats->lnodes;
+    usage->count++;
+    add_block(usage, lnode, sizeof(*lnode));
+    add_block(usage, lnode->subs, lnode->sub_count * sizeof(*lnode->subs));
+    const struct lnode_short_circuits* masks = &lnode->short_circuits;
+    size_t mask_size = masks->word_count * masks->capacity * sizeof(uint64_t);
+    add_block(usage, masks->pass, mask_size);
+    add_block(usage, masks->fail, mask_size);
+    if(lnode->postings != NULL) {
+        add_postings(usage, lnode->postings);
+    }
+    if(lnode->columns != NULL) {
+        add_columns(usage, lnode->columns);
+    }
+    for(size_t i = 0; i < lnode->sub_count; i++) {
+        add_sub(stats, seen, lnode->subs[i]);
+    }
+}
+
+static void add_pdir(struct betree_memory_stats* stats, struct seen_nodes* seen, const struct pdir* pdir);
+
+static void add_cnode(struct betree_memory_stats* stats, struct seen_nodes* seen, const struct cnode* cnode)
+{
+    stats->cnodes.count++;
+    add_block(&stats->cnodes, cnode, sizeof(*cnode));
+    add_block(&stats->cnodes, cnode->required, cnode->required_count * sizeof(*cnode->required));
+    if(cnode->lnode != NULL) {
+        add_lnode(stats, seen, cnode->lnode);
+    }
+    if(cnode->pdir != NULL) {
+        add_pdir(stats, seen, cnode->pdir);
+    }
+}
+
+static void add_cdir(struct betree_memory_stats* stats, struct seen_nodes* seen, const struct cdir* cdir)
+{
+    if(cdir == NULL) {
+        return;
+    }
+    stats->cdirs.count++;
+    add_block(&stats->cdirs, cdir, sizeof(*cdir));
+    add_string(&stats->cdirs, cdir->attr_var.attr);
+    if(cdir->cnode != NULL) {
+        add_cnode(stats, seen, cdir->cnode);
+    }
+    add_cdir(stats, seen, cdir->lchild);
+    add_cdir(stats, seen, cdir->rchild);
+}
+
+static void add_pdir(struct betree_memory_stats* stats, struct seen_nodes* seen, const struct pdir* pdir)
+{
+    stats->pdirs.count++;
+    add_block(&stats->pdirs, pdir, sizeof(*pdir));
+    add_block(&stats->pdirs, pdir->pnodes, pdir->pnode_count * sizeof(*pdir->pnodes));
+    for(size_t i = 0; i < pdir->pnode_count; i++) {
+        const struct pnode* pnode = pdir->pnodes[i];
+        stats->pnodes.count++;
+        add_block(&stats->pnodes, pnode, sizeof(*pnode));
+        add_string(&stats->pnodes, pnode->attr_var.attr);
+        add_cdir(stats, seen, pnode->cdir);
+    }
+}
+
+static void add_trie(struct betree_memory_usage* usage, const struct string_trie* trie)
+{
+    add_block(usage, trie->states, trie->capacity * sizeof(*trie->states));
+    for(uint32_t i = 0; i < trie->state_count; i++) {
+        const struct trie_state* state = &trie->states[i];
+        add_block(usage, state->edges, state->edge_count * sizeof(*state->edges));
+        add_block(usage, state->outputs, state->output_count * sizeof(*state->outputs));
+    }
+}
+
+static void add_pred_map(struct betree_memory_usage* usage, const struct pred_map* pred_map)
+{
+    usage->count += pred_map->node_count;
+    add_block(usage, pred_map, sizeof(*pred_map));
+    add_block(usage, pred_map->slots, pred_map->slot_count * sizeof(*pred_map->slots));
+    const struct string_patterns* patterns = pred_map->strings;
+    if(patterns == NULL) {
+        return;
+    }
+    add_block(usage, patterns, sizeof(*patterns));
+    add_block(usage, patterns->patterns, patterns->capacity * sizeof(*patterns->patterns));
+    add_block(usage, patterns->matchers, patterns->matcher_count * sizeof(*patterns->matchers));
+    for(size_t i = 0; i < patterns->matcher_count; i++) {
+        const struct string_matcher* matcher = &patterns->matchers[i];
+        add_trie(usage, &matcher->contains);
+        add_trie(usage, &matcher->prefixes);
+        add_trie(usage, &matcher->suffixes);
+        add_block(usage, matcher->ids, matcher->id_count * sizeof(*matcher->ids));
+    }
+}
+
+static void add_config(struct betree_memory_stats* stats, const struct config* config)
+{
+    struct betree_memory_usage* domains = &stats->attr_domains;
+    add_block(domains, config, sizeof(*config));
+    add_block(domains, config->attr_domains, config->attr_domain_count * sizeof(*config->attr_domains));
+    for(size_t i = 0; i < config->attr_domain_count; i++) {
+        domains->count++;
+        add_block(domains, config->attr_domains[i], sizeof(*config->attr_domains[i]));
+        add_string(domains, config->attr_domains[i]->attr_var.attr);
+    }
+    add_block(domains, config->attr_slots, config->attr_slot_count * sizeof(*config->attr_slots));
+
+    struct betree_memory_usage* strings = &stats->string_maps;
+    add_block(strings, config->string_maps, config->string_map_count * sizeof(*config->string_maps));
+    add_block(strings, config->string_map_index, config->map_index_count * sizeof(*config->string_map_index));
+    for(size_t i = 0; i < config->string_map_count; i++) {
+        const struct string_map* map = &config->string_maps[i];
+        strings->count += map->string_value_count;
+        add_string(strings, map->attr_var.attr);
+        add_block(strings, map->string_values, map->string_value_count * sizeof(*map->string_values));
+        for(size_t j = 0; j < map->string_value_count; j++) {
+            add_string(strings, map->string_values[j]);
+        }
+        add_block(strings, map->slots, map->slot_count * sizeof(*map->slots));
+    }
+
+    struct betree_memory_usage* integers = &stats->integer_maps;
+    add_block(integers, config->integer_maps, config->integer_map_count * sizeof(*config->integer_maps));
+    add_block(integers, config->integer_map_index, config->map_index_count * sizeof(*config->integer_map_index));
+    for(size_t i = 0; i < config->integer_map_count; i++) {
+        const struct integer_map* map = &config->integer_maps[i];
+        integers->count += map->integer_value_count;
+        add_string(integers, map->attr_var.attr);
+        add_block(integers, map->integer_values, map->integer_value_count * sizeof(*map->integer_values));
+        add_block(integers, map->slots, map->slot_count * sizeof(*map->slots));
+    }
+
+    if(config->pred_map != NULL) {
+        add_pred_map(&stats->pred_map, config->pred_map);
+    }
+}
+
+static void add_sub_index(struct betree_memory_usage* usage, const struct sub_index* index)
+{
+    add_block(usage, index, sizeof(*index));
+    add_block(usage, index->buckets, index->bucket_count * sizeof(*index->buckets));
+    for(size_t i = 0; i < index->bucket_count; i++) {
+        for(const struct sub_index_entry* entry = index->buckets[i]; entry != NULL; entry = entry->next) {
+            usage->count++;
+            add_block(usage, entry, sizeof(*entry));
+        }
+    }
+}
+
+static void add_parse_cache(struct betree_memory_usage* usage, const struct parse_cache* cache)
+{
+    add_block(usage, cache, sizeof(*cache));
+    add_block(usage, cache->slots, cache->slot_count * sizeof(*cache->slots));
+    // The cached parses share nothing with the tree or each other
+    struct seen_nodes seen = { .slot_count = 0, .count = 0, .slots = NULL };
+    struct betree_memory_usage nodes = { .bytes = 0, .count = 0 };
+    for(size_t i = 0; i < cache->slot_count; i++) {
+        const struct parse_cache_entry* entry = &cache->slots[i];
+        if(entry->text != NULL) {
+            usage->count++;
+            add_string(usage, entry->text);
+            add_ast(&nodes, &seen, entry->node);
+        }
+    }
+    usage->bytes += nodes.bytes;
+    free(seen.slots);
+}
+
+static void add_result_cache(struct betree_memory_usage* usage, const struct result_cache* cache)
+{
+    add_block(usage, cache, sizeof(*cache));
+    add_block(usage, cache->slots, cache->slot_count * sizeof(*cache->slots));
+    if(cache->vars != NULL) {
+        add_block(usage, cache->vars, (cache->var_count + 1) * sizeof(*cache->vars));
+    }
+    for(size_t i = 0; i < cache->slot_count; i++) {
+        const struct result_cache_entry* entry = &cache->slots[i];
+        if(entry->key != NULL) {
+            usage->count++;
+            add_block(usage, entry->key, entry->key_length + 1);
+            add_block(usage, entry->matches, (entry->match_count + 1) * sizeof(*entry->matches));
+        }
+    }
+}
+
+void betree_memory_stats(const struct betree* tree, struct betree_memory_stats* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    // Blocks of arena trees are measured by the arena
+    struct arena* previous = set_current_arena(tree->arena);
+    struct seen_nodes seen = { .slot_count = 0, .count = 0, .slots = NULL };
+    add_block(&stats->tree, tree, sizeof(*tree));
+    add_config(stats, tree->config);
+    if(tree->cnode != NULL) {
+        add_cnode(stats, &seen, tree->cnode);
+    }
+    if(tree->sub_index != NULL) {
+        add_sub_index(&stats->sub_index, tree->sub_index);
+    }
+    const struct activation_index* activation = tree->config->activation;
+    add_block(&stats->sub_index, activation, sizeof(*activation));
+    add_block(&stats->sub_index, activation->timers, activation->capacity * sizeof(*activation->timers));
+    const struct sub_dependents* dependents = tree->config->dependents;
+    add_block(&stats->sub_index, dependents, sizeof(*dependents));
+    if(dependents->known) {
+        add_block(&stats->sub_index, dependents->offsets, (dependents->var_count + 1) * sizeof(*dependents->offsets));
+        add_block(&stats->sub_index, dependents->subs,
+            (dependents->offsets[dependents->var_count] + 1) * sizeof(*dependents->subs));
+    }
+    if(tree->config->parse_cache != NULL) {
+        add_parse_cache(&stats->parse_cache, tree->config->parse_cache);
+    }
+    if(tree->config->result_cache != NULL) {
+        add_result_cache(&stats->result_cache, tree->config->result_cache);
+    }
+    free(seen.slots);
+    set_current_arena(previous);
+    const struct betree_memory_usage* usages[] = { &stats->tree, &stats->attr_domains, &stats->string_maps,
+        &stats->integer_maps, &stats->pred_map, &stats->sub_index, &stats->cnodes, &stats->lnodes, &stats->pdirs,
+        &stats->pnodes, &stats->cdirs, &stats->subs, &stats->ast, &stats->parse_cache,
+        &stats->result_cache };
+    for(size_t i = 0; i < sizeof(usages) / sizeof(usages[0]); i++) {
+        stats->total_bytes += usages[i]->bytes;
+    }
+}
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "ast.h"
+#include "clone.h"
+#include "parse_cache.h"
+
+static uint64_t hash_text(const char* text)
+{
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for(const char* c = text; *c != '\0'; c++) {
+        hash = (hash ^ (unsigned char)*c) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+struct parse_cache* make_parse_cache(size_t capacity)
+{
+    struct arena* previous = set_current_arena(NULL);
+    struct parse_cache* cache = bcalloc(sizeof(*cache));
+    if(cache == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    size_t set_count = 1;
+    while(set_count * PARSE_CACHE_WAYS < capacity) {
+        set_count *= 2;
+    }
+    size_t slot_count = set_count * PARSE_CACHE_WAYS;
+    cache->slots = bcalloc(slot_count * sizeof(*cache->slots));
+    if(cache->slots == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->slot_count = slot_count;
+    cache->count = 0;
+    cache->clock = 0;
+    cache->hits = 0;
+    cache->misses = 0;
+    set_current_arena(previous);
+    return cache;
+}
+
+static void clear_entry(struct parse_cache_entry* entry)
+{
+    bfree(entry->text);
+    free_ast_node(entry->node);
+    entry->text = NULL;
+    entry->node = NULL;
+}
+
+void free_parse_cache(struct parse_cache* cache)
+{
+    if(cache == NULL) {
+        return;
+    }
+    struct arena* previous = set_current_arena(NULL);
+    for(size_t i = 0; i < cache->slot_count; i++) {
+        if(cache->slots[i].text != NULL) {
+            clear_entry(&cache->slots[i]);
+        }
+    }
+    bfree(cache->slots);
+    pthread_mutex_destroy(&cache->lock);
+    bfree(cache);
+    set_current_arena(previous);
+}
+
+static struct parse_cache_entry* find_set(struct parse_cache* cache, uint64_t hash)
+{
+    size_t set_count = cache->slot_count / PARSE_CACHE_WAYS;
+    return &cache->slots[(hash & (set_count - 1)) * PARSE_CACHE_WAYS];
+}
+
+struct ast_node* parse_cache_get(struct parse_cache* cache, const char* text)
+{
+    uint64_t hash = hash_text(text);
+    struct ast_node* node = NULL;
+    pthread_mutex_lock(&cache->lock);
+    struct parse_cache_entry* set = find_set(cache, hash);
+    for(size_t i = 0; i < PARSE_CACHE_WAYS; i++) {
+        struct parse_cache_entry* entry = &set[i];
+        if(entry->text != NULL && entry->hash == hash && strcmp(entry->text, text) == 0) {
+            // Copied under the lock, a put may replace the entry as soon as it is released
+            node = clone_node(entry->node);
+            entry->used = ++cache->clock;
+            break;
+        }
+    }
+    if(node != NULL) {
+        cache->hits++;
+    }
+    else {
+        cache->misses++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return node;
+}
+
+void parse_cache_put(struct parse_cache* cache, const char* text, const struct ast_node* node)
+{
+    uint64_t hash = hash_text(text);
+    // Copied before taking the lock, only the swap is serialized
+    struct arena* previous = set_current_arena(NULL);
+    char* copy_text = bstrdup(text);
+    struct ast_node* copy = clone_node(node);
+    struct parse_cache_entry replaced = { .text = NULL, .node = NULL };
+    pthread_mutex_lock(&cache->lock);
+    struct parse_cache_entry* set = find_set(cache, hash);
+    struct parse_cache_entry* entry = &set[0];
+    for(size_t i = 0; i < PARSE_CACHE_WAYS; i++) {
+        // Entries are never emptied so the free ways come last. Another thread may have put the same
+        // text meanwhile
+        if(set[i].text == NULL || (set[i].hash == hash && strcmp(set[i].text, text) == 0)) {
+            entry = &set[i];
+            break;
+        }
+        if(set[i].used < entry->used) {
+            entry = &set[i];
+        }
+    }
+    if(entry->text != NULL) {
+        replaced = *entry;
+    }
+    else {
+        cache->count++;
+    }
+    entry->hash = hash;
+    entry->used = ++cache->clock;
+    entry->text = copy_text;
+    entry->node = copy;
+    pthread_mutex_unlock(&cache->lock);
+    if(replaced.text != NULL) {
+        clear_entry(&replaced);
+    }
+    set_current_arena(previous);
+}
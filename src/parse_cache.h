@@ -0,0 +1,42 @@
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct ast_node;
+
+/*
+ * Parses of expression texts already inserted, so that repeated texts are copied instead of parsed.
+ * A text hashes to a set of PARSE_CACHE_WAYS slots and replaces the least recently used one when
+ * they are all taken. Entries live off the tree's arena
+ */
+
+#define PARSE_CACHE_WAYS 4
+
+struct parse_cache_entry {
+    uint64_t hash;
+    // Clock of the last put or hit
+    uint64_t used;
+    char* text;
+    struct ast_node* node;
+};
+
+struct parse_cache {
+    pthread_mutex_t lock;
+    // A multiple of PARSE_CACHE_WAYS, sets are consecutive
+    size_t slot_count;
+    struct parse_cache_entry* slots;
+    size_t count;
+    uint64_t clock;
+    uint64_t hits;
+    uint64_t misses;
+};
+
+// Capacity is rounded up to a power of two
+struct parse_cache* make_parse_cache(size_t capacity);
+void free_parse_cache(struct parse_cache* cache);
+// Copy of the parse kept for the text, in the current arena, NULL when there is none
+struct ast_node* parse_cache_get(struct parse_cache* cache, const char* text);
+// Keeps a copy of the node, safe to call from several threads
+void parse_cache_put(struct parse_cache* cache, const char* text, const struct ast_node* node);
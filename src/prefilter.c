@@ -0,0 +1,332 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "ast.h"
+#include "prefilter.h"
+#include "tree.h"
+#include "value.h"
+
+struct lnode_postings* make_lnode_postings()
+{
+    struct lnode_postings* postings = bcalloc(sizeof(*postings));
+    if(postings == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    return postings;
+}
+
+void free_lnode_postings(struct lnode_postings* postings)
+{
+    if(postings == NULL) {
+        return;
+    }
+    for(size_t i = 0; i < postings->slot_count; i++) {
+        bfree(postings->slots[i].subs);
+    }
+    bfree(postings->slots);
+    bfree(postings->unkeyed);
+    bfree(postings->vars);
+    bfree(postings);
+}
+
+static size_t key_value_count(const struct ast_node* node)
+{
+    switch(node->type) {
+        case AST_TYPE_EQUALITY_EXPR:
+            if(node->equality_expr.op != AST_EQUALITY_EQ) {
+                return 0;
+            }
+            switch(node->equality_expr.value.value_type) {
+                case AST_EQUALITY_VALUE_INTEGER:
+                case AST_EQUALITY_VALUE_STRING:
+                case AST_EQUALITY_VALUE_INTEGER_ENUM:
+                    return 1;
+                case AST_EQUALITY_VALUE_FLOAT:
+                default:
+                    return 0;
+            }
+        case AST_TYPE_SET_EXPR:
+            if(node->set_expr.op != AST_SET_IN
+                || node->set_expr.left_value.value_type != AST_SET_LEFT_VALUE_VARIABLE) {
+                return 0;
+            }
+            switch(node->set_expr.right_value.value_type) {
+                case AST_SET_RIGHT_VALUE_INTEGER_LIST:
+                    return node->set_expr.right_value.integer_list_value->count;
+                case AST_SET_RIGHT_VALUE_STRING_LIST:
+                    return node->set_expr.right_value.string_list_value->count;
+                case AST_SET_RIGHT_VALUE_INTEGER_LIST_ENUM:
+                case AST_SET_RIGHT_VALUE_VARIABLE:
+                default:
+                    return 0;
+            }
+        case AST_TYPE_IS_NULL_EXPR:
+        case AST_TYPE_SPECIAL_EXPR:
+        case AST_TYPE_BOOL_EXPR:
+        case AST_TYPE_LIST_EXPR:
+        case AST_TYPE_COMPARE_EXPR:
+        default:
+            return 0;
+    }
+}
+
+// Operand of the top AND chain with the fewest values, NULL when none can be used
+static const struct ast_node* find_key_node(const struct ast_node* node)
+{
+    if(node->type == AST_TYPE_BOOL_EXPR && node->bool_expr.op == AST_BOOL_AND) {
+        const struct ast_node* lhs = find_key_node(node->bool_expr.binary.lhs);
+        const struct ast_node* rhs = find_key_node(node->bool_expr.binary.rhs);
+        if(lhs == NULL || (rhs != NULL && key_value_count(rhs) < key_value_count(lhs))) {
+            return rhs;
+        }
+        return lhs;
+    }
+    return key_value_count(node) != 0 ? node : NULL;
+}
+
+static betree_var_t key_var(const struct ast_node* node)
+{
+    if(node->type == AST_TYPE_EQUALITY_EXPR) {
+        return node->equality_expr.attr_var.var;
+    }
+    return node->set_expr.left_value.variable_value.var;
+}
+
+static uint64_t key_value(const struct ast_node* node, size_t i)
+{
+    if(node->type == AST_TYPE_EQUALITY_EXPR) {
+        switch(node->equality_expr.value.value_type) {
+            case AST_EQUALITY_VALUE_INTEGER:
+                return (uint64_t)node->equality_expr.value.integer_value;
+            case AST_EQUALITY_VALUE_STRING:
+                return node->equality_expr.value.string_value.str;
+            case AST_EQUALITY_VALUE_INTEGER_ENUM:
+                return node->equality_expr.value.integer_enum_value.ienum;
+            case AST_EQUALITY_VALUE_FLOAT:
+            default: abort();
+        }
+    }
+    if(node->set_expr.right_value.value_type == AST_SET_RIGHT_VALUE_INTEGER_LIST) {
+        return (uint64_t)node->set_expr.right_value.integer_list_value->integers[i];
+    }
+    return node->set_expr.right_value.string_list_value->strings[i].str;
+}
+
+bool posting_value(const struct betree_variable* variable, uint64_t* value)
+{
+    if(variable == NULL) {
+        return false;
+    }
+    switch(variable->value.value_type) {
+        case BETREE_INTEGER:
+            *value = (uint64_t)variable->value.integer_value;
+            return true;
+        case BETREE_STRING:
+            *value = variable->value.string_value.str;
+            return true;
+        case BETREE_INTEGER_ENUM:
+            *value = variable->value.integer_enum_value.ienum;
+            return true;
+        case BETREE_BOOLEAN:
+        case BETREE_FLOAT:
+        case BETREE_INTEGER_LIST:
+        case BETREE_STRING_LIST:
+        case BETREE_SEGMENTS:
+        case BETREE_FREQUENCY_CAPS:
+        case BETREE_INTEGER_LIST_ENUM:
+        default:
+            return false;
+    }
+}
+
+static size_t hash_key(betree_var_t var, uint64_t value)
+{
+    // splitmix64 finalizer, ids and campaign numbers are often sequential
+    uint64_t x = value ^ (var * 0x9e3779b97f4a7c15ULL);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return (size_t)(x ^ (x >> 31));
+}
+
+static struct posting* probe(const struct lnode_postings* postings, betree_var_t var, uint64_t value)
+{
+    size_t mask = postings->slot_count - 1;
+    for(size_t i = hash_key(var, value) & mask;; i = (i + 1) & mask) {
+        struct posting* posting = &postings->slots[i];
+        if(posting->var == INVALID_VAR || (posting->var == var && posting->value == value)) {
+            return posting;
+        }
+    }
+}
+
+static struct posting* make_slots(size_t slot_count)
+{
+    struct posting* slots = bmalloc(slot_count * sizeof(*slots));
+    if(slots == NULL) {
+        fprintf(stderr, "%s bmalloc failed\n", __func__);
+        abort();
+    }
+    for(size_t i = 0; i < slot_count; i++) {
+        slots[i].var = INVALID_VAR;
+        slots[i].value = 0;
+        slots[i].sub_count = 0;
+        slots[i].subs = NULL;
+    }
+    return slots;
+}
+
+static void grow_slots(struct lnode_postings* postings)
+{
+    // At most half full, postings left without subs are dropped on the way
+    struct posting* old = postings->slots;
+    size_t old_count = postings->slot_count;
+    size_t live = 0;
+    for(size_t i = 0; i < old_count; i++) {
+        live += old[i].sub_count != 0;
+    }
+    size_t slot_count = 8;
+    while(slot_count < (live + 1) * 4) {
+        slot_count *= 2;
+    }
+    postings->slots = make_slots(slot_count);
+    postings->slot_count = slot_count;
+    postings->used_count = 0;
+    for(size_t i = 0; i < old_count; i++) {
+        if(old[i].sub_count != 0) {
+            *probe(postings, old[i].var, old[i].value) = old[i];
+            postings->used_count++;
+        }
+    }
+    bfree(old);
+}
+
+const struct posting* find_posting(const struct lnode_postings* postings, betree_var_t var, uint64_t value)
+{
+    if(postings->slot_count == 0) {
+        return NULL;
+    }
+    const struct posting* posting = probe(postings, var, value);
+    return posting->var == INVALID_VAR ? NULL : posting;
+}
+
+static void append_sub(struct betree_sub*** subs, size_t* count, struct betree_sub* sub)
+{
+    struct betree_sub** grown = brealloc(*subs, (*count + 1) * sizeof(**subs));
+    if(grown == NULL) {
+        fprintf(stderr, "%s brealloc failed\n", __func__);
+        abort();
+    }
+    grown[*count] = sub;
+    *subs = grown;
+    (*count)++;
+}
+
+static void delete_sub(struct betree_sub*** subs, size_t* count, const struct betree_sub* sub)
+{
+    for(size_t i = 0; i < *count; i++) {
+        if((*subs)[i] == sub) {
+            memmove(&(*subs)[i], &(*subs)[i + 1], (*count - i - 1) * sizeof(**subs));
+            (*count)--;
+            if(*count == 0) {
+                bfree(*subs);
+                *subs = NULL;
+            }
+            return;
+        }
+    }
+    fprintf(stderr, "Could not find sub %" PRIu64 " in postings\n", sub->id);
+    abort();
+}
+
+static void count_var(struct lnode_postings* postings, betree_var_t var, bool add)
+{
+    for(size_t i = 0; i < postings->var_count; i++) {
+        if(postings->vars[i].var == var) {
+            if(add) {
+                postings->vars[i].sub_count++;
+            }
+            else if(--postings->vars[i].sub_count == 0) {
+                postings->vars[i] = postings->vars[--postings->var_count];
+            }
+            return;
+        }
+    }
+    struct posting_var* vars = brealloc(postings->vars, (postings->var_count + 1) * sizeof(*vars));
+    if(vars == NULL) {
+        fprintf(stderr, "%s brealloc failed\n", __func__);
+        abort();
+    }
+    vars[postings->var_count].var = var;
+    vars[postings->var_count].sub_count = 1;
+    postings->vars = vars;
+    postings->var_count++;
+}
+
+void postings_add(struct lnode_postings* postings, struct betree_sub* sub)
+{
+    const struct ast_node* node = find_key_node(sub->expr);
+    if(node == NULL) {
+        append_sub(&postings->unkeyed, &postings->unkeyed_count, sub);
+        return;
+    }
+    betree_var_t var = key_var(node);
+    size_t count = key_value_count(node);
+    for(size_t i = 0; i < count; i++) {
+        if((postings->used_count + 1) * 2 > postings->slot_count) {
+            grow_slots(postings);
+        }
+        uint64_t value = key_value(node, i);
+        struct posting* posting = probe(postings, var, value);
+        if(posting->var == INVALID_VAR) {
+            posting->var = var;
+            posting->value = value;
+            postings->used_count++;
+        }
+        // Repeated values in the list
+        if(posting->sub_count != 0 && posting->subs[posting->sub_count - 1] == sub) {
+            continue;
+        }
+        append_sub(&posting->subs, &posting->sub_count, sub);
+    }
+    count_var(postings, var, true);
+}
+
+void postings_remove(struct lnode_postings* postings, const struct betree_sub* sub)
+{
+    const struct ast_node* node = find_key_node(sub->expr);
+    if(node == NULL) {
+        delete_sub(&postings->unkeyed, &postings->unkeyed_count, sub);
+        return;
+    }
+    betree_var_t var = key_var(node);
+    size_t count = key_value_count(node);
+    for(size_t i = 0; i < count; i++) {
+        struct posting* posting = probe(postings, var, key_value(node, i));
+        // Already removed for a repeated value
+        bool found = false;
+        for(size_t j = 0; j < posting->sub_count; j++) {
+            found |= posting->subs[j] == sub;
+        }
+        if(found) {
+            delete_sub(&posting->subs, &posting->sub_count, sub);
+        }
+    }
+    count_var(postings, var, false);
+}
+
+void index_lnode_postings(struct lnode* lnode, bool enable)
+{
+    free_lnode_postings(lnode->postings);
+    lnode->postings = NULL;
+    if(!enable) {
+        return;
+    }
+    lnode->postings = make_lnode_postings();
+    for(size_t i = 0; i < lnode->sub_count; i++) {
+        postings_add(lnode->postings, lnode->subs[i]);
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "value.h"
+
+struct betree_sub;
+struct betree_variable;
+struct lnode;
+
+/*
+ * Optional posting lists of an lnode. A sub whose expression is an AND chain with an "a = X" or
+ * "a in (X, Y)" operand on an integer, string or integer enum attribute can only match an event
+ * holding one of those values, it is kept under each value instead of being evaluated every time
+ */
+
+struct posting {
+    betree_var_t var;
+    uint64_t value;
+    // Slots stay taken when their last sub leaves
+    size_t sub_count;
+    struct betree_sub** subs;
+};
+
+struct posting_var {
+    betree_var_t var;
+    size_t sub_count;
+};
+
+struct lnode_postings {
+    size_t unkeyed_count;
+    struct betree_sub** unkeyed;
+    size_t slot_count;
+    size_t used_count;
+    struct posting* slots;
+    size_t var_count;
+    struct posting_var* vars;
+};
+
+struct lnode_postings* make_lnode_postings();
+void free_lnode_postings(struct lnode_postings* postings);
+
+void postings_add(struct lnode_postings* postings, struct betree_sub* sub);
+void postings_remove(struct lnode_postings* postings, const struct betree_sub* sub);
+// Drops the postings and rebuilds them from the subs of the lnode when enable is set
+void index_lnode_postings(struct lnode* lnode, bool enable);
+
+const struct posting* find_posting(const struct lnode_postings* postings, betree_var_t var, uint64_t value);
+// Value an event variable is looked up with, false when it has none
+bool posting_value(const struct betree_variable* variable, uint64_t* value);
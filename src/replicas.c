@@ -0,0 +1,218 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#include <sched.h>
+#endif
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "betree.h"
+#include "clone.h"
+
+/*
+ * Pages are placed on the node of the thread that first writes them, so each copy is made by a thread
+ * bound to the CPUs of its node. The topology comes from sysfs, without it there is a single node
+ */
+
+#define REPLICAS_MAX_NODES 64
+#define REPLICAS_MAX_CPUS 4096
+
+struct betree_replicas {
+    size_t replica_count;
+    struct betree** trees;
+    // Replica of each CPU, 0 for CPUs the topology doesn't list
+    size_t cpu_count;
+    size_t* cpu_replicas;
+};
+
+struct numa_node {
+    size_t cpu_count;
+    uint16_t cpus[REPLICAS_MAX_CPUS];
+};
+
+// Reads a list like "0-3,8-11" into cpus, false when the file is missing
+static bool read_cpu_list(const char* path, struct numa_node* node)
+{
+    FILE* file = fopen(path, "r");
+    if(file == NULL) {
+        return false;
+    }
+    node->cpu_count = 0;
+    unsigned long first, last;
+    int separator = ',';
+    while(separator == ',' && fscanf(file, "%lu", &first) == 1) {
+        last = first;
+        separator = fgetc(file);
+        if(separator == '-') {
+            if(fscanf(file, "%lu", &last) != 1) {
+                break;
+            }
+            separator = fgetc(file);
+        }
+        for(unsigned long cpu = first; cpu <= last && cpu < REPLICAS_MAX_CPUS; cpu++) {
+            if(node->cpu_count < REPLICAS_MAX_CPUS) {
+                node->cpus[node->cpu_count++] = (uint16_t)cpu;
+            }
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+// Nodes with CPUs, 0 when the topology can't be read
+static size_t read_nodes(struct numa_node* nodes)
+{
+    size_t count = 0;
+    for(size_t n = 0; n < REPLICAS_MAX_NODES; n++) {
+        char path[64];
+        sprintf(path, "/sys/devices/system/node/node%zu/cpulist", n);
+        if(read_cpu_list(path, &nodes[count]) && nodes[count].cpu_count != 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+struct replica_job {
+    const struct betree* tree;
+    struct betree* copy;
+};
+
+static void* make_replica(void* data)
+{
+    struct replica_job* job = data;
+    job->copy = clone_tree(job->tree, make_huge_page_arena());
+    betree_pack(job->copy);
+    return NULL;
+}
+
+// Runs the job on a thread bound to the CPUs of node, or the caller when it can't be bound
+static void make_replica_on(struct replica_job* job, const struct numa_node* node)
+{
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for(size_t i = 0; i < node->cpu_count; i++) {
+        CPU_SET(node->cpus[i], &cpus);
+    }
+    pthread_attr_t attr;
+    pthread_t thread;
+    bool started = pthread_attr_init(&attr) == 0;
+    if(started) {
+        started = pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus) == 0
+            && pthread_create(&thread, &attr, make_replica, job) == 0;
+        pthread_attr_destroy(&attr);
+    }
+    if(started) {
+        pthread_join(thread, NULL);
+        return;
+    }
+#else
+    (void)node;
+#endif
+    make_replica(job);
+}
+
+struct betree_replicas* betree_replicas_make(const struct betree* tree)
+{
+    struct betree_replicas* replicas = bcalloc(sizeof(*replicas));
+    struct numa_node* nodes = bcalloc(REPLICAS_MAX_NODES * sizeof(*nodes));
+    if(replicas == NULL || nodes == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    size_t node_count = read_nodes(nodes);
+    replicas->replica_count = node_count == 0 ? 1 : node_count;
+    replicas->trees = bcalloc(replicas->replica_count * sizeof(*replicas->trees));
+    if(replicas->trees == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    replicas->cpu_count = 0;
+    for(size_t n = 0; n < node_count; n++) {
+        for(size_t i = 0; i < nodes[n].cpu_count; i++) {
+            if((size_t)nodes[n].cpus[i] + 1 > replicas->cpu_count) {
+                replicas->cpu_count = (size_t)nodes[n].cpus[i] + 1;
+            }
+        }
+    }
+    replicas->cpu_replicas = bcalloc((replicas->cpu_count + 1) * sizeof(*replicas->cpu_replicas));
+    if(replicas->cpu_replicas == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    for(size_t n = 0; n < node_count; n++) {
+        for(size_t i = 0; i < nodes[n].cpu_count; i++) {
+            replicas->cpu_replicas[nodes[n].cpus[i]] = n;
+        }
+    }
+    // One node at a time, the copies only read the tree but nothing else promises it is safe
+    for(size_t r = 0; r < replicas->replica_count; r++) {
+        struct replica_job job = { .tree = tree, .copy = NULL };
+        if(node_count == 0) {
+            make_replica(&job);
+        }
+        else {
+            make_replica_on(&job, &nodes[r]);
+        }
+        replicas->trees[r] = job.copy;
+    }
+    bfree(nodes);
+    return replicas;
+}
+
+void betree_replicas_free(struct betree_replicas* replicas)
+{
+    if(replicas == NULL) {
+        return;
+    }
+    for(size_t r = 0; r < replicas->replica_count; r++) {
+        betree_free(replicas->trees[r]);
+    }
+    bfree(replicas->trees);
+    bfree(replicas->cpu_replicas);
+    bfree(replicas);
+}
+
+size_t betree_replicas_count(const struct betree_replicas* replicas)
+{
+    return replicas->replica_count;
+}
+
+const struct betree* betree_replicas_get(const struct betree_replicas* replicas, size_t index)
+{
+    return replicas->trees[index];
+}
+
+const struct betree* betree_replicas_local(const struct betree_replicas* replicas)
+{
+#ifdef __linux__
+    int cpu = sched_getcpu();
+    if(cpu >= 0 && (size_t)cpu < replicas->cpu_count) {
+        return replicas->trees[replicas->cpu_replicas[cpu]];
+    }
+#endif
+    return replicas->trees[0];
+}
+
+bool betree_replicas_search(const struct betree_replicas* replicas, const char* event, struct report* report)
+{
+    return betree_search(betree_replicas_local(replicas), event, report);
+}
+
+bool betree_replicas_search_with_context(const struct betree_replicas* replicas,
+    const char* event,
+    struct report* report,
+    struct betree_search_context* context)
+{
+    return betree_search_with_context(betree_replicas_local(replicas), event, report, context);
+}
+
+bool betree_replicas_exists(const struct betree_replicas* replicas, const char* event)
+{
+    return betree_exists(betree_replicas_local(replicas), event);
+}
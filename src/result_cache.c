@@ -0,0 +1,430 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "ast.h"
+#include "config.h"
+#include "result_cache.h"
+#include "tree.h"
+
+static uint64_t hash_bytes(const uint8_t* bytes, size_t length)
+{
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for(size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+struct result_cache* make_result_cache(size_t capacity, int64_t now_bucket)
+{
+    struct arena* previous = set_current_arena(NULL);
+    struct result_cache* cache = bcalloc(sizeof(*cache));
+    if(cache == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    size_t set_count = 1;
+    while(set_count * RESULT_CACHE_WAYS < capacity) {
+        set_count *= 2;
+    }
+    size_t slot_count = set_count * RESULT_CACHE_WAYS;
+    cache->slots = bcalloc(slot_count * sizeof(*cache->slots));
+    if(cache->slots == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->slot_count = slot_count;
+    cache->count = 0;
+    cache->clock = 0;
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->now_bucket = now_bucket;
+    cache->vars_known = false;
+    cache->var_count = 0;
+    cache->vars = NULL;
+    cache->now_var = INVALID_VAR;
+    set_current_arena(previous);
+    return cache;
+}
+
+static void clear_entry(struct result_cache_entry* entry)
+{
+    bfree(entry->key);
+    bfree(entry->matches);
+    entry->key = NULL;
+    entry->matches = NULL;
+}
+
+// Expects the lock or the only reference
+static void clear_entries(struct result_cache* cache)
+{
+    struct arena* previous = set_current_arena(NULL);
+    for(size_t i = 0; i < cache->slot_count; i++) {
+        if(cache->slots[i].key != NULL) {
+            clear_entry(&cache->slots[i]);
+        }
+        cache->slots[i].used = 0;
+    }
+    bfree(cache->vars);
+    cache->count = 0;
+    cache->vars_known = false;
+    cache->var_count = 0;
+    cache->vars = NULL;
+    cache->now_var = INVALID_VAR;
+    set_current_arena(previous);
+}
+
+void free_result_cache(struct result_cache* cache)
+{
+    if(cache == NULL) {
+        return;
+    }
+    clear_entries(cache);
+    struct arena* previous = set_current_arena(NULL);
+    bfree(cache->slots);
+    pthread_mutex_destroy(&cache->lock);
+    bfree(cache);
+    set_current_arena(previous);
+}
+
+void clear_result_cache(struct result_cache* cache)
+{
+    if(cache == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&cache->lock);
+    clear_entries(cache);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+struct result_key* make_result_key()
+{
+    struct arena* previous = set_current_arena(NULL);
+    struct result_key* key = bcalloc(sizeof(*key));
+    if(key == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    set_current_arena(previous);
+    return key;
+}
+
+void free_result_key(struct result_key* key)
+{
+    if(key == NULL) {
+        return;
+    }
+    struct arena* previous = set_current_arena(NULL);
+    bfree(key->bytes);
+    bfree(key);
+    set_current_arena(previous);
+}
+
+// Expects the lock
+static void find_vars(struct result_cache* cache, const struct config* config, const struct cnode* cnode)
+{
+    size_t word_count = config->attr_domain_count / 64 + 1;
+    size_t sub_count = 0;
+    collect_subs(cnode, NULL, &sub_count);
+    struct betree_sub** subs = bcalloc((sub_count + 1) * sizeof(*subs));
+    uint64_t* used = bcalloc(word_count * sizeof(*used));
+    if(subs == NULL || used == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    sub_count = 0;
+    collect_subs(cnode, subs, &sub_count);
+    betree_var_t now_var = INVALID_VAR;
+    for(size_t i = 0; i < sub_count; i++) {
+        const struct betree_sub* sub = subs[i];
+        for(size_t w = 0; w < sub->short_circuit.word_count; w++) {
+            used[w] |= sub->attr_vars[w];
+        }
+        if(now_var == INVALID_VAR) {
+            now_var = find_now_var(sub->expr);
+        }
+    }
+    // A sub comparing now itself needs it exact
+    bool now_used = now_var != INVALID_VAR && (used[now_var / 64] & (1ULL << (now_var % 64))) != 0;
+    if(now_var != INVALID_VAR) {
+        used[now_var / 64] |= 1ULL << (now_var % 64);
+    }
+    size_t var_count = 0;
+    for(size_t w = 0; w < word_count; w++) {
+        var_count += (size_t)__builtin_popcountll(used[w]);
+    }
+    struct arena* previous = set_current_arena(NULL);
+    cache->vars = bcalloc((var_count + 1) * sizeof(*cache->vars));
+    if(cache->vars == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    set_current_arena(previous);
+    cache->var_count = 0;
+    for(size_t w = 0; w < word_count; w++) {
+        for(uint64_t bits = used[w]; bits != 0; bits &= bits - 1) {
+            cache->vars[cache->var_count++] = w * 64 + (betree_var_t)__builtin_ctzll(bits);
+        }
+    }
+    cache->now_var = now_used || cache->now_bucket <= 1 ? INVALID_VAR : now_var;
+    cache->vars_known = true;
+    bfree(used);
+    bfree(subs);
+}
+
+static void write_bytes(struct result_key* key, const void* bytes, size_t count)
+{
+    if(count == 0) {
+        return;
+    }
+    if(key->length + count > key->capacity) {
+        size_t capacity = key->capacity == 0 ? 256 : key->capacity;
+        while(capacity < key->length + count) {
+            capacity *= 2;
+        }
+        struct arena* previous = set_current_arena(NULL);
+        uint8_t* grown = brealloc(key->bytes, capacity);
+        set_current_arena(previous);
+        if(grown == NULL) {
+            fprintf(stderr, "%s brealloc failed\n", __func__);
+            abort();
+        }
+        key->bytes = grown;
+        key->capacity = capacity;
+    }
+    memcpy(key->bytes + key->length, bytes, count);
+    key->length += count;
+}
+
+static void write_u64(struct result_key* key, uint64_t value)
+{
+    write_bytes(key, &value, sizeof(value));
+}
+
+static void write_string(struct result_key* key, struct string_value string)
+{
+    // Ids cover the comparisons, the text covers the string predicates
+    write_u64(key, string.str);
+    size_t length = string.string == NULL ? 0 : strlen(string.string);
+    write_u64(key, length);
+    write_bytes(key, string.string, length);
+}
+
+// Floor division so a bucket never straddles 0
+static int64_t bucket_of(int64_t now, int64_t bucket)
+{
+    int64_t quotient = now / bucket;
+    return (now % bucket != 0 && now < 0) ? quotient - 1 : quotient;
+}
+
+static void write_value(struct result_key* key, const struct value* value)
+{
+    write_u64(key, (uint64_t)value->value_type);
+    switch(value->value_type) {
+        case BETREE_BOOLEAN:
+            write_u64(key, value->boolean_value ? 1 : 0);
+            break;
+        case BETREE_INTEGER:
+            write_u64(key, (uint64_t)value->integer_value);
+            break;
+        case BETREE_FLOAT:
+            write_bytes(key, &value->float_value, sizeof(value->float_value));
+            break;
+        case BETREE_STRING:
+            write_string(key, value->string_value);
+            break;
+        case BETREE_INTEGER_LIST: {
+            const struct betree_integer_list* list = value->integer_list_value;
+            write_u64(key, list->count);
+            write_bytes(key, list->integers, list->count * sizeof(*list->integers));
+            break;
+        }
+        case BETREE_STRING_LIST: {
+            const struct betree_string_list* list = value->string_list_value;
+            write_u64(key, list->count);
+            for(size_t i = 0; i < list->count; i++) {
+                write_string(key, list->strings[i]);
+            }
+            break;
+        }
+        case BETREE_SEGMENTS: {
+            const struct betree_segments* list = value->segments_value;
+            write_u64(key, list->size);
+            for(size_t i = 0; i < list->size; i++) {
+                write_u64(key, (uint64_t)list->content[i].id);
+                write_u64(key, (uint64_t)list->content[i].timestamp);
+            }
+            break;
+        }
+        case BETREE_FREQUENCY_CAPS: {
+            const struct betree_frequency_caps* list = value->frequency_caps_value;
+            write_u64(key, list->size);
+            for(size_t i = 0; i < list->size; i++) {
+                const struct betree_frequency_cap* cap = &list->content[i];
+                write_u64(key, (uint64_t)cap->type);
+                write_u64(key, cap->id);
+                write_string(key, cap->namespace);
+                write_u64(key, cap->timestamp_defined ? 1 : 0);
+                write_u64(key, (uint64_t)cap->timestamp);
+                write_u64(key, cap->value);
+            }
+            break;
+        }
+        case BETREE_INTEGER_ENUM:
+            write_u64(key, (uint64_t)value->integer_enum_value.integer);
+            write_u64(key, value->integer_enum_value.ienum);
+            break;
+        case BETREE_INTEGER_LIST_ENUM: {
+            const struct betree_integer_enum_list* list = value->integer_enum_list_value;
+            write_u64(key, list->count);
+            for(size_t i = 0; i < list->count; i++) {
+                write_u64(key, (uint64_t)list->integers[i].integer);
+                write_u64(key, list->integers[i].ienum);
+            }
+            break;
+        }
+        default: abort();
+    }
+}
+
+void fill_result_key(struct result_cache* cache,
+    const struct config* config,
+    const struct cnode* cnode,
+    const struct betree_variable** preds,
+    struct result_key* key)
+{
+    key->length = 0;
+    pthread_mutex_lock(&cache->lock);
+    if(!cache->vars_known) {
+        find_vars(cache, config, cnode);
+    }
+    for(size_t i = 0; i < cache->var_count; i++) {
+        betree_var_t var = cache->vars[i];
+        const struct betree_variable* pred = preds[var];
+        write_u64(key, var);
+        if(pred == NULL) {
+            // Past the value types
+            write_u64(key, UINT64_MAX);
+        }
+        else if(var == cache->now_var && pred->value.value_type == BETREE_INTEGER) {
+            write_u64(key, (uint64_t)bucket_of(pred->value.integer_value, cache->now_bucket));
+        }
+        else {
+            write_value(key, &pred->value);
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+static struct result_cache_entry* find_set(struct result_cache* cache, uint64_t hash)
+{
+    size_t set_count = cache->slot_count / RESULT_CACHE_WAYS;
+    return &cache->slots[(hash & (set_count - 1)) * RESULT_CACHE_WAYS];
+}
+
+static bool same_key(const struct result_cache_entry* entry, uint64_t hash, const struct result_key* key)
+{
+    return entry->key != NULL && entry->hash == hash && entry->key_length == key->length
+        && memcmp(entry->key, key->bytes, key->length) == 0;
+}
+
+static void add_matches(struct report* report, const betree_sub_t* matches, size_t count)
+{
+    if(report->matched + count > report->capacity) {
+        size_t capacity = report->capacity == 0 ? 8 : report->capacity;
+        while(capacity < report->matched + count) {
+            capacity *= 2;
+        }
+        betree_sub_t* subs = brealloc(report->subs, sizeof(*report->subs) * capacity);
+        if(subs == NULL) {
+            fprintf(stderr, "%s brealloc failed\n", __func__);
+            abort();
+        }
+        report->subs = subs;
+        report->capacity = capacity;
+    }
+    if(count != 0) {
+        memcpy(report->subs + report->matched, matches, count * sizeof(*matches));
+    }
+    report->matched += count;
+}
+
+bool result_cache_get(struct result_cache* cache, const struct result_key* key, struct report* report)
+{
+    uint64_t hash = hash_bytes(key->bytes, key->length);
+    bool found = false;
+    pthread_mutex_lock(&cache->lock);
+    struct result_cache_entry* set = find_set(cache, hash);
+    for(size_t i = 0; i < RESULT_CACHE_WAYS; i++) {
+        struct result_cache_entry* entry = &set[i];
+        if(same_key(entry, hash, key)) {
+            // Copied under the lock, a put may replace the entry as soon as it is released
+            add_matches(report, entry->matches, entry->match_count);
+            entry->used = ++cache->clock;
+            found = true;
+            break;
+        }
+    }
+    if(found) {
+        cache->hits++;
+    }
+    else {
+        cache->misses++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return found;
+}
+
+void result_cache_put(
+    struct result_cache* cache, const struct result_key* key, const betree_sub_t* matches, size_t match_count)
+{
+    uint64_t hash = hash_bytes(key->bytes, key->length);
+    // Copied before taking the lock, only the swap is serialized
+    struct arena* previous = set_current_arena(NULL);
+    uint8_t* copy_key = bmalloc(key->length + 1);
+    betree_sub_t* copy_matches = bmalloc((match_count + 1) * sizeof(*copy_matches));
+    if(copy_key == NULL || copy_matches == NULL) {
+        fprintf(stderr, "%s bmalloc failed\n", __func__);
+        abort();
+    }
+    memcpy(copy_key, key->bytes, key->length);
+    if(match_count != 0) {
+        memcpy(copy_matches, matches, match_count * sizeof(*matches));
+    }
+    struct result_cache_entry replaced = { .key = NULL, .matches = NULL };
+    pthread_mutex_lock(&cache->lock);
+    struct result_cache_entry* set = find_set(cache, hash);
+    struct result_cache_entry* entry = &set[0];
+    for(size_t i = 0; i < RESULT_CACHE_WAYS; i++) {
+        // Entries are only emptied all at once so the free ways come last. Another thread may have put
+        // the same key meanwhile
+        if(set[i].key == NULL || same_key(&set[i], hash, key)) {
+            entry = &set[i];
+            break;
+        }
+        if(set[i].used < entry->used) {
+            entry = &set[i];
+        }
+    }
+    if(entry->key != NULL) {
+        replaced = *entry;
+    }
+    else {
+        cache->count++;
+    }
+    entry->hash = hash;
+    entry->used = ++cache->clock;
+    entry->key_length = key->length;
+    entry->key = copy_key;
+    entry->match_count = match_count;
+    entry->matches = copy_matches;
+    pthread_mutex_unlock(&cache->lock);
+    if(replaced.key != NULL) {
+        clear_entry(&replaced);
+    }
+    set_current_arena(previous);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "betree.h"
+#include "value.h"
+
+struct betree_variable;
+struct cnode;
+struct config;
+
+/*
+ * Matches of events already searched, keyed by the values of the attributes the subs use, so that
+ * events differing only in other attributes share an entry. Frequency caps and segment predicates
+ * add the now attribute, rounded down to now_bucket when set. A key hashes to a set of
+ * RESULT_CACHE_WAYS slots and replaces the least recently used one when they are all taken.
+ * Entries live off the tree's arena and are dropped whenever subs are inserted or deleted
+ */
+
+#define RESULT_CACHE_WAYS 4
+
+struct result_cache_entry {
+    uint64_t hash;
+    // Clock of the last put or hit
+    uint64_t used;
+    size_t key_length;
+    uint8_t* key;
+    size_t match_count;
+    betree_sub_t* matches;
+};
+
+struct result_cache {
+    pthread_mutex_t lock;
+    // A multiple of RESULT_CACHE_WAYS, sets are consecutive
+    size_t slot_count;
+    struct result_cache_entry* slots;
+    size_t count;
+    uint64_t clock;
+    uint64_t hits;
+    uint64_t misses;
+    int64_t now_bucket;
+    // Attributes keys are made of in increasing order, found again by the first search after a change
+    bool vars_known;
+    size_t var_count;
+    betree_var_t* vars;
+    // The now attribute when it gets rounded down, INVALID_VAR when it is kept exact
+    betree_var_t now_var;
+};
+
+// Key of an event, reused across the searches of a context
+struct result_key {
+    size_t length;
+    size_t capacity;
+    uint8_t* bytes;
+};
+
+// Capacity is rounded up to a power of two, now_bucket of 0 or 1 keeps now exact
+struct result_cache* make_result_cache(size_t capacity, int64_t now_bucket);
+void free_result_cache(struct result_cache* cache);
+// Drops the entries and the attributes, for when the subs change
+void clear_result_cache(struct result_cache* cache);
+
+struct result_key* make_result_key();
+void free_result_key(struct result_key* key);
+// Writes the key of the event, safe to call from several threads
+void fill_result_key(struct result_cache* cache,
+    const struct config* config,
+    const struct cnode* cnode,
+    const struct betree_variable** preds,
+    struct result_key* key);
+
+// Adds the matches kept for the key to the report, false when there are none
+bool result_cache_get(struct result_cache* cache, const struct result_key* key, struct report* report);
+// Keeps a copy of the matches, safe to call from several threads
+void result_cache_put(
+    struct result_cache* cache, const struct result_key* key, const betree_sub_t* matches, size_t match_count);
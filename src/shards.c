@@ -0,0 +1,443 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "ast.h"
+#include "betree.h"
+#include "config.h"
+#include "event_scanner.h"
+#include "sub_index.h"
+#include "tree.h"
+#include "utils.h"
+
+/*
+ * Every shard is a whole tree with its own copy of the schema config, so shards never share the
+ * dictionaries inserts grow and can be written to at the same time. A sub pinned to one value of the
+ * key attribute lives in the shard of that value, any other sub in the shard of its id
+ */
+
+#define SHARDS_MAX_COUNT 64
+
+struct betree_shards {
+    size_t shard_count;
+    struct betree** trees;
+    // Name of the key attribute, NULL when subs are spread by id only
+    char* key;
+    betree_var_t key_var;
+    // Subs of each shard the key does not pin, an event with a key value skips the shards without any
+    size_t* unkeyed_counts;
+};
+
+int parse(const char* text, struct ast_node** node);
+
+static uint64_t mix(uint64_t x)
+{
+    // splitmix64 finalizer, ids and key values are often sequential
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static uint64_t hash_string(const char* string)
+{
+    // FNV-1a, shards have their own string ids so the text is hashed
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for(const char* c = string; *c != '\0'; c++) {
+        hash = (hash ^ (unsigned char)*c) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Hash of the value the top AND chain pins the key to, false when it pins none
+static bool find_key_hash(const struct ast_node* node, const char* key, uint64_t* hash)
+{
+    if(node->type == AST_TYPE_BOOL_EXPR && node->bool_expr.op == AST_BOOL_AND) {
+        return find_key_hash(node->bool_expr.binary.lhs, key, hash)
+            || find_key_hash(node->bool_expr.binary.rhs, key, hash);
+    }
+    if(node->type != AST_TYPE_EQUALITY_EXPR || node->equality_expr.op != AST_EQUALITY_EQ
+        || strcmp(node->equality_expr.attr_var.attr, key) != 0) {
+        return false;
+    }
+    const struct equality_value* value = &node->equality_expr.value;
+    switch(value->value_type) {
+        case AST_EQUALITY_VALUE_INTEGER:
+            *hash = mix((uint64_t)value->integer_value);
+            return true;
+        case AST_EQUALITY_VALUE_INTEGER_ENUM:
+            *hash = mix((uint64_t)value->integer_enum_value.integer);
+            return true;
+        case AST_EQUALITY_VALUE_STRING:
+            *hash = mix(hash_string(value->string_value.string));
+            return true;
+        case AST_EQUALITY_VALUE_FLOAT:
+        default:
+            return false;
+    }
+}
+
+static bool event_key_hash(const struct betree_event* event, betree_var_t key_var, uint64_t* hash)
+{
+    for(size_t i = 0; i < event->variable_count; i++) {
+        const struct betree_variable* variable = event->variables[i];
+        if(variable == NULL || variable->attr_var.var != key_var) {
+            continue;
+        }
+        switch(variable->value.value_type) {
+            case BETREE_INTEGER:
+                *hash = mix((uint64_t)variable->value.integer_value);
+                return true;
+            case BETREE_INTEGER_ENUM:
+                *hash = mix((uint64_t)variable->value.integer_enum_value.integer);
+                return true;
+            case BETREE_STRING:
+                *hash = mix(hash_string(variable->value.string_value.string));
+                return true;
+            case BETREE_BOOLEAN:
+            case BETREE_FLOAT:
+            case BETREE_INTEGER_LIST:
+            case BETREE_STRING_LIST:
+            case BETREE_SEGMENTS:
+            case BETREE_FREQUENCY_CAPS:
+            case BETREE_INTEGER_LIST_ENUM:
+            default:
+                return false;
+        }
+    }
+    return false;
+}
+
+static bool is_keyed(const struct betree_shards* shards, const struct ast_node* node)
+{
+    uint64_t hash;
+    return shards->key != NULL && find_key_hash(node, shards->key, &hash);
+}
+
+static size_t route(const struct betree_shards* shards, betree_sub_t id, const struct ast_node* node)
+{
+    uint64_t hash;
+    if(shards->key != NULL && find_key_hash(node, shards->key, &hash)) {
+        return hash % shards->shard_count;
+    }
+    return mix(id) % shards->shard_count;
+}
+
+static size_t find_shard(const struct betree_shards* shards, betree_sub_t id)
+{
+    for(size_t i = 0; i < shards->shard_count; i++) {
+        if(sub_index_find(shards->trees[i]->sub_index, id) != NULL) {
+            return i;
+        }
+    }
+    return SIZE_MAX;
+}
+
+static struct betree* clone_schema(const struct betree* schema)
+{
+    struct betree* tree = bcalloc(sizeof(*tree));
+    if(tree == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    tree->arena = make_arena_like(schema->arena);
+    struct arena* previous = set_current_arena(tree->arena);
+    tree->config = clone_config(schema->config);
+    tree->cnode = make_cnode(tree->config, NULL);
+    tree->sub_index = make_sub_index();
+    set_current_arena(previous);
+    return tree;
+}
+
+struct betree_shards* betree_shards_make(struct betree* schema, size_t shard_count)
+{
+    size_t sub_count = 0;
+    collect_subs(schema->cnode, NULL, &sub_count);
+    if(shard_count == 0 || shard_count > SHARDS_MAX_COUNT || sub_count != 0) {
+        return NULL;
+    }
+    struct betree_shards* shards = bcalloc(sizeof(*shards));
+    if(shards == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    shards->shard_count = shard_count;
+    shards->trees = bcalloc(shard_count * sizeof(*shards->trees));
+    shards->unkeyed_counts = bcalloc(shard_count * sizeof(*shards->unkeyed_counts));
+    if(shards->trees == NULL || shards->unkeyed_counts == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    shards->trees[0] = schema;
+    for(size_t i = 1; i < shard_count; i++) {
+        shards->trees[i] = clone_schema(schema);
+    }
+    shards->key = NULL;
+    shards->key_var = INVALID_VAR;
+    return shards;
+}
+
+void betree_shards_free(struct betree_shards* shards)
+{
+    if(shards == NULL) {
+        return;
+    }
+    for(size_t i = 0; i < shards->shard_count; i++) {
+        betree_free(shards->trees[i]);
+    }
+    bfree(shards->trees);
+    bfree(shards->unkeyed_counts);
+    bfree(shards->key);
+    bfree(shards);
+}
+
+size_t betree_shards_count(const struct betree_shards* shards)
+{
+    return shards->shard_count;
+}
+
+struct betree* betree_shards_get(struct betree_shards* shards, size_t index)
+{
+    return shards->trees[index];
+}
+
+bool betree_shards_set_key(struct betree_shards* shards, const char* attr)
+{
+    size_t var = betree_get_variable_index(shards->trees[0], attr);
+    if(var == SIZE_MAX) {
+        return false;
+    }
+    for(size_t i = 0; i < shards->shard_count; i++) {
+        size_t sub_count = 0;
+        collect_subs(shards->trees[i]->cnode, NULL, &sub_count);
+        if(sub_count != 0) {
+            return false;
+        }
+    }
+    bfree(shards->key);
+    shards->key = bstrdup(attr);
+    shards->key_var = var;
+    return true;
+}
+
+bool betree_shards_insert(struct betree_shards* shards, betree_sub_t id, const char* expr)
+{
+    struct ast_node* node;
+    if(find_shard(shards, id) != SIZE_MAX || parse(expr, &node) != 0) {
+        return false;
+    }
+    size_t shard = route(shards, id, node);
+    bool keyed = is_keyed(shards, node);
+    free_ast_node(node);
+    if(!betree_insert(shards->trees[shard], id, expr)) {
+        return false;
+    }
+    if(!keyed) {
+        shards->unkeyed_counts[shard]++;
+    }
+    return true;
+}
+
+struct shard_insert_job {
+    struct betree* tree;
+    size_t count;
+    betree_sub_t* ids;
+    const char** exprs;
+    bool valid;
+};
+
+static void* insert_shard(void* arg)
+{
+    struct shard_insert_job* job = arg;
+    job->valid = betree_insert_all(job->tree, job->count, job->ids, job->exprs);
+    return NULL;
+}
+
+bool betree_shards_insert_all(struct betree_shards* shards, size_t count, const betree_sub_t* ids, const char** exprs)
+{
+    size_t* routes = bcalloc(smax(1, count) * sizeof(*routes));
+    bool* keyed = bcalloc(smax(1, count) * sizeof(*keyed));
+    struct shard_insert_job jobs[SHARDS_MAX_COUNT] = { { 0 } };
+    if(routes == NULL || keyed == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    bool valid = true;
+    for(size_t i = 0; i < count && valid; i++) {
+        struct ast_node* node;
+        if(find_shard(shards, ids[i]) != SIZE_MAX || parse(exprs[i], &node) != 0) {
+            valid = false;
+            break;
+        }
+        routes[i] = route(shards, ids[i], node);
+        keyed[i] = is_keyed(shards, node);
+        free_ast_node(node);
+        jobs[routes[i]].count++;
+    }
+    if(valid) {
+        for(size_t s = 0; s < shards->shard_count; s++) {
+            jobs[s].tree = shards->trees[s];
+            jobs[s].ids = bmalloc(smax(1, jobs[s].count) * sizeof(*jobs[s].ids));
+            jobs[s].exprs = bmalloc(smax(1, jobs[s].count) * sizeof(*jobs[s].exprs));
+            if(jobs[s].ids == NULL || jobs[s].exprs == NULL) {
+                fprintf(stderr, "%s bmalloc failed\n", __func__);
+                abort();
+            }
+            jobs[s].count = 0;
+        }
+        for(size_t i = 0; i < count; i++) {
+            struct shard_insert_job* job = &jobs[routes[i]];
+            job->ids[job->count] = ids[i];
+            job->exprs[job->count] = exprs[i];
+            job->count++;
+        }
+        // Every shard is loaded on its own thread, the bulk loader spreads each one further
+        pthread_t threads[SHARDS_MAX_COUNT];
+        for(size_t s = 1; s < shards->shard_count; s++) {
+            if(pthread_create(&threads[s], NULL, insert_shard, &jobs[s]) != 0) {
+                fprintf(stderr, "%s pthread_create failed\n", __func__);
+                abort();
+            }
+        }
+        insert_shard(&jobs[0]);
+        for(size_t s = 1; s < shards->shard_count; s++) {
+            pthread_join(threads[s], NULL);
+        }
+        for(size_t s = 0; s < shards->shard_count; s++) {
+            valid = valid && jobs[s].valid;
+        }
+        // Nothing is kept when one shard refused its subs
+        for(size_t s = 0; s < shards->shard_count && !valid; s++) {
+            for(size_t i = 0; i < jobs[s].count && jobs[s].valid; i++) {
+                betree_delete(shards->trees[s], jobs[s].ids[i]);
+            }
+        }
+        for(size_t i = 0; i < count && valid; i++) {
+            shards->unkeyed_counts[routes[i]] += !keyed[i];
+        }
+        for(size_t s = 0; s < shards->shard_count; s++) {
+            bfree(jobs[s].ids);
+            bfree(jobs[s].exprs);
+        }
+    }
+    bfree(routes);
+    bfree(keyed);
+    return valid;
+}
+
+bool betree_shards_delete(struct betree_shards* shards, betree_sub_t id)
+{
+    size_t shard = find_shard(shards, id);
+    if(shard == SIZE_MAX) {
+        return false;
+    }
+    struct betree* tree = shards->trees[shard];
+    bool keyed = is_keyed(shards, sub_index_find(tree->sub_index, id)->expr);
+    if(!betree_delete(tree, id)) {
+        return false;
+    }
+    if(!keyed) {
+        shards->unkeyed_counts[shard]--;
+    }
+    return true;
+}
+
+struct shard_search_job {
+    const struct betree* tree;
+    const char* event;
+    struct betree_search_context* context;
+    struct report report;
+    bool valid;
+};
+
+static void* search_shard(void* arg)
+{
+    struct shard_search_job* job = arg;
+    if(job->context == NULL) {
+        job->context = make_search_context(job->tree->config);
+    }
+    job->valid = betree_search_with_context(job->tree, job->event, &job->report, job->context);
+    free_search_context(job->context);
+    return NULL;
+}
+
+static void merge_report(struct report* report, const struct report* shard)
+{
+    report->evaluated += shard->evaluated;
+    report->memoized += shard->memoized;
+    report->shorted += shard->shorted;
+    if(shard->matched == 0) {
+        return;
+    }
+    if(report->matched + shard->matched > report->capacity) {
+        size_t capacity = smax(report->capacity * 2, report->matched + shard->matched);
+        betree_sub_t* subs = brealloc(report->subs, capacity * sizeof(*subs));
+        if(subs == NULL) {
+            fprintf(stderr, "%s brealloc failed\n", __func__);
+            abort();
+        }
+        report->subs = subs;
+        report->capacity = capacity;
+    }
+    memcpy(&report->subs[report->matched], shard->subs, shard->matched * sizeof(*shard->subs));
+    report->matched += shard->matched;
+}
+
+bool betree_shards_search(const struct betree_shards* shards, const char* event, struct report* report)
+{
+    // The schema is the same everywhere so the key is read with the first shard
+    struct betree_search_context* first = make_search_context(shards->trees[0]->config);
+    size_t key_shard = SIZE_MAX;
+    if(shards->key != NULL) {
+        struct betree_event* scanned = scan_event(shards->trees[0]->config, event, first);
+        struct betree_event* parsed = scanned != NULL ? NULL : make_event_from_string(shards->trees[0], event);
+        uint64_t hash;
+        if(event_key_hash(scanned != NULL ? scanned : parsed, shards->key_var, &hash)) {
+            key_shard = hash % shards->shard_count;
+        }
+        if(parsed != NULL) {
+            free_event(parsed);
+        }
+    }
+    struct shard_search_job jobs[SHARDS_MAX_COUNT];
+    size_t job_count = 0;
+    for(size_t s = 0; s < shards->shard_count; s++) {
+        if(key_shard != SIZE_MAX && s != key_shard && shards->unkeyed_counts[s] == 0) {
+            continue;
+        }
+        jobs[job_count].tree = shards->trees[s];
+        jobs[job_count].event = event;
+        jobs[job_count].context = NULL;
+        jobs[job_count].report = (struct report){ 0 };
+        job_count++;
+    }
+    if(job_count == 0) {
+        free_search_context(first);
+        return true;
+    }
+    jobs[0].context = jobs[0].tree == shards->trees[0] ? first : NULL;
+    if(jobs[0].context == NULL) {
+        free_search_context(first);
+    }
+    pthread_t threads[SHARDS_MAX_COUNT];
+    for(size_t i = 1; i < job_count; i++) {
+        if(pthread_create(&threads[i], NULL, search_shard, &jobs[i]) != 0) {
+            fprintf(stderr, "%s pthread_create failed\n", __func__);
+            abort();
+        }
+    }
+    search_shard(&jobs[0]);
+    bool valid = true;
+    for(size_t i = 0; i < job_count; i++) {
+        if(i != 0) {
+            pthread_join(threads[i], NULL);
+        }
+        valid = valid && jobs[i].valid;
+        merge_report(report, &jobs[i].report);
+        bfree(jobs[i].report.subs);
+    }
+    return valid;
+}
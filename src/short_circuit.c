@@ -0,0 +1,219 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SHORT_CIRCUIT_X86 1
+#include <immintrin.h>
+#endif
+
+#include "alloc.h"
+#include "short_circuit.h"
+#include "tree.h"
+#include "utils.h"
+
+struct short_circuit_kernels {
+    const char* name;
+    // Bit i is set when xs[i] & mask is not zero, count is at most 64
+    uint64_t (*test)(const uint64_t* xs, size_t count, uint64_t mask);
+};
+
+static uint64_t test_scalar(const uint64_t* xs, size_t count, uint64_t mask)
+{
+    uint64_t bits = 0;
+    for(size_t i = 0; i < count; i++) {
+        bits |= (uint64_t)((xs[i] & mask) != 0) << i;
+    }
+    return bits;
+}
+
+static const struct short_circuit_kernels scalar_kernels = {
+    .name = "scalar",
+    .test = test_scalar,
+};
+
+#if SHORT_CIRCUIT_X86
+
+__attribute__((target("avx2"))) static uint64_t test_avx2(const uint64_t* xs, size_t count, uint64_t mask)
+{
+    __m256i masks = _mm256_set1_epi64x((long long)mask);
+    __m256i zero = _mm256_setzero_si256();
+    uint64_t bits = 0;
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        __m256i hit = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(xs + i)), masks);
+        int none = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(hit, zero)));
+        bits |= (uint64_t)(~none & 0xf) << i;
+    }
+    return i == count ? bits : bits | (test_scalar(xs + i, count - i, mask) << i);
+}
+
+static const struct short_circuit_kernels avx2_kernels = {
+    .name = "avx2",
+    .test = test_avx2,
+};
+
+__attribute__((target("avx512f"))) static uint64_t test_avx512(const uint64_t* xs, size_t count, uint64_t mask)
+{
+    __m512i masks = _mm512_set1_epi64((long long)mask);
+    uint64_t bits = 0;
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        bits |= (uint64_t)_mm512_test_epi64_mask(_mm512_loadu_si512(xs + i), masks) << i;
+    }
+    return i == count ? bits : bits | (test_scalar(xs + i, count - i, mask) << i);
+}
+
+static const struct short_circuit_kernels avx512_kernels = {
+    .name = "avx512",
+    .test = test_avx512,
+};
+
+#endif
+
+static _Atomic(const struct short_circuit_kernels*) current_kernels = NULL;
+
+static const struct short_circuit_kernels* select_kernels(void)
+{
+#if SHORT_CIRCUIT_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f")) {
+        return &avx512_kernels;
+    }
+    if(__builtin_cpu_supports("avx2")) {
+        return &avx2_kernels;
+    }
+#endif
+    return &scalar_kernels;
+}
+
+static const struct short_circuit_kernels* get_kernels(void)
+{
+    // Racing threads all pick the same static table
+    const struct short_circuit_kernels* kernels = atomic_load_explicit(&current_kernels, memory_order_relaxed);
+    if(unlikely(kernels == NULL)) {
+        kernels = select_kernels();
+        atomic_store_explicit(&current_kernels, kernels, memory_order_relaxed);
+    }
+    return kernels;
+}
+
+const char* short_circuit_kernel_name(void)
+{
+    return get_kernels()->name;
+}
+
+static uint64_t* relayout(const uint64_t* words, size_t count, size_t word_count, size_t capacity,
+    size_t new_word_count, size_t new_capacity)
+{
+    uint64_t* grown = bcalloc(new_word_count * new_capacity * sizeof(*grown));
+    if(grown == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    for(size_t w = 0; w < word_count && count != 0; w++) {
+        memcpy(&grown[w * new_capacity], &words[w * capacity], count * sizeof(*grown));
+    }
+    return grown;
+}
+
+// Room for count subs of word_count words, keeping the first current ones
+static void reserve(struct lnode_short_circuits* masks, size_t current, size_t count, size_t word_count)
+{
+    if(count <= masks->capacity && word_count <= masks->word_count) {
+        return;
+    }
+    size_t capacity = masks->capacity;
+    if(count > capacity) {
+        capacity = capacity == 0 ? 4 : capacity;
+        while(capacity < count) {
+            capacity *= 2;
+        }
+    }
+    if(word_count < masks->word_count) {
+        word_count = masks->word_count;
+    }
+    uint64_t* pass = relayout(masks->pass, current, masks->word_count, masks->capacity, word_count, capacity);
+    uint64_t* fail = relayout(masks->fail, current, masks->word_count, masks->capacity, word_count, capacity);
+    bfree(masks->pass);
+    bfree(masks->fail);
+    masks->pass = pass;
+    masks->fail = fail;
+    masks->capacity = capacity;
+    masks->word_count = word_count;
+}
+
+static void set_short_circuit(struct lnode_short_circuits* masks, size_t index, const struct short_circuit* short_circuit)
+{
+    for(size_t w = 0; w < masks->word_count; w++) {
+        bool known = w < short_circuit->word_count;
+        masks->pass[w * masks->capacity + index] = known ? short_circuit->pass[w] : 0;
+        masks->fail[w * masks->capacity + index] = known ? short_circuit->fail[w] : 0;
+    }
+}
+
+void append_short_circuit(struct lnode_short_circuits* masks, size_t count, const struct short_circuit* short_circuit)
+{
+    reserve(masks, count, count + 1, short_circuit->word_count);
+    set_short_circuit(masks, count, short_circuit);
+}
+
+void remove_short_circuit(struct lnode_short_circuits* masks, size_t count, size_t index)
+{
+    for(size_t w = 0; w < masks->word_count; w++) {
+        uint64_t* pass = &masks->pass[w * masks->capacity];
+        uint64_t* fail = &masks->fail[w * masks->capacity];
+        memmove(&pass[index], &pass[index + 1], (count - index - 1) * sizeof(*pass));
+        memmove(&fail[index], &fail[index + 1], (count - index - 1) * sizeof(*fail));
+    }
+}
+
+void rebuild_short_circuits(struct lnode_short_circuits* masks, struct betree_sub* const* subs, size_t count)
+{
+    size_t word_count = 0;
+    for(size_t i = 0; i < count; i++) {
+        if(subs[i]->short_circuit.word_count > word_count) {
+            word_count = subs[i]->short_circuit.word_count;
+        }
+    }
+    reserve(masks, 0, count, word_count);
+    for(size_t i = 0; i < count; i++) {
+        set_short_circuit(masks, i, &subs[i]->short_circuit);
+    }
+}
+
+void free_short_circuits(struct lnode_short_circuits* masks)
+{
+    bfree(masks->pass);
+    bfree(masks->fail);
+    masks->pass = NULL;
+    masks->fail = NULL;
+    masks->capacity = 0;
+    masks->word_count = 0;
+}
+
+void classify_short_circuits(const struct lnode_short_circuits* masks,
+    size_t first,
+    size_t count,
+    const uint64_t* undefined,
+    uint64_t* pass,
+    uint64_t* fail)
+{
+    // Same outcome as try_short_circuit for each sub: the first word with a hit decides, pass first
+    const struct short_circuit_kernels* kernels = get_kernels();
+    uint64_t decided = 0;
+    *pass = 0;
+    *fail = 0;
+    for(size_t w = 0; w < masks->word_count; w++) {
+        if(undefined[w] == 0) {
+            continue;
+        }
+        uint64_t passed = kernels->test(&masks->pass[w * masks->capacity + first], count, undefined[w]);
+        uint64_t failed = kernels->test(&masks->fail[w * masks->capacity + first], count, undefined[w]);
+        *pass |= passed & ~decided;
+        *fail |= failed & ~passed & ~decided;
+        decided |= passed | failed;
+    }
+}
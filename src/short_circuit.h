@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct betree_sub;
+struct lnode_short_circuits;
+struct short_circuit;
+
+/*
+ * The short circuit masks of the subs of an lnode are kept in structure-of-arrays form so a
+ * search can check the whole lnode against the undefined attributes of an event at once
+ */
+
+void append_short_circuit(struct lnode_short_circuits* masks, size_t count, const struct short_circuit* short_circuit);
+// Keeps the order of the other subs, like remove_sub
+void remove_short_circuit(struct lnode_short_circuits* masks, size_t count, size_t index);
+void rebuild_short_circuits(struct lnode_short_circuits* masks, struct betree_sub* const* subs, size_t count);
+void free_short_circuits(struct lnode_short_circuits* masks);
+
+// Bit i of pass or fail is set when sub first + i would short circuit that way, for up to 64 subs
+void classify_short_circuits(const struct lnode_short_circuits* masks,
+    size_t first,
+    size_t count,
+    const uint64_t* undefined,
+    uint64_t* pass,
+    uint64_t* fail);
+
+// Name of the kernels picked for this CPU
+const char* short_circuit_kernel_name(void);
@@ -0,0 +1,1009 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "activation.h"
+#include "alloc.h"
+#include "ast.h"
+#include "betree.h"
+#include "config.h"
+#include "hashmap.h"
+#include "prefilter.h"
+#include "short_circuit.h"
+#include "snapshot.h"
+#include "special.h"
+#include "sub_index.h"
+#include "tree.h"
+
+/*
+ * Layout: a fixed header followed by the payload
+ *   magic[8] version:u32 endianness:u32 payload_size:u64 checksum:u64
+ * The payload holds the config, then the tree depth first with every sub's AST in pre-order.
+ * Nothing in it is a pointer, every value is written in the native byte order
+ */
+
+static const char SNAPSHOT_MAGIC[8] = { 'B', 'E', 'T', 'R', 'E', 'E', 'S', 'N' };
+static const uint32_t SNAPSHOT_ENDIANNESS = 0x01020304;
+static const uint64_t NULL_STRING_LENGTH = UINT64_MAX;
+
+struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t endianness;
+    uint64_t payload_size;
+    uint64_t checksum;
+};
+
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = data;
+    for(size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+
+/*
+ * Writing
+ */
+
+struct snapshot_writer {
+    FILE* file;
+    uint64_t size;
+    uint64_t checksum;
+    bool failed;
+};
+
+static void write_bytes(struct snapshot_writer* writer, const void* data, size_t size)
+{
+    if(writer->failed || size == 0) {
+        return;
+    }
+    if(fwrite(data, size, 1, writer->file) != 1) {
+        writer->failed = true;
+        return;
+    }
+    writer->size += size;
+    writer->checksum = fnv1a(writer->checksum, data, size);
+}
+
+static void write_u32(struct snapshot_writer* writer, uint32_t value)
+{
+    write_bytes(writer, &value, sizeof(value));
+}
+
+static void write_u64(struct snapshot_writer* writer, uint64_t value)
+{
+    write_bytes(writer, &value, sizeof(value));
+}
+
+static void write_i64(struct snapshot_writer* writer, int64_t value)
+{
+    write_bytes(writer, &value, sizeof(value));
+}
+
+static void write_f64(struct snapshot_writer* writer, double value)
+{
+    write_bytes(writer, &value, sizeof(value));
+}
+
+static void write_bool(struct snapshot_writer* writer, bool value)
+{
+    uint8_t byte = value ? 1 : 0;
+    write_bytes(writer, &byte, sizeof(byte));
+}
+
+static void write_string(struct snapshot_writer* writer, const char* string)
+{
+    if(string == NULL) {
+        write_u64(writer, NULL_STRING_LENGTH);
+        return;
+    }
+    size_t length = strlen(string);
+    write_u64(writer, length);
+    write_bytes(writer, string, length);
+}
+
+static void write_attr_var(struct snapshot_writer* writer, struct attr_var attr_var)
+{
+    write_string(writer, attr_var.attr);
+    write_u64(writer, attr_var.var);
+}
+
+static void write_string_value(struct snapshot_writer* writer, struct string_value value)
+{
+    write_string(writer, value.string);
+    write_u64(writer, value.var);
+    write_u64(writer, value.str);
+}
+
+static void write_integer_enum_value(struct snapshot_writer* writer, struct integer_enum_value value)
+{
+    write_i64(writer, value.integer);
+    write_u64(writer, value.var);
+    write_u64(writer, value.ienum);
+}
+
+static void write_integer_list(struct snapshot_writer* writer, const struct betree_integer_list* list)
+{
+    write_u64(writer, list->count);
+    for(size_t i = 0; i < list->count; i++) {
+        write_i64(writer, list->integers[i]);
+    }
+}
+
+static void write_string_list(struct snapshot_writer* writer, const struct betree_string_list* list)
+{
+    write_u64(writer, list->count);
+    for(size_t i = 0; i < list->count; i++) {
+        write_string_value(writer, list->strings[i]);
+    }
+}
+
+static void write_integer_enum_list(struct snapshot_writer* writer, const struct betree_integer_enum_list* list)
+{
+    write_u64(writer, list->count);
+    for(size_t i = 0; i < list->count; i++) {
+        write_integer_enum_value(writer, list->integers[i]);
+    }
+}
+
+static void write_bound(struct snapshot_writer* writer, struct value_bound bound)
+{
+    write_u32(writer, bound.value_type);
+    switch(bound.value_type) {
+        case BETREE_BOOLEAN:
+            write_bool(writer, bound.bmin);
+            write_bool(writer, bound.bmax);
+            break;
+        case BETREE_INTEGER:
+        case BETREE_INTEGER_LIST:
+            write_i64(writer, bound.imin);
+            write_i64(writer, bound.imax);
+            break;
+        case BETREE_FLOAT:
+            write_f64(writer, bound.fmin);
+            write_f64(writer, bound.fmax);
+            break;
+        case BETREE_STRING:
+        case BETREE_STRING_LIST:
+        case BETREE_INTEGER_ENUM:
+        case BETREE_INTEGER_LIST_ENUM:
+            write_u64(writer, bound.smin);
+            write_u64(writer, bound.smax);
+            break;
+        case BETREE_SEGMENTS:
+        case BETREE_FREQUENCY_CAPS:
+            break;
+        default: abort();
+    }
+}
+
+static void write_special(struct snapshot_writer* writer, const struct ast_special_expr* special)
+{
+    write_u32(writer, special->type);
+    switch(special->type) {
+        case AST_SPECIAL_FREQUENCY:
+            write_u32(writer, special->frequency.op);
+            write_attr_var(writer, special->frequency.attr_var);
+            write_u32(writer, special->frequency.type);
+            write_string_value(writer, special->frequency.ns);
+            write_i64(writer, special->frequency.value);
+            write_u64(writer, special->frequency.length);
+            write_attr_var(writer, special->frequency.now);
+            write_u32(writer, special->frequency.id);
+            break;
+        case AST_SPECIAL_SEGMENT:
+            write_u32(writer, special->segment.op);
+            write_bool(writer, special->segment.has_variable);
+            write_attr_var(writer, special->segment.attr_var);
+            write_u64(writer, special->segment.segment_id);
+            write_i64(writer, special->segment.seconds);
+            write_attr_var(writer, special->segment.now);
+            break;
+        case AST_SPECIAL_GEO:
+            write_u32(writer, special->geo.op);
+            write_bool(writer, special->geo.has_radius);
+            write_f64(writer, special->geo.latitude);
+            write_f64(writer, special->geo.longitude);
+            write_f64(writer, special->geo.radius);
+            write_attr_var(writer, special->geo.latitude_var);
+            write_attr_var(writer, special->geo.longitude_var);
+            break;
+        case AST_SPECIAL_STRING:
+            write_u32(writer, special->string.op);
+            write_attr_var(writer, special->string.attr_var);
+            write_string(writer, special->string.pattern);
+            break;
+        default: abort();
+    }
+}
+
+static void write_set(struct snapshot_writer* writer, const struct ast_set_expr* set)
+{
+    write_u32(writer, set->op);
+    write_u32(writer, set->left_value.value_type);
+    switch(set->left_value.value_type) {
+        case AST_SET_LEFT_VALUE_INTEGER:
+            write_i64(writer, set->left_value.integer_value);
+            break;
+        case AST_SET_LEFT_VALUE_STRING:
+            write_string_value(writer, set->left_value.string_value);
+            break;
+        case AST_SET_LEFT_VALUE_VARIABLE:
+            write_attr_var(writer, set->left_value.variable_value);
+            break;
+        default: abort();
+    }
+    write_u32(writer, set->right_value.value_type);
+    switch(set->right_value.value_type) {
+        case AST_SET_RIGHT_VALUE_INTEGER_LIST:
+            write_integer_list(writer, set->right_value.integer_list_value);
+            break;
+        case AST_SET_RIGHT_VALUE_STRING_LIST:
+            write_string_list(writer, set->right_value.string_list_value);
+            break;
+        case AST_SET_RIGHT_VALUE_VARIABLE:
+            write_attr_var(writer, set->right_value.variable_value);
+            break;
+        case AST_SET_RIGHT_VALUE_INTEGER_LIST_ENUM:
+            write_integer_enum_list(writer, set->right_value.integer_enum_list_value);
+            break;
+        default: abort();
+    }
+}
+
+static void write_node(struct snapshot_writer* writer, const struct pred_map* pred_map, const struct ast_node* node)
+{
+    write_u64(writer, node->global_id);
+    write_u64(writer, node->memoize_id);
+    // Only the first node seen for a predicate is in the pred map, the others share its ids
+    write_bool(writer, is_pred_in_map(pred_map, node));
+    write_u32(writer, node->type);
+    switch(node->type) {
+        case AST_TYPE_COMPARE_EXPR:
+            write_u32(writer, node->compare_expr.op);
+            write_attr_var(writer, node->compare_expr.attr_var);
+            write_u32(writer, node->compare_expr.value.value_type);
+            switch(node->compare_expr.value.value_type) {
+                case AST_COMPARE_VALUE_INTEGER:
+                    write_i64(writer, node->compare_expr.value.integer_value);
+                    break;
+                case AST_COMPARE_VALUE_FLOAT:
+                    write_f64(writer, node->compare_expr.value.float_value);
+                    break;
+                default: abort();
+            }
+            break;
+        case AST_TYPE_EQUALITY_EXPR:
+            write_u32(writer, node->equality_expr.op);
+            write_attr_var(writer, node->equality_expr.attr_var);
+            write_u32(writer, node->equality_expr.value.value_type);
+            switch(node->equality_expr.value.value_type) {
+                case AST_EQUALITY_VALUE_INTEGER:
+                    write_i64(writer, node->equality_expr.value.integer_value);
+                    break;
+                case AST_EQUALITY_VALUE_FLOAT:
+                    write_f64(writer, node->equality_expr.value.float_value);
+                    break;
+                case AST_EQUALITY_VALUE_STRING:
+                    write_string_value(writer, node->equality_expr.value.string_value);
+                    break;
+                case AST_EQUALITY_VALUE_INTEGER_ENUM:
+                    write_integer_enum_value(writer, node->equality_expr.value.integer_enum_value);
+                    break;
+                default: abort();
+            }
+            break;
+        case AST_TYPE_BOOL_EXPR:
+            write_u32(writer, node->bool_expr.op);
+            switch(node->bool_expr.op) {
+                case AST_BOOL_OR:
+                case AST_BOOL_AND:
+                    write_node(writer, pred_map, node->bool_expr.binary.lhs);
+                    write_node(writer, pred_map, node->bool_expr.binary.rhs);
+                    break;
+                case AST_BOOL_NOT:
+                    write_node(writer, pred_map, node->bool_expr.unary.expr);
+                    break;
+                case AST_BOOL_VARIABLE:
+                    write_attr_var(writer, node->bool_expr.variable);
+                    break;
+                case AST_BOOL_LITERAL:
+                    write_bool(writer, node->bool_expr.literal);
+                    break;
+                default: abort();
+            }
+            break;
+        case AST_TYPE_SET_EXPR:
+            write_set(writer, &node->set_expr);
+            break;
+        case AST_TYPE_LIST_EXPR:
+            write_u32(writer, node->list_expr.op);
+            write_attr_var(writer, node->list_expr.attr_var);
+            write_u32(writer, node->list_expr.value.value_type);
+            switch(node->list_expr.value.value_type) {
+                case AST_LIST_VALUE_INTEGER_LIST:
+                    write_integer_list(writer, node->list_expr.value.integer_list_value);
+                    break;
+                case AST_LIST_VALUE_STRING_LIST:
+                    write_string_list(writer, node->list_expr.value.string_list_value);
+                    break;
+                default: abort();
+            }
+            break;
+        case AST_TYPE_SPECIAL_EXPR:
+            write_special(writer, &node->special_expr);
+            break;
+        case AST_TYPE_IS_NULL_EXPR:
+            write_u32(writer, node->is_null_expr.type);
+            write_attr_var(writer, node->is_null_expr.attr_var);
+            break;
+        default: abort();
+    }
+}
+
+static void write_config(struct snapshot_writer* writer, const struct config* config)
+{
+    write_u32(writer, config->lnode_max_cap);
+    write_u32(writer, config->partition_min_size);
+    write_u32(writer, config->max_domain_for_split);
+    write_bool(writer, config->reorder_expressions);
+    write_bool(writer, config->prefilter);
+    write_bool(writer, config->balanced_splits);
+    write_u64(writer, config->attr_domain_count);
+    for(size_t i = 0; i < config->attr_domain_count; i++) {
+        const struct attr_domain* attr_domain = config->attr_domains[i];
+        write_attr_var(writer, attr_domain->attr_var);
+        write_bound(writer, attr_domain->bound);
+        write_bool(writer, attr_domain->allow_undefined);
+    }
+    write_u64(writer, config->string_map_count);
+    for(size_t i = 0; i < config->string_map_count; i++) {
+        struct string_map* string_map = &config->string_maps[i];
+        write_attr_var(writer, string_map->attr_var);
+        write_u64(writer, string_map->string_value_count);
+        if(string_map->string_value_count == 0) {
+            continue;
+        }
+        // Strings are written in id order so the ids come back implicitly
+        for(size_t j = 0; j < string_map->string_value_count; j++) {
+            write_string(writer, string_map->string_values[j]);
+        }
+    }
+    write_u64(writer, config->integer_map_count);
+    for(size_t i = 0; i < config->integer_map_count; i++) {
+        const struct integer_map* integer_map = &config->integer_maps[i];
+        write_attr_var(writer, integer_map->attr_var);
+        write_u64(writer, integer_map->integer_value_count);
+        for(size_t j = 0; j < integer_map->integer_value_count; j++) {
+            write_i64(writer, integer_map->integer_values[j]);
+        }
+    }
+    write_u64(writer, config->pred_map->pred_count);
+    write_u64(writer, config->pred_map->memoize_count);
+    write_i64(writer, config->activation->now);
+}
+
+static void write_cnode(struct snapshot_writer* writer, const struct config* config, const struct cnode* cnode);
+
+static void write_cdir(struct snapshot_writer* writer, const struct config* config, const struct cdir* cdir)
+{
+    write_attr_var(writer, cdir->attr_var);
+    write_bound(writer, cdir->bound);
+    write_cnode(writer, config, cdir->cnode);
+    write_bool(writer, cdir->lchild != NULL);
+    if(cdir->lchild != NULL) {
+        write_cdir(writer, config, cdir->lchild);
+    }
+    write_bool(writer, cdir->rchild != NULL);
+    if(cdir->rchild != NULL) {
+        write_cdir(writer, config, cdir->rchild);
+    }
+}
+
+static void write_cnode(struct snapshot_writer* writer, const struct config* config, const struct cnode* cnode)
+{
+    const struct lnode* lnode = cnode->lnode;
+    write_u64(writer, lnode->max);
+    write_u64(writer, lnode->sub_count);
+    for(size_t i = 0; i < lnode->sub_count; i++) {
+        write_u64(writer, lnode->subs[i]->id);
+        write_i64(writer, lnode->subs[i]->priority);
+        write_i64(writer, lnode->subs[i]->window_start);
+        write_i64(writer, lnode->subs[i]->window_end);
+        write_node(writer, config->pred_map, lnode->subs[i]->expr);
+    }
+    size_t pnode_count = cnode->pdir == NULL ? 0 : cnode->pdir->pnode_count;
+    write_u64(writer, pnode_count);
+    for(size_t i = 0; i < pnode_count; i++) {
+        const struct pnode* pnode = cnode->pdir->pnodes[i];
+        write_attr_var(writer, pnode->attr_var);
+        write_f64(writer, pnode->score);
+        write_cdir(writer, config, pnode->cdir);
+    }
+}
+
+bool save_snapshot(const struct betree* betree, const char* path)
+{
+    FILE* file = fopen(path, "wb");
+    if(file == NULL) {
+        fprintf(stderr, "%s can't open %s\n", __func__, path);
+        return false;
+    }
+    struct snapshot_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = BETREE_SNAPSHOT_VERSION;
+    header.endianness = SNAPSHOT_ENDIANNESS;
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    struct snapshot_writer writer = { .file = file, .size = 0, .checksum = FNV_OFFSET, .failed = !written };
+    write_config(&writer, betree->config);
+    write_cnode(&writer, betree->config, betree->cnode);
+
+    // Size and checksum are only known once the payload is out
+    header.payload_size = writer.size;
+    header.checksum = writer.checksum;
+    bool failed = writer.failed || fseek(file, 0, SEEK_SET) != 0
+        || fwrite(&header, sizeof(header), 1, file) != 1;
+    failed = fclose(file) != 0 || failed;
+    if(failed) {
+        fprintf(stderr, "%s failed to write %s\n", __func__, path);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Reading, the checksum is verified before anything is decoded so a short read here means a bug
+ */
+
+struct snapshot_reader {
+    const uint8_t* data;
+    size_t size;
+    size_t position;
+};
+
+static void read_bytes(struct snapshot_reader* reader, void* data, size_t size)
+{
+    if(size > reader->size - reader->position) {
+        fprintf(stderr, "%s snapshot is truncated\n", __func__);
+        abort();
+    }
+    memcpy(data, reader->data + reader->position, size);
+    reader->position += size;
+}
+
+static uint32_t read_u32(struct snapshot_reader* reader)
+{
+    uint32_t value;
+    read_bytes(reader, &value, sizeof(value));
+    return value;
+}
+
+static uint64_t read_u64(struct snapshot_reader* reader)
+{
+    uint64_t value;
+    read_bytes(reader, &value, sizeof(value));
+    return value;
+}
+
+static int64_t read_i64(struct snapshot_reader* reader)
+{
+    int64_t value;
+    read_bytes(reader, &value, sizeof(value));
+    return value;
+}
+
+static double read_f64(struct snapshot_reader* reader)
+{
+    double value;
+    read_bytes(reader, &value, sizeof(value));
+    return value;
+}
+
+static bool read_bool(struct snapshot_reader* reader)
+{
+    uint8_t byte;
+    read_bytes(reader, &byte, sizeof(byte));
+    return byte != 0;
+}
+
+static void* read_alloc(size_t size)
+{
+    if(size == 0) {
+        return NULL;
+    }
+    void* data = bcalloc(size);
+    if(data == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    return data;
+}
+
+static char* read_string(struct snapshot_reader* reader)
+{
+    uint64_t length = read_u64(reader);
+    if(length == NULL_STRING_LENGTH) {
+        return NULL;
+    }
+    if(length > reader->size - reader->position) {
+        fprintf(stderr, "%s snapshot is truncated\n", __func__);
+        abort();
+    }
+    char* string = read_alloc(length + 1);
+    read_bytes(reader, string, length);
+    string[length] = '\0';
+    return string;
+}
+
+static struct attr_var read_attr_var(struct snapshot_reader* reader)
+{
+    struct attr_var attr_var;
+    attr_var.attr = read_string(reader);
+    attr_var.var = read_u64(reader);
+    return attr_var;
+}
+
+static struct string_value read_string_value(struct snapshot_reader* reader)
+{
+    struct string_value value;
+    value.string = read_string(reader);
+    value.var = read_u64(reader);
+    value.str = read_u64(reader);
+    return value;
+}
+
+static struct integer_enum_value read_integer_enum_value(struct snapshot_reader* reader)
+{
+    struct integer_enum_value value;
+    value.integer = read_i64(reader);
+    value.var = read_u64(reader);
+    value.ienum = read_u64(reader);
+    return value;
+}
+
+static struct betree_integer_list* read_integer_list(struct snapshot_reader* reader)
+{
+    struct betree_integer_list* list = make_integer_list();
+    list->count = read_u64(reader);
+    list->integers = read_alloc(list->count * sizeof(*list->integers));
+    for(size_t i = 0; i < list->count; i++) {
+        list->integers[i] = read_i64(reader);
+    }
+    return list;
+}
+
+static struct betree_string_list* read_string_list(struct snapshot_reader* reader)
+{
+    struct betree_string_list* list = make_string_list();
+    list->count = read_u64(reader);
+    list->strings = read_alloc(list->count * sizeof(*list->strings));
+    for(size_t i = 0; i < list->count; i++) {
+        list->strings[i] = read_string_value(reader);
+    }
+    return list;
+}
+
+static struct betree_integer_enum_list* read_integer_enum_list(struct snapshot_reader* reader)
+{
+    size_t count = read_u64(reader);
+    struct betree_integer_enum_list* list = make_integer_enum_list(count);
+    for(size_t i = 0; i < count; i++) {
+        list->integers[i] = read_integer_enum_value(reader);
+    }
+    return list;
+}
+
+static struct value_bound read_bound(struct snapshot_reader* reader)
+{
+    struct value_bound bound;
+    memset(&bound, 0, sizeof(bound));
+    bound.value_type = read_u32(reader);
+    switch(bound.value_type) {
+        case BETREE_BOOLEAN:
+            bound.bmin = read_bool(reader);
+            bound.bmax = read_bool(reader);
+            break;
+        case BETREE_INTEGER:
+        case BETREE_INTEGER_LIST:
+            bound.imin = read_i64(reader);
+            bound.imax = read_i64(reader);
+            break;
+        case BETREE_FLOAT:
+            bound.fmin = read_f64(reader);
+            bound.fmax = read_f64(reader);
+            break;
+        case BETREE_STRING:
+        case BETREE_STRING_LIST:
+        case BETREE_INTEGER_ENUM:
+        case BETREE_INTEGER_LIST_ENUM:
+            bound.smin = read_u64(reader);
+            bound.smax = read_u64(reader);
+            break;
+        case BETREE_SEGMENTS:
+        case BETREE_FREQUENCY_CAPS:
+            break;
+        default: abort();
+    }
+    return bound;
+}
+
+static void read_special(struct snapshot_reader* reader, struct ast_special_expr* special)
+{
+    special->type = read_u32(reader);
+    switch(special->type) {
+        case AST_SPECIAL_FREQUENCY:
+            special->frequency.op = read_u32(reader);
+            special->frequency.attr_var = read_attr_var(reader);
+            special->frequency.type = read_u32(reader);
+            special->frequency.ns = read_string_value(reader);
+            special->frequency.value = read_i64(reader);
+            special->frequency.length = read_u64(reader);
+            special->frequency.now = read_attr_var(reader);
+            special->frequency.id = read_u32(reader);
+            break;
+        case AST_SPECIAL_SEGMENT:
+            special->segment.op = read_u32(reader);
+            special->segment.has_variable = read_bool(reader);
+            special->segment.attr_var = read_attr_var(reader);
+            special->segment.segment_id = read_u64(reader);
+            special->segment.seconds = read_i64(reader);
+            special->segment.now = read_attr_var(reader);
+            break;
+        case AST_SPECIAL_GEO:
+            special->geo.op = read_u32(reader);
+            special->geo.has_radius = read_bool(reader);
+            special->geo.latitude = read_f64(reader);
+            special->geo.longitude = read_f64(reader);
+            special->geo.radius = read_f64(reader);
+            special->geo.latitude_var = read_attr_var(reader);
+            special->geo.longitude_var = read_attr_var(reader);
+            prepare_geo(&special->geo);
+            break;
+        case AST_SPECIAL_STRING:
+            special->string.op = read_u32(reader);
+            special->string.attr_var = read_attr_var(reader);
+            special->string.pattern = read_string(reader);
+            break;
+        default: abort();
+    }
+}
+
+static void read_set(struct snapshot_reader* reader, struct ast_set_expr* set)
+{
+    set->op = read_u32(reader);
+    set->left_value.value_type = read_u32(reader);
+    switch(set->left_value.value_type) {
+        case AST_SET_LEFT_VALUE_INTEGER:
+            set->left_value.integer_value = read_i64(reader);
+            break;
+        case AST_SET_LEFT_VALUE_STRING:
+            set->left_value.string_value = read_string_value(reader);
+            break;
+        case AST_SET_LEFT_VALUE_VARIABLE:
+            set->left_value.variable_value = read_attr_var(reader);
+            break;
+        default: abort();
+    }
+    set->right_value.value_type = read_u32(reader);
+    switch(set->right_value.value_type) {
+        case AST_SET_RIGHT_VALUE_INTEGER_LIST:
+            set->right_value.integer_list_value = read_integer_list(reader);
+            break;
+        case AST_SET_RIGHT_VALUE_STRING_LIST:
+            set->right_value.string_list_value = read_string_list(reader);
+            break;
+        case AST_SET_RIGHT_VALUE_VARIABLE:
+            set->right_value.variable_value = read_attr_var(reader);
+            break;
+        case AST_SET_RIGHT_VALUE_INTEGER_LIST_ENUM:
+            set->right_value.integer_enum_list_value = read_integer_enum_list(reader);
+            break;
+        default: abort();
+    }
+}
+
+static struct ast_node* read_node(struct snapshot_reader* reader, struct pred_map* pred_map)
+{
+    struct ast_node* node = ast_node_create();
+    node->global_id = read_u64(reader);
+    node->memoize_id = read_u64(reader);
+    bool in_pred_map = read_bool(reader);
+    node->type = read_u32(reader);
+    switch(node->type) {
+        case AST_TYPE_COMPARE_EXPR:
+            node->compare_expr.op = read_u32(reader);
+            node->compare_expr.attr_var = read_attr_var(reader);
+            node->compare_expr.value.value_type = read_u32(reader);
+            switch(node->compare_expr.value.value_type) {
+                case AST_COMPARE_VALUE_INTEGER:
+                    node->compare_expr.value.integer_value = read_i64(reader);
+                    break;
+                case AST_COMPARE_VALUE_FLOAT:
+                    node->compare_expr.value.float_value = read_f64(reader);
+                    break;
+                default: abort();
+            }
+            break;
+        case AST_TYPE_EQUALITY_EXPR:
+            node->equality_expr.op = read_u32(reader);
+            node->equality_expr.attr_var = read_attr_var(reader);
+            node->equality_expr.value.value_type = read_u32(reader);
+            switch(node->equality_expr.value.value_type) {
+                case AST_EQUALITY_VALUE_INTEGER:
+                    node->equality_expr.value.integer_value = read_i64(reader);
+                    break;
+                case AST_EQUALITY_VALUE_FLOAT:
+                    node->equality_expr.value.float_value = read_f64(reader);
+                    break;
+                case AST_EQUALITY_VALUE_STRING:
+                    node->equality_expr.value.string_value = read_string_value(reader);
+                    break;
+                case AST_EQUALITY_VALUE_INTEGER_ENUM:
+                    node->equality_expr.value.integer_enum_value = read_integer_enum_value(reader);
+                    break;
+                default: abort();
+            }
+            break;
+        case AST_TYPE_BOOL_EXPR:
+            node->bool_expr.op = read_u32(reader);
+            switch(node->bool_expr.op) {
+                case AST_BOOL_OR:
+                case AST_BOOL_AND:
+                    node->bool_expr.binary.lhs = read_node(reader, pred_map);
+                    node->bool_expr.binary.rhs = read_node(reader, pred_map);
+                    break;
+                case AST_BOOL_NOT:
+                    node->bool_expr.unary.expr = read_node(reader, pred_map);
+                    break;
+                case AST_BOOL_VARIABLE:
+                    node->bool_expr.variable = read_attr_var(reader);
+                    break;
+                case AST_BOOL_LITERAL:
+                    node->bool_expr.literal = read_bool(reader);
+                    break;
+                default: abort();
+            }
+            break;
+        case AST_TYPE_SET_EXPR:
+            read_set(reader, &node->set_expr);
+            break;
+        case AST_TYPE_LIST_EXPR:
+            node->list_expr.op = read_u32(reader);
+            node->list_expr.attr_var = read_attr_var(reader);
+            node->list_expr.value.value_type = read_u32(reader);
+            switch(node->list_expr.value.value_type) {
+                case AST_LIST_VALUE_INTEGER_LIST:
+                    node->list_expr.value.integer_list_value = read_integer_list(reader);
+                    break;
+                case AST_LIST_VALUE_STRING_LIST:
+                    node->list_expr.value.string_list_value = read_string_list(reader);
+                    break;
+                default: abort();
+            }
+            break;
+        case AST_TYPE_SPECIAL_EXPR:
+            read_special(reader, &node->special_expr);
+            break;
+        case AST_TYPE_IS_NULL_EXPR:
+            node->is_null_expr.type = read_u32(reader);
+            node->is_null_expr.attr_var = read_attr_var(reader);
+            break;
+        default: abort();
+    }
+    // Children are complete at this point, which the pred map ordering relies on
+    if(in_pred_map) {
+        // A shared subtree is written once per sub that uses it
+        struct ast_node* find = find_pred(pred_map, node);
+        if(find != NULL) {
+            find->ref_count++;
+            free_ast_node(node);
+            return find;
+        }
+        insert_pred(pred_map, node);
+    }
+    return node;
+}
+
+static struct config* read_config(struct snapshot_reader* reader)
+{
+    uint32_t lnode_max_cap = read_u32(reader);
+    uint32_t partition_min_size = read_u32(reader);
+    struct config* config = make_config(lnode_max_cap, partition_min_size);
+    config->max_domain_for_split = read_u32(reader);
+    config->reorder_expressions = read_bool(reader);
+    config->prefilter = read_bool(reader);
+    config->balanced_splits = read_bool(reader);
+
+    config->attr_domain_count = read_u64(reader);
+    config->attr_domains = read_alloc(config->attr_domain_count * sizeof(*config->attr_domains));
+    for(size_t i = 0; i < config->attr_domain_count; i++) {
+        struct attr_domain* attr_domain = read_alloc(sizeof(*attr_domain));
+        attr_domain->attr_var = read_attr_var(reader);
+        attr_domain->bound = read_bound(reader);
+        attr_domain->allow_undefined = read_bool(reader);
+        config->attr_domains[i] = attr_domain;
+    }
+
+    config->string_map_count = read_u64(reader);
+    config->string_maps = read_alloc(config->string_map_count * sizeof(*config->string_maps));
+    for(size_t i = 0; i < config->string_map_count; i++) {
+        struct string_map* string_map = &config->string_maps[i];
+        string_map->attr_var = read_attr_var(reader);
+        string_map->string_value_count = read_u64(reader);
+        string_map->string_values
+            = read_alloc(string_map->string_value_count * sizeof(*string_map->string_values));
+        for(size_t j = 0; j < string_map->string_value_count; j++) {
+            string_map->string_values[j] = read_string(reader);
+        }
+    }
+
+    config->integer_map_count = read_u64(reader);
+    config->integer_maps = read_alloc(config->integer_map_count * sizeof(*config->integer_maps));
+    for(size_t i = 0; i < config->integer_map_count; i++) {
+        struct integer_map* integer_map = &config->integer_maps[i];
+        integer_map->attr_var = read_attr_var(reader);
+        integer_map->integer_value_count = read_u64(reader);
+        integer_map->integer_values
+            = read_alloc(integer_map->integer_value_count * sizeof(*integer_map->integer_values));
+        for(size_t j = 0; j < integer_map->integer_value_count; j++) {
+            integer_map->integer_values[j] = read_i64(reader);
+        }
+    }
+
+    index_config_maps(config);
+
+    config->pred_map->pred_count = read_u64(reader);
+    config->pred_map->memoize_count = read_u64(reader);
+    config->activation->now = read_i64(reader);
+    return config;
+}
+
+static void read_cnode(struct snapshot_reader* reader,
+    struct betree* betree,
+    struct cnode* cnode);
+
+static struct cdir* read_cdir(struct snapshot_reader* reader, struct betree* betree)
+{
+    struct cdir* cdir = read_alloc(sizeof(*cdir));
+    cdir->attr_var = read_attr_var(reader);
+    cdir->bound = read_bound(reader);
+    cdir->cnode = make_cnode(betree->config, cdir);
+    read_cnode(reader, betree, cdir->cnode);
+    if(read_bool(reader)) {
+        cdir->lchild = read_cdir(reader, betree);
+        cdir->lchild->parent_type = CNODE_PARENT_CDIR;
+        cdir->lchild->cdir_parent = cdir;
+    }
+    if(read_bool(reader)) {
+        cdir->rchild = read_cdir(reader, betree);
+        cdir->rchild->parent_type = CNODE_PARENT_CDIR;
+        cdir->rchild->cdir_parent = cdir;
+    }
+    return cdir;
+}
+
+static void read_cnode(struct snapshot_reader* reader,
+    struct betree* betree,
+    struct cnode* cnode)
+{
+    struct lnode* lnode = cnode->lnode;
+    lnode->max = read_u64(reader);
+    lnode->sub_count = read_u64(reader);
+    lnode->subs = read_alloc(lnode->sub_count * sizeof(*lnode->subs));
+    for(size_t i = 0; i < lnode->sub_count; i++) {
+        betree_sub_t id = read_u64(reader);
+        int64_t priority = read_i64(reader);
+        int64_t window_start = read_i64(reader);
+        int64_t window_end = read_i64(reader);
+        struct ast_node* node = read_node(reader, betree->config->pred_map);
+        // attr_vars and the short circuits are cheap to derive again from the AST
+        struct betree_sub* sub = make_sub(betree->config, id, node);
+        sub->priority = priority;
+        sub->window_start = window_start;
+        sub->window_end = window_end;
+        sub->lnode = lnode;
+        lnode->subs[i] = sub;
+        sub_index_add(betree->sub_index, sub);
+        schedule_activation(betree->config->activation, sub);
+    }
+    rebuild_short_circuits(&lnode->short_circuits, lnode->subs, lnode->sub_count);
+    if(lnode->postings != NULL) {
+        index_lnode_postings(lnode, true);
+    }
+    size_t pnode_count = read_u64(reader);
+    if(pnode_count == 0) {
+        return;
+    }
+    struct pdir* pdir = read_alloc(sizeof(*pdir));
+    pdir->parent = cnode;
+    pdir->pnode_count = pnode_count;
+    pdir->pnodes = read_alloc(pnode_count * sizeof(*pdir->pnodes));
+    for(size_t i = 0; i < pnode_count; i++) {
+        struct pnode* pnode = read_alloc(sizeof(*pnode));
+        pnode->parent = pdir;
+        pnode->attr_var = read_attr_var(reader);
+        pnode->score = read_f64(reader);
+        pnode->cdir = read_cdir(reader, betree);
+        pnode->cdir->parent_type = CNODE_PARENT_PNODE;
+        pnode->cdir->pnode_parent = pnode;
+        pnode->allow_undefined = betree->config->attr_domains[pnode->attr_var.var]->allow_undefined;
+        pdir->pnodes[i] = pnode;
+    }
+    // Older snapshots kept the pnodes in creation order
+    sort_pdir(pdir);
+    cnode->pdir = pdir;
+}
+
+static bool is_valid_header(const struct snapshot_header* header, size_t file_size, const uint8_t* payload)
+{
+    if(memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0) {
+        fprintf(stderr, "Not a betree snapshot\n");
+        return false;
+    }
+    if(header->version != BETREE_SNAPSHOT_VERSION) {
+        fprintf(stderr, "Unsupported snapshot version %u\n", header->version);
+        return false;
+    }
+    if(header->endianness != SNAPSHOT_ENDIANNESS) {
+        fprintf(stderr, "Snapshot was written with another byte order\n");
+        return false;
+    }
+    if(header->payload_size != file_size - sizeof(*header)) {
+        fprintf(stderr, "Snapshot size does not match its header\n");
+        return false;
+    }
+    if(fnv1a(FNV_OFFSET, payload, header->payload_size) != header->checksum) {
+        fprintf(stderr, "Snapshot checksum mismatch\n");
+        return false;
+    }
+    return true;
+}
+
+bool load_snapshot(struct betree* betree, const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        fprintf(stderr, "%s can't open %s\n", __func__, path);
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct snapshot_header)) {
+        fprintf(stderr, "%s %s is too small to be a snapshot\n", __func__, path);
+        close(fd);
+        return false;
+    }
+    size_t file_size = st.st_size;
+    const uint8_t* data = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+        fprintf(stderr, "%s can't map %s\n", __func__, path);
+        return false;
+    }
+    struct snapshot_header header;
+    memcpy(&header, data, sizeof(header));
+    const uint8_t* payload = data + sizeof(header);
+    if(!is_valid_header(&header, file_size, payload)) {
+        munmap((void*)data, file_size);
+        return false;
+    }
+
+    struct snapshot_reader reader = { .data = payload, .size = header.payload_size, .position = 0 };
+    betree->config = read_config(&reader);
+    betree->sub_index = make_sub_index();
+    betree->cnode = make_cnode(betree->config, NULL);
+    read_cnode(&reader, betree, betree->cnode);
+    require_be_tree(betree->cnode);
+    munmap((void*)data, file_size);
+    return true;
+}
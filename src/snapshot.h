@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdbool.h>
+
+struct betree;
+
+// Bump whenever the layout written by save_snapshot changes
+#define BETREE_SNAPSHOT_VERSION 6
+
+bool save_snapshot(const struct betree* betree, const char* path);
+bool load_snapshot(struct betree* betree, const char* path);
@@ -0,0 +1,491 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SORTED_LIST_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define SORTED_LIST_NEON 1
+#include <arm_neon.h>
+#endif
+
+#include "sorted_list.h"
+#include "utils.h"
+#include "value.h"
+
+/*
+ * Intersections use a block merge when both lists have similar sizes and gallop through the
+ * larger one when it is GALLOP_RATIO times bigger. Integer merges and scans are vectorized with
+ * the widest kernels the CPU has, picked on first use. String lists hold ids inside
+ * struct string_value so they would need gathers, they only get the adaptive scalar paths
+ */
+
+enum { GALLOP_RATIO = 16, SCAN_WINDOW = 16 };
+
+struct integer_kernels {
+    const char* name;
+    bool (*scan)(const int64_t* xs, size_t count, int64_t value);
+    bool (*intersects)(const int64_t* xs, size_t x_count, const int64_t* ys, size_t y_count);
+    bool (*includes)(const int64_t* xs, size_t x_count, const int64_t* ys, size_t y_count);
+};
+
+static bool scan_integer_scalar(const int64_t* xs, size_t count, int64_t value)
+{
+    bool found = false;
+    for(size_t i = 0; i < count; i++) {
+        found |= xs[i] == value;
+    }
+    return found;
+}
+
+static bool intersects_integer_scalar(const int64_t* xs, size_t x_count, const int64_t* ys, size_t y_count)
+{
+    size_t i = 0, j = 0;
+    while(i < x_count && j < y_count) {
+        int64_t x = xs[i];
+        int64_t y = ys[j];
+        if(x == y) {
+            return true;
+        }
+        i += x < y;
+        j += y < x;
+    }
+    return false;
+}
+
+static bool includes_integer_scalar(const int64_t* xs, size_t x_count, const int64_t* ys, size_t y_count)
+{
+    size_t i = 0;
+    for(size_t j = 0; j < y_count; j++) {
+        while(i < x_count && xs[i] < ys[j]) {
+            i++;
+        }
+        if(i == x_count || xs[i] != ys[j]) {
+            return false;
+        }
+        i++;
+    }
+    return true;
+}
+
+static const struct integer_kernels scalar_kernels = {
+    .name = "scalar",
+    .scan = scan_integer_scalar,
+    .intersects = intersects_integer_scalar,
+    .includes = includes_integer_scalar,
+};
+
+#if SORTED_LIST_X86
+
+__attribute__((target("avx2"))) static bool scan_integer_avx2(const int64_t* xs, size_t count, int64_t value)
+{
+    __m256i needle = _mm256_set1_epi64x(value);
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        __m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(xs + i)), needle);
+        if(!_mm256_testz_si256(eq, eq)) {
+            return true;
+        }
+    }
+    return scan_integer_scalar(xs + i, count - i, value);
+}
+
+__attribute__((target("avx2"))) static bool intersects_integer_avx2(
+    const int64_t* xs, size_t x_count, const int64_t* ys, size_t y_count)
+{
+    // Every pair of two blocks of 4 is compared by rotating one of them
+    size_t i = 0, j = 0;
+    while(i + 4 <= x_count && j + 4 <= y_count) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(xs + i));
+        __m256i y = _mm256_loadu_si256((const __m256i*)(ys + j));
+        __m256i eq = _mm256_cmpeq_epi64(x, y);
+        eq = _mm256_or_si256(eq, _mm256_cmpeq_epi64(x, _mm256_permute4x64_epi64(y, _MM_SHUFFLE(0, 3, 2, 1))));
+        eq = _mm256_or_si256(eq, _mm256_cmpeq_epi64(x, _mm256_permute4x64_epi64(y, _MM_SHUFFLE(1, 0, 3, 2))));
+        eq = _mm256_or_si256(eq, _mm256_cmpeq_epi64(x, _mm256_permute4x64_epi64(y, _MM_SHUFFLE(2, 1, 0, 3))));
+        if(!_mm256_testz_si256(eq, eq)) {
+            return true;
+        }
+        int64_t x_last = xs[i + 3];
+        int64_t y_last = ys[j + 3];
+        i += x_last <= y_last ? 4 : 0;
+        j += y_last <= x_last ? 4 : 0;
+    }
+    return intersects_integer_scalar(xs + i, x_count - i, ys + j, y_count - j);
+}
+
+__attribute__((target("avx2"))) static bool includes_integer_avx2(
+    const int64_t* xs, size_t x_count, const int64_t* ys, size_t y_count)
+{
+    size_t i = 0, j = 0;
+    for(; j < y_count; j++) {
+        int64_t y = ys[j];
+        while(i + 4 <= x_count && xs[i + 3] < y) {
+            i += 4;
+        }
+        if(i + 4 > x_count) {
+            break;
+        }
+        __m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(xs + i)), _mm256_set1_epi64x(y));
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(eq));
+        if(mask == 0) {
+            return false;
+        }
+        i += __builtin_ctz(mask) + 1;
+    }
+    return includes_integer_scalar(xs + i, x_count - i, ys + j, y_count - j);
+}
+
+static const struct integer_kernels avx2_kernels = {
+    .name = "avx2",
+    .scan = scan_integer_avx2,
+    .intersects = intersects_integer_avx2,
+    .includes = includes_integer_avx2,
+};
+
+__attribute__((target("avx512f"))) static bool scan_integer_avx512(const int64_t* xs, size_t count, int64_t value)
+{
+    __m512i needle = _mm512_set1_epi64(value);
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        if(_mm512_cmpeq_epi64_mask(_mm512_loadu_si512(xs + i), needle) != 0) {
+            return true;
+        }
+    }
+    return scan_integer_scalar(xs + i, count - i, value);
+}
+
+__attribute__((target("avx512f"))) static bool intersects_integer_avx512(
+    const int64_t* xs, size_t x_count, const int64_t* ys, size_t y_count)
+{
+    size_t i = 0, j = 0;
+    while(i + 8 <= x_count && j + 8 <= y_count) {
+        __m512i x = _mm512_loadu_si512(xs + i);
+        __m512i y = _mm512_loadu_si512(ys + j);
+        // Rotates y by one lane each time, the masked form keeps gcc 12 from warning about undefined lanes
+        __m512i rotate = _mm512_set_epi64(0, 7, 6, 5, 4, 3, 2, 1);
+        __mmask8 eq = _mm512_cmpeq_epi64_mask(x, y);
+        for(int k = 1; k < 8; k++) {
+            y = _mm512_mask_permutexvar_epi64(y, 0xff, rotate, y);
+            eq |= _mm512_cmpeq_epi64_mask(x, y);
+        }
+        if(eq != 0) {
+            return true;
+        }
+        int64_t x_last = xs[i + 7];
+        int64_t y_last = ys[j + 7];
+        i += x_last <= y_last ? 8 : 0;
+        j += y_last <= x_last ? 8 : 0;
+    }
+    return intersects_integer_avx2(xs + i, x_count - i, ys + j, y_count - j);
+}
+
+__attribute__((target("avx512f"))) static bool includes_integer_avx512(
+    const int64_t* xs, size_t x_count, const int64_t* ys, size_t y_count)
+{
+    size_t i = 0, j = 0;
+    for(; j < y_count; j++) {
+        int64_t y = ys[j];
+        while(i + 8 <= x_count && xs[i + 7] < y) {
+            i += 8;
+        }
+        if(i + 8 > x_count) {
+            break;
+        }
+        __mmask8 mask = _mm512_cmpeq_epi64_mask(_mm512_loadu_si512(xs + i), _mm512_set1_epi64(y));
+        if(mask == 0) {
+            return false;
+        }
+        i += __builtin_ctz(mask) + 1;
+    }
+    return includes_integer_avx2(xs + i, x_count - i, ys + j, y_count - j);
+}
+
+static const struct integer_kernels avx512_kernels = {
+    .name = "avx512",
+    .scan = scan_integer_avx512,
+    .intersects = intersects_integer_avx512,
+    .includes = includes_integer_avx512,
+};
+
+#elif SORTED_LIST_NEON
+
+static bool any_lane(uint64x2_t eq)
+{
+    return vmaxvq_u32(vreinterpretq_u32_u64(eq)) != 0;
+}
+
+static bool scan_integer_neon(const int64_t* xs, size_t count, int64_t value)
+{
+    int64x2_t needle = vdupq_n_s64(value);
+    size_t i = 0;
+    for(; i + 2 <= count; i += 2) {
+        if(any_lane(vceqq_s64(vld1q_s64(xs + i), needle))) {
+            return true;
+        }
+    }
+    return scan_integer_scalar(xs + i, count - i, value);
+}
+
+static bool intersects_integer_neon(const int64_t* xs, size_t x_count, const int64_t* ys, size_t y_count)
+{
+    size_t i = 0, j = 0;
+    while(i + 2 <= x_count && j + 2 <= y_count) {
+        int64x2_t x = vld1q_s64(xs + i);
+        int64x2_t y = vld1q_s64(ys + j);
+        uint64x2_t eq = vorrq_u64(vceqq_s64(x, y), vceqq_s64(x, vextq_s64(y, y, 1)));
+        if(any_lane(eq)) {
+            return true;
+        }
+        int64_t x_last = xs[i + 1];
+        int64_t y_last = ys[j + 1];
+        i += x_last <= y_last ? 2 : 0;
+        j += y_last <= x_last ? 2 : 0;
+    }
+    return intersects_integer_scalar(xs + i, x_count - i, ys + j, y_count - j);
+}
+
+static bool includes_integer_neon(const int64_t* xs, size_t x_count, const int64_t* ys, size_t y_count)
+{
+    size_t i = 0, j = 0;
+    for(; j < y_count; j++) {
+        int64_t y = ys[j];
+        while(i + 2 <= x_count && xs[i + 1] < y) {
+            i += 2;
+        }
+        if(i + 2 > x_count) {
+            break;
+        }
+        uint64x2_t eq = vceqq_s64(vld1q_s64(xs + i), vdupq_n_s64(y));
+        if(vgetq_lane_u64(eq, 0) != 0) {
+            i += 1;
+        }
+        else if(vgetq_lane_u64(eq, 1) != 0) {
+            i += 2;
+        }
+        else {
+            return false;
+        }
+    }
+    return includes_integer_scalar(xs + i, x_count - i, ys + j, y_count - j);
+}
+
+static const struct integer_kernels neon_kernels = {
+    .name = "neon",
+    .scan = scan_integer_neon,
+    .intersects = intersects_integer_neon,
+    .includes = includes_integer_neon,
+};
+
+#endif
+
+static _Atomic(const struct integer_kernels*) current_kernels = NULL;
+
+static const struct integer_kernels* select_kernels(void)
+{
+#if SORTED_LIST_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f")) {
+        return &avx512_kernels;
+    }
+    if(__builtin_cpu_supports("avx2")) {
+        return &avx2_kernels;
+    }
+    return &scalar_kernels;
+#elif SORTED_LIST_NEON
+    return &neon_kernels;
+#else
+    return &scalar_kernels;
+#endif
+}
+
+static const struct integer_kernels* get_kernels(void)
+{
+    // Racing threads all pick the same static table
+    const struct integer_kernels* kernels = atomic_load_explicit(&current_kernels, memory_order_relaxed);
+    if(unlikely(kernels == NULL)) {
+        kernels = select_kernels();
+        atomic_store_explicit(&current_kernels, kernels, memory_order_relaxed);
+    }
+    return kernels;
+}
+
+const char* sorted_list_kernel_name(void)
+{
+    return get_kernels()->name;
+}
+
+// First index at or after start holding a value not below value, count when there is none
+static size_t gallop_integer(const int64_t* xs, size_t start, size_t count, int64_t value)
+{
+    size_t lo = start, hi = start, step = 1;
+    while(hi < count && xs[hi] < value) {
+        lo = hi + 1;
+        hi += step;
+        step *= 2;
+    }
+    hi = smin(hi, count);
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(xs[mid] < value) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static size_t gallop_string(const struct string_value* xs, size_t start, size_t count, betree_str_t value)
+{
+    size_t lo = start, hi = start, step = 1;
+    while(hi < count && xs[hi].str < value) {
+        lo = hi + 1;
+        hi += step;
+        step *= 2;
+    }
+    hi = smin(hi, count);
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(xs[mid].str < value) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+bool sorted_integer_contains(const int64_t* xs, size_t count, int64_t value)
+{
+    // Binary search down to a window the kernel scans at once
+    size_t lo = 0, hi = count;
+    while(hi - lo > SCAN_WINDOW) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(xs[mid] < value) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid + 1;
+        }
+    }
+    return get_kernels()->scan(xs + lo, hi - lo, value);
+}
+
+bool sorted_integer_intersects(const int64_t* xs, size_t x_count, const int64_t* ys, size_t y_count)
+{
+    if(x_count > y_count) {
+        return sorted_integer_intersects(ys, y_count, xs, x_count);
+    }
+    if(x_count == 0 || xs[x_count - 1] < ys[0] || ys[y_count - 1] < xs[0]) {
+        return false;
+    }
+    if(y_count / x_count < GALLOP_RATIO) {
+        return get_kernels()->intersects(xs, x_count, ys, y_count);
+    }
+    size_t j = 0;
+    for(size_t i = 0; i < x_count; i++) {
+        j = gallop_integer(ys, j, y_count, xs[i]);
+        if(j == y_count) {
+            return false;
+        }
+        if(ys[j] == xs[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool sorted_integer_includes(const int64_t* xs, size_t x_count, const int64_t* ys, size_t y_count)
+{
+    if(y_count == 0) {
+        return true;
+    }
+    if(y_count > x_count || ys[0] < xs[0] || xs[x_count - 1] < ys[y_count - 1]) {
+        return false;
+    }
+    if(x_count / y_count < GALLOP_RATIO) {
+        return get_kernels()->includes(xs, x_count, ys, y_count);
+    }
+    size_t i = 0;
+    for(size_t j = 0; j < y_count; j++) {
+        i = gallop_integer(xs, i, x_count, ys[j]);
+        if(i == x_count || xs[i] != ys[j]) {
+            return false;
+        }
+        i++;
+    }
+    return true;
+}
+
+bool sorted_string_contains(const struct string_value* xs, size_t count, betree_str_t value)
+{
+    size_t i = gallop_string(xs, 0, count, value);
+    return i != count && xs[i].str == value;
+}
+
+bool sorted_string_intersects(
+    const struct string_value* xs, size_t x_count, const struct string_value* ys, size_t y_count)
+{
+    if(x_count > y_count) {
+        return sorted_string_intersects(ys, y_count, xs, x_count);
+    }
+    if(x_count == 0 || xs[x_count - 1].str < ys[0].str || ys[y_count - 1].str < xs[0].str) {
+        return false;
+    }
+    size_t i = 0, j = 0;
+    if(y_count / x_count < GALLOP_RATIO) {
+        while(i < x_count && j < y_count) {
+            betree_str_t x = xs[i].str;
+            betree_str_t y = ys[j].str;
+            if(x == y) {
+                return true;
+            }
+            i += x < y;
+            j += y < x;
+        }
+        return false;
+    }
+    for(; i < x_count; i++) {
+        j = gallop_string(ys, j, y_count, xs[i].str);
+        if(j == y_count) {
+            return false;
+        }
+        if(ys[j].str == xs[i].str) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool sorted_string_includes(
+    const struct string_value* xs, size_t x_count, const struct string_value* ys, size_t y_count)
+{
+    if(y_count == 0) {
+        return true;
+    }
+    if(y_count > x_count || ys[0].str < xs[0].str || xs[x_count - 1].str < ys[y_count - 1].str) {
+        return false;
+    }
+    bool gallop = x_count / y_count >= GALLOP_RATIO;
+    size_t i = 0;
+    for(size_t j = 0; j < y_count; j++) {
+        betree_str_t y = ys[j].str;
+        if(gallop) {
+            i = gallop_string(xs, i, x_count, y);
+        }
+        else {
+            while(i < x_count && xs[i].str < y) {
+                i++;
+            }
+        }
+        if(i == x_count || xs[i].str != y) {
+            return false;
+        }
+        i++;
+    }
+    return true;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "value.h"
+
+// All lists are sorted and without duplicates, as left by the parsers and the event fill
+
+bool sorted_integer_contains(const int64_t* xs, size_t count, int64_t value);
+bool sorted_integer_intersects(const int64_t* xs, size_t x_count, const int64_t* ys, size_t y_count);
+// Every element of ys is in xs
+bool sorted_integer_includes(const int64_t* xs, size_t x_count, const int64_t* ys, size_t y_count);
+
+bool sorted_string_contains(const struct string_value* xs, size_t count, betree_str_t value);
+bool sorted_string_intersects(
+    const struct string_value* xs, size_t x_count, const struct string_value* ys, size_t y_count);
+bool sorted_string_includes(
+    const struct string_value* xs, size_t x_count, const struct string_value* ys, size_t y_count);
+
+// Name of the integer kernels picked for this CPU
+const char* sorted_list_kernel_name(void);
@@ -3,10 +3,12 @@
 #include <stdint.h>
 #include <string.h>
 
+#include "ast.h"
 #include "betree.h"
 #include "error.h"
 #include "special.h"
 #include "utils.h"
+#include "value.h"
 
 bool within_frequency_caps(const struct betree_frequency_caps* caps,
     enum frequency_type_e type,
@@ -16,56 +18,57 @@ bool within_frequency_caps(const struct betree_frequency_caps* caps,
     size_t length,
     int64_t now)
 {
-    for(size_t i = 0; i < caps->size; i++) {
-        if(caps->content[i]->id == id && 
-            caps->content[i]->namespace.str == namespace.str &&
-            caps->content[i]->type == type) {
-            if(length <= 0) {
-                return value > caps->content[i]->value;
-            }
-            if(!caps->content[i]->timestamp_defined) {
-                return true;
-            }
-            if((now - (caps->content[i]->timestamp / 1000000)) > (int64_t)length) {
-                return true;
-            }
-            if(value > caps->content[i]->value) {
-                return true;
-            }
-            return false;
-        }
+    const struct betree_frequency_cap* cap = find_frequency_cap(caps, type, id, namespace.str);
+    if(cap == NULL) {
+        return true;
+    }
+    if(length <= 0) {
+        return value > cap->value;
+    }
+    if(!cap->timestamp_defined) {
+        return true;
+    }
+    if((now - (cap->timestamp / 1000000)) > (int64_t)length) {
+        return true;
     }
-    return true;
+    if(value > cap->value) {
+        return true;
+    }
+    return false;
 }
 
-bool segment_within(
-    int64_t segment_id, int32_t after_seconds, const struct betree_segments* segments, int64_t now)
+// First segment with an id of at least segment_id, segments are sorted by id
+static const struct betree_segment* find_segment(const struct betree_segments* segments, int64_t segment_id)
 {
-    for(size_t i = 0; i < segments->size; i++) {
-        if(segments->content[i]->id < segment_id) {
-            continue;
+    size_t low = 0;
+    size_t high = segments->size;
+    while(low < high) {
+        size_t middle = low + (high - low) / 2;
+        if(segments->content[middle].id < segment_id) {
+            low = middle + 1;
         }
-        if(segments->content[i]->id == segment_id) {
-            return (now - after_seconds) <= (segments->content[i]->timestamp / 1000000);
+        else {
+            high = middle;
         }
-        return false;
     }
-    return false;
+    if(low < segments->size && segments->content[low].id == segment_id) {
+        return &segments->content[low];
+    }
+    return NULL;
+}
+
+bool segment_within(
+    int64_t segment_id, int32_t after_seconds, const struct betree_segments* segments, int64_t now)
+{
+    const struct betree_segment* segment = find_segment(segments, segment_id);
+    return segment != NULL && (now - after_seconds) <= (segment->timestamp / 1000000);
 }
 
 bool segment_before(
     int64_t segment_id, int32_t before_seconds, const struct betree_segments* segments, int64_t now)
 {
-    for(size_t i = 0; i < segments->size; i++) {
-        if(segments->content[i]->id < segment_id) {
-            continue;
-        }
-        if(segments->content[i]->id == segment_id) {
-            return (now - before_seconds) > (segments->content[i]->timestamp / 1000000);
-        }
-        return false;
-    }
-    return false;
+    const struct betree_segment* segment = find_segment(segments, segment_id);
+    return segment != NULL && (now - before_seconds) > (segment->timestamp / 1000000);
 }
 
 #define EARTH_RADIUS 6372.8
@@ -84,6 +87,63 @@ bool geo_within_radius(double lat1, double lon1, double lat2, double lon2, doubl
     return (asin(sqrt(dx * dx + dy * dy + dz * dz) / 2) * 2 * EARTH_RADIUS) <= distance;
 }
 
+// Keeps floating point noise from rejecting points right on the box
+#define SPAN_MARGIN 1e-9
+
+void prepare_geo(struct ast_special_geo* geo)
+{
+    double latitude = geo->latitude * TO_RAD;
+    double angle = geo->radius / EARTH_RADIUS;
+    geo->sin_latitude = sin(latitude);
+    geo->cos_latitude = cos(latitude);
+    if(angle < 0) {
+        geo->chord_squared = -1;
+    }
+    else if(angle >= M_PI) {
+        geo->chord_squared = INFINITY;
+    }
+    else {
+        // Squared chord of the unit sphere, distance <= radius exactly when chord <= this
+        double chord = 2 * sin(angle / 2);
+        geo->chord_squared = chord * chord;
+    }
+    // A point within the angle is at most that many degrees away in latitude, the longitude
+    // range opens up completely when the circle reaches a pole
+    double span = angle / TO_RAD;
+    geo->latitude_span = span * (1 + SPAN_MARGIN) + SPAN_MARGIN;
+    if(fabs(geo->latitude) + span >= 90) {
+        geo->longitude_span = INFINITY;
+    }
+    else {
+        double longitude_span = asin(sin(angle) / geo->cos_latitude) / TO_RAD;
+        geo->longitude_span = longitude_span * (1 + SPAN_MARGIN) + SPAN_MARGIN;
+    }
+}
+
+bool geo_within(const struct ast_special_geo* geo, double latitude, double longitude)
+{
+    // The box only holds for real latitudes, others still go through the full test
+    if(fabs(latitude) <= 90 && fabs(geo->latitude) <= 90) {
+        if(fabs(latitude - geo->latitude) > geo->latitude_span) {
+            return false;
+        }
+        double longitude_delta = fabs(fmod(longitude - geo->longitude, 360));
+        if(longitude_delta > 180) {
+            longitude_delta = 360 - longitude_delta;
+        }
+        if(longitude_delta > geo->longitude_span) {
+            return false;
+        }
+    }
+    double delta = (geo->longitude - longitude) * TO_RAD;
+    double event_latitude = latitude * TO_RAD;
+    double cos_latitude = cos(event_latitude);
+    double dz = geo->sin_latitude - sin(event_latitude);
+    double dx = cos(delta) * geo->cos_latitude - cos_latitude;
+    double dy = sin(delta) * geo->cos_latitude;
+    return dx * dx + dy * dy + dz * dz <= geo->chord_squared;
+}
+
 bool contains(const char* value, const char* pattern)
 {
     return strstr(value, pattern) != NULL;
@@ -0,0 +1,339 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "ast.h"
+#include "betree.h"
+#include "string_matcher.h"
+#include "tree.h"
+
+static const uint32_t NO_STATE = UINT32_MAX;
+
+struct string_patterns* make_string_patterns()
+{
+    struct string_patterns* patterns = bcalloc(sizeof(*patterns));
+    if(patterns == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    return patterns;
+}
+
+static void free_trie(struct string_trie* trie)
+{
+    for(uint32_t i = 0; i < trie->state_count; i++) {
+        bfree(trie->states[i].edges);
+        bfree(trie->states[i].outputs);
+    }
+    bfree(trie->states);
+    trie->states = NULL;
+    trie->state_count = 0;
+    trie->capacity = 0;
+}
+
+static void free_matchers(struct string_patterns* patterns)
+{
+    for(size_t i = 0; i < patterns->matcher_count; i++) {
+        struct string_matcher* matcher = &patterns->matchers[i];
+        free_trie(&matcher->contains);
+        free_trie(&matcher->prefixes);
+        free_trie(&matcher->suffixes);
+        bfree(matcher->ids);
+    }
+    bfree(patterns->matchers);
+    patterns->matchers = NULL;
+    patterns->matcher_count = 0;
+}
+
+void free_string_patterns(struct string_patterns* patterns)
+{
+    if(patterns == NULL) {
+        return;
+    }
+    free_matchers(patterns);
+    bfree(patterns->patterns);
+    bfree(patterns);
+}
+
+void add_string_pattern(struct string_patterns* patterns, const struct ast_node* node)
+{
+    if(patterns->count == patterns->capacity) {
+        size_t capacity = patterns->capacity == 0 ? 8 : patterns->capacity * 2;
+        struct string_pattern* grown = brealloc(patterns->patterns, capacity * sizeof(*grown));
+        if(grown == NULL) {
+            fprintf(stderr, "%s brealloc failed\n", __func__);
+            abort();
+        }
+        patterns->patterns = grown;
+        patterns->capacity = capacity;
+    }
+    const struct ast_special_string* string = &node->special_expr.string;
+    struct string_pattern* pattern = &patterns->patterns[patterns->count++];
+    pattern->op = string->op;
+    pattern->var = string->attr_var.var;
+    pattern->pattern = string->pattern;
+    pattern->memoize_id = node->memoize_id;
+}
+
+void remove_string_pattern(struct string_patterns* patterns, const struct ast_node* node)
+{
+    // Built matchers keep the memoize_id, it is never handed out again so they stay correct
+    for(size_t i = 0; i < patterns->count; i++) {
+        if(patterns->patterns[i].memoize_id == node->memoize_id) {
+            patterns->patterns[i] = patterns->patterns[--patterns->count];
+            return;
+        }
+    }
+}
+
+static uint32_t add_state(struct string_trie* trie)
+{
+    if(trie->state_count == trie->capacity) {
+        uint32_t capacity = trie->capacity == 0 ? 16 : trie->capacity * 2;
+        struct trie_state* grown = brealloc(trie->states, capacity * sizeof(*grown));
+        if(grown == NULL) {
+            fprintf(stderr, "%s brealloc failed\n", __func__);
+            abort();
+        }
+        trie->states = grown;
+        trie->capacity = capacity;
+    }
+    struct trie_state* state = &trie->states[trie->state_count];
+    memset(state, 0, sizeof(*state));
+    state->fail = 0;
+    state->output_link = NO_STATE;
+    return trie->state_count++;
+}
+
+static uint32_t find_edge(const struct trie_state* state, unsigned char byte)
+{
+    uint32_t low = 0;
+    uint32_t high = state->edge_count;
+    while(low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if(state->edges[middle].byte < byte) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    if(low < state->edge_count && state->edges[low].byte == byte) {
+        return state->edges[low].target;
+    }
+    return NO_STATE;
+}
+
+static uint32_t add_edge(struct string_trie* trie, uint32_t from, unsigned char byte)
+{
+    uint32_t found = find_edge(&trie->states[from], byte);
+    if(found != NO_STATE) {
+        return found;
+    }
+    // add_state can move the states
+    uint32_t target = add_state(trie);
+    struct trie_state* state = &trie->states[from];
+    struct trie_edge* edges = brealloc(state->edges, (state->edge_count + 1) * sizeof(*edges));
+    if(edges == NULL) {
+        fprintf(stderr, "%s brealloc failed\n", __func__);
+        abort();
+    }
+    uint32_t position = 0;
+    while(position < state->edge_count && edges[position].byte < byte) {
+        position++;
+    }
+    memmove(&edges[position + 1], &edges[position], (state->edge_count - position) * sizeof(*edges));
+    edges[position].byte = byte;
+    edges[position].target = target;
+    state->edges = edges;
+    state->edge_count++;
+    return target;
+}
+
+static void add_output(struct trie_state* state, betree_pred_t memoize_id)
+{
+    betree_pred_t* outputs = brealloc(state->outputs, (state->output_count + 1) * sizeof(*outputs));
+    if(outputs == NULL) {
+        fprintf(stderr, "%s brealloc failed\n", __func__);
+        abort();
+    }
+    outputs[state->output_count++] = memoize_id;
+    state->outputs = outputs;
+}
+
+static void insert_word(struct string_trie* trie, const char* word, bool reversed, betree_pred_t memoize_id)
+{
+    if(trie->state_count == 0) {
+        add_state(trie);
+    }
+    size_t length = strlen(word);
+    uint32_t state = 0;
+    for(size_t i = 0; i < length; i++) {
+        unsigned char byte = (unsigned char)word[reversed ? length - 1 - i : i];
+        state = add_edge(trie, state, byte);
+    }
+    add_output(&trie->states[state], memoize_id);
+}
+
+static void link_automaton(struct string_trie* trie)
+{
+    if(trie->state_count == 0) {
+        return;
+    }
+    // Breadth-first so every fail target is linked before the states that use it
+    uint32_t* queue = bmalloc(trie->state_count * sizeof(*queue));
+    if(queue == NULL) {
+        fprintf(stderr, "%s bmalloc failed\n", __func__);
+        abort();
+    }
+    uint32_t head = 0, tail = 0;
+    queue[tail++] = 0;
+    while(head < tail) {
+        uint32_t from = queue[head++];
+        const struct trie_state* state = &trie->states[from];
+        for(uint32_t i = 0; i < state->edge_count; i++) {
+            unsigned char byte = state->edges[i].byte;
+            uint32_t target = state->edges[i].target;
+            uint32_t fail = 0;
+            if(from != 0) {
+                uint32_t candidate = state->fail;
+                while(true) {
+                    uint32_t next = find_edge(&trie->states[candidate], byte);
+                    if(next != NO_STATE) {
+                        fail = next;
+                        break;
+                    }
+                    if(candidate == 0) {
+                        break;
+                    }
+                    candidate = trie->states[candidate].fail;
+                }
+            }
+            struct trie_state* child = &trie->states[target];
+            child->fail = fail;
+            child->output_link = trie->states[fail].output_count != 0 ? fail : trie->states[fail].output_link;
+            queue[tail++] = target;
+        }
+    }
+    bfree(queue);
+}
+
+static void memoize_outputs(const struct trie_state* state, struct memoize* memoize)
+{
+    for(size_t i = 0; i < state->output_count; i++) {
+        memoize_result(memoize, state->outputs[i], true);
+    }
+}
+
+static void run_automaton(const struct string_trie* trie, const char* value, struct memoize* memoize)
+{
+    if(trie->state_count == 0) {
+        return;
+    }
+    // Empty patterns sit on the root
+    memoize_outputs(&trie->states[0], memoize);
+    uint32_t state = 0;
+    for(const char* c = value; *c != '\0'; c++) {
+        unsigned char byte = (unsigned char)*c;
+        uint32_t next;
+        while((next = find_edge(&trie->states[state], byte)) == NO_STATE && state != 0) {
+            state = trie->states[state].fail;
+        }
+        state = next == NO_STATE ? 0 : next;
+        for(uint32_t output = state; output != NO_STATE; output = trie->states[output].output_link) {
+            memoize_outputs(&trie->states[output], memoize);
+        }
+    }
+}
+
+static void walk_trie(const struct string_trie* trie, const char* value, bool reversed, struct memoize* memoize)
+{
+    if(trie->state_count == 0) {
+        return;
+    }
+    size_t length = strlen(value);
+    uint32_t state = 0;
+    memoize_outputs(&trie->states[0], memoize);
+    for(size_t i = 0; i < length; i++) {
+        unsigned char byte = (unsigned char)value[reversed ? length - 1 - i : i];
+        state = find_edge(&trie->states[state], byte);
+        if(state == NO_STATE) {
+            return;
+        }
+        memoize_outputs(&trie->states[state], memoize);
+    }
+}
+
+static struct string_matcher* get_matcher(struct string_patterns* patterns, betree_var_t var)
+{
+    for(size_t i = 0; i < patterns->matcher_count; i++) {
+        if(patterns->matchers[i].var == var) {
+            return &patterns->matchers[i];
+        }
+    }
+    struct string_matcher* matchers
+        = brealloc(patterns->matchers, (patterns->matcher_count + 1) * sizeof(*matchers));
+    if(matchers == NULL) {
+        fprintf(stderr, "%s brealloc failed\n", __func__);
+        abort();
+    }
+    patterns->matchers = matchers;
+    struct string_matcher* matcher = &matchers[patterns->matcher_count++];
+    memset(matcher, 0, sizeof(*matcher));
+    matcher->var = var;
+    return matcher;
+}
+
+void build_string_matchers(struct string_patterns* patterns)
+{
+    free_matchers(patterns);
+    for(size_t i = 0; i < patterns->count; i++) {
+        const struct string_pattern* pattern = &patterns->patterns[i];
+        struct string_matcher* matcher = get_matcher(patterns, pattern->var);
+        switch(pattern->op) {
+            case AST_SPECIAL_CONTAINS:
+                insert_word(&matcher->contains, pattern->pattern, false, pattern->memoize_id);
+                break;
+            case AST_SPECIAL_STARTSWITH:
+                insert_word(&matcher->prefixes, pattern->pattern, false, pattern->memoize_id);
+                break;
+            case AST_SPECIAL_ENDSWITH:
+                insert_word(&matcher->suffixes, pattern->pattern, true, pattern->memoize_id);
+                break;
+            default: abort();
+        }
+        betree_pred_t* ids = brealloc(matcher->ids, (matcher->id_count + 1) * sizeof(*ids));
+        if(ids == NULL) {
+            fprintf(stderr, "%s brealloc failed\n", __func__);
+            abort();
+        }
+        ids[matcher->id_count++] = pattern->memoize_id;
+        matcher->ids = ids;
+    }
+    for(size_t i = 0; i < patterns->matcher_count; i++) {
+        link_automaton(&patterns->matchers[i].contains);
+    }
+}
+
+void match_string_patterns(
+    const struct string_patterns* patterns, const struct betree_variable** preds, struct memoize* memoize)
+{
+    for(size_t i = 0; i < patterns->matcher_count; i++) {
+        const struct string_matcher* matcher = &patterns->matchers[i];
+        const struct betree_variable* pred = preds[matcher->var];
+        // Undefined strings fail on their own without a scan
+        if(pred == NULL || pred->value.value_type != BETREE_STRING) {
+            continue;
+        }
+        const char* value = pred->value.string_value.string;
+        run_automaton(&matcher->contains, value, memoize);
+        walk_trie(&matcher->prefixes, value, false, memoize);
+        walk_trie(&matcher->suffixes, value, true, memoize);
+        for(size_t j = 0; j < matcher->id_count; j++) {
+            if(!test_bit(memoize->pass, matcher->ids[j])) {
+                memoize_result(memoize, matcher->ids[j], false);
+            }
+        }
+    }
+}
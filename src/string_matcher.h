@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ast.h"
+#include "memoize.h"
+#include "value.h"
+
+struct betree_variable;
+
+/*
+ * Index of the contains, starts_with and ends_with predicates of the pred map. Each attribute gets
+ * an Aho-Corasick automaton over its contains patterns and tries over its prefixes and reversed
+ * suffixes, every predicate is then decided by one pass over the event string each and its result
+ * written to the memoize bitsets, so the sub only does a bit test. Patterns come and go with
+ * their nodes, the matchers cover the ones present at the last build_string_matchers and predicates
+ * added afterwards are evaluated as before
+ */
+
+struct string_pattern {
+    enum ast_special_string_e op;
+    betree_var_t var;
+    // Owned by the node
+    const char* pattern;
+    betree_pred_t memoize_id;
+};
+
+struct trie_edge {
+    unsigned char byte;
+    uint32_t target;
+};
+
+struct trie_state {
+    // Sorted by byte
+    uint32_t edge_count;
+    struct trie_edge* edges;
+    // Longest proper suffix state and the closest one with outputs, automatons only
+    uint32_t fail;
+    uint32_t output_link;
+    size_t output_count;
+    betree_pred_t* outputs;
+};
+
+struct string_trie {
+    uint32_t state_count;
+    uint32_t capacity;
+    struct trie_state* states;
+};
+
+struct string_matcher {
+    betree_var_t var;
+    struct string_trie contains;
+    struct string_trie prefixes;
+    struct string_trie suffixes;
+    // Every predicate of the attribute, those that did not match are memoized as failed
+    size_t id_count;
+    betree_pred_t* ids;
+};
+
+struct string_patterns {
+    size_t count;
+    size_t capacity;
+    struct string_pattern* patterns;
+    size_t matcher_count;
+    struct string_matcher* matchers;
+};
+
+struct string_patterns* make_string_patterns();
+void free_string_patterns(struct string_patterns* patterns);
+
+// node must be a string special expression with a memoize_id
+void add_string_pattern(struct string_patterns* patterns, const struct ast_node* node);
+void remove_string_pattern(struct string_patterns* patterns, const struct ast_node* node);
+void build_string_matchers(struct string_patterns* patterns);
+
+// Memoizes every indexed predicate on the strings of the event
+void match_string_patterns(
+    const struct string_patterns* patterns, const struct betree_variable** preds, struct memoize* memoize);
@@ -0,0 +1,117 @@
+#include <stdio.h>
+
+#include "alloc.h"
+#include "sub_index.h"
+#include "tree.h"
+
+static const size_t SUB_INDEX_INITIAL_BUCKETS = 64;
+
+static size_t bucket_for_id(size_t bucket_count, betree_sub_t id)
+{
+    // Fibonacci hashing, bucket_count is always a power of two
+    return (size_t)((id * 11400714819323198485ULL) >> 32) & (bucket_count - 1);
+}
+
+static struct sub_index_entry** make_buckets(size_t bucket_count)
+{
+    struct sub_index_entry** buckets = bcalloc(bucket_count * sizeof(*buckets));
+    if(buckets == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    return buckets;
+}
+
+struct sub_index* make_sub_index()
+{
+    struct sub_index* index = bcalloc(sizeof(*index));
+    if(index == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    index->count = 0;
+    index->bucket_count = SUB_INDEX_INITIAL_BUCKETS;
+    index->buckets = make_buckets(index->bucket_count);
+    return index;
+}
+
+void free_sub_index(struct sub_index* index)
+{
+    if(index == NULL) {
+        return;
+    }
+    for(size_t i = 0; i < index->bucket_count; i++) {
+        struct sub_index_entry* entry = index->buckets[i];
+        while(entry != NULL) {
+            struct sub_index_entry* next = entry->next;
+            bfree(entry);
+            entry = next;
+        }
+    }
+    bfree(index->buckets);
+    bfree(index);
+}
+
+static void grow_sub_index(struct sub_index* index)
+{
+    size_t bucket_count = index->bucket_count * 2;
+    struct sub_index_entry** buckets = make_buckets(bucket_count);
+    for(size_t i = 0; i < index->bucket_count; i++) {
+        struct sub_index_entry* entry = index->buckets[i];
+        while(entry != NULL) {
+            struct sub_index_entry* next = entry->next;
+            size_t bucket = bucket_for_id(bucket_count, entry->sub->id);
+            entry->next = buckets[bucket];
+            buckets[bucket] = entry;
+            entry = next;
+        }
+    }
+    bfree(index->buckets);
+    index->buckets = buckets;
+    index->bucket_count = bucket_count;
+}
+
+void sub_index_add(struct sub_index* index, struct betree_sub* sub)
+{
+    if(index->count >= index->bucket_count) {
+        grow_sub_index(index);
+    }
+    struct sub_index_entry* entry = bmalloc(sizeof(*entry));
+    if(entry == NULL) {
+        fprintf(stderr, "%s bmalloc failed\n", __func__);
+        abort();
+    }
+    size_t bucket = bucket_for_id(index->bucket_count, sub->id);
+    entry->sub = sub;
+    entry->next = index->buckets[bucket];
+    index->buckets[bucket] = entry;
+    index->count++;
+}
+
+bool sub_index_remove(struct sub_index* index, const struct betree_sub* sub)
+{
+    size_t bucket = bucket_for_id(index->bucket_count, sub->id);
+    struct sub_index_entry** link = &index->buckets[bucket];
+    while(*link != NULL) {
+        struct sub_index_entry* entry = *link;
+        if(entry->sub == sub) {
+            *link = entry->next;
+            bfree(entry);
+            index->count--;
+            return true;
+        }
+        link = &entry->next;
+    }
+    return false;
+}
+
+struct betree_sub* sub_index_find(const struct sub_index* index, betree_sub_t id)
+{
+    size_t bucket = bucket_for_id(index->bucket_count, id);
+    for(struct sub_index_entry* entry = index->buckets[bucket]; entry != NULL; entry = entry->next) {
+        if(entry->sub->id == id) {
+            return entry->sub;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "betree.h"
+
+struct betree_sub;
+
+struct sub_index_entry {
+    struct betree_sub* sub;
+    struct sub_index_entry* next;
+};
+
+// Chained hash from sub id to the subs with that id, ids are not unique so a bucket can hold duplicates
+struct sub_index {
+    size_t count;
+    size_t bucket_count;
+    struct sub_index_entry** buckets;
+};
+
+struct sub_index* make_sub_index();
+void free_sub_index(struct sub_index* index);
+
+void sub_index_add(struct sub_index* index, struct betree_sub* sub);
+bool sub_index_remove(struct sub_index* index, const struct betree_sub* sub);
+struct betree_sub* sub_index_find(const struct sub_index* index, betree_sub_t id);
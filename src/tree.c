@@ -2,54 +2,73 @@
 #include <float.h>
 #include <inttypes.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "alloc.h"
 #include "ast.h"
 #include "betree.h"
+#include "bitmap.h"
+#include "columns.h"
+#include "dependents.h"
 #include "error.h"
+#include "event_sample.h"
+#include "event_scanner.h"
 #include "hashmap.h"
+#include "jit.h"
 #include "memoize.h"
+#include "prefilter.h"
 #include "printer.h"
+#include "result_cache.h"
+#include "short_circuit.h"
+#include "string_matcher.h"
 #include "tree.h"
 #include "utils.h"
 
-struct subs_to_eval {
-    struct betree_sub** subs;
-    size_t capacity;
-    size_t count;
-};
-
 static void init_subs_to_eval(struct subs_to_eval* subs)
 {
     size_t init = 10;
     subs->subs = bmalloc(init * sizeof(*subs->subs));
+    subs->passed = bmalloc(init * sizeof(*subs->passed));
+    if(subs->subs == NULL || subs->passed == NULL) {
+        fprintf(stderr, "%s bmalloc failed\n", __func__);
+        abort();
+    }
     subs->capacity = init;
     subs->count = 0;
+    subs->failed = 0;
+    subs->ranked_capacity = 0;
+    subs->ranked = NULL;
 }
 
-static void add_sub_to_eval(struct betree_sub* sub, struct subs_to_eval* subs)
+static void add_sub_to_eval(struct betree_sub* sub, bool passed, struct subs_to_eval* subs)
 {
     if(subs->capacity == subs->count) {
         subs->capacity *= 2;
         subs->subs = brealloc(subs->subs, sizeof(*subs->subs) * subs->capacity);
+        subs->passed = brealloc(subs->passed, sizeof(*subs->passed) * subs->capacity);
+        if(subs->subs == NULL || subs->passed == NULL) {
+            fprintf(stderr, "%s brealloc failed\n", __func__);
+            abort();
+        }
     }
 
     subs->subs[subs->count] = sub;
+    subs->passed[subs->count] = passed;
     subs->count++;
 }
 
 enum short_circuit_e { SHORT_CIRCUIT_PASS, SHORT_CIRCUIT_FAIL, SHORT_CIRCUIT_NONE };
 
-static enum short_circuit_e try_short_circuit(size_t attr_domains_count,
+static enum short_circuit_e try_short_circuit(
     const struct short_circuit* short_circuit, const uint64_t* undefined)
 {
-    size_t count = attr_domains_count / 64 + 1;
-    for(size_t i = 0; i < count; i++) {
+    for(size_t i = 0; i < short_circuit->word_count; i++) {
         bool pass = short_circuit->pass[i] & undefined[i];
         if(pass) {
             return SHORT_CIRCUIT_PASS;
@@ -62,18 +81,79 @@ static enum short_circuit_e try_short_circuit(size_t attr_domains_count,
     return SHORT_CIRCUIT_NONE;
 }
 
-static bool match_sub(size_t attr_domains_count,
-    const struct betree_variable** preds,
+#ifdef BETREE_STATS
+static uint64_t stat_clock(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+#endif
+}
+#endif
+
+#ifdef BETREE_JIT
+// Native code of the sub once it was evaluated jit_countdown times, compiled by the thread that got there
+static const struct jit_function* native_sub(struct betree_sub* sub)
+{
+    struct jit_function* native = __atomic_load_n(&sub->native, __ATOMIC_ACQUIRE);
+    if(native != NULL || __atomic_load_n(&sub->jit_countdown, __ATOMIC_RELAXED) == 0) {
+        return native;
+    }
+    if(__atomic_sub_fetch(&sub->jit_countdown, 1, __ATOMIC_RELAXED) != 0) {
+        return NULL;
+    }
+    native = jit_compile(sub->expr);
+    __atomic_store_n(&sub->native, native, __ATOMIC_RELEASE);
+    return native;
+}
+#endif
+
+static bool run_sub(const struct betree_variable** preds,
+    const struct betree_sub* sub,
+    struct memoize* memoize,
+    struct report* report)
+{
+#ifdef BETREE_JIT
+    const struct jit_function* native = native_sub((struct betree_sub*)sub);
+    if(native != NULL) {
+        return jit_run(native, preds);
+    }
+#endif
+    return match_program(preds, sub->program, memoize, report);
+}
+
+// Records the cost of the sub when built with BETREE_STATS, in cycles or nanoseconds off x86
+static bool evaluate_sub(const struct betree_variable** preds,
+    const struct betree_sub* sub,
+    struct memoize* memoize,
+    struct report* report)
+{
+#ifdef BETREE_STATS
+    uint64_t start = stat_clock();
+    bool result = run_sub(preds, sub, memoize, report);
+    STAT_ADD(sub, cycles, stat_clock() - start);
+    STAT_ADD(sub, evaluations, 1);
+    return result;
+#else
+    return run_sub(preds, sub, memoize, report);
+#endif
+}
+
+static bool match_sub(const struct betree_variable** preds,
     const struct betree_sub* sub,
     struct report* report,
     struct memoize* memoize,
     const uint64_t* undefined)
 {
-    enum short_circuit_e short_circuit = try_short_circuit(attr_domains_count, &sub->short_circuit, undefined);
+    enum short_circuit_e short_circuit = try_short_circuit(&sub->short_circuit, undefined);
     if(short_circuit != SHORT_CIRCUIT_NONE) {
         if(report != NULL) {
             report->shorted++;
         }
+        STAT_ADD(sub, shorted, 1);
         if(short_circuit == SHORT_CIRCUIT_PASS) {
             return true;
         }
@@ -81,16 +161,98 @@ static bool match_sub(size_t attr_domains_count,
             return false;
         }
     }
-    bool result = match_node(preds, sub->expr, memoize, report);
+    bool result = evaluate_sub(preds, sub, memoize, report);
     return result;
 }
 
-static void check_sub(const struct lnode* lnode, struct subs_to_eval* subs)
+// Checks the short circuits of the whole lnode 64 subs at a time, only the undecided ones get evaluated
+static void check_lnode_short_circuits(const struct betree_variable** preds,
+    const struct lnode* lnode,
+    const uint64_t* undefined,
+    struct subs_to_eval* subs)
 {
-    for(size_t i = 0; i < lnode->sub_count; i++) {
-        struct betree_sub* sub = lnode->subs[i];
-        add_sub_to_eval(sub, subs);
+    for(size_t first = 0; first < lnode->sub_count; first += 64) {
+        size_t count = lnode->sub_count - first < 64 ? lnode->sub_count - first : 64;
+        uint64_t pass, fail;
+        classify_short_circuits(&lnode->short_circuits, first, count, undefined, &pass, &fail);
+        if(lnode->columns != NULL) {
+            // Out of range of a leading operand, unless the short circuit already passed it
+            fail |= columns_fail(lnode->columns, preds, first, count) & ~pass;
+        }
+        for(size_t i = 0; i < count; i++) {
+            struct betree_sub* sub = lnode->subs[first + i];
+            if(fail & (1ULL << i)) {
+                subs->failed++;
+                STAT_ADD(sub, shorted, 1);
+            }
+            else if(sub->active) {
+                add_sub_to_eval(sub, pass & (1ULL << i), subs);
+                STAT_ADD(sub, shorted, (pass >> i) & 1);
+            }
+        }
+    }
+}
+
+static void check_short_circuit(struct betree_sub* sub, const uint64_t* undefined, struct subs_to_eval* subs)
+{
+    if(!sub->active) {
+        return;
+    }
+    enum short_circuit_e short_circuit = try_short_circuit(&sub->short_circuit, undefined);
+    if(short_circuit == SHORT_CIRCUIT_FAIL) {
+        subs->failed++;
+    }
+    else {
+        add_sub_to_eval(sub, short_circuit == SHORT_CIRCUIT_PASS, subs);
+    }
+    STAT_ADD(sub, shorted, short_circuit != SHORT_CIRCUIT_NONE);
+}
+
+static void check_sub(const struct betree_variable** preds,
+    const uint64_t* undefined,
+    const struct lnode* lnode,
+    struct subs_to_eval* subs)
+{
+    const struct lnode_postings* postings = lnode->postings;
+    if(postings == NULL) {
+        check_lnode_short_circuits(preds, lnode, undefined, subs);
+        return;
+    }
+    // A keyed sub sits under a single attribute, it is added at most once
+    for(size_t i = 0; i < postings->unkeyed_count; i++) {
+        check_short_circuit(postings->unkeyed[i], undefined, subs);
+    }
+    for(size_t i = 0; i < postings->var_count; i++) {
+        betree_var_t var = postings->vars[i].var;
+        uint64_t value;
+        if(!posting_value(preds[var], &value)) {
+            continue;
+        }
+        const struct posting* posting = find_posting(postings, var, value);
+        if(posting == NULL) {
+            continue;
+        }
+        for(size_t j = 0; j < posting->sub_count; j++) {
+            check_short_circuit(posting->subs[j], undefined, subs);
+        }
+    }
+}
+
+// First pnode of the pdir whose variable is not below variable_id
+static size_t lower_pnode(betree_var_t variable_id, const struct pdir* pdir)
+{
+    size_t low = 0;
+    size_t high = pdir->pnode_count;
+    while(low < high) {
+        size_t middle = low + (high - low) / 2;
+        if(pdir->pnodes[middle]->attr_var.var < variable_id) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
     }
+    return low;
 }
 
 static struct pnode* search_pdir(betree_var_t variable_id, const struct pdir* pdir)
@@ -98,49 +260,70 @@ static struct pnode* search_pdir(betree_var_t variable_id, const struct pdir* pd
     if(pdir == NULL) {
         return NULL;
     }
-    for(size_t i = 0; i < pdir->pnode_count; i++) {
-        struct pnode* pnode = pdir->pnodes[i];
-        if(variable_id == pnode->attr_var.var) {
-            return pnode;
-        }
+    size_t i = lower_pnode(variable_id, pdir);
+    if(i < pdir->pnode_count && pdir->pnodes[i]->attr_var.var == variable_id) {
+        return pdir->pnodes[i];
     }
     return NULL;
 }
 
+static int pnode_cmp(const void* a, const void* b)
+{
+    betree_var_t x = (*(const struct pnode* const*)a)->attr_var.var;
+    betree_var_t y = (*(const struct pnode* const*)b)->attr_var.var;
+    return (x > y) - (x < y);
+}
+
+void sort_pdir(struct pdir* pdir)
+{
+    qsort(pdir->pnodes, pdir->pnode_count, sizeof(*pdir->pnodes), pnode_cmp);
+}
+
 static void search_cdir(const struct attr_domain** attr_domains,
     const struct betree_variable** preds,
+    const uint64_t* undefined,
     struct cdir* cdir,
     struct subs_to_eval* subs, bool open_left, bool open_right);
 
-static bool event_contains_variable(const struct betree_variable** preds, betree_var_t variable_id)
+static bool misses_required(const struct cnode* cnode, const uint64_t* undefined)
 {
-    return preds[variable_id] != NULL;
+    for(size_t i = 0; i < cnode->required_count; i++) {
+        if(cnode->required[i] & undefined[i]) {
+            return true;
+        }
+    }
+    return false;
 }
 
-static void match_be_tree(const struct attr_domain** attr_domains,
+static void match_be_tree_recursive(const struct attr_domain** attr_domains,
     const struct betree_variable** preds,
+    const uint64_t* undefined,
     const struct cnode* cnode,
     struct subs_to_eval* subs)
 {
-    check_sub(cnode->lnode, subs);
+    STAT_ADD(cnode, visits, 1);
+    if(misses_required(cnode, undefined)) {
+        return;
+    }
+    STAT_ADD(cnode->lnode, visits, 1);
+    size_t seen = subs->count + subs->failed;
+    check_sub(preds, undefined, cnode->lnode, subs);
+    STAT_ADD(cnode->lnode, candidates, subs->count + subs->failed - seen);
     if(cnode->pdir != NULL) {
         for(size_t i = 0; i < cnode->pdir->pnode_count; i++) {
             struct pnode* pnode = cnode->pdir->pnodes[i];
             const struct attr_domain* attr_domain
                 = get_attr_domain(attr_domains, pnode->attr_var.var);
-            if(attr_domain->allow_undefined
-                || event_contains_variable(preds, pnode->attr_var.var)) {
-                search_cdir(attr_domains, preds, pnode->cdir, subs, true, true);
+            if(attr_domain->allow_undefined || !test_bit(undefined, pnode->attr_var.var)) {
+                STAT_ADD(pnode, visits, 1);
+                search_cdir(attr_domains, preds, undefined, pnode->cdir, subs, true, true);
             }
         }
     }
 }
 
-static bool is_event_enclosed(const struct betree_variable** preds, const struct cdir* cdir, bool open_left, bool open_right)
+static bool event_in_bound(const struct betree_variable** preds, const struct cdir* cdir, bool open_left, bool open_right)
 {
-    if(cdir == NULL) {
-        return false;
-    }
     const struct betree_variable* pred = preds[cdir->attr_var.var];
     if(pred == NULL) {
         return true;
@@ -198,14 +381,69 @@ static bool is_event_enclosed(const struct betree_variable** preds, const struct
     return false;
 }
 
+static bool is_event_enclosed(const struct betree_variable** preds, const struct cdir* cdir, bool open_left, bool open_right)
+{
+    if(cdir == NULL) {
+        return false;
+    }
+    bool enclosed = event_in_bound(preds, cdir, open_left, open_right);
+    STAT_ADD(cdir, checks, 1);
+    STAT_ADD(cdir, enclosed, enclosed);
+    return enclosed;
+}
+
+struct value_bound get_sub_bound(const struct attr_domain* attr_domain, const struct betree_sub* sub)
+{
+    // The cache is not part of the sub's value, it is filled through const subs
+    struct betree_sub* cached = (struct betree_sub*)sub;
+    betree_var_t var = attr_domain->attr_var.var;
+    for(size_t i = 0; i < cached->bound_count; i++) {
+        struct sub_bound* entry = &cached->bounds[i];
+        if(entry->var == var) {
+            if(entry->version != attr_domain->bound_version) {
+                entry->bound = get_variable_bound(attr_domain, sub->expr);
+                entry->version = attr_domain->bound_version;
+            }
+            return entry->bound;
+        }
+    }
+    struct sub_bound* bounds = brealloc(cached->bounds, (cached->bound_count + 1) * sizeof(*bounds));
+    if(bounds == NULL) {
+        fprintf(stderr, "%s brealloc failed\n", __func__);
+        abort();
+    }
+    struct sub_bound* entry = &bounds[cached->bound_count];
+    entry->var = var;
+    entry->version = attr_domain->bound_version;
+    entry->bound = get_variable_bound(attr_domain, sub->expr);
+    cached->bounds = bounds;
+    cached->bound_count++;
+    return entry->bound;
+}
+
+// First attribute of the sub from variable_id on, INVALID_VAR past the last one
+static betree_var_t next_sub_attribute(const struct betree_sub* sub, betree_var_t variable_id)
+{
+    for(size_t w = variable_id / 64; w < sub->short_circuit.word_count; w++) {
+        uint64_t word = sub->attr_vars[w];
+        if(w == variable_id / 64) {
+            word &= UINT64_MAX << (variable_id % 64);
+        }
+        if(word != 0) {
+            return w * 64 + (betree_var_t)__builtin_ctzll(word);
+        }
+    }
+    return INVALID_VAR;
+}
+
 bool sub_is_enclosed(const struct attr_domain** attr_domains, const struct betree_sub* sub, const struct cdir* cdir)
 {
     if(cdir == NULL) {
         return false;
     }
-    if(test_bit(sub->attr_vars, cdir->attr_var.var) == true) {
+    if(sub_has_attribute(sub, cdir->attr_var.var)) {
         const struct attr_domain* attr_domain = get_attr_domain(attr_domains, cdir->attr_var.var);
-        struct value_bound bound = get_variable_bound(attr_domain, sub->expr);
+        struct value_bound bound = get_sub_bound(attr_domain, sub);
         switch(attr_domain->bound.value_type) {
             case(BETREE_INTEGER):
             case(BETREE_INTEGER_LIST):
@@ -240,15 +478,124 @@ bool sub_is_enclosed(const struct attr_domain** attr_domains, const struct betre
 
 static void search_cdir(const struct attr_domain** attr_domains,
     const struct betree_variable** preds,
+    const uint64_t* undefined,
     struct cdir* cdir,
     struct subs_to_eval* subs, bool open_left, bool open_right)
 {
-    match_be_tree(attr_domains, preds, cdir->cnode, subs);
+    STAT_ADD(cdir, visits, 1);
+    match_be_tree_recursive(attr_domains, preds, undefined, cdir->cnode, subs);
     if(is_event_enclosed(preds, cdir->lchild, open_left, false)) {
-        search_cdir(attr_domains, preds, cdir->lchild, subs, open_left, false);
+        search_cdir(attr_domains, preds, undefined, cdir->lchild, subs, open_left, false);
     }
     if(is_event_enclosed(preds, cdir->rchild, false, open_right)) {
-        search_cdir(attr_domains, preds, cdir->rchild, subs, false, open_right);
+        search_cdir(attr_domains, preds, undefined, cdir->rchild, subs, false, open_right);
+    }
+}
+
+#if defined(__GNUC__)
+#define PREFETCH(address) __builtin_prefetch(address)
+#else
+#define PREFETCH(address) ((void)(address))
+#endif
+
+static void push_frame(struct search_stack* stack, struct cdir* cdir, bool open_left, bool open_right)
+{
+    if(stack->count == stack->capacity) {
+        size_t capacity = stack->capacity == 0 ? 16 : stack->capacity * 2;
+        struct search_frame* frames = brealloc(stack->frames, capacity * sizeof(*frames));
+        if(frames == NULL) {
+            fprintf(stderr, "%s brealloc failed\n", __func__);
+            abort();
+        }
+        stack->frames = frames;
+        stack->capacity = capacity;
+    }
+    PREFETCH(cdir);
+    stack->frames[stack->count].cdir = cdir;
+    stack->frames[stack->count].open_left = open_left;
+    stack->frames[stack->count].open_right = open_right;
+    stack->count++;
+}
+
+static void visit_cnode(const struct betree_variable** preds,
+    const uint64_t* undefined,
+    const struct cnode* cnode,
+    struct subs_to_eval* subs,
+    struct search_stack* stack)
+{
+    STAT_ADD(cnode, visits, 1);
+    if(misses_required(cnode, undefined)) {
+        return;
+    }
+    STAT_ADD(cnode->lnode, visits, 1);
+    size_t seen = subs->count + subs->failed;
+    check_sub(preds, undefined, cnode->lnode, subs);
+    STAT_ADD(cnode->lnode, candidates, subs->count + subs->failed - seen);
+    if(cnode->pdir != NULL) {
+        // Pushed last to first so they are popped in the order the recursive search visits them
+        for(size_t i = cnode->pdir->pnode_count; i-- > 0;) {
+            struct pnode* pnode = cnode->pdir->pnodes[i];
+            if(pnode->allow_undefined || !test_bit(undefined, pnode->attr_var.var)) {
+                STAT_ADD(pnode, visits, 1);
+                push_frame(stack, pnode->cdir, true, true);
+            }
+        }
+    }
+}
+
+// Pops the pending cdirs until budget is spent, a unit for each cnode and each candidate it adds.
+// Returns what was spent, the walk is over once the stack is empty
+static size_t walk_be_tree(const struct betree_variable** preds,
+    const uint64_t* undefined,
+    struct subs_to_eval* subs,
+    struct search_stack* stack,
+    size_t budget)
+{
+    size_t spent = 0;
+    while(stack->count != 0 && spent < budget) {
+        struct search_frame frame = stack->frames[--stack->count];
+        struct cdir* cdir = frame.cdir;
+        if(stack->count != 0) {
+            PREFETCH(stack->frames[stack->count - 1].cdir->cnode);
+        }
+        PREFETCH(cdir->cnode->lnode);
+        STAT_ADD(cdir, visits, 1);
+        if(is_event_enclosed(preds, cdir->rchild, false, frame.open_right)) {
+            push_frame(stack, cdir->rchild, false, frame.open_right);
+        }
+        if(is_event_enclosed(preds, cdir->lchild, frame.open_left, false)) {
+            push_frame(stack, cdir->lchild, frame.open_left, false);
+        }
+        size_t seen = subs->count + subs->failed;
+        visit_cnode(preds, undefined, cdir->cnode, subs, stack);
+        spent += 1 + subs->count + subs->failed - seen;
+    }
+    return spent;
+}
+
+// Same walk as match_be_tree_recursive, the pending cdirs are kept on an explicit stack and the
+// next one is prefetched while the current one is searched
+static void match_be_tree(const struct betree_variable** preds,
+    const uint64_t* undefined,
+    const struct cnode* cnode,
+    struct subs_to_eval* subs,
+    struct search_stack* stack)
+{
+    stack->count = 0;
+    visit_cnode(preds, undefined, cnode, subs, stack);
+    walk_be_tree(preds, undefined, subs, stack, SIZE_MAX);
+}
+
+static void search_be_tree(const struct config* config,
+    struct betree_search_context* context,
+    const struct cnode* cnode)
+{
+    const struct attr_domain** attr_domains = (const struct attr_domain**)config->attr_domains;
+    if(config->recursive_search) {
+        match_be_tree_recursive(attr_domains, context->preds, context->undefined, cnode, &context->subs);
+    }
+    else {
+        match_be_tree(context->preds, context->undefined, cnode, &context->subs, &context->stack);
     }
 }
 
@@ -303,6 +650,77 @@ static bool is_used_cnode(betree_var_t variable_id, const struct cnode* cnode)
     return is_used_cdir(variable_id, cnode->parent);
 }
 
+// False when the cnode already required no more than the sub, as do the cnodes above it then
+static bool require_attrs(struct cnode* cnode, const struct short_circuit* short_circuit)
+{
+    if(cnode->required == NULL) {
+        cnode->required = bmalloc(short_circuit->word_count * sizeof(*cnode->required));
+        if(cnode->required == NULL) {
+            fprintf(stderr, "%s bmalloc failed\n", __func__);
+            abort();
+        }
+        memcpy(cnode->required, short_circuit->fail, short_circuit->word_count * sizeof(*cnode->required));
+        cnode->required_count = short_circuit->word_count;
+        return true;
+    }
+    bool changed = false;
+    // Subs made before later attributes were added have shorter bitsets, which require none of those
+    if(short_circuit->word_count < cnode->required_count) {
+        cnode->required_count = short_circuit->word_count;
+        changed = true;
+    }
+    for(size_t i = 0; i < cnode->required_count; i++) {
+        uint64_t required = cnode->required[i] & short_circuit->fail[i];
+        changed |= required != cnode->required[i];
+        cnode->required[i] = required;
+    }
+    return changed;
+}
+
+// cnode whose pdir leads to this one, NULL for the root
+static struct cnode* pdir_cnode(const struct cnode* cnode)
+{
+    const struct cdir* cdir = cnode->parent;
+    if(cdir == NULL) {
+        return NULL;
+    }
+    while(cdir->parent_type == CNODE_PARENT_CDIR) {
+        cdir = cdir->cdir_parent;
+    }
+    return cdir->pnode_parent->parent->parent;
+}
+
+static void require_sub(const struct betree_sub* sub, const struct lnode* lnode)
+{
+    for(struct cnode* cnode = lnode->parent; cnode != NULL; cnode = pdir_cnode(cnode)) {
+        if(!require_attrs(cnode, &sub->short_circuit)) {
+            return;
+        }
+    }
+}
+
+static void require_cdir(const struct cdir* cdir)
+{
+    if(cdir == NULL) {
+        return;
+    }
+    require_be_tree(cdir->cnode);
+    require_cdir(cdir->lchild);
+    require_cdir(cdir->rchild);
+}
+
+void require_be_tree(struct cnode* cnode)
+{
+    for(size_t i = 0; i < cnode->lnode->sub_count; i++) {
+        require_sub(cnode->lnode->subs[i], cnode->lnode);
+    }
+    if(cnode->pdir != NULL) {
+        for(size_t i = 0; i < cnode->pdir->pnode_count; i++) {
+            require_cdir(cnode->pdir->pnodes[i]->cdir);
+        }
+    }
+}
+
 static void insert_sub(const struct betree_sub* sub, struct lnode* lnode)
 {
     if(lnode->sub_count == 0) {
@@ -320,8 +738,17 @@ static void insert_sub(const struct betree_sub* sub, struct lnode* lnode)
         }
         lnode->subs = subs;
     }
+    append_short_circuit(&lnode->short_circuits, lnode->sub_count, &sub->short_circuit);
+    if(lnode->columns != NULL) {
+        columns_append(lnode->columns, lnode->sub_count, sub);
+    }
     lnode->subs[lnode->sub_count] = (struct betree_sub*)sub;
     lnode->sub_count++;
+    ((struct betree_sub*)sub)->lnode = lnode;
+    if(lnode->postings != NULL) {
+        postings_add(lnode->postings, (struct betree_sub*)sub);
+    }
+    require_sub(sub, lnode);
 }
 
 static bool is_root(const struct cnode* cnode)
@@ -411,13 +838,6 @@ static double get_pnode_score(const struct attr_domain** attr_domains, struct pn
     return get_score(attr_domains, pnode->attr_var.var, count);
 }
 
-static double get_lnode_score(
-    const struct attr_domain** attr_domains, const struct lnode* lnode, betree_var_t var)
-{
-    size_t count = count_attr_in_lnode(var, lnode);
-    return get_score(attr_domains, var, count);
-}
-
 static void update_partition_score(const struct attr_domain** attr_domains, struct pnode* pnode)
 {
     pnode->score = get_pnode_score(attr_domains, pnode);
@@ -434,11 +854,9 @@ bool insert_be_tree(
     struct pnode* max_pnode = NULL;
     if(cnode->pdir != NULL) {
         float max_score = -DBL_MAX;
-        for(size_t i = 0; i < config->attr_domain_count; i++) {
-            if(test_bit(sub->attr_vars, i) == false) {
-                continue;
-            }
-            betree_var_t variable_id = i;
+        for(betree_var_t variable_id = next_sub_attribute(sub, 0);
+            variable_id < config->attr_domain_count;
+            variable_id = next_sub_attribute(sub, variable_id + 1)) {
             if(!is_used_cnode(variable_id, cnode)) {
                 struct pnode* pnode = search_pdir(variable_id, cnode->pdir);
                 if(pnode != NULL) {
@@ -493,11 +911,65 @@ static bool is_overflowed(const struct lnode* lnode)
     return lnode->sub_count > lnode->max;
 }
 
+// Whether the search takes the event down to cnode
+static bool sampled_event_reaches(
+    const struct config* config, const struct sampled_event* event, const struct cnode* cnode)
+{
+    while(cnode->parent != NULL) {
+        const struct cdir* cdir = cnode->parent;
+        for(; cdir->parent_type == CNODE_PARENT_CDIR; cdir = cdir->cdir_parent) {
+            // Open on the sides a cdir shares with the top of its pnode, as in search_cdir
+            bool open_left = true, open_right = true;
+            for(const struct cdir* child = cdir; child->parent_type == CNODE_PARENT_CDIR;
+                child = child->cdir_parent) {
+                open_left &= child == child->cdir_parent->lchild;
+                open_right &= child == child->cdir_parent->rchild;
+            }
+            // Variables added since the event was sampled are undefined in it
+            bool defined = cdir->attr_var.var < event->pred_count;
+            if(defined && !event_in_bound(event->preds, cdir, open_left, open_right)) {
+                return false;
+            }
+        }
+        const struct pnode* pnode = cdir->pnode_parent;
+        const struct attr_domain* attr_domain
+            = get_attr_domain((const struct attr_domain**)config->attr_domains, pnode->attr_var.var);
+        if(!attr_domain->allow_undefined && sampled_pred(event, pnode->attr_var.var) == NULL) {
+            return false;
+        }
+        cnode = pnode->parent->parent;
+    }
+    return true;
+}
+
+// While rebalancing, an lnode is also split when the sampled events get too many candidates from it
+static bool needs_split(const struct config* config, const struct cnode* cnode)
+{
+    const struct lnode* lnode = cnode->lnode;
+    if(is_overflowed(lnode)) {
+        return true;
+    }
+    const struct betree_event_sample* sample = config->event_sample;
+    if(sample == NULL || sample->count == 0 || lnode->sub_count <= config->partition_min_size) {
+        return false;
+    }
+    size_t reached = 0;
+    for(size_t i = 0; i < sample->count; i++) {
+        reached += sampled_event_reaches(config, &sample->events[i], cnode);
+    }
+    double candidates = (double)reached / (double)sample->count * (double)lnode->sub_count;
+    return candidates > (double)config->lnode_max_cap / 2.;
+}
+
 bool sub_has_attribute(const struct betree_sub* sub, betree_var_t variable_id)
 {
+    if(variable_id / 64 >= sub->short_circuit.word_count) {
+        return false;
+    }
     return test_bit(sub->attr_vars, variable_id);
 }
 
+
 bool sub_has_attribute_str(struct config* config, const struct betree_sub* sub, const char* attr)
 {
     betree_var_t variable_id = try_get_id_for_attr(config, attr);
@@ -507,15 +979,22 @@ bool sub_has_attribute_str(struct config* config, const struct betree_sub* sub,
     return sub_has_attribute(sub, variable_id);
 }
 
-static bool remove_sub(betree_sub_t sub, struct lnode* lnode)
+static bool remove_sub(const struct betree_sub* sub, struct lnode* lnode)
 {
     for(size_t i = 0; i < lnode->sub_count; i++) {
-        const struct betree_sub* lnode_sub = lnode->subs[i];
-        if(sub == lnode_sub->id) {
+        if(sub == lnode->subs[i]) {
             for(size_t j = i; j < lnode->sub_count - 1; j++) {
                 lnode->subs[j] = lnode->subs[j + 1];
             }
+            remove_short_circuit(&lnode->short_circuits, lnode->sub_count, i);
+            if(lnode->columns != NULL) {
+                columns_remove(lnode->columns, lnode->sub_count, i);
+            }
             lnode->sub_count--;
+            ((struct betree_sub*)sub)->lnode = NULL;
+            if(lnode->postings != NULL) {
+                postings_remove(lnode->postings, sub);
+            }
             if(lnode->sub_count == 0) {
                 bfree(lnode->subs);
                 lnode->subs = NULL;
@@ -536,7 +1015,7 @@ static bool remove_sub(betree_sub_t sub, struct lnode* lnode)
 
 static void move(const struct betree_sub* sub, struct lnode* origin, struct lnode* destination)
 {
-    bool isFound = remove_sub(sub->id, origin);
+    bool isFound = remove_sub(sub, origin);
     if(!isFound) {
         fprintf(stderr, "Could not find sub %" PRIu64 "\n", sub->id);
         abort();
@@ -557,8 +1036,99 @@ static void move(const struct betree_sub* sub, struct lnode* origin, struct lnod
         }
         destination->subs = subs;
     }
+    append_short_circuit(&destination->short_circuits, destination->sub_count, &sub->short_circuit);
+    if(destination->columns != NULL) {
+        columns_append(destination->columns, destination->sub_count, sub);
+    }
     destination->subs[destination->sub_count] = (struct betree_sub*)sub;
     destination->sub_count++;
+    ((struct betree_sub*)sub)->lnode = destination;
+    if(destination->postings != NULL) {
+        postings_add(destination->postings, (struct betree_sub*)sub);
+    }
+    require_sub(sub, destination);
+}
+
+static void append_subs(struct betree_sub** subs, size_t count, struct lnode* lnode)
+{
+    if(count == 0) {
+        return;
+    }
+    struct betree_sub** grown = brealloc(lnode->subs, sizeof(*grown) * (lnode->sub_count + count));
+    if(grown == NULL) {
+        fprintf(stderr, "%s brealloc failed\n", __func__);
+        abort();
+    }
+    lnode->subs = grown;
+    for(size_t i = 0; i < count; i++) {
+        subs[i]->lnode = lnode;
+        append_short_circuit(&lnode->short_circuits, lnode->sub_count + i, &subs[i]->short_circuit);
+        if(lnode->columns != NULL) {
+            columns_append(lnode->columns, lnode->sub_count + i, subs[i]);
+        }
+        lnode->subs[lnode->sub_count + i] = subs[i];
+        if(lnode->postings != NULL) {
+            postings_add(lnode->postings, subs[i]);
+        }
+        require_sub(subs[i], lnode);
+    }
+    lnode->sub_count += count;
+}
+
+// Same result as calling move on every flagged sub in order, in a single pass over origin
+static void move_flagged_subs(struct lnode* origin, const bool* flagged, struct lnode* destination)
+{
+    size_t kept = 0;
+    size_t moved = 0;
+    struct betree_sub** subs = bmalloc(sizeof(*subs) * (origin->sub_count + 1));
+    if(subs == NULL) {
+        fprintf(stderr, "%s bmalloc failed\n", __func__);
+        abort();
+    }
+    for(size_t i = 0; i < origin->sub_count; i++) {
+        if(flagged[i]) {
+            subs[moved] = origin->subs[i];
+            moved++;
+            if(origin->postings != NULL) {
+                postings_remove(origin->postings, origin->subs[i]);
+            }
+        }
+        else {
+            origin->subs[kept] = origin->subs[i];
+            kept++;
+        }
+    }
+    if(moved != 0) {
+        origin->sub_count = kept;
+        if(kept == 0) {
+            bfree(origin->subs);
+            origin->subs = NULL;
+        }
+        else {
+            struct betree_sub** shrunk = brealloc(origin->subs, sizeof(*shrunk) * kept);
+            if(shrunk == NULL) {
+                fprintf(stderr, "%s brealloc failed\n", __func__);
+                abort();
+            }
+            origin->subs = shrunk;
+        }
+        rebuild_short_circuits(&origin->short_circuits, origin->subs, kept);
+        if(origin->columns != NULL) {
+            index_lnode_columns(origin, true);
+        }
+        append_subs(subs, moved, destination);
+    }
+    bfree(subs);
+}
+
+static bool* make_sub_flags(size_t count)
+{
+    bool* flags = bcalloc((count + 1) * sizeof(*flags));
+    if(flags == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    return flags;
 }
 
 static struct cdir* create_cdir(const struct config* config,
@@ -634,6 +1204,7 @@ struct pnode* create_pdir(
         const struct attr_domain* attr_domain = config->attr_domains[i];
         if(attr_domain->attr_var.var == variable_id) {
             bound = attr_domain->bound;
+            pnode->allow_undefined = attr_domain->allow_undefined;
             found = true;
             break;
         }
@@ -659,7 +1230,9 @@ struct pnode* create_pdir(
         }
         pdir->pnodes = pnodes;
     }
-    pdir->pnodes[pdir->pnode_count] = pnode;
+    size_t position = lower_pnode(variable_id, pdir);
+    memmove(&pdir->pnodes[position + 1], &pdir->pnodes[position], (pdir->pnode_count - position) * sizeof(*pdir->pnodes));
+    pdir->pnodes[position] = pnode;
     pdir->pnode_count++;
     return pnode;
 }
@@ -676,7 +1249,7 @@ static size_t count_attr_in_lnode(betree_var_t variable_id, const struct lnode*
             fprintf(stderr, "%s, sub is NULL\n", __func__);
             continue;
         }
-        if(test_bit(sub->attr_vars, variable_id) == true) {
+        if(sub_has_attribute(sub, variable_id)) {
             count++;
         }
     }
@@ -762,33 +1335,77 @@ static bool splitable_attr_domain(
     }
 }
 
-static bool get_next_highest_score_unused_attr(
-    const struct config* config, const struct lnode* lnode, betree_var_t* var)
+// Subs with var the sampled events can't match on average, what a partition on var prunes
+static double get_sampled_score(const struct config* config, const struct lnode* lnode, betree_var_t var)
 {
-    bool found = false;
-    double highest_score = 0;
-    betree_var_t highest_var;
+    const struct betree_event_sample* sample = config->event_sample;
+    const struct attr_domain* attr_domain
+        = get_attr_domain((const struct attr_domain**)config->attr_domains, var);
+    size_t pruned = 0;
     for(size_t i = 0; i < lnode->sub_count; i++) {
         const struct betree_sub* sub = lnode->subs[i];
-        for(size_t j = 0; j < config->attr_domain_count; j++) {
-            if(test_bit(sub->attr_vars, j) == false) {
-                continue;
+        if(!sub_has_attribute(sub, var)) {
+            continue;
+        }
+        struct value_bound bound = get_sub_bound(attr_domain, sub);
+        for(size_t j = 0; j < sample->count; j++) {
+            const struct betree_variable* pred = sampled_pred(&sample->events[j], var);
+            if(pred == NULL ? !attr_domain->allow_undefined : !sampled_value_in_bound(pred, &bound)) {
+                pruned++;
             }
+        }
+    }
+    return (double)pruned / (double)sample->count;
+}
+
+static bool get_next_highest_score_unused_attr(
+    const struct config* config, const struct lnode* lnode, betree_var_t* var)
+{
+    bool found = false;
+    double highest_score = 0;
+    betree_var_t highest_var = INVALID_VAR;
+    // Count every attribute in one pass instead of rescanning the lnode for each candidate
+    size_t* counts = bcalloc((config->attr_domain_count + 1) * sizeof(*counts));
+    bool* seen = bcalloc((config->attr_domain_count + 1) * sizeof(*seen));
+    if(counts == NULL || seen == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    for(size_t i = 0; i < lnode->sub_count; i++) {
+        const struct betree_sub* sub = lnode->subs[i];
+        for(betree_var_t j = next_sub_attribute(sub, 0); j < config->attr_domain_count;
+            j = next_sub_attribute(sub, j + 1)) {
+            counts[j]++;
+        }
+    }
+    // Candidates are still visited in the order subs first use them, to keep the same tie breaks
+    for(size_t i = 0; i < lnode->sub_count; i++) {
+        const struct betree_sub* sub = lnode->subs[i];
+        for(betree_var_t j = next_sub_attribute(sub, 0); j < config->attr_domain_count;
+            j = next_sub_attribute(sub, j + 1)) {
+            if(seen[j]) {
+                continue;
+            }
+            seen[j] = true;
             betree_var_t current_variable_id = j;
             const struct attr_domain* attr_domain = get_attr_domain(
                 (const struct attr_domain**)config->attr_domains, current_variable_id);
             if(splitable_attr_domain(config, attr_domain)
                 && !is_attr_used_in_parent_lnode(current_variable_id, lnode)) {
-                double current_score = get_lnode_score(
-                    (const struct attr_domain**)config->attr_domains, lnode, current_variable_id);
-                found = true;
-                if(current_score > highest_score) {
+                double current_score = config->event_sample != NULL && config->event_sample->count != 0
+                    ? get_sampled_score(config, lnode, current_variable_id)
+                    : get_score((const struct attr_domain**)config->attr_domains, current_variable_id, counts[j]);
+                // Sampled scores can be 0 when nothing gets pruned
+                if(!found || current_score > highest_score) {
+                    found = true;
                     highest_score = current_score;
                     highest_var = current_variable_id;
                 }
             }
         }
     }
+    bfree(counts);
+    bfree(seen);
     if(found == false) {
         return false;
     }
@@ -823,7 +1440,7 @@ static size_t count_subs_with_variable(
 static void space_partitioning(const struct config* config, struct cnode* cnode)
 {
     struct lnode* lnode = cnode->lnode;
-    while(is_overflowed(lnode) == true) {
+    while(needs_split(config, cnode) == true) {
         betree_var_t var;
         bool found = get_next_highest_score_unused_attr(config, lnode, &var);
         if(found == false) {
@@ -836,14 +1453,13 @@ static void space_partitioning(const struct config* config, struct cnode* cnode)
         }
         const char* attr = config->attr_domains[var]->attr_var.attr;
         struct pnode* pnode = create_pdir(config, attr, var, cnode);
+        // The new cdir is a leaf, so every sub with the attribute lands in its lnode
+        bool* flagged = make_sub_flags(lnode->sub_count);
         for(size_t i = 0; i < lnode->sub_count; i++) {
-            const struct betree_sub* sub = lnode->subs[i];
-            if(sub_has_attribute(sub, var)) {
-                struct cdir* cdir = insert_cdir(config, sub, pnode->cdir);
-                move(sub, lnode, cdir->cnode->lnode);
-                i--;
-            }
+            flagged[i] = sub_has_attribute(lnode->subs[i], var);
         }
+        move_flagged_subs(lnode, flagged, pnode->cdir->cnode->lnode);
+        bfree(flagged);
         space_clustering(config, pnode->cdir);
     }
     update_cluster_capacity(config, lnode);
@@ -889,6 +1505,8 @@ struct lnode* make_lnode(const struct config* config, struct cnode* parent)
     lnode->sub_count = 0;
     lnode->subs = NULL;
     lnode->max = config->lnode_max_cap;
+    lnode->postings = config->prefilter ? make_lnode_postings() : NULL;
+    lnode->columns = config->columns ? make_lnode_columns() : NULL;
     return lnode;
 }
 
@@ -1019,33 +1637,187 @@ static struct value_bounds split_value_bound(struct value_bound bound)
     return bounds;
 }
 
+static bool bound_encloses(const struct value_bound* outer, const struct value_bound* inner)
+{
+    switch(outer->value_type) {
+        case(BETREE_INTEGER):
+        case(BETREE_INTEGER_LIST):
+            return outer->imin <= inner->imin && outer->imax >= inner->imax;
+        case(BETREE_FLOAT):
+            return outer->fmin <= inner->fmin && outer->fmax >= inner->fmax;
+        case(BETREE_BOOLEAN):
+            return outer->bmin <= inner->bmin && outer->bmax >= inner->bmax;
+        case(BETREE_STRING):
+        case(BETREE_STRING_LIST):
+        case(BETREE_INTEGER_ENUM):
+        case(BETREE_INTEGER_LIST_ENUM):
+            return outer->smin <= inner->smin && outer->smax >= inner->smax;
+        case(BETREE_SEGMENTS):
+        case(BETREE_FREQUENCY_CAPS):
+        default: abort();
+    }
+}
+
+// Subs left in the parent plus the larger child, what a search down one side still sees
+static size_t split_cost(const struct value_bound* bounds, size_t count, const struct value_bounds* split)
+{
+    size_t left = 0, right = 0;
+    for(size_t i = 0; i < count; i++) {
+        if(bound_encloses(&split->lbound, &bounds[i])) {
+            left++;
+        }
+        else if(bound_encloses(&split->rbound, &bounds[i])) {
+            right++;
+        }
+    }
+    return count - left - right + smax(left, right);
+}
+
+static int int64_cmp(const void* a, const void* b)
+{
+    int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static int double_cmp(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Split at the median of the sub bounds' centers, false when the range is too narrow to pick a point
+static bool median_split(const struct value_bound* bounds, size_t count, struct value_bound bound, struct value_bounds* split)
+{
+    split->lbound = bound;
+    split->rbound = bound;
+    switch(bound.value_type) {
+        case(BETREE_INTEGER):
+        case(BETREE_INTEGER_LIST): {
+            if(bound.imax - bound.imin <= 2) {
+                return false;
+            }
+            int64_t* centers = bmalloc(count * sizeof(*centers));
+            if(centers == NULL) {
+                fprintf(stderr, "%s bmalloc failed\n", __func__);
+                abort();
+            }
+            for(size_t i = 0; i < count; i++) {
+                centers[i] = bounds[i].imin + (bounds[i].imax - bounds[i].imin) / 2;
+            }
+            qsort(centers, count, sizeof(*centers), int64_cmp);
+            int64_t middle = centers[count / 2];
+            bfree(centers);
+            middle = middle <= bound.imin ? bound.imin + 1 : middle >= bound.imax ? bound.imax - 1 : middle;
+            split->lbound.imax = middle;
+            split->rbound.imin = middle;
+            return true;
+        }
+        case(BETREE_FLOAT): {
+            if(bound.fmax - bound.fmin <= 2) {
+                return false;
+            }
+            double* centers = bmalloc(count * sizeof(*centers));
+            if(centers == NULL) {
+                fprintf(stderr, "%s bmalloc failed\n", __func__);
+                abort();
+            }
+            for(size_t i = 0; i < count; i++) {
+                centers[i] = bounds[i].fmin + (bounds[i].fmax - bounds[i].fmin) / 2;
+            }
+            qsort(centers, count, sizeof(*centers), double_cmp);
+            // Whole like the midpoint split
+            double middle = ceil(centers[count / 2]);
+            bfree(centers);
+            middle = middle < bound.fmin + 1 ? bound.fmin + 1 : middle > bound.fmax - 1 ? bound.fmax - 1 : middle;
+            split->lbound.fmax = middle;
+            split->rbound.fmin = middle;
+            return true;
+        }
+        case(BETREE_STRING):
+        case(BETREE_STRING_LIST):
+        case(BETREE_INTEGER_ENUM):
+        case(BETREE_INTEGER_LIST_ENUM): {
+            if(bound.smax - bound.smin <= 2) {
+                return false;
+            }
+            int64_t* centers = bmalloc(count * sizeof(*centers));
+            if(centers == NULL) {
+                fprintf(stderr, "%s bmalloc failed\n", __func__);
+                abort();
+            }
+            for(size_t i = 0; i < count; i++) {
+                centers[i] = (int64_t)(bounds[i].smin + (bounds[i].smax - bounds[i].smin) / 2);
+            }
+            qsort(centers, count, sizeof(*centers), int64_cmp);
+            size_t middle = (size_t)centers[count / 2];
+            bfree(centers);
+            middle = middle <= bound.smin ? bound.smin + 1 : middle >= bound.smax ? bound.smax - 1 : middle;
+            split->lbound.smax = middle;
+            split->rbound.smin = middle;
+            return true;
+        }
+        case(BETREE_BOOLEAN):
+            return false;
+        case(BETREE_SEGMENTS):
+        case(BETREE_FREQUENCY_CAPS):
+        default: abort();
+    }
+}
+
+// The midpoint, or the median of the subs when balanced splits are on and it leaves a search fewer subs
+static struct value_bounds choose_split(const struct config* config, const struct cdir* cdir)
+{
+    struct value_bounds midpoint = split_value_bound(cdir->bound);
+    const struct lnode* lnode = cdir->cnode->lnode;
+    if(!config->balanced_splits || lnode->sub_count == 0) {
+        return midpoint;
+    }
+    const struct attr_domain* attr_domain
+        = get_attr_domain((const struct attr_domain**)config->attr_domains, cdir->attr_var.var);
+    struct value_bound* bounds = bmalloc(lnode->sub_count * sizeof(*bounds));
+    if(bounds == NULL) {
+        fprintf(stderr, "%s bmalloc failed\n", __func__);
+        abort();
+    }
+    for(size_t i = 0; i < lnode->sub_count; i++) {
+        bounds[i] = get_sub_bound(attr_domain, lnode->subs[i]);
+    }
+    struct value_bounds median;
+    struct value_bounds split = midpoint;
+    if(median_split(bounds, lnode->sub_count, cdir->bound, &median)
+        && split_cost(bounds, lnode->sub_count, &median) < split_cost(bounds, lnode->sub_count, &midpoint)) {
+        split = median;
+    }
+    bfree(bounds);
+    return split;
+}
+
 static void space_clustering(const struct config* config, struct cdir* cdir)
 {
     if(cdir == NULL || cdir->cnode == NULL) {
         return;
     }
     struct lnode* lnode = cdir->cnode->lnode;
-    if(!is_overflowed(lnode)) {
+    if(!needs_split(config, cdir->cnode)) {
         return;
     }
     if(!is_leaf(cdir) || is_atomic(cdir)) {
         space_partitioning(config, cdir->cnode);
     }
     else {
-        struct value_bounds bounds = split_value_bound(cdir->bound);
+        struct value_bounds bounds = choose_split(config, cdir);
         cdir->lchild = create_cdir_with_cdir_parent(config, cdir, bounds.lbound);
         cdir->rchild = create_cdir_with_cdir_parent(config, cdir, bounds.rbound);
+        bool* flagged = make_sub_flags(lnode->sub_count);
         for(size_t i = 0; i < lnode->sub_count; i++) {
-            const struct betree_sub* sub = lnode->subs[i];
-            if(sub_is_enclosed((const struct attr_domain**)config->attr_domains, sub, cdir->lchild)) {
-                move(sub, lnode, cdir->lchild->cnode->lnode);
-                i--;
-            }
-            else if(sub_is_enclosed((const struct attr_domain**)config->attr_domains, sub, cdir->rchild)) {
-                move(sub, lnode, cdir->rchild->cnode->lnode);
-                i--;
-            }
+            flagged[i] = sub_is_enclosed((const struct attr_domain**)config->attr_domains, lnode->subs[i], cdir->lchild);
         }
+        move_flagged_subs(lnode, flagged, cdir->lchild->cnode->lnode);
+        for(size_t i = 0; i < lnode->sub_count; i++) {
+            flagged[i] = sub_is_enclosed((const struct attr_domain**)config->attr_domains, lnode->subs[i], cdir->rchild);
+        }
+        move_flagged_subs(lnode, flagged, cdir->rchild->cnode->lnode);
+        bfree(flagged);
         space_partitioning(config, cdir->cnode);
         space_clustering(config, cdir->lchild);
         space_clustering(config, cdir->rchild);
@@ -1053,40 +1825,154 @@ static void space_clustering(const struct config* config, struct cdir* cdir)
     update_cluster_capacity(config, lnode);
 }
 
-/*static bool search_delete_cdir(size_t attr_domains_count,*/
-    /*const struct attr_domain** attr_domains, struct betree_sub* sub, struct cdir* cdir);*/
-
-/*static bool delete_sub_from_leaf(betree_sub_t sub, struct lnode* lnode)*/
-/*{*/
-    /*return remove_sub(sub, lnode);*/
-/*}*/
+// Sides on which the domain reaches past the top cdir of a pnode
+static void domain_overhang(
+    const struct value_bound* top, const struct value_bound* domain, bool* left, bool* right)
+{
+    *left = false;
+    *right = false;
+    switch(domain->value_type) {
+        case BETREE_INTEGER:
+        case BETREE_INTEGER_LIST:
+            *left = domain->imin < top->imin;
+            *right = domain->imax > top->imax;
+            break;
+        case BETREE_FLOAT:
+            *left = domain->fmin < top->fmin;
+            *right = domain->fmax > top->fmax;
+            break;
+        case BETREE_STRING:
+        case BETREE_STRING_LIST:
+        case BETREE_INTEGER_ENUM:
+        case BETREE_INTEGER_LIST_ENUM:
+            *left = domain->smin < top->smin;
+            *right = domain->smax > top->smax;
+            break;
+        case BETREE_BOOLEAN:
+        case BETREE_SEGMENTS:
+        case BETREE_FREQUENCY_CAPS:
+            break;
+        default: abort();
+    }
+}
 
-/*static bool is_lnode_empty(const struct lnode* lnode)*/
-/*{*/
-    /*return lnode == NULL || lnode->sub_count == 0;*/
-/*}*/
+static void widen_side(struct value_bound* bound, const struct value_bound* domain, bool left)
+{
+    switch(domain->value_type) {
+        case BETREE_INTEGER:
+        case BETREE_INTEGER_LIST:
+            if(left) {
+                bound->imin = domain->imin;
+            }
+            else {
+                bound->imax = domain->imax;
+            }
+            break;
+        case BETREE_FLOAT:
+            if(left) {
+                bound->fmin = domain->fmin;
+            }
+            else {
+                bound->fmax = domain->fmax;
+            }
+            break;
+        case BETREE_STRING:
+        case BETREE_STRING_LIST:
+        case BETREE_INTEGER_ENUM:
+        case BETREE_INTEGER_LIST_ENUM:
+            if(left) {
+                bound->smin = domain->smin;
+            }
+            else {
+                bound->smax = domain->smax;
+            }
+            break;
+        case BETREE_BOOLEAN:
+        case BETREE_SEGMENTS:
+        case BETREE_FREQUENCY_CAPS:
+        default: abort();
+    }
+}
 
-/*static bool is_pdir_empty(const struct pdir* pdir)*/
-/*{*/
-    /*return pdir == NULL || pdir->pnode_count == 0;*/
-/*}*/
+// Subs kept in a widened cdir because they did not fit in either child go down to the one they fit in now
+static void push_down_subs(const struct config* config, struct cdir* cdir)
+{
+    struct lnode* lnode = cdir->cnode->lnode;
+    if(is_leaf(cdir) || lnode->sub_count == 0) {
+        return;
+    }
+    const struct attr_domain** attr_domains = (const struct attr_domain**)config->attr_domains;
+    struct betree_sub** moved = bmalloc(sizeof(*moved) * lnode->sub_count);
+    if(moved == NULL) {
+        fprintf(stderr, "%s bmalloc failed\n", __func__);
+        abort();
+    }
+    size_t count = 0;
+    for(size_t i = 0; i < lnode->sub_count; i++) {
+        struct betree_sub* sub = lnode->subs[i];
+        if(sub_is_enclosed(attr_domains, sub, cdir->lchild) || sub_is_enclosed(attr_domains, sub, cdir->rchild)) {
+            moved[count] = sub;
+            count++;
+        }
+    }
+    for(size_t i = 0; i < count; i++) {
+        remove_sub(moved[i], lnode);
+        struct cdir* target = insert_cdir(config, moved[i], cdir);
+        insert_be_tree(config, moved[i], target->cnode, target);
+    }
+    bfree(moved);
+    update_cluster_capacity(config, lnode);
+}
 
-/*static bool is_cnode_empty(const struct cnode* cnode)*/
-/*{*/
-    /*return cnode == NULL || (is_lnode_empty(cnode->lnode) && is_pdir_empty(cnode->pdir));*/
-/*}*/
+// The outer cdirs of a pnode are searched open on their outer side, so moving those sides out to
+// the domain changes no match. The inner splits stay where they are
+static void widen_pnode(const struct config* config, struct pnode* pnode)
+{
+    const struct attr_domain* attr_domain
+        = get_attr_domain((const struct attr_domain**)config->attr_domains, pnode->attr_var.var);
+    bool left, right;
+    domain_overhang(&pnode->cdir->bound, &attr_domain->bound, &left, &right);
+    if(!left && !right) {
+        return;
+    }
+    for(struct cdir* cdir = pnode->cdir; left && cdir != NULL; cdir = cdir->lchild) {
+        widen_side(&cdir->bound, &attr_domain->bound, true);
+    }
+    for(struct cdir* cdir = pnode->cdir; right && cdir != NULL; cdir = cdir->rchild) {
+        widen_side(&cdir->bound, &attr_domain->bound, false);
+    }
+    // Top down, subs pushed out of a cdir can go further down the same side
+    for(struct cdir* cdir = pnode->cdir; left && cdir != NULL; cdir = cdir->lchild) {
+        push_down_subs(config, cdir);
+    }
+    for(struct cdir* cdir = right && left ? pnode->cdir->rchild : pnode->cdir; right && cdir != NULL;
+        cdir = cdir->rchild) {
+        push_down_subs(config, cdir);
+    }
+    update_partition_score((const struct attr_domain**)config->attr_domains, pnode);
+}
 
-/*static bool is_cdir_empty(const struct cdir* cdir)*/
-/*{*/
-    /*return cdir == NULL*/
-        /*|| (is_cnode_empty(cdir->cnode) && is_cdir_empty(cdir->lchild)*/
-               /*&& is_cdir_empty(cdir->rchild));*/
-/*}*/
+static void widen_cdir(const struct config* config, struct cdir* cdir)
+{
+    if(cdir == NULL) {
+        return;
+    }
+    widen_be_tree(config, cdir->cnode);
+    widen_cdir(config, cdir->lchild);
+    widen_cdir(config, cdir->rchild);
+}
 
-/*static bool is_pnode_empty(const struct pnode* pnode)*/
-/*{*/
-    /*return pnode == NULL || (is_cdir_empty(pnode->cdir));*/
-/*}*/
+void widen_be_tree(const struct config* config, struct cnode* cnode)
+{
+    if(cnode->pdir == NULL) {
+        return;
+    }
+    for(size_t i = 0; i < cnode->pdir->pnode_count; i++) {
+        struct pnode* pnode = cnode->pdir->pnodes[i];
+        widen_pnode(config, pnode);
+        widen_cdir(config, pnode->cdir);
+    }
+}
 
 static void free_pnode(struct pnode* pnode);
 
@@ -1119,12 +2005,14 @@ void free_sub(struct betree_sub* sub)
     if(sub == NULL) {
         return;
     }
-    bfree(sub->attr_vars);
-    sub->attr_vars = NULL;
+    free_ast_program(sub->program);
+    sub->program = NULL;
     free_ast_node((struct ast_node*)sub->expr);
     sub->expr = NULL;
-    bfree(sub->short_circuit.pass);
-    bfree(sub->short_circuit.fail);
+    bfree(sub->bounds);
+#ifdef BETREE_JIT
+    jit_free(sub->native);
+#endif
     bfree(sub);
 }
 
@@ -1143,6 +2031,37 @@ void free_event(struct betree_event* event)
     bfree(event);
 }
 
+void merge_events(struct betree_event* event, struct betree_event* delta)
+{
+    for(size_t i = 0; i < delta->variable_count; i++) {
+        struct betree_variable* pred = delta->variables[i];
+        if(pred == NULL) {
+            continue;
+        }
+        size_t j = 0;
+        while(j < event->variable_count
+            && (event->variables[j] == NULL || event->variables[j]->attr_var.var != pred->attr_var.var)) {
+            j++;
+        }
+        if(j == event->variable_count) {
+            struct betree_variable** variables
+                = brealloc(event->variables, (event->variable_count + 1) * sizeof(*event->variables));
+            if(variables == NULL) {
+                fprintf(stderr, "%s brealloc failed\n", __func__);
+                abort();
+            }
+            event->variables = variables;
+            event->variable_count++;
+        }
+        else {
+            free_pred(event->variables[j]);
+        }
+        event->variables[j] = pred;
+    }
+    bfree(delta->variables);
+    bfree(delta);
+}
+
 void free_lnode(struct lnode* lnode)
 {
     if(lnode == NULL) {
@@ -1154,6 +2073,9 @@ void free_lnode(struct lnode* lnode)
     }
     bfree(lnode->subs);
     lnode->subs = NULL;
+    free_lnode_postings(lnode->postings);
+    free_lnode_columns(lnode->columns);
+    free_short_circuits(&lnode->short_circuits);
     bfree(lnode);
 }
 
@@ -1166,6 +2088,7 @@ void free_cnode(struct cnode* cnode)
     cnode->lnode = NULL;
     free_pdir(cnode->pdir);
     cnode->pdir = NULL;
+    bfree(cnode->required);
     bfree(cnode);
 }
 
@@ -1184,32 +2107,6 @@ static void free_cdir(struct cdir* cdir)
     bfree(cdir);
 }
 
-/*static void try_remove_pnode_from_parent(const struct pnode* pnode)*/
-/*{*/
-    /*struct pdir* pdir = pnode->parent;*/
-    /*for(size_t i = 0; i < pdir->pnode_count; i++) {*/
-        /*if(pnode == pdir->pnodes[i]) {*/
-            /*for(size_t j = i; j < pdir->pnode_count - 1; j++) {*/
-                /*pdir->pnodes[j] = pdir->pnodes[j + 1];*/
-            /*}*/
-            /*pdir->pnode_count--;*/
-            /*if(pdir->pnode_count == 0) {*/
-                /*bfree(pdir->pnodes);*/
-                /*pdir->pnodes = NULL;*/
-            /*}*/
-            /*else {*/
-                /*struct pnode** pnodes = brealloc(pdir->pnodes, sizeof(*pnodes) * pdir->pnode_count);*/
-                /*if(pnodes == NULL) {*/
-                    /*fprintf(stderr, "%s brealloc failed\n", __func__);*/
-                    /*abort();*/
-                /*}*/
-                /*pdir->pnodes = pnodes;*/
-            /*}*/
-            /*return;*/
-        /*}*/
-    /*}*/
-/*}*/
-
 static void free_pnode(struct pnode* pnode)
 {
     if(pnode == NULL) {
@@ -1221,151 +2118,393 @@ static void free_pnode(struct pnode* pnode)
     bfree(pnode);
 }
 
-/*bool betree_delete_inner(size_t attr_domains_count,*/
-    /*const struct attr_domain** attr_domains, struct betree_sub* sub, struct cnode* cnode)*/
-/*{*/
-    /*struct pnode* pnode = NULL;*/
-    /*bool isFound = delete_sub_from_leaf(sub->id, cnode->lnode);*/
-    /*if(!isFound) {*/
-        /*for(size_t i = 0; i < attr_domains_count; i++) {*/
-            /*if(test_bit(sub->attr_vars, i) == false) {*/
-                /*continue;*/
-            /*}*/
-            /*betree_var_t variable_id = i;*/
-            /*pnode = search_pdir(variable_id, cnode->pdir);*/
-            /*if(pnode != NULL) {*/
-                /*isFound = search_delete_cdir(attr_domains_count, attr_domains, sub, pnode->cdir);*/
-            /*}*/
-            /*if(isFound) {*/
-                /*break;*/
-            /*}*/
-        /*}*/
-    /*}*/
-    /*if(isFound) {*/
-        /*if(pnode != NULL && is_pnode_empty(pnode)) {*/
-            /*try_remove_pnode_from_parent(pnode);*/
-            /*free_pnode(pnode);*/
-        /*}*/
-        /*if(cnode != NULL && is_pdir_empty(cnode->pdir)) {*/
-            /*free_pdir(cnode->pdir);*/
-            /*cnode->pdir = NULL;*/
-        /*}*/
-        /*if(!is_root(cnode)) {*/
-            /*if(cnode != NULL && is_lnode_empty(cnode->lnode)) {*/
-                /*free_lnode(cnode->lnode);*/
-                /*cnode->lnode = NULL;*/
-            /*}*/
-            /*if(is_cnode_empty(cnode)) {*/
-                /*cnode->parent->cnode = NULL;*/
-                /*free_cnode(cnode);*/
-            /*}*/
-        /*}*/
-    /*}*/
-    /*return isFound;*/
-/*}*/
-
-static struct betree_sub* find_sub_id_cdir(betree_sub_t id, struct cdir* cdir)
+static void update_partition_scores_cdir(const struct config* config, struct cdir* cdir);
+
+static void update_partition_scores(const struct config* config, struct cnode* cnode)
+{
+    if(cnode->pdir == NULL) {
+        return;
+    }
+    for(size_t i = 0; i < cnode->pdir->pnode_count; i++) {
+        struct pnode* pnode = cnode->pdir->pnodes[i];
+        update_partition_scores_cdir(config, pnode->cdir);
+        update_partition_score((const struct attr_domain**)config->attr_domains, pnode);
+    }
+}
+
+static void update_partition_scores_cdir(const struct config* config, struct cdir* cdir)
+{
+    if(cdir == NULL) {
+        return;
+    }
+    update_partition_scores(config, cdir->cnode);
+    update_partition_scores_cdir(config, cdir->lchild);
+    update_partition_scores_cdir(config, cdir->rchild);
+}
+
+static void index_cdir_postings(struct cdir* cdir, bool enable);
+
+void index_be_tree_postings(struct cnode* cnode, bool enable)
+{
+    index_lnode_postings(cnode->lnode, enable);
+    if(cnode->pdir == NULL) {
+        return;
+    }
+    for(size_t i = 0; i < cnode->pdir->pnode_count; i++) {
+        index_cdir_postings(cnode->pdir->pnodes[i]->cdir, enable);
+    }
+}
+
+static void index_cdir_postings(struct cdir* cdir, bool enable)
+{
+    if(cdir == NULL) {
+        return;
+    }
+    index_be_tree_postings(cdir->cnode, enable);
+    index_cdir_postings(cdir->lchild, enable);
+    index_cdir_postings(cdir->rchild, enable);
+}
+
+static void index_cdir_columns(struct cdir* cdir, bool enable);
+
+void index_be_tree_columns(struct cnode* cnode, bool enable)
+{
+    index_lnode_columns(cnode->lnode, enable);
+    if(cnode->pdir == NULL) {
+        return;
+    }
+    for(size_t i = 0; i < cnode->pdir->pnode_count; i++) {
+        index_cdir_columns(cnode->pdir->pnodes[i]->cdir, enable);
+    }
+}
+
+static void index_cdir_columns(struct cdir* cdir, bool enable)
+{
+    if(cdir == NULL) {
+        return;
+    }
+    index_be_tree_columns(cdir->cnode, enable);
+    index_cdir_columns(cdir->lchild, enable);
+    index_cdir_columns(cdir->rchild, enable);
+}
+
+static int hits_cmp(const void* a, const void* b)
+{
+    const struct betree_sub* x = *(const struct betree_sub* const*)a;
+    const struct betree_sub* y = *(const struct betree_sub* const*)b;
+    if(x->hits != y->hits) {
+        return x->hits > y->hits ? -1 : 1;
+    }
+    return x->id < y->id ? -1 : x->id > y->id;
+}
+
+static void order_lnode_by_hits(struct lnode* lnode)
+{
+    bool ordered = true;
+    for(size_t i = 1; i < lnode->sub_count && ordered; i++) {
+        ordered = hits_cmp(&lnode->subs[i - 1], &lnode->subs[i]) <= 0;
+    }
+    if(!ordered) {
+        qsort(lnode->subs, lnode->sub_count, sizeof(*lnode->subs), hits_cmp);
+        // Everything indexed by position follows
+        rebuild_short_circuits(&lnode->short_circuits, lnode->subs, lnode->sub_count);
+        if(lnode->postings != NULL) {
+            index_lnode_postings(lnode, true);
+        }
+        if(lnode->columns != NULL) {
+            index_lnode_columns(lnode, true);
+        }
+    }
+    // Later orders weigh the recent searches more
+    for(size_t i = 0; i < lnode->sub_count; i++) {
+        lnode->subs[i]->hits /= 2;
+    }
+}
+
+static void order_cdir_by_hits(struct cdir* cdir)
+{
+    if(cdir == NULL) {
+        return;
+    }
+    order_be_tree_by_hits(cdir->cnode);
+    order_cdir_by_hits(cdir->lchild);
+    order_cdir_by_hits(cdir->rchild);
+}
+
+void order_be_tree_by_hits(struct cnode* cnode)
+{
+    order_lnode_by_hits(cnode->lnode);
+    if(cnode->pdir == NULL) {
+        return;
+    }
+    for(size_t i = 0; i < cnode->pdir->pnode_count; i++) {
+        order_cdir_by_hits(cnode->pdir->pnodes[i]->cdir);
+    }
+}
+
+#ifdef BETREE_STATS
+static void reset_stats_cdir(struct cdir* cdir)
+{
+    if(cdir == NULL) {
+        return;
+    }
+    memset(&cdir->stats, 0, sizeof(cdir->stats));
+    reset_stats_cnode(cdir->cnode);
+    reset_stats_cdir(cdir->lchild);
+    reset_stats_cdir(cdir->rchild);
+}
+#endif
+
+void reset_stats_cnode(struct cnode* cnode)
+{
+#ifdef BETREE_STATS
+    memset(&cnode->stats, 0, sizeof(cnode->stats));
+    memset(&cnode->lnode->stats, 0, sizeof(cnode->lnode->stats));
+    for(size_t i = 0; i < cnode->lnode->sub_count; i++) {
+        memset(&cnode->lnode->subs[i]->stats, 0, sizeof(cnode->lnode->subs[i]->stats));
+    }
+    if(cnode->pdir == NULL) {
+        return;
+    }
+    for(size_t i = 0; i < cnode->pdir->pnode_count; i++) {
+        struct pnode* pnode = cnode->pdir->pnodes[i];
+        memset(&pnode->stats, 0, sizeof(pnode->stats));
+        reset_stats_cdir(pnode->cdir);
+    }
+#else
+    (void)cnode;
+#endif
+}
+
+static void collect_subs_cdir(const struct cdir* cdir, struct betree_sub** subs, size_t* count)
+{
+    if(cdir == NULL) {
+        return;
+    }
+    collect_subs(cdir->cnode, subs, count);
+    collect_subs_cdir(cdir->lchild, subs, count);
+    collect_subs_cdir(cdir->rchild, subs, count);
+}
+
+void collect_subs(const struct cnode* cnode, struct betree_sub** subs, size_t* count)
+{
+    // Only counts when subs is NULL
+    for(size_t i = 0; i < cnode->lnode->sub_count; i++) {
+        if(subs != NULL) {
+            subs[*count] = cnode->lnode->subs[i];
+        }
+        (*count)++;
+    }
+    if(cnode->pdir != NULL) {
+        for(size_t i = 0; i < cnode->pdir->pnode_count; i++) {
+            collect_subs_cdir(cnode->pdir->pnodes[i]->cdir, subs, count);
+        }
+    }
+}
+
+static void clear_lnodes(struct cnode* cnode);
+
+static void clear_lnodes_cdir(struct cdir* cdir)
+{
+    if(cdir == NULL) {
+        return;
+    }
+    clear_lnodes(cdir->cnode);
+    clear_lnodes_cdir(cdir->lchild);
+    clear_lnodes_cdir(cdir->rchild);
+}
+
+static void clear_lnodes(struct cnode* cnode)
+{
+    cnode->lnode->sub_count = 0;
+    if(cnode->pdir != NULL) {
+        for(size_t i = 0; i < cnode->pdir->pnode_count; i++) {
+            clear_lnodes_cdir(cnode->pdir->pnodes[i]->cdir);
+        }
+    }
+}
+
+void rebuild_be_tree(const struct config* config, struct cnode* cnode)
+{
+    size_t count = 0;
+    collect_subs(cnode, NULL, &count);
+    struct betree_sub** subs = bcalloc(smax(1, count) * sizeof(*subs));
+    if(subs == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    count = 0;
+    collect_subs(cnode, subs, &count);
+    // Only the nodes go, the subs are put back in a fresh root
+    clear_lnodes(cnode);
+    free_pdir(cnode->pdir);
+    cnode->pdir = NULL;
+    free_lnode(cnode->lnode);
+    cnode->lnode = make_lnode(config, cnode);
+    if(count != 0) {
+        insert_be_tree_all(config, subs, count, cnode);
+    }
+    bfree(subs);
+}
+
+bool insert_be_tree_all(
+    const struct config* config, struct betree_sub** subs, size_t count, struct cnode* cnode)
+{
+    // Only an unpartitioned root can be built top-down, anything else goes through the regular insert
+    if(!is_root(cnode) || cnode->pdir != NULL) {
+        for(size_t i = 0; i < count; i++) {
+            insert_be_tree(config, subs[i], cnode, NULL);
+        }
+        return true;
+    }
+    append_subs(subs, count, cnode->lnode);
+    space_partitioning(config, cnode);
+    update_partition_scores(config, cnode);
+    return true;
+}
+
+static bool is_lnode_empty(const struct lnode* lnode)
+{
+    return lnode == NULL || lnode->sub_count == 0;
+}
+
+static bool is_pdir_empty(const struct pdir* pdir)
+{
+    return pdir == NULL || pdir->pnode_count == 0;
+}
+
+static bool is_cnode_empty(const struct cnode* cnode)
+{
+    return cnode == NULL || (is_lnode_empty(cnode->lnode) && is_pdir_empty(cnode->pdir));
+}
+
+static bool is_cdir_empty(const struct cdir* cdir)
+{
+    return cdir == NULL || (is_leaf(cdir) && is_cnode_empty(cdir->cnode));
+}
+
+static void remove_pnode_from_parent(const struct pnode* pnode)
+{
+    struct pdir* pdir = pnode->parent;
+    for(size_t i = 0; i < pdir->pnode_count; i++) {
+        if(pnode == pdir->pnodes[i]) {
+            for(size_t j = i; j < pdir->pnode_count - 1; j++) {
+                pdir->pnodes[j] = pdir->pnodes[j + 1];
+            }
+            pdir->pnode_count--;
+            if(pdir->pnode_count == 0) {
+                bfree(pdir->pnodes);
+                pdir->pnodes = NULL;
+            }
+            else {
+                struct pnode** pnodes = brealloc(pdir->pnodes, sizeof(*pnodes) * pdir->pnode_count);
+                if(pnodes == NULL) {
+                    fprintf(stderr, "%s brealloc failed\n", __func__);
+                    abort();
+                }
+                pdir->pnodes = pnodes;
+            }
+            return;
+        }
+    }
+}
+
+static void remove_cdir_from_parent(const struct cdir* cdir)
+{
+    struct cdir* parent = cdir->cdir_parent;
+    if(parent->lchild == cdir) {
+        parent->lchild = NULL;
+    }
+    else if(parent->rchild == cdir) {
+        parent->rchild = NULL;
+    }
+}
+
+static bool is_mergeable_child(const struct cdir* cdir)
+{
+    return cdir == NULL || (is_leaf(cdir) && is_pdir_empty(cdir->cnode->pdir));
+}
+
+static size_t child_sub_count(const struct cdir* cdir)
+{
+    return cdir == NULL ? 0 : cdir->cnode->lnode->sub_count;
+}
+
+static void merge_child(struct cdir* child, struct lnode* lnode)
+{
+    if(child == NULL) {
+        return;
+    }
+    struct lnode* origin = child->cnode->lnode;
+    while(origin->sub_count != 0) {
+        move(origin->subs[origin->sub_count - 1], origin, lnode);
+    }
+    free_cdir(child);
+}
+
+// Undo a clustering split once both children are leaves that fit back in the parent lnode
+static void try_merge_children(const struct config* config, struct cdir* cdir)
 {
-    if(cdir == NULL) {
-        return NULL;
-    }
-    struct betree_sub* in_cnode = find_sub_id(id, cdir->cnode);
-    if(in_cnode != NULL) {
-        return in_cnode;
-    }
-    struct betree_sub* in_lcdir = find_sub_id_cdir(id, cdir->lchild);
-    if(in_lcdir != NULL) {
-        return in_lcdir;
+    if(is_leaf(cdir) || !is_mergeable_child(cdir->lchild) || !is_mergeable_child(cdir->rchild)) {
+        return;
     }
-    struct betree_sub* in_rcdir = find_sub_id_cdir(id, cdir->rchild);
-    if(in_rcdir != NULL) {
-        return in_rcdir;
+    struct lnode* lnode = cdir->cnode->lnode;
+    size_t count = lnode->sub_count + child_sub_count(cdir->lchild) + child_sub_count(cdir->rchild);
+    if(count > config->lnode_max_cap) {
+        return;
     }
-    return NULL;
+    merge_child(cdir->lchild, lnode);
+    cdir->lchild = NULL;
+    merge_child(cdir->rchild, lnode);
+    cdir->rchild = NULL;
 }
 
-struct betree_sub* find_sub_id(betree_sub_t id, struct cnode* cnode)
+// Walk from the cnode that lost a sub up to the root, merging and freeing what became empty
+static void collapse_cnode(const struct config* config, struct cnode* cnode)
 {
-    if(cnode == NULL) {
-        return NULL;
-    }
-    for(size_t i = 0; i < cnode->lnode->sub_count; i++) {
-        if(cnode->lnode->subs[i]->id == id) {
-            return cnode->lnode->subs[i];
+    while(!is_root(cnode)) {
+        struct cdir* cdir = cnode->parent;
+        try_merge_children(config, cdir);
+        update_cluster_capacity(config, cnode->lnode);
+        bool is_empty = is_cdir_empty(cdir);
+        if(cdir->parent_type == CNODE_PARENT_CDIR) {
+            struct cdir* parent = cdir->cdir_parent;
+            if(is_empty) {
+                remove_cdir_from_parent(cdir);
+                free_cdir(cdir);
+            }
+            cnode = parent->cnode;
         }
-    }
-    if(cnode->pdir != NULL) {
-        for(size_t i = 0; i < cnode->pdir->pnode_count; i++) {
-            struct betree_sub* in_cdir = find_sub_id_cdir(id, cnode->pdir->pnodes[i]->cdir);
-            if(in_cdir != NULL) {
-                return in_cdir;
+        else {
+            struct pnode* pnode = cdir->pnode_parent;
+            struct pdir* pdir = pnode->parent;
+            cnode = pdir->parent;
+            if(is_empty) {
+                remove_pnode_from_parent(pnode);
+                free_pnode(pnode);
+                if(is_pdir_empty(pdir)) {
+                    free_pdir(pdir);
+                    cnode->pdir = NULL;
+                }
+            }
+            else {
+                update_partition_score((const struct attr_domain**)config->attr_domains, pnode);
             }
         }
     }
-    return NULL;
+    update_cluster_capacity(config, cnode->lnode);
 }
 
-/*static bool is_empty(struct cdir* cdir)*/
-/*{*/
-    /*return is_cdir_empty(cdir);*/
-/*}*/
-
-/*static void remove_bucket(struct cdir* cdir)*/
-/*{*/
-    /*free_cdir(cdir);*/
-/*}*/
-
-/*static void try_remove_cdir_from_parent(struct cdir* cdir)*/
-/*{*/
-    /*switch(cdir->parent_type) {*/
-        /*case CNODE_PARENT_CDIR: {*/
-            /*if(cdir->cdir_parent->lchild == cdir) {*/
-                /*cdir->cdir_parent->lchild = NULL;*/
-            /*}*/
-            /*else if(cdir->cdir_parent->rchild == cdir) {*/
-                /*cdir->cdir_parent->rchild = NULL;*/
-            /*}*/
-            /*break;*/
-        /*}*/
-        /*case CNODE_PARENT_PNODE: {*/
-            /*cdir->pnode_parent->cdir = NULL;*/
-            /*break;*/
-        /*}*/
-        /*default: {*/
-            /*switch_default_error("Invalid cdir parent type");*/
-        /*}*/
-    /*}*/
-/*}*/
-
-/*static bool search_delete_cdir(size_t attr_domains_count,*/
-    /*const struct attr_domain** attr_domains, struct betree_sub* sub, struct cdir* cdir)*/
-/*{*/
-    /*bool isFound = false;*/
-    /*if(sub_is_enclosed(attr_domains, sub, cdir->lchild)) {*/
-        /*isFound = search_delete_cdir(attr_domains_count, attr_domains, sub, cdir->lchild);*/
-    /*}*/
-    /*else if(sub_is_enclosed(attr_domains, sub, cdir->rchild)) {*/
-        /*isFound = search_delete_cdir(attr_domains_count, attr_domains, sub, cdir->rchild);*/
-    /*}*/
-    /*else {*/
-        /*isFound = betree_delete_inner(attr_domains_count, attr_domains, sub, cdir->cnode);*/
-    /*}*/
-    /*if(isFound) {*/
-        /*if(is_empty(cdir->lchild)) {*/
-            /*remove_bucket(cdir->lchild);*/
-            /*cdir->lchild = NULL;*/
-        /*}*/
-        /*if(is_empty(cdir->rchild)) {*/
-            /*remove_bucket(cdir->rchild);*/
-            /*cdir->rchild = NULL;*/
-        /*}*/
-        /*if(is_empty(cdir)) {*/
-            /*try_remove_cdir_from_parent(cdir);*/
-            /*free_cdir(cdir);*/
-        /*}*/
-    /*}*/
-    /*return isFound;*/
-/*}*/
+bool betree_delete_inner(const struct config* config, struct betree_sub* sub)
+{
+    struct lnode* lnode = sub->lnode;
+    if(lnode == NULL) {
+        return false;
+    }
+    remove_sub(sub, lnode);
+    collapse_cnode(config, lnode->parent);
+    return true;
+}
 
 struct betree_variable* make_pred(const char* attr, betree_var_t variable_id, struct value value)
 {
@@ -1600,21 +2739,62 @@ static void fill_short_circuit(struct config* config, struct betree_sub* sub)
     }
 }
 
+static void set_sub_masks(struct betree_sub* sub, size_t word_count)
+{
+    sub->attr_vars = sub->masks;
+    sub->short_circuit.word_count = word_count;
+    sub->short_circuit.pass = sub->masks + word_count;
+    sub->short_circuit.fail = sub->masks + 2 * word_count;
+}
+
+// Words up to the last one with a bit set in any mask, at least one
+static size_t used_mask_words(const struct betree_sub* sub)
+{
+    size_t used = 1;
+    for(size_t i = 0; i < sub->short_circuit.word_count; i++) {
+        if(sub->attr_vars[i] != 0 || sub->short_circuit.pass[i] != 0 || sub->short_circuit.fail[i] != 0) {
+            used = i + 1;
+        }
+    }
+    return used;
+}
+
 struct betree_sub* make_sub(struct config* config, betree_sub_t id, struct ast_node* expr)
 {
-    struct betree_sub* sub = bcalloc(sizeof(*sub));
+    size_t count = config->attr_domain_count / 64 + 1;
+    struct betree_sub* sub = bcalloc(sizeof(*sub) + 3 * count * sizeof(*sub->masks));
     if(sub == NULL) {
         fprintf(stderr, "%s bcalloc failed\n", __func__);
         abort();
     }
     sub->id = id;
-    size_t count = config->attr_domain_count / 64 + 1;
-    sub->attr_vars = bcalloc(count * sizeof(*sub->attr_vars));
+    sub->lnode = NULL;
+    sub->active = true;
+    sub->window_start = INT64_MIN;
+    sub->window_end = INT64_MAX;
+    sub->timer = SIZE_MAX;
+#ifdef BETREE_JIT
+    sub->jit_countdown = config->jit_threshold;
+    sub->native = NULL;
+#endif
+    set_sub_masks(sub, count);
     sub->expr = expr;
+    index_list_bitmaps(config, expr);
+    sub->program = compile_ast(expr);
     fill_pred(sub, sub->expr);
-    sub->short_circuit.pass = bcalloc(count * sizeof(*sub->short_circuit.pass));
-    sub->short_circuit.fail = bcalloc(count * sizeof(*sub->short_circuit.fail));
     fill_short_circuit(config, sub);
+    // Most subs use a few of the attributes, the words past the last one are dropped
+    size_t used = used_mask_words(sub);
+    if(used < count) {
+        memmove(sub->masks + used, sub->short_circuit.pass, used * sizeof(*sub->masks));
+        memmove(sub->masks + 2 * used, sub->short_circuit.fail, used * sizeof(*sub->masks));
+        sub = brealloc(sub, sizeof(*sub) + 3 * used * sizeof(*sub->masks));
+        if(sub == NULL) {
+            fprintf(stderr, "%s brealloc failed\n", __func__);
+            abort();
+        }
+        set_sub_masks(sub, used);
+    }
     return sub;
 }
 
@@ -1638,22 +2818,6 @@ const char* get_attr_for_id(const struct config* config, betree_var_t variable_i
     return NULL;
 }
 
-betree_var_t try_get_id_for_attr(const struct config* config, const char* attr)
-{
-    char* copy = bstrdup(attr);
-    for(size_t i = 0; copy[i]; i++) {
-        copy[i] = tolower(copy[i]);
-    }
-    for(size_t i = 0; i < config->attr_domain_count; i++) {
-        if(strcmp(config->attr_domains[i]->attr_var.attr, copy) == 0) {
-            bfree(copy);
-            return i;
-        }
-    }
-    bfree(copy);
-    return INVALID_VAR;
-}
-
 void event_to_string(const struct betree_event* event, char* buffer)
 {
     size_t length = 0;
@@ -1720,11 +2884,8 @@ int event_parse(const char* text, struct betree_event** event);
 
 struct memoize make_memoize(size_t pred_count)
 {
-    size_t count = pred_count / 64 + 1;
-    struct memoize memoize = {
-        .pass = bcalloc(count * sizeof(*memoize.pass)),
-        .fail = bcalloc(count * sizeof(*memoize.fail)),
-    };
+    struct memoize memoize = { .pass = NULL, .fail = NULL, .word_count = 0, .touched_count = 0, .touched = NULL };
+    grow_memoize(&memoize, pred_count);
     return memoize;
 }
 
@@ -1732,95 +2893,578 @@ void free_memoize(struct memoize memoize)
 {
     bfree(memoize.pass);
     bfree(memoize.fail);
+    bfree(memoize.touched);
 }
 
-static uint64_t* make_undefined(size_t attr_domain_count, const struct betree_variable** preds)
+static void fill_undefined(size_t attr_domain_count, const struct betree_variable** preds, uint64_t* undefined)
 {
-    size_t count = attr_domain_count / 64 + 1;
-    uint64_t* undefined = bcalloc(count * sizeof(*undefined));
     for(size_t i = 0; i < attr_domain_count; i++) {
         if(preds[i] == NULL) {
             set_bit(undefined, i);
         }
     }
-    return undefined;
 }
 
-static void add_sub(betree_sub_t id, struct report* report)
+static void alloc_search_attrs(const struct config* config, struct betree_search_context* context)
 {
-    if(report->matched == 0) {
-        report->subs = bcalloc(sizeof(*report->subs));
-        if(report->subs == NULL) {
-            fprintf(stderr, "%s bcalloc failed", __func__);
-            abort();
-        }
+    context->attr_domain_count = config->attr_domain_count;
+    // One extra slot so an empty config still gets a valid allocation
+    context->preds = bcalloc((context->attr_domain_count + 1) * sizeof(*context->preds));
+    size_t count = context->attr_domain_count / 64 + 1;
+    context->undefined = bcalloc(count * sizeof(*context->undefined));
+    if(context->preds == NULL || context->undefined == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+}
+
+static void dealloc_search_attrs(struct betree_search_context* context)
+{
+    bfree(context->preds);
+    context->preds = NULL;
+    bfree(context->undefined);
+    context->undefined = NULL;
+}
+
+static void alloc_search_context(const struct config* config, struct betree_search_context* context)
+{
+    alloc_search_attrs(config, context);
+    context->memoize_count = config->pred_map->memoize_count;
+    context->memoize = make_memoize(context->memoize_count);
+}
+
+static void dealloc_search_context(struct betree_search_context* context)
+{
+    dealloc_search_attrs(context);
+    free_memoize(context->memoize);
+    context->memoize.pass = NULL;
+    context->memoize.fail = NULL;
+    context->memoize.touched = NULL;
+}
+
+struct betree_search_context* make_search_context(const struct config* config)
+{
+    struct betree_search_context* context = bcalloc(sizeof(*context));
+    if(context == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    alloc_search_context(config, context);
+    init_subs_to_eval(&context->subs);
+    return context;
+}
+
+void reset_search_context(const struct config* config, struct betree_search_context* context)
+{
+    // The tree can gain attributes and memoized preds between two searches
+    if(context->attr_domain_count != config->attr_domain_count) {
+        dealloc_search_attrs(context);
+        alloc_search_attrs(config, context);
     }
     else {
-        betree_sub_t* subs
-            = brealloc(report->subs, sizeof(*report->subs) * (report->matched + 1));
+        size_t attr_count = context->attr_domain_count / 64 + 1;
+        memset(context->preds, 0, context->attr_domain_count * sizeof(*context->preds));
+        memset(context->undefined, 0, attr_count * sizeof(*context->undefined));
+    }
+    // Only the words the last search wrote are cleared, the bitsets are kept across searches
+    reset_memoize(&context->memoize);
+    context->memoize_count = config->pred_map->memoize_count;
+    grow_memoize(&context->memoize, context->memoize_count);
+    context->subs.count = 0;
+    context->subs.failed = 0;
+}
+
+void free_search_context(struct betree_search_context* context)
+{
+    if(context == NULL) {
+        return;
+    }
+    dealloc_search_context(context);
+    bfree(context->subs.subs);
+    context->subs.subs = NULL;
+    bfree(context->subs.passed);
+    context->subs.passed = NULL;
+    bfree(context->subs.ranked);
+    context->subs.ranked = NULL;
+    bfree(context->stack.frames);
+    free_event_scratch(context->scratch);
+    free_result_key(context->result_key);
+    bfree(context);
+}
+
+static void add_sub(betree_sub_t id, struct report* report)
+{
+    if(report->matched == report->capacity) {
+        size_t capacity = report->capacity == 0 ? 8 : report->capacity * 2;
+        betree_sub_t* subs = brealloc(report->subs, sizeof(*report->subs) * capacity);
         if(subs == NULL) {
             fprintf(stderr, "%s brealloc failed", __func__);
             abort();
         }
         report->subs = subs;
+        report->capacity = capacity;
     }
     report->subs[report->matched] = id;
     report->matched++;
 }
 
-bool betree_search_with_preds(const struct config* config,
-    const struct betree_variable** preds,
+// False once the sink asked to stop
+static bool report_sub(const struct betree_variable** preds,
+    struct betree_sub* sub,
+    bool passed,
+    struct memoize* memoize,
+    const struct match_sink* sink,
+    struct report* report,
+    size_t* found)
+{
+    report->evaluated++;
+    if(passed) {
+        report->shorted++;
+    }
+    else if(!evaluate_sub(preds, sub, memoize, report)) {
+        return true;
+    }
+    (*found)++;
+    STAT_ADD(sub->lnode, matches, 1);
+    STAT_ADD(sub, passes, 1);
+    if(sink != NULL) {
+        return sink->callback(sub->id, sink->data);
+    }
+    add_sub(sub->id, report);
+    return true;
+}
+
+static int ranked_sub_cmp(const void* a, const void* b)
+{
+    const struct betree_sub* x = ((const struct ranked_sub*)a)->sub;
+    const struct betree_sub* y = ((const struct ranked_sub*)b)->sub;
+    if(x->priority != y->priority) {
+        return x->priority > y->priority ? -1 : 1;
+    }
+    return x->id < y->id ? -1 : x->id > y->id;
+}
+
+static void rank_subs(struct subs_to_eval* subs)
+{
+    if(subs->ranked_capacity < subs->count) {
+        struct ranked_sub* ranked = brealloc(subs->ranked, subs->capacity * sizeof(*ranked));
+        if(ranked == NULL) {
+            fprintf(stderr, "%s brealloc failed\n", __func__);
+            abort();
+        }
+        subs->ranked = ranked;
+        subs->ranked_capacity = subs->capacity;
+    }
+    for(size_t i = 0; i < subs->count; i++) {
+        subs->ranked[i].sub = subs->subs[i];
+        subs->ranked[i].passed = subs->passed[i];
+    }
+    if(subs->count > 1) {
+        qsort(subs->ranked, subs->count, sizeof(*subs->ranked), ranked_sub_cmp);
+    }
+}
+
+#define SEARCH_MAX_THREADS 16
+// Candidates each extra thread needs to pay for starting it
+#define SEARCH_SUBS_PER_THREAD 512
+// Candidates a thread claims at a time, small enough that threads stuck on costly subs are caught up on
+#define SEARCH_CHUNK_SIZE 64
+
+struct search_job {
+    const struct betree_variable** preds;
+    struct subs_to_eval* subs;
+    // Shared between the jobs of a search
+    size_t* next;
+    struct memoize memoize;
+    struct report report;
+};
+
+static void* evaluate_chunks(void* arg)
+{
+    struct search_job* job = arg;
+    struct subs_to_eval* subs = job->subs;
+    while(true) {
+        size_t start = __atomic_fetch_add(job->next, SEARCH_CHUNK_SIZE, __ATOMIC_RELAXED);
+        if(start >= subs->count) {
+            return NULL;
+        }
+        size_t end = smin(start + SEARCH_CHUNK_SIZE, subs->count);
+        // Each sub is written by the one job that claimed it, passed is left holding the matches
+        for(size_t i = start; i < end; i++) {
+            job->report.evaluated++;
+            if(subs->passed[i]) {
+                job->report.shorted++;
+            }
+            else {
+                subs->passed[i] = evaluate_sub(job->preds, subs->subs[i], &job->memoize, &job->report);
+            }
+        }
+    }
+}
+
+static size_t search_thread_count(const struct config* config, size_t count)
+{
+    return smax(1, smin(smin(config->search_threads, SEARCH_MAX_THREADS), count / SEARCH_SUBS_PER_THREAD));
+}
+
+// Every thread starts from the string matches with its own memoize, the caller keeps the context one
+static void search_parallel(struct betree_search_context* context, size_t thread_count, struct report* report)
+{
+    struct search_job jobs[SEARCH_MAX_THREADS];
+    pthread_t threads[SEARCH_MAX_THREADS];
+    size_t next = 0;
+    for(size_t i = 0; i < thread_count; i++) {
+        jobs[i].preds = context->preds;
+        jobs[i].subs = &context->subs;
+        jobs[i].next = &next;
+        jobs[i].report = (struct report){ 0 };
+        if(i == 0) {
+            jobs[i].memoize = context->memoize;
+            continue;
+        }
+        jobs[i].memoize = make_memoize(context->memoize_count);
+        copy_memoize(&jobs[i].memoize, &context->memoize);
+    }
+    for(size_t i = 1; i < thread_count; i++) {
+        if(pthread_create(&threads[i], NULL, evaluate_chunks, &jobs[i]) != 0) {
+            fprintf(stderr, "%s pthread_create failed\n", __func__);
+            abort();
+        }
+    }
+    evaluate_chunks(&jobs[0]);
+    context->memoize = jobs[0].memoize;
+    for(size_t i = 0; i < thread_count; i++) {
+        if(i != 0) {
+            pthread_join(threads[i], NULL);
+            free_memoize(jobs[i].memoize);
+        }
+        report->evaluated += jobs[i].report.evaluated;
+        report->memoized += jobs[i].report.memoized;
+        report->shorted += jobs[i].report.shorted;
+    }
+    for(size_t i = 0; i < context->subs.count; i++) {
+        if(context->subs.passed[i]) {
+            struct betree_sub* sub = context->subs.subs[i];
+            STAT_ADD(sub->lnode, matches, 1);
+            STAT_ADD(sub, passes, 1);
+            add_sub(sub->id, report);
+        }
+    }
+}
+
+bool betree_search_limit_with_preds(const struct config* config,
+    struct betree_search_context* context,
+    const struct cnode* cnode,
+    size_t limit,
+    bool by_priority,
+    const struct match_sink* sink,
+    struct report* report)
+{
+    const struct betree_variable** preds = context->preds;
+    fill_undefined(config->attr_domain_count, preds, context->undefined);
+    match_string_patterns(config->pred_map->strings, preds, &context->memoize);
+    search_be_tree(config, context, cnode);
+    report->evaluated += context->subs.failed;
+    report->shorted += context->subs.failed;
+    size_t thread_count = search_thread_count(config, context->subs.count);
+    if(thread_count > 1 && limit == SIZE_MAX && !by_priority && sink == NULL) {
+        search_parallel(context, thread_count, report);
+        return true;
+    }
+    if(by_priority) {
+        rank_subs(&context->subs);
+    }
+    size_t found = 0;
+    for(size_t i = 0; i < context->subs.count && found < limit; i++) {
+        struct betree_sub* sub = by_priority ? context->subs.ranked[i].sub : context->subs.subs[i];
+        bool passed = by_priority ? context->subs.ranked[i].passed : context->subs.passed[i];
+        if(!report_sub(preds, sub, passed, &context->memoize, sink, report, &found)) {
+            break;
+        }
+    }
+    return true;
+}
+
+// Subs of the same id next to each other
+static int sub_id_cmp(const void* a, const void* b)
+{
+    const struct betree_sub* x = *(const struct betree_sub* const*)a;
+    const struct betree_sub* y = *(const struct betree_sub* const*)b;
+    if(x->id != y->id) {
+        return x->id < y->id ? -1 : 1;
+    }
+    return ((uintptr_t)x > (uintptr_t)y) - ((uintptr_t)x < (uintptr_t)y);
+}
+
+static bool has_sub_id(const struct subs_to_eval* subs, betree_sub_t id)
+{
+    size_t low = 0;
+    size_t high = subs->count;
+    while(low < high) {
+        size_t middle = low + (high - low) / 2;
+        if(subs->subs[middle]->id < id) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return low < subs->count && subs->subs[low]->id == id;
+}
+
+bool betree_search_delta_with_preds(const struct config* config,
+    struct betree_search_context* context,
     const struct cnode* cnode,
+    const uint64_t* changed,
+    const struct report* previous,
     struct report* report)
 {
-    uint64_t* undefined = make_undefined(config->attr_domain_count, preds);
-    struct memoize memoize = make_memoize(config->pred_map->memoize_count);
-    struct subs_to_eval subs;
-    init_subs_to_eval(&subs);
-    match_be_tree((const struct attr_domain**)config->attr_domains, preds, cnode, &subs);
-    for(size_t i = 0; i < subs.count; i++) {
-        const struct betree_sub* sub = subs.subs[i];
+    const struct betree_variable** preds = context->preds;
+    fill_undefined(config->attr_domain_count, preds, context->undefined);
+    match_string_patterns(config->pred_map->strings, preds, &context->memoize);
+    struct sub_dependents* dependents = config->dependents;
+    find_sub_dependents(dependents, config, cnode);
+    struct subs_to_eval* subs = &context->subs;
+    for(size_t var = 0; var < dependents->var_count; var++) {
+        if(!test_bit(changed, var)) {
+            continue;
+        }
+        for(size_t i = dependents->offsets[var]; i < dependents->offsets[var + 1]; i++) {
+            add_sub_to_eval(dependents->subs[i], false, subs);
+        }
+    }
+    // A sub depending on several of the changed attributes is listed under each
+    qsort(subs->subs, subs->count, sizeof(*subs->subs), sub_id_cmp);
+    size_t unique = 0;
+    for(size_t i = 0; i < subs->count; i++) {
+        if(unique == 0 || subs->subs[unique - 1] != subs->subs[i]) {
+            subs->subs[unique++] = subs->subs[i];
+        }
+    }
+    subs->count = unique;
+    // Every sub of an id is listed when one of them is, the others keep their previous outcome
+    for(size_t i = 0; i < previous->matched; i++) {
+        if(!has_sub_id(subs, previous->subs[i])) {
+            add_sub(previous->subs[i], report);
+        }
+    }
+    for(size_t i = 0; i < subs->count; i++) {
+        const struct betree_sub* sub = subs->subs[i];
+        if(!sub->active) {
+            continue;
+        }
         report->evaluated++;
-        if(match_sub(config->attr_domain_count, preds, sub, report, &memoize, undefined) == true) {
+        if(match_sub(preds, sub, report, &context->memoize, context->undefined)) {
             add_sub(sub->id, report);
+            STAT_ADD(sub, passes, 1);
         }
     }
-    bfree(subs.subs);
-    free_memoize(memoize);
-    bfree(undefined);
-    bfree(preds);
     return true;
 }
 
-bool betree_exists_with_preds(const struct config* config, const struct betree_variable** preds, const struct cnode* cnode)
+bool betree_search_with_preds(const struct config* config,
+    struct betree_search_context* context,
+    const struct cnode* cnode,
+    struct report* report)
+{
+    return betree_search_limit_with_preds(config, context, cnode, SIZE_MAX, false, NULL, report);
+}
+
+void start_search_steps(const struct config* config,
+    struct betree_search_context* context,
+    const struct cnode* cnode,
+    struct search_steps* steps)
+{
+    steps->walked = false;
+    steps->next = 0;
+    fill_undefined(config->attr_domain_count, context->preds, context->undefined);
+    match_string_patterns(config->pred_map->strings, context->preds, &context->memoize);
+    context->stack.count = 0;
+    visit_cnode(context->preds, context->undefined, cnode, &context->subs, &context->stack);
+}
+
+bool search_steps(struct betree_search_context* context, struct search_steps* steps, size_t budget, struct report* report)
+{
+    const struct betree_variable** preds = context->preds;
+    struct subs_to_eval* subs = &context->subs;
+    // Something gets done on every call
+    budget = smax(1, budget);
+    size_t spent = 0;
+    if(!steps->walked) {
+        spent = walk_be_tree(preds, context->undefined, subs, &context->stack, budget);
+        if(context->stack.count != 0) {
+            return false;
+        }
+        steps->walked = true;
+        report->evaluated += subs->failed;
+        report->shorted += subs->failed;
+    }
+    size_t found = 0;
+    for(; steps->next < subs->count && spent < budget; steps->next++, spent++) {
+        report_sub(preds, subs->subs[steps->next], subs->passed[steps->next], &context->memoize, NULL, report, &found);
+    }
+    return steps->next == subs->count;
+}
+
+bool betree_exists_with_preds(const struct config* config,
+    struct betree_search_context* context,
+    const struct cnode* cnode)
 {
-    uint64_t* undefined = make_undefined(config->attr_domain_count, preds);
-    struct memoize memoize = make_memoize(config->pred_map->memoize_count);
-    struct subs_to_eval subs;
-    init_subs_to_eval(&subs);
-    match_be_tree((const struct attr_domain**)config->attr_domains, preds, cnode, &subs);
+    const struct betree_variable** preds = context->preds;
+    fill_undefined(config->attr_domain_count, preds, context->undefined);
+    match_string_patterns(config->pred_map->strings, preds, &context->memoize);
+    search_be_tree(config, context, cnode);
     bool result = false;
-    for(size_t i = 0; i < subs.count; i++) {
-        const struct betree_sub* sub = subs.subs[i];
-        if(match_sub(config->attr_domain_count, preds, sub, NULL, &memoize, undefined) == true) {
+    for(size_t i = 0; i < context->subs.count; i++) {
+        const struct betree_sub* sub = context->subs.subs[i];
+        if(context->subs.passed[i] || evaluate_sub(preds, sub, &context->memoize, NULL)) {
+            __atomic_fetch_add((uint64_t*)&sub->hits, 1, __ATOMIC_RELAXED);
             result = true;
             break;
         }
     }
-    bfree(subs.subs);
-    free_memoize(memoize);
-    bfree(undefined);
-    bfree(preds);
     return result;
 }
 
-void sort_event_lists(struct betree_event* event)
+static void match_lnode_batch(const struct lnode* lnode,
+    struct betree_search_context** contexts,
+    struct report** reports,
+    uint64_t live)
+{
+    STAT_ADD(lnode, visits, __builtin_popcountll(live));
+    STAT_ADD(lnode, candidates, lnode->sub_count * __builtin_popcountll(live));
+    // Each sub is evaluated against every live event while it is still in cache
+    for(size_t i = 0; i < lnode->sub_count; i++) {
+        const struct betree_sub* sub = lnode->subs[i];
+        if(!sub->active) {
+            continue;
+        }
+        for(uint64_t remaining = live; remaining != 0; remaining &= remaining - 1) {
+            size_t j = __builtin_ctzll(remaining);
+            struct betree_search_context* context = contexts[j];
+            reports[j]->evaluated++;
+            if(match_sub(context->preds, sub, reports[j], &context->memoize, context->undefined) == true) {
+                add_sub(sub->id, reports[j]);
+                STAT_ADD(lnode, matches, 1);
+                STAT_ADD(sub, passes, 1);
+            }
+        }
+    }
+}
+
+static void search_cdir_batch(const struct config* config,
+    struct betree_search_context** contexts,
+    struct report** reports,
+    const struct cdir* cdir,
+    uint64_t live,
+    bool open_left,
+    bool open_right);
+
+static void match_be_tree_batch(const struct config* config,
+    struct betree_search_context** contexts,
+    struct report** reports,
+    const struct cnode* cnode,
+    uint64_t live)
+{
+    STAT_ADD(cnode, visits, __builtin_popcountll(live));
+    for(uint64_t remaining = live; remaining != 0; remaining &= remaining - 1) {
+        size_t j = __builtin_ctzll(remaining);
+        if(misses_required(cnode, contexts[j]->undefined)) {
+            live &= ~(1ULL << j);
+        }
+    }
+    if(live == 0) {
+        return;
+    }
+    match_lnode_batch(cnode->lnode, contexts, reports, live);
+    if(cnode->pdir != NULL) {
+        for(size_t i = 0; i < cnode->pdir->pnode_count; i++) {
+            const struct pnode* pnode = cnode->pdir->pnodes[i];
+            uint64_t pnode_live = live;
+            if(!pnode->allow_undefined) {
+                pnode_live = 0;
+                for(uint64_t remaining = live; remaining != 0; remaining &= remaining - 1) {
+                    size_t j = __builtin_ctzll(remaining);
+                    if(!test_bit(contexts[j]->undefined, pnode->attr_var.var)) {
+                        pnode_live |= 1ULL << j;
+                    }
+                }
+            }
+            if(pnode_live != 0) {
+                STAT_ADD(pnode, visits, __builtin_popcountll(pnode_live));
+                search_cdir_batch(config, contexts, reports, pnode->cdir, pnode_live, true, true);
+            }
+        }
+    }
+}
+
+static uint64_t enclosed_events(struct betree_search_context** contexts,
+    const struct cdir* cdir,
+    uint64_t live,
+    bool open_left,
+    bool open_right)
+{
+    if(cdir == NULL) {
+        return 0;
+    }
+    uint64_t enclosed = 0;
+    for(uint64_t remaining = live; remaining != 0; remaining &= remaining - 1) {
+        size_t j = __builtin_ctzll(remaining);
+        if(is_event_enclosed(contexts[j]->preds, cdir, open_left, open_right)) {
+            enclosed |= 1ULL << j;
+        }
+    }
+    return enclosed;
+}
+
+static void search_cdir_batch(const struct config* config,
+    struct betree_search_context** contexts,
+    struct report** reports,
+    const struct cdir* cdir,
+    uint64_t live,
+    bool open_left,
+    bool open_right)
+{
+    STAT_ADD(cdir, visits, __builtin_popcountll(live));
+    match_be_tree_batch(config, contexts, reports, cdir->cnode, live);
+    uint64_t lchild_live = enclosed_events(contexts, cdir->lchild, live, open_left, false);
+    if(lchild_live != 0) {
+        search_cdir_batch(config, contexts, reports, cdir->lchild, lchild_live, open_left, false);
+    }
+    uint64_t rchild_live = enclosed_events(contexts, cdir->rchild, live, false, open_right);
+    if(rchild_live != 0) {
+        search_cdir_batch(config, contexts, reports, cdir->rchild, rchild_live, false, open_right);
+    }
+}
+
+bool betree_search_batch_with_preds(const struct config* config,
+    struct betree_search_context** contexts,
+    uint64_t live,
+    const struct cnode* cnode,
+    struct report** reports)
+{
+    for(uint64_t remaining = live; remaining != 0; remaining &= remaining - 1) {
+        size_t j = __builtin_ctzll(remaining);
+        fill_undefined(config->attr_domain_count, contexts[j]->preds, contexts[j]->undefined);
+        match_string_patterns(config->pred_map->strings, contexts[j]->preds, &contexts[j]->memoize);
+    }
+    if(live != 0) {
+        match_be_tree_batch(config, contexts, reports, cnode, live);
+    }
+    return true;
+}
+
+void sort_event_lists(const struct config* config, struct betree_event* event)
 {
     for(size_t i = 0; i < event->variable_count; i++) {
         struct betree_variable* pred = event->variables[i];
         if(pred == NULL) {
             continue;
         }
+        if(config->presorted_lists
+            && (pred->value.value_type == BETREE_INTEGER_LIST || pred->value.value_type == BETREE_SEGMENTS)) {
+            continue;
+        }
         if(pred->value.value_type == BETREE_INTEGER_LIST) {
             sort_and_remove_duplicate_integer_list(pred->value.integer_list_value);
         }
@@ -1830,6 +3474,9 @@ void sort_event_lists(struct betree_event* event)
         else if(pred->value.value_type == BETREE_INTEGER_LIST_ENUM) {
             sort_and_remove_duplicate_integer_enum_list(pred->value.integer_enum_list_value);
         }
+        else if(pred->value.value_type == BETREE_SEGMENTS) {
+            sort_segments(pred->value.segments_value);
+        }
     }
 }
 
@@ -1841,7 +3488,7 @@ struct betree_event* make_event_from_string(const struct betree* betree, const c
         abort();
     }
     fill_event(betree->config, event);
-    sort_event_lists(event);
+    sort_event_lists(betree->config, event);
     return event;
 }
 
@@ -1894,6 +3541,37 @@ void add_variable(struct betree_variable* variable, struct betree_event* event)
     event->variable_count++;
 }
 
+// The event parser reads an empty list as an integer list, integers are never read as strings, segments or caps
+static void convert_parsed_list(struct value* value, enum betree_value_type_e value_type)
+{
+    if(value->value_type != BETREE_INTEGER_LIST) {
+        return;
+    }
+    switch(value_type) {
+        case BETREE_STRING_LIST:
+            free_integer_list(value->integer_list_value);
+            value->string_list_value = make_string_list();
+            break;
+        case BETREE_SEGMENTS:
+            free_integer_list(value->integer_list_value);
+            value->segments_value = make_segments();
+            break;
+        case BETREE_FREQUENCY_CAPS:
+            free_integer_list(value->integer_list_value);
+            value->frequency_caps_value = make_frequency_caps();
+            break;
+        case BETREE_BOOLEAN:
+        case BETREE_INTEGER:
+        case BETREE_FLOAT:
+        case BETREE_STRING:
+        case BETREE_INTEGER_LIST:
+        case BETREE_INTEGER_ENUM:
+        case BETREE_INTEGER_LIST_ENUM:
+        default:
+            break;
+    }
+}
+
 void fill_event(const struct config* config, struct betree_event* event)
 {
     for(size_t i = 0; i < event->variable_count; i++) {
@@ -1908,6 +3586,7 @@ void fill_event(const struct config* config, struct betree_event* event)
         }
         pred->attr_var.var = var;
         struct attr_domain* domain = config->attr_domains[var];
+        convert_parsed_list(&pred->value, domain->bound.value_type);
         pred->value.value_type = domain->bound.value_type;
         switch(pred->value.value_type) {
             case BETREE_BOOLEAN:
@@ -1946,16 +3625,18 @@ void fill_event(const struct config* config, struct betree_event* event)
                     pred->value.string_list_value->strings[j].var = pred->attr_var.var;
                     pred->value.string_list_value->strings[j].str = str;
                 }
+                index_string_list(domain, pred->value.string_list_value);
                 break;
             }
             case BETREE_FREQUENCY_CAPS: {
                 for(size_t j = 0; j < pred->value.frequency_caps_value->size; j++) {
                     betree_str_t str = try_get_id_for_string(config,
                         pred->attr_var,
-                        pred->value.frequency_caps_value->content[j]->namespace.string);
-                    pred->value.frequency_caps_value->content[j]->namespace.var = pred->attr_var.var;
-                    pred->value.frequency_caps_value->content[j]->namespace.str = str;
+                        pred->value.frequency_caps_value->content[j].namespace.string);
+                    pred->value.frequency_caps_value->content[j].namespace.var = pred->attr_var.var;
+                    pred->value.frequency_caps_value->content[j].namespace.str = str;
                 }
+                index_frequency_caps(pred->value.frequency_caps_value);
                 break;
             }
             default: abort();
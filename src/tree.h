@@ -14,19 +14,94 @@ struct betree_variable {
     struct value value;
 };
 
+struct ast_program;
+
+#ifdef BETREE_STATS
+// Search counters, built with make STATS=1. Searches share the tree so they are bumped with relaxed
+// atomics through STAT_ADD, counts are per event
+struct node_stats {
+    uint64_t visits;
+    // cdir: enclosure checks of the event against its bound, and how many passed
+    uint64_t checks;
+    uint64_t enclosed;
+    // lnode: subs looked at, including the ones ruled out by their short circuit, and subs matched
+    uint64_t candidates;
+    uint64_t matches;
+};
+
+struct sub_stats {
+    // Runs of the compiled expression and the cycles they took
+    uint64_t evaluations;
+    uint64_t cycles;
+    uint64_t passes;
+    // Decided by the short circuit without being evaluated
+    uint64_t shorted;
+};
+#define STAT_ADD(object, field, n) \
+    __atomic_fetch_add((uint64_t*)&(object)->stats.field, (uint64_t)(n), __ATOMIC_RELAXED)
+#else
+#define STAT_ADD(object, field, n) ((void)(object), (void)(n))
+#endif
+
+// Words of attr_vars, pass and fail, trimmed after the last attribute of the sub
 struct short_circuit {
+    size_t word_count;
     uint64_t* pass;
     uint64_t* fail;
 };
 
+// Short circuit masks of the subs of an lnode, word w of sub i is at [w * capacity + i]
+struct lnode_short_circuits {
+    size_t word_count;
+    size_t capacity;
+    uint64_t* pass;
+    uint64_t* fail;
+};
+
+struct sub_bound {
+    betree_var_t var;
+    uint32_t version;
+    struct value_bound bound;
+};
+
 struct betree_sub {
     betree_sub_t id;
+    // Order of the sub in betree_search_top, higher first
+    int64_t priority;
+    // Exists searches the sub answered since the last betree_order_by_hits, halved by it
+    uint64_t hits;
+    // Only a candidate while the clock of the tree is in [window_start, window_end], see activation.h
+    bool active;
+    int64_t window_start;
+    int64_t window_end;
+    // Position of the sub's timer in the activation index, SIZE_MAX when it has none
+    size_t timer;
     uint64_t* attr_vars;
     const struct ast_node* expr;
+    // expr compiled for matching
+    struct ast_program* program;
     struct short_circuit short_circuit;
+    // Owning lnode, kept current as the sub moves through the tree
+    struct lnode* lnode;
+    // Bounds asked for so far, see get_sub_bound
+    size_t bound_count;
+    struct sub_bound* bounds;
+#ifdef BETREE_STATS
+    struct sub_stats stats;
+#endif
+#ifdef BETREE_JIT
+    // Evaluations left before expr gets compiled to native code, 0 once it is or when it won't be
+    uint64_t jit_countdown;
+    struct jit_function* native;
+#endif
+    // attr_vars, pass and fail one after the other, allocated with the sub
+    uint64_t masks[];
 };
 
 struct cnode;
+struct lnode_columns;
+struct lnode_postings;
+struct result_key;
 
 struct lnode {
     struct cnode* parent;
@@ -35,6 +110,15 @@ struct lnode {
         struct betree_sub** subs;
     };
     size_t max;
+    // Follows subs
+    struct lnode_short_circuits short_circuits;
+    // Posting lists over the subs, NULL unless the prefilter is enabled
+    struct lnode_postings* postings;
+    // Ranges of the subs in the leading operands they share, NULL unless columns are enabled
+    struct lnode_columns* columns;
+#ifdef BETREE_STATS
+    struct node_stats stats;
+#endif
 };
 
 struct pdir;
@@ -45,6 +129,13 @@ struct cnode {
     struct cdir* parent;
     struct lnode* lnode;
     struct pdir* pdir;
+    // AND of the short circuit fail bits of every sub placed in the lnode or under the pdir, both
+    // are skipped for events without one of these attributes. NULL until a sub is placed
+    size_t required_count;
+    uint64_t* required;
+#ifdef BETREE_STATS
+    struct node_stats stats;
+#endif
 };
 
 struct cdir;
@@ -54,7 +145,12 @@ struct pnode {
     struct pdir* parent;
     struct attr_var attr_var;
     struct cdir* cdir;
+    // Copied from the attribute domain, pdirs keep their pnodes sorted by attr_var.var
+    bool allow_undefined;
     float score;
+#ifdef BETREE_STATS
+    struct node_stats stats;
+#endif
 };
 
 enum c_parent_e {
@@ -73,6 +169,9 @@ struct cdir {
     struct cnode* cnode;
     struct cdir* lchild;
     struct cdir* rchild;
+#ifdef BETREE_STATS
+    struct node_stats stats;
+#endif
 };
 
 struct pdir {
@@ -83,12 +182,25 @@ struct pdir {
     };
 };
 
+// Fills the required attributes of every cnode from the subs under it, for trees built without insert_be_tree
+void require_be_tree(struct cnode* cnode);
+// Puts the pnodes back in variable order
+void sort_pdir(struct pdir* pdir);
+
 void free_sub(struct betree_sub* sub);
 void free_event(struct betree_event* event);
+// Moves the variables of delta into event, replacing those event already has, and frees delta. Both
+// have gone through fill_event
+void merge_events(struct betree_event* event, struct betree_event* delta);
 
 bool sub_has_attribute(const struct betree_sub* sub, betree_var_t variable_id);
 bool sub_has_attribute_str(struct config* config, const struct betree_sub* sub, const char* attr);
 bool sub_is_enclosed(const struct attr_domain** attr_domains, const struct betree_sub* sub, const struct cdir* cdir);
+// get_variable_bound of the sub's expression, computed once per attribute and domain version
+struct value_bound get_sub_bound(const struct attr_domain* attr_domain, const struct betree_sub* sub);
+
+// Zeroes the search counters of the subtree and its subs, nothing to do without BETREE_STATS
+void reset_stats_cnode(struct cnode* cnode);
 
 struct lnode* make_lnode(const struct config* config, struct cnode* parent);
 void free_lnode(struct lnode* lnode);
@@ -111,21 +223,129 @@ struct betree_event* make_event_from_string(const struct betree* betree, const c
 struct memoize make_memoize(size_t pred_count);
 void free_memoize(struct memoize memoize);
 
+struct ranked_sub {
+    struct betree_sub* sub;
+    bool passed;
+};
+
+struct subs_to_eval {
+    struct betree_sub** subs;
+    // Subs already known to match from their short circuit, they are kept in place to report in order
+    bool* passed;
+    size_t capacity;
+    size_t count;
+    // Subs the short circuit ruled out, they were not added
+    size_t failed;
+    // The subs by priority, only filled by searches that rank them
+    size_t ranked_capacity;
+    struct ranked_sub* ranked;
+};
+
+// cdirs left to search, kept with the context so searches reuse the frames
+struct search_frame {
+    struct cdir* cdir;
+    bool open_left;
+    bool open_right;
+};
+
+struct search_stack {
+    size_t capacity;
+    size_t count;
+    struct search_frame* frames;
+};
+
+// Per-thread scratch buffers for a search, sized from the config and grown on reset when needed
+struct betree_search_context {
+    size_t attr_domain_count;
+    size_t memoize_count;
+    const struct betree_variable** preds;
+    uint64_t* undefined;
+    struct memoize memoize;
+    struct subs_to_eval subs;
+    struct search_stack stack;
+    // Backs the events read by scan_event
+    struct event_scratch* scratch;
+    // Backs the keys of the result cache
+    struct result_key* result_key;
+};
+
+struct betree_search_context* make_search_context(const struct config* config);
+void reset_search_context(const struct config* config, struct betree_search_context* context);
+void free_search_context(struct betree_search_context* context);
+
 struct betree_constant {
     const char* name;
     struct value value;
 };
 
-//bool betree_delete_inner(size_t attr_domains_count, const struct attr_domain** attr_domains, struct betree_sub* sub, struct cnode* cnode);
-struct betree_sub* find_sub_id(betree_sub_t id, struct cnode* cnode);
+bool betree_delete_inner(const struct config* config, struct betree_sub* sub);
 
 bool betree_search_with_preds(const struct config* config,
-    const struct betree_variable** preds,
+    struct betree_search_context* context,
+    const struct cnode* cnode,
+    struct report* report);
+// Gets the matches instead of report->subs
+struct match_sink {
+    betree_match_callback callback;
+    void* data;
+};
+
+// Stops once limit subs matched, by_priority evaluates the subs from the highest priority down.
+// The matches go to the sink when there is one, report only gets the counters then
+bool betree_search_limit_with_preds(const struct config* config,
+    struct betree_search_context* context,
+    const struct cnode* cnode,
+    size_t limit,
+    bool by_priority,
+    const struct match_sink* sink,
+    struct report* report);
+// Copies the matches previous got for an event, then evaluates again the subs depending on the
+// attributes set in changed, the words of which cover every attribute
+bool betree_search_delta_with_preds(const struct config* config,
+    struct betree_search_context* context,
     const struct cnode* cnode,
+    const uint64_t* changed,
+    const struct report* previous,
     struct report* report);
-bool betree_exists_with_preds(const struct config* config, const struct betree_variable** preds, const struct cnode* cnode);
+// Where a search split into steps is, see betree_make_search_cursor
+struct search_steps {
+    bool walked;
+    // Next candidate to evaluate once the walk is over
+    size_t next;
+};
+
+// Same search as betree_search_with_preds done in bounded steps, always on the caller's thread
+void start_search_steps(const struct config* config,
+    struct betree_search_context* context,
+    const struct cnode* cnode,
+    struct search_steps* steps);
+// Spends about budget units, a cnode visited or a candidate added or evaluated each, true once report is complete
+bool search_steps(struct betree_search_context* context, struct search_steps* steps, size_t budget, struct report* report);
+bool betree_exists_with_preds(const struct config* config,
+    struct betree_search_context* context,
+    const struct cnode* cnode);
+// Searches up to 64 events at once, bit j of live selects contexts[j] and reports[j]
+bool betree_search_batch_with_preds(const struct config* config,
+    struct betree_search_context** contexts,
+    uint64_t live,
+    const struct cnode* cnode,
+    struct report** reports);
 
 bool insert_be_tree(const struct config* config, const struct betree_sub* sub, struct cnode* cnode, struct cdir* cdir);
+bool insert_be_tree_all(const struct config* config, struct betree_sub** subs, size_t count, struct cnode* cnode);
+// Moves the outer cdirs of every pnode out to the domain of its variable once it has grown, and the subs
+// that then fit further down along with them
+void widen_be_tree(const struct config* config, struct cnode* cnode);
+// Subs of the whole subtree, only counted when subs is NULL
+void collect_subs(const struct cnode* cnode, struct betree_sub** subs, size_t* count);
+// Builds the tree under the root cnode again from its subs, as the bulk loader would
+void rebuild_be_tree(const struct config* config, struct cnode* cnode);
+// Builds or drops the prefilter postings of every lnode under cnode
+void index_be_tree_postings(struct cnode* cnode, bool enable);
+// Builds or drops the columns of every lnode under cnode
+// Puts the subs of each lnode that answer the most exists searches first
+void order_be_tree_by_hits(struct cnode* cnode);
+void index_be_tree_columns(struct cnode* cnode, bool enable);
 
-void sort_event_lists(struct betree_event* event);
+void sort_event_lists(const struct config* config, struct betree_event* event);
 
@@ -0,0 +1,129 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "alloc.h"
+#include "betree.h"
+#include "config.h"
+#include "sub_index.h"
+#include "tree.h"
+
+// Capacities past the 255 the config used to hold matter for large corpora
+static const uint32_t tune_lnode_caps[] = { 4, 8, 16, 32, 64, 128, 256, 512 };
+static const uint32_t tune_split_domains[] = { 1000, 10000, 100000 };
+#define TUNE_PASSES 3
+// Candidates this much slower than the fastest still win on memory
+#define TUNE_TOLERANCE 0.05
+
+struct tune_trial {
+    struct betree_params params;
+    uint64_t nanoseconds;
+    size_t bytes;
+};
+
+static uint64_t tune_clock(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+// Same variables and settings as the schema, none of its subs
+static struct betree* make_trial_tree(const struct betree* schema, const struct betree_params* params)
+{
+    struct betree* tree = bcalloc(sizeof(*tree));
+    if(tree == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    tree->arena = NULL;
+    tree->config = clone_config(schema->config);
+    tree->config->lnode_max_cap = params->lnode_max_cap;
+    tree->config->partition_min_size = params->partition_min_size;
+    tree->config->max_domain_for_split = params->max_domain_for_split;
+    tree->cnode = make_cnode(tree->config, NULL);
+    tree->sub_index = make_sub_index();
+    return tree;
+}
+
+// Best of a few passes over the events, false when one doesn't parse
+static bool run_trial(const struct betree* schema, size_t count, const betree_sub_t* ids,
+    const char** exprs, size_t event_count, const char** events, struct tune_trial* trial)
+{
+    struct betree* tree = make_trial_tree(schema, &trial->params);
+    if(!betree_insert_all(tree, count, ids, exprs)) {
+        betree_free(tree);
+        return false;
+    }
+    struct report* report = make_report();
+    struct betree_search_context* context = betree_make_search_context(tree);
+    bool valid = true;
+    trial->nanoseconds = UINT64_MAX;
+    for(size_t pass = 0; valid && pass < TUNE_PASSES; pass++) {
+        uint64_t start = tune_clock();
+        for(size_t i = 0; i < event_count; i++) {
+            betree_report_reset(report);
+            if(!betree_search_with_context(tree, events[i], report, context)) {
+                valid = false;
+                break;
+            }
+        }
+        uint64_t elapsed = tune_clock() - start;
+        if(elapsed < trial->nanoseconds) {
+            trial->nanoseconds = elapsed;
+        }
+    }
+    struct betree_memory_stats stats;
+    betree_memory_stats(tree, &stats);
+    trial->bytes = stats.total_bytes;
+    betree_free_search_context(context);
+    free_report(report);
+    betree_free(tree);
+    return valid;
+}
+
+bool betree_tune_params(const struct betree* betree, size_t count, const char** exprs,
+    size_t event_count, const char** events, struct betree_params* params)
+{
+    size_t cap_count = sizeof(tune_lnode_caps) / sizeof(*tune_lnode_caps);
+    size_t domain_count = sizeof(tune_split_domains) / sizeof(*tune_split_domains);
+    size_t trial_count = cap_count * domain_count;
+    struct tune_trial* trials = bcalloc(trial_count * sizeof(*trials));
+    betree_sub_t* ids = bcalloc((count == 0 ? 1 : count) * sizeof(*ids));
+    if(trials == NULL || ids == NULL) {
+        fprintf(stderr, "%s bcalloc failed\n", __func__);
+        abort();
+    }
+    for(size_t i = 0; i < count; i++) {
+        ids[i] = i;
+    }
+    bool valid = true;
+    uint64_t fastest = UINT64_MAX;
+    for(size_t i = 0; valid && i < trial_count; i++) {
+        struct tune_trial* trial = &trials[i];
+        trial->params.lnode_max_cap = tune_lnode_caps[i / domain_count];
+        trial->params.partition_min_size = betree->config->partition_min_size;
+        trial->params.max_domain_for_split = tune_split_domains[i % domain_count];
+        valid = run_trial(betree, count, ids, exprs, event_count, events, trial);
+        if(trial->nanoseconds < fastest) {
+            fastest = trial->nanoseconds;
+        }
+    }
+    if(valid) {
+        const struct tune_trial* best = NULL;
+        for(size_t i = 0; i < trial_count; i++) {
+            if((double)trials[i].nanoseconds > (double)fastest * (1. + TUNE_TOLERANCE)) {
+                continue;
+            }
+            if(best == NULL || trials[i].bytes < best->bytes) {
+                best = &trials[i];
+            }
+        }
+        *params = best->params;
+    }
+    bfree(ids);
+    bfree(trials);
+    return valid;
+}
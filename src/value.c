@@ -1,4 +1,5 @@
 #include <inttypes.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -167,72 +168,55 @@ char* integer_enum_list_value_to_string(struct betree_integer_enum_list* list)
     return string;
 }
 
-void add_segment(struct betree_segment* segment, struct betree_segments* list)
+// Doubles the room of a list that is full
+static void* grow_content(void* content, size_t size, size_t* capacity, size_t element_size)
 {
-    if(list->size == 0) {
-        list->content = bcalloc(sizeof(*list->content));
-        if(list->content == NULL) {
-            fprintf(stderr, "%s bcalloc failed", __func__);
-            abort();
-        }
+    if(size < *capacity) {
+        return content;
     }
-    else {
-        struct betree_segment** content = brealloc(list->content, sizeof(*list->content) * (list->size + 1));
-        if(content == NULL) {
-            fprintf(stderr, "%s brealloc failed", __func__);
-            abort();
-        }
-        list->content = content;
+    size_t grown_capacity = *capacity == 0 ? 4 : *capacity * 2;
+    void* grown = brealloc(content, grown_capacity * element_size);
+    if(grown == NULL) {
+        fprintf(stderr, "%s brealloc failed", __func__);
+        abort();
     }
+    *capacity = grown_capacity;
+    return grown;
+}
+
+void add_segment(struct betree_segment segment, struct betree_segments* list)
+{
+    list->content = grow_content(list->content, list->size, &list->capacity, sizeof(*list->content));
     list->content[list->size] = segment;
     list->size++;
 }
 
-void add_frequency(struct betree_frequency_cap* frequency, struct betree_frequency_caps* list)
+void add_frequency(struct betree_frequency_cap frequency, struct betree_frequency_caps* list)
 {
-    if(list->size == 0) {
-        list->content = bcalloc(sizeof(*list->content));
-        if(list->content == NULL) {
-            fprintf(stderr, "%s bcalloc failed", __func__);
-            abort();
-        }
-    }
-    else {
-        struct betree_frequency_cap** content
-            = brealloc(list->content, sizeof(*list->content) * (list->size + 1));
-        if(content == NULL) {
-            fprintf(stderr, "%s brealloc failed", __func__);
-            abort();
-        }
-        list->content = content;
-    }
+    list->content = grow_content(list->content, list->size, &list->capacity, sizeof(*list->content));
     list->content[list->size] = frequency;
     list->size++;
 }
 
-struct betree_segment* make_segment(int64_t id, int64_t timestamp)
+struct betree_segment make_segment(int64_t id, int64_t timestamp)
 {
-    struct betree_segment* segment = bmalloc(sizeof(*segment));
-    segment->id = id;
-    segment->timestamp = timestamp;
+    struct betree_segment segment = { .id = id, .timestamp = timestamp };
     return segment;
 }
 
-struct betree_frequency_cap* make_frequency_cap(const char* stype,
+struct betree_frequency_cap make_frequency_cap(const char* stype,
     uint32_t id,
     struct string_value namespace,
     bool timestamp_defined,
     int64_t timestamp,
     uint32_t value)
 {
-    struct betree_frequency_cap* frequency_cap = bmalloc(sizeof(*frequency_cap));
-    enum frequency_type_e type = get_type_from_string(stype);
-    frequency_cap->type = type;
-    frequency_cap->id = id;
-    frequency_cap->namespace = namespace;
-    frequency_cap->timestamp_defined = timestamp_defined;
-    frequency_cap->timestamp = timestamp;
-    frequency_cap->value = value;
+    struct betree_frequency_cap frequency_cap = { .type = get_type_from_string(stype),
+        .id = id,
+        .namespace = namespace,
+        .timestamp_defined = timestamp_defined,
+        .timestamp = timestamp,
+        .value = value };
     return frequency_cap;
 }
 
@@ -284,6 +268,7 @@ void free_string_list(struct betree_string_list* value)
         bfree((char*)value->strings[i].string);
     }
     bfree(value->strings);
+    bfree(value->bitmap);
     bfree(value);
 }
 
@@ -294,11 +279,6 @@ void free_segment(struct betree_segment* value)
 
 void free_segments(struct betree_segments* value)
 {
-    for(size_t i = 0; i < value->size; i++) {
-        if(value->content[i] != NULL) {
-            bfree(value->content[i]);
-        }
-    }
     bfree(value->content);
     bfree(value);
 }
@@ -312,10 +292,9 @@ void free_frequency_cap(struct betree_frequency_cap* value)
 void free_frequency_caps(struct betree_frequency_caps* value)
 {
     for(size_t i = 0; i < value->size; i++) {
-        if(value->content[i] != NULL) {
-            free_frequency_cap(value->content[i]);
-        }
+        bfree((char*)value->content[i].namespace.string);
     }
+    bfree(value->slots);
     bfree(value->content);
     bfree(value);
 }
@@ -369,7 +348,7 @@ char* segments_value_to_string(struct betree_segments* list)
     char* string = NULL;
     for(size_t i = 0; i < list->size; i++) {
         char* new_string;
-        char* segment = segment_value_to_string(list->content[i]);
+        char* segment = segment_value_to_string(&list->content[i]);
         if(i != 0) {
             if(basprintf(&new_string, "%s, %s", string, segment) < 0) {
                 abort();
@@ -409,7 +388,7 @@ char* frequency_caps_value_to_string(struct betree_frequency_caps* list)
     char* string = NULL;
     for(size_t i = 0; i < list->size; i++) {
         char* new_string;
-        char* cap = frequency_cap_to_string(list->content[i]);
+        char* cap = frequency_cap_to_string(&list->content[i]);
         if(i != 0) {
             if(basprintf(&new_string, "%s, %s", string, cap) < 0) {
                 abort();
@@ -427,6 +406,90 @@ char* frequency_caps_value_to_string(struct betree_frequency_caps* list)
     return string;
 }
 
+static uint64_t sort_key(const char* element, size_t key_offset, bool is_signed)
+{
+    uint64_t key;
+    memcpy(&key, element + key_offset, sizeof(key));
+    // Flipping the sign bit orders signed keys as unsigned ones
+    return is_signed ? key ^ (1ULL << 63) : key;
+}
+
+enum key_order {
+    KEYS_UNSORTED,
+    KEYS_SORTED,
+    KEYS_UNIQUE,
+};
+
+static enum key_order find_key_order(const void* elements, size_t count, size_t size, size_t key_offset, bool is_signed)
+{
+    const char* bytes = elements;
+    enum key_order order = KEYS_UNIQUE;
+    for(size_t i = 1; i < count; i++) {
+        uint64_t previous = sort_key(bytes + (i - 1) * size, key_offset, is_signed);
+        uint64_t key = sort_key(bytes + i * size, key_offset, is_signed);
+        if(key < previous) {
+            return KEYS_UNSORTED;
+        }
+        if(key == previous) {
+            order = KEYS_SORTED;
+        }
+    }
+    return order;
+}
+
+// Least significant byte first, one pass per byte that differs between the keys
+static void radix_sort(void* elements, size_t count, size_t size, size_t key_offset, bool is_signed)
+{
+    char* buffer = bmalloc(count * size);
+    if(buffer == NULL) {
+        fprintf(stderr, "%s bmalloc failed\n", __func__);
+        abort();
+    }
+    char* from = elements;
+    char* to = buffer;
+    for(unsigned shift = 0; shift < 64; shift += 8) {
+        size_t offsets[256] = { 0 };
+        for(size_t i = 0; i < count; i++) {
+            offsets[(sort_key(from + i * size, key_offset, is_signed) >> shift) & 0xff]++;
+        }
+        if(offsets[(sort_key(from, key_offset, is_signed) >> shift) & 0xff] == count) {
+            continue;
+        }
+        size_t total = 0;
+        for(size_t i = 0; i < 256; i++) {
+            size_t bucket = offsets[i];
+            offsets[i] = total;
+            total += bucket;
+        }
+        for(size_t i = 0; i < count; i++) {
+            size_t byte = (sort_key(from + i * size, key_offset, is_signed) >> shift) & 0xff;
+            memcpy(to + offsets[byte]++ * size, from + i * size, size);
+        }
+        char* swap = from;
+        from = to;
+        to = swap;
+    }
+    if(from != elements) {
+        memcpy(elements, from, count * size);
+    }
+    bfree(buffer);
+}
+
+static void sort_keys(void* elements,
+    size_t count,
+    size_t size,
+    size_t key_offset,
+    bool is_signed,
+    int (*cmp)(const void*, const void*))
+{
+    if(count >= RADIX_SORT_MIN) {
+        radix_sort(elements, count, size, key_offset, is_signed);
+    }
+    else if(count > 1) {
+        qsort(elements, count, size, cmp);
+    }
+}
+
 void remove_duplicates_integer_list(struct betree_integer_list* list)
 {
     if (list->count == 0) {
@@ -443,12 +506,18 @@ void remove_duplicates_integer_list(struct betree_integer_list* list)
 
 void sort_integer_list(struct betree_integer_list* list)
 {
-    qsort(list->integers, list->count, sizeof(*list->integers), icmpfunc);
+    sort_keys(list->integers, list->count, sizeof(*list->integers), 0, true, icmpfunc);
 }
 
 void sort_and_remove_duplicate_integer_list(struct betree_integer_list* list)
 {
-    sort_integer_list(list);
+    enum key_order order = find_key_order(list->integers, list->count, sizeof(*list->integers), 0, true);
+    if(order == KEYS_UNIQUE) {
+        return;
+    }
+    if(order == KEYS_UNSORTED) {
+        sort_integer_list(list);
+    }
     remove_duplicates_integer_list(list);
 }
 
@@ -471,12 +540,24 @@ void remove_duplicates_string_list(struct betree_string_list* list)
 
 void sort_string_list(struct betree_string_list* list)
 {
-    qsort(list->strings, list->count, sizeof(*list->strings), scmpfunc);
+    sort_keys(list->strings,
+        list->count,
+        sizeof(*list->strings),
+        offsetof(struct string_value, str),
+        false,
+        scmpfunc);
 }
 
 void sort_and_remove_duplicate_string_list(struct betree_string_list* list)
 {
-    sort_string_list(list);
+    enum key_order order = find_key_order(
+        list->strings, list->count, sizeof(*list->strings), offsetof(struct string_value, str), false);
+    if(order == KEYS_UNIQUE) {
+        return;
+    }
+    if(order == KEYS_UNSORTED) {
+        sort_string_list(list);
+    }
     remove_duplicates_string_list(list);
 }
 
@@ -496,12 +577,134 @@ void remove_duplicates_integer_enum_list(struct betree_integer_enum_list* list)
 
 void sort_integer_enum_list(struct betree_integer_enum_list* list)
 {
-    qsort(list->integers, list->count, sizeof(*list->integers), iecmpfunc);
+    sort_keys(list->integers,
+        list->count,
+        sizeof(*list->integers),
+        offsetof(struct integer_enum_value, ienum),
+        false,
+        iecmpfunc);
 }
 
 void sort_and_remove_duplicate_integer_enum_list(struct betree_integer_enum_list* list)
 {
-    sort_integer_enum_list(list);
+    enum key_order order = find_key_order(list->integers,
+        list->count,
+        sizeof(*list->integers),
+        offsetof(struct integer_enum_value, ienum),
+        false);
+    if(order == KEYS_UNIQUE) {
+        return;
+    }
+    if(order == KEYS_UNSORTED) {
+        sort_integer_enum_list(list);
+    }
     remove_duplicates_integer_enum_list(list);
 }
 
+
+static int segment_cmp(const void* a, const void* b)
+{
+    const struct betree_segment* x = a;
+    const struct betree_segment* y = b;
+    if(x->id != y->id) {
+        return x->id < y->id ? -1 : 1;
+    }
+    return x->timestamp < y->timestamp ? -1 : x->timestamp > y->timestamp;
+}
+
+void sort_segments(struct betree_segments* list)
+{
+    for(size_t i = 1; i < list->size; i++) {
+        if(list->content[i].id < list->content[i - 1].id) {
+            qsort(list->content, list->size, sizeof(*list->content), segment_cmp);
+            return;
+        }
+    }
+}
+
+static size_t frequency_cap_hash(enum frequency_type_e type, uint32_t id, betree_str_t namespace)
+{
+    uint64_t x = ((uint64_t)id << 32 | (uint64_t)type) ^ (namespace * 0x9e3779b97f4a7c15ULL);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return (size_t)(x ^ (x >> 31));
+}
+
+static bool same_frequency_cap(const struct betree_frequency_cap* cap,
+    enum frequency_type_e type,
+    uint32_t id,
+    betree_str_t namespace)
+{
+    return cap->id == id && cap->namespace.str == namespace && cap->type == type;
+}
+
+size_t frequency_caps_slot_count(size_t size)
+{
+    if(size < FREQUENCY_CAPS_INDEX_MIN) {
+        return 0;
+    }
+    size_t slot_count = 16;
+    while(slot_count < size * 2) {
+        slot_count *= 2;
+    }
+    return slot_count;
+}
+
+void fill_frequency_caps_slots(struct betree_frequency_caps* list)
+{
+    memset(list->slots, 0, list->slot_count * sizeof(*list->slots));
+    size_t mask = list->slot_count - 1;
+    for(size_t i = 0; i < list->size; i++) {
+        const struct betree_frequency_cap* cap = &list->content[i];
+        size_t slot = frequency_cap_hash(cap->type, cap->id, cap->namespace.str) & mask;
+        // A repeated key keeps the first cap, like the linear scan
+        while(list->slots[slot] != 0
+            && !same_frequency_cap(
+                &list->content[list->slots[slot] - 1], cap->type, cap->id, cap->namespace.str)) {
+            slot = (slot + 1) & mask;
+        }
+        if(list->slots[slot] == 0) {
+            list->slots[slot] = (uint32_t)(i + 1);
+        }
+    }
+}
+
+void index_frequency_caps(struct betree_frequency_caps* list)
+{
+    bfree(list->slots);
+    list->slots = NULL;
+    list->slot_count = frequency_caps_slot_count(list->size);
+    if(list->slot_count == 0) {
+        return;
+    }
+    list->slots = bmalloc(list->slot_count * sizeof(*list->slots));
+    if(list->slots == NULL) {
+        fprintf(stderr, "%s bmalloc failed\n", __func__);
+        abort();
+    }
+    fill_frequency_caps_slots(list);
+}
+
+const struct betree_frequency_cap* find_frequency_cap(const struct betree_frequency_caps* list,
+    enum frequency_type_e type,
+    uint32_t id,
+    betree_str_t namespace)
+{
+    if(list->slots == NULL) {
+        for(size_t i = 0; i < list->size; i++) {
+            if(same_frequency_cap(&list->content[i], type, id, namespace)) {
+                return &list->content[i];
+            }
+        }
+        return NULL;
+    }
+    size_t mask = list->slot_count - 1;
+    for(size_t slot = frequency_cap_hash(type, id, namespace) & mask; list->slots[slot] != 0;
+        slot = (slot + 1) & mask) {
+        const struct betree_frequency_cap* cap = &list->content[list->slots[slot] - 1];
+        if(same_frequency_cap(cap, type, id, namespace)) {
+            return cap;
+        }
+    }
+    return NULL;
+}
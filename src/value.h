@@ -6,6 +6,8 @@
 
 #include "betree.h"
 
+struct id_bitmap;
+
 typedef uint64_t betree_var_t;
 static const betree_var_t INVALID_VAR = UINT64_MAX;
 typedef uint64_t betree_str_t;
@@ -40,6 +42,8 @@ struct betree_integer_enum_list {
 struct betree_string_list {
     size_t count;
     struct string_value* strings;
+    // Only set for small domains, see bitmap.h
+    struct id_bitmap* bitmap;
 };
 
 struct betree_segment {
@@ -49,7 +53,8 @@ struct betree_segment {
 
 struct betree_segments {
     size_t size;
-    struct betree_segment** content;
+    size_t capacity;
+    struct betree_segment* content;
 };
 
 enum frequency_type_e {
@@ -74,7 +79,11 @@ struct betree_frequency_cap {
 
 struct betree_frequency_caps {
     size_t size;
-    struct betree_frequency_cap** content;
+    size_t capacity;
+    struct betree_frequency_cap* content;
+    // Index + 1 of the first cap of each (type, id, namespace), only set by fill_event on large lists
+    size_t slot_count;
+    uint32_t* slots;
 };
 
 struct value {
@@ -126,10 +135,10 @@ char* integer_list_value_to_string(struct betree_integer_list* list);
 void add_string_list_value(struct string_value string, struct betree_string_list* list);
 char* string_list_value_to_string(struct betree_string_list* list);
 char* integer_enum_list_value_to_string(struct betree_integer_enum_list* list);
-void add_segment(struct betree_segment* segment, struct betree_segments* list);
-void add_frequency(struct betree_frequency_cap* frequency, struct betree_frequency_caps* list);
-struct betree_segment* make_segment(int64_t id, int64_t timestamp);
-struct betree_frequency_cap* make_frequency_cap(const char* stype,
+void add_segment(struct betree_segment segment, struct betree_segments* list);
+void add_frequency(struct betree_frequency_cap frequency, struct betree_frequency_caps* list);
+struct betree_segment make_segment(int64_t id, int64_t timestamp);
+struct betree_frequency_cap make_frequency_cap(const char* stype,
     uint32_t id,
     struct string_value namespace,
     bool timestamp_defined,
@@ -150,6 +159,9 @@ void free_integer_enum_list(struct betree_integer_enum_list* value);
 
 void free_value(struct value value);
 
+// Lists with at least that many values are radix sorted on their 64 bit keys
+#define RADIX_SORT_MIN 64
+
 void remove_duplicates_integer_list(struct betree_integer_list* list);
 void sort_integer_list(struct betree_integer_list* list);
 void sort_and_remove_duplicate_integer_list(struct betree_integer_list* list);
@@ -159,4 +171,21 @@ void sort_and_remove_duplicate_string_list(struct betree_string_list* list);
 void remove_duplicates_integer_enum_list(struct betree_integer_enum_list* list);
 void sort_integer_enum_list(struct betree_integer_enum_list* list);
 void sort_and_remove_duplicate_integer_enum_list(struct betree_integer_enum_list* list);
+// Only reorders segments that are not already sorted by id
+void sort_segments(struct betree_segments* list);
+
+// Caps lists with at least that many caps get slots
+#define FREQUENCY_CAPS_INDEX_MIN 8
+
+// Number of slots for a list of that many caps, 0 when it is too small to get any
+size_t frequency_caps_slot_count(size_t size);
+// Fills the slot_count slots of the list, the namespaces must have their ids
+void fill_frequency_caps_slots(struct betree_frequency_caps* list);
+// Replaces the slots of the list
+void index_frequency_caps(struct betree_frequency_caps* list);
+// First cap of the list with that key, NULL when there is none
+const struct betree_frequency_cap* find_frequency_cap(const struct betree_frequency_caps* list,
+    enum frequency_type_e type,
+    uint32_t id,
+    betree_str_t namespace);
 
@@ -1,15 +1,25 @@
 #include <float.h>
+#include <inttypes.h>
 #include <math.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "alloc.h"
 #include "betree.h"
+#include "bitmap.h"
 #include "debug.h"
+#include "hashmap.h"
 #include "helper.h"
 #include "minunit.h"
+#include "parse_cache.h"
 #include "printer.h"
+#include "result_cache.h"
+#include "sorted_list.h"
+#include "string_matcher.h"
+#include "sub_index.h"
 #include "tree.h"
 #include "utils.h"
 
@@ -28,6 +38,36 @@ int test_sub_has_attribute()
     return 0;
 }
 
+int test_sub_masks_trimmed()
+{
+    struct betree* tree = betree_make();
+    char name[16];
+    for(size_t i = 0; i < 200; i++) {
+        sprintf(name, "a%zu", i);
+        add_attr_domain_bounded_i(tree->config, name, true, 0, 10);
+    }
+
+    mu_assert(betree_insert(tree, 0, "a3 = 0"), "");
+    mu_assert(betree_insert(tree, 1, "a150 = 0 or a70 = 1"), "");
+
+    const struct betree_sub* low = betree_make_sub(tree, 2, 0, NULL, "a3 = 0");
+    const struct betree_sub* high = betree_make_sub(tree, 3, 0, NULL, "a150 = 0 or a70 = 1");
+    mu_assert(low->short_circuit.word_count == 1, "only the words up to the last attribute are kept");
+    mu_assert(high->short_circuit.word_count == 3, "only the words up to the last attribute are kept");
+    mu_assert(sub_has_attribute(high, 150) && sub_has_attribute(high, 70), "attributes are kept");
+    mu_assert(!sub_has_attribute(low, 150) && !sub_has_attribute(high, 199), "attributes past the masks are not used");
+    mu_assert(test_bit(low->short_circuit.fail, 3), "short circuit is kept");
+
+    struct report* report = make_report();
+    mu_assert(betree_search(tree, "{\"a150\": 0}", report), "");
+    mu_assert(report->matched == 1 && report->subs[0] == 1, "undefined a3 fails sub 0");
+    free_report(report);
+    free_sub((struct betree_sub*)low);
+    free_sub((struct betree_sub*)high);
+    betree_free(tree);
+    return 0;
+}
+
 bool cnode_has_sub0(struct cnode* cnode)
 {
     return cnode != NULL && cnode->lnode != NULL && cnode->lnode->sub_count == 0;
@@ -240,49 +280,147 @@ int test_cdir_split_twice()
     return 0;
 }
 
-/*int test_remove_sub_in_tree()*/
-/*{*/
-    /*struct betree* tree = betree_make();*/
-    /*add_attr_domain_bounded_i(tree->config, "a", false, 0, 10);*/
+int test_remove_sub_in_tree()
+{
+    struct betree* tree = betree_make();
+    add_attr_domain_bounded_i(tree->config, "a", false, 0, 10);
+
+    mu_assert(betree_insert(tree, 0, "a = 0"), "");
+
+    mu_assert(tree->cnode->lnode->sub_count == 1, "lnode has the sub");
+
+    mu_assert(betree_delete(tree, 0), "");
+
+    mu_assert(tree->cnode->lnode->sub_count == 0, "lnode does not have the sub");
+    mu_assert(tree->cnode != NULL && tree->cnode->lnode != NULL,
+        "did not delete the cnode or lnode because it's root");
+
+    betree_free(tree);
+    return 0;
+}
+
+int test_remove_sub_in_tree_with_delete()
+{
+    struct betree* tree = betree_make();
+    add_attr_domain_bounded_i(tree->config, "a", false, 0, 10);
+    add_attr_domain_bounded_i(tree->config, "b", false, 0, 10);
+
+    mu_assert(betree_insert(tree, 1, "a = 0"), "");
+    mu_assert(betree_insert(tree, 2, "a = 0"), "");
+    mu_assert(betree_insert(tree, 3, "a = 0"), "");
+    mu_assert(betree_insert(tree, 4, "b = 0"), "");
+
+    mu_assert(tree->cnode->lnode->sub_count == 1, "sub 4 is in lnode");
+    mu_assert(tree->cnode->pdir->pnodes[0]->cdir->cnode->lnode->sub_count == 3,
+        "sub 1, 2, and 3 is lower lnode");
+
+    mu_assert(betree_delete(tree, 1), "");
+    mu_assert(betree_delete(tree, 2), "");
+    mu_assert(betree_delete(tree, 3), "");
+
+    mu_assert(tree->cnode->pdir == NULL, "deleted everything down of the pdir");
+
+    betree_free(tree);
+    return 0;
+}
+
+int test_delete_merges_clusters()
+{
+    struct betree* tree = betree_make();
+    add_attr_domain_bounded_i(tree->config, "a", false, 0, 10);
+    add_attr_domain_bounded_i(tree->config, "b", false, 0, 10);
+
+    mu_assert(betree_insert(tree, 1, "a = 2"), "");
+    mu_assert(betree_insert(tree, 2, "a = 2"), "");
+    mu_assert(betree_insert(tree, 3, "a = 2"), "");
+    mu_assert(betree_insert(tree, 4, "b = 0"), "");
+    mu_assert(betree_insert(tree, 5, "a = 7"), "");
+    mu_assert(betree_insert(tree, 6, "a = 7"), "");
+    mu_assert(betree_insert(tree, 7, "a = 7"), "");
+
+    struct cdir* cdir = tree->cnode->pdir->pnodes[0]->cdir;
+    mu_assert(cdir->lchild != NULL && cdir->rchild != NULL, "cdir was split");
+
+    mu_assert(betree_delete(tree, 5), "");
+    mu_assert(betree_delete(tree, 6), "");
+    mu_assert(cdir->lchild != NULL && cdir->rchild != NULL, "too many subs to merge");
 
-    /*mu_assert(betree_insert(tree, 0, "a = 0"), "");*/
+    mu_assert(betree_delete(tree, 1), "");
+    mu_assert(cdir->lchild == NULL && cdir->rchild == NULL, "children merged back");
+    mu_assert(cdir->cnode->lnode->sub_count == 3, "merged subs are in the parent lnode");
 
-    /*mu_assert(tree->cnode->lnode->sub_count == 1, "lnode has the sub");*/
+    mu_assert(!betree_delete(tree, 5), "already deleted");
 
-    /*mu_assert(betree_delete(tree, 0), "");*/
+    struct report* report = make_report();
+    mu_assert(betree_search(tree, "{\"a\": 7, \"b\": 1}", report), "");
+    mu_assert(report->matched == 1 && report->subs[0] == 7, "found the remaining sub");
+    free_report(report);
+
+    betree_free(tree);
+    return 0;
+}
+
+static bool lnode_has_sub(const struct lnode* lnode, const struct betree_sub* sub)
+{
+    for(size_t i = 0; i < lnode->sub_count; i++) {
+        if(lnode->subs[i] == sub) {
+            return true;
+        }
+    }
+    return false;
+}
 
-    /*mu_assert(tree->cnode->lnode->sub_count == 0, "lnode does not have the sub");*/
-    /*mu_assert(tree->cnode != NULL && tree->cnode->lnode != NULL,*/
-        /*"did not delete the cnode or lnode because it's root");*/
+int test_sub_index()
+{
+    struct betree* tree = betree_make();
+    add_attr_domain_bounded_i(tree->config, "a", false, 0, 10);
+    add_attr_domain_bounded_i(tree->config, "b", false, 0, 10);
 
-    /*betree_free(tree);*/
-    /*return 0;*/
-/*}*/
+    for(size_t i = 0; i < 200; i++) {
+        char expr[32];
+        sprintf(expr, "a = %zu", i % 11);
+        mu_assert(betree_insert(tree, i, expr), "");
+    }
+    mu_assert(betree_insert(tree, 200, "b = 0"), "");
+    mu_assert(betree_insert(tree, 200, "b = 1"), "");
+    mu_assert(tree->sub_index->count == 202, "every sub is indexed");
+
+    for(size_t i = 0; i <= 200; i++) {
+        const struct betree_sub* sub = sub_index_find(tree->sub_index, i);
+        mu_assert(sub != NULL && sub->id == i, "found the sub");
+        mu_assert(sub->lnode != NULL && lnode_has_sub(sub->lnode, sub), "owning lnode followed the moves");
+    }
+    mu_assert(sub_index_find(tree->sub_index, 201) == NULL, "unknown id");
 
-/*int test_remove_sub_in_tree_with_delete()*/
-/*{*/
-    /*struct betree* tree = betree_make();*/
-    /*add_attr_domain_bounded_i(tree->config, "a", false, 0, 10);*/
-    /*add_attr_domain_bounded_i(tree->config, "b", false, 0, 10);*/
+    mu_assert(betree_delete(tree, 200), "");
+    mu_assert(sub_index_find(tree->sub_index, 200) != NULL, "duplicate id is still there");
+    mu_assert(betree_delete(tree, 200), "");
+    mu_assert(sub_index_find(tree->sub_index, 200) == NULL, "both duplicates deleted");
+    mu_assert(!betree_delete(tree, 200), "nothing left to delete");
+    mu_assert(tree->sub_index->count == 200, "index shrank with the deletes");
 
-    /*mu_assert(betree_insert(tree, 1, "a = 0"), "");*/
-    /*mu_assert(betree_insert(tree, 2, "a = 0"), "");*/
-    /*mu_assert(betree_insert(tree, 3, "a = 0"), "");*/
-    /*mu_assert(betree_insert(tree, 4, "b = 0"), "");*/
+    betree_free(tree);
+    return 0;
+}
 
-    /*mu_assert(tree->cnode->lnode->sub_count == 1, "sub 4 is in lnode");*/
-    /*mu_assert(tree->cnode->pdir->pnodes[0]->cdir->cnode->lnode->sub_count == 3,*/
-        /*"sub 1, 2, and 3 is lower lnode");*/
+int test_delete_then_insert_same_expr()
+{
+    struct betree* tree = betree_make();
+    add_attr_domain_bounded_i(tree->config, "a", false, 0, 10);
 
-    /*mu_assert(betree_delete(tree, 1), "");*/
-    /*mu_assert(betree_delete(tree, 2), "");*/
-    /*mu_assert(betree_delete(tree, 3), "");*/
+    mu_assert(betree_insert(tree, 1, "a = 2 and a < 5"), "");
+    mu_assert(betree_insert(tree, 2, "a = 2 and a < 5"), "");
+    mu_assert(betree_delete(tree, 1), "");
+    mu_assert(betree_insert(tree, 3, "a = 2 and a < 5"), "");
 
-    /*mu_assert(tree->cnode->pdir == NULL, "deleted everything down of the pdir");*/
+    struct report* report = make_report();
+    mu_assert(betree_search(tree, "{\"a\": 2}", report), "");
+    mu_assert(report->matched == 2, "both remaining subs match");
+    free_report(report);
 
-    /*betree_free(tree);*/
-    /*return 0;*/
-/*}*/
+    betree_free(tree);
+    return 0;
+}
 
 int test_match_deeper()
 {
@@ -496,6 +634,66 @@ int test_string()
     return 0;
 }
 
+int test_many_values()
+{
+    struct betree* tree = betree_make();
+    betree_add_string_variable(tree, "s", false, 500);
+    betree_add_integer_enum_variable(tree, "e", false, 500);
+
+    // Enough values for the lookup tables to grow a few times
+    for(size_t i = 0; i < 200; i++) {
+        char expr[64];
+        sprintf(expr, "s = \"v%zu\" and e = %zu", i, i * 7);
+        mu_assert(betree_insert(tree, i, expr), "");
+    }
+
+    struct attr_var s = tree->config->attr_domains[0]->attr_var;
+    struct attr_var e = tree->config->attr_domains[1]->attr_var;
+    mu_assert(try_get_id_for_string(tree->config, s, "v150") != INVALID_STR, "");
+    mu_assert(try_get_id_for_string(tree->config, s, "v200") == INVALID_STR, "");
+    mu_assert(try_get_id_for_ienum(tree->config, e, 1050) != INVALID_IENUM, "");
+    mu_assert(try_get_id_for_ienum(tree->config, e, 1051) == INVALID_IENUM, "");
+
+    struct report* report = make_report();
+    for(size_t i = 0; i < 200; i += 13) {
+        char event[64];
+        sprintf(event, "{\"s\": \"v%zu\", \"e\": %zu}", i, i * 7);
+        betree_report_reset(report);
+        mu_assert(betree_search(tree, event, report), "");
+        mu_assert(report->matched == 1 && report->subs[0] == i, "found the matching sub");
+    }
+    betree_report_reset(report);
+    mu_assert(betree_search(tree, "{\"s\": \"v3\", \"e\": 22}", report), "");
+    mu_assert(report->matched == 0, "values from different subs");
+
+    free_report(report);
+    betree_free(tree);
+    return 0;
+}
+
+int test_many_attributes()
+{
+    struct betree* tree = betree_make();
+    for(size_t i = 0; i < 300; i++) {
+        char name[16];
+        sprintf(name, "a%zu", i);
+        betree_add_integer_variable(tree, name, true, 0, 10);
+    }
+    mu_assert(try_get_id_for_attr(tree->config, "a17") == 17, "");
+    mu_assert(try_get_id_for_attr(tree->config, "A299") == 299, "names are lowercased");
+    mu_assert(try_get_id_for_exact_attr(tree->config, "A299") == INVALID_VAR, "");
+    mu_assert(try_get_id_for_attr(tree->config, "a300") == INVALID_VAR, "");
+
+    mu_assert(betree_insert(tree, 0, "a250 = 3"), "");
+    struct report* report = make_report();
+    mu_assert(betree_search(tree, "{\"a249\": 3, \"a250\": 3}", report), "");
+    mu_assert(report->matched == 1, "");
+
+    free_report(report);
+    betree_free(tree);
+    return 0;
+}
+
 int test_string_wont_split()
 {
     struct betree* tree = betree_make();
@@ -1348,6 +1546,45 @@ int test_api()
     return 0;
 }
 
+int test_api_from_array()
+{
+    struct betree* tree = betree_make();
+    betree_add_segments_variable(tree, "seg", false);
+    betree_add_frequency_caps_variable(tree, "frequency_caps", false);
+    betree_add_integer_variable(tree, "now", false, INT64_MIN, INT64_MAX);
+
+    const struct betree_constant* constants[] = { betree_make_integer_constant("flight_id", 10) };
+    mu_assert(betree_insert(tree, 0, "segment_within(seg, 3, 20)"), "");
+    mu_assert(betree_insert(tree, 1, "segment_within(seg, 4, 20)"), "");
+    mu_assert(betree_insert_with_constants(tree, 2, 1, constants, "within_frequency_cap(\"flight\", \"ns\", 5, 0)"), "");
+    betree_free_constant((struct betree_constant*)constants[0]);
+
+    int64_t usec = 1000 * 1000;
+    int64_t ids[] = { 1, 2, 3, 5 };
+    int64_t timestamps[] = { 10 * usec, 10 * usec, 10 * usec, 10 * usec };
+    const char* stypes[] = { "flight", "flight" };
+    uint32_t cap_ids[] = { 9, 10 };
+    const char* namespaces[] = { "ns", "ns" };
+    bool timestamp_defined[] = { false, false };
+    int64_t cap_timestamps[] = { 0, 0 };
+    uint32_t values[] = { 0, 4 };
+
+    struct betree_event* event = betree_make_event(tree);
+    betree_set_variable(event, 0, betree_make_segments_variable("seg", betree_make_segments_from_array(4, ids, timestamps)));
+    betree_set_variable(event, 1, betree_make_frequency_caps_variable("frequency_caps", betree_make_frequency_caps_from_array(2, stypes, cap_ids, namespaces, timestamp_defined, cap_timestamps, values)));
+    betree_set_variable(event, 2, betree_make_integer_variable("now", 0));
+
+    struct report* report = make_report();
+    mu_assert(betree_search_with_event(tree, event, report), "");
+    mu_assert(report->matched == 2 && report->subs[0] != 1 && report->subs[1] != 1, "from array");
+
+    betree_free_event(event);
+    betree_free(tree);
+    free_report(report);
+
+    return 0;
+}
+
 int test_inverted_binop()
 {
     struct betree* tree = betree_make();
@@ -1649,22 +1886,3045 @@ int test_duplicate_unsorted_string_list()
     return 0;
 }
 
+int test_search_context()
+{
+    struct betree* tree = betree_make();
+    add_attr_domain_bounded_i(tree->config, "i", false, 0, 10);
+
+    mu_assert(betree_insert(tree, 1, "i = 0"), "");
+    mu_assert(betree_insert(tree, 2, "i = 1"), "");
+
+    struct betree_search_context* context = betree_make_search_context(tree);
+    {
+        struct report* report = make_report();
+        mu_assert(betree_search_with_context(tree, "{\"i\": 0}", report, context), "");
+        mu_assert(report->matched == 1 && report->subs[0] == 1, "found first");
+        free_report(report);
+    }
+    {
+        struct report* report = make_report();
+        mu_assert(betree_search_with_context(tree, "{\"i\": 1}", report, context), "");
+        mu_assert(report->matched == 1 && report->subs[0] == 2, "nothing left from the previous search");
+        free_report(report);
+    }
+
+    // Memoized preds and attributes added after the context was made
+    add_attr_domain_bounded_i(tree->config, "j", true, 0, 10);
+    mu_assert(betree_insert(tree, 3, "i = 0 and j = 2"), "");
+    mu_assert(betree_insert(tree, 4, "i = 0 and j = 3"), "");
+    {
+        struct report* report = make_report();
+        mu_assert(betree_search_with_context(tree, "{\"i\": 0, \"j\": 2}", report, context), "");
+        mu_assert(report->matched == 2, "context grew with the tree");
+        free_report(report);
+    }
+    mu_assert(betree_exists_with_context(tree, "{\"i\": 1}", context), "");
+    mu_assert(!betree_exists_with_context(tree, "{\"i\": 5}", context), "");
+
+    betree_free_search_context(context);
+    betree_free(tree);
+    return 0;
+}
+
+int test_search_batch()
+{
+    struct betree* tree = betree_make();
+    add_attr_domain_bounded_i(tree->config, "i", false, 0, 10);
+    add_attr_domain_bounded_i(tree->config, "j", true, 0, 10);
+    add_attr_domain_b(tree->config, "b", false);
+
+    for(size_t n = 0; n < 100; n++) {
+        char expr[64];
+        sprintf(expr, "i = %zu and (b or j = %zu)", n % 11, n % 7);
+        mu_assert(betree_insert(tree, n, expr), "");
+    }
+
+    size_t count = 150;
+    struct betree_event* events[150];
+    struct report* reports[150];
+    for(size_t n = 0; n < count; n++) {
+        char event[64];
+        if(n % 3 == 0) {
+            sprintf(event, "{\"i\": %zu, \"b\": %s}", n % 11, n % 2 ? "true" : "false");
+        }
+        else {
+            sprintf(event, "{\"i\": %zu, \"j\": %zu, \"b\": false}", n % 11, n % 7);
+        }
+        events[n] = make_event_from_string(tree, event);
+        reports[n] = make_report();
+    }
+
+    mu_assert(betree_search_batch(tree, events, count, reports), "");
+
+    struct betree_search_context* context = betree_make_search_context(tree);
+    for(size_t n = 0; n < count; n++) {
+        struct report* report = make_report();
+        mu_assert(betree_search_with_event_and_context(tree, events[n], report, context), "");
+        mu_assert(report->matched == reports[n]->matched
+                && report->evaluated == reports[n]->evaluated,
+            "batch matches a single search");
+        for(size_t k = 0; k < report->matched; k++) {
+            mu_assert(report->subs[k] == reports[n]->subs[k], "same subs in the same order");
+        }
+        free_report(report);
+        free_report(reports[n]);
+        free_event(events[n]);
+    }
+    betree_free_search_context(context);
+
+    betree_free(tree);
+    return 0;
+}
+
+static int sub_id_cmp(const void* a, const void* b)
+{
+    betree_sub_t x = *(const betree_sub_t*)a;
+    betree_sub_t y = *(const betree_sub_t*)b;
+    return (x > y) - (x < y);
+}
+
+int test_insert_all()
+{
+    struct betree* incremental = betree_make();
+    struct betree* bulk = betree_make();
+    struct betree* trees[2] = { incremental, bulk };
+    for(size_t t = 0; t < 2; t++) {
+        add_attr_domain_bounded_i(trees[t]->config, "i", false, 0, 100);
+        add_attr_domain_bounded_i(trees[t]->config, "j", true, 0, 10);
+        add_attr_domain_s(trees[t]->config, "s", false);
+    }
+
+    size_t count = 10000;
+    char** exprs = bcalloc(count * sizeof(*exprs));
+    betree_sub_t* ids = bcalloc(count * sizeof(*ids));
+    const char* strings[4] = { "a", "b", "c", "d" };
+    for(size_t n = 0; n < count; n++) {
+        exprs[n] = bcalloc(128);
+        sprintf(exprs[n], "i > %zu and (j = %zu or s in (\"%s\", \"%s\"))", n % 100, n % 11, strings[n % 4], strings[(n + 1) % 4]);
+        ids[n] = n;
+        mu_assert(betree_insert(incremental, ids[n], exprs[n]), "");
+    }
+    mu_assert(betree_insert_all(bulk, count, ids, (const char**)exprs), "");
+    mu_assert(bulk->cnode->pdir != NULL, "bulk tree is partitioned");
+
+    for(size_t n = 0; n < 50; n++) {
+        char event[64];
+        sprintf(event, "{\"i\": %zu, \"j\": %zu, \"s\": \"%s\"}", (n * 7) % 101, n % 11, strings[n % 4]);
+        struct report* expected = make_report();
+        struct report* actual = make_report();
+        mu_assert(betree_search(incremental, event, expected), "");
+        mu_assert(betree_search(bulk, event, actual), "");
+        mu_assert(expected->matched == actual->matched, "same match count");
+        if(actual->matched != 0) {
+            qsort(expected->subs, expected->matched, sizeof(*expected->subs), sub_id_cmp);
+            qsort(actual->subs, actual->matched, sizeof(*actual->subs), sub_id_cmp);
+        }
+        for(size_t k = 0; k < actual->matched; k++) {
+            mu_assert(expected->subs[k] == actual->subs[k], "same subs matched");
+        }
+        free_report(expected);
+        free_report(actual);
+    }
+    mu_assert(betree_delete(bulk, 42), "bulk loaded subs are indexed");
+
+    const char* invalid[2] = { "i > 2", "k = 3" };
+    betree_sub_t invalid_ids[2] = { 1, 2 };
+    struct betree* empty = betree_make();
+    add_attr_domain_bounded_i(empty->config, "i", false, 0, 100);
+    mu_assert(!betree_insert_all(empty, 2, invalid_ids, invalid), "unknown variable");
+    mu_assert(empty->cnode->lnode->sub_count == 0 && empty->sub_index->count == 0, "nothing inserted");
+
+    for(size_t n = 0; n < count; n++) {
+        bfree(exprs[n]);
+    }
+    bfree(exprs);
+    bfree(ids);
+    betree_free(empty);
+    betree_free(incremental);
+    betree_free(bulk);
+    return 0;
+}
+
+struct each_matches {
+    size_t count;
+    size_t stop_after;
+    betree_sub_t ids[100];
+};
+
+static bool collect_match(betree_sub_t id, void* data)
+{
+    struct each_matches* matches = data;
+    matches->ids[matches->count++] = id;
+    return matches->count != matches->stop_after;
+}
+
+int test_search_each()
+{
+    struct betree* tree = betree_make();
+    betree_add_integer_variable(tree, "i", false, 0, 100);
+    char expr[64];
+    for(size_t id = 0; id < 100; id++) {
+        sprintf(expr, "i > %zu", id);
+        mu_assert(betree_insert(tree, id, expr), "");
+    }
+    const char* event = "{\"i\": 30}";
+    struct report* report = make_report();
+    mu_assert(betree_search(tree, event, report), "");
+
+    struct each_matches matches = { .count = 0, .stop_after = 0 };
+    mu_assert(betree_search_each(tree, event, collect_match, &matches), "");
+    mu_assert(matches.count == report->matched && report->matched == 30, "every match");
+    bool same = true;
+    for(size_t i = 0; i < matches.count; i++) {
+        same &= matches.ids[i] == report->subs[i];
+    }
+    mu_assert(same, "same order as search");
+
+    struct each_matches stopped = { .count = 0, .stop_after = 3 };
+    mu_assert(betree_search_each(tree, event, collect_match, &stopped), "");
+    mu_assert(stopped.count == 3, "stopped");
+
+    free_report(report);
+    betree_free(tree);
+    return 0;
+}
+
+static bool same_report(const struct report* a, const struct report* b)
+{
+    // Threads memoize on their own so only the memoized count can differ
+    if(a->matched != b->matched || a->evaluated != b->evaluated || a->shorted != b->shorted) {
+        return false;
+    }
+    for(size_t i = 0; i < a->matched; i++) {
+        if(a->subs[i] != b->subs[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int test_search_threads()
+{
+    struct betree* serial = betree_make();
+    struct betree* parallel = betree_make();
+    struct betree* trees[] = { serial, parallel };
+    for(size_t t = 0; t < 2; t++) {
+        betree_add_integer_variable(trees[t], "i", false, 0, 100);
+        betree_add_integer_variable(trees[t], "j", true, 0, 10);
+        betree_add_string_variable(trees[t], "s", true, 100);
+    }
+    betree_set_search_threads(parallel, 4);
+    char expr[128];
+    for(size_t id = 0; id < 5000; id++) {
+        sprintf(expr, "i > %zu and (contains(s, \"%c\") or j = %zu)", id % 100, (char)('a' + id % 26), id % 7);
+        mu_assert(betree_insert(serial, id, expr), "");
+        mu_assert(betree_insert(parallel, id, expr), "");
+    }
+    const char* events[] = {
+        "{\"i\": 50, \"s\": \"abc\", \"j\": 3}",
+        "{\"i\": 99, \"s\": \"the quick brown fox\"}",
+        "{\"i\": 10, \"j\": 0}",
+        "{\"i\": 0, \"s\": \"zzz\"}",
+    };
+    bool same = true;
+    for(size_t e = 0; e < sizeof(events) / sizeof(*events); e++) {
+        struct report* expected = make_report();
+        struct report* report = make_report();
+        mu_assert(betree_search(serial, events[e], expected), "");
+        mu_assert(betree_search(parallel, events[e], report), "");
+        same &= same_report(expected, report);
+        free_report(expected);
+        free_report(report);
+    }
+    mu_assert(same, "same results as one thread");
+
+    struct report* report = make_report();
+    mu_assert(betree_search(parallel, events[1], report), "");
+    mu_assert(report->matched > 1000, "enough candidates to spread");
+    free_report(report);
+
+    betree_free(serial);
+    betree_free(parallel);
+    return 0;
+}
+
+static int compare_sub_ids(const void* a, const void* b)
+{
+    betree_sub_t x = *(const betree_sub_t*)a;
+    betree_sub_t y = *(const betree_sub_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static bool same_matches(struct report* a, struct report* b)
+{
+    // Shards report in their own order
+    if(a->matched != b->matched) {
+        return false;
+    }
+    if(a->matched == 0) {
+        return true;
+    }
+    qsort(a->subs, a->matched, sizeof(*a->subs), compare_sub_ids);
+    qsort(b->subs, b->matched, sizeof(*b->subs), compare_sub_ids);
+    return memcmp(a->subs, b->subs, a->matched * sizeof(*a->subs)) == 0;
+}
+
+static struct betree* make_shard_schema()
+{
+    struct betree* tree = betree_make();
+    betree_add_integer_variable(tree, "i", false, 0, 100);
+    betree_add_integer_variable(tree, "c", true, 0, 50);
+    betree_add_string_variable(tree, "s", true, 10);
+    return tree;
+}
+
+int test_search_cursor()
+{
+    struct betree* tree = betree_make();
+    betree_add_integer_variable(tree, "i", false, 0, 100);
+    betree_add_integer_variable(tree, "j", true, 0, 10);
+    betree_add_string_variable(tree, "s", true, 100);
+    char expr[128];
+    for(size_t id = 0; id < 2000; id++) {
+        sprintf(expr, "i > %zu and (contains(s, \"%c\") or j = %zu)", id % 100, (char)('a' + id % 26), id % 7);
+        mu_assert(betree_insert(tree, id, expr), "");
+    }
+    const char* events[] = {
+        "{\"i\": 50, \"s\": \"abc\", \"j\": 3}",
+        "{\"i\": 99, \"s\": \"the quick brown fox\"}",
+        "{\"i\": 10, \"j\": 0}",
+    };
+    const size_t budgets[] = { 0, 1, 7, 500, SIZE_MAX };
+    struct betree_search_context* context = betree_make_search_context(tree);
+    bool same = true;
+    size_t small_steps = 0;
+    for(size_t indexed = 0; indexed < 2; indexed++) {
+        for(size_t e = 0; e < sizeof(events) / sizeof(*events); e++) {
+            struct report* expected = make_report();
+            mu_assert(betree_search(tree, events[e], expected), "");
+            for(size_t b = 0; b < sizeof(budgets) / sizeof(*budgets); b++) {
+                struct report* report = make_report();
+                struct betree_search_cursor* cursor = betree_make_search_cursor(tree, events[e], report, context);
+                mu_assert(cursor != NULL, "");
+                size_t steps = 1;
+                while(!betree_search_cursor_step(cursor, budgets[b])) {
+                    steps++;
+                }
+                betree_free_search_cursor(cursor);
+                same &= same_report(expected, report) && expected->matched != 0;
+                same &= budgets[b] != SIZE_MAX || steps == 1;
+                if(budgets[b] == 1) {
+                    small_steps += steps;
+                }
+                free_report(report);
+            }
+            free_report(expected);
+        }
+        betree_pack(tree);
+    }
+    mu_assert(same, "cursors find what searches find");
+    mu_assert(small_steps > 1000, "small budgets take many steps");
+
+    betree_set_prefilter(tree, true);
+    struct report* expected = make_report();
+    mu_assert(betree_search(tree, events[0], expected), "");
+    struct report* report = make_report();
+    struct betree_search_cursor* cursor = betree_make_search_cursor(tree, events[0], report, context);
+    while(!betree_search_cursor_step(cursor, 3)) {
+    }
+    betree_free_search_cursor(cursor);
+    mu_assert(same_report(expected, report), "cursors go through the postings");
+    free_report(expected);
+    free_report(report);
+
+    report = make_report();
+    mu_assert(betree_make_search_cursor(tree, "{\"j\": 3}", report, context) == NULL, "invalid event");
+    free_report(report);
+    betree_free_search_context(context);
+    betree_free(tree);
+    return 0;
+}
+
+int test_shards()
+{
+    struct betree* single = make_shard_schema();
+    struct betree_shards* by_id = betree_shards_make(make_shard_schema(), 4);
+    struct betree_shards* by_key = betree_shards_make(make_shard_schema(), 8);
+    mu_assert(by_id != NULL && by_key != NULL, "");
+    mu_assert(!betree_shards_set_key(by_key, "d"), "unknown key");
+    mu_assert(betree_shards_set_key(by_key, "c"), "");
+    betree_sub_t ids[2000];
+    char exprs[2000][96];
+    const char* expr_pointers[2000];
+    for(size_t id = 0; id < 2000; id++) {
+        switch(id % 3) {
+            case 0: sprintf(exprs[id], "i > %zu and c = %zu", id % 100, id % 50); break;
+            case 1: sprintf(exprs[id], "s = \"s%zu\" and i < %zu", id % 10, id % 100); break;
+            default: sprintf(exprs[id], "i = %zu or c = %zu", id % 100, id % 50); break;
+        }
+        ids[id] = id;
+        expr_pointers[id] = exprs[id];
+        mu_assert(betree_insert(single, id, exprs[id]), "");
+        mu_assert(betree_shards_insert(by_id, id, exprs[id]), "");
+    }
+    mu_assert(betree_shards_insert_all(by_key, 2000, ids, expr_pointers), "");
+    mu_assert(!betree_shards_insert(by_id, 5, "i = 1"), "duplicate id");
+    mu_assert(!betree_shards_insert_all(by_key, 1, ids, expr_pointers), "duplicate id");
+    mu_assert(betree_shards_delete(by_id, 7) && betree_shards_delete(by_key, 7) && betree_delete(single, 7), "");
+    mu_assert(!betree_shards_delete(by_key, 7), "already deleted");
+
+    const char* events[] = {
+        "{\"i\": 50, \"c\": 13, \"s\": \"s3\"}",
+        "{\"i\": 3, \"s\": \"s1\"}",
+        "{\"i\": 99, \"c\": 0}",
+    };
+    bool same = true;
+    for(size_t e = 0; e < sizeof(events) / sizeof(*events); e++) {
+        struct report* expected = make_report();
+        struct report* id_report = make_report();
+        struct report* key_report = make_report();
+        mu_assert(betree_search(single, events[e], expected), "");
+        mu_assert(betree_shards_search(by_id, events[e], id_report), "");
+        mu_assert(betree_shards_search(by_key, events[e], key_report), "");
+        same &= expected->matched != 0 && same_matches(expected, id_report) && same_matches(expected, key_report);
+        free_report(expected);
+        free_report(id_report);
+        free_report(key_report);
+    }
+    mu_assert(same, "same matches as one tree");
+
+    betree_free(single);
+    betree_shards_free(by_id);
+    betree_shards_free(by_key);
+    return 0;
+}
+
+static bool same_search(const struct betree* a, const struct betree* b, const char* event)
+{
+    struct report* expected = make_report();
+    struct report* report = make_report();
+    bool same = betree_search(a, event, expected) && betree_search(b, event, report)
+        && same_report(expected, report) && expected->memoized == report->memoized;
+    free_report(expected);
+    free_report(report);
+    return same;
+}
+
+// Special predicates read variables past i, a variable id lost on the way would read i instead
+static void add_special_variables(struct betree* tree)
+{
+    betree_add_integer_variable(tree, "i", false, 0, 100);
+    betree_add_segments_variable(tree, "seg", true);
+    betree_add_segments_variable(tree, "segments_with_timestamp", true);
+    betree_add_frequency_caps_variable(tree, "frequency_caps", true);
+    betree_add_integer_variable(tree, "now", false, INT64_MIN, INT64_MAX);
+    betree_add_float_variable(tree, "latitude", true, -90., 90.);
+    betree_add_float_variable(tree, "longitude", true, -180., 180.);
+}
+
+static const char* special_exprs[] = {
+    "not (segment_within(2, 3948))",
+    "segment_within(seg, 1, 20)",
+    "i > 50 and segment_before(seg, 3, 100)",
+    "geo_within_radius(10.0, 20.0, 100.0)",
+    "i < 30 or not geo_within_radius(10.0, 20.0, 500.0)",
+    "within_frequency_cap(\"flight\", \"ns\", 3, 0)",
+    "i > 20 and not within_frequency_cap(\"flight\", \"ns\", 1, 100)",
+};
+
+enum { special_sub_count = 70 };
+
+// Sub id gets special_exprs[id % 7], its frequency caps are of flight 1
+static bool insert_special_subs(struct betree* tree)
+{
+    const struct betree_constant* constants[] = { betree_make_integer_constant("flight_id", 1) };
+    bool inserted = true;
+    for(size_t id = 0; id < special_sub_count; id++) {
+        const char* expr = special_exprs[id % (sizeof(special_exprs) / sizeof(*special_exprs))];
+        inserted &= betree_insert_with_constants(tree, id, 1, constants, expr);
+    }
+    betree_free_constant((struct betree_constant*)constants[0]);
+    return inserted;
+}
+
+// An event around now for the special predicates, some of their variables undefined
+static void make_special_event(char* event)
+{
+    int64_t now = 5000 + rand() % 5000;
+    int n = sprintf(event, "{\"i\": %d, \"now\": %" PRId64, rand() % 100, now);
+    if(rand() % 4 != 0) {
+        n += sprintf(event + n, ", \"segments_with_timestamp\": [[2, %" PRId64 "]]", (now - rand() % 8000) * 1000000);
+    }
+    if(rand() % 4 != 0) {
+        n += sprintf(event + n, ", \"seg\": [[1, %" PRId64 "], [3, %" PRId64 "]]", (now - rand() % 40) * 1000000,
+            (now - rand() % 200) * 1000000);
+    }
+    if(rand() % 4 != 0) {
+        n += sprintf(event + n, ", \"frequency_caps\": [[[\"flight\", 1, \"ns\"], %d, %" PRId64 "]]", rand() % 5,
+            (now - rand() % 200) * 1000000);
+    }
+    if(rand() % 4 != 0) {
+        n += sprintf(event + n, ", \"latitude\": %.3f, \"longitude\": %.3f", 10. + (rand() % 40 - 20) / 10.,
+            20. + (rand() % 40 - 20) / 10.);
+    }
+    sprintf(event + n, "}");
+}
+
+static bool same_attr_var(struct attr_var a, struct attr_var b)
+{
+    return a.var == b.var && (a.attr == b.attr || (a.attr != NULL && b.attr != NULL && strcmp(a.attr, b.attr) == 0));
+}
+
+static bool same_string_value(struct string_value a, struct string_value b)
+{
+    return a.var == b.var && a.str == b.str && strcmp(a.string, b.string) == 0;
+}
+
+// Every field of the special predicates of a and b, expressions of the same shape
+static bool same_specials(const struct ast_node* a, const struct ast_node* b)
+{
+    if(a->type != b->type) {
+        return false;
+    }
+    if(a->type == AST_TYPE_BOOL_EXPR) {
+        switch(a->bool_expr.op) {
+            case AST_BOOL_OR:
+            case AST_BOOL_AND:
+                return same_specials(a->bool_expr.binary.lhs, b->bool_expr.binary.lhs)
+                    && same_specials(a->bool_expr.binary.rhs, b->bool_expr.binary.rhs);
+            case AST_BOOL_NOT: return same_specials(a->bool_expr.unary.expr, b->bool_expr.unary.expr);
+            case AST_BOOL_VARIABLE:
+            case AST_BOOL_LITERAL: return true;
+            default: abort();
+        }
+    }
+    if(a->type != AST_TYPE_SPECIAL_EXPR) {
+        return true;
+    }
+    const struct ast_special_expr* x = &a->special_expr;
+    const struct ast_special_expr* y = &b->special_expr;
+    if(x->type != y->type) {
+        return false;
+    }
+    switch(x->type) {
+        case AST_SPECIAL_FREQUENCY:
+            return x->frequency.op == y->frequency.op && same_attr_var(x->frequency.attr_var, y->frequency.attr_var)
+                && x->frequency.type == y->frequency.type && same_string_value(x->frequency.ns, y->frequency.ns)
+                && x->frequency.value == y->frequency.value && x->frequency.length == y->frequency.length
+                && same_attr_var(x->frequency.now, y->frequency.now) && x->frequency.id == y->frequency.id;
+        case AST_SPECIAL_SEGMENT:
+            return x->segment.op == y->segment.op && x->segment.has_variable == y->segment.has_variable
+                && same_attr_var(x->segment.attr_var, y->segment.attr_var)
+                && x->segment.segment_id == y->segment.segment_id && x->segment.seconds == y->segment.seconds
+                && same_attr_var(x->segment.now, y->segment.now);
+        case AST_SPECIAL_GEO:
+            return x->geo.op == y->geo.op && x->geo.has_radius == y->geo.has_radius
+                && feq(x->geo.latitude, y->geo.latitude) && feq(x->geo.longitude, y->geo.longitude)
+                && feq(x->geo.radius, y->geo.radius) && same_attr_var(x->geo.latitude_var, y->geo.latitude_var)
+                && same_attr_var(x->geo.longitude_var, y->geo.longitude_var)
+                && feq(x->geo.sin_latitude, y->geo.sin_latitude) && feq(x->geo.cos_latitude, y->geo.cos_latitude)
+                && feq(x->geo.latitude_span, y->geo.latitude_span)
+                && feq(x->geo.longitude_span, y->geo.longitude_span)
+                && feq(x->geo.chord_squared, y->geo.chord_squared);
+        case AST_SPECIAL_STRING:
+            return x->string.op == y->string.op && same_attr_var(x->string.attr_var, y->string.attr_var)
+                && strcmp(x->string.pattern, y->string.pattern) == 0;
+        default: abort();
+    }
+}
+
+int test_clone()
+{
+    struct betree* trees[] = { betree_make(), betree_make_with_arena(3, 3) };
+    const char* events[] = {
+        "{\"i\": 50, \"s\": \"abc\", \"j\": 3}",
+        "{\"i\": 99, \"s\": \"the quick brown fox\"}",
+        "{\"i\": 10, \"j\": 0}",
+    };
+    bool same = true;
+    for(size_t t = 0; t < 2; t++) {
+        struct betree* tree = trees[t];
+        betree_add_integer_variable(tree, "i", false, 0, 100);
+        betree_add_integer_variable(tree, "j", true, 0, 10);
+        betree_add_string_variable(tree, "s", true, 100);
+        char expr[128];
+        for(size_t id = 0; id < 1000; id++) {
+            sprintf(expr, "i > %zu and (contains(s, \"%c\") or j = %zu)", id % 100, (char)('a' + id % 26), id % 7);
+            mu_assert(betree_insert(tree, id, expr), "");
+        }
+        betree_set_priority(tree, 26, 42);
+        struct betree* clone = betree_clone(tree);
+        for(size_t e = 0; e < sizeof(events) / sizeof(*events); e++) {
+            same &= same_search(tree, clone, events[e]);
+        }
+        struct report* top = make_report();
+        mu_assert(betree_search_top(clone, events[0], 1, top), "");
+        same &= top->matched == 1 && top->subs[0] == 26;
+        free_report(top);
+
+        // Changes to the clone stay in the clone
+        mu_assert(betree_delete(clone, 26), "");
+        mu_assert(betree_insert(clone, 5000, "i = 50 and contains(s, \"bc\")"), "");
+        struct report* original = make_report();
+        struct report* changed = make_report();
+        mu_assert(betree_search(tree, events[0], original), "");
+        mu_assert(betree_search(clone, events[0], changed), "");
+        bool has_26 = false, has_5000 = false;
+        for(size_t i = 0; i < original->matched; i++) {
+            has_26 |= original->subs[i] == 26;
+            has_5000 |= original->subs[i] == 5000;
+        }
+        same &= has_26 && !has_5000;
+        has_26 = has_5000 = false;
+        for(size_t i = 0; i < changed->matched; i++) {
+            has_26 |= changed->subs[i] == 26;
+            has_5000 |= changed->subs[i] == 5000;
+        }
+        same &= !has_26 && has_5000 && changed->matched == original->matched;
+        free_report(original);
+        free_report(changed);
+
+        betree_free(tree);
+        betree_pack(clone);
+        struct report* report = make_report();
+        mu_assert(betree_search(clone, events[1], report), "");
+        same &= report->matched != 0;
+        free_report(report);
+        betree_free(clone);
+    }
+    mu_assert(same, "clone searches like the original");
+
+    // Special predicates keep every field, the variables they read included
+    struct betree* specials = betree_make();
+    add_special_variables(specials);
+    mu_assert(insert_special_subs(specials), "");
+    struct betree* clone = betree_clone(specials);
+    for(betree_sub_t id = 0; id < special_sub_count; id++) {
+        same &= same_specials(sub_index_find(specials->sub_index, id)->expr, sub_index_find(clone->sub_index, id)->expr);
+    }
+    betree_free(clone);
+    betree_free(specials);
+    mu_assert(same, "clone keeps every field of special predicates");
+    return 0;
+}
+
+/*
+ * Ways of searching a copy of a tree, each checked against the tree itself on the special predicates,
+ * whose variables are the fields copies lose most easily
+ */
+struct special_path {
+    // NULL when the copy can't be made
+    void* (*make)(struct betree* tree);
+    bool (*search)(void* copy, const char* event, struct report* report);
+    void (*free)(void* copy);
+};
+
+static void* make_clone_copy(struct betree* tree)
+{
+    return betree_clone(tree);
+}
+
+static bool search_tree_copy(void* copy, const char* event, struct report* report)
+{
+    return betree_search(copy, event, report);
+}
+
+static void free_tree_copy(void* copy)
+{
+    betree_free(copy);
+}
+
+struct live_copy {
+    struct betree_live* live;
+    struct betree_live_reader* reader;
+};
+
+static void free_live_copy(void* copy)
+{
+    struct live_copy* live_copy = copy;
+    betree_live_unregister(live_copy->reader);
+    betree_live_free(live_copy->live);
+    free(live_copy);
+}
+
+// Putting sub 0 back stages the next version on a copy of the first one
+static void* make_live_copy(struct betree* tree)
+{
+    struct live_copy* copy = malloc(sizeof(*copy));
+    copy->live = betree_live_make(betree_clone(tree));
+    copy->reader = betree_live_register(copy->live);
+    betree_sub_t id = 0;
+    const char* expr = special_exprs[0];
+    if(!betree_live_update(copy->live, 1, &id, 1, &id, &expr)) {
+        free_live_copy(copy);
+        return NULL;
+    }
+    return copy;
+}
+
+static bool search_live_copy(void* copy, const char* event, struct report* report)
+{
+    return betree_live_search(((struct live_copy*)copy)->reader, event, report);
+}
+
+static bool same_path_search(const struct betree* tree, const struct special_path* path, void* copy, const char* event, size_t* matched)
+{
+    struct report* expected = make_report();
+    struct report* report = make_report();
+    // Empty reports may have no subs array yet
+    bool same = betree_search(tree, event, expected) && path->search(copy, event, report)
+        && (expected->matched == 0 ? report->matched == 0 : same_matches(expected, report));
+    *matched += expected->matched;
+    free_report(expected);
+    free_report(report);
+    return same;
+}
+
+// The same subs on a tree with a parse cache, every text but the first of each gets a copy of the cached parse
+static void* make_cached_copy(struct betree* tree)
+{
+    (void)tree;
+    struct betree* copy = betree_make();
+    add_special_variables(copy);
+    betree_set_parse_cache(copy, 64);
+    size_t texts = sizeof(special_exprs) / sizeof(*special_exprs);
+    if(!insert_special_subs(copy) || copy->config->parse_cache->hits != special_sub_count - texts) {
+        betree_free(copy);
+        return NULL;
+    }
+    return copy;
+}
+
+static void* make_replicas_copy(struct betree* tree)
+{
+    return betree_replicas_make(tree);
+}
+
+// Through the replica of the node, false as well when another replica or the exists search disagrees
+static bool search_replicas_copy(void* copy, const char* event, struct report* report)
+{
+    const struct betree_replicas* replicas = copy;
+    if(!betree_replicas_search(replicas, event, report)) {
+        return false;
+    }
+    bool same = betree_replicas_exists(replicas, event) == (report->matched != 0);
+    for(size_t r = 0; r < betree_replicas_count(replicas); r++) {
+        struct report* replica_report = make_report();
+        same &= betree_search(betree_replicas_get(replicas, r), event, replica_report)
+            && (report->matched == 0 ? replica_report->matched == 0 : same_matches(report, replica_report));
+        free_report(replica_report);
+    }
+    return same;
+}
+
+static void free_replicas_copy(void* copy)
+{
+    betree_replicas_free(copy);
+}
+
+int test_special_paths()
+{
+    const struct special_path paths[] = {
+        { make_clone_copy, search_tree_copy, free_tree_copy },
+        { make_live_copy, search_live_copy, free_live_copy },
+        { make_cached_copy, search_tree_copy, free_tree_copy },
+        { make_replicas_copy, search_replicas_copy, free_replicas_copy },
+    };
+    struct betree* trees[] = { betree_make(), betree_make_with_arena(3, 3) };
+    bool same = true;
+    size_t matched = 0;
+    for(size_t t = 0; t < 2; t++) {
+        add_special_variables(trees[t]);
+        mu_assert(insert_special_subs(trees[t]), "");
+        for(size_t p = 0; p < sizeof(paths) / sizeof(*paths); p++) {
+            void* copy = paths[p].make(trees[t]);
+            mu_assert(copy != NULL, "copy made");
+            const char* segment = "{\"i\": 0, \"now\": 7071, \"segments_with_timestamp\": [[2, 9903000000]]}";
+            same &= same_path_search(trees[t], &paths[p], copy, segment, &matched);
+            srand(40);
+            for(size_t e = 0; e < 200; e++) {
+                char event[256];
+                make_special_event(event);
+                same &= same_path_search(trees[t], &paths[p], copy, event, &matched);
+            }
+            paths[p].free(copy);
+        }
+        betree_free(trees[t]);
+    }
+    mu_assert(matched != 0 && same, "every path matches special predicates like the tree");
+    return 0;
+}
+
+static int64_t test_priority(size_t id)
+{
+    return (int64_t)((id * 37) % 100);
+}
+
+int test_search_limit()
+{
+    struct betree* tree = betree_make();
+    betree_add_integer_variable(tree, "i", false, 0, 100);
+    char expr[64];
+    for(size_t id = 0; id < 100; id++) {
+        sprintf(expr, "i > %zu", id);
+        mu_assert(betree_insert(tree, id, expr), "");
+        mu_assert(betree_set_priority(tree, id, test_priority(id)), "");
+    }
+    mu_assert(!betree_set_priority(tree, 100, 1), "no such sub");
+    const char* event = "{\"i\": 50}";
+
+    struct report* all = make_report();
+    mu_assert(betree_search(tree, event, all), "");
+    mu_assert(all->matched == 50, "every match");
+
+    struct report* report = make_report();
+    mu_assert(betree_search_limit(tree, event, 10, report), "");
+    mu_assert(report->matched == 10, "limited");
+    mu_assert(report->evaluated < all->evaluated, "fewer evaluated");
+    bool below = true;
+    for(size_t i = 0; i < report->matched; i++) {
+        below &= report->subs[i] < 50;
+    }
+    mu_assert(below, "limited subs match");
+    free_report(report);
+
+    report = make_report();
+    mu_assert(betree_search_limit(tree, event, 80, report), "");
+    mu_assert(report->matched == 50, "limit above the matches");
+    free_report(report);
+
+    // Both snapshots and live copies keep the priorities
+    const char* path = "/tmp/betree_search_limit_test.bin";
+    mu_assert(betree_save(tree, path), "saved");
+    struct betree* loaded = betree_load(path);
+    mu_assert(loaded != NULL, "loaded");
+    struct betree* trees[] = { tree, loaded };
+    for(size_t t = 0; t < 2; t++) {
+        report = make_report();
+        mu_assert(betree_search_top(trees[t], event, 5, report), "");
+        mu_assert(report->matched == 5, "top count");
+        bool ranked = true;
+        for(size_t i = 0; i < report->matched; i++) {
+            // No matching sub left out has a higher priority, priorities are all different
+            size_t higher = 0;
+            for(size_t id = 0; id < 50; id++) {
+                higher += test_priority(id) > test_priority(report->subs[i]);
+            }
+            ranked &= report->subs[i] < 50 && higher == i;
+        }
+        mu_assert(ranked, "top by priority");
+        free_report(report);
+    }
+    remove(path);
+
+    free_report(all);
+    betree_free(loaded);
+    betree_free(tree);
+    return 0;
+}
+
+int test_snapshot()
+{
+    struct betree* tree = betree_make();
+    add_attr_domain_bounded_i(tree->config, "i", false, 0, 100);
+    add_attr_domain_f(tree->config, "f", true);
+    add_attr_domain_s(tree->config, "s", false);
+    add_attr_domain_bounded_il(tree->config, "il", true, 0, 10);
+    add_attr_domain_sl(tree->config, "sl", true);
+    add_attr_domain_f(tree->config, "latitude", true);
+    add_attr_domain_f(tree->config, "longitude", true);
+
+    size_t count = 500;
+    const char* strings[4] = { "a", "b", "c", "d" };
+    for(size_t n = 0; n < count; n++) {
+        char expr[256];
+        switch(n % 5) {
+            case 0:
+                sprintf(expr, "i > %zu and s = \"%s\"", n % 100, strings[n % 4]);
+                break;
+            case 1:
+                sprintf(expr, "not (f < %zu.5) or il none of (%zu, %zu)", n % 50, n % 10, (n + 3) % 10);
+                break;
+            case 2:
+                sprintf(expr, "\"%s\" in sl and i in (%zu, %zu)", strings[n % 4], n % 100, (n + 1) % 100);
+                break;
+            case 3:
+                sprintf(expr, "il is null or (i <> %zu and geo_within_radius(100.0, 100.0, 10.0))", n % 100);
+                break;
+            default:
+                sprintf(expr, "i = %zu or s not in (\"%s\")", n % 100, strings[n % 4]);
+                break;
+        }
+        mu_assert(betree_insert(tree, n, expr), "");
+    }
+
+    const char* path = "/tmp/betree_snapshot_test.bin";
+    mu_assert(betree_save(tree, path), "saved");
+    struct betree* loaded = betree_load(path);
+    mu_assert(loaded != NULL, "loaded");
+
+    for(size_t n = 0; n < 50; n++) {
+        char event[256];
+        sprintf(event, "{\"i\": %zu, \"f\": %zu.0, \"s\": \"%s\", \"il\": [%zu], \"sl\": [\"%s\"], "
+            "\"latitude\": 100.0, \"longitude\": 100.0}",
+            (n * 7) % 101, n, strings[n % 4], n % 10, strings[(n + 1) % 4]);
+        struct report* expected = make_report();
+        struct report* actual = make_report();
+        mu_assert(betree_search(tree, event, expected), "");
+        mu_assert(betree_search(loaded, event, actual), "");
+        mu_assert(expected->matched == actual->matched, "same match count");
+        mu_assert(expected->evaluated == actual->evaluated, "same tree shape");
+        for(size_t k = 0; k < actual->matched; k++) {
+            mu_assert(expected->subs[k] == actual->subs[k], "same subs matched");
+        }
+        free_report(expected);
+        free_report(actual);
+    }
+
+    // The loaded tree keeps working as a regular tree
+    mu_assert(betree_delete(loaded, 42), "subs are indexed");
+    mu_assert(betree_insert(loaded, 1000, "s = \"e\""), "strings keep their ids");
+    struct report* report = make_report();
+    mu_assert(betree_search(loaded, "{\"i\": 0, \"s\": \"e\"}", report), "");
+    bool found = false;
+    for(size_t k = 0; k < report->matched; k++) {
+        found = found || report->subs[k] == 1000;
+    }
+    mu_assert(found, "new sub matched");
+    free_report(report);
+
+    // Flip a byte in the payload, the checksum has to catch it
+    FILE* file = fopen(path, "r+b");
+    mu_assert(file != NULL, "");
+    fseek(file, -1, SEEK_END);
+    int last = fgetc(file);
+    fseek(file, -1, SEEK_END);
+    fputc(last ^ 0xFF, file);
+    fclose(file);
+    mu_assert(betree_load(path) == NULL, "corrupt snapshot rejected");
+    remove(path);
+    mu_assert(betree_load(path) == NULL, "missing snapshot rejected");
+
+    betree_free(loaded);
+    betree_free(tree);
+    return 0;
+}
+
+static size_t memory_sum(const struct betree_memory_stats* stats)
+{
+    return stats->tree.bytes + stats->attr_domains.bytes + stats->string_maps.bytes + stats->integer_maps.bytes
+        + stats->pred_map.bytes + stats->sub_index.bytes + stats->cnodes.bytes + stats->lnodes.bytes
+        + stats->pdirs.bytes + stats->pnodes.bytes + stats->cdirs.bytes + stats->subs.bytes + stats->ast.bytes
+        + stats->parse_cache.bytes + stats->result_cache.bytes;
+}
+
+int test_memory_stats()
+{
+    struct betree* trees[] = { betree_make(), betree_make_with_arena(3, 3) };
+    bool counted = true;
+    for(size_t t = 0; t < 2; t++) {
+        struct betree* tree = trees[t];
+        betree_add_integer_variable(tree, "i", false, 0, 100);
+        betree_add_integer_variable(tree, "j", true, 0, 10);
+        betree_add_string_variable(tree, "s", true, 100);
+        struct betree_memory_stats empty;
+        betree_memory_stats(tree, &empty);
+        counted &= empty.subs.count == 0 && empty.ast.count == 0 && empty.attr_domains.count == 3;
+
+        char expr[128];
+        for(size_t id = 0; id < 1000; id++) {
+            sprintf(expr, "i > %zu and (contains(s, \"%c\") or j = %zu)", id % 100, (char)('a' + id % 26), id % 7);
+            mu_assert(betree_insert(tree, id, expr), "");
+        }
+        struct betree_memory_stats full;
+        betree_memory_stats(tree, &full);
+        counted &= full.subs.count == 1000 && full.sub_index.count == 1000;
+        counted &= full.total_bytes == memory_sum(&full) && full.total_bytes > empty.total_bytes;
+        counted &= full.ast.count != 0 && full.ast.count == full.pred_map.count;
+        counted &= full.lnodes.count == full.cnodes.count && full.cdirs.count != 0;
+
+        // Same expression, its nodes are shared and counted once
+        mu_assert(betree_insert(tree, 1000, expr), "");
+        struct betree_memory_stats again;
+        betree_memory_stats(tree, &again);
+        counted &= again.subs.count == 1001 && again.ast.count == full.ast.count;
+        counted &= again.subs.bytes > full.subs.bytes && again.ast.bytes == full.ast.bytes;
+
+        for(size_t id = 0; id <= 1000; id += 2) {
+            mu_assert(betree_delete(tree, id), "");
+        }
+        struct betree_memory_stats deleted;
+        betree_memory_stats(tree, &deleted);
+        counted &= deleted.subs.count == 500 && deleted.subs.bytes < again.subs.bytes;
+        counted &= deleted.total_bytes < again.total_bytes;
+        betree_free(tree);
+    }
+    mu_assert(counted, "memory stats follow the tree");
+    return 0;
+}
+
+int test_params()
+{
+    mu_assert(betree_make_with_parameters(0, 0) == NULL, "empty lnodes rejected");
+    mu_assert(betree_make_with_parameters((uint64_t)UINT32_MAX + 1, 0) == NULL, "wide cap rejected");
+    mu_assert(betree_make_with_arena(3, (uint64_t)UINT32_MAX + 1) == NULL, "wide min size rejected");
+    struct betree_params defaults = betree_default_params();
+    mu_assert(defaults.lnode_max_cap == 3 && defaults.partition_min_size == 0
+            && defaults.max_domain_for_split == 1000,
+        "defaults");
+    struct betree_params empty = { .lnode_max_cap = 0 };
+    mu_assert(betree_make_with_params(&empty) == NULL, "empty lnodes rejected");
+
+    // Wider than the uint8_t the config used to hold
+    struct betree_params wide = { .lnode_max_cap = 1000, .partition_min_size = 300, .max_domain_for_split = 5000 };
+    struct betree* tree = betree_make_with_params(&wide);
+    struct betree* plain = betree_make();
+    struct betree* trees[2] = { tree, plain };
+    char expr[64];
+    for(size_t t = 0; t < 2; t++) {
+        betree_add_integer_variable(trees[t], "i", false, 0, 2000);
+        for(size_t id = 0; id < 900; id++) {
+            sprintf(expr, "i > %zu", id * 2);
+            mu_assert(betree_insert(trees[t], id, expr), "");
+        }
+    }
+    struct betree_params loaded_params = betree_get_params(tree);
+    mu_assert(loaded_params.lnode_max_cap == 1000 && loaded_params.max_domain_for_split == 5000, "kept");
+    mu_assert(tree->cnode->lnode->sub_count == 900 && tree->cnode->pdir == NULL, "fits one lnode");
+    mu_assert(!betree_set_params(tree, &defaults), "set once the tree has subs");
+
+    const char* path = "/tmp/betree_params_test.bin";
+    mu_assert(betree_save(tree, path), "saved");
+    struct betree* loaded = betree_load(path);
+    loaded_params = betree_get_params(loaded);
+    mu_assert(loaded_params.lnode_max_cap == 1000 && loaded_params.partition_min_size == 300
+            && loaded_params.max_domain_for_split == 5000,
+        "snapshot keeps the params");
+    remove(path);
+
+    const char* events[] = { "{\"i\": 0}", "{\"i\": 901}", "{\"i\": 2000}" };
+    bool same = true;
+    for(size_t i = 0; i < 3; i++) {
+        struct report* a = make_report();
+        struct report* b = make_report();
+        struct report* c = make_report();
+        mu_assert(betree_search(tree, events[i], a), "");
+        mu_assert(betree_search(plain, events[i], b), "");
+        mu_assert(betree_search(loaded, events[i], c), "");
+        same &= same_matches(a, b) && same_matches(a, c);
+        free_report(a);
+        free_report(b);
+        free_report(c);
+    }
+    mu_assert(same, "params don't change matches");
+    betree_free(loaded);
+    betree_free(plain);
+    betree_free(tree);
+
+    struct betree* schema = betree_make();
+    betree_add_integer_variable(schema, "i", false, 0, 100);
+    betree_add_string_variable(schema, "s", true, 100);
+    char exprs_buffer[300][64];
+    const char* exprs[300];
+    for(size_t id = 0; id < 300; id++) {
+        sprintf(exprs_buffer[id], "i > %zu and s = \"%c\"", id % 100, (char)('a' + id % 26));
+        exprs[id] = exprs_buffer[id];
+    }
+    const char* sample[] = { "{\"i\": 50, \"s\": \"c\"}", "{\"i\": 7}", "{\"i\": 99, \"s\": \"z\"}" };
+    struct betree_params tuned;
+    mu_assert(betree_tune_params(schema, 300, exprs, 3, sample, &tuned), "tuned");
+    mu_assert(tuned.lnode_max_cap >= 4 && tuned.lnode_max_cap <= 512, "a candidate");
+    mu_assert(betree_set_params(schema, &tuned), "applies to an empty tree");
+    struct betree_params applied = betree_get_params(schema);
+    mu_assert(applied.lnode_max_cap == tuned.lnode_max_cap
+            && applied.max_domain_for_split == tuned.max_domain_for_split,
+        "applied");
+    const char* bad_events[] = { "{\"s\": \"a\"}" };
+    mu_assert(!betree_tune_params(schema, 300, exprs, 1, bad_events, &tuned), "bad event");
+    const char* bad_exprs[] = { "j > 1" };
+    mu_assert(!betree_tune_params(schema, 1, bad_exprs, 3, sample, &tuned), "bad expression");
+    struct betree* untuned = betree_make();
+    betree_add_integer_variable(untuned, "i", false, 0, 100);
+    betree_add_string_variable(untuned, "s", true, 100);
+    for(size_t id = 0; id < 300; id++) {
+        mu_assert(betree_insert(schema, id, exprs[id]), "");
+        mu_assert(betree_insert(untuned, id, exprs[id]), "");
+    }
+    same = true;
+    for(size_t i = 0; i < 3; i++) {
+        struct report* a = make_report();
+        struct report* b = make_report();
+        mu_assert(betree_search(schema, sample[i], a), "");
+        mu_assert(betree_search(untuned, sample[i], b), "");
+        same &= same_matches(a, b);
+        free_report(a);
+        free_report(b);
+    }
+    mu_assert(same, "tuned tree matches the same subs");
+    betree_free(untuned);
+    betree_free(schema);
+    return 0;
+}
+
+int test_parse_cache()
+{
+    struct betree* trees[3] = { betree_make(), betree_make(), betree_make_with_arena(3, 0) };
+    betree_set_parse_cache(trees[1], 64);
+    betree_set_parse_cache(trees[2], 64);
+    const char* capped = "i > 10 and within_frequency_cap(\"flight\", \"ns\", 5, 0)";
+    for(size_t t = 0; t < 3; t++) {
+        struct betree* tree = trees[t];
+        betree_add_integer_variable(tree, "i", false, 0, 100);
+        betree_add_frequency_caps_variable(tree, "frequency_caps", false);
+        betree_add_integer_variable(tree, "now", false, INT64_MIN, INT64_MAX);
+        // Invalid until j is added, the parse with the unknown variable is not kept
+        mu_assert(!betree_insert(tree, 0, "j = 1"), "unknown variable");
+        betree_add_integer_variable(tree, "j", true, 0, 10);
+        mu_assert(betree_insert(tree, 0, "j = 1"), "");
+        // Same text, the constants still differ
+        for(size_t id = 1; id <= 20; id++) {
+            const struct betree_constant* constants[1] = { betree_make_integer_constant("flight_id", id % 2) };
+            mu_assert(betree_insert_with_constants(tree, id, 1, constants, capped), "");
+            betree_free_constant((struct betree_constant*)constants[0]);
+        }
+        betree_sub_t ids[5000];
+        char exprs_buffer[5000][32];
+        const char* exprs[5000];
+        for(size_t i = 0; i < 5000; i++) {
+            ids[i] = 100 + i;
+            sprintf(exprs_buffer[i], "i = %zu or j = %zu", i % 7, i % 3);
+            exprs[i] = exprs_buffer[i];
+        }
+        mu_assert(betree_insert_all(tree, 5000, ids, exprs), "");
+        mu_assert(betree_insert(tree, 6000, "i = 50"), "");
+    }
+    const struct parse_cache* cache = trees[1]->config->parse_cache;
+    // Every valid text is parsed once
+    mu_assert(cache->count == 24 && cache->hits == 19 + 5000 - 21, "repeated texts hit");
+    mu_assert(trees[0]->config->parse_cache == NULL, "off by default");
+
+    const char* events[] = {
+        "{\"i\": 50, \"j\": 1, \"now\": 0, \"frequency_caps\": [[[\"flight\", 1, \"ns\"], 10, 0]]}",
+        "{\"i\": 3, \"j\": 2, \"now\": 0, \"frequency_caps\": [[[\"flight\", 0, \"ns\"], 10, 0]]}",
+        "{\"i\": 20, \"now\": 0, \"frequency_caps\": []}",
+    };
+    bool same = true;
+    for(size_t i = 0; i < 3; i++) {
+        struct report* reports[3];
+        for(size_t t = 0; t < 3; t++) {
+            reports[t] = make_report();
+            mu_assert(betree_search(trees[t], events[i], reports[t]), "");
+        }
+        same &= reports[0]->matched != 0 && same_matches(reports[0], reports[1]) && same_matches(reports[0], reports[2]);
+        for(size_t t = 0; t < 3; t++) {
+            free_report(reports[t]);
+        }
+    }
+    mu_assert(same, "cached parses match the same subs");
+    struct report* report = make_report();
+    mu_assert(betree_search(trees[1], events[0], report), "");
+    // Half of the capped subs are for the flight over its cap
+    mu_assert(report->matched == 1 + 1 + 1667 + 10, "constants assigned per sub");
+    free_report(report);
+
+    struct betree_memory_stats stats;
+    betree_memory_stats(trees[1], &stats);
+    mu_assert(stats.parse_cache.count == cache->count && stats.parse_cache.bytes != 0, "cache measured");
+    mu_assert(stats.total_bytes == memory_sum(&stats), "in the total");
+    betree_set_parse_cache(trees[1], 0);
+    mu_assert(trees[1]->config->parse_cache == NULL, "dropped");
+    for(size_t t = 0; t < 3; t++) {
+        betree_free(trees[t]);
+    }
+    return 0;
+}
+
+int test_result_cache()
+{
+    struct betree* trees[3] = { betree_make(), betree_make(), betree_make_with_arena(3, 0) };
+    betree_set_result_cache(trees[1], 64, 0);
+    betree_set_result_cache(trees[2], 64, 100);
+    for(size_t t = 0; t < 3; t++) {
+        struct betree* tree = trees[t];
+        betree_add_integer_variable(tree, "i", false, 0, 100);
+        betree_add_string_variable(tree, "s", true, 100);
+        // No sub uses u
+        betree_add_integer_variable(tree, "u", true, 0, 100);
+        betree_add_segments_variable(tree, "seg", true);
+        betree_add_integer_variable(tree, "now", false, INT64_MIN, INT64_MAX);
+        for(size_t id = 0; id < 50; id++) {
+            char expr[64];
+            sprintf(expr, "i = %zu or s = \"s%zu\"", id % 10, id % 5);
+            mu_assert(betree_insert(tree, id, expr), "");
+        }
+        mu_assert(betree_insert(tree, 50, "segment_within(seg, 3, 20)"), "");
+    }
+    mu_assert(trees[0]->config->result_cache == NULL, "off by default");
+
+    const char* events[] = {
+        "{\"i\": 1, \"s\": \"s2\", \"u\": 1, \"now\": 1010, \"seg\": [[3, 1000000000]]}",
+        "{\"i\": 4, \"now\": 1010}",
+        // Only u and now within the bucket differ from the first
+        "{\"i\": 1, \"s\": \"s2\", \"u\": 9, \"now\": 1030, \"seg\": [[3, 1000000000]]}",
+        "{\"i\": 1, \"s\": \"s2\", \"now\": 1010, \"seg\": [[3, 1000000000]]}",
+        "{\"i\": 4, \"now\": 1010}",
+    };
+    bool same = true;
+    for(size_t i = 0; i < 5; i++) {
+        struct report* reports[3];
+        for(size_t t = 0; t < 3; t++) {
+            reports[t] = make_report();
+            mu_assert(betree_search(trees[t], events[i], reports[t]), "");
+        }
+        if(i == 2) {
+            // Matches of the first event of the bucket, when seg was still recent enough
+            same &= reports[0]->matched + 1 == reports[2]->matched && same_matches(reports[0], reports[1]);
+        }
+        else {
+            same &= reports[0]->matched != 0 && same_matches(reports[0], reports[1])
+                && same_matches(reports[0], reports[2]);
+        }
+        for(size_t t = 0; t < 3; t++) {
+            free_report(reports[t]);
+        }
+    }
+    mu_assert(same, "cached matches are the searched ones");
+    const struct result_cache* cache = trees[1]->config->result_cache;
+    mu_assert(cache->count == 3 && cache->hits == 2 && cache->misses == 3, "exact now");
+    cache = trees[2]->config->result_cache;
+    mu_assert(cache->count == 2 && cache->hits == 3 && cache->misses == 2, "now rounded down");
+
+    struct betree_memory_stats stats;
+    betree_memory_stats(trees[1], &stats);
+    mu_assert(stats.result_cache.count == 3 && stats.result_cache.bytes != 0, "cache measured");
+    mu_assert(stats.total_bytes == memory_sum(&stats), "in the total");
+
+    // Inserting or deleting drops the matches kept
+    bool dropped = true;
+    for(size_t t = 0; t < 3; t++) {
+        mu_assert(betree_insert(trees[t], 100, "u = 1"), "");
+        dropped &= t == 0 || trees[t]->config->result_cache->count == 0;
+    }
+    struct report* reports[3];
+    for(size_t t = 0; t < 3; t++) {
+        reports[t] = make_report();
+        mu_assert(betree_search(trees[t], events[0], reports[t]), "");
+    }
+    same = same_matches(reports[0], reports[1]) && same_matches(reports[0], reports[2]);
+    bool found = false;
+    for(size_t i = 0; i < reports[1]->matched; i++) {
+        found |= reports[1]->subs[i] == 100;
+    }
+    for(size_t t = 0; t < 3; t++) {
+        free_report(reports[t]);
+    }
+    mu_assert(same && found, "u in the keys once a sub uses it");
+    for(size_t t = 0; t < 3; t++) {
+        mu_assert(betree_delete(trees[t], 100), "");
+        dropped &= t == 0 || trees[t]->config->result_cache->count == 0;
+        reports[t] = make_report();
+        mu_assert(betree_search(trees[t], events[0], reports[t]), "");
+    }
+    same = same_matches(reports[0], reports[1]) && same_matches(reports[0], reports[2]);
+    for(size_t t = 0; t < 3; t++) {
+        free_report(reports[t]);
+    }
+    mu_assert(dropped && same, "invalidated");
+
+    betree_set_result_cache(trees[1], 0, 0);
+    mu_assert(trees[1]->config->result_cache == NULL, "dropped");
+    for(size_t t = 0; t < 3; t++) {
+        betree_free(trees[t]);
+    }
+    return 0;
+}
+
+int test_prepared_event()
+{
+    struct betree* tree = betree_make();
+    betree_add_integer_variable(tree, "i", false, 0, 100);
+    betree_add_string_variable(tree, "s", true, 100);
+    betree_add_string_list_variable(tree, "sl", true, 100);
+    betree_add_integer_list_variable(tree, "il", true, 0, 100);
+    char expr[128];
+    for(size_t id = 0; id < 200; id++) {
+        sprintf(expr, "i > %zu and (s = \"%c\" or \"%c\" in sl or %zu in il)", id % 50, (char)('a' + id % 5),
+            (char)('a' + id % 7), id % 11);
+        mu_assert(betree_insert(tree, id, expr), "");
+    }
+    const char* event = "{\"i\": 30, \"s\": \"new\", \"sl\": [\"f\", \"b\", \"b\"], \"il\": [7, 3, 7]}";
+    struct betree_prepared_event* prepared = betree_prepare_event(tree, event);
+    struct betree_search_context* context = betree_make_search_context(tree);
+    struct report* expected = make_report();
+    struct report* report = make_report();
+    mu_assert(betree_search(tree, event, expected), "");
+    bool same = expected->matched != 0;
+    for(size_t i = 0; i < 2; i++) {
+        betree_report_reset(report);
+        mu_assert(betree_search_prepared(tree, prepared, report, context), "");
+        same &= same_matches(expected, report);
+    }
+    mu_assert(same, "prepared once, searched twice");
+
+    // Subs without new strings keep the ids the event was prepared with
+    mu_assert(betree_insert(tree, 200, "i = 30"), "");
+    uint64_t stamp = tree->config->ids_stamp;
+    struct betree* clone = betree_clone(tree);
+    mu_assert(clone->config->ids_stamp == stamp, "copies share the ids");
+    free_report(expected);
+    expected = make_report();
+    betree_report_reset(report);
+    mu_assert(betree_search(clone, event, expected), "");
+    mu_assert(betree_search_prepared(clone, prepared, report, context), "");
+    mu_assert(same_matches(expected, report) && report->matched > 1, "searched on a copy");
+
+    // A string unknown when the event was prepared now has an id, the event is read again
+    mu_assert(betree_insert(clone, 201, "s = \"new\""), "");
+    mu_assert(clone->config->ids_stamp != stamp && tree->config->ids_stamp == stamp, "ids changed");
+    free_report(expected);
+    expected = make_report();
+    betree_report_reset(report);
+    mu_assert(betree_search(clone, event, expected), "");
+    mu_assert(betree_search_prepared(clone, prepared, report, context), "");
+    bool found = false;
+    for(size_t i = 0; i < report->matched; i++) {
+        found |= report->subs[i] == 201;
+    }
+    mu_assert(found && same_matches(expected, report), "stale ids not used");
+    betree_free_prepared_event(prepared);
+
+    prepared = betree_prepare_event(tree, "{\"s\": \"a\"}");
+    betree_report_reset(report);
+    mu_assert(!betree_search_prepared(tree, prepared, report, context), "invalid event");
+    betree_free_prepared_event(prepared);
+    free_report(expected);
+    free_report(report);
+    betree_free_search_context(context);
+    betree_free(clone);
+    betree_free(tree);
+    return 0;
+}
+
+int test_reorder_expressions()
+{
+    struct betree* plain = betree_make();
+    struct betree* reordered = betree_make();
+    betree_set_reorder_expressions(reordered, true);
+    struct betree* trees[2] = { plain, reordered };
+    for(size_t t = 0; t < 2; t++) {
+        add_attr_domain_bounded_i(trees[t]->config, "i", false, 0, 100);
+        add_attr_domain_bounded_il(trees[t]->config, "il", true, 0, 10);
+        add_attr_domain_b(trees[t]->config, "b", true);
+    }
+
+    // The inequality almost always passes so the disjunction, which fails half the time, goes first
+    mu_assert(betree_insert(reordered, 0, "i <> 1 and (il one of (1, 2, 3) and i = 2 or b)"), "");
+    const struct ast_node* root = reordered->cnode->lnode->subs[0]->expr;
+    const struct ast_node* disjunction = root->bool_expr.binary.lhs;
+    mu_assert(disjunction->type == AST_TYPE_BOOL_EXPR && disjunction->bool_expr.op == AST_BOOL_OR, "or first");
+    mu_assert(root->bool_expr.binary.rhs->type == AST_TYPE_EQUALITY_EXPR, "inequality last");
+    mu_assert(disjunction->bool_expr.binary.lhs->bool_expr.op == AST_BOOL_VARIABLE, "variable first in or");
+    const struct ast_node* conjunction = disjunction->bool_expr.binary.rhs;
+    mu_assert(conjunction->bool_expr.binary.lhs->type == AST_TYPE_EQUALITY_EXPR, "equality before list");
+    mu_assert(betree_insert(plain, 0, "i <> 1 and (il one of (1, 2, 3) and i = 2 or b)"), "");
+
+    for(size_t n = 1; n < 300; n++) {
+        char expr[256];
+        sprintf(expr, "(i <> %zu or b) and il none of (%zu, %zu) and (i = %zu or (i > %zu and not b))",
+            n % 100, n % 10, (n + 5) % 10, n % 100, n % 50);
+        mu_assert(betree_insert(plain, n, expr), "");
+        mu_assert(betree_insert(reordered, n, expr), "");
+    }
+    for(size_t n = 0; n < 100; n++) {
+        char event[128];
+        sprintf(event, "{\"i\": %zu, \"il\": [%zu], \"b\": %s}", n, n % 10, n % 3 == 0 ? "true" : "false");
+        struct report* expected = make_report();
+        struct report* actual = make_report();
+        mu_assert(betree_search(plain, event, expected), "");
+        mu_assert(betree_search(reordered, event, actual), "");
+        mu_assert(expected->matched == actual->matched, "same match count");
+        for(size_t k = 0; k < actual->matched; k++) {
+            mu_assert(expected->subs[k] == actual->subs[k], "same subs matched");
+        }
+        free_report(expected);
+        free_report(actual);
+    }
+
+    betree_free(plain);
+    betree_free(reordered);
+    return 0;
+}
+
+int test_arena()
+{
+    struct betree* heap = betree_make_with_parameters(3, 0);
+    struct betree* arena = betree_make_with_arena(3, 0);
+    struct betree* trees[2] = { heap, arena };
+    for(size_t t = 0; t < 2; t++) {
+        betree_add_integer_variable(trees[t], "i", false, 0, 100);
+        betree_add_string_variable(trees[t], "s", true, 10);
+        betree_add_integer_list_variable(trees[t], "il", true, 0, 10);
+    }
+
+    const char* strings[4] = { "a", "b", "c", "d" };
+    size_t count = 2000;
+    char** exprs = bcalloc(count * sizeof(*exprs));
+    betree_sub_t* ids = bcalloc(count * sizeof(*ids));
+    for(size_t n = 0; n < count; n++) {
+        exprs[n] = bcalloc(128);
+        sprintf(exprs[n], "i > %zu and (s = \"%s\" or il one of (%zu, %zu))", n % 100, strings[n % 4], n % 10, (n + 1) % 10);
+        ids[n] = n;
+        mu_assert(betree_insert(heap, ids[n], exprs[n]), "");
+        if(n < count / 2) {
+            mu_assert(betree_insert(arena, ids[n], exprs[n]), "");
+        }
+    }
+    mu_assert(betree_insert_all(arena, count / 2, ids + count / 2, (const char**)exprs + count / 2), "");
+    for(size_t n = 0; n < count; n += 3) {
+        mu_assert(betree_delete(heap, n), "");
+        mu_assert(betree_delete(arena, n), "");
+    }
+    // Reinsert into blocks the deletes put back on the free lists
+    for(size_t n = 0; n < count; n += 6) {
+        mu_assert(betree_insert(heap, n, exprs[n]), "");
+        mu_assert(betree_insert(arena, n, exprs[n]), "");
+    }
+
+    for(size_t n = 0; n < 50; n++) {
+        char event[128];
+        sprintf(event, "{\"i\": %zu, \"s\": \"%s\", \"il\": [%zu]}", (n * 7) % 101, strings[n % 4], n % 10);
+        struct report* expected = make_report();
+        struct report* actual = make_report();
+        mu_assert(betree_search(heap, event, expected), "");
+        mu_assert(betree_search(arena, event, actual), "");
+        mu_assert(expected->matched == actual->matched, "same match count");
+        if(actual->matched != 0) {
+            qsort(expected->subs, expected->matched, sizeof(*expected->subs), sub_id_cmp);
+            qsort(actual->subs, actual->matched, sizeof(*actual->subs), sub_id_cmp);
+        }
+        for(size_t k = 0; k < actual->matched; k++) {
+            mu_assert(expected->subs[k] == actual->subs[k], "same subs matched");
+        }
+        free_report(expected);
+        free_report(actual);
+    }
+
+    for(size_t n = 0; n < count; n++) {
+        bfree(exprs[n]);
+    }
+    bfree(exprs);
+    bfree(ids);
+    betree_free(heap);
+    betree_free(arena);
+    return 0;
+}
+
+int test_binary_event()
+{
+    struct betree* tree = betree_make();
+    betree_add_integer_variable(tree, "i", false, 0, 100);
+    betree_add_string_variable(tree, "s", true, 10);
+    betree_add_integer_list_variable(tree, "il", true, 0, 100);
+    betree_add_string_list_variable(tree, "sl", true, 10);
+    betree_add_integer_enum_variable(tree, "e", true, 10);
+    betree_add_boolean_variable(tree, "b", true);
+    mu_assert(betree_insert(tree, 0, "i > 10 and s = \"a\""), "");
+    mu_assert(betree_insert(tree, 1, "il one of (3, 4) and \"y\" in sl"), "");
+    mu_assert(betree_insert(tree, 2, "e = 7 and b"), "");
+    mu_assert(betree_insert(tree, 3, "i < 5 or s = \"b\""), "");
+    mu_assert(betree_insert(tree, 4, "starts_with(s, \"ab\")"), "");
+
+    size_t i = betree_get_variable_index(tree, "i");
+    size_t s = betree_get_variable_index(tree, "s");
+    size_t il = betree_get_variable_index(tree, "il");
+    size_t sl = betree_get_variable_index(tree, "sl");
+    size_t e = betree_get_variable_index(tree, "e");
+    size_t b = betree_get_variable_index(tree, "b");
+    mu_assert(betree_get_variable_index(tree, "missing") == SIZE_MAX, "");
+    mu_assert(betree_get_string_id(tree, s, "never") == BETREE_UNKNOWN_ID, "");
+
+    size_t size = betree_binary_event_size(6, 4);
+    void* buffer = bcalloc(size);
+    struct betree_binary_event* event = betree_binary_event_init(tree, buffer, size);
+    mu_assert(event != NULL, "");
+    mu_assert(betree_binary_event_add_integer(event, i, 20), "");
+    mu_assert(!betree_binary_event_add_integer(event, s, 20), "wrong type");
+    mu_assert(betree_binary_event_add_string(event, s, betree_get_string_id(tree, s, "abc"), "abc"), "");
+    const int64_t integers[2] = { 1, 3 };
+    mu_assert(betree_binary_event_add_integer_list(event, il, 2, integers), "");
+    uint64_t ids[2] = { betree_get_string_id(tree, sl, "y"), betree_get_string_id(tree, sl, "z") };
+    mu_assert(betree_binary_event_add_string_list(event, sl, 2, ids, NULL), "");
+    mu_assert(betree_binary_event_add_integer_enum(event, e, betree_get_integer_enum_id(tree, e, 7), 7), "");
+    mu_assert(betree_binary_event_add_boolean(event, b, true), "");
+
+    // Same event through the parser
+    struct report* expected = make_report();
+    mu_assert(betree_search(tree,
+        "{\"i\": 20, \"s\": \"abc\", \"il\": [1, 3], \"sl\": [\"y\", \"z\"], \"e\": 7, \"b\": true}",
+        expected), "");
+    struct report* report = make_report();
+    mu_assert(betree_search_binary_event(tree, event, report), "");
+    mu_assert(report->matched == 3 && report->matched == expected->matched, "same matches as the parsed event");
+    qsort(report->subs, report->matched, sizeof(*report->subs), sub_id_cmp);
+    mu_assert(report->subs[0] == 1 && report->subs[1] == 2 && report->subs[2] == 4, "");
+
+    // Reused for another event
+    betree_binary_event_clear(event);
+    mu_assert(betree_binary_event_add_integer(event, i, 3), "");
+    betree_report_reset(report);
+    mu_assert(betree_search_binary_event(tree, event, report), "");
+    mu_assert(report->matched == 1 && report->subs[0] == 3, "");
+
+    betree_binary_event_clear(event);
+    betree_report_reset(report);
+    mu_assert(!betree_search_binary_event(tree, event, report), "i is not optional");
+
+    struct betree* other = betree_make();
+    betree_add_integer_variable(other, "i", false, 0, 100);
+    mu_assert(betree_binary_event_add_integer(event, i, 3), "");
+    mu_assert(!betree_search_binary_event(other, event, report), "built for another tree");
+
+    char small[64] __attribute__((aligned(16)));
+    struct betree_binary_event* full = betree_binary_event_init(tree, small, sizeof(small));
+    mu_assert(full != NULL && !betree_binary_event_add_integer_list(full, il, 2, integers), "buffer full");
+
+    free_report(expected);
+    free_report(report);
+    bfree(buffer);
+    betree_free(other);
+    betree_free(tree);
+    return 0;
+}
+
+struct live_search_job {
+    struct betree_live* live;
+    size_t iterations;
+    bool valid;
+};
+
+static void* live_search_thread(void* arg)
+{
+    struct live_search_job* job = arg;
+    struct betree_live_reader* reader = betree_live_register(job->live);
+    struct report* report = make_report();
+    for(size_t n = 0; n < job->iterations; n++) {
+        betree_report_reset(report);
+        char event[64];
+        sprintf(event, "{\"i\": %zu}", n % 100);
+        // Each version holds every id with the same parity, never a mix
+        if(!betree_live_search(reader, event, report)) {
+            job->valid = false;
+        }
+        for(size_t k = 1; k < report->matched; k++) {
+            if(report->subs[k] % 2 != report->subs[0] % 2) {
+                job->valid = false;
+            }
+        }
+    }
+    free_report(report);
+    betree_live_unregister(reader);
+    return NULL;
+}
+
+int test_replicas()
+{
+    // Plain against huge pages, whose clones keep them
+    struct betree* trees[2] = { betree_make_with_parameters(3, 0), betree_make_with_huge_pages(3, 0) };
+    for(size_t t = 0; t < 2; t++) {
+        betree_add_integer_variable(trees[t], "i", false, 0, 100);
+        betree_add_string_variable(trees[t], "s", true, 10);
+        for(size_t id = 0; id < 3000; id++) {
+            char expr[64];
+            sprintf(expr, "i > %zu and s = \"s%zu\"", id % 100, id % 10);
+            mu_assert(betree_insert(trees[t], id, expr), "");
+        }
+    }
+    struct betree* clone = betree_clone(trees[1]);
+    struct betree_replicas* replicas = betree_replicas_make(trees[0]);
+    size_t count = betree_replicas_count(replicas);
+    bool local = false;
+    for(size_t r = 0; r < count; r++) {
+        local |= betree_replicas_get(replicas, r) == betree_replicas_local(replicas);
+    }
+    mu_assert(count >= 1 && local, "one copy per node");
+    // Changes to the tree are not seen by the copies
+    mu_assert(betree_insert(trees[0], 5000, "i = 1"), "");
+
+    bool same = true;
+    struct betree_search_context* context = betree_make_search_context(trees[0]);
+    srand(55);
+    for(size_t e = 0; e < 100; e++) {
+        char event[64];
+        sprintf(event, "{\"i\": %d, \"s\": \"s%d\"}", 2 + rand() % 99, rand() % 10);
+        struct report* reports[5] = { make_report(), make_report(), make_report(), make_report(), make_report() };
+        mu_assert(betree_search(trees[0], event, reports[0]), "");
+        mu_assert(betree_search(trees[1], event, reports[1]), "");
+        mu_assert(betree_search(clone, event, reports[2]), "");
+        mu_assert(betree_replicas_search(replicas, event, reports[3]), "");
+        mu_assert(betree_replicas_search_with_context(replicas, event, reports[4], context), "");
+        same &= same_matches(reports[0], reports[1]) && same_matches(reports[0], reports[2])
+            && same_matches(reports[0], reports[3]) && same_matches(reports[0], reports[4])
+            && betree_replicas_exists(replicas, event) == (reports[0]->matched != 0);
+        for(size_t r = 0; r < 5; r++) {
+            free_report(reports[r]);
+        }
+    }
+    mu_assert(same, "same matches");
+    mu_assert(!betree_replicas_exists(replicas, "{\"i\": 1, \"s\": \"s1\"}"), "copied before the insert");
+    betree_free_search_context(context);
+    betree_replicas_free(replicas);
+    betree_free(clone);
+    for(size_t t = 0; t < 2; t++) {
+        betree_free(trees[t]);
+    }
+    return 0;
+}
+
+enum { engine_producer_count = 4, engine_event_count = 300 };
+
+struct engine_results {
+    // Matches of each event, SIZE_MAX when invalid
+    size_t matched[engine_producer_count * engine_event_count + 2];
+    size_t done;
+};
+
+struct engine_call {
+    struct engine_results* results;
+    size_t index;
+};
+
+static void engine_completed(void* data, bool valid, const struct report* report)
+{
+    struct engine_call* call = data;
+    call->results->matched[call->index] = valid ? report->matched : SIZE_MAX;
+    __atomic_fetch_add(&call->results->done, 1, __ATOMIC_RELEASE);
+}
+
+struct engine_producer {
+    struct betree_engine* engine;
+    struct engine_call* calls;
+    size_t first;
+};
+
+static void engine_event(size_t index, char* event)
+{
+    sprintf(event, "{\"i\": %zu, \"s\": \"s%zu\"}", index % 101, index % 7);
+}
+
+static void* engine_produce(void* data)
+{
+    struct engine_producer* producer = data;
+    for(size_t e = 0; e < engine_event_count; e++) {
+        char event[64];
+        engine_event(producer->first + e, event);
+        betree_engine_submit(producer->engine, event, engine_completed, &producer->calls[producer->first + e]);
+    }
+    return NULL;
+}
+
+int test_engine()
+{
+    struct betree* tree = betree_make();
+    betree_add_integer_variable(tree, "i", false, 0, 100);
+    betree_add_string_variable(tree, "s", true, 10);
+    for(size_t id = 0; id < 500; id++) {
+        char expr[64];
+        sprintf(expr, "i > %zu and (s = \"s%zu\" or i < %zu)", id % 50, id % 7, 60 + id % 40);
+        mu_assert(betree_insert(tree, id, expr), "");
+    }
+    struct betree_engine* engine = betree_engine_make(tree, 3);
+    struct engine_results* results = bcalloc(sizeof(*results));
+    struct engine_call* calls = bcalloc(sizeof(results->matched) / sizeof(results->matched[0]) * sizeof(*calls));
+    size_t total = engine_producer_count * engine_event_count;
+    for(size_t i = 0; i < total + 2; i++) {
+        calls[i] = (struct engine_call){ .results = results, .index = i };
+    }
+    pthread_t threads[engine_producer_count];
+    struct engine_producer producers[engine_producer_count];
+    for(size_t t = 0; t < engine_producer_count; t++) {
+        producers[t] = (struct engine_producer){ .engine = engine, .calls = calls, .first = t * engine_event_count };
+        mu_assert(pthread_create(&threads[t], NULL, engine_produce, &producers[t]) == 0, "");
+    }
+    // Refused instead of aborting like betree_search
+    betree_engine_submit(engine, "{\"j\": 1}", engine_completed, &calls[total]);
+    betree_engine_submit(engine, "{\"s\": \"s1\"}", engine_completed, &calls[total + 1]);
+    struct betree_engine_future* futures[2]
+        = { betree_engine_submit_future(engine, "{\"i\": 70, \"s\": \"s3\"}"), betree_engine_submit_future(engine, "{") };
+    for(size_t t = 0; t < engine_producer_count; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    struct report* reports[2] = { make_report(), make_report() };
+    mu_assert(betree_engine_future_wait(futures[0], reports[0]), "");
+    mu_assert(betree_search(tree, "{\"i\": 70, \"s\": \"s3\"}", reports[1]), "");
+    mu_assert(reports[0]->matched != 0 && same_matches(reports[0], reports[1]), "future");
+    mu_assert(!betree_engine_future_wait(futures[1], reports[0]), "unparsed");
+    free_report(reports[0]);
+    free_report(reports[1]);
+    while(__atomic_load_n(&results->done, __ATOMIC_ACQUIRE) != total + 2) {
+        sched_yield();
+    }
+
+    bool same = true;
+    for(size_t i = 0; i < total; i++) {
+        char event[64];
+        engine_event(i, event);
+        struct report* report = make_report();
+        mu_assert(betree_search(tree, event, report), "");
+        same &= results->matched[i] == report->matched;
+        free_report(report);
+    }
+    mu_assert(same, "callbacks");
+    mu_assert(results->matched[total] == SIZE_MAX && results->matched[total + 1] == SIZE_MAX, "invalid events");
+    struct betree_engine_metrics metrics;
+    betree_engine_get_metrics(engine, &metrics);
+    uint64_t bucketed = 0;
+    for(size_t i = 0; i < BETREE_ENGINE_LATENCY_BUCKETS; i++) {
+        bucketed += metrics.latency_buckets[i];
+    }
+    mu_assert(metrics.submitted == total + 4 && metrics.completed == metrics.submitted && metrics.queue_depth == 0
+            && metrics.invalid == 3 && bucketed == metrics.completed,
+        "counted");
+    mu_assert(metrics.batches != 0 && metrics.batches <= metrics.completed && metrics.latency_max_ns != 0
+            && metrics.latency_total_ns >= metrics.latency_max_ns,
+        "batched");
+    betree_engine_free(engine);
+    bfree(calls);
+    bfree(results);
+    betree_free(tree);
+    return 0;
+}
+
+static void window_expr(char* expr, size_t id, int64_t start, int64_t end)
+{
+    if(start == INT64_MIN) {
+        sprintf(expr, "x = %zu", id % 10);
+    }
+    else {
+        sprintf(expr, "x = %zu and now >= %" PRId64 " and now <= %" PRId64, id % 10, start, end);
+    }
+}
+
+static bool same_as_windows(struct betree** trees, size_t count, struct betree* expected, int64_t now)
+{
+    bool same = true;
+    for(int x = 0; x < 10; x++) {
+        char event[64];
+        sprintf(event, "{\"x\": %d, \"now\": %" PRId64 "}", x, now);
+        struct report* report = make_report();
+        betree_search(expected, event, report);
+        bool exists = betree_exists(expected, event);
+        for(size_t t = 0; t < count; t++) {
+            struct report* windowed = make_report();
+            betree_search(trees[t], event, windowed);
+            same &= same_matches(report, windowed) && betree_exists(trees[t], event) == exists;
+            free_report(windowed);
+        }
+        free_report(report);
+    }
+    return same;
+}
+
+int test_activation_windows()
+{
+    enum { sub_count = 300 };
+    // Windowed, windowed with posting lists and columns, windows written in the expressions
+    struct betree* trees[3] = { betree_make_with_parameters(16, 0), betree_make_with_parameters(16, 0),
+        betree_make_with_parameters(16, 0) };
+    for(size_t t = 0; t < 3; t++) {
+        betree_add_integer_variable(trees[t], "x", false, 0, 9);
+        betree_add_integer_variable(trees[t], "now", false, 0, 2000);
+    }
+    betree_set_prefilter(trees[1], true);
+    betree_set_columns(trees[1], true);
+    srand(57);
+    for(size_t id = 0; id < sub_count; id++) {
+        int64_t start = INT64_MIN, end = INT64_MAX;
+        if(id % 7 != 0) {
+            start = rand() % 1000;
+            end = start + rand() % 200;
+        }
+        char expr[128];
+        sprintf(expr, "x = %zu", id % 10);
+        for(size_t t = 0; t < 2; t++) {
+            const struct betree_sub* sub = betree_make_sub_with_window(trees[t], id, 0, NULL, expr, start, end);
+            mu_assert(betree_insert_sub(trees[t], sub), "");
+        }
+        window_expr(expr, id, start, end);
+        mu_assert(betree_insert(trees[2], id, expr), "");
+    }
+    mu_assert(betree_get_time(trees[0]) == INT64_MIN, "clock not started");
+
+    bool same = true;
+    for(int64_t now = 0; now < 1300; now += 7) {
+        for(size_t t = 0; t < 2; t++) {
+            mu_assert(betree_advance_time(trees[t], now), "");
+        }
+        if(now == 497) {
+            // Moved and dropped windows, like deleting and inserting the subs again
+            for(size_t t = 0; t < 2; t++) {
+                mu_assert(!betree_advance_time(trees[t], now - 1), "clock never moves back");
+                mu_assert(betree_set_sub_window(trees[t], 1, now, now + 50), "");
+                mu_assert(betree_set_sub_window(trees[t], 2, INT64_MIN, INT64_MAX), "");
+                mu_assert(betree_delete(trees[t], 3), "");
+            }
+            mu_assert(!betree_set_sub_window(trees[0], sub_count, 0, 1), "no such sub");
+            char expr[128];
+            mu_assert(betree_delete(trees[2], 1) && betree_delete(trees[2], 2) && betree_delete(trees[2], 3), "");
+            window_expr(expr, 1, now, now + 50);
+            mu_assert(betree_insert(trees[2], 1, expr), "");
+            window_expr(expr, 2, INT64_MIN, INT64_MAX);
+            mu_assert(betree_insert(trees[2], 2, expr), "");
+        }
+        same &= same_as_windows(trees, 2, trees[2], now);
+    }
+    mu_assert(same, "same matches as the windows in the expressions");
+
+    // Copies and snapshots keep the windows and the clock
+    struct betree* source = betree_make_with_parameters(16, 0);
+    betree_add_integer_variable(source, "x", false, 0, 9);
+    betree_add_integer_variable(source, "now", false, 0, 2000);
+    for(size_t id = 0; id < 100; id++) {
+        char expr[32];
+        sprintf(expr, "x = %zu", id % 10);
+        const struct betree_sub* sub = betree_make_sub_with_window(source, id, 0, NULL, expr, (int64_t)id * 10, (int64_t)id * 10 + 50);
+        mu_assert(betree_insert_sub(source, sub), "");
+    }
+    mu_assert(betree_advance_time(source, 300), "");
+    const char* path = "/tmp/betree_activation_windows_test.bin";
+    mu_assert(betree_save(source, path), "saved");
+    struct betree* copies[2] = { betree_clone(source), betree_load(path) };
+    mu_assert(copies[1] != NULL, "loaded");
+    remove(path);
+    mu_assert(betree_get_time(copies[0]) == 300 && betree_get_time(copies[1]) == 300, "same clock");
+    for(int64_t now = 300; now < 1200; now += 100) {
+        for(size_t t = 0; t < 2; t++) {
+            mu_assert(betree_advance_time(copies[t], now), "");
+        }
+        mu_assert(betree_advance_time(source, now), "");
+        same &= same_as_windows(copies, 2, source, now);
+    }
+    mu_assert(same, "copies keep the windows and the timers");
+    for(size_t t = 0; t < 2; t++) {
+        betree_free(copies[t]);
+    }
+    betree_free(source);
+
+    for(size_t t = 0; t < 3; t++) {
+        betree_free(trees[t]);
+    }
+    return 0;
+}
+
+int test_search_delta()
+{
+    struct betree* tree = betree_make_with_parameters(16, 0);
+    betree_add_integer_variable(tree, "user", false, 0, 50);
+    betree_add_integer_variable(tree, "placement", true, 0, 20);
+    betree_add_segments_variable(tree, "seg", true);
+    betree_add_integer_variable(tree, "now", false, INT64_MIN, INT64_MAX);
+    for(size_t id = 0; id < 300; id++) {
+        char expr[64];
+        switch(id % 4) {
+            case 0: sprintf(expr, "user = %zu", id % 50); break;
+            case 1: sprintf(expr, "placement = %zu", id % 20); break;
+            case 2: sprintf(expr, "user < %zu and placement > %zu", id % 50, id % 20); break;
+            default: sprintf(expr, "segment_within(seg, %zu, %zu)", id % 3, id % 40); break;
+        }
+        mu_assert(betree_insert(tree, id, expr), "");
+    }
+    // One id, one of its subs depending on placement and the other not
+    mu_assert(betree_insert(tree, 300, "user = 7") && betree_insert(tree, 300, "placement = 3"), "");
+    struct betree_search_context* context = betree_make_search_context(tree);
+
+    srand(58);
+    bool same = true;
+    uint64_t delta_evaluated = 0, full_evaluated = 0;
+    for(size_t u = 0; u < 20; u++) {
+        int user = rand() % 50, placement = rand() % 20;
+        int64_t now = 1000;
+        char text[128];
+        sprintf(text, "{\"user\": %d, \"placement\": %d, \"now\": %" PRId64 ", \"seg\": [[0, 990000000], [2, 1000000000]]}",
+            user, placement, now);
+        // Each delta points into the events before it, they are freed together
+        struct betree_prepared_event* chain[11];
+        chain[0] = betree_prepare_event(tree, text);
+        struct report* previous_report = make_report();
+        mu_assert(betree_search_prepared(tree, chain[0], previous_report, context), "");
+        for(size_t step = 1; step < 11; step++) {
+            char delta[64];
+            if(rand() % 2 == 0) {
+                placement = rand() % 20;
+                sprintf(delta, "{\"placement\": %d}", placement);
+            }
+            else {
+                now += rand() % 10;
+                sprintf(delta, "{\"now\": %" PRId64 "}", now);
+            }
+            chain[step] = betree_prepare_delta(tree, chain[step - 1], delta);
+            struct report* report = make_report();
+            mu_assert(betree_search_delta(tree, chain[step - 1], previous_report, chain[step], report, context), "");
+            sprintf(text, "{\"user\": %d, \"placement\": %d, \"now\": %" PRId64 ", \"seg\": [[0, 990000000], [2, 1000000000]]}",
+                user, placement, now);
+            struct report* expected = make_report();
+            mu_assert(betree_search(tree, text, expected), "");
+            same &= same_matches(report, expected);
+            delta_evaluated += report->evaluated;
+            full_evaluated += expected->evaluated;
+            free_report(previous_report);
+            free_report(expected);
+            previous_report = report;
+        }
+        // Not a delta of the event given, searched in full
+        struct report* report = make_report();
+        mu_assert(betree_search_delta(tree, chain[0], previous_report, chain[10], report, context), "");
+        struct report* expected = make_report();
+        mu_assert(betree_search(tree, text, expected), "");
+        same &= same_matches(report, expected);
+        free_report(report);
+        free_report(expected);
+        free_report(previous_report);
+        for(size_t step = 0; step < 11; step++) {
+            betree_free_prepared_event(chain[step]);
+        }
+    }
+    mu_assert(same, "same matches as full searches");
+    mu_assert(delta_evaluated < full_evaluated, "fewer subs evaluated");
+
+    // New subs and variables after the events were prepared
+    struct betree_prepared_event* base = betree_prepare_event(tree, "{\"user\": 7, \"placement\": 3, \"now\": 1000}");
+    struct betree_prepared_event* delta = betree_prepare_delta(tree, base, "{\"placement\": 4}");
+    mu_assert(betree_insert(tree, 301, "placement = 4"), "");
+    struct report* reports[4] = { make_report(), make_report(), make_report(), make_report() };
+    mu_assert(betree_search_prepared(tree, base, reports[0], context), "");
+    mu_assert(betree_search_delta(tree, base, reports[0], delta, reports[1], context), "");
+    mu_assert(betree_search(tree, "{\"user\": 7, \"placement\": 4, \"now\": 1000}", reports[2]), "");
+    mu_assert(same_matches(reports[1], reports[2]), "new sub found");
+    // Both events are read again for the new ids
+    betree_add_integer_variable(tree, "extra", true, 0, 10);
+    struct betree_prepared_event* stale = betree_prepare_delta(tree, base, "{\"placement\": 4}");
+    reports[1]->matched = 0;
+    mu_assert(betree_search_delta(tree, base, reports[0], delta, reports[1], context), "");
+    mu_assert(betree_search_delta(tree, base, reports[0], stale, reports[3], context), "");
+    mu_assert(same_matches(reports[1], reports[2]) && same_matches(reports[3], reports[2]), "new variable");
+    for(size_t i = 0; i < 4; i++) {
+        free_report(reports[i]);
+    }
+    betree_free_prepared_event(stale);
+    betree_free_prepared_event(delta);
+    betree_free_prepared_event(base);
+    betree_free_search_context(context);
+    betree_free(tree);
+    return 0;
+}
+
+int test_live()
+{
+    struct betree* tree = betree_make();
+    betree_add_integer_variable(tree, "i", false, 0, 100);
+    betree_add_string_variable(tree, "s", true, 10);
+    mu_assert(betree_insert(tree, 0, "i > 10"), "");
+    mu_assert(betree_insert(tree, 2, "i > 20 and s = \"a\""), "");
+    struct betree_live* live = betree_live_make(tree);
+
+    struct betree_live_reader* reader = betree_live_register(live);
+    const struct betree* pinned = betree_live_pin(reader);
+
+    const betree_sub_t deletes[1] = { 0 };
+    const betree_sub_t ids[2] = { 4, 6 };
+    const char* exprs[2] = { "i < 50", "s = \"b\"" };
+    mu_assert(betree_live_update(live, 1, deletes, 2, ids, exprs), "");
+
+    // The pinned version is untouched by the update
+    struct report* report = make_report();
+    mu_assert(betree_search(pinned, "{\"i\": 30, \"s\": \"a\"}", report), "");
+    mu_assert(report->matched == 2, "old version still complete");
+    betree_live_unpin(reader);
+
+    betree_report_reset(report);
+    mu_assert(betree_live_search(reader, "{\"i\": 30, \"s\": \"b\"}", report), "");
+    mu_assert(report->matched == 2, "new version has the update");
+    qsort(report->subs, report->matched, sizeof(*report->subs), sub_id_cmp);
+    mu_assert(report->subs[0] == 4 && report->subs[1] == 6, "");
+
+    const char* invalid[1] = { "j = 3" };
+    const betree_sub_t invalid_ids[1] = { 8 };
+    mu_assert(!betree_live_update(live, 0, NULL, 1, invalid_ids, invalid), "invalid batch rejected");
+    betree_report_reset(report);
+    mu_assert(betree_live_search(reader, "{\"i\": 30, \"s\": \"b\"}", report), "");
+    mu_assert(report->matched == 2, "current version kept");
+    free_report(report);
+    betree_live_unregister(reader);
+
+    // Readers run while a writer flips every id between even and odd
+    enum { thread_count = 4, update_count = 20 };
+    pthread_t threads[thread_count];
+    struct live_search_job jobs[thread_count];
+    for(size_t t = 0; t < thread_count; t++) {
+        jobs[t] = (struct live_search_job){ .live = live, .iterations = 2000, .valid = true };
+        mu_assert(pthread_create(&threads[t], NULL, live_search_thread, &jobs[t]) == 0, "");
+    }
+    betree_sub_t current[50] = { 2, 4, 6 };
+    size_t current_count = 3;
+    for(size_t u = 0; u < update_count; u++) {
+        betree_sub_t next[50];
+        char* next_exprs[50];
+        for(size_t k = 0; k < 50; k++) {
+            next[k] = 2 * k + (u % 2 == 0 ? 1 : 0);
+            next_exprs[k] = bcalloc(32);
+            sprintf(next_exprs[k], "i > %zu", k);
+        }
+        mu_assert(betree_live_update(live, current_count, current, 50, next, (const char**)next_exprs), "");
+        for(size_t k = 0; k < 50; k++) {
+            bfree(next_exprs[k]);
+            current[k] = next[k];
+        }
+        current_count = 50;
+    }
+    for(size_t t = 0; t < thread_count; t++) {
+        pthread_join(threads[t], NULL);
+        mu_assert(jobs[t].valid, "readers only saw whole versions");
+    }
+
+    betree_live_free(live);
+    return 0;
+}
+
+static size_t random_sorted_list(int64_t* xs, size_t count, int64_t range)
+{
+    for(size_t i = 0; i < count; i++) {
+        xs[i] = rand() % range - range / 2;
+    }
+    qsort(xs, count, sizeof(*xs), icmpfunc);
+    size_t unique = 0;
+    for(size_t i = 0; i < count; i++) {
+        if(unique == 0 || xs[unique - 1] != xs[i]) {
+            xs[unique++] = xs[i];
+        }
+    }
+    return unique;
+}
+
+static bool naive_contains(const int64_t* xs, size_t count, int64_t value)
+{
+    for(size_t i = 0; i < count; i++) {
+        if(xs[i] == value) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int test_sorted_list_kernels()
+{
+    enum { max_count = 700 };
+    int64_t xs[max_count], ys[max_count];
+    struct string_value sxs[max_count], sys[max_count];
+    // Sizes on both sides of the block widths and of the galloping ratio
+    const size_t counts[] = { 0, 1, 3, 4, 7, 8, 9, 17, 40, 300, 700 };
+    const size_t count_count = sizeof(counts) / sizeof(counts[0]);
+    srand(16);
+    for(size_t a = 0; a < count_count; a++) {
+        for(size_t b = 0; b < count_count; b++) {
+            for(size_t round = 0; round < 8; round++) {
+                int64_t range = round % 2 == 0 ? 2000 : 100000;
+                size_t x_count = random_sorted_list(xs, counts[a], range);
+                size_t y_count = random_sorted_list(ys, counts[b], range);
+                // Some rounds take ys from xs so inclusion also holds
+                if(round % 4 == 3 && x_count != 0) {
+                    y_count = 0;
+                    for(size_t i = 0; i < x_count && y_count < counts[b]; i += 1 + rand() % 3) {
+                        ys[y_count++] = xs[i];
+                    }
+                }
+                bool intersects = false, includes = true;
+                for(size_t j = 0; j < y_count; j++) {
+                    bool found = naive_contains(xs, x_count, ys[j]);
+                    intersects |= found;
+                    includes &= found;
+                    mu_assert(sorted_integer_contains(xs, x_count, ys[j]) == found, "contains");
+                }
+                mu_assert(sorted_integer_intersects(xs, x_count, ys, y_count) == intersects, "intersects");
+                mu_assert(sorted_integer_includes(xs, x_count, ys, y_count) == includes, "includes");
+
+                for(size_t i = 0; i < x_count; i++) {
+                    sxs[i].str = (betree_str_t)(xs[i] + range);
+                }
+                for(size_t j = 0; j < y_count; j++) {
+                    sys[j].str = (betree_str_t)(ys[j] + range);
+                    mu_assert(sorted_string_contains(sxs, x_count, sys[j].str)
+                            == naive_contains(xs, x_count, ys[j]),
+                        "string contains");
+                }
+                mu_assert(sorted_string_intersects(sxs, x_count, sys, y_count) == intersects, "string intersects");
+                mu_assert(sorted_string_includes(sxs, x_count, sys, y_count) == includes, "string includes");
+            }
+        }
+    }
+
+    struct betree* tree = betree_make();
+    add_attr_domain_i(tree->config, "i", false);
+    add_attr_domain_il(tree->config, "il", false);
+    mu_assert(betree_insert(tree, 1, "il one of (5, 10, 200, 4000)"), "");
+    mu_assert(betree_insert(tree, 2, "il all of (10, 20, 30, 40, 50)"), "");
+    mu_assert(betree_insert(tree, 3, "i in (1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20)"), "");
+    struct report* report = make_report();
+    mu_assert(betree_search(tree, "{\"i\": 17, \"il\": [1, 2, 3, 10, 20, 30, 40, 50, 60, 70]}", report), "");
+    mu_assert(report->matched == 3, "all three list expressions match");
+    betree_report_reset(report);
+    mu_assert(betree_search(tree, "{\"i\": 21, \"il\": [1, 2, 3, 20, 30, 40, 50, 60, 70, 80]}", report), "");
+    mu_assert(report->matched == 0, "none of the list expressions match");
+    free_report(report);
+    betree_free(tree);
+    return 0;
+}
+
+static size_t random_ids(size_t* ids, size_t max_count, size_t range)
+{
+    size_t count = 0;
+    size_t target = rand() % (max_count + 1);
+    while(count < target) {
+        size_t id = rand() % range;
+        bool seen = false;
+        for(size_t i = 0; i < count; i++) {
+            seen |= ids[i] == id;
+        }
+        if(!seen) {
+            ids[count++] = id;
+        }
+    }
+    return count;
+}
+
+static void append_ids(char* buffer, const size_t* ids, size_t count)
+{
+    for(size_t i = 0; i < count; i++) {
+        if(i != 0) {
+            strcat(buffer, ", ");
+        }
+        sprintf(buffer + strlen(buffer), "\"v%zu\"", ids[i]);
+    }
+}
+
+static bool ids_contain(const size_t* ids, size_t count, size_t id)
+{
+    for(size_t i = 0; i < count; i++) {
+        if(ids[i] == id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int test_list_bitmaps()
+{
+    enum { sub_count = 200, event_count = 100 };
+    struct betree* tree = betree_make();
+    add_attr_domain_bounded_sl(tree->config, "sl", true, 32);
+    add_attr_domain_bounded_s(tree->config, "s", true, 32);
+    size_t kinds[sub_count], counts[sub_count], ids[sub_count][5];
+    const char* ops[] = { "one of", "none of", "all of" };
+    srand(17);
+    for(size_t i = 0; i < sub_count; i++) {
+        kinds[i] = rand() % 4;
+        counts[i] = 1 + random_ids(ids[i], 4, 24);
+        ids[i][counts[i] - 1] = rand() % 24;
+        if(ids_contain(ids[i], counts[i] - 1, ids[i][counts[i] - 1])) {
+            counts[i]--;
+        }
+        char expr[256] = "";
+        if(kinds[i] < 3) {
+            sprintf(expr, "sl %s (", ops[kinds[i]]);
+            append_ids(expr, ids[i], counts[i]);
+        }
+        else {
+            strcpy(expr, "s in (");
+            append_ids(expr, ids[i], counts[i]);
+        }
+        strcat(expr, ")");
+        mu_assert(betree_insert(tree, i, expr), "");
+    }
+
+    struct report* report = make_report();
+    for(size_t e = 0; e < event_count; e++) {
+        // Values past 24 are unknown to the tree
+        size_t event_ids[8];
+        size_t event_id_count = random_ids(event_ids, 8, 30);
+        size_t s = rand() % 30;
+        char event[512] = "{\"sl\": [";
+        append_ids(event, event_ids, event_id_count);
+        sprintf(event + strlen(event), "], \"s\": \"v%zu\"}", s);
+
+        size_t expected = 0;
+        for(size_t i = 0; i < sub_count; i++) {
+            size_t hits = 0;
+            for(size_t j = 0; j < counts[i]; j++) {
+                hits += ids_contain(event_ids, event_id_count, ids[i][j]);
+            }
+            bool match = (kinds[i] == 0 && hits != 0) || (kinds[i] == 1 && hits == 0)
+                || (kinds[i] == 2 && hits == counts[i]) || (kinds[i] == 3 && ids_contain(ids[i], counts[i], s));
+            expected += match;
+        }
+        betree_report_reset(report);
+        mu_assert(betree_search(tree, event, report), "");
+        mu_assert(report->matched == expected, "scanned event");
+        struct betree_event* parsed = make_event_from_string(tree, event);
+        betree_report_reset(report);
+        mu_assert(betree_search_with_event(tree, parsed, report), "");
+        mu_assert(report->matched == expected, "parsed event");
+        free_event(parsed);
+    }
+    free_report(report);
+    betree_free(tree);
+
+    // Both sides carry bitmaps only while the domain is small
+    tree = betree_make();
+    add_attr_domain_bounded_sl(tree->config, "small", false, 32);
+    add_attr_domain_bounded_sl(tree->config, "large", false, LIST_BITMAP_MAX_IDS + 1);
+    mu_assert(betree_insert(tree, 0, "small one of (\"a\", \"b\") and large one of (\"a\", \"b\")"), "");
+    const struct ast_node* expr = tree->cnode->lnode->subs[0]->expr;
+    mu_assert(expr->bool_expr.binary.lhs->list_expr.value.string_list_value->bitmap != NULL, "small expression");
+    mu_assert(expr->bool_expr.binary.rhs->list_expr.value.string_list_value->bitmap == NULL, "large expression");
+    struct betree_event* parsed = make_event_from_string(tree, "{\"small\": [\"b\"], \"large\": []}");
+    mu_assert(parsed->variables[0]->value.string_list_value->bitmap != NULL, "small event");
+    mu_assert(parsed->variables[1]->value.string_list_value->count == 0, "empty event list");
+    free_event(parsed);
+    betree_free(tree);
+    return 0;
+}
+
+static int compare_ids(const void* a, const void* b)
+{
+    betree_sub_t x = *(const betree_sub_t*)a, y = *(const betree_sub_t*)b;
+    return (x > y) - (x < y);
+}
+
+int test_prefilter()
+{
+    enum { sub_count = 300, event_count = 100 };
+    // Plain, prefiltered from the start in an arena, prefiltered once filled
+    struct betree* trees[3] = { betree_make_with_parameters(8, 4), betree_make_with_arena(8, 4),
+        betree_make_with_parameters(8, 4) };
+    for(size_t t = 0; t < 3; t++) {
+        betree_add_integer_variable(trees[t], "i", true, 0, 20);
+        betree_add_string_variable(trees[t], "s", true, 32);
+        betree_add_boolean_variable(trees[t], "b", true);
+    }
+    betree_set_prefilter(trees[1], true);
+    srand(18);
+    for(size_t i = 0; i < sub_count; i++) {
+        size_t ids[4];
+        size_t count = 1 + random_ids(ids, 3, 24);
+        ids[count - 1] = 24;
+        char expr[256];
+        switch(rand() % 5) {
+            case 0:
+                sprintf(expr, "i = %d", rand() % 20);
+                break;
+            case 1:
+                strcpy(expr, "s in (");
+                append_ids(expr, ids, count);
+                strcat(expr, ")");
+                break;
+            case 2:
+                sprintf(expr, "b and i = %d and s in (", rand() % 20);
+                append_ids(expr, ids, count);
+                strcat(expr, ")");
+                break;
+            case 3:
+                strcpy(expr, "b");
+                break;
+            default:
+                sprintf(expr, "i > %d", rand() % 20);
+                break;
+        }
+        for(size_t t = 0; t < 3; t++) {
+            mu_assert(betree_insert(trees[t], i, expr), "");
+        }
+    }
+    betree_set_prefilter(trees[2], true);
+
+    struct report* reports[3] = { make_report(), make_report(), make_report() };
+    for(size_t round = 0; round < 2; round++) {
+        size_t evaluated[3] = { 0, 0, 0 };
+        for(size_t e = 0; e < event_count; e++) {
+            char event[128];
+            sprintf(event, "{\"i\": %d, \"s\": \"v%d\", \"b\": %s}", rand() % 20, rand() % 30,
+                rand() % 2 ? "true" : "false");
+            for(size_t t = 0; t < 3; t++) {
+                betree_report_reset(reports[t]);
+                mu_assert(betree_search(trees[t], event, reports[t]), "");
+                qsort(reports[t]->subs, reports[t]->matched, sizeof(*reports[t]->subs), compare_ids);
+                evaluated[t] += reports[t]->evaluated;
+            }
+            for(size_t t = 1; t < 3; t++) {
+                mu_assert(reports[t]->matched == reports[0]->matched, "same match count");
+                mu_assert(memcmp(reports[t]->subs, reports[0]->subs, reports[0]->matched * sizeof(*reports[0]->subs)) == 0,
+                    "same matches");
+            }
+        }
+        mu_assert(evaluated[1] < evaluated[0] && evaluated[2] == evaluated[1], "fewer subs evaluated");
+        for(size_t i = round; i < sub_count; i += 3) {
+            for(size_t t = 0; t < 3; t++) {
+                mu_assert(betree_delete(trees[t], i), "");
+            }
+        }
+    }
+    betree_set_prefilter(trees[2], false);
+    mu_assert(trees[2]->cnode->lnode->postings == NULL, "postings dropped");
+    for(size_t t = 0; t < 3; t++) {
+        free_report(reports[t]);
+        betree_free(trees[t]);
+    }
+    return 0;
+}
+
+int test_order_by_hits()
+{
+    enum { sub_count = 200 };
+    // Ordered, ordered with posting lists and columns in an arena, never ordered
+    struct betree* trees[3] = { betree_make_with_parameters(1000, 16), betree_make_with_arena(1000, 16),
+        betree_make_with_parameters(1000, 16) };
+    for(size_t t = 0; t < 3; t++) {
+        betree_add_integer_variable(trees[t], "i", false, 0, 1000);
+        betree_add_integer_variable(trees[t], "j", true, 0, 10);
+        for(size_t id = 0; id < sub_count; id++) {
+            char expr[64];
+            sprintf(expr, "i = %zu and j = %zu", id, id % 5);
+            mu_assert(betree_insert(trees[t], id, expr), "");
+        }
+        // Matches every event past 500, last of the lnode
+        mu_assert(betree_insert(trees[t], sub_count, "i >= 500"), "");
+    }
+    betree_set_prefilter(trees[1], true);
+    betree_set_columns(trees[1], true);
+    const struct lnode* lnodes[2] = { trees[0]->cnode->lnode, trees[1]->cnode->lnode };
+    mu_assert(lnodes[0]->sub_count == sub_count + 1 && lnodes[0]->subs[sub_count]->id == sub_count, "inserted last");
+
+    for(size_t e = 0; e < 50; e++) {
+        char event[64];
+        sprintf(event, "{\"i\": %zu}", 500 + e);
+        for(size_t t = 0; t < 2; t++) {
+            mu_assert(betree_exists(trees[t], event), "");
+        }
+    }
+    mu_assert(lnodes[0]->subs[sub_count]->hits == 50, "counted");
+    for(size_t t = 0; t < 2; t++) {
+        betree_order_by_hits(trees[t]);
+        mu_assert(lnodes[t]->subs[0]->id == sub_count && lnodes[t]->subs[0]->hits == 25, "most hits first");
+    }
+
+    bool same = true;
+    srand(54);
+    for(size_t e = 0; e < 200; e++) {
+        char event[64];
+        if(rand() % 2 == 0) {
+            sprintf(event, "{\"i\": %d, \"j\": %d}", rand() % 1000, rand() % 10);
+        }
+        else {
+            sprintf(event, "{\"i\": %d}", rand() % sub_count);
+        }
+        struct report* reports[3];
+        for(size_t t = 0; t < 3; t++) {
+            reports[t] = make_report();
+            mu_assert(betree_search(trees[t], event, reports[t]), "");
+        }
+        bool exists = betree_exists(trees[2], event);
+        same &= same_matches(reports[0], reports[2]) && same_matches(reports[1], reports[2])
+            && betree_exists(trees[0], event) == exists && betree_exists(trees[1], event) == exists;
+        for(size_t t = 0; t < 3; t++) {
+            free_report(reports[t]);
+        }
+    }
+    mu_assert(same, "same matches");
+    for(size_t t = 0; t < 3; t++) {
+        betree_free(trees[t]);
+    }
+    return 0;
+}
+
+int test_columns()
+{
+    enum { sub_count = 400, event_count = 100 };
+    // Plain, with columns from the start in an arena, with columns once filled
+    struct betree* trees[3] = { betree_make_with_parameters(64, 16), betree_make_with_arena(64, 16),
+        betree_make_with_parameters(64, 16) };
+    for(size_t t = 0; t < 3; t++) {
+        betree_add_integer_variable(trees[t], "i", true, 0, 100);
+        betree_add_integer_variable(trees[t], "j", false, 0, 100);
+        betree_add_string_variable(trees[t], "s", true, 16);
+        betree_add_boolean_variable(trees[t], "b", true);
+    }
+    betree_set_columns(trees[1], true);
+    srand(51);
+    for(size_t i = 0; i < sub_count; i++) {
+        char expr[256];
+        switch(rand() % 5) {
+            case 0:
+                sprintf(expr, "i >= %d and j < %d", rand() % 100, rand() % 100);
+                break;
+            case 1:
+                sprintf(expr, "s = \"v%d\" and i <= %d", rand() % 16, rand() % 100);
+                break;
+            case 2:
+                sprintf(expr, "b and j > %d and (i = %d or s = \"v1\")", rand() % 100, rand() % 100);
+                break;
+            case 3:
+                sprintf(expr, "i > %d and i < %d and j = %d", rand() % 50, 50 + rand() % 50, rand() % 100);
+                break;
+            default:
+                sprintf(expr, "i = %d or j = %d", rand() % 100, rand() % 100);
+                break;
+        }
+        for(size_t t = 0; t < 3; t++) {
+            mu_assert(betree_insert(trees[t], i, expr), "");
+        }
+    }
+    betree_set_columns(trees[2], true);
+    mu_assert(trees[2]->cnode->lnode->columns != NULL, "columns built");
+
+    struct report* reports[4] = { make_report(), make_report(), make_report(), make_report() };
+    for(size_t round = 0; round < 2; round++) {
+        struct betree* clone = betree_clone(trees[1]);
+        size_t evaluated[4] = { 0, 0, 0, 0 };
+        for(size_t e = 0; e < event_count; e++) {
+            char event[128];
+            // i is left out now and then, the short circuits rule those subs out instead
+            if(rand() % 4 == 0) {
+                sprintf(event, "{\"j\": %d, \"s\": \"v%d\", \"b\": true}", rand() % 100, rand() % 16);
+            }
+            else {
+                sprintf(event, "{\"i\": %d, \"j\": %d, \"s\": \"v%d\", \"b\": %s}", rand() % 100,
+                    rand() % 100, rand() % 16, rand() % 2 ? "true" : "false");
+            }
+            for(size_t t = 0; t < 4; t++) {
+                betree_report_reset(reports[t]);
+                mu_assert(betree_search(t == 3 ? clone : trees[t], event, reports[t]), "");
+                // Subs ruled out without being run count as shorted
+                evaluated[t] += reports[t]->evaluated - reports[t]->shorted;
+            }
+            for(size_t t = 1; t < 4; t++) {
+                mu_assert(same_matches(reports[t], reports[0]), "same matches");
+            }
+        }
+        mu_assert(evaluated[1] < evaluated[0], "fewer subs evaluated");
+        mu_assert(evaluated[2] == evaluated[1] && evaluated[3] == evaluated[1], "same columns however built");
+        betree_free(clone);
+        for(size_t i = round; i < sub_count; i += 3) {
+            for(size_t t = 0; t < 3; t++) {
+                mu_assert(betree_delete(trees[t], i), "");
+            }
+        }
+    }
+    betree_set_columns(trees[2], false);
+    mu_assert(trees[2]->cnode->lnode->columns == NULL, "columns dropped");
+    for(size_t t = 0; t < 4; t++) {
+        free_report(reports[t]);
+    }
+    for(size_t t = 0; t < 3; t++) {
+        betree_free(trees[t]);
+    }
+    return 0;
+}
+
+int test_jit()
+{
+    enum { event_count = 300 };
+    struct betree* trees[2] = { betree_make(), betree_make() };
+    for(size_t t = 0; t < 2; t++) {
+        betree_add_integer_variable(trees[t], "i", true, -100, 100);
+        betree_add_string_variable(trees[t], "s", true, 8);
+        betree_add_integer_enum_variable(trees[t], "e", true, 8);
+        betree_add_boolean_variable(trees[t], "b", true);
+        betree_add_float_variable(trees[t], "f", true, 0., 10.);
+        betree_add_integer_list_variable(trees[t], "l", true, 0, 10);
+    }
+#ifdef BETREE_JIT
+    mu_assert(betree_set_jit_threshold(trees[1], 5), "native tier built in");
+#else
+    mu_assert(!betree_set_jit_threshold(trees[1], 5), "no native tier");
+#endif
+    const char* exprs[] = {
+        "i < -3 and s = \"v1\"",
+        "i >= 40 or not b",
+        "(i <> 7 and e = 3) or (i <= 0 and i > -50)",
+        "b and f > 2.5 and 1 in l",
+        "not (s <> \"v2\") or e <> 5",
+        "i = 12 or (l one of (3, 4) and not (i < 0))",
+        "true and (b or false)",
+        "i is null or s in (\"v3\", \"v4\")",
+    };
+    size_t expr_count = sizeof(exprs) / sizeof(*exprs);
+    for(size_t i = 0; i < expr_count; i++) {
+        for(size_t t = 0; t < 2; t++) {
+            mu_assert(betree_insert(trees[t], i, exprs[i]), "");
+        }
+    }
+
+    struct report* reports[2] = { make_report(), make_report() };
+    srand(52);
+    for(size_t e = 0; e < event_count; e++) {
+        char event[256];
+        size_t length = sprintf(event, "{\"s\": \"v%d\", \"e\": %d, \"f\": %d.5, \"l\": [%d, %d]",
+            rand() % 8, rand() % 8, rand() % 10, rand() % 10, rand() % 10);
+        // Leave some out so the undefined paths run too
+        if(rand() % 4 != 0) {
+            length += sprintf(event + length, ", \"i\": %d", rand() % 200 - 100);
+        }
+        if(rand() % 4 != 0) {
+            length += sprintf(event + length, ", \"b\": %s", rand() % 2 ? "true" : "false");
+        }
+        strcpy(event + length, "}");
+        for(size_t t = 0; t < 2; t++) {
+            betree_report_reset(reports[t]);
+            mu_assert(betree_search(trees[t], event, reports[t]), "");
+        }
+        mu_assert(same_matches(reports[0], reports[1]), "same matches");
+    }
+#ifdef BETREE_JIT
+    const struct betree_sub* sub = trees[1]->cnode->lnode->subs[0];
+    mu_assert(sub->native != NULL && sub->jit_countdown == 0, "hot sub compiled");
+    struct betree_memory_stats stats[2];
+    betree_memory_stats(trees[0], &stats[0]);
+    betree_memory_stats(trees[1], &stats[1]);
+    mu_assert(stats[1].subs.bytes > stats[0].subs.bytes, "native code counted");
+#endif
+    for(size_t t = 0; t < 2; t++) {
+        free_report(reports[t]);
+        betree_free(trees[t]);
+    }
+    return 0;
+}
+
+int test_lnode_short_circuits()
+{
+    enum { attr_count = 70, sub_count = 200 };
+    struct betree* tree = betree_make_with_parameters(255, 255);
+    for(size_t i = 0; i < attr_count; i++) {
+        char name[8];
+        sprintf(name, "b%zu", i);
+        betree_add_boolean_variable(tree, name, true);
+    }
+    srand(19);
+    size_t lhs[sub_count], rhs[sub_count];
+    for(size_t i = 0; i < sub_count; i++) {
+        char expr[64];
+        lhs[i] = rand() % attr_count;
+        rhs[i] = rand() % attr_count;
+        sprintf(expr, "b%zu and not b%zu", lhs[i], rhs[i]);
+        mu_assert(betree_insert(tree, i, expr), "");
+    }
+    const struct lnode* lnode = tree->cnode->lnode;
+    mu_assert(lnode->sub_count == sub_count && lnode->short_circuits.word_count == 2, "one lnode over two words");
+
+    // Deleting keeps the masks in step with the subs
+    for(size_t i = 0; i < sub_count; i += 7) {
+        mu_assert(betree_delete(tree, i), "");
+    }
+    struct report* report = make_report();
+    for(size_t e = 0; e < 100; e++) {
+        bool defined[attr_count], values[attr_count];
+        char event[2048] = "{";
+        for(size_t i = 0; i < attr_count; i++) {
+            defined[i] = rand() % 4 != 0;
+            values[i] = rand() % 2;
+            if(defined[i]) {
+                sprintf(event + strlen(event), "%s\"b%zu\": %s", strlen(event) > 1 ? ", " : "", i,
+                    values[i] ? "true" : "false");
+            }
+        }
+        strcat(event, "}");
+        size_t expected = 0, shorted = 0;
+        for(size_t i = 0; i < sub_count; i++) {
+            if(i % 7 == 0) {
+                continue;
+            }
+            expected += defined[lhs[i]] && values[lhs[i]] && !(defined[rhs[i]] && values[rhs[i]]);
+            shorted += !defined[lhs[i]];
+        }
+        betree_report_reset(report);
+        mu_assert(betree_search(tree, event, report), "");
+        mu_assert(report->matched == expected, "same matches");
+        mu_assert(report->evaluated == lnode->sub_count && report->shorted >= shorted, "all shorted subs counted");
+        for(size_t i = 1; i < report->matched; i++) {
+            mu_assert(report->subs[i - 1] < report->subs[i], "reported in lnode order");
+        }
+    }
+    free_report(report);
+    betree_free(tree);
+    return 0;
+}
+
+int test_iterative_search()
+{
+    struct betree* tree = betree_make_with_parameters(4, 2);
+    betree_add_integer_variable(tree, "a", false, 0, 100);
+    betree_add_integer_variable(tree, "b", true, 0, 100);
+    for(size_t i = 0; i < 200; i++) {
+        char expr[64];
+        if(i % 2 == 0) {
+            sprintf(expr, "a >= %zu and a <= %zu", i / 2, i / 2 + i % 7);
+        }
+        else {
+            sprintf(expr, "b = %zu", i % 100);
+        }
+        mu_assert(betree_insert(tree, i, expr), "");
+    }
+    struct report* recursive = make_report();
+    struct report* iterative = make_report();
+    for(size_t a = 0; a <= 100; a += 3) {
+        char event[64];
+        sprintf(event, "{\"a\": %zu, \"b\": %zu}", a, 100 - a);
+        betree_report_reset(recursive);
+        betree_report_reset(iterative);
+        betree_set_recursive_search(tree, true);
+        mu_assert(betree_search(tree, event, recursive), "");
+        betree_set_recursive_search(tree, false);
+        mu_assert(betree_search(tree, event, iterative), "");
+        mu_assert(recursive->matched == iterative->matched && recursive->evaluated == iterative->evaluated, "same work");
+        for(size_t i = 0; i < recursive->matched; i++) {
+            mu_assert(recursive->subs[i] == iterative->subs[i], "same order");
+        }
+    }
+    free_report(recursive);
+    free_report(iterative);
+    betree_free(tree);
+    return 0;
+}
+
+static bool is_pdir_sorted(const struct pdir* pdir)
+{
+    for(size_t i = 1; i < pdir->pnode_count; i++) {
+        if(pdir->pnodes[i - 1]->attr_var.var >= pdir->pnodes[i]->attr_var.var) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int test_sorted_pdir()
+{
+    struct betree* tree = betree_make_with_parameters(2, 1);
+    for(size_t i = 0; i < 32; i++) {
+        char name[8];
+        sprintf(name, "a%zu", i);
+        betree_add_integer_variable(tree, name, i % 4 != 0, 0, 10);
+    }
+    // Inserted backwards so pnodes would otherwise come in reverse
+    for(size_t i = 32; i-- > 0;) {
+        for(size_t j = 0; j < 3; j++) {
+            char expr[32];
+            sprintf(expr, "a%zu = %zu", i, j);
+            mu_assert(betree_insert(tree, i * 3 + j, expr), "");
+        }
+    }
+    const struct pdir* pdir = tree->cnode->pdir;
+    mu_assert(pdir != NULL && pdir->pnode_count > 1 && is_pdir_sorted(pdir), "sorted");
+
+    // The attributes every event must have are given a value no sub wants
+    char event[256] = "{\"a5\": 1, \"a30\": 2";
+    for(size_t i = 0; i < 32; i += 4) {
+        sprintf(event + strlen(event), ", \"a%zu\": 9", i);
+    }
+    strcat(event, "}");
+    struct report* report = make_report();
+    mu_assert(betree_search(tree, event, report), "");
+    mu_assert(report->matched == 2, "found the present attributes");
+    for(size_t j = 0; j < 3; j++) {
+        mu_assert(betree_delete(tree, 5 * 3 + j), "");
+    }
+    mu_assert(is_pdir_sorted(tree->cnode->pdir), "still sorted");
+    betree_report_reset(report);
+    mu_assert(betree_search(tree, event, report), "");
+    mu_assert(report->matched == 1 && report->subs[0] == 30 * 3 + 2, "found the one left");
+
+    free_report(report);
+    betree_free(tree);
+    return 0;
+}
+
+int test_required_attrs()
+{
+    struct betree* tree = betree_make_with_parameters(4, 2);
+    betree_add_integer_variable(tree, "x", true, 0, 100);
+    betree_add_integer_variable(tree, "y", true, 0, 100);
+    for(size_t i = 0; i < 200; i++) {
+        char expr[64];
+        sprintf(expr, "x = %zu and y > 3", i % 100);
+        mu_assert(betree_insert(tree, i, expr), "");
+    }
+    for(size_t i = 200; i < 210; i++) {
+        mu_assert(betree_insert(tree, i, "y = 1"), "");
+    }
+    const struct cnode* cnode = tree->cnode->pdir->pnodes[0]->cdir->cnode;
+    mu_assert(cnode->required != NULL && test_bit(cnode->required, 0), "x required under its pnode");
+    mu_assert(!test_bit(tree->cnode->required, 0), "not for the whole tree");
+
+    // Without x the subtrees that need it are skipped instead of each sub failing its short circuit
+    struct report* report = make_report();
+    mu_assert(betree_search(tree, "{\"y\": 1}", report), "");
+    mu_assert(report->matched == 10 && report->evaluated < 100, "skipped the x subs");
+
+    const char* path = "/tmp/betree_required_test.bin";
+    mu_assert(betree_save(tree, path), "saved");
+    struct betree* loaded = betree_load(path);
+    mu_assert(loaded != NULL, "loaded");
+    struct report* loaded_report = make_report();
+    mu_assert(betree_search(loaded, "{\"y\": 1}", loaded_report), "");
+    mu_assert(loaded_report->matched == 10 && loaded_report->evaluated == report->evaluated, "same skips once loaded");
+    remove(path);
+
+    free_report(loaded_report);
+    free_report(report);
+    betree_free(loaded);
+    betree_free(tree);
+    return 0;
+}
+
+int test_string_matchers()
+{
+    const char* words[] = { "he", "she", "his", "hers", "", "ers", "abc", "me" };
+    const char* ops[] = { "contains", "starts_with", "ends_with" };
+    struct betree* trees[2] = { betree_make(), betree_make() };
+    for(size_t t = 0; t < 2; t++) {
+        betree_add_string_variable(trees[t], "s", true, 64);
+        betree_add_string_variable(trees[t], "u", false, 64);
+    }
+    size_t id = 0;
+    for(size_t w = 0; w < sizeof(words) / sizeof(*words); w++) {
+        for(size_t o = 0; o < 3; o++) {
+            char expr[64];
+            sprintf(expr, "%s(%s, \"%s\")", ops[o], w % 2 == 0 ? "s" : "u", words[w]);
+            for(size_t t = 0; t < 2; t++) {
+                mu_assert(betree_insert(trees[t], id, expr), "");
+            }
+            id++;
+        }
+    }
+    // Shared with another sub, the node keeps its pattern
+    for(size_t t = 0; t < 2; t++) {
+        mu_assert(betree_insert(trees[t], id, "contains(s, \"she\") and u = \"ushers\""), "");
+    }
+    betree_pack(trees[0]);
+    mu_assert(trees[0]->config->pred_map->strings->matcher_count == 2, "one matcher per attribute");
+
+    const char* events[] = {
+        "{\"s\": \"ushers\", \"u\": \"ushers\"}",
+        "{\"s\": \"hishe\", \"u\": \"me\"}",
+        "{\"u\": \"abcers\"}",
+        "{\"s\": \"\", \"u\": \"h\"}",
+    };
+    struct report* reports[2] = { make_report(), make_report() };
+    for(size_t round = 0; round < 2; round++) {
+        for(size_t e = 0; e < sizeof(events) / sizeof(*events); e++) {
+            for(size_t t = 0; t < 2; t++) {
+                betree_report_reset(reports[t]);
+                mu_assert(betree_search(trees[t], events[e], reports[t]), "");
+            }
+            mu_assert(reports[0]->matched == reports[1]->matched, "same matches");
+            for(size_t i = 0; i < reports[0]->matched; i++) {
+                mu_assert(reports[0]->subs[i] == reports[1]->subs[i], "same subs");
+            }
+            mu_assert(reports[0]->memoized > reports[1]->memoized, "decided by the matchers");
+        }
+        // Random strings over the letters of the patterns
+        srand(31);
+        for(size_t e = 0; e < 200; e++) {
+            char value[2][16];
+            for(size_t v = 0; v < 2; v++) {
+                size_t length = rand() % 9;
+                for(size_t i = 0; i < length; i++) {
+                    value[v][i] = "hesrabcmi"[rand() % 9];
+                }
+                value[v][length] = '\0';
+            }
+            char event[64];
+            sprintf(event, "{\"s\": \"%s\", \"u\": \"%s\"}", value[0], value[1]);
+            for(size_t t = 0; t < 2; t++) {
+                betree_report_reset(reports[t]);
+                mu_assert(betree_search(trees[t], event, reports[t]), "");
+            }
+            mu_assert(reports[0]->matched == reports[1]->matched, "same random matches");
+        }
+        // Removed patterns leave the built matchers correct
+        for(size_t t = 0; t < 2 && round == 0; t++) {
+            mu_assert(betree_delete(trees[t], 1), "");
+            mu_assert(betree_delete(trees[t], 9), "");
+        }
+    }
+    free_report(reports[0]);
+    free_report(reports[1]);
+    betree_free(trees[0]);
+    betree_free(trees[1]);
+    return 0;
+}
+
+int test_balanced_splits()
+{
+    enum { sub_count = 400 };
+    struct betree* trees[2] = { betree_make_with_parameters(8, 4), betree_make_with_parameters(8, 4) };
+    betree_set_balanced_splits(trees[1], false);
+    srand(26);
+    for(size_t t = 0; t < 2; t++) {
+        betree_add_integer_variable(trees[t], "p", false, 0, 999);
+    }
+    // Most prices are low, a few spread over the whole range
+    for(size_t i = 0; i < sub_count; i++) {
+        char expr[64];
+        int low = rand() % 40;
+        int high = rand() % 1000;
+        sprintf(expr, i % 10 == 0 ? "p > %d" : "p = %d", i % 10 == 0 ? high : low);
+        for(size_t t = 0; t < 2; t++) {
+            mu_assert(betree_insert(trees[t], i, expr), "");
+        }
+    }
+    mu_assert(trees[0]->cnode->pdir != NULL && trees[1]->cnode->pdir != NULL, "partitioned");
+
+    struct report* reports[2] = { make_report(), make_report() };
+    size_t evaluated[2] = { 0, 0 };
+    for(int price = 0; price < 1000; price += 7) {
+        char event[32];
+        sprintf(event, "{\"p\": %d}", price);
+        for(size_t t = 0; t < 2; t++) {
+            betree_report_reset(reports[t]);
+            mu_assert(betree_search(trees[t], event, reports[t]), "");
+            evaluated[t] += reports[t]->evaluated;
+        }
+        mu_assert(reports[0]->matched == reports[1]->matched, "same matches");
+    }
+    mu_assert(evaluated[0] < evaluated[1], "fewer evaluated subs");
+    for(size_t t = 0; t < 2; t++) {
+        free_report(reports[t]);
+        betree_free(trees[t]);
+    }
+    return 0;
+}
+
+int test_negated_bounds()
+{
+    // Enough subs on i for cdirs to split on it under both kinds of splits
+    struct betree* trees[2] = { betree_make_with_parameters(8, 4), betree_make_with_parameters(8, 4) };
+    betree_set_balanced_splits(trees[1], false);
+    bool found = true;
+    for(size_t t = 0; t < 2; t++) {
+        betree_add_integer_variable(trees[t], "i", false, 0, 100);
+        betree_add_string_variable(trees[t], "t", true, 10);
+        for(size_t id = 0; id < 400; id++) {
+            char expr[32];
+            sprintf(expr, "i = %zu", id % 90);
+            mu_assert(betree_insert(trees[t], id, expr), "");
+        }
+        // True whenever t doesn't end with ac, so its bound on i is the whole domain
+        mu_assert(betree_insert(trees[t], 1000, "not ((ends_with(t, \"ac\")) and (i > 2))"), "");
+        mu_assert(trees[t]->cnode->pdir != NULL, "partitioned");
+        const char* events[] = { "{\"i\": 12, \"t\": \"c\"}", "{\"i\": 10}", "{\"i\": 95, \"t\": \"zz\"}" };
+        for(size_t e = 0; e < sizeof(events) / sizeof(*events); e++) {
+            struct report* report = make_report();
+            mu_assert(betree_search(trees[t], events[e], report), "");
+            bool has_sub = false;
+            for(size_t i = 0; i < report->matched; i++) {
+                has_sub |= report->subs[i] == 1000;
+            }
+            found &= has_sub;
+            free_report(report);
+        }
+        betree_free(trees[t]);
+    }
+    mu_assert(found, "negated conjunction matches outside its operands' bounds");
+    return 0;
+}
+
+int test_rebalance()
+{
+    enum { sub_count = 300, event_count = 200 };
+    struct betree* tree = betree_make_with_parameters(8, 4);
+    betree_add_integer_variable(tree, "x", false, 0, 10);
+    betree_add_integer_variable(tree, "y", false, 0, 500);
+    // x has the narrower domain so it is partitioned on first, but nearly every sub and event has x = 5
+    for(size_t i = 0; i < sub_count; i++) {
+        char expr[64];
+        sprintf(expr, "x = %zu and y = %zu", i % 10 == 0 ? i % 11 : 5, i);
+        mu_assert(betree_insert(tree, i, expr), "");
+    }
+    betree_var_t y = tree->config->attr_domains[1]->attr_var.var;
+    mu_assert(tree->cnode->pdir->pnodes[0]->attr_var.var != y, "x partitioned first");
+
+    struct betree_event_sample* sample = betree_make_event_sample(64);
+    char events[event_count][64];
+    srand(25);
+    for(size_t e = 0; e < event_count; e++) {
+        sprintf(events[e], "{\"x\": 5, \"y\": %d}", rand() % sub_count);
+        mu_assert(betree_sample_event(sample, tree, events[e]), "");
+    }
+
+    struct report* before[event_count];
+    size_t evaluated_before = 0;
+    for(size_t e = 0; e < event_count; e++) {
+        before[e] = make_report();
+        mu_assert(betree_search(tree, events[e], before[e]), "");
+        evaluated_before += before[e]->evaluated;
+    }
+    betree_rebalance(tree, sample);
+    mu_assert(tree->cnode->pdir->pnodes[0]->attr_var.var == y, "y prunes the sampled events more");
+    size_t evaluated_after = 0;
+    struct report* report = make_report();
+    for(size_t e = 0; e < event_count; e++) {
+        betree_report_reset(report);
+        mu_assert(betree_search(tree, events[e], report), "");
+        evaluated_after += report->evaluated;
+        mu_assert(report->matched == before[e]->matched, "same matches");
+        if(report->matched > 1) {
+            qsort(report->subs, report->matched, sizeof(*report->subs), sub_id_cmp);
+            qsort(before[e]->subs, before[e]->matched, sizeof(*before[e]->subs), sub_id_cmp);
+        }
+        for(size_t i = 0; i < report->matched; i++) {
+            mu_assert(report->subs[i] == before[e]->subs[i], "same subs");
+        }
+    }
+    mu_assert(evaluated_after < evaluated_before, "fewer candidates");
+    mu_assert(betree_delete(tree, 1) && betree_insert(tree, 1, "x = 5 and y = 1"), "still updatable");
+
+    // The live version is rebuilt on the side
+    struct betree_live* live = betree_live_make(tree);
+    struct betree_live_reader* reader = betree_live_register(live);
+    const struct betree* pinned = betree_live_pin(reader);
+    betree_live_rebalance(live, sample);
+    betree_report_reset(report);
+    mu_assert(betree_search(pinned, "{\"x\": 5, \"y\": 1}", report), "");
+    mu_assert(report->matched == 1, "pinned version untouched");
+    betree_live_unpin(reader);
+    betree_report_reset(report);
+    mu_assert(betree_live_search(reader, "{\"x\": 5, \"y\": 1}", report), "");
+    mu_assert(report->matched == 1 && report->subs[0] == 1, "rebalanced version searched");
+    betree_live_unregister(reader);
+
+    for(size_t e = 0; e < event_count; e++) {
+        free_report(before[e]);
+    }
+    free_report(report);
+    betree_free_event_sample(sample);
+    betree_live_free(live);
+    return 0;
+}
+
+#ifdef BETREE_STATS
+static uint64_t lnode_matches(const struct cnode* cnode);
+
+static uint64_t cdir_matches(const struct cdir* cdir)
+{
+    if(cdir == NULL) {
+        return 0;
+    }
+    return lnode_matches(cdir->cnode) + cdir_matches(cdir->lchild) + cdir_matches(cdir->rchild);
+}
+
+static uint64_t lnode_matches(const struct cnode* cnode)
+{
+    uint64_t matches = cnode->lnode->stats.matches;
+    if(cnode->pdir != NULL) {
+        for(size_t i = 0; i < cnode->pdir->pnode_count; i++) {
+            matches += cdir_matches(cnode->pdir->pnodes[i]->cdir);
+        }
+    }
+    return matches;
+}
+
+int test_search_stats()
+{
+    struct betree* tree = betree_make_with_parameters(4, 2);
+    betree_add_integer_variable(tree, "i", false, 0, 100);
+    betree_add_boolean_variable(tree, "b", true);
+    for(size_t i = 0; i < 60; i++) {
+        char expr[64];
+        sprintf(expr, i % 3 == 0 ? "b and i > %zu" : "i = %zu", i % 40);
+        mu_assert(betree_insert(tree, i, expr), "");
+    }
+    mu_assert(tree->cnode->pdir != NULL, "partitioned");
+
+    struct report* report = make_report();
+    uint64_t matched = 0;
+    for(size_t e = 0; e < 50; e++) {
+        char event[64];
+        sprintf(event, e % 2 == 0 ? "{\"i\": %zu, \"b\": true}" : "{\"i\": %zu}", e % 45);
+        betree_report_reset(report);
+        mu_assert(betree_search(tree, event, report), "");
+        matched += report->matched;
+    }
+    mu_assert(tree->cnode->stats.visits == 50, "root visited once per search");
+    mu_assert(lnode_matches(tree->cnode) == matched, "matches counted once under their lnode");
+
+    betree_reset_stats(tree);
+    mu_assert(tree->cnode->stats.visits == 0 && lnode_matches(tree->cnode) == 0, "stats reset");
+
+    free_report(report);
+    betree_free(tree);
+    return 0;
+}
+
+int test_sub_stats()
+{
+    struct betree* tree = betree_make_with_parameters(4, 2);
+    betree_add_integer_variable(tree, "i", false, 0, 100);
+    betree_add_boolean_variable(tree, "b", true);
+    for(size_t i = 0; i < 20; i++) {
+        char expr[64];
+        sprintf(expr, i % 2 == 0 ? "b is null or i > %zu" : "i = %zu", i);
+        mu_assert(betree_insert(tree, i, expr), "");
+    }
+    struct report* report = make_report();
+    uint64_t matched = 0;
+    for(size_t e = 0; e < 30; e++) {
+        char event[64];
+        sprintf(event, e % 3 == 0 ? "{\"i\": %zu}" : "{\"i\": %zu, \"b\": true}", e % 25);
+        betree_report_reset(report);
+        mu_assert(betree_search(tree, event, report), "");
+        matched += report->matched;
+    }
+
+    struct betree_sub_stats stats[20];
+    mu_assert(betree_most_expensive_subs(tree, 5, stats) == 5, "only n kept");
+    mu_assert(betree_most_expensive_subs(tree, 20, stats) == 20, "every sub");
+    uint64_t passes = 0, shorted = 0;
+    for(size_t i = 0; i < 20; i++) {
+        mu_assert(i == 0 || stats[i - 1].cycles >= stats[i].cycles, "most expensive first");
+        mu_assert(stats[i].passes <= stats[i].evaluations + stats[i].shorted, "passed once looked at");
+        passes += stats[i].passes;
+        shorted += stats[i].shorted;
+    }
+    mu_assert(passes == matched, "every match counted");
+    // The "b is null or" subs short circuit on the events without b
+    mu_assert(shorted != 0, "short circuits counted");
+
+    betree_reset_stats(tree);
+    mu_assert(betree_most_expensive_subs(tree, 1, stats) == 1 && stats[0].evaluations == 0, "stats reset");
+
+    free_report(report);
+    betree_free(tree);
+    return 0;
+}
+#endif
+
 int all_tests()
 {
     mu_run_test(test_int_enum);
     mu_run_test(test_sub_has_attribute);
+    mu_run_test(test_sub_masks_trimmed);
     mu_run_test(test_match_single_cnode);
     mu_run_test(test_insert_first_split);
     mu_run_test(test_pdir_split_twice);
     mu_run_test(test_cdir_split_twice);
-    /*mu_run_test(test_remove_sub_in_tree);*/
-    /*mu_run_test(test_remove_sub_in_tree_with_delete);*/
+    mu_run_test(test_remove_sub_in_tree);
+    mu_run_test(test_remove_sub_in_tree_with_delete);
+    mu_run_test(test_delete_merges_clusters);
+    mu_run_test(test_delete_then_insert_same_expr);
+    mu_run_test(test_sub_index);
     mu_run_test(test_match_deeper);
     mu_run_test(test_large_cdir_split);
     mu_run_test(test_min_partition);
     mu_run_test(test_allow_undefined);
     mu_run_test(test_float);
     mu_run_test(test_string);
+    mu_run_test(test_many_values);
+    mu_run_test(test_many_attributes);
     mu_run_test(test_string_wont_split);
     mu_run_test(test_negative_int);
     mu_run_test(test_negative_float);
@@ -1683,6 +4943,7 @@ int all_tests()
     mu_run_test(test_set_bug_cdir);
     mu_run_test(test_undefined_cdir_search);
     mu_run_test(test_api);
+    mu_run_test(test_api_from_array);
     mu_run_test(test_inverted_binop);
     mu_run_test(test_float_no_point_in_expr);
     mu_run_test(test_is_null);
@@ -1694,6 +4955,48 @@ int all_tests()
     mu_run_test(test_frequency_bug);
     mu_run_test(test_duplicate_unsorted_integer_list);
     mu_run_test(test_duplicate_unsorted_string_list);
+    mu_run_test(test_search_context);
+    mu_run_test(test_search_batch);
+    mu_run_test(test_insert_all);
+    mu_run_test(test_snapshot);
+    mu_run_test(test_search_limit);
+    mu_run_test(test_search_each);
+    mu_run_test(test_search_threads);
+    mu_run_test(test_search_cursor);
+    mu_run_test(test_prepared_event);
+    mu_run_test(test_shards);
+    mu_run_test(test_clone);
+    mu_run_test(test_memory_stats);
+    mu_run_test(test_params);
+    mu_run_test(test_parse_cache);
+    mu_run_test(test_result_cache);
+    mu_run_test(test_reorder_expressions);
+    mu_run_test(test_arena);
+    mu_run_test(test_live);
+    mu_run_test(test_special_paths);
+    mu_run_test(test_replicas);
+    mu_run_test(test_engine);
+    mu_run_test(test_activation_windows);
+    mu_run_test(test_search_delta);
+    mu_run_test(test_binary_event);
+    mu_run_test(test_sorted_list_kernels);
+    mu_run_test(test_list_bitmaps);
+    mu_run_test(test_prefilter);
+    mu_run_test(test_columns);
+    mu_run_test(test_jit);
+    mu_run_test(test_order_by_hits);
+    mu_run_test(test_lnode_short_circuits);
+    mu_run_test(test_rebalance);
+    mu_run_test(test_balanced_splits);
+    mu_run_test(test_negated_bounds);
+    mu_run_test(test_iterative_search);
+    mu_run_test(test_sorted_pdir);
+    mu_run_test(test_required_attrs);
+    mu_run_test(test_string_matchers);
+#ifdef BETREE_STATS
+    mu_run_test(test_search_stats);
+    mu_run_test(test_sub_stats);
+#endif
 
     return 0;
 }
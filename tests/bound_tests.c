@@ -161,6 +161,12 @@ int test_integer_bounds()
     /*mu_assert(match_integer(tree->config, "i not in ()", min, max), "empty not in");*/
     /*mu_assert(match_integer(tree->config, "not (i not in ())", min, max), "not (empty not in)");*/
 
+    mu_assert(match_integer(tree->config, "i > 1 and wrong", 2, max), "and");
+    mu_assert(match_integer(tree->config, "not (i > 1 and wrong)", min, max), "not (and)");
+    mu_assert(match_integer(tree->config, "not (i > 1 and i < 5)", min, max), "not (and) of both sides");
+    mu_assert(match_integer(tree->config, "i < 1 or wrong", min, max), "or");
+    mu_assert(match_integer(tree->config, "not (i < 1 or i > 5)", 1, 5), "not (or)");
+
     mu_assert(match_integer(tree->config, "wrong", min, max), "not in expression");
 
     betree_free(tree);
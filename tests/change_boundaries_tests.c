@@ -9,6 +9,7 @@
 #include "helper.h"
 #include "minunit.h"
 #include "printer.h"
+#include "sub_index.h"
 #include "tree.h"
 #include "utils.h"
 
@@ -228,6 +229,31 @@ int test_integer_list()
     return 0;
 }
 
+int test_cached_bounds()
+{
+    struct betree* tree = betree_make();
+    add_attr_domain_i(tree->config, "i", false);
+    mu_assert(betree_insert(tree, 1, "i <> 5"), "");
+    const struct betree_sub* sub = sub_index_find(tree->sub_index, 1);
+    const struct attr_domain* domain = tree->config->attr_domains[0];
+
+    struct value_bound before = get_sub_bound(domain, sub);
+    mu_assert(before.imin == INT64_MIN && before.imax == INT64_MAX, "whole domain");
+    mu_assert(sub->bound_count == 1, "cached");
+    before = get_sub_bound(domain, sub);
+    mu_assert(sub->bound_count == 1, "cached once");
+
+    betree_change_boundaries(tree, "i > 2");
+    betree_change_boundaries(tree, "i < 8");
+    struct value_bound after = get_sub_bound(domain, sub);
+    struct value_bound expected = get_variable_bound(domain, sub->expr);
+    mu_assert(after.imin == 3 && after.imax == 7, "follows the domain");
+    mu_assert(after.imin == expected.imin && after.imax == expected.imax, "");
+
+    betree_free(tree);
+    return 0;
+}
+
 int test_normal()
 {
     struct betree* tree = betree_make();
@@ -266,6 +292,69 @@ int test_normal()
     return 0;
 }
 
+static bool search_count(struct betree* tree, int64_t i, size_t* matched, size_t* evaluated)
+{
+    char event[64];
+    sprintf(event, "{\"i\": %ld}", i);
+    struct report* report = make_report();
+    bool found = betree_search(tree, event, report);
+    *matched = report->matched;
+    *evaluated = report->evaluated;
+    free_report(report);
+    return found;
+}
+
+int test_widen_tree()
+{
+    struct betree* tree = betree_make();
+    add_attr_domain_i(tree->config, "i", false);
+    betree_change_boundaries(tree, "i = 0");
+    betree_change_boundaries(tree, "i = 99");
+    char expr[32];
+    for(size_t id = 0; id < 50; id++) {
+        sprintf(expr, "i = %zu", id * 2);
+        mu_assert(betree_insert(tree, id, expr), "");
+    }
+    // Past the domain, they fit in none of the children of the top cdir
+    for(size_t id = 50; id < 70; id++) {
+        sprintf(expr, "i = %zu", 100 + id);
+        mu_assert(betree_insert(tree, id, expr), "");
+    }
+    mu_assert(tree->cnode->pdir != NULL && tree->cnode->pdir->pnode_count == 1, "partitioned on i");
+    struct cdir* top = tree->cnode->pdir->pnodes[0]->cdir;
+    const struct lnode* top_lnode = top->cnode->lnode;
+    mu_assert(top->lchild != NULL && top->bound.imax == 99, "split in the old domain");
+    mu_assert(sub_index_find(tree->sub_index, 60)->lnode == top_lnode, "stuck on top");
+    size_t stuck = top_lnode->sub_count;
+
+    mu_assert(betree_change_boundaries(tree, "i < 400"), "");
+    mu_assert(top->bound.imin == 0 && top->bound.imax == 399, "top widened");
+    for(const struct cdir* cdir = top; cdir != NULL; cdir = cdir->rchild) {
+        mu_assert(cdir->bound.imax == 399, "right side widened");
+    }
+    mu_assert(top_lnode->sub_count + 20 <= stuck, "pushed down");
+    mu_assert(sub_index_find(tree->sub_index, 60)->lnode != top_lnode, "moved");
+    for(size_t id = 70; id < 100; id++) {
+        sprintf(expr, "i = %zu", 300 + id);
+        mu_assert(betree_insert(tree, id, expr), "");
+    }
+    mu_assert(top_lnode->sub_count + 20 <= stuck, "new subs go down too");
+
+    bool matched_all = true;
+    size_t max_evaluated = 0;
+    for(int64_t i = 0; i < 410; i++) {
+        size_t matched, evaluated;
+        mu_assert(search_count(tree, i, &matched, &evaluated), "");
+        bool expected = (i < 100 && i % 2 == 0) || (i >= 150 && i < 170) || (i >= 370 && i < 400);
+        matched_all &= matched == (expected ? 1 : 0);
+        max_evaluated = evaluated > max_evaluated ? evaluated : max_evaluated;
+    }
+    mu_assert(matched_all, "same matches");
+    mu_assert(max_evaluated < 10, "few candidates on the widened side");
+    betree_free(tree);
+    return 0;
+}
+
 int all_tests()
 {
     mu_run_test(test_integer);
@@ -274,6 +363,8 @@ int all_tests()
     mu_run_test(test_integer_set_left);
     mu_run_test(test_integer_set_right);
     mu_run_test(test_normal);
+    mu_run_test(test_cached_bounds);
+    mu_run_test(test_widen_tree);
 
     return 0;
 }
@@ -3,6 +3,8 @@
 #include <string.h>
 
 #include "ast.h"
+#include "betree.h"
+#include "event_scanner.h"
 #include "minunit.h"
 #include "tree.h"
 #include "utils.h"
@@ -147,8 +149,8 @@ bool test_segment_list_pred(
         && (test_empty_list(pred) || pred->value.value_type == BETREE_SEGMENTS)) {
         if(list->size == pred->value.segments_value->size) {
             for(size_t i = 0; i < list->size; i++) {
-                struct betree_segment* target = list->content[i];
-                struct betree_segment* value = pred->value.segments_value->content[i];
+                struct betree_segment* target = &list->content[i];
+                struct betree_segment* value = &pred->value.segments_value->content[i];
                 if(target->id != value->id || target->timestamp != value->timestamp) {
                     return false;
                 }
@@ -171,7 +173,7 @@ bool test_segment_list_pred1(
     const char* attr, int64_t id1, int64_t timestamp1, const struct betree_event* event, size_t index)
 {
     struct betree_segments* list = make_segments();
-    struct betree_segment* s1 = make_segment(id1, timestamp1);
+    struct betree_segment s1 = make_segment(id1, timestamp1);
     add_segment(s1, list);
     bool result = test_segment_list_pred(attr, list, event, index);
     free_segments(list);
@@ -187,8 +189,8 @@ bool test_segment_list_pred2(const char* attr,
     size_t index)
 {
     struct betree_segments* list = make_segments();
-    struct betree_segment* s1 = make_segment(id1, timestamp1);
-    struct betree_segment* s2 = make_segment(id2, timestamp2);
+    struct betree_segment s1 = make_segment(id1, timestamp1);
+    struct betree_segment s2 = make_segment(id2, timestamp2);
     add_segment(s1, list);
     add_segment(s2, list);
     bool result = test_segment_list_pred(attr, list, event, index);
@@ -204,8 +206,8 @@ bool test_frequency_list_pred(
         && (test_empty_list(pred) || pred->value.value_type == BETREE_FREQUENCY_CAPS)) {
         if(list->size == pred->value.frequency_caps_value->size) {
             for(size_t i = 0; i < list->size; i++) {
-                struct betree_frequency_cap* target = list->content[i];
-                struct betree_frequency_cap* value = pred->value.frequency_caps_value->content[i];
+                struct betree_frequency_cap* target = &list->content[i];
+                struct betree_frequency_cap* value = &pred->value.frequency_caps_value->content[i];
                 if(target->id != value->id || target->timestamp != value->timestamp
                     || target->timestamp_defined != value->timestamp_defined
                     || target->type != value->type || target->value != value->value
@@ -238,7 +240,7 @@ bool test_frequency_list_pred1(const char* attr,
 {
     struct betree_frequency_caps* list = make_frequency_caps();
     struct string_value ns1 = { .string = strdup(namespace1) };
-    struct betree_frequency_cap* s1 = make_frequency_cap(type1, id1, ns1, true, timestamp1, value1);
+    struct betree_frequency_cap s1 = make_frequency_cap(type1, id1, ns1, true, timestamp1, value1);
     add_frequency(s1, list);
     bool result = test_frequency_list_pred(attr, list, event, index);
     free_frequency_caps(list);
@@ -261,9 +263,9 @@ bool test_frequency_list_pred2(const char* attr,
 {
     struct betree_frequency_caps* list = make_frequency_caps();
     struct string_value ns1 = { .string = strdup(namespace1) };
-    struct betree_frequency_cap* s1 = make_frequency_cap(type1, id1, ns1, true, timestamp1, value1);
+    struct betree_frequency_cap s1 = make_frequency_cap(type1, id1, ns1, true, timestamp1, value1);
     struct string_value ns2 = { .string = strdup(namespace2) };
-    struct betree_frequency_cap* s2 = make_frequency_cap(type2, id2, ns2, true, timestamp2, value2);
+    struct betree_frequency_cap s2 = make_frequency_cap(type2, id2, ns2, true, timestamp2, value2);
     add_frequency(s1, list);
     add_frequency(s2, list);
     bool result = test_frequency_list_pred(attr, list, event, index);
@@ -416,6 +418,200 @@ int test_null()
     return 0;
 }
 
+static bool same_value(const struct value* a, const struct value* b)
+{
+    if(a->value_type != b->value_type) {
+        return false;
+    }
+    switch(a->value_type) {
+        case BETREE_BOOLEAN: return a->boolean_value == b->boolean_value;
+        case BETREE_INTEGER: return a->integer_value == b->integer_value;
+        case BETREE_FLOAT: return feq(a->float_value, b->float_value);
+        case BETREE_STRING:
+            return a->string_value.str == b->string_value.str
+                && strcmp(a->string_value.string, b->string_value.string) == 0;
+        case BETREE_INTEGER_ENUM: return a->integer_enum_value.ienum == b->integer_enum_value.ienum;
+        case BETREE_INTEGER_LIST:
+            if(a->integer_list_value->count != b->integer_list_value->count) {
+                return false;
+            }
+            for(size_t i = 0; i < a->integer_list_value->count; i++) {
+                if(a->integer_list_value->integers[i] != b->integer_list_value->integers[i]) {
+                    return false;
+                }
+            }
+            return true;
+        case BETREE_STRING_LIST:
+            if(a->string_list_value->count != b->string_list_value->count) {
+                return false;
+            }
+            for(size_t i = 0; i < a->string_list_value->count; i++) {
+                if(a->string_list_value->strings[i].str != b->string_list_value->strings[i].str) {
+                    return false;
+                }
+            }
+            return true;
+        case BETREE_SEGMENTS:
+            if(a->segments_value->size != b->segments_value->size) {
+                return false;
+            }
+            for(size_t i = 0; i < a->segments_value->size; i++) {
+                if(a->segments_value->content[i].id != b->segments_value->content[i].id
+                    || a->segments_value->content[i].timestamp != b->segments_value->content[i].timestamp) {
+                    return false;
+                }
+            }
+            return true;
+        case BETREE_FREQUENCY_CAPS:
+            if(a->frequency_caps_value->size != b->frequency_caps_value->size) {
+                return false;
+            }
+            for(size_t i = 0; i < a->frequency_caps_value->size; i++) {
+                const struct betree_frequency_cap* x = &a->frequency_caps_value->content[i];
+                const struct betree_frequency_cap* y = &b->frequency_caps_value->content[i];
+                if(x->type != y->type || x->id != y->id || x->namespace.str != y->namespace.str
+                    || strcmp(x->namespace.string, y->namespace.string) != 0 || x->timestamp != y->timestamp
+                    || x->value != y->value) {
+                    return false;
+                }
+            }
+            return true;
+        case BETREE_INTEGER_LIST_ENUM:
+        default: return false;
+    }
+}
+
+static bool scanner_matches_parser(const struct betree* tree, const char* text, struct betree_search_context* context)
+{
+    struct betree_event* scanned = scan_event(tree->config, text, context);
+    struct betree_event* parsed = make_event_from_string(tree, text);
+    bool same = scanned != NULL;
+    for(size_t i = 0; same && i < tree->config->attr_domain_count; i++) {
+        const struct betree_variable* expected = NULL;
+        for(size_t j = 0; j < parsed->variable_count; j++) {
+            if(parsed->variables[j] != NULL && parsed->variables[j]->attr_var.var == i) {
+                expected = parsed->variables[j];
+            }
+        }
+        const struct betree_variable* actual = scanned->variables[i];
+        if(expected == NULL || actual == NULL) {
+            same = expected == actual;
+        }
+        else {
+            same = actual->attr_var.var == i && same_value(&actual->value, &expected->value);
+        }
+    }
+    free_event(parsed);
+    return same;
+}
+
+int test_scanner()
+{
+    struct betree* tree = betree_make();
+    betree_add_boolean_variable(tree, "b", true);
+    betree_add_integer_variable(tree, "i", true, 0, 100);
+    betree_add_float_variable(tree, "f", true, 0., 100.);
+    betree_add_string_variable(tree, "s", true, 10);
+    betree_add_integer_list_variable(tree, "il", true, 0, 100);
+    betree_add_string_list_variable(tree, "sl", true, 10);
+    betree_add_segments_variable(tree, "seg", true);
+    betree_add_frequency_caps_variable(tree, "fc", true);
+    betree_add_integer_enum_variable(tree, "e", true, 10);
+    mu_assert(betree_insert(tree, 0, "s = \"a\" and \"x\" in sl and e = 5"), "");
+    struct betree_search_context* context = betree_make_search_context(tree);
+
+    const char* events[] = {
+        "{\"b\": true, \"i\": 10, \"f\": 1.5, \"s\": \"a\"}",
+        "{ \"b\" : false ,\n\t\"i\": - 3, \"f\": -2., 's': 'unknown' }",
+        "{\"il\": [3, 1, 2, 1], \"sl\": [\"y\", \"x\", \"x\"], \"e\": 5}",
+        "{\"il\": [], \"sl\": [], \"seg\": [], \"fc\": []}",
+        "{\"seg\": [[1, 10], [2, 20]], \"s\": \"with \\\" quote\", \"i\": null}",
+        "{\"fc\": [[\"flight\", 1, \"ns\", 2, 3], [[\"campaign:ip\", 4, \"a\"], 5, 6]]}",
+        "{\"i\": 1, \"i\": 2, \"unknown\": null}",
+    };
+    for(size_t i = 0; i < sizeof(events) / sizeof(*events); i++) {
+        mu_assert(scanner_matches_parser(tree, events[i], context), "same event as the parser");
+    }
+
+    // Left to the bison parser
+    mu_assert(scan_event(tree->config, "{}", context) == NULL, "empty event");
+    mu_assert(scan_event(tree->config, "{\"i\": 1.5}", context) == NULL, "float for an integer");
+    mu_assert(scan_event(tree->config, "{\"f\": 1}", context) == NULL, "integer for a float");
+    mu_assert(scan_event(tree->config, "{\"i\": 1e3}", context) == NULL, "exponent");
+    mu_assert(scan_event(tree->config, "{\"i\": 99999999999999999999}", context) == NULL, "overflow");
+    mu_assert(scan_event(tree->config, "{\"i\": 1} x", context) == NULL, "trailing text");
+    mu_assert(scan_event(tree->config, "{\"missing\": 1}", context) == NULL, "unknown attribute");
+
+    // Events bigger than the first scratch block
+    char big[20000];
+    size_t length = sprintf(big, "{\"il\": [0");
+    for(size_t i = 1; i < 2000; i++) {
+        length += sprintf(big + length, ", %zu", i % 100);
+    }
+    sprintf(big + length, "]}");
+    for(size_t i = 0; i < 2; i++) {
+        mu_assert(scanner_matches_parser(tree, big, context), "big event");
+    }
+
+    betree_free_search_context(context);
+    betree_free(tree);
+    return 0;
+}
+
+static bool sorts_like_qsort(size_t count, int64_t range)
+{
+    struct betree_integer_list* list = make_integer_list();
+    int64_t* expected = malloc(sizeof(*expected) * (count + 1));
+    for(size_t i = 0; i < count; i++) {
+        int64_t value = (int64_t)(rand() % (2 * range + 1)) - range;
+        // Large ids so that every byte gets a pass
+        if(i % 3 == 0) {
+            value *= INT64_C(1) << 40;
+        }
+        add_integer_list_value(value, list);
+        expected[i] = value;
+    }
+    qsort(expected, count, sizeof(*expected), icmpfunc);
+    size_t expected_count = 0;
+    for(size_t i = 0; i < count; i++) {
+        if(expected_count == 0 || expected[expected_count - 1] != expected[i]) {
+            expected[expected_count++] = expected[i];
+        }
+    }
+    sort_and_remove_duplicate_integer_list(list);
+    bool same = list->count == expected_count;
+    for(size_t i = 0; same && i < expected_count; i++) {
+        same = list->integers[i] == expected[i];
+    }
+    free(expected);
+    free_integer_list(list);
+    return same;
+}
+
+int test_sorted_lists()
+{
+    srand(35);
+    mu_assert(sorts_like_qsort(0, 10), "empty");
+    mu_assert(sorts_like_qsort(10, 5), "small");
+    mu_assert(sorts_like_qsort(RADIX_SORT_MIN, 1000), "radix smallest");
+    mu_assert(sorts_like_qsort(1000, 100), "radix repeats");
+    mu_assert(sorts_like_qsort(1000, 1000000), "radix wide");
+
+    struct betree* tree = betree_make();
+    betree_add_integer_list_variable(tree, "il", false, INT64_MIN, INT64_MAX);
+    betree_add_segments_variable(tree, "seg", true);
+    betree_add_integer_variable(tree, "now", false, INT64_MIN, INT64_MAX);
+    betree_set_presorted_lists(tree, true);
+    mu_assert(betree_insert(tree, 1, "5 in il"), "");
+    mu_assert(betree_insert(tree, 2, "segment_within(seg, 7, 10)"), "");
+    struct report* report = make_report();
+    mu_assert(betree_search(tree, "{\"il\": [1, 5, 9], \"seg\": [[3, 0], [7, 0]], \"now\": 5}", report), "");
+    mu_assert(report->matched == 2, "presorted");
+    free_report(report);
+    betree_free(tree);
+    return 0;
+}
+
 int all_tests()
 {
     mu_run_test(test_bool);
@@ -427,6 +623,8 @@ int all_tests()
     mu_run_test(test_segment);
     mu_run_test(test_frequency);
     mu_run_test(test_null);
+    mu_run_test(test_scanner);
+    mu_run_test(test_sorted_lists);
     return 0;
 }
 
@@ -306,6 +306,26 @@ int test_sub()
     return 0;
 }
 
+int test_late_memoize_id()
+{
+    struct betree* tree = betree_make();
+    add_attr_domain_bounded_i(tree->config, "i", false, 0, 10);
+
+    mu_assert(betree_insert(tree, 1, "i = 0 or i = 1"), "");
+    const struct betree_sub* first = tree->cnode->lnode->subs[0];
+    mu_assert(first->program->instructions[0].memoize_id == INVALID_PRED, "nothing shared yet");
+    mu_assert(betree_insert(tree, 2, "i = 0 or i = 1"), "");
+    mu_assert(first->program->instructions[0].memoize_id != INVALID_PRED, "first program patched once shared");
+
+    struct report* report = make_report();
+    mu_assert(betree_search(tree, "{\"i\": 1}", report), "");
+    mu_assert(report->matched == 2 && report->memoized == 1, "second sub memoized");
+
+    free_report(report);
+    betree_free(tree);
+    return 0;
+}
+
 int test_bit_logic()
 {
     enum { pred_count = 250 };
@@ -338,6 +358,123 @@ int test_bit_logic()
     return 0;
 }
 
+int test_memoize_reset()
+{
+    struct betree* tree = betree_make();
+    add_attr_domain_bounded_i(tree->config, "i", false, 0, 200);
+    // Every pair of subs shares "i = n", so each of their preds is memoized
+    for(size_t n = 0; n < 100; n++) {
+        char expr[64];
+        sprintf(expr, "i = %zu or i > 150", n);
+        mu_assert(betree_insert(tree, 2 * n, expr), "");
+        mu_assert(betree_insert(tree, 2 * n + 1, expr), "");
+    }
+    struct betree_search_context* context = betree_make_search_context(tree);
+    struct report* report = make_report();
+    for(size_t round = 0; round < 3; round++) {
+        for(size_t n = 0; n < 200; n += 7) {
+            char event[32];
+            sprintf(event, "{\"i\": %zu}", n);
+            betree_report_reset(report);
+            mu_assert(betree_search_with_context(tree, event, report, context), "");
+            size_t expected = n > 150 ? 2 * (100 + round * 10) : (n < 100 + round * 10 ? 2 : 0);
+            mu_assert(report->matched == expected, "nothing left over from the previous search");
+            mu_assert(context->memoize.touched_count != 0, "touched words tracked");
+            mu_assert(context->memoize.touched_count <= context->memoize.word_count, "each word listed once");
+        }
+        // New shared preds grow the bitsets of the context
+        for(size_t n = 100 + round * 10; n < 110 + round * 10; n++) {
+            char expr[64];
+            sprintf(expr, "i = %zu or i > 150", n);
+            mu_assert(betree_insert(tree, 2 * n, expr), "");
+            mu_assert(betree_insert(tree, 2 * n + 1, expr), "");
+        }
+    }
+    free_report(report);
+    betree_free_search_context(context);
+    betree_free(tree);
+    return 0;
+}
+
+int test_shared_subtrees()
+{
+    struct betree* tree = betree_make_with_parameters(16, 16);
+    add_attr_domain_bounded_i(tree->config, "i", false, 0, 10);
+    add_attr_domain_b(tree->config, "b", true);
+
+    mu_assert(betree_insert(tree, 1, "(i = 1 or i = 2) and b"), "");
+    mu_assert(betree_insert(tree, 2, "(i = 1 or i = 2) and not b"), "");
+    mu_assert(betree_insert(tree, 3, "(i = 1 or i = 2) and b"), "");
+    mu_assert(betree_insert(tree, 4, "i = 3 or i = 3"), "");
+    const struct ast_node* first = tree->cnode->lnode->subs[0]->expr;
+    const struct ast_node* second = tree->cnode->lnode->subs[1]->expr;
+    const struct ast_node* third = tree->cnode->lnode->subs[2]->expr;
+    const struct ast_node* fourth = tree->cnode->lnode->subs[3]->expr;
+    mu_assert(first == third && first->ref_count == 2, "whole expression stored once");
+    mu_assert(first->bool_expr.binary.rhs == second->bool_expr.binary.rhs
+            && first->bool_expr.binary.rhs->ref_count == 2,
+        "or subtree stored once");
+    mu_assert(first->memoize_id != INVALID_PRED && first->bool_expr.binary.rhs->memoize_id != INVALID_PRED,
+        "composite nodes memoized");
+    mu_assert(fourth->bool_expr.binary.lhs == fourth->bool_expr.binary.rhs, "operands of one node shared");
+
+    struct report* report = make_report();
+    mu_assert(betree_search(tree, "{\"i\": 2, \"b\": true}", report), "");
+    mu_assert(report->matched == 2 && report->memoized != 0, "shared subs memoized");
+
+    mu_assert(betree_delete(tree, 1), "");
+    mu_assert(betree_delete(tree, 4), "");
+    mu_assert(third->ref_count == 1 && third->bool_expr.binary.rhs->ref_count == 2, "references dropped");
+    mu_assert(betree_insert(tree, 5, "(i = 1 or i = 2) and b"), "");
+    mu_assert(betree_delete(tree, 2), "");
+    mu_assert(betree_delete(tree, 3), "");
+    betree_report_reset(report);
+    mu_assert(betree_search(tree, "{\"i\": 1, \"b\": true}", report), "");
+    mu_assert(report->matched == 1 && report->subs[0] == 5, "last copy still matches");
+
+    free_report(report);
+    betree_free(tree);
+    return 0;
+}
+
+int test_pred_map_table()
+{
+    struct betree* tree = betree_make_with_parameters(16, 16);
+    add_attr_domain_bounded_i(tree->config, "i", false, 0, 1000);
+
+    // Enough distinct predicates to grow the table several times, every sub repeated once
+    char expr[64];
+    for(size_t id = 0; id < 400; id++) {
+        sprintf(expr, "i = %zu or i = %zu", id % 200, id % 200 + 1);
+        mu_assert(betree_insert(tree, id, expr), "");
+    }
+    // 201 equalities and 200 ors
+    mu_assert(tree->config->pred_map->node_count == 401, "duplicates stored once");
+    mu_assert(tree->config->pred_map->node_count * 2 <= tree->config->pred_map->slot_count, "at most half full");
+
+    for(size_t id = 0; id < 400; id += 2) {
+        mu_assert(betree_delete(tree, id), "");
+    }
+    // Only "i = 0" was left to the even ors
+    mu_assert(tree->config->pred_map->node_count == 300, "even ors erased");
+    for(size_t id = 1; id < 400; id += 2) {
+        if(id % 200 != 7) {
+            mu_assert(betree_delete(tree, id), "");
+        }
+    }
+    mu_assert(tree->config->pred_map->node_count == 3, "unreferenced nodes erased");
+
+    struct report* report = make_report();
+    mu_assert(betree_search(tree, "{\"i\": 8}", report), "");
+    mu_assert(report->matched == 2, "remaining nodes still found");
+    mu_assert(betree_insert(tree, 1000, "i = 8 or i = 7"), "");
+    mu_assert(tree->config->pred_map->node_count == 4, "equalities found after erasures");
+
+    free_report(report);
+    betree_free(tree);
+    return 0;
+}
+
 int all_tests() 
 {
     mu_run_test(test_compare_integer);
@@ -357,7 +494,11 @@ int all_tests()
     mu_run_test(test_special_string);
     mu_run_test(test_bool);
     mu_run_test(test_sub);
+    mu_run_test(test_late_memoize_id);
     mu_run_test(test_bit_logic);
+    mu_run_test(test_memoize_reset);
+    mu_run_test(test_shared_subtrees);
+    mu_run_test(test_pred_map_table);
 
     return 0;
 }
@@ -113,12 +113,85 @@ int test_pdir_split()
     return 0;
 }
 
+static uint64_t search_events_us(struct betree* tree, const char** events, size_t event_count, size_t* matched)
+{
+    struct timespec start, done;
+    struct report* report = make_report();
+    *matched = 0;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    for(size_t i = 0; i < event_count; i++) {
+        betree_report_reset(report);
+        if(!betree_search(tree, events[i], report)) {
+            abort();
+        }
+        *matched += report->matched;
+    }
+    clock_gettime(CLOCK_MONOTONIC_RAW, &done);
+    free_report(report);
+    return (done.tv_sec - start.tv_sec) * 1000000 + (done.tv_nsec - start.tv_nsec) / 1000;
+}
+
+int test_iterative_search()
+{
+    struct betree* tree = betree_make();
+    betree_add_integer_variable(tree, "a", false, 0, COUNT * 10);
+    betree_add_integer_variable(tree, "b", false, 0, COUNT * 10);
+    betree_add_integer_variable(tree, "c", false, 0, COUNT * 10);
+
+    // Ranges of every width on three attributes give deep cdirs under several pnodes
+    srand(27);
+    for(size_t i = 0; i < COUNT * 10; i++) {
+        char* expr;
+        int low = rand() % (COUNT * 10);
+        int width = rand() % 200;
+        if(basprintf(&expr, "%s >= %d and %s <= %d", i % 3 == 0 ? "a" : i % 3 == 1 ? "b" : "c", low,
+               i % 3 == 0 ? "a" : i % 3 == 1 ? "b" : "c", low + width)
+            < 0) {
+            abort();
+        }
+        betree_insert(tree, i + 1, expr);
+        free(expr);
+    }
+
+    enum { event_count = 500 };
+    const char** events = malloc(event_count * sizeof(*events));
+    for(size_t i = 0; i < event_count; i++) {
+        char* event;
+        if(basprintf(&event, "{\"a\": %d, \"b\": %d, \"c\": %d}", rand() % (COUNT * 10),
+               rand() % (COUNT * 10), rand() % (COUNT * 10))
+            < 0) {
+            abort();
+        }
+        events[i] = event;
+    }
+
+    size_t recursive_matched, iterative_matched;
+    betree_set_recursive_search(tree, true);
+    uint64_t recursive_us = search_events_us(tree, events, event_count, &recursive_matched);
+    betree_set_recursive_search(tree, false);
+    uint64_t iterative_us = search_events_us(tree, events, event_count, &iterative_matched);
+
+    mu_assert(recursive_matched == iterative_matched, "Same matches");
+
+    printf("    Recursive search took %" PRIu64 "\n", recursive_us);
+    printf("    Iterative search took %" PRIu64 "\n", iterative_us);
+
+    for(size_t i = 0; i < event_count; i++) {
+        free((char*)events[i]);
+    }
+    free(events);
+    betree_free(tree);
+    return 0;
+}
+
 int all_tests()
 {
     mu_run_test(test_cdir_split);
     printf("\n");
     mu_run_test(test_pdir_split);
     printf("\n");
+    mu_run_test(test_iterative_search);
+    printf("\n");
 
     return 0;
 }
@@ -66,11 +66,43 @@ int test_string()
     return 0;
 }
 
+int test_report_reset()
+{
+    struct betree* tree = betree_make();
+    add_attr_domain_bounded_i(tree->config, "a", false, 0, 100);
+
+    for(size_t i = 0; i < 20; i++) {
+        mu_assert(betree_insert(tree, i, "a > 0"), "");
+    }
+
+    struct report* report = make_report();
+    mu_assert(betree_search(tree, "{\"a\":2}", report), "");
+    mu_assert(report->matched == 20 && report->capacity >= 20, "");
+    betree_sub_t* subs = report->subs;
+    size_t capacity = report->capacity;
+
+    betree_report_reset(report);
+    mu_assert(report->evaluated == 0 && report->matched == 0, "counters reset");
+    mu_assert(report->subs == subs && report->capacity == capacity, "kept the buffer");
+
+    mu_assert(betree_search(tree, "{\"a\":2}", report), "");
+    mu_assert(report->matched == 20 && report->subs == subs, "reused the buffer");
+    for(size_t i = 0; i < report->matched; i++) {
+        mu_assert(report->subs[i] < 20, "valid id");
+    }
+
+    free_report(report);
+    betree_free(tree);
+
+    return 0;
+}
+
 int all_tests()
 {
     mu_run_test(test_integer);
     mu_run_test(test_float);
     mu_run_test(test_string);
+    mu_run_test(test_report_reset);
 
     return 0;
 }
@@ -1,4 +1,5 @@
 #include <inttypes.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -300,6 +301,80 @@ int test_segment()
     return 0;
 }
 
+static int test_many_segments_and_caps()
+{
+    struct betree* tree = betree_make();
+    add_attr_domain_bounded_i(tree->config, "now", false, 0, 1000);
+    add_attr_domain_segments(tree->config, "segments_with_timestamp", false);
+    add_attr_domain_frequency(tree->config, "frequency_caps", false);
+    const struct betree_constant* constants[] = { betree_make_integer_constant("flight_id", 0) };
+    char* expr;
+    // Segment ids 0, 2, 4, ... and flight caps with a value of id % 7 are in the event
+    for(size_t i = 0; i < 40; i++) {
+        if(basprintf(&expr, "segment_within(%zu, 500)", i) < 0) {
+            abort();
+        }
+        betree_insert(tree, i, expr);
+        free(expr);
+        ((struct betree_constant*)constants[0])->value.integer_value = (int64_t)i;
+        if(basprintf(&expr, "within_frequency_cap(\"flight\", \"ns\", 3, 0)") < 0) {
+            abort();
+        }
+        betree_insert_with_constants(tree, 100 + i, 1, constants, expr);
+        free(expr);
+    }
+    char* segments = NULL;
+    char* caps = NULL;
+    // Written out of order so the event has to be sorted
+    for(size_t k = 0; k < 20; k++) {
+        size_t id = ((k * 7) % 20) * 2;
+        char* next;
+        if(basprintf(&next, "%s%s[%zu, %d]", segments == NULL ? "" : segments, segments == NULL ? "" : ", ", id, 900 * 1000 * 1000) < 0) {
+            abort();
+        }
+        free(segments);
+        segments = next;
+    }
+    for(size_t id = 0; id < 30; id++) {
+        char* next;
+        if(basprintf(&next, "%s%s[\"flight\", %zu, \"ns\", %zu, 0]", caps == NULL ? "" : caps, caps == NULL ? "" : ", ", id, id % 7) < 0) {
+            abort();
+        }
+        free(caps);
+        caps = next;
+    }
+    char* event_str;
+    if(basprintf(&event_str, "{\"now\": 1000, \"segments_with_timestamp\": [%s], \"frequency_caps\": [%s]}", segments, caps) < 0) {
+        abort();
+    }
+    struct report* report = make_report();
+    mu_assert(betree_search(tree, event_str, report), "many_search");
+    size_t segment_matches = 0, cap_matches = 0;
+    bool right = true;
+    for(size_t i = 0; i < report->matched; i++) {
+        betree_sub_t id = report->subs[i];
+        if(id < 100) {
+            segment_matches++;
+            right &= id % 2 == 0;
+        }
+        else {
+            cap_matches++;
+            // Flights without a cap are always within
+            right &= id - 100 >= 30 || (id - 100) % 7 < 3;
+        }
+    }
+    mu_assert(right, "many_right_subs");
+    mu_assert(segment_matches == 20, "many_segments");
+    mu_assert(cap_matches == 10 + 14, "many_caps");
+    free(segments);
+    free(caps);
+    free(event_str);
+    free_report(report);
+    betree_free_constant((struct betree_constant*)constants[0]);
+    betree_free(tree);
+    return 0;
+}
+
 static bool geo(bool has_not, const char* latitude, const char* longitude, const char* radius, double latitude_value, double longitude_value)
 {
     struct betree* tree = betree_make();
@@ -348,6 +423,84 @@ int test_geo()
     return 0;
 }
 
+static double geo_distance(double lat1, double lon1, double lat2, double lon2)
+{
+    double to_rad = 3.1415926536 / 180;
+    lon1 -= lon2;
+    lon1 *= to_rad, lat1 *= to_rad, lat2 *= to_rad;
+    double dz = sin(lat1) - sin(lat2);
+    double dx = cos(lon1) * cos(lat1) - cos(lat2);
+    double dy = sin(lon1) * cos(lat1);
+    return asin(sqrt(dx * dx + dy * dy + dz * dz) / 2) * 2 * 6372.8;
+}
+
+static double random_between(double low, double high)
+{
+    return low + (high - low) * ((double)rand() / RAND_MAX);
+}
+
+static bool same_geo(double latitude, double longitude, double radius)
+{
+    struct betree* tree = betree_make();
+    add_attr_domain_f(tree->config, "latitude", false);
+    add_attr_domain_f(tree->config, "longitude", false);
+    char* expr;
+    if(basprintf(&expr, "geo_within_radius(%.9f, %.9f, %.9f)", latitude, longitude, radius) < 0) {
+        abort();
+    }
+    betree_insert(tree, 1, expr);
+    sscanf(expr, "geo_within_radius(%lf, %lf, %lf)", &latitude, &longitude, &radius);
+    bool same = true;
+    for(size_t i = 0; i < 200 && same; i++) {
+        // Mostly close to the center so both sides of the radius get hit
+        double event_latitude = i % 2 == 0 ? random_between(-90, 90)
+                                           : fmax(-90, fmin(90, latitude + random_between(-5, 5)));
+        double event_longitude = i % 2 == 0 ? random_between(-180, 180)
+                                            : longitude + random_between(-5, 5) + (i % 3 == 0 ? 360 : 0);
+        char* event_str;
+        if(basprintf(&event_str, "{\"latitude\": %.9f, \"longitude\": %.9f}", event_latitude, event_longitude) < 0) {
+            abort();
+        }
+        // Parse back what the event holds
+        sscanf(event_str, "{\"latitude\": %lf, \"longitude\": %lf}", &event_latitude, &event_longitude);
+        double distance = geo_distance(latitude, longitude, event_latitude, event_longitude);
+        struct report* report = make_report();
+        if(betree_search(tree, event_str, report) == false) {
+            fprintf(stderr, "Failed to search for event\n");
+            abort();
+        }
+        // Both forms round differently right on the circle
+        if(fabs(distance - radius) >= 1e-6) {
+            same = (report->matched == 1) == (distance <= radius);
+        }
+        free_report(report);
+        free(event_str);
+    }
+    free(expr);
+    betree_free(tree);
+    return same;
+}
+
+int test_geo_prefilter()
+{
+    srand(32);
+    mu_assert(same_geo(45.5, -73.6, 10), "geo_prefilter_city");
+    mu_assert(same_geo(0, 179.9, 300), "geo_prefilter_antimeridian");
+    mu_assert(same_geo(-0.5, -179.5, 100), "geo_prefilter_antimeridian_west");
+    mu_assert(same_geo(89.5, 10, 200), "geo_prefilter_north_pole");
+    mu_assert(same_geo(-88, 120, 500), "geo_prefilter_south_pole");
+    mu_assert(same_geo(10, 10, 0), "geo_prefilter_zero_radius");
+    mu_assert(same_geo(10, 10, 30000), "geo_prefilter_whole_earth");
+    mu_assert(same_geo(10, 10, 9000), "geo_prefilter_wide");
+    for(size_t i = 0; i < 50; i++) {
+        double latitude = random_between(-90, 90);
+        double longitude = random_between(-180, 180);
+        double radius = random_between(0, 2000);
+        mu_assert(same_geo(latitude, longitude, radius), "geo_prefilter_random");
+    }
+    return 0;
+}
+
 static bool contains(bool has_not, const char* attr, bool allow_undefined, const char* pattern, const char* value)
 {
     struct betree* tree = betree_make();
@@ -521,7 +674,9 @@ int all_tests()
 {
     mu_run_test(test_frequency);
     mu_run_test(test_segment);
+    mu_run_test(test_many_segments_and_caps);
     mu_run_test(test_geo);
+    mu_run_test(test_geo_prefilter);
     mu_run_test(test_contains);
     mu_run_test(test_starts_with);
     mu_run_test(test_ends_with);